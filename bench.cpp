@@ -0,0 +1,1497 @@
+/*
+    Yojimbo Benchmarks.
+
+    Copyright © 2016 - 2024, Mas Bandwidth LLC.
+
+    Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+        1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+        2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+           in the documentation and/or other materials provided with the distribution.
+
+        3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+           from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+    INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+    WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+    USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "shared.h"
+#include "netcode.h"
+#include "reliable.h"
+#include <string.h>
+#include <thread>
+
+const int BenchmarkClients = 256;
+const int BenchmarkTicks = 600;
+const double BenchmarkTickRate = 60.0;
+
+static const uint8_t BenchmarkPrivateKey[KeyBytes] = { 0x60, 0x6a, 0xbe, 0x6e, 0xc9, 0x19, 0x10, 0xea, 
+                                                       0x9a, 0x65, 0x62, 0xf6, 0x6f, 0x2b, 0x30, 0xe4, 
+                                                       0x43, 0x71, 0xd6, 0x2c, 0xd1, 0x99, 0x27, 0x26,
+                                                       0x6b, 0x3c, 0x60, 0xf4, 0xb7, 0x15, 0xab, 0xa1 };
+
+// ---------------------------------------------------------------------------------------------------------
+
+struct NetcodeBenchmarkServer
+{
+    netcode_server_t * server;
+    netcode_client_t * client[NETCODE_MAX_CLIENTS];
+    int numClients;
+    double time;
+};
+
+static bool CreateNetcodeBenchmarkServer( NetcodeBenchmarkServer & bench, const netcode_server_config_t & serverConfig, int numClients )
+{
+    yojimbo_assert( numClients <= NETCODE_MAX_CLIENTS );
+
+    memset( &bench, 0, sizeof( bench ) );
+
+    bench.numClients = numClients;
+
+    bench.server = netcode_server_create( "127.0.0.1:40000", &serverConfig, bench.time );
+    if ( !bench.server )
+        return false;
+
+    netcode_server_start( bench.server, numClients );
+
+    const char * serverAddress = "127.0.0.1:40000";
+
+    for ( int i = 0; i < numClients; ++i )
+    {
+        char clientAddress[MaxAddressLength];
+        snprintf( clientAddress, sizeof( clientAddress ), "0.0.0.0:%d", ClientPort + i );
+
+        netcode_client_config_t clientConfig;
+        netcode_default_client_config( &clientConfig );
+
+        bench.client[i] = netcode_client_create( clientAddress, &clientConfig, bench.time );
+        if ( !bench.client[i] )
+            return false;
+
+        uint8_t userData[NETCODE_USER_DATA_BYTES];
+        memset( userData, 0, sizeof( userData ) );
+
+        // tokens ask for whatever cipher suite the server is configured for
+
+        uint8_t connectToken[NETCODE_CONNECT_TOKEN_BYTES];
+        if ( !netcode_generate_connect_token_with_cipher_suite( 1, &serverAddress, &serverAddress, 30, 5, uint64_t( i + 1 ), ProtocolId, BenchmarkPrivateKey, userData, serverConfig.cipher_suite, connectToken ) )
+            return false;
+
+        netcode_client_connect( bench.client[i], connectToken );
+    }
+
+    for ( int iteration = 0; iteration < 1000; ++iteration )
+    {
+        for ( int i = 0; i < numClients; ++i )
+            netcode_client_update( bench.client[i], bench.time );
+
+        netcode_server_update( bench.server, bench.time );
+
+        bench.time += 1.0 / BenchmarkTickRate;
+
+        int numConnected = 0;
+        for ( int i = 0; i < numClients; ++i )
+        {
+            if ( netcode_client_state( bench.client[i] ) == NETCODE_CLIENT_STATE_CONNECTED )
+                numConnected++;
+        }
+
+        if ( numConnected == numClients )
+            return true;
+    }
+
+    return false;
+}
+
+static void DestroyNetcodeBenchmarkServer( NetcodeBenchmarkServer & bench )
+{
+    for ( int i = 0; i < bench.numClients; ++i )
+    {
+        if ( bench.client[i] )
+            netcode_client_destroy( bench.client[i] );
+    }
+
+    if ( bench.server )
+        netcode_server_destroy( bench.server );
+
+    memset( &bench, 0, sizeof( bench ) );
+}
+
+static void DrainNetcodeBenchmarkClients( NetcodeBenchmarkServer & bench )
+{
+    for ( int i = 0; i < bench.numClients; ++i )
+    {
+        netcode_client_update( bench.client[i], bench.time );
+
+        while ( true )
+        {
+            int packetBytes;
+            uint64_t packetSequence;
+            uint8_t * packet = netcode_client_receive_packet( bench.client[i], &packetBytes, &packetSequence );
+            if ( !packet )
+                break;
+            netcode_client_free_packet( bench.client[i], packet );
+        }
+    }
+}
+
+static void DrainNetcodeBenchmarkServer( NetcodeBenchmarkServer & bench )
+{
+    for ( int i = 0; i < bench.numClients; ++i )
+    {
+        while ( true )
+        {
+            int packetBytes;
+            uint64_t packetSequence;
+            uint8_t * packet = netcode_server_receive_packet( bench.server, i, &packetBytes, &packetSequence );
+            if ( !packet )
+                break;
+            netcode_server_free_packet( bench.server, packet );
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+static bool BenchmarkSocketBatching()
+{
+    printf( "socket batching: %d clients, %d ticks, one payload packet each way per client per tick\n\n", BenchmarkClients, BenchmarkTicks );
+
+    uint8_t packetData[NETCODE_MAX_PACKET_SIZE];
+    for ( int i = 0; i < NETCODE_MAX_PACKET_SIZE; ++i )
+        packetData[i] = uint8_t( i );
+
+    for ( int batch = 0; batch <= 1; ++batch )
+    {
+        netcode_server_config_t serverConfig;
+        netcode_default_server_config( &serverConfig );
+        serverConfig.protocol_id = ProtocolId;
+        serverConfig.batch_socket_io = batch;
+        memcpy( serverConfig.private_key, BenchmarkPrivateKey, NETCODE_KEY_BYTES );
+
+        NetcodeBenchmarkServer bench;
+        if ( !CreateNetcodeBenchmarkServer( bench, serverConfig, BenchmarkClients ) )
+        {
+            printf( "error: failed to connect benchmark clients\n" );
+            DestroyNetcodeBenchmarkServer( bench );
+            return false;
+        }
+
+        uint64_t counters[NETCODE_SERVER_NUM_COUNTERS];
+        memcpy( counters, netcode_server_counters( bench.server ), sizeof( counters ) );
+
+        double serverTime = 0.0;
+
+        for ( int tick = 0; tick < BenchmarkTicks; ++tick )
+        {
+            for ( int i = 0; i < bench.numClients; ++i )
+                netcode_client_send_packet( bench.client[i], packetData, sizeof( packetData ) );
+
+            const double start = yojimbo_time();
+
+            netcode_server_update( bench.server, bench.time );
+
+            DrainNetcodeBenchmarkServer( bench );
+
+            for ( int i = 0; i < bench.numClients; ++i )
+                netcode_server_send_packet( bench.server, i, packetData, sizeof( packetData ) );
+
+            netcode_server_flush_packets( bench.server );
+
+            serverTime += yojimbo_time() - start;
+
+            DrainNetcodeBenchmarkClients( bench );
+
+            bench.time += 1.0 / BenchmarkTickRate;
+        }
+
+        const uint64_t * current = netcode_server_counters( bench.server );
+
+        const double sendCalls = double( current[NETCODE_SERVER_COUNTER_NUM_SOCKET_SEND_CALLS] - counters[NETCODE_SERVER_COUNTER_NUM_SOCKET_SEND_CALLS] ) / BenchmarkTicks;
+        const double receiveCalls = double( current[NETCODE_SERVER_COUNTER_NUM_SOCKET_RECEIVE_CALLS] - counters[NETCODE_SERVER_COUNTER_NUM_SOCKET_RECEIVE_CALLS] ) / BenchmarkTicks;
+        const double packetsSent = double( current[NETCODE_SERVER_COUNTER_NUM_PACKETS_SENT] - counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_SENT] ) / BenchmarkTicks;
+        const double packetsReceived = double( current[NETCODE_SERVER_COUNTER_NUM_PACKETS_RECEIVED] - counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_RECEIVED] ) / BenchmarkTicks;
+
+        printf( "    %-10s %7.1f packets sent/tick, %7.1f send syscalls/tick | %7.1f packets received/tick, %7.1f receive syscalls/tick | %8.1f us/tick\n",
+            batch ? "batched" : "unbatched",
+            packetsSent, sendCalls,
+            packetsReceived, receiveCalls,
+            serverTime / BenchmarkTicks * 1000000.0 );
+
+        DestroyNetcodeBenchmarkServer( bench );
+    }
+
+    printf( "\n" );
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+const int IoUringPacketBytes = 100;
+
+static bool BenchmarkIoUring()
+{
+    printf( "io_uring: %d clients, %d ticks at %.0fHz, %d byte payload packets each way\n\n", BenchmarkClients, BenchmarkTicks, BenchmarkTickRate, IoUringPacketBytes );
+
+    uint8_t packetData[IoUringPacketBytes];
+    for ( int i = 0; i < IoUringPacketBytes; ++i )
+        packetData[i] = uint8_t( i );
+
+    const int packetRates[] = { 10000, 50000, 100000 };
+
+    bool fellBack = false;
+
+    for ( int rateIndex = 0; rateIndex < int( sizeof( packetRates ) / sizeof( packetRates[0] ) ); ++rateIndex )
+    {
+        const int packetsPerClientPerTick = int( ( packetRates[rateIndex] / BenchmarkTickRate + BenchmarkClients - 1 ) / BenchmarkClients );
+
+        printf( "    %d packets/sec each way (%d per client per tick)\n", packetsPerClientPerTick * BenchmarkClients * int( BenchmarkTickRate ), packetsPerClientPerTick );
+
+        for ( int backend = 0; backend <= 2; ++backend )
+        {
+            netcode_server_config_t serverConfig;
+            netcode_default_server_config( &serverConfig );
+            serverConfig.protocol_id = ProtocolId;
+            serverConfig.batch_socket_io = backend >= 1;
+            serverConfig.io_uring_socket_io = backend == 2;
+            memcpy( serverConfig.private_key, BenchmarkPrivateKey, NETCODE_KEY_BYTES );
+
+            NetcodeBenchmarkServer bench;
+            if ( !CreateNetcodeBenchmarkServer( bench, serverConfig, BenchmarkClients ) )
+            {
+                printf( "error: failed to connect benchmark clients\n" );
+                DestroyNetcodeBenchmarkServer( bench );
+                return false;
+            }
+
+            const char * backendName = "recvfrom";
+            if ( backend == 1 )
+                backendName = "recvmmsg";
+            if ( backend == 2 )
+            {
+                fellBack = fellBack || !netcode_server_io_uring_active( bench.server );
+                backendName = netcode_server_io_uring_active( bench.server ) ? "io_uring" : "io_uring*";
+            }
+
+            uint64_t counters[NETCODE_SERVER_NUM_COUNTERS];
+            memcpy( counters, netcode_server_counters( bench.server ), sizeof( counters ) );
+
+            double serverTime = 0.0;
+
+            for ( int tick = 0; tick < BenchmarkTicks; ++tick )
+            {
+                for ( int i = 0; i < bench.numClients; ++i )
+                {
+                    for ( int j = 0; j < packetsPerClientPerTick; ++j )
+                        netcode_client_send_packet( bench.client[i], packetData, sizeof( packetData ) );
+                }
+
+                const double start = yojimbo_time();
+
+                netcode_server_update( bench.server, bench.time );
+
+                DrainNetcodeBenchmarkServer( bench );
+
+                for ( int i = 0; i < bench.numClients; ++i )
+                {
+                    for ( int j = 0; j < packetsPerClientPerTick; ++j )
+                        netcode_server_send_packet( bench.server, i, packetData, sizeof( packetData ) );
+                }
+
+                netcode_server_flush_packets( bench.server );
+
+                serverTime += yojimbo_time() - start;
+
+                DrainNetcodeBenchmarkClients( bench );
+
+                bench.time += 1.0 / BenchmarkTickRate;
+            }
+
+            const uint64_t * current = netcode_server_counters( bench.server );
+
+            const double sendCalls = double( current[NETCODE_SERVER_COUNTER_NUM_SOCKET_SEND_CALLS] - counters[NETCODE_SERVER_COUNTER_NUM_SOCKET_SEND_CALLS] ) / BenchmarkTicks;
+            const double receiveCalls = double( current[NETCODE_SERVER_COUNTER_NUM_SOCKET_RECEIVE_CALLS] - counters[NETCODE_SERVER_COUNTER_NUM_SOCKET_RECEIVE_CALLS] ) / BenchmarkTicks;
+            const double packetsReceived = double( current[NETCODE_SERVER_COUNTER_NUM_PACKETS_RECEIVED] - counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_RECEIVED] ) / BenchmarkTicks;
+
+            printf( "        %-10s %7.1f packets received/tick, %6.1f receive syscalls/tick, %6.1f send syscalls/tick | %8.1f us/tick\n",
+                backendName,
+                packetsReceived, receiveCalls, sendCalls,
+                serverTime / BenchmarkTicks * 1000000.0 );
+
+            DestroyNetcodeBenchmarkServer( bench );
+        }
+
+        printf( "\n" );
+    }
+
+    if ( fellBack )
+        printf( "    * io_uring is not available here, so the server fell back to recvmmsg/sendmmsg\n\n" );
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+const int WorkerThreadsMessagesPerTick = 8;
+const int WorkerThreadsMaxReflectedPackets = 16;
+
+class WorkerThreadsBenchmarkAdapter : public TestAdapter
+{
+public:
+
+    // packets the server sends to loopback clients are reflected back at it on the next tick,
+    // so every tick has real packets to receive as well as send
+
+    struct ReflectedPacket
+    {
+        int packetBytes;
+        uint64_t packetSequence;
+        uint8_t packetData[NETCODE_MAX_PACKET_SIZE];
+    };
+
+    ReflectedPacket * packets;
+    int numPackets[BenchmarkClients];
+
+    WorkerThreadsBenchmarkAdapter()
+    {
+        packets = (ReflectedPacket*) malloc( sizeof( ReflectedPacket ) * BenchmarkClients * WorkerThreadsMaxReflectedPackets );
+        memset( numPackets, 0, sizeof( numPackets ) );
+    }
+
+    ~WorkerThreadsBenchmarkAdapter()
+    {
+        free( packets );
+    }
+
+    void ServerSendLoopbackPacket( int clientIndex, const uint8_t * packetData, int packetBytes, uint64_t packetSequence )
+    {
+        if ( numPackets[clientIndex] == WorkerThreadsMaxReflectedPackets )
+            return;
+        ReflectedPacket & packet = packets[clientIndex * WorkerThreadsMaxReflectedPackets + numPackets[clientIndex]++];
+        packet.packetBytes = packetBytes;
+        packet.packetSequence = packetSequence;
+        memcpy( packet.packetData, packetData, packetBytes );
+    }
+
+    void ReflectPackets( Server & server )
+    {
+        for ( int i = 0; i < BenchmarkClients; ++i )
+        {
+            for ( int j = 0; j < numPackets[i]; ++j )
+            {
+                const ReflectedPacket & packet = packets[i * WorkerThreadsMaxReflectedPackets + j];
+                server.ProcessLoopbackPacket( i, packet.packetData, packet.packetBytes, packet.packetSequence );
+            }
+            numPackets[i] = 0;
+        }
+    }
+};
+
+static bool BenchmarkWorkerThreads()
+{
+    const int maxThreads = std::thread::hardware_concurrency() > 0 ? int( std::thread::hardware_concurrency() ) : 1;
+
+    printf( "server worker threads: %d loopback clients, %d ticks, %d messages each way per client per tick, up to %d threads\n\n", 
+        BenchmarkClients, BenchmarkTicks, WorkerThreadsMessagesPerTick, maxThreads );
+
+    double baseTime = 0.0;
+
+    for ( int numThreads = 1; ; numThreads = numThreads * 2 < maxThreads ? numThreads * 2 : maxThreads )
+    {
+        ClientServerConfig config;
+        config.protocolId = ProtocolId;
+        config.networkSimulator = false;
+        config.serverPerClientMemory = 1024 * 1024;
+        config.serverWorkerThreads = numThreads;
+        config.numChannels = 1;
+        config.channel[0].type = CHANNEL_TYPE_UNRELIABLE_UNORDERED;
+
+        WorkerThreadsBenchmarkAdapter benchmarkAdapter;
+
+        double time = 0.0;
+
+        Server server( GetDefaultAllocator(), BenchmarkPrivateKey, Address( "127.0.0.1", ServerPort ), config, benchmarkAdapter, time, NULL );
+
+        server.Start( BenchmarkClients );
+
+        if ( !server.IsRunning() )
+        {
+            printf( "error: failed to start benchmark server\n" );
+            return false;
+        }
+
+        for ( int i = 0; i < BenchmarkClients; ++i )
+        {
+            server.ConnectLoopbackClient( i, uint64_t( i + 1 ), NULL );
+        }
+
+        double serverTime = 0.0;
+        uint16_t sequence = 0;
+
+        for ( int tick = 0; tick < BenchmarkTicks; ++tick )
+        {
+            for ( int i = 0; i < BenchmarkClients; ++i )
+            {
+                for ( int j = 0; j < WorkerThreadsMessagesPerTick; ++j )
+                {
+                    TestMessage * message = (TestMessage*) server.CreateMessage( i, TEST_MESSAGE );
+                    if ( !message )
+                        break;
+                    message->sequence = sequence++;
+                    server.SendMessage( i, 0, message );
+                }
+            }
+
+            benchmarkAdapter.ReflectPackets( server );
+
+            const double start = yojimbo_time();
+
+            server.SendPackets();
+
+            server.ReceivePackets();
+
+            server.AdvanceTime( time );
+
+            serverTime += yojimbo_time() - start;
+
+            for ( int i = 0; i < BenchmarkClients; ++i )
+            {
+                while ( Message * message = server.ReceiveMessage( i, 0 ) )
+                {
+                    server.ReleaseMessage( i, message );
+                }
+            }
+
+            time += 1.0 / BenchmarkTickRate;
+        }
+
+        const double microsecondsPerTick = serverTime / BenchmarkTicks * 1000000.0;
+
+        if ( numThreads == 1 )
+            baseTime = microsecondsPerTick;
+
+        printf( "    %2d threads %8.1f us/tick %5.2fx\n", numThreads, microsecondsPerTick, baseTime / microsecondsPerTick );
+
+        for ( int i = 0; i < BenchmarkClients; ++i )
+        {
+            server.DisconnectLoopbackClient( i );
+        }
+
+        server.Stop();
+
+        if ( numThreads == maxThreads )
+            break;
+    }
+
+    printf( "\n" );
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+static bool BenchmarkBatchEncryption()
+{
+    printf( "batch encryption: %d clients, %d ticks, one payload packet per client per tick, batched socket io\n\n", BenchmarkClients, BenchmarkTicks );
+
+    const int packetSizes[] = { 100, NETCODE_MAX_PACKET_SIZE };
+
+    static uint8_t packetData[NETCODE_MAX_PACKET_SIZE];
+    for ( int i = 0; i < NETCODE_MAX_PACKET_SIZE; ++i )
+        packetData[i] = uint8_t( i );
+
+    int clientIndex[BenchmarkClients];
+    const uint8_t * packets[BenchmarkClients];
+    int packetBytes[BenchmarkClients];
+
+    for ( int sizeIndex = 0; sizeIndex < int( sizeof( packetSizes ) / sizeof( packetSizes[0] ) ); ++sizeIndex )
+    {
+        printf( "    %d byte packets\n", packetSizes[sizeIndex] );
+
+        for ( int batch = 0; batch <= 1; ++batch )
+        {
+            netcode_server_config_t serverConfig;
+            netcode_default_server_config( &serverConfig );
+            serverConfig.protocol_id = ProtocolId;
+            serverConfig.batch_socket_io = 1;
+            memcpy( serverConfig.private_key, BenchmarkPrivateKey, NETCODE_KEY_BYTES );
+
+            NetcodeBenchmarkServer bench;
+            if ( !CreateNetcodeBenchmarkServer( bench, serverConfig, BenchmarkClients ) )
+            {
+                printf( "error: failed to connect benchmark clients\n" );
+                DestroyNetcodeBenchmarkServer( bench );
+                return false;
+            }
+
+            for ( int i = 0; i < bench.numClients; ++i )
+            {
+                clientIndex[i] = i;
+                packets[i] = packetData;
+                packetBytes[i] = packetSizes[sizeIndex];
+            }
+
+            double sendTime = 0.0;
+
+            for ( int tick = 0; tick < BenchmarkTicks; ++tick )
+            {
+                netcode_server_update( bench.server, bench.time );
+
+                DrainNetcodeBenchmarkServer( bench );
+
+                const double start = yojimbo_time();
+
+                if ( batch )
+                {
+                    netcode_server_send_packets_batch( bench.server, clientIndex, packets, packetBytes, bench.numClients );
+                }
+                else
+                {
+                    for ( int i = 0; i < bench.numClients; ++i )
+                        netcode_server_send_packet( bench.server, i, packets[i], packetBytes[i] );
+                }
+
+                netcode_server_flush_packets( bench.server );
+
+                sendTime += yojimbo_time() - start;
+
+                DrainNetcodeBenchmarkClients( bench );
+
+                bench.time += 1.0 / BenchmarkTickRate;
+            }
+
+            const double seconds = sendTime / BenchmarkTicks;
+            const double packetsPerSecond = bench.numClients / seconds;
+
+            printf( "        %-10s %8.1f us/tick to encrypt and send | %6.2f Mpps | %7.1f MB/sec\n",
+                batch ? "batched" : "per packet",
+                seconds * 1000000.0,
+                packetsPerSecond / 1000000.0,
+                packetsPerSecond * packetSizes[sizeIndex] / ( 1024.0 * 1024.0 ) );
+
+            DestroyNetcodeBenchmarkServer( bench );
+        }
+    }
+
+    printf( "\n" );
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+static bool BenchmarkCipherSuites()
+{
+    const int numClients = 64;
+
+    printf( "cipher suites: %d clients, %d ticks, one payload packet each way per client per tick\n\n", numClients, BenchmarkTicks );
+
+    if ( !netcode_cipher_suite_supported( NETCODE_CIPHER_SUITE_AES256_GCM ) )
+    {
+        printf( "    (aes-256-gcm is not supported on this cpu, only chacha20-poly1305 is measured)\n\n" );
+    }
+
+    const int packetSizes[] = { 64, 256, NETCODE_MAX_PACKET_SIZE };
+
+    static uint8_t packetData[NETCODE_MAX_PACKET_SIZE];
+    for ( int i = 0; i < NETCODE_MAX_PACKET_SIZE; ++i )
+        packetData[i] = uint8_t( i );
+
+    for ( int sizeIndex = 0; sizeIndex < int( sizeof( packetSizes ) / sizeof( packetSizes[0] ) ); ++sizeIndex )
+    {
+        printf( "    %d byte packets\n", packetSizes[sizeIndex] );
+
+        for ( int cipherSuite = 0; cipherSuite < NETCODE_NUM_CIPHER_SUITES; ++cipherSuite )
+        {
+            if ( !netcode_cipher_suite_supported( cipherSuite ) )
+                continue;
+
+            netcode_server_config_t serverConfig;
+            netcode_default_server_config( &serverConfig );
+            serverConfig.protocol_id = ProtocolId;
+            serverConfig.cipher_suite = cipherSuite;
+            memcpy( serverConfig.private_key, BenchmarkPrivateKey, NETCODE_KEY_BYTES );
+
+            NetcodeBenchmarkServer bench;
+            if ( !CreateNetcodeBenchmarkServer( bench, serverConfig, numClients ) )
+            {
+                printf( "error: failed to connect benchmark clients\n" );
+                DestroyNetcodeBenchmarkServer( bench );
+                return false;
+            }
+
+            // sends land in the socket send batch, which holds one packet per client, so the send timing is
+            // the encryption. receives go through the whole server update, so socket time is in there as well
+
+            double encryptTime = 0.0;
+            double decryptTime = 0.0;
+
+            for ( int tick = 0; tick < BenchmarkTicks; ++tick )
+            {
+                for ( int i = 0; i < bench.numClients; ++i )
+                    netcode_client_send_packet( bench.client[i], packetData, packetSizes[sizeIndex] );
+
+                double start = yojimbo_time();
+
+                netcode_server_update( bench.server, bench.time );
+
+                decryptTime += yojimbo_time() - start;
+
+                DrainNetcodeBenchmarkServer( bench );
+
+                netcode_server_flush_packets( bench.server );
+
+                start = yojimbo_time();
+
+                for ( int i = 0; i < bench.numClients; ++i )
+                    netcode_server_send_packet( bench.server, i, packetData, packetSizes[sizeIndex] );
+
+                encryptTime += yojimbo_time() - start;
+
+                netcode_server_flush_packets( bench.server );
+
+                DrainNetcodeBenchmarkClients( bench );
+
+                bench.time += 1.0 / BenchmarkTickRate;
+            }
+
+            const double numPackets = double( BenchmarkTicks ) * bench.numClients;
+
+            const char * cipherSuiteNames[NETCODE_NUM_CIPHER_SUITES] = { "chacha20-poly1305", "aes-256-gcm", "integrity only" };
+
+            printf( "        %-18s %7.1f ns/packet to encrypt | %7.1f ns/packet to receive and decrypt\n",
+                cipherSuiteNames[cipherSuite],
+                encryptTime / numPackets * 1000000000.0,
+                decryptTime / numPackets * 1000000000.0 );
+
+            DestroyNetcodeBenchmarkServer( bench );
+        }
+    }
+
+    printf( "\n" );
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+const int HandshakeFloodRequestsPerSecond = 10000;
+const int HandshakeFloodTicks = 120;
+
+const int ConnectionRequestBytes = 1 + 13 + 8 + 8 + 24 + 1024;
+
+static void WriteConnectionRequest( const uint8_t * connectToken, uint8_t * requestData )
+{
+    // connect token: version info, protocol id, create timestamp, expire timestamp, nonce, private data.
+    // connection request: prefix byte, version info, protocol id, expire timestamp, nonce, private data
+
+    const int versionInfoBytes = 13;
+    const int nonceBytes = 24;
+    const int privateBytes = 1024;
+
+    requestData[0] = 0;
+    memcpy( requestData + 1, connectToken, versionInfoBytes + 8 );
+    memcpy( requestData + 1 + versionInfoBytes + 8, connectToken + versionInfoBytes + 8 + 8, 8 + nonceBytes + privateBytes );
+}
+
+static bool BenchmarkHandshakeFlood()
+{
+    const int numClients = 64;
+
+    const int requestsPerTick = int( HandshakeFloodRequestsPerSecond / BenchmarkTickRate );
+
+    printf( "handshake flood: %d clients, %d ticks paced at %.0fHz, %d connection requests/sec (%d per tick)\n\n", 
+        numClients, HandshakeFloodTicks, BenchmarkTickRate, requestsPerTick * int( BenchmarkTickRate ), requestsPerTick );
+
+    uint8_t packetData[256];
+    for ( int i = 0; i < int( sizeof( packetData ) ); ++i )
+        packetData[i] = uint8_t( i );
+
+    // the flood replays one valid connect token from many addresses, so every request costs a full token decrypt
+    // before the replay check throws it away. requests are handed to the server the way a receive override would
+
+    const char * serverAddress = "127.0.0.1:40000";
+
+    uint8_t userData[NETCODE_USER_DATA_BYTES];
+    memset( userData, 0, sizeof( userData ) );
+
+    uint8_t connectToken[NETCODE_CONNECT_TOKEN_BYTES];
+    if ( !netcode_generate_connect_token( 1, &serverAddress, &serverAddress, 300, 5, 0xFFFFFFFFULL, ProtocolId, BenchmarkPrivateKey, userData, connectToken ) )
+        return false;
+
+    uint8_t requestData[ConnectionRequestBytes];
+    WriteConnectionRequest( connectToken, requestData );
+
+    // the first run has no flood, as the baseline for the others. the last caps connection requests at 
+    // 1000/sec, so most of the flood is shed by admission control before it is decrypted
+
+    const int maxConnectionRequestsPerSecond = 1000;
+
+    for ( int mode = 0; mode <= 3; ++mode )
+    {
+        const int floodRequestsPerTick = mode > 0 ? requestsPerTick : 0;
+
+        netcode_server_config_t serverConfig;
+        netcode_default_server_config( &serverConfig );
+        serverConfig.protocol_id = ProtocolId;
+        serverConfig.handshake_thread = mode == 2;
+        serverConfig.max_connection_requests_per_second = mode == 3 ? maxConnectionRequestsPerSecond : 0;
+        memcpy( serverConfig.private_key, BenchmarkPrivateKey, NETCODE_KEY_BYTES );
+
+        NetcodeBenchmarkServer bench;
+        if ( !CreateNetcodeBenchmarkServer( bench, serverConfig, numClients ) )
+        {
+            printf( "error: failed to connect benchmark clients\n" );
+            DestroyNetcodeBenchmarkServer( bench );
+            return false;
+        }
+
+        uint64_t counters[NETCODE_SERVER_NUM_COUNTERS];
+        memcpy( counters, netcode_server_counters( bench.server ), sizeof( counters ) );
+
+        double serverTime = 0.0;
+        double worstTickTime = 0.0;
+        int floodIndex = 0;
+
+        double nextTickTime = yojimbo_time();
+
+        for ( int tick = 0; tick < HandshakeFloodTicks; ++tick )
+        {
+            for ( int i = 0; i < bench.numClients; ++i )
+                netcode_client_send_packet( bench.client[i], packetData, sizeof( packetData ) );
+
+            const double start = yojimbo_time();
+
+            for ( int i = 0; i < floodRequestsPerTick; ++i, ++floodIndex )
+            {
+                netcode_address_t from;
+                memset( &from, 0, sizeof( from ) );
+                from.type = NETCODE_ADDRESS_IPV4;
+                from.data.ipv4[0] = 127;
+                from.data.ipv4[1] = 1;
+                from.data.ipv4[2] = uint8_t( floodIndex >> 8 );
+                from.data.ipv4[3] = uint8_t( floodIndex );
+                from.port = 60000;
+                netcode_server_process_packet( bench.server, &from, requestData, sizeof( requestData ) );
+            }
+
+            netcode_server_update( bench.server, bench.time );
+
+            DrainNetcodeBenchmarkServer( bench );
+
+            for ( int i = 0; i < bench.numClients; ++i )
+                netcode_server_send_packet( bench.server, i, packetData, sizeof( packetData ) );
+
+            netcode_server_flush_packets( bench.server );
+
+            const double tickTime = yojimbo_time() - start;
+
+            serverTime += tickTime;
+
+            if ( tickTime > worstTickTime )
+                worstTickTime = tickTime;
+
+            DrainNetcodeBenchmarkClients( bench );
+
+            bench.time += 1.0 / BenchmarkTickRate;
+
+            // pace the ticks in real time, otherwise the handshake thread sees a much bigger flood than the one asked for
+
+            nextTickTime += 1.0 / BenchmarkTickRate;
+
+            const double sleepTime = nextTickTime - yojimbo_time();
+            if ( sleepTime > 0.0 )
+                yojimbo_sleep( sleepTime );
+        }
+
+        const uint64_t * current = netcode_server_counters( bench.server );
+
+        const double handshakesDropped = double( current[NETCODE_SERVER_COUNTER_NUM_HANDSHAKES_DROPPED] - counters[NETCODE_SERVER_COUNTER_NUM_HANDSHAKES_DROPPED] ) / HandshakeFloodTicks;
+
+        const double requestsRejected = double( current[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_REQUEST_RATE] - counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_REQUEST_RATE] ) / HandshakeFloodTicks;
+
+        const char * modeNames[] = { "no flood", "inline", "handshake thread", "admission control" };
+
+        printf( "    %-18s %8.1f us/tick | %8.1f us worst tick | %6.1f handshakes dropped/tick | %6.1f requests shed/tick | %d/%d clients connected\n",
+            modeNames[mode],
+            serverTime / HandshakeFloodTicks * 1000000.0,
+            worstTickTime * 1000000.0,
+            handshakesDropped,
+            requestsRejected,
+            netcode_server_num_connected_clients( bench.server ), 
+            bench.numClients );
+
+        DestroyNetcodeBenchmarkServer( bench );
+    }
+
+    printf( "\n" );
+
+    return true;
+}
+
+const int JoinStormRequests = 2048;
+
+static bool BenchmarkJoinStorm()
+{
+    printf( "join storm: %d connection requests with distinct tokens, then the same tokens replayed from other addresses\n\n", JoinStormRequests );
+
+    // the server has NETCODE_MAX_CLIENTS slots, so the connect token replay table has 2048 entries and
+    // the storm fills it. every request costs a token decrypt either way, the difference is the replay table
+
+    const char * serverAddress = "127.0.0.1:40000";
+
+    uint8_t userData[NETCODE_USER_DATA_BYTES];
+    memset( userData, 0, sizeof( userData ) );
+
+    uint8_t * requestData = (uint8_t*) malloc( size_t( JoinStormRequests ) * ConnectionRequestBytes );
+    if ( !requestData )
+        return false;
+
+    for ( int i = 0; i < JoinStormRequests; ++i )
+    {
+        uint8_t connectToken[NETCODE_CONNECT_TOKEN_BYTES];
+        if ( !netcode_generate_connect_token( 1, &serverAddress, &serverAddress, 300, 5, uint64_t( i + 1 ), ProtocolId, BenchmarkPrivateKey, userData, connectToken ) )
+        {
+            free( requestData );
+            return false;
+        }
+
+        WriteConnectionRequest( connectToken, requestData + i * ConnectionRequestBytes );
+    }
+
+    for ( int scan = 1; scan >= 0; --scan )
+    {
+        netcode_server_config_t serverConfig;
+        netcode_default_server_config( &serverConfig );
+        serverConfig.protocol_id = ProtocolId;
+        serverConfig.connect_token_scan = scan;
+        memcpy( serverConfig.private_key, BenchmarkPrivateKey, NETCODE_KEY_BYTES );
+
+        netcode_server_t * server = netcode_server_create( serverAddress, &serverConfig, 0.0 );
+        if ( !server )
+        {
+            free( requestData );
+            return false;
+        }
+
+        netcode_server_start( server, NETCODE_MAX_CLIENTS );
+
+        uint8_t packetData[ConnectionRequestBytes];
+
+        double phaseTime[2];
+
+        for ( int phase = 0; phase < 2; ++phase )
+        {
+            const double start = yojimbo_time();
+
+            for ( int i = 0; i < JoinStormRequests; ++i )
+            {
+                netcode_address_t from;
+                memset( &from, 0, sizeof( from ) );
+                from.type = NETCODE_ADDRESS_IPV4;
+                from.data.ipv4[0] = 127;
+                from.data.ipv4[1] = uint8_t( 1 + phase );
+                from.data.ipv4[2] = uint8_t( i >> 8 );
+                from.data.ipv4[3] = uint8_t( i );
+                from.port = 60000;
+                // tokens are decrypted in place, so each request is read from a copy
+
+                memcpy( packetData, requestData + i * ConnectionRequestBytes, ConnectionRequestBytes );
+                netcode_server_process_packet( server, &from, packetData, ConnectionRequestBytes );
+            }
+
+            phaseTime[phase] = yojimbo_time() - start;
+
+            netcode_server_flush_packets( server );
+        }
+
+        printf( "    %-10s %6.2f us/request new | %6.2f us/request replayed\n",
+            scan ? "scan" : "hash index",
+            phaseTime[0] / JoinStormRequests * 1000000.0,
+            phaseTime[1] / JoinStormRequests * 1000000.0 );
+
+        netcode_server_destroy( server );
+    }
+
+    printf( "\n" );
+
+    free( requestData );
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+const int HandshakeLatencyTrials = 500;
+const int LossyLinkMaxPackets = 256;
+const int LossyLinkMaxPacketBytes = 1500;
+const double LossyLinkLatency = 0.025;
+
+struct LossyLinkPacket
+{
+    double deliveryTime;
+    bool toServer;
+    int packetBytes;
+    uint8_t packetData[LossyLinkMaxPacketBytes];
+};
+
+struct LossyLink
+{
+    double time;
+    float packetLoss;
+    uint32_t random;
+    netcode_address_t clientAddress;
+    netcode_address_t serverAddress;
+    int numPackets;
+    LossyLinkPacket packets[LossyLinkMaxPackets];
+};
+
+static bool LossyLinkDropPacket( LossyLink & link )
+{
+    // xorshift, so both handshake modes see the same loss pattern for the same seed
+
+    link.random ^= link.random << 13;
+    link.random ^= link.random >> 17;
+    link.random ^= link.random << 5;
+    return ( link.random % 10000 ) < uint32_t( link.packetLoss * 10000.0f );
+}
+
+static void LossyLinkSend( LossyLink & link, bool toServer, const uint8_t * packetData, int packetBytes )
+{
+    if ( LossyLinkDropPacket( link ) || link.numPackets == LossyLinkMaxPackets || packetBytes > LossyLinkMaxPacketBytes )
+        return;
+
+    LossyLinkPacket & packet = link.packets[link.numPackets++];
+    packet.deliveryTime = link.time + LossyLinkLatency;
+    packet.toServer = toServer;
+    packet.packetBytes = packetBytes;
+    memcpy( packet.packetData, packetData, packetBytes );
+}
+
+static int LossyLinkReceive( LossyLink & link, bool toServer, netcode_address_t * from, uint8_t * packetData, int maxPacketBytes )
+{
+    for ( int i = 0; i < link.numPackets; ++i )
+    {
+        LossyLinkPacket & packet = link.packets[i];
+
+        if ( packet.toServer != toServer || packet.deliveryTime > link.time || packet.packetBytes > maxPacketBytes )
+            continue;
+
+        const int packetBytes = packet.packetBytes;
+        memcpy( packetData, packet.packetData, packetBytes );
+        *from = toServer ? link.clientAddress : link.serverAddress;
+
+        link.packets[i] = link.packets[--link.numPackets];
+
+        return packetBytes;
+    }
+
+    return 0;
+}
+
+static void LossyLinkClientSend( void * context, netcode_address_t *, const uint8_t * packetData, int packetBytes )
+{
+    LossyLinkSend( *(LossyLink*) context, true, packetData, packetBytes );
+}
+
+static int LossyLinkClientReceive( void * context, netcode_address_t * from, uint8_t * packetData, int maxPacketBytes )
+{
+    return LossyLinkReceive( *(LossyLink*) context, false, from, packetData, maxPacketBytes );
+}
+
+static void LossyLinkServerSend( void * context, netcode_address_t *, const uint8_t * packetData, int packetBytes )
+{
+    LossyLinkSend( *(LossyLink*) context, false, packetData, packetBytes );
+}
+
+static int LossyLinkServerReceive( void * context, netcode_address_t * from, uint8_t * packetData, int maxPacketBytes )
+{
+    return LossyLinkReceive( *(LossyLink*) context, true, from, packetData, maxPacketBytes );
+}
+
+static bool HandshakeLatencyTrial( LossyLink & link, int adaptiveHandshake, double & connectTime, double & firstPayloadTime )
+{
+    const char * serverAddress = "127.0.0.1:40000";
+
+    link.time = 0.0;
+    link.numPackets = 0;
+    netcode_parse_address( "127.0.0.1:50000", &link.clientAddress );
+    netcode_parse_address( serverAddress, &link.serverAddress );
+
+    netcode_server_config_t serverConfig;
+    netcode_default_server_config( &serverConfig );
+    serverConfig.protocol_id = ProtocolId;
+    serverConfig.adaptive_handshake = adaptiveHandshake;
+    serverConfig.callback_context = &link;
+    serverConfig.override_send_and_receive = 1;
+    serverConfig.send_packet_override = LossyLinkServerSend;
+    serverConfig.receive_packet_override = LossyLinkServerReceive;
+    memcpy( serverConfig.private_key, BenchmarkPrivateKey, NETCODE_KEY_BYTES );
+
+    netcode_server_t * server = netcode_server_create( serverAddress, &serverConfig, link.time );
+    if ( !server )
+        return false;
+
+    netcode_server_start( server, 1 );
+
+    netcode_client_config_t clientConfig;
+    netcode_default_client_config( &clientConfig );
+    clientConfig.adaptive_handshake = adaptiveHandshake;
+    clientConfig.callback_context = &link;
+    clientConfig.override_send_and_receive = 1;
+    clientConfig.send_packet_override = LossyLinkClientSend;
+    clientConfig.receive_packet_override = LossyLinkClientReceive;
+
+    netcode_client_t * client = netcode_client_create( "127.0.0.1:50000", &clientConfig, link.time );
+    if ( !client )
+    {
+        netcode_server_destroy( server );
+        return false;
+    }
+
+    uint8_t userData[NETCODE_USER_DATA_BYTES];
+    memset( userData, 0, sizeof( userData ) );
+
+    uint8_t connectToken[NETCODE_CONNECT_TOKEN_BYTES];
+    if ( !netcode_generate_connect_token( 1, &serverAddress, &serverAddress, 30, 5, 1, ProtocolId, BenchmarkPrivateKey, userData, connectToken ) )
+    {
+        netcode_client_destroy( client );
+        netcode_server_destroy( server );
+        return false;
+    }
+
+    netcode_client_connect( client, connectToken );
+
+    // the server sends a payload every millisecond once it has the client, the way a game sends its first snapshot
+
+    uint8_t payload[100];
+    memset( payload, 0, sizeof( payload ) );
+
+    connectTime = -1.0;
+    firstPayloadTime = -1.0;
+
+    while ( link.time < 4.0 && netcode_client_state( client ) > NETCODE_CLIENT_STATE_DISCONNECTED )
+    {
+        netcode_client_update( client, link.time );
+
+        netcode_server_update( server, link.time );
+
+        if ( connectTime < 0.0 && netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+            connectTime = link.time;
+
+        int packetBytes;
+        uint64_t packetSequence;
+        uint8_t * packet = netcode_client_receive_packet( client, &packetBytes, &packetSequence );
+        if ( packet )
+        {
+            netcode_client_free_packet( client, packet );
+            firstPayloadTime = link.time;
+            break;
+        }
+
+        if ( netcode_server_client_connected( server, 0 ) )
+            netcode_server_send_packet( server, 0, payload, sizeof( payload ) );
+
+        link.time += 0.001;
+    }
+
+    netcode_client_destroy( client );
+    netcode_server_destroy( server );
+
+    return true;
+}
+
+static int CompareDoubles( const void * a, const void * b )
+{
+    const double x = *(const double*) a;
+    const double y = *(const double*) b;
+    return ( x > y ) - ( x < y );
+}
+
+static bool BenchmarkHandshakeLatency()
+{
+    printf( "handshake latency: %d connects per loss rate over a %dms one way link, time until connected and until the first payload\n\n", 
+        HandshakeLatencyTrials, int( LossyLinkLatency * 1000.0 ) );
+
+    static LossyLink link;
+
+    double * connectTimes = (double*) malloc( sizeof( double ) * HandshakeLatencyTrials );
+    double * payloadTimes = (double*) malloc( sizeof( double ) * HandshakeLatencyTrials );
+    if ( !connectTimes || !payloadTimes )
+    {
+        free( connectTimes );
+        free( payloadTimes );
+        return false;
+    }
+
+    const float packetLoss[] = { 0.0f, 0.1f, 0.2f, 0.3f };
+
+    for ( int i = 0; i < int( sizeof( packetLoss ) / sizeof( packetLoss[0] ) ); ++i )
+    {
+        for ( int adaptive = 0; adaptive <= 1; ++adaptive )
+        {
+            link.packetLoss = packetLoss[i];
+            link.random = 0x9e3779b9u + uint32_t( i );
+
+            int numConnected = 0;
+            double connectSum = 0.0;
+            double payloadSum = 0.0;
+
+            for ( int trial = 0; trial < HandshakeLatencyTrials; ++trial )
+            {
+                double connectTime, firstPayloadTime;
+                if ( !HandshakeLatencyTrial( link, adaptive, connectTime, firstPayloadTime ) )
+                {
+                    free( connectTimes );
+                    free( payloadTimes );
+                    return false;
+                }
+
+                if ( firstPayloadTime < 0.0 )
+                    continue;
+
+                connectTimes[numConnected] = connectTime;
+                payloadTimes[numConnected] = firstPayloadTime;
+                connectSum += connectTime;
+                payloadSum += firstPayloadTime;
+                numConnected++;
+            }
+
+            if ( numConnected == 0 )
+                continue;
+
+            qsort( connectTimes, numConnected, sizeof( double ), CompareDoubles );
+            qsort( payloadTimes, numConnected, sizeof( double ), CompareDoubles );
+
+            const int p95 = ( numConnected * 95 ) / 100;
+
+            printf( "    %2d%% loss %-9s connect mean %6.1fms p95 %6.1fms | first payload mean %6.1fms p95 %6.1fms | %d/%d connected\n",
+                int( packetLoss[i] * 100.0f + 0.5f ),
+                adaptive ? "adaptive" : "classic",
+                connectSum / numConnected * 1000.0, connectTimes[p95] * 1000.0,
+                payloadSum / numConnected * 1000.0, payloadTimes[p95] * 1000.0,
+                numConnected, HandshakeLatencyTrials );
+        }
+    }
+
+    printf( "\n" );
+
+    free( connectTimes );
+    free( payloadTimes );
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+struct ReliableBenchmarkPair
+{
+    reliable_endpoint_t * endpoint[2];
+    uint32_t random;
+};
+
+static void ReliableBenchmarkTransmitPacket( void * context, uint64_t id, uint16_t, uint8_t * packetData, int packetBytes )
+{
+    // loses about 5% of packets, so the loss and acked bandwidth stats have something to measure
+
+    ReliableBenchmarkPair * pair = (ReliableBenchmarkPair*) context;
+    pair->random = pair->random * 1664525u + 1013904223u;
+    if ( ( pair->random >> 8 ) % 20 == 0 )
+        return;
+    reliable_endpoint_receive_packet( pair->endpoint[id ^ 1], packetData, packetBytes );
+}
+
+static int ReliableBenchmarkProcessPacket( void *, uint64_t, uint16_t, uint8_t *, int )
+{
+    return 1;
+}
+
+static bool BenchmarkReliableUpdate()
+{
+    printf( "reliable update: %d clients, %d ticks, one packet each way per client per tick, cost of reliable_endpoint_update on the server side\n\n", BenchmarkClients, BenchmarkTicks );
+
+    const int bufferSizes[] = { 256, 1024, 4096 };
+
+    uint8_t packetData[100];
+    memset( packetData, 0, sizeof( packetData ) );
+
+    ReliableBenchmarkPair * pairs = (ReliableBenchmarkPair*) malloc( sizeof( ReliableBenchmarkPair ) * BenchmarkClients );
+    if ( !pairs )
+        return false;
+
+    for ( int sizeIndex = 0; sizeIndex < int( sizeof( bufferSizes ) / sizeof( bufferSizes[0] ) ); ++sizeIndex )
+    {
+        double time = 100.0;
+
+        for ( int i = 0; i < BenchmarkClients; ++i )
+        {
+            pairs[i].random = 0x9e3779b9u + uint32_t( i );
+
+            for ( int j = 0; j < 2; ++j )
+            {
+                reliable_config_t config;
+                reliable_default_config( &config );
+                config.context = &pairs[i];
+                config.id = j;
+                config.sent_packets_buffer_size = bufferSizes[sizeIndex];
+                config.received_packets_buffer_size = bufferSizes[sizeIndex];
+                config.transmit_packet_function = ReliableBenchmarkTransmitPacket;
+                config.process_packet_function = ReliableBenchmarkProcessPacket;
+                pairs[i].endpoint[j] = reliable_endpoint_create( &config, time );
+            }
+        }
+
+        double updateTime = 0.0;
+        float packetLoss = 0.0f;
+
+        // fill the buffers before measuring, so every update samples a full window
+
+        const int warmupTicks = bufferSizes[sizeIndex];
+
+        for ( int tick = 0; tick < warmupTicks + BenchmarkTicks; ++tick )
+        {
+            for ( int i = 0; i < BenchmarkClients; ++i )
+            {
+                reliable_endpoint_send_packet( pairs[i].endpoint[0], packetData, sizeof( packetData ) );
+                reliable_endpoint_send_packet( pairs[i].endpoint[1], packetData, sizeof( packetData ) );
+                reliable_endpoint_update( pairs[i].endpoint[1], time );
+                reliable_endpoint_clear_acks( pairs[i].endpoint[0] );
+                reliable_endpoint_clear_acks( pairs[i].endpoint[1] );
+            }
+
+            const double start = yojimbo_time();
+
+            for ( int i = 0; i < BenchmarkClients; ++i )
+                reliable_endpoint_update( pairs[i].endpoint[0], time );
+
+            if ( tick >= warmupTicks )
+                updateTime += yojimbo_time() - start;
+
+            time += 1.0 / BenchmarkTickRate;
+        }
+
+        for ( int i = 0; i < BenchmarkClients; ++i )
+        {
+            packetLoss += reliable_endpoint_packet_loss( pairs[i].endpoint[0] );
+            reliable_endpoint_destroy( pairs[i].endpoint[0] );
+            reliable_endpoint_destroy( pairs[i].endpoint[1] );
+        }
+
+        printf( "    %5d entry buffers %8.1f us/tick | %6.1f ns per endpoint update | %4.1f%% packet loss measured\n",
+            bufferSizes[sizeIndex],
+            updateTime / BenchmarkTicks * 1000000.0,
+            updateTime / BenchmarkTicks / BenchmarkClients * 1000000000.0,
+            packetLoss / BenchmarkClients );
+    }
+
+    printf( "\n" );
+
+    free( pairs );
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+const double CongestionLinkLatency = 0.02;
+const double CongestionSeconds = 30.0;
+const double CongestionMeasureSeconds = 10.0;
+const int CongestionSimulatorPackets = 4 * 1024;
+
+struct CongestionBenchmarkPair
+{
+    reliable_endpoint_t * endpoint[2];
+    NetworkSimulator * simulator[2];
+    double time;
+    uint64_t receivedBytes;
+};
+
+static void CongestionBenchmarkTransmitPacket( void * context, uint64_t id, uint16_t, uint8_t * packetData, int packetBytes )
+{
+    CongestionBenchmarkPair * pair = (CongestionBenchmarkPair*) context;
+    pair->simulator[id]->SendPacket( int( id ^ 1 ), packetData, packetBytes );
+}
+
+static int CongestionBenchmarkProcessPacket( void * context, uint64_t id, uint16_t, uint8_t *, int packetBytes )
+{
+    CongestionBenchmarkPair * pair = (CongestionBenchmarkPair*) context;
+    if ( id == 1 && pair->time >= 100.0 + CongestionMeasureSeconds )
+        pair->receivedBytes += packetBytes;
+    return 1;
+}
+
+static void CongestionBenchmarkDeliverPackets( CongestionBenchmarkPair & pair, NetworkSimulator & simulator )
+{
+    static uint8_t * packetData[CongestionSimulatorPackets];
+    static int packetBytes[CongestionSimulatorPackets];
+    static int to[CongestionSimulatorPackets];
+    simulator.AdvanceTime( pair.time );
+    const int numPackets = simulator.ReceivePackets( CongestionSimulatorPackets, packetData, packetBytes, to );
+    for ( int i = 0; i < numPackets; ++i )
+    {
+        reliable_endpoint_receive_packet( pair.endpoint[to[i]], packetData[i], packetBytes[i] );
+        YOJIMBO_FREE( simulator.GetAllocator(), packetData[i] );
+    }
+}
+
+static bool BenchmarkCongestionControl()
+{
+    printf( "congestion control: one sender wanting 4mbps through a bottleneck with %dms latency each way and a 250ms drop tail queue, steady state over the last %ds\n\n",
+        int( CongestionLinkLatency * 1000.0 ), int( CongestionSeconds - CongestionMeasureSeconds ) );
+
+    const float bandwidth[] = { 1000.0f, 2000.0f };
+
+    uint8_t packetData[8000];
+    memset( packetData, 0, sizeof( packetData ) );
+
+    for ( int i = 0; i < int( sizeof( bandwidth ) / sizeof( bandwidth[0] ) ); ++i )
+    {
+        for ( int congestionControl = 0; congestionControl <= 1; ++congestionControl )
+        {
+            CongestionBenchmarkPair pair;
+            memset( &pair, 0, sizeof( pair ) );
+            pair.time = 100.0;
+
+            for ( int j = 0; j < 2; ++j )
+            {
+                pair.simulator[j] = YOJIMBO_NEW( GetDefaultAllocator(), NetworkSimulator, GetDefaultAllocator(), CongestionSimulatorPackets, pair.time );
+                pair.simulator[j]->SetLatency( float( CongestionLinkLatency * 1000.0 ) );
+
+                reliable_config_t config;
+                reliable_default_config( &config );
+                config.context = &pair;
+                config.id = j;
+                config.congestion_control = j == 0 ? congestionControl : 0;
+                config.transmit_packet_function = CongestionBenchmarkTransmitPacket;
+                config.process_packet_function = CongestionBenchmarkProcessPacket;
+                pair.endpoint[j] = reliable_endpoint_create( &config, pair.time );
+            }
+
+            pair.simulator[0]->SetBandwidth( bandwidth[i] );
+
+            // 1ms steps, with each side sending at 60HZ. the sender fills whatever the send budget allows
+
+            const int numSteps = int( CongestionSeconds * 1000.0 );
+
+            for ( int step = 0; step < numSteps; ++step )
+            {
+                pair.time += 0.001;
+
+                CongestionBenchmarkDeliverPackets( pair, *pair.simulator[0] );
+                CongestionBenchmarkDeliverPackets( pair, *pair.simulator[1] );
+
+                if ( step % 16 == 0 )
+                {
+                    const int packetBytes = yojimbo_min( reliable_endpoint_send_budget( pair.endpoint[0] ), int( sizeof( packetData ) ) );
+                    if ( packetBytes > 0 )
+                    {
+                        reliable_endpoint_send_packet( pair.endpoint[0], packetData, packetBytes );
+                    }
+                    reliable_endpoint_send_packet( pair.endpoint[1], packetData, 32 );
+                }
+
+                for ( int j = 0; j < 2; ++j )
+                {
+                    reliable_endpoint_update( pair.endpoint[j], pair.time );
+                    reliable_endpoint_clear_acks( pair.endpoint[j] );
+                }
+            }
+
+            float rttP50, rttP95, rttP99;
+            reliable_endpoint_rtt_percentiles( pair.endpoint[0], &rttP50, &rttP95, &rttP99 );
+
+            const double goodput = pair.receivedBytes * 8.0 / 1000.0 / ( CongestionSeconds - CongestionMeasureSeconds );
+
+            printf( "    %5.0fkbps link %-12s goodput %7.1fkbps (%5.1f%%) | rtt p50 %6.1fms p95 %6.1fms p99 %6.1fms | %4.1f%% packet loss\n",
+                bandwidth[i],
+                congestionControl ? "controlled" : "uncontrolled",
+                goodput, goodput / bandwidth[i] * 100.0,
+                rttP50, rttP95, rttP99,
+                reliable_endpoint_packet_loss( pair.endpoint[0] ) );
+
+            for ( int j = 0; j < 2; ++j )
+            {
+                reliable_endpoint_destroy( pair.endpoint[j] );
+                YOJIMBO_DELETE( GetDefaultAllocator(), NetworkSimulator, pair.simulator[j] );
+            }
+        }
+    }
+
+    printf( "\n" );
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+struct Benchmark
+{
+    const char * name;
+    bool (*function)();
+};
+
+static Benchmark benchmarks[] = 
+{
+    { "socket_batching", BenchmarkSocketBatching },
+    { "io_uring", BenchmarkIoUring },
+    { "worker_threads", BenchmarkWorkerThreads },
+    { "batch_encryption", BenchmarkBatchEncryption },
+    { "cipher_suites", BenchmarkCipherSuites },
+    { "handshake_flood", BenchmarkHandshakeFlood },
+    { "join_storm", BenchmarkJoinStorm },
+    { "handshake_latency", BenchmarkHandshakeLatency },
+    { "reliable_update", BenchmarkReliableUpdate },
+    { "congestion_control", BenchmarkCongestionControl },
+};
+
+int main( int argc, char * argv[] )
+{
+    printf( "\nbench\n\n" );
+
+    if ( !InitializeYojimbo() )
+    {
+        printf( "error: failed to initialize Yojimbo!\n" );
+        return 1;
+    }
+
+    yojimbo_log_level( YOJIMBO_LOG_LEVEL_NONE );
+
+    srand( (unsigned int) time( NULL ) );
+
+    const int numBenchmarks = sizeof( benchmarks ) / sizeof( benchmarks[0] );
+
+    int result = 0;
+    int numBenchmarksRun = 0;
+
+    for ( int i = 0; i < numBenchmarks; ++i )
+    {
+        if ( argc > 1 && strcmp( argv[1], benchmarks[i].name ) != 0 )
+            continue;
+
+        if ( !benchmarks[i].function() )
+            result = 1;
+
+        numBenchmarksRun++;
+    }
+
+    if ( numBenchmarksRun == 0 )
+    {
+        printf( "error: unknown benchmark '%s'. available benchmarks:\n\n", argv[1] );
+        for ( int i = 0; i < numBenchmarks; ++i )
+            printf( "    %s\n", benchmarks[i].name );
+        printf( "\n" );
+        result = 1;
+    }
+
+    ShutdownYojimbo();
+
+    return result;
+}
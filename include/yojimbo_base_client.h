@@ -103,7 +103,7 @@ namespace yojimbo
 
     protected:
 
-        uint8_t * GetPacketBuffer() { return m_packetBuffer; }
+        uint8_t * GetPacketBuffer() { return m_packetBuffer + PacketHeadroomBytes; }
 
         void * GetContext() { return m_context; }
 
@@ -127,10 +127,14 @@ namespace yojimbo
 
         virtual void TransmitPacketFunction( uint16_t packetSequence, uint8_t * packetData, int packetBytes ) = 0;
 
+        virtual void TransmitPacketInPlaceFunction( uint16_t packetSequence, uint8_t * packetData, int packetBytes );
+
         virtual int ProcessPacketFunction( uint16_t packetSequence, uint8_t * packetData, int packetBytes ) = 0;
 
         static void StaticTransmitPacketFunction( void * context, uint64_t index, uint16_t packetSequence, uint8_t * packetData, int packetBytes );
 
+        static void StaticTransmitPacketInPlaceFunction( void * context, uint64_t index, uint16_t packetSequence, uint8_t * packetData, int packetBytes );
+
         static int StaticProcessPacketFunction( void * context, uint64_t index, uint16_t packetSequence, uint8_t * packetData, int packetBytes );
 
         static void * StaticAllocateFunction( void * context, size_t bytes );
@@ -156,7 +160,7 @@ namespace yojimbo
         ClientState m_clientState;                                          ///< The current client state. See ClientInterface::GetClientState
         int m_clientIndex;                                                  ///< The client slot index on the server [0,maxClients-1]. -1 if not connected.
         double m_time;                                                      ///< The current client time. See ClientInterface::AdvanceTime
-        uint8_t * m_packetBuffer;                                           ///< Buffer used to read and write packets.
+        uint8_t * m_packetBuffer;                                           ///< Buffer used to read and write packets. Packets are written after PacketHeadroomBytes so headers can be prepended in place.
 
     private:
 
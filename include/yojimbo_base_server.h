@@ -89,7 +89,21 @@ namespace yojimbo
 
     protected:
 
-        uint8_t * GetPacketBuffer() { return m_packetBuffer; }
+        uint8_t * GetPacketBuffer() { return m_packetBuffer + PacketHeadroomBytes; }
+
+        bool IsProcessingClientsInParallel() const { return m_workerPool != NULL; }
+
+        int GetNumShards() const { return m_numShards; }
+
+        void GetShardClients( int shardIndex, int & firstClientIndex, int & endClientIndex ) const;
+
+        uint8_t * GetShardPacketBuffer( int shardIndex );
+
+        void RunShards( void (*function)( void * context, int shardIndex ), void * context );
+
+        void BeginStagingTransmits();
+
+        void EndStagingTransmits();
 
         void * GetContext() { return m_context; }
 
@@ -107,10 +121,26 @@ namespace yojimbo
 
         virtual void TransmitPacketFunction( int clientIndex, uint16_t packetSequence, uint8_t * packetData, int packetBytes ) = 0;
 
+        virtual void TransmitPacketsFunction( int clientIndex, uint16_t packetSequence, uint8_t ** packetData, int * packetBytes, int numPackets );
+
+        virtual void TransmitPacketInPlaceFunction( int clientIndex, uint16_t packetSequence, uint8_t * packetData, int packetBytes );
+
+        virtual void TransmitStagedPacketsFunction( const int * clientIndex, const uint16_t * packetSequence, uint8_t ** packetData, const int * packetBytes, int numPackets );
+
         virtual int ProcessPacketFunction( int clientIndex, uint16_t packetSequence, uint8_t * packetData, int packetBytes ) = 0;
 
+        void AdvanceTimeShard( int shardIndex );
+
+        void StageTransmit( int clientIndex, uint16_t packetSequence, const uint8_t * packetData, int packetBytes );
+
+        static void StaticAdvanceTimeShard( void * context, int shardIndex );
+
         static void StaticTransmitPacketFunction( void * context, uint64_t index, uint16_t packetSequence, uint8_t * packetData, int packetBytes );
 
+        static void StaticTransmitPacketsFunction( void * context, uint64_t index, uint16_t packetSequence, uint8_t ** packetData, int * packetBytes, int numPackets );
+
+        static void StaticTransmitPacketInPlaceFunction( void * context, uint64_t index, uint16_t packetSequence, uint8_t * packetData, int packetBytes );
+
         static int StaticProcessPacketFunction( void * context, uint64_t index, uint16_t packetSequence, uint8_t * packetData, int packetBytes );
 
         static void * StaticAllocateFunction( void * context, size_t bytes );
@@ -131,14 +161,19 @@ namespace yojimbo
         bool m_running;                                             ///< True if server is currently running, eg. after "Start" is called, before "Stop".
         double m_time;                                              ///< Current server time in seconds.
         uint8_t * m_globalMemory;                                   ///< The block of memory backing the global allocator. Allocated with m_allocator.
-        uint8_t * m_clientMemory[MaxClients];                       ///< The block of memory backing the per-client allocators. Allocated with m_allocator.
+        uint8_t ** m_clientMemory;                                  ///< Array of blocks of memory backing the per-client allocators. Sized to max clients in Start. Allocated with m_allocator.
         Allocator * m_globalAllocator;                              ///< The global allocator. Used for allocations that don't belong to a specific client.
-        Allocator * m_clientAllocator[MaxClients];                  ///< Array of per-client allocator. These are used for allocations related to connected clients.
-        MessageFactory * m_clientMessageFactory[MaxClients];        ///< Array of per-client message factories. This silos message allocations per-client slot.
-        Connection * m_clientConnection[MaxClients];                ///< Array of per-client connection classes. This is how messages are exchanged with clients.
-        reliable_endpoint_t * m_clientEndpoint[MaxClients];         ///< Array of per-client reliable endpoints.
+        Allocator ** m_clientAllocator;                             ///< Array of per-client allocator. These are used for allocations related to connected clients.
+        MessageFactory ** m_clientMessageFactory;                   ///< Array of per-client message factories. This silos message allocations per-client slot.
+        Connection ** m_clientConnection;                           ///< Array of per-client connection classes. This is how messages are exchanged with clients.
+        reliable_endpoint_t ** m_clientEndpoint;                    ///< Array of per-client reliable endpoints.
         NetworkSimulator * m_networkSimulator;                      ///< The network simulator used to simulate packet loss, latency, jitter etc. Optional.
-        uint8_t * m_packetBuffer;                                   ///< Buffer used when writing packets.
+        uint8_t * m_packetBuffer;                                   ///< Buffer used when writing packets. Packets are written after PacketHeadroomBytes so headers can be prepended in place.
+        class WorkerPool * m_workerPool;                            ///< Worker pool used to process shards of clients in parallel. NULL unless config.serverWorkerThreads > 1.
+        int m_numShards;                                            ///< Number of contiguous client ranges that are processed independently. 1 when processing clients serially.
+        int m_clientsPerShard;                                      ///< Number of clients in each shard. The last shard may have fewer.
+        struct ServerShard * m_shards;                              ///< Per-shard packet buffers and staged transmits. Allocated with m_allocator.
+        bool m_stagingTransmits;                                    ///< True while shards are generating packets. Transmits are staged per-shard and sent in groups from the calling thread afterwards.
     };
 }
 
@@ -66,6 +66,8 @@ namespace yojimbo
 
         void ReceivePackets();
 
+        bool WaitForPackets( double timeout );
+
         void AdvanceTime( double time );
 
         int GetClientIndex() const;
@@ -82,6 +84,15 @@ namespace yojimbo
 
         const Address & GetAddress() const { return m_boundAddress; }
 
+        /**
+            Get the latest session ticket the server handed out.
+            The ticket is kept after disconnecting. Pass it to Connect in place of a connect token to reconnect to the same server without a challenge round trip.
+            @param sessionTicket Buffer of ConnectTokenBytes that the ticket is written to.
+            @returns True if the client has a session ticket, false otherwise.
+         */
+
+        bool GetSessionTicket( uint8_t * sessionTicket ) const;
+
 		netcode_client_t* GetClientDetail() const { return m_client; }
 		client_adapter* GetParent() const { return m_parent; }
 
@@ -103,6 +114,8 @@ namespace yojimbo
 
         void TransmitPacketFunction( uint16_t packetSequence, uint8_t * packetData, int packetBytes );
 
+        void TransmitPacketInPlaceFunction( uint16_t packetSequence, uint8_t * packetData, int packetBytes );
+
         int ProcessPacketFunction( uint16_t packetSequence, uint8_t * packetData, int packetBytes );
 
         void SendLoopbackPacketCallbackFunction( int clientIndex, const uint8_t * packetData, int packetBytes, uint64_t packetSequence );
@@ -114,6 +127,8 @@ namespace yojimbo
         Address m_address;                              ///< Original address passed to ctor.
         Address m_boundAddress;                         ///< Address after socket bind, eg. with valid port
         uint64_t m_clientId;                            ///< The globally unique client id (set on each call to connect)
+        bool m_hasSessionTicket;                        ///< True if the server handed out a session ticket on this or a previous connection.
+        uint8_t m_sessionTicket[ConnectTokenBytes];     ///< Latest session ticket, kept when the netcode client is destroyed on disconnect.
 
 		client_adapter* m_parent;
     };
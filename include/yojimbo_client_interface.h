@@ -84,6 +84,14 @@ namespace yojimbo
 
         virtual void ReceivePackets() = 0;
 
+        /**
+            Block until packets arrive from the server, or until the timeout expires.
+            @param timeout The maximum time to wait in seconds. Pass 0 to check without blocking, or a negative value to wait indefinitely.
+            @returns True if packets may be ready to receive, false if the timeout expired.
+         */
+
+        virtual bool WaitForPackets( double timeout ) = 0;
+
         /**
             Advance client time.
             Call this at the end of each frame to advance the client time forward.
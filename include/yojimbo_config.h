@@ -197,6 +197,25 @@ namespace yojimbo
         int ackedPacketsBufferSize;                             ///< Number of packet entries in the acked packet buffer. Consider your packet send rate and aim to have at least a few seconds worth of entries.
         int receivedPacketsBufferSize;                          ///< Number of packet entries in the received packet sequence buffer. Consider your packet send rate and aim to have at least a few seconds worth of entries.
         float rttSmoothingFactor;                               ///< Round-Trip Time (RTT) smoothing factor over time.
+        float rttMinWindowSeconds;                              ///< Window the minimum RTT in NetworkInfo is taken over (seconds).
+        int packetAckBits;                                      ///< Number of packets acked by each packet header: 32, 64 or 128. Wider acks keep packets from falling out of the ack window at high send rates, or under bursts of loss, before they are acked. Only used once the other side shows it can read them, so a connection to an older build stays on 32.
+        bool congestionControl;                                 ///< If true, packets are sent at a rate that adapts to the connection: it backs off when packet loss or growing round trip times show a queue building up on the path, and creeps back up when they don't. Packets shrink to fit the rate and fragments are spaced out across updates.
+        float congestionTargetDelay;                            ///< Queueing delay on top of the minimum RTT that congestion control aims for (milliseconds). Lower keeps latency down, higher holds on to bandwidth against other traffic.
+        float congestionMinBandwidth;                           ///< Congestion control never sends slower than this (kbps).
+        float congestionInitialBandwidth;                       ///< Rate congestion control starts out at, before it has seen the connection (kbps).
+        float congestionMaxBandwidth;                           ///< Congestion control never sends faster than this (kbps).
+        int serverWorkerThreads;                                ///< Number of threads the server uses to process clients in SendPackets, ReceivePackets and AdvanceTime, including the calling thread. 1 processes every client on the calling thread. Socket I/O always stays on the calling thread.
+        bool serverUdpOffload;                                  ///< If true, the server sends the fragments of a packet as one segmented send (UDP GSO) and receives coalesced datagrams (UDP GRO) on Linux. Falls back to regular batched socket I/O when the kernel doesn't support it.
+        bool aesGcm;                                            ///< If true, insecure connect tokens ask for AES-256-GCM packet encryption and the server agrees to it. Connections fall back to ChaCha20-Poly1305 when either end lacks AES-NI or the other side doesn't ask for it.
+        bool integrityOnly;                                     ///< If true, insecure connect tokens ask for packets that are authenticated but not encrypted, and the server agrees to it. Only for trusted links like bots and datacenter internal traffic. Takes precedence over aesGcm.
+        bool serverHandshakeThread;                             ///< If true, the server decrypts connect tokens and encrypts challenge tokens on a background thread, so a flood of connection requests doesn't stall the thread calling ReceivePackets. Requests past the bounded handshake queue are dropped.
+        bool serverAdmissionControl;                            ///< If true, the server sheds malformed and unexpected packets and rate limits handshake packets per address before decrypting anything, so the CPU a flood costs per tick stays bounded.
+        int serverMaxConnectionRequestsPerSecond;               ///< Cap on connection requests the server decrypts per second, across all addresses. 0 is no cap. Only applies when serverAdmissionControl is true.
+        bool serverConnectTokenScan;                            ///< If true, the server checks connect tokens for replay with a constant time scan of every entry instead of a hash lookup. Only for anybody relying on the timing of the scan, it is much slower under a join storm.
+        bool adaptiveHandshake;                                 ///< If true, clients retry lost handshake packets after 25ms, backing off to the regular 100ms, answer the challenge in the same update they receive it, and keep a payload that beats the confirming keep-alive. Servers resend the keep-alive as soon as a duplicate connection response shows it was lost. Cuts connect time on lossy links.
+        int raceConnectServers;                                 ///< Number of servers from the connect token the client sends connection requests to at once. The client commits to whichever answers with a challenge first and tells the others to drop its handshake. 1 tries each server in turn, only moving on after the previous one times out or denies the connection.
+        int serverSessionTicketSeconds;                         ///< How long session tickets handed out by the server stay valid. A client can reconnect with its latest ticket (see Client::GetSessionTicket) in one round trip, without a new connect token from the backend. Each ticket works once. 0 disables session tickets.
+        bool connectionIds;                                     ///< If true, clients tag their packets with a connection id and servers follow a client to a new address when its packets show up there under its id, so a NAT rebinding or a switch between networks doesn't drop the connection. Costs 8 bytes per client packet.
 
         ClientServerConfig()
         {
@@ -214,6 +233,25 @@ namespace yojimbo
             ackedPacketsBufferSize = 256;
             receivedPacketsBufferSize = 256;
             rttSmoothingFactor = 0.0025f;
+            rttMinWindowSeconds = 10.0f;
+            packetAckBits = 32;
+            congestionControl = false;
+            congestionTargetDelay = 25.0f;
+            congestionMinBandwidth = 64.0f;
+            congestionInitialBandwidth = 512.0f;
+            congestionMaxBandwidth = 100000.0f;
+            serverWorkerThreads = 1;
+            serverUdpOffload = false;
+            aesGcm = false;
+            integrityOnly = false;
+            serverHandshakeThread = false;
+            serverAdmissionControl = true;
+            serverMaxConnectionRequestsPerSecond = 0;
+            serverConnectTokenScan = false;
+            adaptiveHandshake = false;
+            raceConnectServers = 1;
+            serverSessionTicketSeconds = 0;
+            connectionIds = false;
         }
     };
 }
@@ -26,10 +26,12 @@
 #define YOJIMBO_CONSTANTS_H
 
 #include "serialize.h"
+#include "reliable.h"
+#include "netcode.h"
 
 namespace yojimbo
 {
-    const int MaxClients = 64;                                      ///< The maximum number of clients supported by this library. You can increase this if you want, but this library is designed around patterns that work best for [2,64] player games. If your game has less than 64 clients, reducing this will save memory.
+    const int MaxClients = 64;                                      ///< The typical number of clients for a server. Server::Start sizes per-client state from the max clients passed in, so this is not a hard limit, but this library is designed around patterns that work best for [2,64] player games.
 
     const int MaxChannels = 64;                                     ///< The maximum number of message channels supported by this library. If you need less than 64 channels per-packet, reducing this will save memory.
 
@@ -45,6 +47,14 @@ namespace yojimbo
     
     const int ConservativePacketHeaderBits = 16;                    ///< Conservative number of bits per-packet header.
     
+    const int PacketHeadroomBytes = 40;                             ///< Bytes reserved in front of packet buffers so the reliable header (23) and the netcode prefix, connection id and sequence (17) can be written in place. Must equal RELIABLE_MAX_PACKET_HEADER_BYTES + NETCODE_PACKET_HEADROOM_BYTES.
+
+    const int PacketTailroomBytes = 16;                             ///< Bytes reserved after packet buffers so the packet MAC can be appended in place. Must equal NETCODE_PACKET_TAILROOM_BYTES.
+
+    static_assert( PacketHeadroomBytes == RELIABLE_MAX_PACKET_HEADER_BYTES + NETCODE_PACKET_HEADROOM_BYTES, "packet headroom must match the reliable and netcode headers written in place" );
+
+    static_assert( PacketTailroomBytes == NETCODE_PACKET_TAILROOM_BYTES, "packet tailroom must match the netcode MAC appended in place" );
+
     const int MaxAddressLength = 256;                               ///< The maximum length of an address when converted to a string (includes terminating NULL). @see Address::ToString
 }
 
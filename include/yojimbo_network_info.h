@@ -37,6 +37,12 @@ namespace yojimbo
     struct NetworkInfo
     {
         float RTT;                                  ///< Round trip time estimate (milliseconds).
+        float smoothedRTT;                          ///< Smoothed round trip time as in RFC 6298. Follows changes in RTT far quicker than the RTT estimate (milliseconds).
+        float RTTVariance;                          ///< Round trip time variation as in RFC 6298. The mean deviation of RTT samples from the smoothed RTT (milliseconds).
+        float minRTT;                               ///< Smallest round trip time seen over the last ClientServerConfig::rttMinWindowSeconds (milliseconds).
+        float RTTp50;                               ///< Median round trip time of recent packets (milliseconds).
+        float RTTp95;                               ///< 95th percentile round trip time of recent packets (milliseconds).
+        float RTTp99;                               ///< 99th percentile round trip time of recent packets (milliseconds).
         float packetLoss;                           ///< Packet loss percent.
         float sentBandwidth;                        ///< Sent bandwidth (kbps).
         float receivedBandwidth;                    ///< Received bandwidth (kbps).
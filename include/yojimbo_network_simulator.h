@@ -31,7 +31,7 @@
 namespace yojimbo
 {
     /**
-        Simulates packet loss, latency, jitter and duplicate packets.
+        Simulates packet loss, latency, jitter, duplicate packets and a bandwidth bottleneck.
         This is useful during development, so your game is tested and played under real world conditions, instead of ideal LAN conditions.
         This simulator works on packet send. This means that if you want 125ms of latency (round trip), you must to add 125/2 = 62.5ms of latency to each side.
      */
@@ -47,6 +47,7 @@ namespace yojimbo
                 Jitter: 0ms
                 Packet Loss: 0%
                 Duplicates: 0%
+                Bandwidth: unlimited
             @param allocator The allocator to use.
             @param numPackets The maximum number of packets that can be stored in the simulator at any time.
             @param time The initial time value in seconds.
@@ -92,9 +93,25 @@ namespace yojimbo
 
         void SetDuplicates( float percent );
 
+        /**
+            Set the bandwidth of the link packets are sent over, in kilobits per second.
+            Packets queue up behind each other when sent faster than this, so they arrive later and later, just like they do behind a slow link on the real internet. All packets sent through this simulator share the one link.
+            @param kbps The bandwidth of the link in kilobits per second. 0 = unlimited.
+         */
+
+        void SetBandwidth( float kbps );
+
+        /**
+            Set how long packets can queue up for behind the bandwidth limit before new packets are dropped.
+            Only used when the bandwidth is limited. The default is 250ms.
+            @param milliseconds The maximum queueing delay in milliseconds. 0 = packets are never dropped for queueing too long.
+         */
+
+        void SetMaxQueueDelay( float milliseconds );
+
         /**
             Is the network simulator active?
-            The network simulator is active when packet loss, latency, duplicates or jitter are non-zero values.
+            The network simulator is active when packet loss, latency, duplicates, jitter or bandwidth are non-zero values.
             This is used by the transport to know whether it should shunt packets through the simulator, or send them directly to the network. This is a minor optimization.
          */
 
@@ -167,6 +184,9 @@ namespace yojimbo
         float m_jitter;                                 ///< Jitter in milliseconds +/-
         float m_packetLoss;                             ///< Packet loss percentage.
         float m_duplicates;                             ///< Duplicate packet percentage
+        float m_bandwidth;                              ///< Bandwidth of the link in kbps. 0 is unlimited.
+        float m_maxQueueDelay;                          ///< Packets that would queue longer than this behind the bandwidth limit are dropped (milliseconds). 0 is no limit.
+        double m_linkFreeTime;                          ///< Time the last packet queued on the link finishes sending (seconds).
         bool m_active;                                  ///< True if network simulator is active, eg. if any of the network settings above are enabled.
 
         /// A packet buffered in the network simulator.
@@ -58,6 +58,8 @@ namespace yojimbo
 
         void ReceivePackets();
 
+        bool WaitForPackets( double timeout );
+
         void AdvanceTime( double time );
 
         bool IsClientConnected( int clientIndex ) const;
@@ -83,8 +85,24 @@ namespace yojimbo
 
     private:
 
+        void SendClientPacket( int clientIndex, uint8_t * packetData );
+
+        void SendPacketsShard( int shardIndex );
+
+        void ReceivePacketsShard( int shardIndex );
+
+        static void StaticSendPacketsShard( void * context, int shardIndex );
+
+        static void StaticReceivePacketsShard( void * context, int shardIndex );
+
         void TransmitPacketFunction( int clientIndex, uint16_t packetSequence, uint8_t * packetData, int packetBytes );
 
+        void TransmitPacketsFunction( int clientIndex, uint16_t packetSequence, uint8_t ** packetData, int * packetBytes, int numPackets );
+
+        void TransmitPacketInPlaceFunction( int clientIndex, uint16_t packetSequence, uint8_t * packetData, int packetBytes );
+
+        void TransmitStagedPacketsFunction( const int * clientIndex, const uint16_t * packetSequence, uint8_t ** packetData, const int * packetBytes, int numPackets );
+
         int ProcessPacketFunction( int clientIndex, uint16_t packetSequence, uint8_t * packetData, int packetBytes );
 
         void ConnectDisconnectCallbackFunction( int clientIndex, int connected );
@@ -101,6 +119,18 @@ namespace yojimbo
         Address m_boundAddress;                             // address after socket bind, eg. valid port
         uint8_t m_privateKey[KeyBytes];
 
+        struct ReceivedPacket
+        {
+            int clientIndex;
+            int packetBytes;
+            uint8_t * packetData;
+        };
+
+        ReceivedPacket * m_receivedPackets;                 // packets pulled from netcode before shards process them in parallel
+        int m_numReceivedPackets;
+        int m_maxReceivedPackets;
+        int * m_shardReceivedPacketsStart;                  // index of the first received packet for each shard, plus one past the end
+
 		server_adapter* m_parent;
     };
 }
@@ -58,7 +58,7 @@ namespace yojimbo
         /**
             Start the server and allocate client slots.
             Each client that connects to this server occupies one of the client slots allocated by this function.
-            @param maxClients The number of client slots to allocate. Must be in range [1,MaxClients]
+            @param maxClients The number of client slots to allocate. Must be at least 1. Per-client state is allocated for exactly this many slots, so it may exceed MaxClients.
             @see Server::Stop
          */
 
@@ -102,6 +102,15 @@ namespace yojimbo
 
         virtual void ReceivePackets() = 0;
 
+        /**
+            Block until packets arrive on the server sockets, or until the timeout expires.
+            Lets a dedicated server sleep between ticks instead of spinning. Follow with AdvanceTime and ReceivePackets to process whatever arrived.
+            @param timeout The maximum time to wait in seconds. Pass 0 to check without blocking, or a negative value to wait indefinitely.
+            @returns True if packets may be ready to receive, false if the timeout expired.
+         */
+
+        virtual bool WaitForPackets( double timeout ) = 0;
+
         /**
             Advance server time.
             Call this at the end of each frame to advance the server time forward.
@@ -0,0 +1,96 @@
+/*
+    Yojimbo Client/Server Network Library.
+
+    Copyright © 2016 - 2024, Mas Bandwidth LLC.
+
+    Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+        1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+        2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+           in the documentation and/or other materials provided with the distribution.
+
+        3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived
+           from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+    INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+    WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+    USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef YOJIMBO_WORKER_POOL_H
+#define YOJIMBO_WORKER_POOL_H
+
+#include "yojimbo_allocator.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace yojimbo
+{
+    /**
+        A fixed pool of worker threads that runs a batch of tasks to completion.
+        The thread calling Run works through tasks alongside the workers, so a pool of n threads spawns n-1 workers.
+        Tasks are expected to be coarse (eg. one per shard of clients), so they are handed out under a single lock.
+     */
+
+    class WorkerPool
+    {
+    public:
+
+        /**
+            Worker pool constructor.
+            @param allocator The allocator used for the worker thread array.
+            @param numThreads The total number of threads that run tasks, including the thread calling Run. Must be at least 1.
+         */
+
+        WorkerPool( Allocator & allocator, int numThreads );
+
+        /**
+            Worker pool destructor.
+            Signals the worker threads to quit and joins them.
+         */
+
+        ~WorkerPool();
+
+        /**
+            Run a batch of tasks and block until all of them have finished.
+            @param numTasks The number of tasks. The function is called once with each task index in [0,numTasks-1].
+            @param function The task function. Called from the worker threads and the calling thread.
+            @param context Passed to the task function.
+         */
+
+        void Run( int numTasks, void (*function)( void * context, int taskIndex ), void * context );
+
+        /**
+            Get the total number of threads that run tasks, including the thread calling Run.
+         */
+
+        int GetNumThreads() const { return m_numThreads; }
+
+    private:
+
+        void WorkerThread();
+
+        bool RunNextTask( std::unique_lock<std::mutex> & lock );
+
+        Allocator * m_allocator;                                    ///< Allocator passed in to constructor.
+        int m_numThreads;                                           ///< Total number of threads running tasks, including the caller of Run.
+        std::thread * m_threads;                                    ///< Array of m_numThreads-1 worker threads.
+        std::mutex m_mutex;                                         ///< Protects every member below.
+        std::condition_variable m_taskReady;                        ///< Signalled when a batch of tasks is posted or the pool is quitting.
+        std::condition_variable m_tasksDone;                        ///< Signalled when the last task of a batch finishes.
+        void (*m_function)( void * context, int taskIndex );        ///< Task function for the current batch.
+        void * m_context;                                           ///< Context for the current batch.
+        int m_numTasks;                                             ///< Number of tasks in the current batch.
+        int m_nextTask;                                             ///< Index of the next task to hand out.
+        int m_numTasksRemaining;                                    ///< Number of tasks in the current batch that haven't finished yet.
+        bool m_quit;                                                ///< Set by the destructor to stop the worker threads.
+    };
+}
+
+#endif // #ifndef YOJIMBO_WORKER_POOL_H
@@ -22,6 +22,10 @@
     USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif // #if defined(__linux__) && !defined(_GNU_SOURCE)
+
 #include "netcode.h"
 #include <stdlib.h>
 #include <memory.h>
@@ -51,14 +55,20 @@
 #define NETCODE_PACKET_QUEUE_SIZE 256
 #define NETCODE_REPLAY_PROTECTION_BUFFER_SIZE 256
 #define NETCODE_CLIENT_MAX_RECEIVE_PACKETS 64
-#define NETCODE_SERVER_MAX_RECEIVE_PACKETS ( 64 * NETCODE_MAX_CLIENTS )
+#define NETCODE_SERVER_RECEIVE_PACKETS_PER_CLIENT 64
 #define NETCODE_CLIENT_SOCKET_SNDBUF_SIZE ( 256 * 1024 )
 #define NETCODE_CLIENT_SOCKET_RCVBUF_SIZE ( 256 * 1024 )
 #define NETCODE_SERVER_SOCKET_SNDBUF_SIZE ( 4 * 1024 * 1024 )
 #define NETCODE_SERVER_SOCKET_RCVBUF_SIZE ( 4 * 1024 * 1024 )
+#define NETCODE_SOCKET_BATCH_SIZE 64
+#define NETCODE_HANDSHAKE_QUEUE_SIZE 512
+#define NETCODE_ADMISSION_ADDRESS_BUCKETS 4096
+#define NETCODE_ADMISSION_PACKETS_PER_SECOND 40.0
+#define NETCODE_ADMISSION_PACKET_BURST 16.0
 
 #define NETCODE_VERSION_INFO ( (uint8_t*) "NETCODE 1.02" )
 #define NETCODE_PACKET_SEND_RATE 10.0
+#define NETCODE_HANDSHAKE_RETRY_TIME 0.025
 #define NETCODE_NUM_DISCONNECT_PACKETS 10
 
 #ifndef NETCODE_ENABLE_TESTS
@@ -171,6 +181,8 @@ void netcode_default_free_function( void * context, void * pointer )
     #include <arpa/inet.h>
     #include <unistd.h>
     #include <errno.h>
+    #include <pthread.h>
+    #include <poll.h>
 
 #else
 
@@ -178,6 +190,68 @@ void netcode_default_free_function( void * context, void * pointer )
 
 #endif
 
+#ifndef NETCODE_SOCKET_BATCHING
+#if NETCODE_PLATFORM == NETCODE_PLATFORM_UNIX && defined(__linux__) && !defined(__EMSCRIPTEN__)
+#define NETCODE_SOCKET_BATCHING 1
+#else
+#define NETCODE_SOCKET_BATCHING 0
+#endif
+#endif // #ifndef NETCODE_SOCKET_BATCHING
+
+#if NETCODE_SOCKET_BATCHING
+#include <netinet/udp.h>
+#ifndef NETCODE_UDP_OFFLOAD
+#if defined( UDP_SEGMENT ) && defined( UDP_GRO )
+#define NETCODE_UDP_OFFLOAD 1
+#endif // #if defined( UDP_SEGMENT ) && defined( UDP_GRO )
+#endif // #ifndef NETCODE_UDP_OFFLOAD
+#endif // #if NETCODE_SOCKET_BATCHING
+
+#ifndef NETCODE_UDP_OFFLOAD
+#define NETCODE_UDP_OFFLOAD 0
+#endif // #ifndef NETCODE_UDP_OFFLOAD
+
+#ifndef NETCODE_IO_URING
+#if NETCODE_SOCKET_BATCHING && defined( __has_include )
+#if __has_include( <linux/io_uring.h> )
+#define NETCODE_IO_URING 1
+#endif // #if __has_include( <linux/io_uring.h> )
+#endif // #if NETCODE_SOCKET_BATCHING && defined( __has_include )
+#endif // #ifndef NETCODE_IO_URING
+
+#if NETCODE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if !defined( IORING_RECV_MULTISHOT )
+#undef NETCODE_IO_URING
+#endif // #if !defined( IORING_RECV_MULTISHOT )
+#endif // #if NETCODE_IO_URING
+
+#ifndef NETCODE_IO_URING
+#define NETCODE_IO_URING 0
+#endif // #ifndef NETCODE_IO_URING
+
+#ifndef NETCODE_AEAD_AVX2
+#if ( defined( __x86_64__ ) || defined( __i386__ ) ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define NETCODE_AEAD_AVX2 1
+#else
+#define NETCODE_AEAD_AVX2 0
+#endif
+#endif // #ifndef NETCODE_AEAD_AVX2
+
+#ifndef NETCODE_AES256GCM
+#if ( defined( __x86_64__ ) || defined( __i386__ ) ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define NETCODE_AES256GCM 1
+#else
+#define NETCODE_AES256GCM 0
+#endif
+#endif // #ifndef NETCODE_AES256GCM
+
+#if NETCODE_AEAD_AVX2 || NETCODE_AES256GCM
+#include <immintrin.h>
+#endif // #if NETCODE_AEAD_AVX2 || NETCODE_AES256GCM
+
 // ----------------------------------------------------------------
 
 #ifdef __MINGW32__
@@ -545,6 +619,8 @@ int netcode_address_equal( struct netcode_address_t * a, struct netcode_address_
 struct netcode_t
 {
     int initialized;
+    int aead_avx2;
+    int aes256gcm;
 };
 
 static struct netcode_t netcode;
@@ -562,6 +638,14 @@ int netcode_init()
     if ( sodium_init() == -1 )
         return NETCODE_ERROR;
 
+#if NETCODE_AEAD_AVX2
+    netcode.aead_avx2 = __builtin_cpu_supports( "avx2" ) ? 1 : 0;
+#endif // #if NETCODE_AEAD_AVX2
+
+#if NETCODE_AES256GCM
+    netcode.aes256gcm = ( __builtin_cpu_supports( "aes" ) && __builtin_cpu_supports( "pclmul" ) && __builtin_cpu_supports( "ssse3" ) ) ? 1 : 0;
+#endif // #if NETCODE_AES256GCM
+
     netcode.initialized = 1;
 
     return NETCODE_OK;
@@ -608,6 +692,7 @@ struct netcode_socket_holder_t
 #define NETCODE_SOCKET_ERROR_BIND_IPV6_FAILED                   7
 #define NETCODE_SOCKET_ERROR_GET_SOCKNAME_IPV4_FAILED           8
 #define NETCODE_SOCKET_ERROR_GET_SOCKNAME_IPV6_FAILED           7
+#define NETCODE_SOCKET_ERROR_SOCKOPT_REUSEPORT_FAILED           9
 
 void netcode_socket_destroy( struct netcode_socket_t * socket )
 {
@@ -645,7 +730,7 @@ int netcode_socket_get_ttl(struct netcode_socket_t * s)
 	return ttl;
 }
 
-int netcode_socket_create( struct netcode_socket_t * s, struct netcode_address_t * address, int send_buffer_size, int receive_buffer_size )
+int netcode_socket_create( struct netcode_socket_t * s, struct netcode_address_t * address, int send_buffer_size, int receive_buffer_size, int reuse_port )
 {
     netcode_assert( s );
     netcode_assert( address );
@@ -708,6 +793,25 @@ int netcode_socket_create( struct netcode_socket_t * s, struct netcode_address_t
         return NETCODE_SOCKET_ERROR_SOCKOPT_RCVBUF_FAILED;
     }
 
+    // let several sockets bind the same address. the kernel hashes each flow to one of them
+
+    if ( reuse_port )
+    {
+#if defined( SO_REUSEPORT )
+        int yes = 1;
+        if ( setsockopt( s->handle, SOL_SOCKET, SO_REUSEPORT, (char*)&yes, sizeof(yes) ) != 0 )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: failed to set socket reuse port\n" );
+            netcode_socket_destroy( s );
+            return NETCODE_SOCKET_ERROR_SOCKOPT_REUSEPORT_FAILED;
+        }
+#else // #if defined( SO_REUSEPORT )
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: socket reuse port is not supported on this platform\n" );
+        netcode_socket_destroy( s );
+        return NETCODE_SOCKET_ERROR_SOCKOPT_REUSEPORT_FAILED;
+#endif // #if defined( SO_REUSEPORT )
+    }
+
     // bind to port
 
     if ( address->type == NETCODE_ADDRESS_IPV6 )
@@ -807,42 +911,91 @@ int netcode_socket_create( struct netcode_socket_t * s, struct netcode_address_t
     return NETCODE_SOCKET_ERROR_NONE;
 }
 
-void netcode_socket_send_packet( struct netcode_socket_t * socket, struct netcode_address_t * to, void * packet_data, int packet_bytes )
+#if NETCODE_PLATFORM == NETCODE_PLATFORM_WINDOWS
+typedef int netcode_socklen_t;
+#else // #if NETCODE_PLATFORM == NETCODE_PLATFORM_WINDOWS
+typedef socklen_t netcode_socklen_t;
+#endif // #if NETCODE_PLATFORM == NETCODE_PLATFORM_WINDOWS
+
+netcode_socklen_t netcode_address_to_sockaddr( struct netcode_address_t * address, struct sockaddr_storage * sockaddr )
 {
-    netcode_assert( socket );
-    netcode_assert( socket->handle != 0 );
-    netcode_assert( to );
-    netcode_assert( to->type == NETCODE_ADDRESS_IPV6 || to->type == NETCODE_ADDRESS_IPV4 );
-    netcode_assert( packet_data );
-    netcode_assert( packet_bytes > 0 );
+    netcode_assert( address );
+    netcode_assert( sockaddr );
+
+    memset( sockaddr, 0, sizeof( struct sockaddr_storage ) );
 
-    if ( to->type == NETCODE_ADDRESS_IPV6 )
+    if ( address->type == NETCODE_ADDRESS_IPV6 )
     {
-        struct sockaddr_in6 socket_address;
-        memset( &socket_address, 0, sizeof( socket_address ) );
-        socket_address.sin6_family = AF_INET6;
+        struct sockaddr_in6 * socket_address = (struct sockaddr_in6*) sockaddr;
+        socket_address->sin6_family = AF_INET6;
         int i;
         for ( i = 0; i < 8; ++i )
         {
-            ( (uint16_t*) &socket_address.sin6_addr ) [i] = htons( to->data.ipv6[i] );
+            ( (uint16_t*) &socket_address->sin6_addr ) [i] = htons( address->data.ipv6[i] );
         }
-        socket_address.sin6_port = htons( to->port );
-        int result = sendto( socket->handle, (char*) packet_data, packet_bytes, 0, (struct sockaddr*) &socket_address, sizeof( struct sockaddr_in6 ) );
-        (void) result;
+        socket_address->sin6_port = htons( address->port );
+        return sizeof( struct sockaddr_in6 );
     }
-    else if ( to->type == NETCODE_ADDRESS_IPV4 )
+    else if ( address->type == NETCODE_ADDRESS_IPV4 )
     {
-        struct sockaddr_in socket_address;
-        memset( &socket_address, 0, sizeof( socket_address ) );
-        socket_address.sin_family = AF_INET;
-        socket_address.sin_addr.s_addr = ( ( (uint32_t) to->data.ipv4[0] ) )        | 
-                                         ( ( (uint32_t) to->data.ipv4[1] ) << 8 )   | 
-                                         ( ( (uint32_t) to->data.ipv4[2] ) << 16 )  | 
-                                         ( ( (uint32_t) to->data.ipv4[3] ) << 24 );
-        socket_address.sin_port = htons( to->port );
-        int result = sendto( socket->handle, (NETCODE_CONST char*) packet_data, packet_bytes, 0, (struct sockaddr*) &socket_address, sizeof( struct sockaddr_in ) );
-        (void) result;
+        struct sockaddr_in * socket_address = (struct sockaddr_in*) sockaddr;
+        socket_address->sin_family = AF_INET;
+        socket_address->sin_addr.s_addr = ( ( (uint32_t) address->data.ipv4[0] ) )        | 
+                                          ( ( (uint32_t) address->data.ipv4[1] ) << 8 )   | 
+                                          ( ( (uint32_t) address->data.ipv4[2] ) << 16 )  | 
+                                          ( ( (uint32_t) address->data.ipv4[3] ) << 24 );
+        socket_address->sin_port = htons( address->port );
+        return sizeof( struct sockaddr_in );
+    }
+
+    return 0;
+}
+
+int netcode_address_from_sockaddr( struct netcode_address_t * address, struct sockaddr_storage * sockaddr )
+{
+    netcode_assert( address );
+    netcode_assert( sockaddr );
+
+    if ( sockaddr->ss_family == AF_INET6 )
+    {
+        struct sockaddr_in6 * addr_ipv6 = (struct sockaddr_in6*) sockaddr;
+        address->type = NETCODE_ADDRESS_IPV6;
+        int i;
+        for ( i = 0; i < 8; ++i )
+        {
+            address->data.ipv6[i] = ntohs( ( (uint16_t*) &addr_ipv6->sin6_addr ) [i] );
+        }
+        address->port = ntohs( addr_ipv6->sin6_port );
+        return 1;
+    }
+    else if ( sockaddr->ss_family == AF_INET )
+    {
+        struct sockaddr_in * addr_ipv4 = (struct sockaddr_in*) sockaddr;
+        address->type = NETCODE_ADDRESS_IPV4;
+        address->data.ipv4[0] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x000000FF ) );
+        address->data.ipv4[1] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x0000FF00 ) >> 8 );
+        address->data.ipv4[2] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x00FF0000 ) >> 16 );
+        address->data.ipv4[3] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0xFF000000 ) >> 24 );
+        address->port = ntohs( addr_ipv4->sin_port );
+        return 1;
     }
+
+    return 0;
+}
+
+void netcode_socket_send_packet( struct netcode_socket_t * socket, struct netcode_address_t * to, void * packet_data, int packet_bytes )
+{
+    netcode_assert( socket );
+    netcode_assert( socket->handle != 0 );
+    netcode_assert( to );
+    netcode_assert( to->type == NETCODE_ADDRESS_IPV6 || to->type == NETCODE_ADDRESS_IPV4 );
+    netcode_assert( packet_data );
+    netcode_assert( packet_bytes > 0 );
+
+    struct sockaddr_storage socket_address;
+    netcode_socklen_t socket_address_length = netcode_address_to_sockaddr( to, &socket_address );
+    int result = sendto( socket->handle, (NETCODE_CONST char*) packet_data, packet_bytes, 0, (struct sockaddr*) &socket_address, socket_address_length );
+    (void) result;
 }
 
 int netcode_socket_receive_packet( struct netcode_socket_t * socket, struct netcode_address_t * from, void * packet_data, int max_packet_size )
@@ -853,12 +1006,8 @@ int netcode_socket_receive_packet( struct netcode_socket_t * socket, struct netc
     netcode_assert( packet_data );
     netcode_assert( max_packet_size > 0 );
 
-#if NETCODE_PLATFORM == NETCODE_PLATFORM_WINDOWS
-    typedef int socklen_t;
-#endif // #if NETCODE_PLATFORM == NETCODE_PLATFORM_WINDOWS
-    
     struct sockaddr_storage sockaddr_from;
-    socklen_t from_length = sizeof( sockaddr_from );
+    netcode_socklen_t from_length = sizeof( sockaddr_from );
 
     int result = recvfrom( socket->handle, (char*) packet_data, max_packet_size, 0, (struct sockaddr*) &sockaddr_from, &from_length );
 
@@ -886,28 +1035,7 @@ int netcode_socket_receive_packet( struct netcode_socket_t * socket, struct netc
     }
 #endif // #if NETCODE_PLATFORM == NETCODE_PLATFORM_WINDOWS
 
-    if ( sockaddr_from.ss_family == AF_INET6 )
-    {
-        struct sockaddr_in6 * addr_ipv6 = (struct sockaddr_in6*) &sockaddr_from;
-        from->type = NETCODE_ADDRESS_IPV6;
-        int i;
-        for ( i = 0; i < 8; ++i )
-        {
-            from->data.ipv6[i] = ntohs( ( (uint16_t*) &addr_ipv6->sin6_addr ) [i] );
-        }
-        from->port = ntohs( addr_ipv6->sin6_port );
-    }
-    else if ( sockaddr_from.ss_family == AF_INET )
-    {
-        struct sockaddr_in * addr_ipv4 = (struct sockaddr_in*) &sockaddr_from;
-        from->type = NETCODE_ADDRESS_IPV4;
-        from->data.ipv4[0] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x000000FF ) );
-        from->data.ipv4[1] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x0000FF00 ) >> 8 );
-        from->data.ipv4[2] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x00FF0000 ) >> 16 );
-        from->data.ipv4[3] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0xFF000000 ) >> 24 );
-        from->port = ntohs( addr_ipv4->sin_port );
-    }
-    else
+    if ( !netcode_address_from_sockaddr( from, &sockaddr_from ) )
     {
         netcode_assert( 0 );
         return 0;
@@ -920,5665 +1048,14996 @@ int netcode_socket_receive_packet( struct netcode_socket_t * socket, struct netc
     return bytes_read;
 }
 
-// ----------------------------------------------------------------
-
-void netcode_write_uint8( uint8_t ** p, uint8_t value )
+int netcode_socket_wait( netcode_socket_handle_t * handles, int num_handles, double timeout )
 {
-    **p = value;
-    ++(*p);
-}
+    netcode_assert( handles );
+    netcode_assert( num_handles > 0 );
+    netcode_assert( num_handles <= 4 );
 
-void netcode_write_uint16( uint8_t ** p, uint16_t value )
-{
-    (*p)[0] = value & 0xFF;
-    (*p)[1] = value >> 8;
-    *p += 2;
-}
+    // timeout < 0 blocks until a handle is readable, timeout == 0 polls without blocking
 
-void netcode_write_uint32( uint8_t ** p, uint32_t value )
-{
-    (*p)[0] = value & 0xFF;
-    (*p)[1] = ( value >> 8  ) & 0xFF;
-    (*p)[2] = ( value >> 16 ) & 0xFF;
-    (*p)[3] = value >> 24;
-    *p += 4;
-}
+    int timeout_milliseconds = timeout < 0.0 ? -1 : (int) ( timeout * 1000.0 + 0.5 );
 
-void netcode_write_uint64( uint8_t ** p, uint64_t value )
-{
-    (*p)[0] = value & 0xFF;
-    (*p)[1] = ( value >> 8  ) & 0xFF;
-    (*p)[2] = ( value >> 16 ) & 0xFF;
-    (*p)[3] = ( value >> 24 ) & 0xFF;
-    (*p)[4] = ( value >> 32 ) & 0xFF;
-    (*p)[5] = ( value >> 40 ) & 0xFF;
-    (*p)[6] = ( value >> 48 ) & 0xFF;
-    (*p)[7] = value >> 56;
-    *p += 8;
-}
+#if NETCODE_PLATFORM == NETCODE_PLATFORM_WINDOWS
 
-void netcode_write_bytes( uint8_t ** p, uint8_t * byte_array, int num_bytes )
-{
+    WSAPOLLFD poll_handles[4];
+    int num_poll_handles = 0;
     int i;
-    for ( i = 0; i < num_bytes; ++i )
+    for ( i = 0; i < num_handles; i++ )
     {
-        netcode_write_uint8( p, byte_array[i] );
+        if ( handles[i] == 0 )
+            continue;
+        poll_handles[num_poll_handles].fd = handles[i];
+        poll_handles[num_poll_handles].events = POLLRDNORM;
+        poll_handles[num_poll_handles].revents = 0;
+        num_poll_handles++;
     }
-}
-
-uint8_t netcode_read_uint8( uint8_t ** p )
-{
-    uint8_t value = **p;
-    ++(*p);
-    return value;
-}
 
-uint16_t netcode_read_uint16( uint8_t ** p )
-{
-    uint16_t value;
-    value = (*p)[0];
-    value |= ( ( (uint16_t)( (*p)[1] ) ) << 8 );
-    *p += 2;
-    return value;
-}
+    if ( num_poll_handles == 0 )
+        return 0;
 
-uint32_t netcode_read_uint32( uint8_t ** p )
-{
-    uint32_t value;
-    value  = (*p)[0];
-    value |= ( ( (uint32_t)( (*p)[1] ) ) << 8 );
-    value |= ( ( (uint32_t)( (*p)[2] ) ) << 16 );
-    value |= ( ( (uint32_t)( (*p)[3] ) ) << 24 );
-    *p += 4;
-    return value;
-}
+    int result = WSAPoll( poll_handles, num_poll_handles, timeout_milliseconds );
+    if ( result == SOCKET_ERROR )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: WSAPoll failed with error %d\n", WSAGetLastError() );
+        return 1;
+    }
 
-uint64_t netcode_read_uint64( uint8_t ** p )
-{
-    uint64_t value;
-    value  = (*p)[0];
-    value |= ( ( (uint64_t)( (*p)[1] ) ) << 8  );
-    value |= ( ( (uint64_t)( (*p)[2] ) ) << 16 );
-    value |= ( ( (uint64_t)( (*p)[3] ) ) << 24 );
-    value |= ( ( (uint64_t)( (*p)[4] ) ) << 32 );
-    value |= ( ( (uint64_t)( (*p)[5] ) ) << 40 );
-    value |= ( ( (uint64_t)( (*p)[6] ) ) << 48 );
-    value |= ( ( (uint64_t)( (*p)[7] ) ) << 56 );
-    *p += 8;
-    return value;
-}
+#else // #if NETCODE_PLATFORM == NETCODE_PLATFORM_WINDOWS
 
-void netcode_read_bytes( uint8_t ** p, uint8_t * byte_array, int num_bytes )
-{
+    struct pollfd poll_handles[4];
+    int num_poll_handles = 0;
     int i;
-    for ( i = 0; i < num_bytes; ++i )
+    for ( i = 0; i < num_handles; i++ )
     {
-        byte_array[i] = netcode_read_uint8( p );
+        if ( handles[i] == 0 )
+            continue;
+        poll_handles[num_poll_handles].fd = (int) handles[i];
+        poll_handles[num_poll_handles].events = POLLIN;
+        poll_handles[num_poll_handles].revents = 0;
+        num_poll_handles++;
     }
-}
 
-// ----------------------------------------------------------------
+    if ( num_poll_handles == 0 )
+        return 0;
 
-void netcode_generate_key( uint8_t * key )
-{
-    netcode_assert( key );
-    randombytes_buf( key, NETCODE_KEY_BYTES );
-}
+    int result = poll( poll_handles, num_poll_handles, timeout_milliseconds );
+    if ( result < 0 )
+    {
+        // interrupted by a signal: report readable so the caller goes back through its update loop
 
-void netcode_generate_nonce( uint8_t * nonce )
-{
-    netcode_assert( nonce );
-    randombytes_buf( nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
-}
+        if ( errno != EINTR )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: poll failed with error %d\n", errno );
+        }
+        return 1;
+    }
 
-void netcode_random_bytes( uint8_t * data, int bytes )
-{
-    netcode_assert( data );
-    netcode_assert( bytes > 0 );
-    randombytes_buf( data, bytes );
+#endif // #if NETCODE_PLATFORM == NETCODE_PLATFORM_WINDOWS
+
+    return result > 0 ? 1 : 0;
 }
 
-int netcode_encrypt_aead_bignonce( uint8_t * message, uint64_t message_length, 
-                                   uint8_t * additional, uint64_t additional_length,
-                                   NETCODE_CONST uint8_t * nonce,
-                                   NETCODE_CONST uint8_t * key )
+#if NETCODE_SOCKET_BATCHING
+
+struct netcode_socket_batch_t
 {
-    unsigned long long encrypted_length;
+    int num_packets;
+    struct netcode_address_t address[NETCODE_SOCKET_BATCH_SIZE];
+    int packet_bytes[NETCODE_SOCKET_BATCH_SIZE];
+    uint8_t packet_data[NETCODE_SOCKET_BATCH_SIZE][NETCODE_MAX_PACKET_BYTES];
+};
 
-    int result = crypto_aead_xchacha20poly1305_ietf_encrypt( message, &encrypted_length,
-                                                             message, (unsigned long long) message_length,
-                                                             additional, (unsigned long long) additional_length,
-                                                             NULL, nonce, key );
-    
-    if ( result != 0 )
-        return NETCODE_ERROR;
+int netcode_socket_send_packets( struct netcode_socket_t * socket, struct netcode_socket_batch_t * batch, int first_packet )
+{
+    netcode_assert( socket );
+    netcode_assert( socket->handle != 0 );
+    netcode_assert( batch );
+    netcode_assert( first_packet >= 0 );
+    netcode_assert( first_packet < batch->num_packets );
 
-    netcode_assert( encrypted_length == message_length + NETCODE_MAC_BYTES );
+    struct mmsghdr messages[NETCODE_SOCKET_BATCH_SIZE];
+    struct iovec iov[NETCODE_SOCKET_BATCH_SIZE];
+    struct sockaddr_storage socket_address[NETCODE_SOCKET_BATCH_SIZE];
 
-    return NETCODE_OK;
-}
+    int num_messages = batch->num_packets - first_packet;
 
-int netcode_decrypt_aead_bignonce( uint8_t * message, uint64_t message_length, 
-                                   uint8_t * additional, uint64_t additional_length,
-                                   uint8_t * nonce,
-                                   uint8_t * key )
-{
-    unsigned long long decrypted_length;
+    memset( messages, 0, sizeof( struct mmsghdr ) * num_messages );
 
-    int result = crypto_aead_xchacha20poly1305_ietf_decrypt( message, &decrypted_length,
-                                                             NULL,
-                                                             message, (unsigned long long) message_length,
-                                                             additional, (unsigned long long) additional_length,
-                                                             nonce, key );
+    int i;
+    for ( i = 0; i < num_messages; ++i )
+    {
+        const int index = first_packet + i;
+        iov[i].iov_base = batch->packet_data[index];
+        iov[i].iov_len = batch->packet_bytes[index];
+        messages[i].msg_hdr.msg_name = &socket_address[i];
+        messages[i].msg_hdr.msg_namelen = netcode_address_to_sockaddr( &batch->address[index], &socket_address[i] );
+        messages[i].msg_hdr.msg_iov = &iov[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
 
-    if ( result != 0 )
-        return NETCODE_ERROR;
+    int result = sendmmsg( socket->handle, messages, num_messages, 0 );
 
-    netcode_assert( decrypted_length == message_length - NETCODE_MAC_BYTES );
+    if ( result < 0 )
+    {
+        if ( errno != EAGAIN && errno != EINTR )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: sendmmsg failed with error %d\n", errno );
+        }
+        return 0;
+    }
 
-    return NETCODE_OK;
+    return result;
 }
 
-int netcode_encrypt_aead( uint8_t * message, uint64_t message_length, 
-                          uint8_t * additional, uint64_t additional_length,
-                          NETCODE_CONST uint8_t * nonce,
-                          NETCODE_CONST uint8_t * key )
+struct netcode_socket_receive_batch_t
 {
-    unsigned long long encrypted_length;
+    int num_packets;
+    struct netcode_address_t address[NETCODE_SOCKET_BATCH_SIZE];
+    int packet_bytes[NETCODE_SOCKET_BATCH_SIZE];
+    uint8_t * packet_data[NETCODE_SOCKET_BATCH_SIZE];
+};
 
-    int result = crypto_aead_chacha20poly1305_ietf_encrypt( message, &encrypted_length,
-                                                            message, (unsigned long long) message_length,
-                                                            additional, (unsigned long long) additional_length,
-                                                            NULL, nonce, key );
-    
-    if ( result != 0 )
-        return NETCODE_ERROR;
+int netcode_socket_receive_packets( struct netcode_socket_t * socket, struct netcode_socket_receive_batch_t * batch )
+{
+    netcode_assert( socket );
+    netcode_assert( socket->handle != 0 );
+    netcode_assert( batch );
 
-    netcode_assert( encrypted_length == message_length + NETCODE_MAC_BYTES );
+    struct mmsghdr messages[NETCODE_SOCKET_BATCH_SIZE];
+    struct iovec iov[NETCODE_SOCKET_BATCH_SIZE];
+    struct sockaddr_storage sockaddr_from[NETCODE_SOCKET_BATCH_SIZE];
 
-    return NETCODE_OK;
-}
+    memset( messages, 0, sizeof( messages ) );
 
-int netcode_decrypt_aead( uint8_t * message, uint64_t message_length, 
-                          uint8_t * additional, uint64_t additional_length,
-                          uint8_t * nonce,
-                          uint8_t * key )
-{
-    unsigned long long decrypted_length;
+    int i;
+    for ( i = 0; i < NETCODE_SOCKET_BATCH_SIZE; ++i )
+    {
+        iov[i].iov_base = batch->packet_data[i];
+        iov[i].iov_len = NETCODE_MAX_PACKET_BYTES;
+        messages[i].msg_hdr.msg_name = &sockaddr_from[i];
+        messages[i].msg_hdr.msg_namelen = sizeof( struct sockaddr_storage );
+        messages[i].msg_hdr.msg_iov = &iov[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
 
-    int result = crypto_aead_chacha20poly1305_ietf_decrypt( message, &decrypted_length,
-                                                            NULL,
-                                                            message, (unsigned long long) message_length,
-                                                            additional, (unsigned long long) additional_length,
-                                                            nonce, key );
+    batch->num_packets = 0;
 
-    if ( result != 0 )
-        return NETCODE_ERROR;
+    int result = recvmmsg( socket->handle, messages, NETCODE_SOCKET_BATCH_SIZE, MSG_DONTWAIT, NULL );
 
-    netcode_assert( decrypted_length == message_length - NETCODE_MAC_BYTES );
+    if ( result <= 0 )
+    {
+        if ( result < 0 && errno != EAGAIN && errno != EINTR )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: recvmmsg failed with error %d\n", errno );
+        }
+        return 0;
+    }
 
-    return NETCODE_OK;
+    for ( i = 0; i < result; ++i )
+    {
+        if ( messages[i].msg_len == 0 )
+            continue;
+
+        const int index = batch->num_packets;
+
+        if ( !netcode_address_from_sockaddr( &batch->address[index], &sockaddr_from[i] ) )
+            continue;
+
+        if ( index != i )
+        {
+            // swap buffers rather than copy. the receive buffers belong to the caller's packet pool
+            uint8_t * packet_data = batch->packet_data[index];
+            batch->packet_data[index] = batch->packet_data[i];
+            batch->packet_data[i] = packet_data;
+        }
+
+        batch->packet_bytes[index] = (int) messages[i].msg_len;
+        batch->num_packets++;
+    }
+
+    return result;
 }
 
-// ----------------------------------------------------------------
+#if NETCODE_UDP_OFFLOAD
 
-struct netcode_connect_token_private_t
+#define NETCODE_UDP_MAX_SEGMENTS 64
+#define NETCODE_UDP_MAX_MESSAGE_BYTES 65000
+// as many buffers as a regular batch. small packets from different clients never coalesce, so with ordinary game
+// traffic each buffer holds one datagram and a smaller batch would only mean more receive calls per tick
+#define NETCODE_SOCKET_COALESCED_BATCH_SIZE NETCODE_SOCKET_BATCH_SIZE
+#define NETCODE_SOCKET_COALESCED_PACKET_BYTES 65536
+
+struct netcode_socket_coalesced_batch_t
 {
-    uint64_t client_id;
-    int timeout_seconds;
-    int num_server_addresses;
-    struct netcode_address_t server_addresses[NETCODE_MAX_SERVERS_PER_CONNECT];
-    uint8_t client_to_server_key[NETCODE_KEY_BYTES];
-    uint8_t server_to_client_key[NETCODE_KEY_BYTES];
-    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    int num_packets;
+    struct netcode_address_t address[NETCODE_SOCKET_COALESCED_BATCH_SIZE];
+    int packet_bytes[NETCODE_SOCKET_COALESCED_BATCH_SIZE];
+    int segment_bytes[NETCODE_SOCKET_COALESCED_BATCH_SIZE];
+    uint8_t packet_data[NETCODE_SOCKET_COALESCED_BATCH_SIZE][NETCODE_SOCKET_COALESCED_PACKET_BYTES];
 };
 
-void netcode_generate_connect_token_private( struct netcode_connect_token_private_t * connect_token, 
-                                             uint64_t client_id, 
-                                             int timeout_seconds,
-                                             int num_server_addresses, 
-                                             struct netcode_address_t * server_addresses, 
-                                             uint8_t * user_data )
+int netcode_socket_udp_offload_supported( struct netcode_socket_t * socket )
 {
-    netcode_assert( connect_token );
-    netcode_assert( num_server_addresses > 0 );
-    netcode_assert( num_server_addresses <= NETCODE_MAX_SERVERS_PER_CONNECT );
-    netcode_assert( server_addresses );
-    netcode_assert( user_data );
+    netcode_assert( socket );
+    netcode_assert( socket->handle != 0 );
 
-    connect_token->client_id = client_id;
-    connect_token->timeout_seconds = timeout_seconds;
-    connect_token->num_server_addresses = num_server_addresses;
-    
-    int i;
-    for ( i = 0; i < num_server_addresses; ++i )
-    {
-        memcpy( &connect_token->server_addresses[i], &server_addresses[i], sizeof( struct netcode_address_t ) );
-    }
+    int segment_bytes = 0;
+    socklen_t length = sizeof( segment_bytes );
+    return getsockopt( socket->handle, SOL_UDP, UDP_SEGMENT, &segment_bytes, &length ) == 0;
+}
 
-    netcode_generate_key( connect_token->client_to_server_key );
-    netcode_generate_key( connect_token->server_to_client_key );
+int netcode_socket_set_udp_gro( struct netcode_socket_t * socket, int enabled )
+{
+    netcode_assert( socket );
+    netcode_assert( socket->handle != 0 );
 
-    if ( user_data != NULL )
-    {
-        memcpy( connect_token->user_data, user_data, NETCODE_USER_DATA_BYTES );
-    }
-    else
-    {
-        memset( connect_token->user_data, 0, NETCODE_USER_DATA_BYTES );
-    }
+    return setsockopt( socket->handle, SOL_UDP, UDP_GRO, &enabled, sizeof( enabled ) ) == 0 ? NETCODE_OK : NETCODE_ERROR;
 }
 
-void netcode_write_connect_token_private( struct netcode_connect_token_private_t * connect_token, uint8_t * buffer, int buffer_length )
+int netcode_socket_send_packets_segmented( struct netcode_socket_t * socket, struct netcode_socket_batch_t * batch, int first_packet )
 {
-    (void) buffer_length;
-
-    netcode_assert( connect_token );
-    netcode_assert( connect_token->num_server_addresses > 0 );
-    netcode_assert( connect_token->num_server_addresses <= NETCODE_MAX_SERVERS_PER_CONNECT );
-    netcode_assert( buffer );
-    netcode_assert( buffer_length >= NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    netcode_assert( socket );
+    netcode_assert( socket->handle != 0 );
+    netcode_assert( batch );
+    netcode_assert( first_packet >= 0 );
+    netcode_assert( first_packet < batch->num_packets );
 
-    uint8_t * start = buffer;
+    struct mmsghdr messages[NETCODE_SOCKET_BATCH_SIZE];
+    struct iovec iov[NETCODE_SOCKET_BATCH_SIZE];
+    struct sockaddr_storage socket_address[NETCODE_SOCKET_BATCH_SIZE];
+    union { char buffer[CMSG_SPACE( sizeof( uint16_t ) )]; struct cmsghdr align; } control[NETCODE_SOCKET_BATCH_SIZE];
+    int message_packets[NETCODE_SOCKET_BATCH_SIZE];
 
-    (void) start;
+    memset( messages, 0, sizeof( messages ) );
 
-    netcode_write_uint64( &buffer, connect_token->client_id );
+    int num_messages = 0;
+    int index = first_packet;
 
-    netcode_write_uint32( &buffer, connect_token->timeout_seconds );
+    while ( index < batch->num_packets )
+    {
+        // consecutive datagrams to the same address, all the same size except for a shorter last one,
+        // leave in a single send and the kernel cuts them back into datagrams (UDP_SEGMENT)
 
-    netcode_write_uint32( &buffer, connect_token->num_server_addresses );
+        const int segment_bytes = batch->packet_bytes[index];
 
-    int i,j;
+        int run_packets = 1;
+        int run_bytes = segment_bytes;
 
-    for ( i = 0; i < connect_token->num_server_addresses; ++i )
-    {
-        if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV4 )
-        {
-            netcode_write_uint8( &buffer, NETCODE_ADDRESS_IPV4 );
-            for ( j = 0; j < 4; ++j )
-            {
-                netcode_write_uint8( &buffer, connect_token->server_addresses[i].data.ipv4[j] );
-            }
-            netcode_write_uint16( &buffer, connect_token->server_addresses[i].port );
-        }
-        else if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV6 )
+        while ( index + run_packets < batch->num_packets && run_packets < NETCODE_UDP_MAX_SEGMENTS )
         {
-            netcode_write_uint8( &buffer, NETCODE_ADDRESS_IPV6 );
-            for ( j = 0; j < 8; ++j )
-            {
-                netcode_write_uint16( &buffer, connect_token->server_addresses[i].data.ipv6[j] );
-            }
-            netcode_write_uint16( &buffer, connect_token->server_addresses[i].port );
+            const int next = index + run_packets;
+
+            if ( batch->packet_bytes[next] > segment_bytes || run_bytes + batch->packet_bytes[next] > NETCODE_UDP_MAX_MESSAGE_BYTES )
+                break;
+
+            if ( !netcode_address_equal( &batch->address[next], &batch->address[index] ) )
+                break;
+
+            run_bytes += batch->packet_bytes[next];
+            run_packets++;
+
+            if ( batch->packet_bytes[next] < segment_bytes )
+                break;
         }
-        else
+
+        int i;
+        for ( i = 0; i < run_packets; ++i )
         {
-            netcode_assert( 0 );
+            iov[index - first_packet + i].iov_base = batch->packet_data[index + i];
+            iov[index - first_packet + i].iov_len = batch->packet_bytes[index + i];
         }
-    }
 
-    netcode_write_bytes( &buffer, connect_token->client_to_server_key, NETCODE_KEY_BYTES );
+        struct msghdr * header = &messages[num_messages].msg_hdr;
+        header->msg_name = &socket_address[num_messages];
+        header->msg_namelen = netcode_address_to_sockaddr( &batch->address[index], &socket_address[num_messages] );
+        header->msg_iov = &iov[index - first_packet];
+        header->msg_iovlen = run_packets;
 
-    netcode_write_bytes( &buffer, connect_token->server_to_client_key, NETCODE_KEY_BYTES );
+        if ( run_packets > 1 )
+        {
+            header->msg_control = control[num_messages].buffer;
+            header->msg_controllen = sizeof( control[num_messages].buffer );
+            struct cmsghdr * cmsg = CMSG_FIRSTHDR( header );
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN( sizeof( uint16_t ) );
+            uint16_t segment_size = (uint16_t) segment_bytes;
+            memcpy( CMSG_DATA( cmsg ), &segment_size, sizeof( segment_size ) );
+        }
 
-    netcode_write_bytes( &buffer, connect_token->user_data, NETCODE_USER_DATA_BYTES );
+        message_packets[num_messages++] = run_packets;
 
-    netcode_assert( buffer - start <= NETCODE_CONNECT_TOKEN_PRIVATE_BYTES - NETCODE_MAC_BYTES );
+        index += run_packets;
+    }
 
-    memset( buffer, 0, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES - ( buffer - start ) );
-}
+    int result = sendmmsg( socket->handle, messages, num_messages, 0 );
 
-int netcode_encrypt_connect_token_private( uint8_t * buffer, 
-                                           int buffer_length, 
-                                           uint8_t * version_info, 
-                                           uint64_t protocol_id, 
-                                           uint64_t expire_timestamp, 
-                                           NETCODE_CONST uint8_t * nonce, 
-                                           NETCODE_CONST uint8_t * key )
-{
-    netcode_assert( buffer );
-    netcode_assert( buffer_length == NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
-    netcode_assert( key );
+    if ( result < 0 )
+    {
+        if ( errno != EAGAIN && errno != EINTR )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: sendmmsg failed with error %d\n", errno );
+        }
+        return 0;
+    }
 
-    (void) buffer_length;
+    int num_packets_sent = 0;
 
-    uint8_t additional_data[NETCODE_VERSION_INFO_BYTES+8+8];
+    int i;
+    for ( i = 0; i < result; ++i )
     {
-        uint8_t * p = additional_data;
-        netcode_write_bytes( &p, version_info, NETCODE_VERSION_INFO_BYTES );
-        netcode_write_uint64( &p, protocol_id );
-        netcode_write_uint64( &p, expire_timestamp );
+        num_packets_sent += message_packets[i];
     }
 
-    return netcode_encrypt_aead_bignonce( buffer, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES - NETCODE_MAC_BYTES, additional_data, sizeof( additional_data ), nonce, key );
+    return num_packets_sent;
 }
 
-int netcode_decrypt_connect_token_private( uint8_t * buffer, 
-                                           int buffer_length, 
-                                           uint8_t * version_info, 
-                                           uint64_t protocol_id, 
-                                           uint64_t expire_timestamp, 
-                                           uint8_t * nonce, 
-                                           uint8_t * key )
+int netcode_socket_receive_packets_coalesced( struct netcode_socket_t * socket, struct netcode_socket_coalesced_batch_t * batch )
 {
-    netcode_assert( buffer );
-    netcode_assert( buffer_length == NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
-    netcode_assert( key );
+    netcode_assert( socket );
+    netcode_assert( socket->handle != 0 );
+    netcode_assert( batch );
 
-    (void) buffer_length;
+    struct mmsghdr messages[NETCODE_SOCKET_COALESCED_BATCH_SIZE];
+    struct iovec iov[NETCODE_SOCKET_COALESCED_BATCH_SIZE];
+    struct sockaddr_storage sockaddr_from[NETCODE_SOCKET_COALESCED_BATCH_SIZE];
+    union { char buffer[CMSG_SPACE( sizeof( int ) )]; struct cmsghdr align; } control[NETCODE_SOCKET_COALESCED_BATCH_SIZE];
 
-    uint8_t additional_data[NETCODE_VERSION_INFO_BYTES+8+8];
+    memset( messages, 0, sizeof( messages ) );
+
+    int i;
+    for ( i = 0; i < NETCODE_SOCKET_COALESCED_BATCH_SIZE; ++i )
     {
-        uint8_t * p = additional_data;
-        netcode_write_bytes( &p, version_info, NETCODE_VERSION_INFO_BYTES );
-        netcode_write_uint64( &p, protocol_id );
-        netcode_write_uint64( &p, expire_timestamp );
+        iov[i].iov_base = batch->packet_data[i];
+        iov[i].iov_len = NETCODE_SOCKET_COALESCED_PACKET_BYTES;
+        messages[i].msg_hdr.msg_name = &sockaddr_from[i];
+        messages[i].msg_hdr.msg_namelen = sizeof( struct sockaddr_storage );
+        messages[i].msg_hdr.msg_iov = &iov[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_control = control[i].buffer;
+        messages[i].msg_hdr.msg_controllen = sizeof( control[i].buffer );
     }
-    return netcode_decrypt_aead_bignonce( buffer, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, additional_data, sizeof( additional_data ), nonce, key );
-}
 
-int netcode_read_connect_token_private( uint8_t * buffer, int buffer_length, struct netcode_connect_token_private_t * connect_token )
-{
-    netcode_assert( buffer );
-    netcode_assert( connect_token );
+    batch->num_packets = 0;
 
-    if ( buffer_length < NETCODE_CONNECT_TOKEN_PRIVATE_BYTES )
-        return NETCODE_ERROR;
-    
-    connect_token->client_id = netcode_read_uint64( &buffer );
+    int result = recvmmsg( socket->handle, messages, NETCODE_SOCKET_COALESCED_BATCH_SIZE, MSG_DONTWAIT, NULL );
 
-    connect_token->timeout_seconds = (int) netcode_read_uint32( &buffer );
+    if ( result <= 0 )
+    {
+        if ( result < 0 && errno != EAGAIN && errno != EINTR )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: recvmmsg failed with error %d\n", errno );
+        }
+        return 0;
+    }
 
-    connect_token->num_server_addresses = netcode_read_uint32( &buffer );
+    for ( i = 0; i < result; ++i )
+    {
+        if ( messages[i].msg_len == 0 || ( messages[i].msg_hdr.msg_flags & MSG_TRUNC ) )
+            continue;
 
-    if ( connect_token->num_server_addresses <= 0 )
-        return NETCODE_ERROR;
+        const int index = batch->num_packets;
 
-    if ( connect_token->num_server_addresses > NETCODE_MAX_SERVERS_PER_CONNECT )
-        return NETCODE_ERROR;
+        if ( !netcode_address_from_sockaddr( &batch->address[index], &sockaddr_from[i] ) )
+            continue;
 
-    int i,j;
+        // the kernel reports the datagram size when it merged several datagrams from this address into one buffer
 
-    for ( i = 0; i < connect_token->num_server_addresses; ++i )
-    {
-        connect_token->server_addresses[i].type = netcode_read_uint8( &buffer );
+        int segment_bytes = (int) messages[i].msg_len;
 
-        if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV4 )
-        {
-            for ( j = 0; j < 4; ++j )
-            {
-                connect_token->server_addresses[i].data.ipv4[j] = netcode_read_uint8( &buffer );
-            }
-            connect_token->server_addresses[i].port = netcode_read_uint16( &buffer );
-        }
-        else if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV6 )
+        struct cmsghdr * cmsg;
+        for ( cmsg = CMSG_FIRSTHDR( &messages[i].msg_hdr ); cmsg != NULL; cmsg = CMSG_NXTHDR( &messages[i].msg_hdr, cmsg ) )
         {
-            for ( j = 0; j < 8; ++j )
+            if ( cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO )
             {
-                connect_token->server_addresses[i].data.ipv6[j] = netcode_read_uint16( &buffer );
+                int gro_size = 0;
+                memcpy( &gro_size, CMSG_DATA( cmsg ), sizeof( gro_size ) );
+                if ( gro_size > 0 )
+                    segment_bytes = gro_size;
             }
-            connect_token->server_addresses[i].port = netcode_read_uint16( &buffer );
         }
-        else
+
+        if ( index != i )
         {
-            return NETCODE_ERROR;
+            memmove( batch->packet_data[index], batch->packet_data[i], messages[i].msg_len );
         }
+
+        batch->packet_bytes[index] = (int) messages[i].msg_len;
+        batch->segment_bytes[index] = segment_bytes;
+        batch->num_packets++;
     }
 
-    netcode_read_bytes( &buffer, connect_token->client_to_server_key, NETCODE_KEY_BYTES );
+    return result;
+}
 
-    netcode_read_bytes( &buffer, connect_token->server_to_client_key, NETCODE_KEY_BYTES );
+#endif // #if NETCODE_UDP_OFFLOAD
 
-    netcode_read_bytes( &buffer, connect_token->user_data, NETCODE_USER_DATA_BYTES );
+#endif // #if NETCODE_SOCKET_BATCHING
 
-    return NETCODE_OK;
-}
+#if NETCODE_IO_URING
 
-// -----------------------------------------------
+#define NETCODE_IO_URING_NUM_BUFFERS 512
+#define NETCODE_IO_URING_BUFFER_GROUP 0
+#define NETCODE_IO_URING_BUFFER_BYTES ( sizeof( struct io_uring_recvmsg_out ) + sizeof( struct sockaddr_storage ) + NETCODE_MAX_PACKET_BYTES )
+#define NETCODE_IO_URING_RECEIVE_USER_DATA 0xFFFFFFFFFFFFFFFFULL
 
-struct netcode_challenge_token_t
+struct netcode_io_uring_queue_t
 {
-    uint64_t client_id;
-    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    int fd;
+    void * sq_ring;
+    size_t sq_ring_bytes;
+    void * cq_ring;
+    size_t cq_ring_bytes;
+    struct io_uring_sqe * sqes;
+    size_t sqes_bytes;
+    unsigned * sq_tail;
+    unsigned * sq_mask;
+    unsigned * sq_array;
+    unsigned * cq_head;
+    unsigned * cq_tail;
+    unsigned * cq_mask;
+    struct io_uring_cqe * cqes;
 };
 
-void netcode_write_challenge_token( struct netcode_challenge_token_t * challenge_token, uint8_t * buffer, int buffer_length )
+struct netcode_io_uring_t
 {
-    (void) buffer_length;
+    void * allocator_context;
+    void (*free_function)(void*,void*);
+    netcode_socket_handle_t handle;
+    struct netcode_io_uring_queue_t receive_queue;
+    struct netcode_io_uring_queue_t send_queue;
+    struct io_uring_buf_ring * buffer_ring;
+    size_t buffer_ring_bytes;
+    uint8_t * buffers;
+    int num_recycled_buffers;
+    int receive_armed;
+    struct msghdr receive_message;
+    struct msghdr send_message[NETCODE_SOCKET_BATCH_SIZE];
+    struct iovec send_iov[NETCODE_SOCKET_BATCH_SIZE];
+    struct sockaddr_storage send_address[NETCODE_SOCKET_BATCH_SIZE];
+};
 
-    netcode_assert( challenge_token );
-    netcode_assert( buffer );
-    netcode_assert( buffer_length >= NETCODE_CHALLENGE_TOKEN_BYTES );
+int netcode_io_uring_enter( struct netcode_io_uring_queue_t * queue, unsigned to_submit, unsigned min_complete )
+{
+    return (int) syscall( __NR_io_uring_enter, queue->fd, to_submit, min_complete, IORING_ENTER_GETEVENTS, NULL, 0 );
+}
 
-    memset( buffer, 0, NETCODE_CHALLENGE_TOKEN_BYTES );
-
-    uint8_t * start = buffer;
+void netcode_io_uring_queue_destroy( struct netcode_io_uring_queue_t * queue )
+{
+    if ( queue->sqes )
+        munmap( queue->sqes, queue->sqes_bytes );
 
-    (void) start;
+    if ( queue->cq_ring && queue->cq_ring != queue->sq_ring )
+        munmap( queue->cq_ring, queue->cq_ring_bytes );
 
-    netcode_write_uint64( &buffer, challenge_token->client_id );
+    if ( queue->sq_ring )
+        munmap( queue->sq_ring, queue->sq_ring_bytes );
 
-    netcode_write_bytes( &buffer, challenge_token->user_data, NETCODE_USER_DATA_BYTES ); 
+    if ( queue->fd > 0 )
+        close( queue->fd );
 
-    netcode_assert( buffer - start <= NETCODE_CHALLENGE_TOKEN_BYTES - NETCODE_MAC_BYTES );
+    memset( queue, 0, sizeof( struct netcode_io_uring_queue_t ) );
 }
 
-int netcode_encrypt_challenge_token( uint8_t * buffer, int buffer_length, uint64_t sequence, uint8_t * key )
+int netcode_io_uring_queue_create( struct netcode_io_uring_queue_t * queue, unsigned num_entries, unsigned num_completions )
 {
-    netcode_assert( buffer );
-    netcode_assert( buffer_length >= NETCODE_CHALLENGE_TOKEN_BYTES );
-    netcode_assert( key );
+    memset( queue, 0, sizeof( struct netcode_io_uring_queue_t ) );
 
-    (void) buffer_length;
+    struct io_uring_params params;
+    memset( &params, 0, sizeof( params ) );
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = num_completions;
 
-    uint8_t nonce[12];
+    queue->fd = (int) syscall( __NR_io_uring_setup, num_entries, &params );
+    if ( queue->fd < 0 )
     {
-        uint8_t * p = nonce;
-        netcode_write_uint32( &p, 0 );
-        netcode_write_uint64( &p, sequence );
+        queue->fd = 0;
+        return NETCODE_ERROR;
     }
 
-    return netcode_encrypt_aead( buffer, NETCODE_CHALLENGE_TOKEN_BYTES - NETCODE_MAC_BYTES, NULL, 0, nonce, key );
-}
-
-int netcode_decrypt_challenge_token( uint8_t * buffer, int buffer_length, uint64_t sequence, uint8_t * key )
-{
-    netcode_assert( buffer );
-    netcode_assert( buffer_length >= NETCODE_CHALLENGE_TOKEN_BYTES );
-    netcode_assert( key );
-
-    (void) buffer_length;
+    queue->sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+    queue->cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
 
-    uint8_t nonce[12];
+    if ( params.features & IORING_FEAT_SINGLE_MMAP )
     {
-        uint8_t * p = nonce;
-        netcode_write_uint32( &p, 0 );
-        netcode_write_uint64( &p, sequence );
+        if ( queue->cq_ring_bytes > queue->sq_ring_bytes )
+            queue->sq_ring_bytes = queue->cq_ring_bytes;
+        queue->cq_ring_bytes = queue->sq_ring_bytes;
     }
 
-    return netcode_decrypt_aead( buffer, NETCODE_CHALLENGE_TOKEN_BYTES, NULL, 0, nonce, key );
-}
-
-int netcode_read_challenge_token( uint8_t * buffer, int buffer_length, struct netcode_challenge_token_t * challenge_token )
-{
-    netcode_assert( buffer );
-    netcode_assert( challenge_token );
-
-    if ( buffer_length < NETCODE_CHALLENGE_TOKEN_BYTES )
+    void * sq_ring = mmap( NULL, queue->sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, queue->fd, IORING_OFF_SQ_RING );
+    if ( sq_ring == MAP_FAILED )
+    {
+        netcode_io_uring_queue_destroy( queue );
         return NETCODE_ERROR;
+    }
+    queue->sq_ring = sq_ring;
 
-    uint8_t * start = buffer;
+    if ( params.features & IORING_FEAT_SINGLE_MMAP )
+    {
+        queue->cq_ring = queue->sq_ring;
+    }
+    else
+    {
+        void * cq_ring = mmap( NULL, queue->cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, queue->fd, IORING_OFF_CQ_RING );
+        if ( cq_ring == MAP_FAILED )
+        {
+            netcode_io_uring_queue_destroy( queue );
+            return NETCODE_ERROR;
+        }
+        queue->cq_ring = cq_ring;
+    }
 
-    (void) start;
-    
-    challenge_token->client_id = netcode_read_uint64( &buffer );
+    queue->sqes_bytes = params.sq_entries * sizeof( struct io_uring_sqe );
+    void * sqes = mmap( NULL, queue->sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, queue->fd, IORING_OFF_SQES );
+    if ( sqes == MAP_FAILED )
+    {
+        netcode_io_uring_queue_destroy( queue );
+        return NETCODE_ERROR;
+    }
+    queue->sqes = (struct io_uring_sqe*) sqes;
 
-    netcode_read_bytes( &buffer, challenge_token->user_data, NETCODE_USER_DATA_BYTES );
+    uint8_t * sq = (uint8_t*) queue->sq_ring;
+    uint8_t * cq = (uint8_t*) queue->cq_ring;
 
-    netcode_assert( buffer - start == 8 + NETCODE_USER_DATA_BYTES );
+    queue->sq_tail = (unsigned*) ( sq + params.sq_off.tail );
+    queue->sq_mask = (unsigned*) ( sq + params.sq_off.ring_mask );
+    queue->sq_array = (unsigned*) ( sq + params.sq_off.array );
+    queue->cq_head = (unsigned*) ( cq + params.cq_off.head );
+    queue->cq_tail = (unsigned*) ( cq + params.cq_off.tail );
+    queue->cq_mask = (unsigned*) ( cq + params.cq_off.ring_mask );
+    queue->cqes = (struct io_uring_cqe*) ( cq + params.cq_off.cqes );
 
     return NETCODE_OK;
 }
 
-// ----------------------------------------------------------------
-
-#define NETCODE_CONNECTION_REQUEST_PACKET           0
-#define NETCODE_CONNECTION_DENIED_PACKET            1
-#define NETCODE_CONNECTION_CHALLENGE_PACKET         2
-#define NETCODE_CONNECTION_RESPONSE_PACKET          3
-#define NETCODE_CONNECTION_KEEP_ALIVE_PACKET        4
-#define NETCODE_CONNECTION_PAYLOAD_PACKET           5
-#define NETCODE_CONNECTION_DISCONNECT_PACKET        6
-#define NETCODE_CONNECTION_NUM_PACKETS              7
-
-struct netcode_connection_request_packet_t
-{
-    uint8_t packet_type;
-    uint8_t version_info[NETCODE_VERSION_INFO_BYTES];
-    uint64_t protocol_id;
-    uint64_t connect_token_expire_timestamp;
-    uint8_t connect_token_nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
-    uint8_t connect_token_data[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
-};
-
-struct netcode_connection_denied_packet_t
+struct io_uring_sqe * netcode_io_uring_queue_get_sqe( struct netcode_io_uring_queue_t * queue, uint64_t user_data )
 {
-    uint8_t packet_type;
-};
+    // IMPORTANT: only this thread writes the submission tail, and every submission is entered before
+    // the next batch is queued, so the ring never holds more entries than it was created with
+
+    unsigned tail = *queue->sq_tail;
+    unsigned index = tail & *queue->sq_mask;
+    struct io_uring_sqe * sqe = &queue->sqes[index];
+    memset( sqe, 0, sizeof( struct io_uring_sqe ) );
+    sqe->user_data = user_data;
+    queue->sq_array[index] = index;
+    __atomic_store_n( queue->sq_tail, tail + 1, __ATOMIC_RELEASE );
+    return sqe;
+}
 
-struct netcode_connection_challenge_packet_t
+int netcode_io_uring_queue_pop_cqe( struct netcode_io_uring_queue_t * queue, struct io_uring_cqe * cqe )
 {
-    uint8_t packet_type;
-    uint64_t challenge_token_sequence;
-    uint8_t challenge_token_data[NETCODE_CHALLENGE_TOKEN_BYTES];
-};
+    unsigned head = *queue->cq_head;
+    if ( head == __atomic_load_n( queue->cq_tail, __ATOMIC_ACQUIRE ) )
+        return 0;
+    *cqe = queue->cqes[head & *queue->cq_mask];
+    __atomic_store_n( queue->cq_head, head + 1, __ATOMIC_RELEASE );
+    return 1;
+}
 
-struct netcode_connection_response_packet_t
+void netcode_io_uring_add_buffer( struct netcode_io_uring_t * ring, int buffer_id )
 {
-    uint8_t packet_type;
-    uint64_t challenge_token_sequence;
-    uint8_t challenge_token_data[NETCODE_CHALLENGE_TOKEN_BYTES];
-};
+    const int mask = NETCODE_IO_URING_NUM_BUFFERS - 1;
+    struct io_uring_buf * buffer = &ring->buffer_ring->bufs[( ring->buffer_ring->tail + ring->num_recycled_buffers ) & mask];
+    buffer->addr = (uint64_t) (uintptr_t) ( ring->buffers + (size_t) buffer_id * NETCODE_IO_URING_BUFFER_BYTES );
+    buffer->len = NETCODE_IO_URING_BUFFER_BYTES;
+    buffer->bid = (uint16_t) buffer_id;
+    ring->num_recycled_buffers++;
+}
 
-struct netcode_connection_keep_alive_packet_t
+void netcode_io_uring_publish_buffers( struct netcode_io_uring_t * ring )
 {
-    uint8_t packet_type;
-    int client_index;
-    int max_clients;
-};
+    if ( ring->num_recycled_buffers == 0 )
+        return;
+    __atomic_store_n( &ring->buffer_ring->tail, (uint16_t) ( ring->buffer_ring->tail + ring->num_recycled_buffers ), __ATOMIC_RELEASE );
+    ring->num_recycled_buffers = 0;
+}
 
-struct netcode_connection_payload_packet_t
+void netcode_io_uring_destroy( struct netcode_io_uring_t * ring )
 {
-    uint8_t packet_type;
-    uint32_t payload_bytes;
-    uint8_t payload_data[1];
-};
+    netcode_assert( ring );
 
-struct netcode_connection_disconnect_packet_t
-{
-    uint8_t packet_type;
-};
+    if ( ring->receive_armed )
+    {
+        // ring teardown is asynchronous in the kernel. cancel the multishot receive and wait for its final
+        // completion, otherwise it keeps a reference to the socket and the port stays bound after we return
 
-struct netcode_connection_payload_packet_t * netcode_create_payload_packet( int payload_bytes, void * allocator_context, void* (*allocate_function)(void*,size_t) )
-{
-    netcode_assert( payload_bytes >= 0 );
-    netcode_assert( payload_bytes <= NETCODE_MAX_PAYLOAD_BYTES );
+        struct io_uring_sqe * sqe = netcode_io_uring_queue_get_sqe( &ring->receive_queue, 0 );
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = NETCODE_IO_URING_RECEIVE_USER_DATA;
 
-    if ( allocate_function == NULL )
-    {
-        allocate_function = netcode_default_allocate_function;
+        int to_submit = 1;
+        int iterations = 0;
+        while ( ring->receive_armed && iterations++ < 1000 )
+        {
+            if ( netcode_io_uring_enter( &ring->receive_queue, to_submit, 1 ) < 0 && errno != EINTR )
+                break;
+            to_submit = 0;
+            struct io_uring_cqe cqe;
+            while ( netcode_io_uring_queue_pop_cqe( &ring->receive_queue, &cqe ) )
+            {
+                if ( cqe.user_data == NETCODE_IO_URING_RECEIVE_USER_DATA && !( cqe.flags & IORING_CQE_F_MORE ) )
+                    ring->receive_armed = 0;
+            }
+        }
     }
 
-    struct netcode_connection_payload_packet_t * packet = (struct netcode_connection_payload_packet_t*) 
-        allocate_function( allocator_context, sizeof( struct netcode_connection_payload_packet_t ) + payload_bytes );
+    netcode_io_uring_queue_destroy( &ring->receive_queue );
+    netcode_io_uring_queue_destroy( &ring->send_queue );
 
-    if ( !packet )
-        return NULL;
-    
-    packet->packet_type = NETCODE_CONNECTION_PAYLOAD_PACKET;
-    packet->payload_bytes = payload_bytes;
+    if ( ring->buffer_ring )
+        munmap( ring->buffer_ring, ring->buffer_ring_bytes );
 
-    return packet;
+    if ( ring->buffers )
+        ring->free_function( ring->allocator_context, ring->buffers );
+
+    ring->free_function( ring->allocator_context, ring );
 }
 
-struct netcode_context_t
+struct netcode_io_uring_t * netcode_io_uring_create( struct netcode_socket_t * socket, 
+                                                     void * allocator_context, 
+                                                     void * (*allocate_function)(void*,size_t), 
+                                                     void (*free_function)(void*,void*) )
 {
-    uint8_t write_packet_key[NETCODE_KEY_BYTES];
-    uint8_t read_packet_key[NETCODE_KEY_BYTES];
-};
+    netcode_assert( socket );
+    netcode_assert( socket->handle != 0 );
+    netcode_assert( allocate_function );
+    netcode_assert( free_function );
 
-int netcode_sequence_number_bytes_required( uint64_t sequence )
-{
-    int i;
-    uint64_t mask = 0xFF00000000000000UL;
-    for ( i = 0; i < 7; ++i )
-    {
-        if ( sequence & mask )
-            break;
-        mask >>= 8;
-    }
-    return 8 - i;
-}
+    struct netcode_io_uring_t * ring = (struct netcode_io_uring_t*) allocate_function( allocator_context, sizeof( struct netcode_io_uring_t ) );
+    if ( !ring )
+        return NULL;
 
-int netcode_write_packet( void * packet, uint8_t * buffer, int buffer_length, uint64_t sequence, uint8_t * write_packet_key, uint64_t protocol_id )
-{
-    netcode_assert( packet );
-    netcode_assert( buffer );
-    netcode_assert( write_packet_key );
+    memset( ring, 0, sizeof( struct netcode_io_uring_t ) );
 
-    (void) buffer_length;
+    ring->allocator_context = allocator_context;
+    ring->free_function = free_function;
+    ring->handle = socket->handle;
 
-    uint8_t packet_type = ((uint8_t*)packet)[0];
+    // receive and send use separate rings, so waiting on a batch of sends never has to step over receive completions
 
-    if ( packet_type == NETCODE_CONNECTION_REQUEST_PACKET )
+    if ( netcode_io_uring_queue_create( &ring->receive_queue, 8, NETCODE_IO_URING_NUM_BUFFERS * 2 ) != NETCODE_OK ||
+         netcode_io_uring_queue_create( &ring->send_queue, NETCODE_SOCKET_BATCH_SIZE, NETCODE_SOCKET_BATCH_SIZE * 2 ) != NETCODE_OK )
     {
-        // connection request packet: first byte is zero
-
-        netcode_assert( buffer_length >= 1 + 13 + 8 + 8 + NETCODE_CONNECT_TOKEN_NONCE_BYTES + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+        netcode_io_uring_destroy( ring );
+        return NULL;
+    }
 
-        struct netcode_connection_request_packet_t * p = (struct netcode_connection_request_packet_t*) packet;
+    // register a ring of provided buffers. the kernel picks a buffer per datagram and we hand it back once processed
 
-        uint8_t * start = buffer;
+    ring->buffer_ring_bytes = sizeof( struct io_uring_buf ) * NETCODE_IO_URING_NUM_BUFFERS;
+    void * buffer_ring = mmap( NULL, ring->buffer_ring_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if ( buffer_ring == MAP_FAILED )
+    {
+        netcode_io_uring_destroy( ring );
+        return NULL;
+    }
+    ring->buffer_ring = (struct io_uring_buf_ring*) buffer_ring;
 
-        netcode_write_uint8( &buffer, NETCODE_CONNECTION_REQUEST_PACKET );
-        netcode_write_bytes( &buffer, p->version_info, NETCODE_VERSION_INFO_BYTES );
-        netcode_write_uint64( &buffer, p->protocol_id );
-        netcode_write_uint64( &buffer, p->connect_token_expire_timestamp );
-        netcode_write_bytes( &buffer, p->connect_token_nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
-        netcode_write_bytes( &buffer, p->connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    ring->buffers = (uint8_t*) allocate_function( allocator_context, (size_t) NETCODE_IO_URING_NUM_BUFFERS * NETCODE_IO_URING_BUFFER_BYTES );
+    if ( !ring->buffers )
+    {
+        netcode_io_uring_destroy( ring );
+        return NULL;
+    }
 
-        netcode_assert( buffer - start == 1 + 13 + 8 + 8 + NETCODE_CONNECT_TOKEN_NONCE_BYTES + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    struct io_uring_buf_reg buffer_registration;
+    memset( &buffer_registration, 0, sizeof( buffer_registration ) );
+    buffer_registration.ring_addr = (uint64_t) (uintptr_t) ring->buffer_ring;
+    buffer_registration.ring_entries = NETCODE_IO_URING_NUM_BUFFERS;
+    buffer_registration.bgid = NETCODE_IO_URING_BUFFER_GROUP;
 
-        return (int) ( buffer - start );
-    }
-    else
+    if ( syscall( __NR_io_uring_register, ring->receive_queue.fd, IORING_REGISTER_PBUF_RING, &buffer_registration, 1 ) != 0 )
     {
-        // *** encrypted packets ***
+        netcode_io_uring_destroy( ring );
+        return NULL;
+    }
 
-        // write the prefix byte (this is a combination of the packet type and number of sequence bytes)
+    int i;
+    for ( i = 0; i < NETCODE_IO_URING_NUM_BUFFERS; ++i )
+    {
+        netcode_io_uring_add_buffer( ring, i );
+    }
 
-        uint8_t * start = buffer;
+    netcode_io_uring_publish_buffers( ring );
 
-        uint8_t sequence_bytes = (uint8_t) netcode_sequence_number_bytes_required( sequence );
+    ring->receive_message.msg_namelen = sizeof( struct sockaddr_storage );
 
-        netcode_assert( sequence_bytes >= 1 );
-        netcode_assert( sequence_bytes <= 8 );
+    return ring;
+}
 
-        netcode_assert( packet_type <= 0xF );
+void netcode_io_uring_submit_receive( struct netcode_io_uring_t * ring )
+{
+    netcode_assert( ring );
 
-        uint8_t prefix_byte = packet_type | ( sequence_bytes << 4 );
+    netcode_io_uring_publish_buffers( ring );
 
-        netcode_write_uint8( &buffer, prefix_byte );
+    unsigned to_submit = 0;
 
-        // write the variable length sequence number [1,8] bytes.
+    if ( !ring->receive_armed )
+    {
+        // one multishot receive keeps posting a completion per datagram until it runs out of buffers
+
+        struct io_uring_sqe * sqe = netcode_io_uring_queue_get_sqe( &ring->receive_queue, NETCODE_IO_URING_RECEIVE_USER_DATA );
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = ring->handle;
+        sqe->addr = (uint64_t) (uintptr_t) &ring->receive_message;
+        sqe->len = 1;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = NETCODE_IO_URING_BUFFER_GROUP;
+        to_submit = 1;
+    }
 
-        uint64_t sequence_temp = sequence;
+    int result = netcode_io_uring_enter( &ring->receive_queue, to_submit, 0 );
 
-        int i;
-        for ( i = 0; i < sequence_bytes; ++i )
+    if ( result < 0 )
+    {
+        if ( errno != EAGAIN && errno != EINTR )
         {
-            netcode_write_uint8( &buffer, (uint8_t) ( sequence_temp & 0xFF ) );
-            sequence_temp >>= 8;
+            netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: io_uring_enter failed with error %d\n", errno );
         }
+        return;
+    }
 
-        // write packet data according to type. this data will be encrypted.
+    if ( to_submit )
+    {
+        ring->receive_armed = 1;
+    }
+}
 
-        uint8_t * encrypted_start = buffer;
+int netcode_io_uring_receive_packet( struct netcode_io_uring_t * ring, struct netcode_address_t * from, uint8_t ** packet_data, int * buffer_id )
+{
+    netcode_assert( ring );
+    netcode_assert( from );
+    netcode_assert( packet_data );
+    netcode_assert( buffer_id );
 
-        switch ( packet_type )
+    struct io_uring_cqe cqe;
+
+    while ( netcode_io_uring_queue_pop_cqe( &ring->receive_queue, &cqe ) )
+    {
+        if ( !( cqe.flags & IORING_CQE_F_MORE ) )
         {
-            case NETCODE_CONNECTION_DENIED_PACKET:
-            {
-                // ...
-            }
-            break;
+            // the multishot receive has stopped, usually because every buffer is in use. re-arm on the next submit
+            ring->receive_armed = 0;
+        }
 
-            case NETCODE_CONNECTION_CHALLENGE_PACKET:
+        if ( !( cqe.flags & IORING_CQE_F_BUFFER ) )
+        {
+            if ( cqe.res < 0 && cqe.res != -ENOBUFS )
             {
-                struct netcode_connection_challenge_packet_t * p = (struct netcode_connection_challenge_packet_t*) packet;
-                netcode_write_uint64( &buffer, p->challenge_token_sequence );
-                netcode_write_bytes( &buffer, p->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
+                netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: io_uring receive failed with error %d\n", -cqe.res );
             }
-            break;
+            continue;
+        }
 
-            case NETCODE_CONNECTION_RESPONSE_PACKET:
-            {
-                struct netcode_connection_response_packet_t * p = (struct netcode_connection_response_packet_t*) packet;
-                netcode_write_uint64( &buffer, p->challenge_token_sequence );
-                netcode_write_bytes( &buffer, p->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
-            }
-            break;
+        const int id = (int) ( cqe.flags >> IORING_CQE_BUFFER_SHIFT );
 
-            case NETCODE_CONNECTION_KEEP_ALIVE_PACKET:
-            {
-                struct netcode_connection_keep_alive_packet_t * p = (struct netcode_connection_keep_alive_packet_t*) packet;
-                netcode_write_uint32( &buffer, p->client_index );
-                netcode_write_uint32( &buffer, p->max_clients );
-            }
-            break;
+        uint8_t * buffer = ring->buffers + (size_t) id * NETCODE_IO_URING_BUFFER_BYTES;
 
-            case NETCODE_CONNECTION_PAYLOAD_PACKET:
-            {
-                struct netcode_connection_payload_packet_t * p = (struct netcode_connection_payload_packet_t*) packet;
+        struct io_uring_recvmsg_out * header = (struct io_uring_recvmsg_out*) buffer;
 
-                netcode_assert( p->payload_bytes <= NETCODE_MAX_PAYLOAD_BYTES );
+        struct sockaddr_storage * sockaddr_from = (struct sockaddr_storage*) ( buffer + sizeof( struct io_uring_recvmsg_out ) );
 
-                netcode_write_bytes( &buffer, p->payload_data, p->payload_bytes );
-            }
-            break;
+        if ( cqe.res <= 0 || ( header->flags & MSG_TRUNC ) || header->payloadlen == 0 || !netcode_address_from_sockaddr( from, sockaddr_from ) )
+        {
+            netcode_io_uring_add_buffer( ring, id );
+            continue;
+        }
 
-            case NETCODE_CONNECTION_DISCONNECT_PACKET:
-            {
-                // ...
-            }
-            break;
+        *packet_data = buffer + sizeof( struct io_uring_recvmsg_out ) + ring->receive_message.msg_namelen;
+        *buffer_id = id;
 
-            default:
-                netcode_assert( 0 );
-        }
+        return (int) header->payloadlen;
+    }
 
-        netcode_assert( buffer - start <= buffer_length - NETCODE_MAC_BYTES );
+    return 0;
+}
 
-        uint8_t * encrypted_finish = buffer;
+void netcode_io_uring_recycle_buffer( struct netcode_io_uring_t * ring, int buffer_id )
+{
+    netcode_assert( ring );
+    netcode_assert( buffer_id >= 0 );
+    netcode_assert( buffer_id < NETCODE_IO_URING_NUM_BUFFERS );
 
-        // encrypt the per-packet packet written with the prefix byte, protocol id and version as the associated data. this must match to decrypt.
+    netcode_io_uring_add_buffer( ring, buffer_id );
+}
 
-        uint8_t additional_data[NETCODE_VERSION_INFO_BYTES+8+1];
+int netcode_io_uring_send_packets( struct netcode_io_uring_t * ring, struct netcode_socket_batch_t * batch, int first_packet )
+{
+    netcode_assert( ring );
+    netcode_assert( batch );
+    netcode_assert( first_packet >= 0 );
+    netcode_assert( first_packet < batch->num_packets );
+
+    int num_messages = batch->num_packets - first_packet;
+
+    int i;
+    for ( i = 0; i < num_messages; ++i )
+    {
+        const int index = first_packet + i;
+
+        ring->send_iov[i].iov_base = batch->packet_data[index];
+        ring->send_iov[i].iov_len = batch->packet_bytes[index];
+
+        struct msghdr * message = &ring->send_message[i];
+        memset( message, 0, sizeof( struct msghdr ) );
+        message->msg_name = &ring->send_address[i];
+        message->msg_namelen = netcode_address_to_sockaddr( &batch->address[index], &ring->send_address[i] );
+        message->msg_iov = &ring->send_iov[i];
+        message->msg_iovlen = 1;
+
+        struct io_uring_sqe * sqe = netcode_io_uring_queue_get_sqe( &ring->send_queue, (uint64_t) i );
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = ring->handle;
+        sqe->addr = (uint64_t) (uintptr_t) message;
+        sqe->len = 1;
+    }
+
+    // submit the whole batch and wait for it in one call. udp sends complete inline, so this doesn't block,
+    // and the batch memory is free to be reused as soon as it returns
+
+    int num_submitted = 0;
+    int num_completed = 0;
+
+    while ( num_completed < num_messages )
+    {
+        int result = netcode_io_uring_enter( &ring->send_queue, (unsigned) ( num_messages - num_submitted ), (unsigned) ( num_messages - num_completed ) );
+
+        if ( result < 0 && errno != EINTR )
         {
-            uint8_t * p = additional_data;
-            netcode_write_bytes( &p, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
-            netcode_write_uint64( &p, protocol_id );
-            netcode_write_uint8( &p, prefix_byte );
+            netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: io_uring_enter failed with error %d\n", errno );
+            return 0;
         }
 
-        uint8_t nonce[12];
+        if ( result > 0 )
         {
-            uint8_t * p = nonce;
-            netcode_write_uint32( &p, 0 );
-            netcode_write_uint64( &p, sequence );
+            num_submitted += result;
         }
 
-        if ( netcode_encrypt_aead( encrypted_start, 
-                                   encrypted_finish - encrypted_start, 
-                                   additional_data, sizeof( additional_data ), 
-                                   nonce, write_packet_key ) != NETCODE_OK )
+        struct io_uring_cqe cqe;
+        while ( netcode_io_uring_queue_pop_cqe( &ring->send_queue, &cqe ) )
         {
-            return NETCODE_ERROR;
+            num_completed++;
         }
+    }
 
-        buffer += NETCODE_MAC_BYTES;
+    return num_messages;
+}
 
-        netcode_assert( buffer - start <= buffer_length );
+#endif // #if NETCODE_IO_URING
 
-        return (int) ( buffer - start );
-    }
+// ----------------------------------------------------------------
+
+void netcode_write_uint8( uint8_t ** p, uint8_t value )
+{
+    **p = value;
+    ++(*p);
 }
 
-struct netcode_replay_protection_t
+void netcode_write_uint16( uint8_t ** p, uint16_t value )
 {
-    uint64_t most_recent_sequence;
-    uint64_t received_packet[NETCODE_REPLAY_PROTECTION_BUFFER_SIZE];
-};
+    (*p)[0] = value & 0xFF;
+    (*p)[1] = value >> 8;
+    *p += 2;
+}
 
-void netcode_replay_protection_reset( struct netcode_replay_protection_t * replay_protection )
+void netcode_write_uint32( uint8_t ** p, uint32_t value )
 {
-    netcode_assert( replay_protection );
-    replay_protection->most_recent_sequence = 0;
-    memset( replay_protection->received_packet, 0xFF, sizeof( replay_protection->received_packet ) );
+    (*p)[0] = value & 0xFF;
+    (*p)[1] = ( value >> 8  ) & 0xFF;
+    (*p)[2] = ( value >> 16 ) & 0xFF;
+    (*p)[3] = value >> 24;
+    *p += 4;
 }
 
-int netcode_replay_protection_already_received( struct netcode_replay_protection_t * replay_protection, uint64_t sequence )
+void netcode_write_uint64( uint8_t ** p, uint64_t value )
 {
-    netcode_assert( replay_protection );
+    (*p)[0] = value & 0xFF;
+    (*p)[1] = ( value >> 8  ) & 0xFF;
+    (*p)[2] = ( value >> 16 ) & 0xFF;
+    (*p)[3] = ( value >> 24 ) & 0xFF;
+    (*p)[4] = ( value >> 32 ) & 0xFF;
+    (*p)[5] = ( value >> 40 ) & 0xFF;
+    (*p)[6] = ( value >> 48 ) & 0xFF;
+    (*p)[7] = value >> 56;
+    *p += 8;
+}
 
-    if ( sequence + NETCODE_REPLAY_PROTECTION_BUFFER_SIZE <= replay_protection->most_recent_sequence )
-        return 1;
-    
-    int index = (int) ( sequence % NETCODE_REPLAY_PROTECTION_BUFFER_SIZE );
+void netcode_write_bytes( uint8_t ** p, uint8_t * byte_array, int num_bytes )
+{
+    int i;
+    for ( i = 0; i < num_bytes; ++i )
+    {
+        netcode_write_uint8( p, byte_array[i] );
+    }
+}
 
-    if ( replay_protection->received_packet[index] == UINT64_MAX )
-        return 0;
+uint8_t netcode_read_uint8( uint8_t ** p )
+{
+    uint8_t value = **p;
+    ++(*p);
+    return value;
+}
 
-    if ( replay_protection->received_packet[index] >= sequence )
-        return 1;
+uint16_t netcode_read_uint16( uint8_t ** p )
+{
+    uint16_t value;
+    value = (*p)[0];
+    value |= ( ( (uint16_t)( (*p)[1] ) ) << 8 );
+    *p += 2;
+    return value;
+}
 
-    return 0;
+uint32_t netcode_read_uint32( uint8_t ** p )
+{
+    uint32_t value;
+    value  = (*p)[0];
+    value |= ( ( (uint32_t)( (*p)[1] ) ) << 8 );
+    value |= ( ( (uint32_t)( (*p)[2] ) ) << 16 );
+    value |= ( ( (uint32_t)( (*p)[3] ) ) << 24 );
+    *p += 4;
+    return value;
 }
 
-void netcode_replay_protection_advance_sequence( struct netcode_replay_protection_t * replay_protection, uint64_t sequence )
+uint64_t netcode_read_uint64( uint8_t ** p )
 {
-    netcode_assert( replay_protection );
+    uint64_t value;
+    value  = (*p)[0];
+    value |= ( ( (uint64_t)( (*p)[1] ) ) << 8  );
+    value |= ( ( (uint64_t)( (*p)[2] ) ) << 16 );
+    value |= ( ( (uint64_t)( (*p)[3] ) ) << 24 );
+    value |= ( ( (uint64_t)( (*p)[4] ) ) << 32 );
+    value |= ( ( (uint64_t)( (*p)[5] ) ) << 40 );
+    value |= ( ( (uint64_t)( (*p)[6] ) ) << 48 );
+    value |= ( ( (uint64_t)( (*p)[7] ) ) << 56 );
+    *p += 8;
+    return value;
+}
 
-    if ( sequence > replay_protection->most_recent_sequence )
-        replay_protection->most_recent_sequence = sequence;
+void netcode_read_bytes( uint8_t ** p, uint8_t * byte_array, int num_bytes )
+{
+    int i;
+    for ( i = 0; i < num_bytes; ++i )
+    {
+        byte_array[i] = netcode_read_uint8( p );
+    }
+}
 
-    int index = (int) ( sequence % NETCODE_REPLAY_PROTECTION_BUFFER_SIZE );
+// ----------------------------------------------------------------
 
-    replay_protection->received_packet[index] = sequence;
+void netcode_generate_key( uint8_t * key )
+{
+    netcode_assert( key );
+    randombytes_buf( key, NETCODE_KEY_BYTES );
 }
 
-void * netcode_read_packet( uint8_t * buffer, 
-                            int buffer_length, 
-                            uint64_t * sequence, 
-                            uint8_t * read_packet_key, 
-                            uint64_t protocol_id, 
-                            uint64_t current_timestamp, 
-                            uint8_t * private_key, 
-                            uint8_t * allowed_packets, 
-                            struct netcode_replay_protection_t * replay_protection, 
-                            void * allocator_context, 
-                            void* (*allocate_function)(void*,size_t) )
+void netcode_generate_nonce( uint8_t * nonce )
 {
-    netcode_assert( sequence );
-    netcode_assert( allowed_packets );
+    netcode_assert( nonce );
+    randombytes_buf( nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+}
 
-    *sequence = 0;
+void netcode_random_bytes( uint8_t * data, int bytes )
+{
+    netcode_assert( data );
+    netcode_assert( bytes > 0 );
+    randombytes_buf( data, bytes );
+}
 
-    if ( allocate_function == NULL )
-    {
-        allocate_function = netcode_default_allocate_function;
-    }
+int netcode_encrypt_aead_bignonce( uint8_t * message, uint64_t message_length, 
+                                   uint8_t * additional, uint64_t additional_length,
+                                   NETCODE_CONST uint8_t * nonce,
+                                   NETCODE_CONST uint8_t * key )
+{
+    unsigned long long encrypted_length;
 
-    if ( buffer_length < 1 )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored packet. buffer length is less than 1\n" );
-        return NULL;
-    }
+    int result = crypto_aead_xchacha20poly1305_ietf_encrypt( message, &encrypted_length,
+                                                             message, (unsigned long long) message_length,
+                                                             additional, (unsigned long long) additional_length,
+                                                             NULL, nonce, key );
+    
+    if ( result != 0 )
+        return NETCODE_ERROR;
 
-    uint8_t * start = buffer;
+    netcode_assert( encrypted_length == message_length + NETCODE_MAC_BYTES );
 
-    uint8_t prefix_byte = netcode_read_uint8( &buffer );
+    return NETCODE_OK;
+}
 
-    if ( prefix_byte == NETCODE_CONNECTION_REQUEST_PACKET )
-    {
-        // connection request packet: first byte is zero
+int netcode_decrypt_aead_bignonce( uint8_t * message, uint64_t message_length, 
+                                   uint8_t * additional, uint64_t additional_length,
+                                   uint8_t * nonce,
+                                   uint8_t * key )
+{
+    unsigned long long decrypted_length;
 
-        if ( !allowed_packets[NETCODE_CONNECTION_REQUEST_PACKET] )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. packet type is not allowed\n" );
-            return NULL;
-        }
+    int result = crypto_aead_xchacha20poly1305_ietf_decrypt( message, &decrypted_length,
+                                                             NULL,
+                                                             message, (unsigned long long) message_length,
+                                                             additional, (unsigned long long) additional_length,
+                                                             nonce, key );
 
-        if ( buffer_length != 1 + NETCODE_VERSION_INFO_BYTES + 8 + 8 + NETCODE_CONNECT_TOKEN_NONCE_BYTES + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. bad packet length (expected %d, got %d)\n", 1 + NETCODE_VERSION_INFO_BYTES + 8 + 8 + 8 + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, buffer_length );
-            return NULL;
-        }
+    if ( result != 0 )
+        return NETCODE_ERROR;
 
-        if ( !private_key )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. no private key\n" );
-            return NULL;
-        }
+    netcode_assert( decrypted_length == message_length - NETCODE_MAC_BYTES );
 
-        uint8_t version_info[NETCODE_VERSION_INFO_BYTES];
-        netcode_read_bytes( &buffer, version_info, NETCODE_VERSION_INFO_BYTES );
-        if ( version_info[0]  != 'N' || 
-             version_info[1]  != 'E' || 
-             version_info[2]  != 'T' || 
-             version_info[3]  != 'C' || 
-             version_info[4]  != 'O' ||
-             version_info[5]  != 'D' ||
-             version_info[6]  != 'E' ||
-             version_info[7]  != ' ' || 
-             version_info[8]  != '1' ||
-             version_info[9]  != '.' ||
-             version_info[10] != '0' ||
-             version_info[11] != '2' ||
-             version_info[12] != '\0' )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. bad version info\n" );
-            return NULL;
-        }
+    return NETCODE_OK;
+}
 
-        uint64_t packet_protocol_id = netcode_read_uint64( &buffer );
-        if ( packet_protocol_id != protocol_id )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. wrong protocol id. expected %.16" PRIx64 ", got %.16" PRIx64 "\n", 
-                protocol_id, packet_protocol_id );
-            return NULL;
-        }
+int netcode_encrypt_aead( uint8_t * message, uint64_t message_length, 
+                          uint8_t * additional, uint64_t additional_length,
+                          NETCODE_CONST uint8_t * nonce,
+                          NETCODE_CONST uint8_t * key )
+{
+    unsigned long long encrypted_length;
 
-        uint64_t packet_connect_token_expire_timestamp = netcode_read_uint64( &buffer );
-        if ( packet_connect_token_expire_timestamp <= current_timestamp )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. connect token expired\n" );
-            return NULL;
-        }
+    int result = crypto_aead_chacha20poly1305_ietf_encrypt( message, &encrypted_length,
+                                                            message, (unsigned long long) message_length,
+                                                            additional, (unsigned long long) additional_length,
+                                                            NULL, nonce, key );
+    
+    if ( result != 0 )
+        return NETCODE_ERROR;
 
-        uint8_t packet_connect_token_nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
-        netcode_read_bytes(&buffer, packet_connect_token_nonce, sizeof(packet_connect_token_nonce));
+    netcode_assert( encrypted_length == message_length + NETCODE_MAC_BYTES );
 
-        netcode_assert( buffer - start == 1 + NETCODE_VERSION_INFO_BYTES + 8 + 8 + NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+    return NETCODE_OK;
+}
 
-        if ( netcode_decrypt_connect_token_private( buffer, 
-                                                    NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, 
-                                                    version_info, 
-                                                    protocol_id, 
-                                                    packet_connect_token_expire_timestamp, 
-                                                    packet_connect_token_nonce, 
-                                                    private_key ) != NETCODE_OK )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. connect token failed to decrypt\n" );
-            return NULL;
-        }
+int netcode_encrypt_aead_to( uint8_t * output, 
+                             NETCODE_CONST uint8_t * message, uint64_t message_length, 
+                             uint8_t * additional, uint64_t additional_length,
+                             NETCODE_CONST uint8_t * nonce,
+                             NETCODE_CONST uint8_t * key )
+{
+    // output may be the message itself, but must not otherwise overlap it
 
-        struct netcode_connection_request_packet_t * packet = (struct netcode_connection_request_packet_t*) 
-            allocate_function( allocator_context, sizeof( struct netcode_connection_request_packet_t ) );
+    unsigned long long encrypted_length;
 
-        if ( !packet )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. failed to allocate packet\n" );
-            return NULL;
-        }
+    int result = crypto_aead_chacha20poly1305_ietf_encrypt( output, &encrypted_length,
+                                                            message, (unsigned long long) message_length,
+                                                            additional, (unsigned long long) additional_length,
+                                                            NULL, nonce, key );
+    
+    if ( result != 0 )
+        return NETCODE_ERROR;
 
-        packet->packet_type = NETCODE_CONNECTION_REQUEST_PACKET;
-        memcpy( packet->version_info, version_info, NETCODE_VERSION_INFO_BYTES );
-        packet->protocol_id = packet_protocol_id;
-        packet->connect_token_expire_timestamp = packet_connect_token_expire_timestamp;
-        memcpy( packet->connect_token_nonce, packet_connect_token_nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
-        netcode_read_bytes( &buffer, packet->connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    netcode_assert( encrypted_length == message_length + NETCODE_MAC_BYTES );
 
-        netcode_assert( buffer - start == 1 + NETCODE_VERSION_INFO_BYTES + 8 + 8 + NETCODE_CONNECT_TOKEN_NONCE_BYTES + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    return NETCODE_OK;
+}
 
-        return packet;
+int netcode_decrypt_aead( uint8_t * message, uint64_t message_length, 
+                          uint8_t * additional, uint64_t additional_length,
+                          uint8_t * nonce,
+                          uint8_t * key )
+{
+    unsigned long long decrypted_length;
+
+    int result = crypto_aead_chacha20poly1305_ietf_decrypt( message, &decrypted_length,
+                                                            NULL,
+                                                            message, (unsigned long long) message_length,
+                                                            additional, (unsigned long long) additional_length,
+                                                            nonce, key );
+
+    if ( result != 0 )
+        return NETCODE_ERROR;
+
+    netcode_assert( decrypted_length == message_length - NETCODE_MAC_BYTES );
+
+    return NETCODE_OK;
+}
+
+// ----------------------------------------------------------------
+
+/*
+    Batched AEAD. Each packet has its own key and nonce, so the single stream chacha20 kernels in sodium can't
+    help with the small packets a server sends every tick. Instead, run eight independent chacha20 states side
+    by side, one per 32 bit lane of an AVX2 register, and generate one 64 byte block for all eight packets at a
+    time. Poly1305 is still computed per packet via sodium. The output is bit for bit what the scalar
+    chacha20poly1305 ietf construction produces, so either side can use either path.
+*/
+
+#define NETCODE_AEAD_BATCH_LANES 8
+
+#if NETCODE_AEAD_AVX2
+
+#define NETCODE_CHACHA20_AVX2_ROTATE( a, bits ) _mm256_or_si256( _mm256_slli_epi32( a, bits ), _mm256_srli_epi32( a, 32 - bits ) )
+
+#define NETCODE_CHACHA20_AVX2_QUARTER_ROUND( a, b, c, d )                                                          \
+    a = _mm256_add_epi32( a, b ); d = _mm256_shuffle_epi8( _mm256_xor_si256( d, a ), rotate16 );                 \
+    c = _mm256_add_epi32( c, d ); b = NETCODE_CHACHA20_AVX2_ROTATE( _mm256_xor_si256( b, c ), 12 );             \
+    a = _mm256_add_epi32( a, b ); d = _mm256_shuffle_epi8( _mm256_xor_si256( d, a ), rotate8 );                  \
+    c = _mm256_add_epi32( c, d ); b = NETCODE_CHACHA20_AVX2_ROTATE( _mm256_xor_si256( b, c ), 7 )
+
+__attribute__(( target( "avx2" ) ))
+static void netcode_chacha20_lanes_block_avx2( uint32_t state[16][NETCODE_AEAD_BATCH_LANES], uint8_t * keystream )
+{
+    // state holds word w of lane l at state[w][l]. writes one 64 byte block per lane to keystream + 64 * lane,
+    // then steps the block counter of every lane
+
+    const __m256i rotate16 = _mm256_set_epi8( 13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                                              13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2 );
+    const __m256i rotate8 = _mm256_set_epi8( 14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+                                             14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3 );
+
+    __m256i x[16];
+    int i;
+    for ( i = 0; i < 16; ++i )
+    {
+        x[i] = _mm256_loadu_si256( (const __m256i*) state[i] );
     }
-    else
+
+    for ( i = 0; i < 10; ++i )
     {
-        // *** encrypted packets ***
+        NETCODE_CHACHA20_AVX2_QUARTER_ROUND( x[0], x[4], x[8], x[12] );
+        NETCODE_CHACHA20_AVX2_QUARTER_ROUND( x[1], x[5], x[9], x[13] );
+        NETCODE_CHACHA20_AVX2_QUARTER_ROUND( x[2], x[6], x[10], x[14] );
+        NETCODE_CHACHA20_AVX2_QUARTER_ROUND( x[3], x[7], x[11], x[15] );
+        NETCODE_CHACHA20_AVX2_QUARTER_ROUND( x[0], x[5], x[10], x[15] );
+        NETCODE_CHACHA20_AVX2_QUARTER_ROUND( x[1], x[6], x[11], x[12] );
+        NETCODE_CHACHA20_AVX2_QUARTER_ROUND( x[2], x[7], x[8], x[13] );
+        NETCODE_CHACHA20_AVX2_QUARTER_ROUND( x[3], x[4], x[9], x[14] );
+    }
 
-        if ( !read_packet_key )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. no read packet key for this address\n" );
-            return NULL;
-        }
+    for ( i = 0; i < 16; ++i )
+    {
+        x[i] = _mm256_add_epi32( x[i], _mm256_loadu_si256( (const __m256i*) state[i] ) );
+    }
 
-        if ( buffer_length < 1 + 1 + NETCODE_MAC_BYTES )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. packet is too small to be valid (%d bytes)\n", buffer_length );
-            return NULL;
-        }
+    // transpose each group of eight words from word major back to lane major, same as the dolbeau avx2 kernel
 
-        // extract the packet type and number of sequence bytes from the prefix byte
+    int half;
+    for ( half = 0; half < 2; ++half )
+    {
+        __m256i * a = x + half * 8;
+
+        __m256i t0 = _mm256_unpacklo_epi32( a[0], a[1] );
+        __m256i t1 = _mm256_unpacklo_epi32( a[2], a[3] );
+        __m256i t2 = _mm256_unpackhi_epi32( a[0], a[1] );
+        __m256i t3 = _mm256_unpackhi_epi32( a[2], a[3] );
+        __m256i t4 = _mm256_unpacklo_epi32( a[4], a[5] );
+        __m256i t5 = _mm256_unpacklo_epi32( a[6], a[7] );
+        __m256i t6 = _mm256_unpackhi_epi32( a[4], a[5] );
+        __m256i t7 = _mm256_unpackhi_epi32( a[6], a[7] );
+
+        __m256i b0 = _mm256_unpacklo_epi64( t0, t1 );
+        __m256i b1 = _mm256_unpackhi_epi64( t0, t1 );
+        __m256i b2 = _mm256_unpacklo_epi64( t2, t3 );
+        __m256i b3 = _mm256_unpackhi_epi64( t2, t3 );
+        __m256i b4 = _mm256_unpacklo_epi64( t4, t5 );
+        __m256i b5 = _mm256_unpackhi_epi64( t4, t5 );
+        __m256i b6 = _mm256_unpacklo_epi64( t6, t7 );
+        __m256i b7 = _mm256_unpackhi_epi64( t6, t7 );
+
+        uint8_t * output = keystream + half * 32;
+        _mm256_storeu_si256( (__m256i*) ( output + 0 * 64 ), _mm256_permute2x128_si256( b0, b4, 0x20 ) );
+        _mm256_storeu_si256( (__m256i*) ( output + 1 * 64 ), _mm256_permute2x128_si256( b1, b5, 0x20 ) );
+        _mm256_storeu_si256( (__m256i*) ( output + 2 * 64 ), _mm256_permute2x128_si256( b2, b6, 0x20 ) );
+        _mm256_storeu_si256( (__m256i*) ( output + 3 * 64 ), _mm256_permute2x128_si256( b3, b7, 0x20 ) );
+        _mm256_storeu_si256( (__m256i*) ( output + 4 * 64 ), _mm256_permute2x128_si256( b0, b4, 0x31 ) );
+        _mm256_storeu_si256( (__m256i*) ( output + 5 * 64 ), _mm256_permute2x128_si256( b1, b5, 0x31 ) );
+        _mm256_storeu_si256( (__m256i*) ( output + 6 * 64 ), _mm256_permute2x128_si256( b2, b6, 0x31 ) );
+        _mm256_storeu_si256( (__m256i*) ( output + 7 * 64 ), _mm256_permute2x128_si256( b3, b7, 0x31 ) );
+    }
 
-        int packet_type = prefix_byte & 0xF;
+    _mm256_storeu_si256( (__m256i*) state[12], _mm256_add_epi32( _mm256_loadu_si256( (const __m256i*) state[12] ), _mm256_set1_epi32( 1 ) ) );
+}
 
-        if ( packet_type >= NETCODE_CONNECTION_NUM_PACKETS )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. packet type %d is invalid\n", packet_type );
-            return NULL;
-        }
+#undef NETCODE_CHACHA20_AVX2_QUARTER_ROUND
+#undef NETCODE_CHACHA20_AVX2_ROTATE
 
-        if ( !allowed_packets[packet_type] )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. packet type %d is not allowed\n", packet_type );
-            return NULL;
-        }
+static uint32_t netcode_load_uint32_le( NETCODE_CONST uint8_t * p )
+{
+    return ( (uint32_t) p[0] ) | ( ( (uint32_t) p[1] ) << 8 ) | ( ( (uint32_t) p[2] ) << 16 ) | ( ( (uint32_t) p[3] ) << 24 );
+}
 
-        int sequence_bytes = prefix_byte >> 4;
+static void netcode_chacha20_lanes_setup( uint32_t state[16][NETCODE_AEAD_BATCH_LANES], 
+                                          uint8_t ** nonce, 
+                                          uint8_t ** key, 
+                                          int num_lanes )
+{
+    // chacha20 ietf: constants, 256 bit key, 32 bit block counter, 96 bit nonce. unused lanes run on zeroes
 
-        if ( sequence_bytes < 1 || sequence_bytes > 8 )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. sequence bytes %d is out of range [1,8]\n", sequence_bytes );
-            return NULL;
-        }
+    memset( state, 0, sizeof( uint32_t ) * 16 * NETCODE_AEAD_BATCH_LANES );
 
-        if ( buffer_length < 1 + sequence_bytes + NETCODE_MAC_BYTES )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. buffer is too small for sequence bytes + encryption mac\n" );
-            return NULL;
-        }
+    int lane;
+    for ( lane = 0; lane < NETCODE_AEAD_BATCH_LANES; ++lane )
+    {
+        state[0][lane] = 0x61707865;
+        state[1][lane] = 0x3320646e;
+        state[2][lane] = 0x79622d32;
+        state[3][lane] = 0x6b206574;
 
-        // read variable length sequence number [1,8]
+        if ( lane >= num_lanes )
+            continue;
 
         int i;
-        for ( i = 0; i < sequence_bytes; ++i )
+        for ( i = 0; i < 8; ++i )
         {
-            uint8_t value = netcode_read_uint8( &buffer );
-            (*sequence) |= ( uint64_t) ( value ) << ( 8 * i );
+            state[4+i][lane] = netcode_load_uint32_le( key[lane] + i * 4 );
         }
+        state[13][lane] = netcode_load_uint32_le( nonce[lane] + 0 );
+        state[14][lane] = netcode_load_uint32_le( nonce[lane] + 4 );
+        state[15][lane] = netcode_load_uint32_le( nonce[lane] + 8 );
+    }
+}
 
-        // ignore the packet if it has already been received
+static void netcode_poly1305_aead_tag( uint8_t * tag, 
+                                       NETCODE_CONST uint8_t * poly_key, 
+                                       NETCODE_CONST uint8_t * additional, 
+                                       uint64_t additional_length, 
+                                       NETCODE_CONST uint8_t * ciphertext, 
+                                       uint64_t ciphertext_length )
+{
+    static const uint8_t padding[16] = { 0 };
+
+    crypto_onetimeauth_poly1305_state state;
+    crypto_onetimeauth_poly1305_init( &state, poly_key );
+    crypto_onetimeauth_poly1305_update( &state, additional, additional_length );
+    crypto_onetimeauth_poly1305_update( &state, padding, ( 0x10 - additional_length ) & 0xF );
+    crypto_onetimeauth_poly1305_update( &state, ciphertext, ciphertext_length );
+    crypto_onetimeauth_poly1305_update( &state, padding, ( 0x10 - ciphertext_length ) & 0xF );
+
+    uint8_t lengths[16];
+    uint8_t * p = lengths;
+    netcode_write_uint64( &p, additional_length );
+    netcode_write_uint64( &p, ciphertext_length );
+    crypto_onetimeauth_poly1305_update( &state, lengths, sizeof( lengths ) );
+
+    crypto_onetimeauth_poly1305_final( &state, tag );
+}
 
-        if ( replay_protection && packet_type >= NETCODE_CONNECTION_KEEP_ALIVE_PACKET )
+static void netcode_chacha20_lanes_xor( uint32_t state[16][NETCODE_AEAD_BATCH_LANES], 
+                                        uint8_t ** output, 
+                                        uint8_t ** input, 
+                                        NETCODE_CONST uint64_t * length, 
+                                        NETCODE_CONST int * active, 
+                                        int num_lanes )
+{
+    // xor every active lane with its keystream, starting from the current block counter. lanes run in lockstep
+    // until the longest one is done, so lanes of similar length make best use of the kernel
+
+    uint64_t max_length = 0;
+    int lane;
+    for ( lane = 0; lane < num_lanes; ++lane )
+    {
+        if ( active[lane] && length[lane] > max_length )
+            max_length = length[lane];
+    }
+
+    uint8_t keystream[NETCODE_AEAD_BATCH_LANES*64];
+
+    uint64_t offset;
+    for ( offset = 0; offset < max_length; offset += 64 )
+    {
+        netcode_chacha20_lanes_block_avx2( state, keystream );
+
+        for ( lane = 0; lane < num_lanes; ++lane )
         {
-            if ( netcode_replay_protection_already_received( replay_protection, *sequence ) )
+            if ( !active[lane] || offset >= length[lane] )
+                continue;
+
+            uint64_t bytes = length[lane] - offset;
+            if ( bytes > 64 )
+                bytes = 64;
+
+            NETCODE_CONST uint8_t * k = keystream + lane * 64;
+            NETCODE_CONST uint8_t * in = input[lane] + offset;
+            uint8_t * out = output[lane] + offset;
+
+            uint64_t i;
+            for ( i = 0; i < bytes; ++i )
             {
-                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored packet. sequence %.16" PRIx64 " already received (replay protection)\n", *sequence );
-                return NULL;
+                out[i] = in[i] ^ k[i];
             }
         }
+    }
+}
 
-        // decrypt the per-packet type data
+#endif // #if NETCODE_AEAD_AVX2
 
-        uint8_t additional_data[NETCODE_VERSION_INFO_BYTES+8+1];
-        {
-            uint8_t * p = additional_data;
-            netcode_write_bytes( &p, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
-            netcode_write_uint64( &p, protocol_id );
-            netcode_write_uint8( &p, prefix_byte );
-        }
+int netcode_encrypt_aead_batch( int num_messages, 
+                                uint8_t ** output, 
+                                uint8_t ** message, NETCODE_CONST uint64_t * message_length, 
+                                uint8_t ** additional, NETCODE_CONST uint64_t * additional_length, 
+                                uint8_t ** nonce, 
+                                uint8_t ** key )
+{
+    // encrypts each message into its output with the mac appended, exactly like netcode_encrypt_aead_to. 
 
-        uint8_t nonce[12];
-        {
-            uint8_t * p = nonce;
-            netcode_write_uint32( &p, 0 );
-            netcode_write_uint64( &p, *sequence );
-        }
+    netcode_assert( num_messages >= 0 );
 
-        int encrypted_bytes = (int) ( buffer_length - ( buffer - start ) );
+    int first = 0;
 
-        if ( encrypted_bytes < NETCODE_MAC_BYTES )
+#if NETCODE_AEAD_AVX2
+    if ( netcode.aead_avx2 )
+    {
+        for ( ; first + 1 < num_messages; first += NETCODE_AEAD_BATCH_LANES )
         {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. encrypted payload is too small\n" );
-            return NULL;
-        }
+            int num_lanes = num_messages - first;
+            if ( num_lanes > NETCODE_AEAD_BATCH_LANES )
+                num_lanes = NETCODE_AEAD_BATCH_LANES;
 
-        if ( netcode_decrypt_aead( buffer, encrypted_bytes, additional_data, sizeof( additional_data ), nonce, read_packet_key ) != NETCODE_OK )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. failed to decrypt\n" );
-            return NULL;
-        }
+            uint32_t state[16][NETCODE_AEAD_BATCH_LANES];
+            netcode_chacha20_lanes_setup( state, nonce + first, key + first, num_lanes );
 
-        int decrypted_bytes = encrypted_bytes - NETCODE_MAC_BYTES;
+            // block 0 of each lane is the poly1305 key, the message is encrypted from block 1 on
 
-        // update the latest replay protection sequence #
+            uint8_t poly_keys[NETCODE_AEAD_BATCH_LANES*64];
+            netcode_chacha20_lanes_block_avx2( state, poly_keys );
 
-        if ( replay_protection && packet_type >= NETCODE_CONNECTION_KEEP_ALIVE_PACKET )
-        {
-            netcode_replay_protection_advance_sequence( replay_protection, *sequence );
+            int active[NETCODE_AEAD_BATCH_LANES];
+            int lane;
+            for ( lane = 0; lane < NETCODE_AEAD_BATCH_LANES; ++lane )
+                active[lane] = 1;
+
+            netcode_chacha20_lanes_xor( state, output + first, message + first, message_length + first, active, num_lanes );
+
+            for ( lane = 0; lane < num_lanes; ++lane )
+            {
+                const int i = first + lane;
+                netcode_poly1305_aead_tag( output[i] + message_length[i], poly_keys + lane * 64, additional[i], additional_length[i], output[i], message_length[i] );
+            }
+
+            sodium_memzero( poly_keys, sizeof( poly_keys ) );
+            sodium_memzero( state, sizeof( state ) );
         }
+    }
+#endif // #if NETCODE_AEAD_AVX2
 
-        // process the per-packet type data that was just decrypted
-        
-        switch ( packet_type )
+    // whatever is left over (or everything, without avx2) goes through sodium one message at a time
+
+    int i;
+    for ( i = first; i < num_messages; ++i )
+    {
+        if ( netcode_encrypt_aead_to( output[i], message[i], message_length[i], additional[i], additional_length[i], nonce[i], key[i] ) != NETCODE_OK )
+            return NETCODE_ERROR;
+    }
+
+    return NETCODE_OK;
+}
+
+void netcode_decrypt_aead_batch( int num_messages, 
+                                 uint8_t ** message, NETCODE_CONST uint64_t * message_length, 
+                                 uint8_t ** additional, NETCODE_CONST uint64_t * additional_length, 
+                                 uint8_t ** nonce, 
+                                 uint8_t ** key, 
+                                 int * result )
+{
+    // decrypts each message in place, like netcode_decrypt_aead. message_length includes the mac.
+    // result is NETCODE_OK or NETCODE_ERROR per message. don't rely on the contents of messages that fail verification
+
+    netcode_assert( num_messages >= 0 );
+
+    int first = 0;
+
+#if NETCODE_AEAD_AVX2
+    if ( netcode.aead_avx2 )
+    {
+        for ( ; first + 1 < num_messages; first += NETCODE_AEAD_BATCH_LANES )
         {
-            case NETCODE_CONNECTION_DENIED_PACKET:
-            {
-                if ( decrypted_bytes != 0 )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection denied packet. decrypted packet data is wrong size\n" );
-                    return NULL;
-                }
+            int num_lanes = num_messages - first;
+            if ( num_lanes > NETCODE_AEAD_BATCH_LANES )
+                num_lanes = NETCODE_AEAD_BATCH_LANES;
 
-                struct netcode_connection_denied_packet_t * packet = (struct netcode_connection_denied_packet_t*) 
-                    allocate_function( allocator_context, sizeof( struct netcode_connection_denied_packet_t ) );
+            uint32_t state[16][NETCODE_AEAD_BATCH_LANES];
+            netcode_chacha20_lanes_setup( state, nonce + first, key + first, num_lanes );
 
-                if ( !packet )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection denied packet. could not allocate packet struct\n" );
-                    return NULL;
-                }
-                
-                packet->packet_type = NETCODE_CONNECTION_DENIED_PACKET;
-                
-                return packet;
-            }
-            break;
+            uint8_t poly_keys[NETCODE_AEAD_BATCH_LANES*64];
+            netcode_chacha20_lanes_block_avx2( state, poly_keys );
 
-            case NETCODE_CONNECTION_CHALLENGE_PACKET:
+            // verify every mac before decrypting anything
+
+            uint64_t ciphertext_length[NETCODE_AEAD_BATCH_LANES];
+            int active[NETCODE_AEAD_BATCH_LANES];
+            int lane;
+            for ( lane = 0; lane < num_lanes; ++lane )
             {
-                if ( decrypted_bytes != 8 + NETCODE_CHALLENGE_TOKEN_BYTES )
+                const int i = first + lane;
+                active[lane] = 0;
+                result[i] = NETCODE_ERROR;
+                ciphertext_length[lane] = 0;
+                if ( message_length[i] < NETCODE_MAC_BYTES )
+                    continue;
+                ciphertext_length[lane] = message_length[i] - NETCODE_MAC_BYTES;
+                uint8_t tag[NETCODE_MAC_BYTES];
+                netcode_poly1305_aead_tag( tag, poly_keys + lane * 64, additional[i], additional_length[i], message[i], ciphertext_length[lane] );
+                if ( crypto_verify_16( tag, message[i] + ciphertext_length[lane] ) == 0 )
                 {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection challenge packet. decrypted packet data is wrong size\n" );
-                    return NULL;
+                    active[lane] = 1;
+                    result[i] = NETCODE_OK;
                 }
+            }
 
-                struct netcode_connection_challenge_packet_t * packet = (struct netcode_connection_challenge_packet_t*) 
-                    allocate_function( allocator_context, sizeof( struct netcode_connection_challenge_packet_t ) );
-
-                if ( !packet )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection challenge packet. could not allocate packet struct\n" );
-                    return NULL;
-                }
-                
-                packet->packet_type = NETCODE_CONNECTION_CHALLENGE_PACKET;
-                packet->challenge_token_sequence = netcode_read_uint64( &buffer );
-                netcode_read_bytes( &buffer, packet->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
-                
-                return packet;
-            }
-            break;
-
-            case NETCODE_CONNECTION_RESPONSE_PACKET:
-            {
-                if ( decrypted_bytes != 8 + NETCODE_CHALLENGE_TOKEN_BYTES )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection response packet. decrypted packet data is wrong size\n" );
-                    return NULL;
-                }
-
-                struct netcode_connection_response_packet_t * packet = (struct netcode_connection_response_packet_t*) 
-                    allocate_function( allocator_context, sizeof( struct netcode_connection_response_packet_t ) );
-
-                if ( !packet )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection response packet. could not allocate packet struct\n" );
-                    return NULL;
-                }
-                
-                packet->packet_type = NETCODE_CONNECTION_RESPONSE_PACKET;
-                packet->challenge_token_sequence = netcode_read_uint64( &buffer );
-                netcode_read_bytes( &buffer, packet->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
-                
-                return packet;
-            }
-            break;
-
-            case NETCODE_CONNECTION_KEEP_ALIVE_PACKET:
-            {
-                if ( decrypted_bytes != 8 )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection keep alive packet. decrypted packet data is wrong size\n" );
-                    return NULL;
-                }
-
-                struct netcode_connection_keep_alive_packet_t * packet = (struct netcode_connection_keep_alive_packet_t*) 
-                    allocate_function( allocator_context, sizeof( struct netcode_connection_keep_alive_packet_t ) );
-
-                if ( !packet )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection keep alive packet. could not allocate packet struct\n" );
-                    return NULL;
-                }
-                
-                packet->packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
-                packet->client_index = netcode_read_uint32( &buffer );
-                packet->max_clients = netcode_read_uint32( &buffer );
-                
-                return packet;
-            }
-            break;
-            
-            case NETCODE_CONNECTION_PAYLOAD_PACKET:
-            {
-                if ( decrypted_bytes < 1 )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection payload packet. payload is too small\n" );
-                    return NULL;
-                }
-
-                if ( decrypted_bytes > NETCODE_MAX_PAYLOAD_BYTES )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection payload packet. payload is too large\n" );
-                    return NULL;
-                }
+            netcode_chacha20_lanes_xor( state, message + first, message + first, ciphertext_length, active, num_lanes );
 
-                struct netcode_connection_payload_packet_t * packet = netcode_create_payload_packet( decrypted_bytes, allocator_context, allocate_function );
+            sodium_memzero( poly_keys, sizeof( poly_keys ) );
+            sodium_memzero( state, sizeof( state ) );
+        }
+    }
+#endif // #if NETCODE_AEAD_AVX2
 
-                if ( !packet )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection payload packet. could not allocate packet struct\n" );
-                    return NULL;
-                }
-                
-                memcpy( packet->payload_data, buffer, decrypted_bytes );
-                
-                return packet;
-            }
-            break;
+    int i;
+    for ( i = first; i < num_messages; ++i )
+    {
+        result[i] = ( message_length[i] >= NETCODE_MAC_BYTES ) ? netcode_decrypt_aead( message[i], message_length[i], additional[i], additional_length[i], nonce[i], key[i] ) : NETCODE_ERROR;
+    }
+}
 
-            case NETCODE_CONNECTION_DISCONNECT_PACKET:
-            {
-                if ( decrypted_bytes != 0 )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection disconnect packet. decrypted packet data is wrong size\n" );
-                    return NULL;
-                }
+// ----------------------------------------------------------------
 
-                struct netcode_connection_disconnect_packet_t * packet = (struct netcode_connection_disconnect_packet_t*) 
-                    allocate_function( allocator_context, sizeof( struct netcode_connection_disconnect_packet_t ) );
+/*
+    AES-256-GCM, the alternative cipher suite for connected packets. On CPUs with AES-NI and PCLMULQDQ it costs
+    a fraction of chacha20-poly1305 per packet, so a connection uses it when the connect token asks for it and
+    both ends have the instructions. The key schedule and powers of the hash key are expanded once per
+    connection, and keys are derived from the connect token keys so no key is ever used with both suites.
+*/
 
-                if ( !packet )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection disconnect packet. could not allocate packet struct\n" );
-                    return NULL;
-                }
-                
-                packet->packet_type = NETCODE_CONNECTION_DISCONNECT_PACKET;
-                
-                return packet;
-            }
-            break;
+struct netcode_aes256gcm_key_t
+{
+    uint8_t round_keys[15][16];
+    uint8_t hash_key_powers[4][16];                 // H, H^2, H^3, H^4, byte reversed for the multiply below
+};
 
-            default:
-                return NULL;
-        }
+#if NETCODE_AES256GCM
+
+#define NETCODE_AES256GCM_TARGET __attribute__((target("aes,pclmul,ssse3")))
+
+#define NETCODE_AES256GCM_EXPAND_ROUND( round_keys, index, temp1, temp3, rcon )                         \
+    do                                                                                                  \
+    {                                                                                                   \
+        __m128i temp2 = _mm_shuffle_epi32( _mm_aeskeygenassist_si128( temp3, rcon ), 0xff );           \
+        temp1 = _mm_xor_si128( temp1, _mm_slli_si128( temp1, 4 ) );                                     \
+        temp1 = _mm_xor_si128( temp1, _mm_slli_si128( temp1, 8 ) );                                     \
+        temp1 = _mm_xor_si128( temp1, temp2 );                                                          \
+        _mm_storeu_si128( (__m128i*) round_keys[index], temp1 );                                        \
+        if ( index < 14 )                                                                               \
+        {                                                                                               \
+            temp2 = _mm_shuffle_epi32( _mm_aeskeygenassist_si128( temp1, 0 ), 0xaa );                   \
+            temp3 = _mm_xor_si128( temp3, _mm_slli_si128( temp3, 4 ) );                                 \
+            temp3 = _mm_xor_si128( temp3, _mm_slli_si128( temp3, 8 ) );                                 \
+            temp3 = _mm_xor_si128( temp3, temp2 );                                                      \
+            _mm_storeu_si128( (__m128i*) round_keys[index+1], temp3 );                                  \
+        }                                                                                               \
+    } while (0)
+
+static NETCODE_AES256GCM_TARGET __m128i netcode_aes256_encrypt_block( NETCODE_CONST struct netcode_aes256gcm_key_t * aes_key, __m128i block )
+{
+    block = _mm_xor_si128( block, _mm_loadu_si128( (const __m128i*) aes_key->round_keys[0] ) );
+    int i;
+    for ( i = 1; i < 14; ++i )
+    {
+        block = _mm_aesenc_si128( block, _mm_loadu_si128( (const __m128i*) aes_key->round_keys[i] ) );
     }
+    return _mm_aesenclast_si128( block, _mm_loadu_si128( (const __m128i*) aes_key->round_keys[14] ) );
 }
 
-// ----------------------------------------------------------------
-
-struct netcode_connect_token_t
+static NETCODE_AES256GCM_TARGET void netcode_aes256_encrypt_blocks_4( NETCODE_CONST struct netcode_aes256gcm_key_t * aes_key, __m128i * block )
 {
-    uint8_t version_info[NETCODE_VERSION_INFO_BYTES];
-    uint64_t protocol_id;
-    uint64_t create_timestamp;
-    uint64_t expire_timestamp;
-    uint8_t nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
-    uint8_t private_data[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
-    int timeout_seconds;
-    int num_server_addresses;
-    struct netcode_address_t server_addresses[NETCODE_MAX_SERVERS_PER_CONNECT];
-    uint8_t client_to_server_key[NETCODE_KEY_BYTES];
-    uint8_t server_to_client_key[NETCODE_KEY_BYTES];
-};
+    // four independent blocks, so the aesenc latency overlaps
 
-void netcode_write_connect_token( struct netcode_connect_token_t * connect_token, uint8_t * buffer, int buffer_length )
+    __m128i round_key = _mm_loadu_si128( (const __m128i*) aes_key->round_keys[0] );
+    block[0] = _mm_xor_si128( block[0], round_key );
+    block[1] = _mm_xor_si128( block[1], round_key );
+    block[2] = _mm_xor_si128( block[2], round_key );
+    block[3] = _mm_xor_si128( block[3], round_key );
+    int i;
+    for ( i = 1; i < 14; ++i )
+    {
+        round_key = _mm_loadu_si128( (const __m128i*) aes_key->round_keys[i] );
+        block[0] = _mm_aesenc_si128( block[0], round_key );
+        block[1] = _mm_aesenc_si128( block[1], round_key );
+        block[2] = _mm_aesenc_si128( block[2], round_key );
+        block[3] = _mm_aesenc_si128( block[3], round_key );
+    }
+    round_key = _mm_loadu_si128( (const __m128i*) aes_key->round_keys[14] );
+    block[0] = _mm_aesenclast_si128( block[0], round_key );
+    block[1] = _mm_aesenclast_si128( block[1], round_key );
+    block[2] = _mm_aesenclast_si128( block[2], round_key );
+    block[3] = _mm_aesenclast_si128( block[3], round_key );
+}
+
+static NETCODE_AES256GCM_TARGET void netcode_ghash_multiply( __m128i a, __m128i b, __m128i * low, __m128i * high )
 {
-    netcode_assert( connect_token );
-    netcode_assert( buffer );
-    netcode_assert( buffer_length >= NETCODE_CONNECT_TOKEN_BYTES );
+    // carry-less product of two byte reversed field elements, accumulated unreduced so several can share one reduction
 
-    uint8_t * start = buffer;
+    __m128i t0 = _mm_clmulepi64_si128( a, b, 0x00 );
+    __m128i t1 = _mm_xor_si128( _mm_clmulepi64_si128( a, b, 0x10 ), _mm_clmulepi64_si128( a, b, 0x01 ) );
+    __m128i t2 = _mm_clmulepi64_si128( a, b, 0x11 );
+    *low = _mm_xor_si128( *low, _mm_xor_si128( t0, _mm_slli_si128( t1, 8 ) ) );
+    *high = _mm_xor_si128( *high, _mm_xor_si128( t2, _mm_srli_si128( t1, 8 ) ) );
+}
 
-    (void) start;
-    (void) buffer_length;
+static NETCODE_AES256GCM_TARGET __m128i netcode_ghash_reduce( __m128i low, __m128i high )
+{
+    // shift the 256 bit product left by one (the operands are bit reflected), then reduce modulo x^128 + x^7 + x^2 + x + 1
+
+    __m128i carry_low = _mm_srli_epi32( low, 31 );
+    __m128i carry_high = _mm_srli_epi32( high, 31 );
+    low = _mm_slli_epi32( low, 1 );
+    high = _mm_slli_epi32( high, 1 );
+    __m128i carry_across = _mm_srli_si128( carry_low, 12 );
+    carry_high = _mm_slli_si128( carry_high, 4 );
+    carry_low = _mm_slli_si128( carry_low, 4 );
+    low = _mm_or_si128( low, carry_low );
+    high = _mm_or_si128( high, carry_high );
+    high = _mm_or_si128( high, carry_across );
+
+    __m128i a = _mm_xor_si128( _mm_xor_si128( _mm_slli_epi32( low, 31 ), _mm_slli_epi32( low, 30 ) ), _mm_slli_epi32( low, 25 ) );
+    __m128i b = _mm_srli_si128( a, 4 );
+    low = _mm_xor_si128( low, _mm_slli_si128( a, 12 ) );
+    __m128i c = _mm_xor_si128( _mm_xor_si128( _mm_srli_epi32( low, 1 ), _mm_srli_epi32( low, 2 ) ), _mm_srli_epi32( low, 7 ) );
+    c = _mm_xor_si128( c, b );
+    low = _mm_xor_si128( low, c );
+    return _mm_xor_si128( high, low );
+}
 
-    netcode_write_bytes( &buffer, connect_token->version_info, NETCODE_VERSION_INFO_BYTES );
+static NETCODE_AES256GCM_TARGET __m128i netcode_ghash_byte_reverse( __m128i block )
+{
+    return _mm_shuffle_epi8( block, _mm_set_epi8( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 ) );
+}
 
-    netcode_write_uint64( &buffer, connect_token->protocol_id );
+static NETCODE_AES256GCM_TARGET __m128i netcode_ghash_load_partial( NETCODE_CONST uint8_t * data, int bytes )
+{
+    uint8_t block[16];
+    memset( block, 0, sizeof( block ) );
+    memcpy( block, data, bytes );
+    return netcode_ghash_byte_reverse( _mm_loadu_si128( (const __m128i*) block ) );
+}
 
-    netcode_write_uint64( &buffer, connect_token->create_timestamp );
+static NETCODE_AES256GCM_TARGET __m128i netcode_ghash_update( NETCODE_CONST struct netcode_aes256gcm_key_t * aes_key, __m128i x, NETCODE_CONST uint8_t * data, uint64_t bytes )
+{
+    __m128i h1 = _mm_loadu_si128( (const __m128i*) aes_key->hash_key_powers[0] );
 
-    netcode_write_uint64( &buffer, connect_token->expire_timestamp );
+    while ( bytes >= 64 )
+    {
+        __m128i low = _mm_setzero_si128();
+        __m128i high = _mm_setzero_si128();
+        __m128i block0 = _mm_xor_si128( x, netcode_ghash_byte_reverse( _mm_loadu_si128( (const __m128i*) data ) ) );
+        netcode_ghash_multiply( block0, _mm_loadu_si128( (const __m128i*) aes_key->hash_key_powers[3] ), &low, &high );
+        netcode_ghash_multiply( netcode_ghash_byte_reverse( _mm_loadu_si128( (const __m128i*) ( data + 16 ) ) ), _mm_loadu_si128( (const __m128i*) aes_key->hash_key_powers[2] ), &low, &high );
+        netcode_ghash_multiply( netcode_ghash_byte_reverse( _mm_loadu_si128( (const __m128i*) ( data + 32 ) ) ), _mm_loadu_si128( (const __m128i*) aes_key->hash_key_powers[1] ), &low, &high );
+        netcode_ghash_multiply( netcode_ghash_byte_reverse( _mm_loadu_si128( (const __m128i*) ( data + 48 ) ) ), h1, &low, &high );
+        x = netcode_ghash_reduce( low, high );
+        data += 64;
+        bytes -= 64;
+    }
 
-    netcode_write_bytes( &buffer, connect_token->nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+    while ( bytes > 0 )
+    {
+        const int block_bytes = bytes >= 16 ? 16 : (int) bytes;
+        __m128i block = ( block_bytes == 16 ) ? netcode_ghash_byte_reverse( _mm_loadu_si128( (const __m128i*) data ) ) : netcode_ghash_load_partial( data, block_bytes );
+        __m128i low = _mm_setzero_si128();
+        __m128i high = _mm_setzero_si128();
+        netcode_ghash_multiply( _mm_xor_si128( x, block ), h1, &low, &high );
+        x = netcode_ghash_reduce( low, high );
+        data += block_bytes;
+        bytes -= block_bytes;
+    }
 
-    netcode_write_bytes( &buffer, connect_token->private_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    return x;
+}
 
-    int i,j;
+static NETCODE_AES256GCM_TARGET __m128i netcode_aes256gcm_counter_block( NETCODE_CONST uint8_t * nonce, uint32_t counter )
+{
+    uint32_t n0, n1, n2;
+    memcpy( &n0, nonce, 4 );
+    memcpy( &n1, nonce + 4, 4 );
+    memcpy( &n2, nonce + 8, 4 );
+    return _mm_set_epi32( (int) __builtin_bswap32( counter ), (int) n2, (int) n1, (int) n0 );
+}
 
-    netcode_write_uint32( &buffer, connect_token->timeout_seconds );
+static NETCODE_AES256GCM_TARGET void netcode_aes256gcm_ctr( NETCODE_CONST struct netcode_aes256gcm_key_t * aes_key, NETCODE_CONST uint8_t * nonce, uint8_t * output, NETCODE_CONST uint8_t * input, uint64_t bytes )
+{
+    // the message starts at counter 2. counter 1 encrypts the tag
 
-    netcode_write_uint32( &buffer, connect_token->num_server_addresses );
+    uint32_t counter = 2;
 
-    for ( i = 0; i < connect_token->num_server_addresses; ++i )
+    while ( bytes >= 64 )
     {
-        if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV4 )
+        __m128i block[4];
+        block[0] = netcode_aes256gcm_counter_block( nonce, counter );
+        block[1] = netcode_aes256gcm_counter_block( nonce, counter + 1 );
+        block[2] = netcode_aes256gcm_counter_block( nonce, counter + 2 );
+        block[3] = netcode_aes256gcm_counter_block( nonce, counter + 3 );
+        netcode_aes256_encrypt_blocks_4( aes_key, block );
+        int i;
+        for ( i = 0; i < 4; ++i )
         {
-            netcode_write_uint8( &buffer, NETCODE_ADDRESS_IPV4 );
-            for ( j = 0; j < 4; ++j )
-            {
-                netcode_write_uint8( &buffer, connect_token->server_addresses[i].data.ipv4[j] );
-            }
-            netcode_write_uint16( &buffer, connect_token->server_addresses[i].port );
+            _mm_storeu_si128( (__m128i*) ( output + i * 16 ), _mm_xor_si128( block[i], _mm_loadu_si128( (const __m128i*) ( input + i * 16 ) ) ) );
         }
-        else if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV6 )
+        counter += 4;
+        input += 64;
+        output += 64;
+        bytes -= 64;
+    }
+
+    while ( bytes > 0 )
+    {
+        __m128i keystream = netcode_aes256_encrypt_block( aes_key, netcode_aes256gcm_counter_block( nonce, counter++ ) );
+        if ( bytes >= 16 )
         {
-            netcode_write_uint8( &buffer, NETCODE_ADDRESS_IPV6 );
-            for ( j = 0; j < 8; ++j )
-            {
-                netcode_write_uint16( &buffer, connect_token->server_addresses[i].data.ipv6[j] );
-            }
-            netcode_write_uint16( &buffer, connect_token->server_addresses[i].port );
+            _mm_storeu_si128( (__m128i*) output, _mm_xor_si128( keystream, _mm_loadu_si128( (const __m128i*) input ) ) );
+            input += 16;
+            output += 16;
+            bytes -= 16;
         }
         else
         {
-            netcode_assert( 0 );
+            uint8_t block[16];
+            _mm_storeu_si128( (__m128i*) block, keystream );
+            uint64_t i;
+            for ( i = 0; i < bytes; ++i )
+            {
+                output[i] = input[i] ^ block[i];
+            }
+            bytes = 0;
         }
     }
+}
 
-    netcode_write_bytes( &buffer, connect_token->client_to_server_key, NETCODE_KEY_BYTES );
-
-    netcode_write_bytes( &buffer, connect_token->server_to_client_key, NETCODE_KEY_BYTES );
+static NETCODE_AES256GCM_TARGET void netcode_aes256gcm_tag( NETCODE_CONST struct netcode_aes256gcm_key_t * aes_key, 
+                                                            NETCODE_CONST uint8_t * ciphertext, uint64_t ciphertext_length, 
+                                                            NETCODE_CONST uint8_t * additional, uint64_t additional_length, 
+                                                            NETCODE_CONST uint8_t * nonce, 
+                                                            uint8_t * tag )
+{
+    __m128i x = _mm_setzero_si128();
+    x = netcode_ghash_update( aes_key, x, additional, additional_length );
+    x = netcode_ghash_update( aes_key, x, ciphertext, ciphertext_length );
 
-    netcode_assert( buffer - start <= NETCODE_CONNECT_TOKEN_BYTES );
+    uint8_t lengths[16];
+    {
+        uint8_t * p = lengths;
+        uint64_t bits = additional_length * 8;
+        int i;
+        for ( i = 7; i >= 0; --i )
+            netcode_write_uint8( &p, (uint8_t) ( bits >> ( i * 8 ) ) );
+        bits = ciphertext_length * 8;
+        for ( i = 7; i >= 0; --i )
+            netcode_write_uint8( &p, (uint8_t) ( bits >> ( i * 8 ) ) );
+    }
+    x = netcode_ghash_update( aes_key, x, lengths, sizeof( lengths ) );
 
-    memset( buffer, 0, NETCODE_CONNECT_TOKEN_BYTES - ( buffer - start ) );
+    __m128i mask = netcode_aes256_encrypt_block( aes_key, netcode_aes256gcm_counter_block( nonce, 1 ) );
+    _mm_storeu_si128( (__m128i*) tag, _mm_xor_si128( netcode_ghash_byte_reverse( x ), mask ) );
 }
 
-int netcode_read_connect_token( uint8_t * buffer, int buffer_length, struct netcode_connect_token_t * connect_token )
+NETCODE_AES256GCM_TARGET void netcode_aes256gcm_expand_key( struct netcode_aes256gcm_key_t * aes_key, NETCODE_CONST uint8_t * key )
 {
-    netcode_assert( buffer );
-    netcode_assert( connect_token );
+    netcode_assert( aes_key );
+    netcode_assert( key );
 
-    if ( buffer_length != NETCODE_CONNECT_TOKEN_BYTES )
+    __m128i temp1 = _mm_loadu_si128( (const __m128i*) key );
+    __m128i temp3 = _mm_loadu_si128( (const __m128i*) ( key + 16 ) );
+    _mm_storeu_si128( (__m128i*) aes_key->round_keys[0], temp1 );
+    _mm_storeu_si128( (__m128i*) aes_key->round_keys[1], temp3 );
+    NETCODE_AES256GCM_EXPAND_ROUND( aes_key->round_keys, 2, temp1, temp3, 0x01 );
+    NETCODE_AES256GCM_EXPAND_ROUND( aes_key->round_keys, 4, temp1, temp3, 0x02 );
+    NETCODE_AES256GCM_EXPAND_ROUND( aes_key->round_keys, 6, temp1, temp3, 0x04 );
+    NETCODE_AES256GCM_EXPAND_ROUND( aes_key->round_keys, 8, temp1, temp3, 0x08 );
+    NETCODE_AES256GCM_EXPAND_ROUND( aes_key->round_keys, 10, temp1, temp3, 0x10 );
+    NETCODE_AES256GCM_EXPAND_ROUND( aes_key->round_keys, 12, temp1, temp3, 0x20 );
+    NETCODE_AES256GCM_EXPAND_ROUND( aes_key->round_keys, 14, temp1, temp3, 0x40 );
+
+    __m128i h = netcode_ghash_byte_reverse( netcode_aes256_encrypt_block( aes_key, _mm_setzero_si128() ) );
+    __m128i power = h;
+    _mm_storeu_si128( (__m128i*) aes_key->hash_key_powers[0], h );
+    int i;
+    for ( i = 1; i < 4; ++i )
     {
-        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: read connect data has bad buffer length (%d)\n", buffer_length );
-        return NETCODE_ERROR;
+        __m128i low = _mm_setzero_si128();
+        __m128i high = _mm_setzero_si128();
+        netcode_ghash_multiply( power, h, &low, &high );
+        power = netcode_ghash_reduce( low, high );
+        _mm_storeu_si128( (__m128i*) aes_key->hash_key_powers[i], power );
     }
+}
 
-    netcode_read_bytes( &buffer, connect_token->version_info, NETCODE_VERSION_INFO_BYTES );
-    if ( connect_token->version_info[0]  != 'N' || 
-         connect_token->version_info[1]  != 'E' || 
-         connect_token->version_info[2]  != 'T' || 
-         connect_token->version_info[3]  != 'C' || 
-         connect_token->version_info[4]  != 'O' ||
-         connect_token->version_info[5]  != 'D' ||
-         connect_token->version_info[6]  != 'E' ||
-         connect_token->version_info[7]  != ' ' || 
-         connect_token->version_info[8]  != '1' ||
-         connect_token->version_info[9]  != '.' ||
-         connect_token->version_info[10] != '0' ||
-         connect_token->version_info[11] != '2' ||
-         connect_token->version_info[12] != '\0' )
-    {
-        connect_token->version_info[12] = '\0';
-        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: read connect data has bad version info (got %s, expected %s)\n", connect_token->version_info, NETCODE_VERSION_INFO );
-        return NETCODE_ERROR;
-    }
+int netcode_encrypt_aead_aes256gcm( uint8_t * output, 
+                                    NETCODE_CONST uint8_t * message, uint64_t message_length, 
+                                    NETCODE_CONST uint8_t * additional, uint64_t additional_length,
+                                    NETCODE_CONST uint8_t * nonce,
+                                    NETCODE_CONST struct netcode_aes256gcm_key_t * aes_key )
+{
+    // same contract as netcode_encrypt_aead_to: output may be the message itself, and gets the tag appended
 
-    connect_token->protocol_id = netcode_read_uint64( &buffer );
+    netcode_assert( netcode.aes256gcm );
 
-    connect_token->create_timestamp = netcode_read_uint64( &buffer );
+    netcode_aes256gcm_ctr( aes_key, nonce, output, message, message_length );
+    netcode_aes256gcm_tag( aes_key, output, message_length, additional, additional_length, nonce, output + message_length );
 
-    connect_token->expire_timestamp = netcode_read_uint64( &buffer );
+    return NETCODE_OK;
+}
 
-    if ( connect_token->create_timestamp > connect_token->expire_timestamp )
-        return NETCODE_ERROR;
+int netcode_decrypt_aead_aes256gcm( uint8_t * message, uint64_t message_length, 
+                                    NETCODE_CONST uint8_t * additional, uint64_t additional_length,
+                                    NETCODE_CONST uint8_t * nonce,
+                                    NETCODE_CONST struct netcode_aes256gcm_key_t * aes_key )
+{
+    // decrypts in place. message_length includes the tag. the message is only decrypted once the tag checks out
 
-    netcode_read_bytes( &buffer, connect_token->nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+    netcode_assert( netcode.aes256gcm );
 
-    netcode_read_bytes( &buffer, connect_token->private_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    if ( message_length < NETCODE_MAC_BYTES )
+        return NETCODE_ERROR;
 
-    connect_token->timeout_seconds = (int) netcode_read_uint32( &buffer );
+    const uint64_t ciphertext_length = message_length - NETCODE_MAC_BYTES;
 
-    connect_token->num_server_addresses = netcode_read_uint32( &buffer );
+    uint8_t tag[NETCODE_MAC_BYTES];
+    netcode_aes256gcm_tag( aes_key, message, ciphertext_length, additional, additional_length, nonce, tag );
 
-    if ( connect_token->num_server_addresses <= 0 || connect_token->num_server_addresses > NETCODE_MAX_SERVERS_PER_CONNECT )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: read connect data has bad number of server addresses (%d)\n", connect_token->num_server_addresses );
+    if ( crypto_verify_16( tag, message + ciphertext_length ) != 0 )
         return NETCODE_ERROR;
-    }
-
-    int i,j;
-
-    for ( i = 0; i < connect_token->num_server_addresses; ++i )
-    {
-        connect_token->server_addresses[i].type = netcode_read_uint8( &buffer );
-
-        if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV4 )
-        {
-            for ( j = 0; j < 4; ++j )
-            {
-                connect_token->server_addresses[i].data.ipv4[j] = netcode_read_uint8( &buffer );
-            }
-            connect_token->server_addresses[i].port = netcode_read_uint16( &buffer );
-        }
-        else if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV6 )
-        {
-            for ( j = 0; j < 8; ++j )
-            {
-                connect_token->server_addresses[i].data.ipv6[j] = netcode_read_uint16( &buffer );
-            }
-            connect_token->server_addresses[i].port = netcode_read_uint16( &buffer );
-        }
-        else
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: read connect data has bad address type (%d)\n", connect_token->server_addresses[i].type );
-            return NETCODE_ERROR;
-        }
-    }
 
-    netcode_read_bytes( &buffer, connect_token->client_to_server_key, NETCODE_KEY_BYTES );
+    netcode_aes256gcm_ctr( aes_key, nonce, message, message, ciphertext_length );
 
-    netcode_read_bytes( &buffer, connect_token->server_to_client_key, NETCODE_KEY_BYTES );
-    
     return NETCODE_OK;
 }
 
-// ----------------------------------------------------------------
+#else // #if NETCODE_AES256GCM
 
-struct netcode_packet_queue_t
+void netcode_aes256gcm_expand_key( struct netcode_aes256gcm_key_t * aes_key, NETCODE_CONST uint8_t * key )
 {
-    void * allocator_context;
-    void * (*allocate_function)(void*,size_t);
-    void (*free_function)(void*,void*);
-    int num_packets;
-    int start_index;
-    void * packet_data[NETCODE_PACKET_QUEUE_SIZE];
-    uint64_t packet_sequence[NETCODE_PACKET_QUEUE_SIZE];
-};
+    (void) key;
+    memset( aes_key, 0, sizeof( struct netcode_aes256gcm_key_t ) );
+}
 
-void netcode_packet_queue_init( struct netcode_packet_queue_t * queue, 
-                                void * allocator_context, 
-                                void * (*allocate_function)(void*,size_t), 
-                                void (*free_function)(void*,void*) )
+int netcode_encrypt_aead_aes256gcm( uint8_t * output, 
+                                    NETCODE_CONST uint8_t * message, uint64_t message_length, 
+                                    NETCODE_CONST uint8_t * additional, uint64_t additional_length,
+                                    NETCODE_CONST uint8_t * nonce,
+                                    NETCODE_CONST struct netcode_aes256gcm_key_t * aes_key )
 {
-    if ( allocate_function == NULL )
-    {
-        allocate_function = netcode_default_allocate_function;
-    }
-
-    if ( free_function == NULL )
-    {
-        free_function = netcode_default_free_function;
-    }
-
-    netcode_assert( queue );
-
-    queue->allocator_context = allocator_context;
-    queue->allocate_function = allocate_function;
-    queue->free_function = free_function;
-    queue->num_packets = 0;
-    queue->start_index = 0;
-    memset( queue->packet_data, 0, sizeof( queue->packet_data ) );
-    memset( queue->packet_sequence, 0, sizeof( queue->packet_sequence ) );
+    (void) output; (void) message; (void) message_length; (void) additional; (void) additional_length; (void) nonce; (void) aes_key;
+    netcode_assert( !"aes-256-gcm is not compiled in" );
+    return NETCODE_ERROR;
 }
 
-void netcode_packet_queue_clear( struct netcode_packet_queue_t * queue )
+int netcode_decrypt_aead_aes256gcm( uint8_t * message, uint64_t message_length, 
+                                    NETCODE_CONST uint8_t * additional, uint64_t additional_length,
+                                    NETCODE_CONST uint8_t * nonce,
+                                    NETCODE_CONST struct netcode_aes256gcm_key_t * aes_key )
 {
-    int i;
-    for ( i = 0; i < queue->num_packets; ++i )
-    {
-        queue->free_function( queue->allocator_context, queue->packet_data[i] );
-    }
-    queue->num_packets = 0;
-    queue->start_index = 0;
-    memset( queue->packet_data, 0, sizeof( queue->packet_data ) );
-    memset( queue->packet_sequence, 0, sizeof( queue->packet_sequence ) );
+    (void) message; (void) message_length; (void) additional; (void) additional_length; (void) nonce; (void) aes_key;
+    return NETCODE_ERROR;
 }
 
-int netcode_packet_queue_push( struct netcode_packet_queue_t * queue, void * packet_data, uint64_t packet_sequence )
+#endif // #if NETCODE_AES256GCM
+
+int netcode_cipher_suite_supported( int cipher_suite )
 {
-    netcode_assert( queue );
-    netcode_assert( packet_data );
-    if ( queue->num_packets == NETCODE_PACKET_QUEUE_SIZE )
+    netcode_assert( netcode.initialized );
+
+    switch ( cipher_suite )
     {
-        queue->free_function( queue->allocator_context, packet_data );
-        return 0;
+        case NETCODE_CIPHER_SUITE_CHACHA20_POLY1305: return 1;
+        case NETCODE_CIPHER_SUITE_AES256_GCM: return netcode.aes256gcm;
+        case NETCODE_CIPHER_SUITE_INTEGRITY_ONLY: return 1;
+        default: return 0;
     }
-    int index = ( queue->start_index + queue->num_packets ) % NETCODE_PACKET_QUEUE_SIZE;
-    queue->packet_data[index] = packet_data;
-    queue->packet_sequence[index] = packet_sequence;
-    queue->num_packets++;
-    return 1;
 }
 
-void * netcode_packet_queue_pop( struct netcode_packet_queue_t * queue, uint64_t * packet_sequence )
+void netcode_aes256gcm_init_packet_key( struct netcode_aes256gcm_key_t * aes_key, NETCODE_CONST uint8_t * packet_key )
 {
-    if ( queue->num_packets == 0 )
-        return NULL;
-    void * packet = queue->packet_data[queue->start_index];
-    if ( packet_sequence )
-        *packet_sequence = queue->packet_sequence[queue->start_index];
-    queue->start_index = ( queue->start_index + 1 ) % NETCODE_PACKET_QUEUE_SIZE;
-    queue->num_packets--;
-    return packet;
-}
-
-// ----------------------------------------------------------------
+    // connect token keys are chacha20 keys. derive the aes key from them rather than using them directly
 
-#define NETCODE_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES ( NETCODE_MAX_CLIENTS * 256 )
-#define NETCODE_NETWORK_SIMULATOR_NUM_PENDING_RECEIVE_PACKETS ( NETCODE_MAX_CLIENTS * 64 )
-
-struct netcode_network_simulator_packet_entry_t
-{
-    struct netcode_address_t from;
-    struct netcode_address_t to;
-    double delivery_time;
-    uint8_t * packet_data;
-    int packet_bytes;
-};
+    uint8_t key[NETCODE_KEY_BYTES];
+    crypto_generichash( key, NETCODE_KEY_BYTES, (const unsigned char*) "netcode aes-256-gcm", 19, packet_key, NETCODE_KEY_BYTES );
+    netcode_aes256gcm_expand_key( aes_key, key );
+}
 
-struct netcode_network_simulator_t
+void netcode_poly1305_auth_update( crypto_onetimeauth_poly1305_state * state, NETCODE_CONST uint8_t * data, uint64_t data_length )
 {
-    void * allocator_context;
-    void * (*allocate_function)(void*,size_t);
-    void (*free_function)(void*,void*);
-    float latency_milliseconds;
-    float jitter_milliseconds;
-    float packet_loss_percent;
-    float duplicate_packet_percent;
-    double time;
-    int current_index;
-    int num_pending_receive_packets;
-    struct netcode_network_simulator_packet_entry_t packet_entries[NETCODE_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES];
-    struct netcode_network_simulator_packet_entry_t pending_receive_packets[NETCODE_NETWORK_SIMULATOR_NUM_PENDING_RECEIVE_PACKETS];
-};
+    static const uint8_t zero_padding[16] = { 0 };
+    crypto_onetimeauth_poly1305_update( state, data, data_length );
+    crypto_onetimeauth_poly1305_update( state, zero_padding, ( 16 - ( data_length & 15 ) ) & 15 );
+}
 
-struct netcode_network_simulator_t * netcode_network_simulator_create( void * allocator_context, 
-                                                                       void * (*allocate_function)(void*,size_t), 
-                                                                       void (*free_function)(void*,void*) )
+void netcode_poly1305_auth( uint8_t * tag,
+                            NETCODE_CONST uint8_t * message, uint64_t message_length, 
+                            NETCODE_CONST uint8_t * additional, uint64_t additional_length,
+                            NETCODE_CONST uint8_t * nonce,
+                            NETCODE_CONST uint8_t * key )
 {
-    if ( allocate_function == NULL )
-    {
-        allocate_function = netcode_default_allocate_function;
-    }
-
-    if ( free_function == NULL )
-    {
-        free_function = netcode_default_free_function;
-    }
+    // the chacha20-poly1305 mac with the message standing in for the ciphertext. the one-time poly1305 key is the
+    // first chacha20 block for the nonce, just as the aead would use, so only 64 bytes of keystream get generated
 
-    struct netcode_network_simulator_t * network_simulator = (struct netcode_network_simulator_t*) 
-        allocate_function( allocator_context, sizeof( struct netcode_network_simulator_t ) );
+    uint8_t block[64];
+    memset( block, 0, sizeof( block ) );
+    crypto_stream_chacha20_ietf_xor( block, block, sizeof( block ), nonce, key );
 
-    netcode_assert( network_simulator );
+    crypto_onetimeauth_poly1305_state state;
+    crypto_onetimeauth_poly1305_init( &state, block );
 
-    memset( network_simulator, 0, sizeof( struct netcode_network_simulator_t ) );
+    netcode_poly1305_auth_update( &state, additional, additional_length );
+    netcode_poly1305_auth_update( &state, message, message_length );
 
-    network_simulator->allocator_context = allocator_context;
-    network_simulator->allocate_function = allocate_function;
-    network_simulator->free_function = free_function;
+    uint8_t lengths[16];
+    uint8_t * p = lengths;
+    netcode_write_uint64( &p, additional_length );
+    netcode_write_uint64( &p, message_length );
+    crypto_onetimeauth_poly1305_update( &state, lengths, sizeof( lengths ) );
 
-    return network_simulator;
+    crypto_onetimeauth_poly1305_final( &state, tag );
 }
 
-void netcode_network_simulator_reset( struct netcode_network_simulator_t * network_simulator )
+int netcode_sign_integrity_only( uint8_t * output, 
+                                 NETCODE_CONST uint8_t * message, uint64_t message_length, 
+                                 NETCODE_CONST uint8_t * additional, uint64_t additional_length,
+                                 NETCODE_CONST uint8_t * nonce,
+                                 NETCODE_CONST uint8_t * key )
 {
-    netcode_assert( network_simulator );
-
-    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "network simulator reset\n" );
+    // same contract as netcode_encrypt_aead_to, except the message is copied across in the clear
 
-    int i;
-    for ( i = 0; i < NETCODE_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES; ++i )
+    if ( output != message )
     {
-        network_simulator->free_function( network_simulator->allocator_context, network_simulator->packet_entries[i].packet_data );
-        memset( &network_simulator->packet_entries[i], 0, sizeof( struct netcode_network_simulator_packet_entry_t ) );
+        memmove( output, message, message_length );
     }
 
-    for ( i = 0; i < network_simulator->num_pending_receive_packets; ++i )
-    {
-        network_simulator->free_function( network_simulator->allocator_context, network_simulator->pending_receive_packets[i].packet_data );
-        memset( &network_simulator->pending_receive_packets[i], 0, sizeof( struct netcode_network_simulator_packet_entry_t ) );
-    }
+    netcode_poly1305_auth( output + message_length, output, message_length, additional, additional_length, nonce, key );
 
-    network_simulator->current_index = 0;
-    network_simulator->num_pending_receive_packets = 0;
+    return NETCODE_OK;
 }
 
-void netcode_network_simulator_destroy( struct netcode_network_simulator_t * network_simulator )
+int netcode_verify_integrity_only( uint8_t * message, uint64_t message_length, 
+                                   NETCODE_CONST uint8_t * additional, uint64_t additional_length,
+                                   NETCODE_CONST uint8_t * nonce,
+                                   NETCODE_CONST uint8_t * key )
 {
-    netcode_assert( network_simulator );
-    netcode_network_simulator_reset( network_simulator );
-    network_simulator->free_function( network_simulator->allocator_context, network_simulator );
-}
+    // message_length includes the tag. the message is left as it is
 
-float netcode_random_float( float a, float b )
-{
-    netcode_assert( a < b );
-    float random = ( (float) rand() ) / (float) RAND_MAX;
-    float diff = b - a;
-    float r = random * diff;
-    return a + r;
+    if ( message_length < NETCODE_MAC_BYTES )
+        return NETCODE_ERROR;
+
+    message_length -= NETCODE_MAC_BYTES;
+
+    uint8_t tag[NETCODE_MAC_BYTES];
+    netcode_poly1305_auth( tag, message, message_length, additional, additional_length, nonce, key );
+
+    return ( crypto_verify_16( tag, message + message_length ) == 0 ) ? NETCODE_OK : NETCODE_ERROR;
 }
 
-void netcode_network_simulator_queue_packet( struct netcode_network_simulator_t * network_simulator, 
-                                             struct netcode_address_t * from, 
-                                             struct netcode_address_t * to, 
-                                             uint8_t * packet_data, 
-                                             int packet_bytes, 
-                                             float delay )
+struct netcode_packet_cipher_t
 {
-    network_simulator->packet_entries[network_simulator->current_index].from = *from;
-    network_simulator->packet_entries[network_simulator->current_index].to = *to;
-    network_simulator->packet_entries[network_simulator->current_index].packet_data = 
-        (uint8_t*) network_simulator->allocate_function( network_simulator->allocator_context, packet_bytes );
-    memcpy( network_simulator->packet_entries[network_simulator->current_index].packet_data, packet_data, packet_bytes );
-    network_simulator->packet_entries[network_simulator->current_index].packet_bytes = packet_bytes;
-    network_simulator->packet_entries[network_simulator->current_index].delivery_time = network_simulator->time + delay;
-    network_simulator->current_index++;
-    network_simulator->current_index %= NETCODE_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES;
-}
+    int cipher_suite;
+    struct netcode_aes256gcm_key_t aes_key;
+};
 
-void netcode_network_simulator_send_packet( struct netcode_network_simulator_t * network_simulator, 
-                                            struct netcode_address_t * from, 
-                                            struct netcode_address_t * to, 
-                                            uint8_t * packet_data, 
-                                            int packet_bytes )
+void netcode_packet_cipher_init( struct netcode_packet_cipher_t * cipher, int cipher_suite, NETCODE_CONST uint8_t * packet_key )
 {
-    netcode_assert( network_simulator );
-    netcode_assert( from );
-    netcode_assert( from->type != 0 );
-    netcode_assert( to );
-    netcode_assert( to->type != 0 );
-    netcode_assert( packet_data );
-    netcode_assert( packet_bytes > 0 );
-    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_BYTES );
+    netcode_assert( cipher );
+    netcode_assert( cipher_suite >= 0 );
+    netcode_assert( cipher_suite < NETCODE_NUM_CIPHER_SUITES );
 
-    if ( netcode_random_float( 0.0f, 100.0f ) <= network_simulator->packet_loss_percent )
-        return;
+    cipher->cipher_suite = cipher_suite;
 
-    if ( network_simulator->packet_entries[network_simulator->current_index].packet_data )
+    if ( cipher_suite == NETCODE_CIPHER_SUITE_AES256_GCM )
     {
-        network_simulator->free_function( network_simulator->allocator_context, network_simulator->packet_entries[network_simulator->current_index].packet_data );
-        network_simulator->packet_entries[network_simulator->current_index].packet_data = NULL;
+        netcode_aes256gcm_init_packet_key( &cipher->aes_key, packet_key );
     }
+}
 
-    float delay = network_simulator->latency_milliseconds / 1000.0f;
+int netcode_encrypt_packet_aead( uint8_t * output, 
+                                 NETCODE_CONST uint8_t * message, uint64_t message_length, 
+                                 uint8_t * additional, uint64_t additional_length,
+                                 NETCODE_CONST uint8_t * nonce,
+                                 NETCODE_CONST uint8_t * key, 
+                                 NETCODE_CONST struct netcode_packet_cipher_t * cipher )
+{
+    // cipher is set for connections that negotiated something other than chacha20-poly1305
 
-    if ( network_simulator->jitter_milliseconds > 0.0 )
-        delay += netcode_random_float( -network_simulator->jitter_milliseconds, +network_simulator->jitter_milliseconds ) / 1000.0f;
+    if ( cipher && cipher->cipher_suite == NETCODE_CIPHER_SUITE_AES256_GCM )
+        return netcode_encrypt_aead_aes256gcm( output, message, message_length, additional, additional_length, nonce, &cipher->aes_key );
 
-    netcode_network_simulator_queue_packet( network_simulator, from, to, packet_data, packet_bytes, delay );
+    if ( cipher && cipher->cipher_suite == NETCODE_CIPHER_SUITE_INTEGRITY_ONLY )
+        return netcode_sign_integrity_only( output, message, message_length, additional, additional_length, nonce, key );
 
-    if ( netcode_random_float( 0.0f, 100.0f ) <= network_simulator->duplicate_packet_percent )
-    {
-        netcode_network_simulator_queue_packet( network_simulator, from, to, packet_data, packet_bytes, delay + netcode_random_float( 0, 1.0 ) );
-    }
+    return netcode_encrypt_aead_to( output, message, message_length, additional, additional_length, nonce, key );
 }
 
-int netcode_network_simulator_receive_packets( struct netcode_network_simulator_t * network_simulator, 
-                                               struct netcode_address_t * to, 
-                                               int max_packets, 
-                                               uint8_t ** packet_data, 
-                                               int * packet_bytes, 
-                                               struct netcode_address_t * from )
+int netcode_decrypt_packet_aead( uint8_t * message, uint64_t message_length, 
+                                 uint8_t * additional, uint64_t additional_length,
+                                 uint8_t * nonce,
+                                 uint8_t * key, 
+                                 NETCODE_CONST struct netcode_packet_cipher_t * cipher )
 {
-    netcode_assert( network_simulator );
-    netcode_assert( max_packets >= 0 );
-    netcode_assert( packet_data );
-    netcode_assert( packet_bytes );
-    netcode_assert( from );
-    netcode_assert( to );
+    if ( cipher && cipher->cipher_suite == NETCODE_CIPHER_SUITE_AES256_GCM )
+        return netcode_decrypt_aead_aes256gcm( message, message_length, additional, additional_length, nonce, &cipher->aes_key );
 
-    int num_packets = 0;
+    if ( cipher && cipher->cipher_suite == NETCODE_CIPHER_SUITE_INTEGRITY_ONLY )
+        return netcode_verify_integrity_only( message, message_length, additional, additional_length, nonce, key );
 
-    int i;
-    for ( i = 0; i < network_simulator->num_pending_receive_packets; ++i )
-    {
-        if ( num_packets == max_packets )
-            break;
+    return netcode_decrypt_aead( message, message_length, additional, additional_length, nonce, key );
+}
 
-        if ( !network_simulator->pending_receive_packets[i].packet_data )
-            continue;
-
-        if ( !netcode_address_equal( &network_simulator->pending_receive_packets[i].to, to ) )
-            continue;
-
-        packet_data[num_packets] = network_simulator->pending_receive_packets[i].packet_data;
-        packet_bytes[num_packets] = network_simulator->pending_receive_packets[i].packet_bytes;
-        from[num_packets] = network_simulator->pending_receive_packets[i].from;
-
-        network_simulator->pending_receive_packets[i].packet_data = NULL;
-
-        num_packets++;
-    }
-
-    netcode_assert( num_packets <= max_packets );
-
-    return num_packets;
-}
-
-void netcode_network_simulator_update( struct netcode_network_simulator_t * network_simulator, double time )
-{   
-    netcode_assert( network_simulator );
+// ----------------------------------------------------------------
 
-    network_simulator->time = time;
+struct netcode_connect_token_private_t
+{
+    uint64_t client_id;
+    int timeout_seconds;
+    int num_server_addresses;
+    struct netcode_address_t server_addresses[NETCODE_MAX_SERVERS_PER_CONNECT];
+    uint8_t client_to_server_key[NETCODE_KEY_BYTES];
+    uint8_t server_to_client_key[NETCODE_KEY_BYTES];
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    int cipher_suite;
+    int session_ticket;
+    uint64_t session_ticket_sequence;
+};
 
-    // discard any pending receive packets that are still in the buffer
+void netcode_generate_connect_token_private( struct netcode_connect_token_private_t * connect_token, 
+                                             uint64_t client_id, 
+                                             int timeout_seconds,
+                                             int num_server_addresses, 
+                                             struct netcode_address_t * server_addresses, 
+                                             uint8_t * user_data )
+{
+    netcode_assert( connect_token );
+    netcode_assert( num_server_addresses > 0 );
+    netcode_assert( num_server_addresses <= NETCODE_MAX_SERVERS_PER_CONNECT );
+    netcode_assert( server_addresses );
+    netcode_assert( user_data );
 
+    connect_token->client_id = client_id;
+    connect_token->timeout_seconds = timeout_seconds;
+    connect_token->num_server_addresses = num_server_addresses;
+    
     int i;
-    for ( i = 0; i < network_simulator->num_pending_receive_packets; ++i )
+    for ( i = 0; i < num_server_addresses; ++i )
     {
-        if ( network_simulator->pending_receive_packets[i].packet_data )
-        {
-            network_simulator->free_function( network_simulator->allocator_context, network_simulator->pending_receive_packets[i].packet_data );
-            network_simulator->pending_receive_packets[i].packet_data = NULL;
-        }
+        memcpy( &connect_token->server_addresses[i], &server_addresses[i], sizeof( struct netcode_address_t ) );
     }
 
-    network_simulator->num_pending_receive_packets = 0;
-
-    // walk across packet entries and move any that are ready to be received into the pending receive buffer
+    netcode_generate_key( connect_token->client_to_server_key );
+    netcode_generate_key( connect_token->server_to_client_key );
 
-    for ( i = 0; i < NETCODE_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES; ++i )
+    if ( user_data != NULL )
     {
-        if ( !network_simulator->packet_entries[i].packet_data )
-            continue;
-
-        if ( network_simulator->num_pending_receive_packets == NETCODE_NETWORK_SIMULATOR_NUM_PENDING_RECEIVE_PACKETS )
-            break;
-
-        if ( network_simulator->packet_entries[i].packet_data && network_simulator->packet_entries[i].delivery_time <= time )
-        {
-            network_simulator->pending_receive_packets[network_simulator->num_pending_receive_packets] = network_simulator->packet_entries[i];
-            network_simulator->num_pending_receive_packets++;
-            network_simulator->packet_entries[i].packet_data = NULL;
-        }
+        memcpy( connect_token->user_data, user_data, NETCODE_USER_DATA_BYTES );
     }
-}
-
-// ----------------------------------------------------------------
-    
-NETCODE_CONST char * netcode_client_state_name( int client_state )
-{
-    switch ( client_state )
+    else
     {
-        case NETCODE_CLIENT_STATE_CONNECT_TOKEN_EXPIRED:                return "connect token expired";
-        case NETCODE_CLIENT_STATE_INVALID_CONNECT_TOKEN:                return "invalid connect token";
-        case NETCODE_CLIENT_STATE_CONNECTION_TIMED_OUT:                 return "connection timed out";
-        case NETCODE_CLIENT_STATE_CONNECTION_REQUEST_TIMED_OUT:         return "connection request timed out";
-        case NETCODE_CLIENT_STATE_CONNECTION_RESPONSE_TIMED_OUT:        return "connection response timed out";
-        case NETCODE_CLIENT_STATE_CONNECTION_DENIED:                    return "connection denied";
-        case NETCODE_CLIENT_STATE_DISCONNECTED:                         return "disconnected";
-        case NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST:           return "sending connection request";
-        case NETCODE_CLIENT_STATE_SENDING_CONNECTION_RESPONSE:          return "sending connection response";
-        case NETCODE_CLIENT_STATE_CONNECTED:                            return "connected";
-        default:
-            netcode_assert( 0 );
-            return "???";
+        memset( connect_token->user_data, 0, NETCODE_USER_DATA_BYTES );
     }
+
+    connect_token->cipher_suite = NETCODE_CIPHER_SUITE_CHACHA20_POLY1305;
+    connect_token->session_ticket = 0;
+    connect_token->session_ticket_sequence = 0;
 }
 
-void netcode_default_client_config( struct netcode_client_config_t * config )
+void netcode_write_connect_token_private( struct netcode_connect_token_private_t * connect_token, uint8_t * buffer, int buffer_length )
 {
-    netcode_assert( config );
-    config->allocator_context = NULL;
-    config->allocate_function = netcode_default_allocate_function;
-    config->free_function = netcode_default_free_function;
-    config->network_simulator = NULL;
-    config->callback_context = NULL;
-    config->state_change_callback = NULL;
-    config->send_loopback_packet_callback = NULL;
-    config->override_send_and_receive = 0;
-    config->send_packet_override = NULL;
-    config->receive_packet_override = NULL;
-};
+    (void) buffer_length;
 
-struct netcode_client_t
-{
-    struct netcode_client_config_t config;
-    int state;
-    double time;
-    double connect_start_time;
-    double last_packet_send_time;
-    double last_packet_receive_time;
-    int should_disconnect;
-    int should_disconnect_state;
-    uint64_t sequence;
-    int client_index;
-    int max_clients;
-    int server_address_index;
-    struct netcode_address_t address;
-    struct netcode_address_t server_address;
-    struct netcode_connect_token_t connect_token;
-    struct netcode_socket_holder_t socket_holder;
-    struct netcode_context_t context;
-    struct netcode_replay_protection_t replay_protection;
-    struct netcode_packet_queue_t packet_receive_queue;
-    uint64_t challenge_token_sequence;
-    uint8_t challenge_token_data[NETCODE_CHALLENGE_TOKEN_BYTES];
-    uint8_t * receive_packet_data[NETCODE_CLIENT_MAX_RECEIVE_PACKETS];
-    int receive_packet_bytes[NETCODE_CLIENT_MAX_RECEIVE_PACKETS];
-    struct netcode_address_t receive_from[NETCODE_CLIENT_MAX_RECEIVE_PACKETS];
-    int loopback;
-};
+    netcode_assert( connect_token );
+    netcode_assert( connect_token->num_server_addresses > 0 );
+    netcode_assert( connect_token->num_server_addresses <= NETCODE_MAX_SERVERS_PER_CONNECT );
+    netcode_assert( buffer );
+    netcode_assert( buffer_length >= NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
 
-int netcode_client_socket_create( struct netcode_socket_t * socket,
-                                  struct netcode_address_t * address,
-                                  int send_buffer_size,
-                                  int receive_buffer_size,
-                                  NETCODE_CONST struct netcode_client_config_t * config )
-{
-    netcode_assert( socket );
-    netcode_assert( address );
-    netcode_assert( config );
+    uint8_t * start = buffer;
 
-    if ( !config->network_simulator )
+    (void) start;
+
+    netcode_write_uint64( &buffer, connect_token->client_id );
+
+    netcode_write_uint32( &buffer, connect_token->timeout_seconds );
+
+    netcode_write_uint32( &buffer, connect_token->num_server_addresses );
+
+    int i,j;
+
+    for ( i = 0; i < connect_token->num_server_addresses; ++i )
     {
-        if ( !config->override_send_and_receive )
+        if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV4 )
         {
-            if ( netcode_socket_create( socket, address, send_buffer_size, receive_buffer_size ) != NETCODE_SOCKET_ERROR_NONE )
+            netcode_write_uint8( &buffer, NETCODE_ADDRESS_IPV4 );
+            for ( j = 0; j < 4; ++j )
             {
-                return 0;
+                netcode_write_uint8( &buffer, connect_token->server_addresses[i].data.ipv4[j] );
             }
+            netcode_write_uint16( &buffer, connect_token->server_addresses[i].port );
         }
-    }
-    else
-    {
-        if ( address->port == 0 )
+        else if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV6 )
         {
-            netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: must bind to a specific port when using network simulator\n" );
-            return 0;
+            netcode_write_uint8( &buffer, NETCODE_ADDRESS_IPV6 );
+            for ( j = 0; j < 8; ++j )
+            {
+                netcode_write_uint16( &buffer, connect_token->server_addresses[i].data.ipv6[j] );
+            }
+            netcode_write_uint16( &buffer, connect_token->server_addresses[i].port );
+        }
+        else
+        {
+            netcode_assert( 0 );
         }
     }
 
-    return 1;
-}
+    netcode_write_bytes( &buffer, connect_token->client_to_server_key, NETCODE_KEY_BYTES );
 
-struct netcode_client_t * netcode_client_create_overload( NETCODE_CONST char * address1_string,
-                                                          NETCODE_CONST char * address2_string,
-                                                          NETCODE_CONST struct netcode_client_config_t * config,
-                                                          double time )
-{
-    netcode_assert( config );
-    netcode_assert( netcode.initialized );
+    netcode_write_bytes( &buffer, connect_token->server_to_client_key, NETCODE_KEY_BYTES );
 
-    struct netcode_address_t address1;
-    struct netcode_address_t address2;
+    netcode_write_bytes( &buffer, connect_token->user_data, NETCODE_USER_DATA_BYTES );
 
-    memset( &address1, 0, sizeof( address1 ) );
-    memset( &address2, 0, sizeof( address2 ) );
+    // tokens written before cipher suites existed have zero padding here, which reads as chacha20-poly1305
 
-    if ( netcode_parse_address( address1_string, &address1 ) != NETCODE_OK )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: failed to parse client address\n" );
-        return NULL;
-    }
+    netcode_write_uint8( &buffer, (uint8_t) connect_token->cipher_suite );
 
-    if ( address2_string != NULL && netcode_parse_address( address2_string, &address2 ) != NETCODE_OK )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: failed to parse client address2\n" );
-        return NULL;
-    }
+    // likewise for session tickets. tokens from the backend are never session tickets
 
+    netcode_write_uint8( &buffer, (uint8_t) connect_token->session_ticket );
 
-    struct netcode_socket_t socket_ipv4;
-    struct netcode_socket_t socket_ipv6;
+    netcode_write_uint64( &buffer, connect_token->session_ticket_sequence );
 
-    memset( &socket_ipv4, 0, sizeof( socket_ipv4 ) );
-    memset( &socket_ipv6, 0, sizeof( socket_ipv6 ) );
+    netcode_assert( buffer - start <= NETCODE_CONNECT_TOKEN_PRIVATE_BYTES - NETCODE_MAC_BYTES );
 
-    if ( address1.type == NETCODE_ADDRESS_IPV4 || address2.type == NETCODE_ADDRESS_IPV4 )
-    {
-        if ( !netcode_client_socket_create( &socket_ipv4, address1.type == NETCODE_ADDRESS_IPV4 ? &address1 : &address2, NETCODE_CLIENT_SOCKET_SNDBUF_SIZE, NETCODE_CLIENT_SOCKET_RCVBUF_SIZE, config ) )
-        {
-            return NULL;
-        }
-    }
+    memset( buffer, 0, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES - ( buffer - start ) );
+}
 
-    if ( address1.type == NETCODE_ADDRESS_IPV6 || address2.type == NETCODE_ADDRESS_IPV6 )
-    {
-        if ( !netcode_client_socket_create( &socket_ipv6, address1.type == NETCODE_ADDRESS_IPV6 ? &address1 : &address2, NETCODE_CLIENT_SOCKET_SNDBUF_SIZE, NETCODE_CLIENT_SOCKET_RCVBUF_SIZE, config ) )
-        {
-            return NULL;
-        }
-    }
+int netcode_encrypt_connect_token_private( uint8_t * buffer, 
+                                           int buffer_length, 
+                                           uint8_t * version_info, 
+                                           uint64_t protocol_id, 
+                                           uint64_t expire_timestamp, 
+                                           NETCODE_CONST uint8_t * nonce, 
+                                           NETCODE_CONST uint8_t * key )
+{
+    netcode_assert( buffer );
+    netcode_assert( buffer_length == NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    netcode_assert( key );
 
-    struct netcode_client_t * client = (struct netcode_client_t*) config->allocate_function( config->allocator_context, sizeof( struct netcode_client_t ) );
+    (void) buffer_length;
 
-    if ( !client )
+    uint8_t additional_data[NETCODE_VERSION_INFO_BYTES+8+8];
     {
-        netcode_socket_destroy( &socket_ipv4 );
-        netcode_socket_destroy( &socket_ipv6 );
-        return NULL;
+        uint8_t * p = additional_data;
+        netcode_write_bytes( &p, version_info, NETCODE_VERSION_INFO_BYTES );
+        netcode_write_uint64( &p, protocol_id );
+        netcode_write_uint64( &p, expire_timestamp );
     }
 
-    struct netcode_address_t socket_address = address1.type == NETCODE_ADDRESS_IPV4 ? socket_ipv4.address : socket_ipv6.address;
+    return netcode_encrypt_aead_bignonce( buffer, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES - NETCODE_MAC_BYTES, additional_data, sizeof( additional_data ), nonce, key );
+}
 
-    if ( !config->network_simulator )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_INFO, "client started on port %d\n", socket_address.port );
-    }
-    else
+int netcode_decrypt_connect_token_private( uint8_t * buffer, 
+                                           int buffer_length, 
+                                           uint8_t * version_info, 
+                                           uint64_t protocol_id, 
+                                           uint64_t expire_timestamp, 
+                                           uint8_t * nonce, 
+                                           uint8_t * key )
+{
+    netcode_assert( buffer );
+    netcode_assert( buffer_length == NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    netcode_assert( key );
+
+    (void) buffer_length;
+
+    uint8_t additional_data[NETCODE_VERSION_INFO_BYTES+8+8];
     {
-        netcode_printf( NETCODE_LOG_LEVEL_INFO, "client started on port %d (network simulator)\n", socket_address.port );
+        uint8_t * p = additional_data;
+        netcode_write_bytes( &p, version_info, NETCODE_VERSION_INFO_BYTES );
+        netcode_write_uint64( &p, protocol_id );
+        netcode_write_uint64( &p, expire_timestamp );
     }
+    return netcode_decrypt_aead_bignonce( buffer, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, additional_data, sizeof( additional_data ), nonce, key );
+}
 
-    client->config = *config;
-    client->socket_holder.ipv4 = socket_ipv4;
-    client->socket_holder.ipv6 = socket_ipv6;
-    client->address = config->network_simulator ? address1 : socket_address;
-    client->state = NETCODE_CLIENT_STATE_DISCONNECTED;
-    client->time = time;
-    client->connect_start_time = 0.0;
-    client->last_packet_send_time = -1000.0;
-    client->last_packet_receive_time = -1000.0;
-    client->should_disconnect = 0;
-    client->should_disconnect_state = NETCODE_CLIENT_STATE_DISCONNECTED;
-    client->sequence = 0;
-    client->client_index = 0;
-    client->max_clients = 0;
-    client->server_address_index = 0;
-    client->challenge_token_sequence = 0;
-    client->loopback = 0;
-    memset( &client->server_address, 0, sizeof( struct netcode_address_t ) );
-    memset( &client->connect_token, 0, sizeof( struct netcode_connect_token_t ) );
-    memset( &client->context, 0, sizeof( struct netcode_context_t ) );
-    memset( client->challenge_token_data, 0, NETCODE_CHALLENGE_TOKEN_BYTES );
+int netcode_read_connect_token_private( uint8_t * buffer, int buffer_length, struct netcode_connect_token_private_t * connect_token )
+{
+    netcode_assert( buffer );
+    netcode_assert( connect_token );
 
-    netcode_packet_queue_init( &client->packet_receive_queue, config->allocator_context, config->allocate_function, config->free_function );
+    if ( buffer_length < NETCODE_CONNECT_TOKEN_PRIVATE_BYTES )
+        return NETCODE_ERROR;
+    
+    connect_token->client_id = netcode_read_uint64( &buffer );
 
-    netcode_replay_protection_reset( &client->replay_protection );
+    connect_token->timeout_seconds = (int) netcode_read_uint32( &buffer );
 
-    return client;
-}
+    connect_token->num_server_addresses = netcode_read_uint32( &buffer );
 
-struct netcode_client_t * netcode_client_create( NETCODE_CONST char * address,
-                                                 NETCODE_CONST struct netcode_client_config_t * config,
-                                                 double time )
-{
-    return netcode_client_create_overload( address, NULL, config, time );
-}
+    if ( connect_token->num_server_addresses <= 0 )
+        return NETCODE_ERROR;
 
-void netcode_client_destroy( struct netcode_client_t * client )
-{
-    netcode_assert( client );
-    if ( !client->loopback )
-        netcode_client_disconnect( client );
-    else
-        netcode_client_disconnect_loopback( client );
-    netcode_socket_destroy( &client->socket_holder.ipv4 );
-    netcode_socket_destroy( &client->socket_holder.ipv6 );
-    netcode_packet_queue_clear( &client->packet_receive_queue );
-    client->config.free_function( client->config.allocator_context, client );
-}
+    if ( connect_token->num_server_addresses > NETCODE_MAX_SERVERS_PER_CONNECT )
+        return NETCODE_ERROR;
 
-void netcode_client_set_state( struct netcode_client_t * client, int client_state )
-{
-    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client changed state from '%s' to '%s'\n", 
-        netcode_client_state_name( client->state ), netcode_client_state_name( client_state ) );
+    int i,j;
 
-    if ( client->config.state_change_callback )
+    for ( i = 0; i < connect_token->num_server_addresses; ++i )
     {
-        client->config.state_change_callback( client->config.callback_context, client->state, client_state );
-    }
+        connect_token->server_addresses[i].type = netcode_read_uint8( &buffer );
 
-    client->state = client_state;
-}
+        if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV4 )
+        {
+            for ( j = 0; j < 4; ++j )
+            {
+                connect_token->server_addresses[i].data.ipv4[j] = netcode_read_uint8( &buffer );
+            }
+            connect_token->server_addresses[i].port = netcode_read_uint16( &buffer );
+        }
+        else if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV6 )
+        {
+            for ( j = 0; j < 8; ++j )
+            {
+                connect_token->server_addresses[i].data.ipv6[j] = netcode_read_uint16( &buffer );
+            }
+            connect_token->server_addresses[i].port = netcode_read_uint16( &buffer );
+        }
+        else
+        {
+            return NETCODE_ERROR;
+        }
+    }
 
-void netcode_client_reset_before_next_connect( struct netcode_client_t * client )
-{
-    client->connect_start_time = client->time;
-    client->last_packet_send_time = client->time - 1.0f;
-    client->last_packet_receive_time = client->time;
-    client->should_disconnect = 0;
-    client->should_disconnect_state = NETCODE_CLIENT_STATE_DISCONNECTED;
-    client->challenge_token_sequence = 0;
+    netcode_read_bytes( &buffer, connect_token->client_to_server_key, NETCODE_KEY_BYTES );
 
-    memset( client->challenge_token_data, 0, NETCODE_CHALLENGE_TOKEN_BYTES );
+    netcode_read_bytes( &buffer, connect_token->server_to_client_key, NETCODE_KEY_BYTES );
 
-    netcode_replay_protection_reset( &client->replay_protection );
-}
+    netcode_read_bytes( &buffer, connect_token->user_data, NETCODE_USER_DATA_BYTES );
 
-void netcode_client_reset_connection_data( struct netcode_client_t * client, int client_state )
-{
-    netcode_assert( client );
+    connect_token->cipher_suite = netcode_read_uint8( &buffer );
 
-    client->sequence = 0;
-    client->loopback = 0;
-    client->client_index = 0;
-    client->max_clients = 0;
-    client->connect_start_time = 0.0;
-    client->server_address_index = 0;
-    memset( &client->server_address, 0, sizeof( struct netcode_address_t ) );
-    memset( &client->connect_token, 0, sizeof( struct netcode_connect_token_t ) );
-    memset( &client->context, 0, sizeof( struct netcode_context_t ) );
+    if ( connect_token->cipher_suite >= NETCODE_NUM_CIPHER_SUITES )
+        return NETCODE_ERROR;
 
-    netcode_client_set_state( client, client_state );
+    connect_token->session_ticket = netcode_read_uint8( &buffer );
 
-    netcode_client_reset_before_next_connect( client );
+    connect_token->session_ticket_sequence = netcode_read_uint64( &buffer );
 
-    while ( 1 )
-    {
-        void * packet = netcode_packet_queue_pop( &client->packet_receive_queue, NULL );
-        if ( !packet )
-            break;
-        client->config.free_function( client->config.allocator_context, packet );
-    }
+    if ( connect_token->session_ticket > 1 )
+        return NETCODE_ERROR;
 
-    netcode_packet_queue_clear( &client->packet_receive_queue );
+    return NETCODE_OK;
 }
 
-void netcode_client_disconnect_internal( struct netcode_client_t * client, int destination_state, int send_disconnect_packets );
+// -----------------------------------------------
 
-void netcode_client_connect( struct netcode_client_t * client, uint8_t * connect_token )
+struct netcode_challenge_token_t
 {
-    netcode_assert( client );
-    netcode_assert( connect_token );
+    uint64_t client_id;
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    int cipher_suite;
+};
 
-    netcode_client_disconnect( client );
+void netcode_write_challenge_token( struct netcode_challenge_token_t * challenge_token, uint8_t * buffer, int buffer_length )
+{
+    (void) buffer_length;
 
-    if ( netcode_read_connect_token( connect_token, NETCODE_CONNECT_TOKEN_BYTES, &client->connect_token ) != NETCODE_OK )
-    {
-        netcode_client_set_state( client, NETCODE_CLIENT_STATE_INVALID_CONNECT_TOKEN );
-        return;
-    }
+    netcode_assert( challenge_token );
+    netcode_assert( buffer );
+    netcode_assert( buffer_length >= NETCODE_CHALLENGE_TOKEN_BYTES );
 
-    client->server_address_index = 0;
-    client->server_address = client->connect_token.server_addresses[0];
+    memset( buffer, 0, NETCODE_CHALLENGE_TOKEN_BYTES );
 
-    char server_address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+    uint8_t * start = buffer;
 
-    netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connecting to server %s [%d/%d]\n", 
-        netcode_address_to_string( &client->server_address, server_address_string ), client->server_address_index + 1, client->connect_token.num_server_addresses );
+    (void) start;
 
-    memcpy( client->context.read_packet_key, client->connect_token.server_to_client_key, NETCODE_KEY_BYTES );
-    memcpy( client->context.write_packet_key, client->connect_token.client_to_server_key, NETCODE_KEY_BYTES );
+    netcode_write_uint64( &buffer, challenge_token->client_id );
 
-    netcode_client_reset_before_next_connect( client );
+    netcode_write_bytes( &buffer, challenge_token->user_data, NETCODE_USER_DATA_BYTES ); 
 
-    netcode_client_set_state( client, NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST );
+    netcode_write_uint8( &buffer, (uint8_t) challenge_token->cipher_suite );
+
+    netcode_assert( buffer - start <= NETCODE_CHALLENGE_TOKEN_BYTES - NETCODE_MAC_BYTES );
 }
 
-void netcode_client_process_packet_internal( struct netcode_client_t * client, struct netcode_address_t * from, uint8_t * packet, uint64_t sequence )
+int netcode_encrypt_challenge_token( uint8_t * buffer, int buffer_length, uint64_t sequence, uint8_t * key )
 {
-    netcode_assert( client );
-    netcode_assert( packet );
+    netcode_assert( buffer );
+    netcode_assert( buffer_length >= NETCODE_CHALLENGE_TOKEN_BYTES );
+    netcode_assert( key );
 
-    uint8_t packet_type = ( (uint8_t*) packet ) [0];
+    (void) buffer_length;
 
-    switch ( packet_type )
+    uint8_t nonce[12];
     {
-        case NETCODE_CONNECTION_DENIED_PACKET:
-        {
-            if ( ( client->state == NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST || 
-                   client->state == NETCODE_CLIENT_STATE_SENDING_CONNECTION_RESPONSE ) 
-                                                && 
-                      netcode_address_equal( from, &client->server_address ) )
-            {
-                client->should_disconnect = 1;
-                client->should_disconnect_state = NETCODE_CLIENT_STATE_CONNECTION_DENIED;
-                client->last_packet_receive_time = client->time;
-            }
-        }
-        break;
-
-        case NETCODE_CONNECTION_CHALLENGE_PACKET:
-        {
-            if ( client->state == NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST && netcode_address_equal( from, &client->server_address ) )
-            {
-                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client received connection challenge packet from server\n" );
-
-                struct netcode_connection_challenge_packet_t * p = (struct netcode_connection_challenge_packet_t*) packet;
-                client->challenge_token_sequence = p->challenge_token_sequence;
-                memcpy( client->challenge_token_data, p->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
-                client->last_packet_receive_time = client->time;
+        uint8_t * p = nonce;
+        netcode_write_uint32( &p, 0 );
+        netcode_write_uint64( &p, sequence );
+    }
 
-                netcode_client_set_state( client, NETCODE_CLIENT_STATE_SENDING_CONNECTION_RESPONSE );
-            }
-        }
-        break;
+    return netcode_encrypt_aead( buffer, NETCODE_CHALLENGE_TOKEN_BYTES - NETCODE_MAC_BYTES, NULL, 0, nonce, key );
+}
 
-        case NETCODE_CONNECTION_KEEP_ALIVE_PACKET:
-        {
-            if ( netcode_address_equal( from, &client->server_address ) )
-            {
-                struct netcode_connection_keep_alive_packet_t * p = (struct netcode_connection_keep_alive_packet_t*) packet;
+int netcode_decrypt_challenge_token( uint8_t * buffer, int buffer_length, uint64_t sequence, uint8_t * key )
+{
+    netcode_assert( buffer );
+    netcode_assert( buffer_length >= NETCODE_CHALLENGE_TOKEN_BYTES );
+    netcode_assert( key );
 
-                if ( client->state == NETCODE_CLIENT_STATE_CONNECTED )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client received connection keep alive packet from server\n" );
+    (void) buffer_length;
 
-                    client->last_packet_receive_time = client->time;
-                }
-                else if ( client->state == NETCODE_CLIENT_STATE_SENDING_CONNECTION_RESPONSE )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client received connection keep alive packet from server\n" );
-
-                    client->last_packet_receive_time = client->time;
-                    client->client_index = p->client_index;
-                    client->max_clients = p->max_clients;
+    uint8_t nonce[12];
+    {
+        uint8_t * p = nonce;
+        netcode_write_uint32( &p, 0 );
+        netcode_write_uint64( &p, sequence );
+    }
 
-                    netcode_client_set_state( client, NETCODE_CLIENT_STATE_CONNECTED );
+    return netcode_decrypt_aead( buffer, NETCODE_CHALLENGE_TOKEN_BYTES, NULL, 0, nonce, key );
+}
 
-                    netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connected to server\n" );
-                }
-            }
-        }
-        break;
+int netcode_read_challenge_token( uint8_t * buffer, int buffer_length, struct netcode_challenge_token_t * challenge_token )
+{
+    netcode_assert( buffer );
+    netcode_assert( challenge_token );
 
-        case NETCODE_CONNECTION_PAYLOAD_PACKET:
-        {
-            if ( client->state == NETCODE_CLIENT_STATE_CONNECTED && netcode_address_equal( from, &client->server_address ) )
-            {
-                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client received connection payload packet from server\n" );
+    if ( buffer_length < NETCODE_CHALLENGE_TOKEN_BYTES )
+        return NETCODE_ERROR;
 
-                netcode_packet_queue_push( &client->packet_receive_queue, packet, sequence );
+    uint8_t * start = buffer;
 
-                client->last_packet_receive_time = client->time;
+    (void) start;
+    
+    challenge_token->client_id = netcode_read_uint64( &buffer );
 
-                return;
-            }
-        }
-        break;
+    netcode_read_bytes( &buffer, challenge_token->user_data, NETCODE_USER_DATA_BYTES );
 
-        case NETCODE_CONNECTION_DISCONNECT_PACKET:
-        {
-            if ( client->state == NETCODE_CLIENT_STATE_CONNECTED && netcode_address_equal( from, &client->server_address ) )
-            {
-                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client received disconnect packet from server\n" );
+    challenge_token->cipher_suite = netcode_read_uint8( &buffer );
 
-                client->should_disconnect = 1;
-                client->should_disconnect_state = NETCODE_CLIENT_STATE_DISCONNECTED;
-                client->last_packet_receive_time = client->time;
-            }
-        }
-        break;
+    netcode_assert( buffer - start == 8 + NETCODE_USER_DATA_BYTES + 1 );
 
-        default:
-            break;
-    }
+    if ( challenge_token->cipher_suite >= NETCODE_NUM_CIPHER_SUITES )
+        return NETCODE_ERROR;
 
-    client->config.free_function( client->config.allocator_context, packet );    
+    return NETCODE_OK;
 }
 
-void netcode_client_process_packet( struct netcode_client_t * client, struct netcode_address_t * from, uint8_t * packet_data, int packet_bytes )
-{
-    (void) client;
-    (void) from;
-    (void) packet_data;
-    (void) packet_bytes;
-
-    uint8_t allowed_packets[NETCODE_CONNECTION_NUM_PACKETS];
-    memset( allowed_packets, 0, sizeof( allowed_packets ) );
-    allowed_packets[NETCODE_CONNECTION_DENIED_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_CHALLENGE_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_KEEP_ALIVE_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_PAYLOAD_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_DISCONNECT_PACKET] = 1;
+// ----------------------------------------------------------------
 
-    uint64_t current_timestamp = (uint64_t) time( NULL );
+#define NETCODE_CONNECTION_REQUEST_PACKET           0
+#define NETCODE_CONNECTION_DENIED_PACKET            1
+#define NETCODE_CONNECTION_CHALLENGE_PACKET         2
+#define NETCODE_CONNECTION_RESPONSE_PACKET          3
+#define NETCODE_CONNECTION_KEEP_ALIVE_PACKET        4
+#define NETCODE_CONNECTION_PAYLOAD_PACKET           5
+#define NETCODE_CONNECTION_DISCONNECT_PACKET        6
+#define NETCODE_CONNECTION_SESSION_TICKET_PACKET    7
+#define NETCODE_CONNECTION_NUM_PACKETS              8
 
-    uint64_t sequence;
+// packets a client sends on a connection may carry a connection id between the prefix byte and the sequence,
+// flagged in the packet type bits. this caps packet types at eight
 
-    void * packet = netcode_read_packet( packet_data, 
-                                         packet_bytes, 
-                                         &sequence, 
-                                         client->context.read_packet_key, 
-                                         client->connect_token.protocol_id, 
-                                         current_timestamp, 
-                                         NULL, 
-                                         allowed_packets, 
-                                         &client->replay_protection, 
-                                         client->config.allocator_context, 
-                                         client->config.allocate_function );
+#define NETCODE_CONNECTION_ID_FLAG                  0x8
+#define NETCODE_CONNECTION_ID_BYTES                 8
 
-    if ( !packet )
-        return;
-    
-    netcode_client_process_packet_internal( client, from, (uint8_t*)packet, sequence );
-}
+#define NETCODE_SESSION_TICKET_PACKET_BYTES ( 8 + NETCODE_CONNECT_TOKEN_NONCE_BYTES + 4 + 1 + NETCODE_KEY_BYTES * 2 + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES )
 
-void netcode_client_receive_packets( struct netcode_client_t * client )
+struct netcode_connection_request_packet_t
 {
-    netcode_assert( client );
-    netcode_assert( !client->loopback );
+    uint8_t packet_type;
+    uint8_t version_info[NETCODE_VERSION_INFO_BYTES];
+    uint64_t protocol_id;
+    uint64_t connect_token_expire_timestamp;
+    uint8_t connect_token_nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
+    uint8_t connect_token_data[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
+    int cipher_suite;
+};
 
-    uint8_t allowed_packets[NETCODE_CONNECTION_NUM_PACKETS];
-    memset( allowed_packets, 0, sizeof( allowed_packets ) );
-    allowed_packets[NETCODE_CONNECTION_DENIED_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_CHALLENGE_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_KEEP_ALIVE_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_PAYLOAD_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_DISCONNECT_PACKET] = 1;
+struct netcode_connection_denied_packet_t
+{
+    uint8_t packet_type;
+};
 
-    uint64_t current_timestamp = (uint64_t) time( NULL );
+struct netcode_connection_challenge_packet_t
+{
+    uint8_t packet_type;
+    uint64_t challenge_token_sequence;
+    uint8_t challenge_token_data[NETCODE_CHALLENGE_TOKEN_BYTES];
+    int cipher_suite;
+};
 
-    if ( !client->config.network_simulator )
-    {
-        // process packets received from socket
+struct netcode_connection_response_packet_t
+{
+    uint8_t packet_type;
+    uint64_t challenge_token_sequence;
+    uint8_t challenge_token_data[NETCODE_CHALLENGE_TOKEN_BYTES];
+};
 
-        while ( 1 )
-        {
-            struct netcode_address_t from;
-            uint8_t packet_data[NETCODE_MAX_PACKET_BYTES];
-            int packet_bytes = 0;
+struct netcode_connection_keep_alive_packet_t
+{
+    uint8_t packet_type;
+    int client_index;
+    int max_clients;
+};
 
-            if ( client->config.override_send_and_receive )
-            {
-                packet_bytes = client->config.receive_packet_override( client->config.callback_context, &from, packet_data, NETCODE_MAX_PACKET_BYTES );
-            }
-            else if ( client->server_address.type == NETCODE_ADDRESS_IPV4 )
-            {
-                packet_bytes = netcode_socket_receive_packet( &client->socket_holder.ipv4, &from, packet_data, NETCODE_MAX_PACKET_BYTES );
-            }
-            else if ( client->server_address.type == NETCODE_ADDRESS_IPV6 )
-            {
-                packet_bytes = netcode_socket_receive_packet( &client->socket_holder.ipv6, &from, packet_data, NETCODE_MAX_PACKET_BYTES );
-            }
+struct netcode_connection_payload_packet_t
+{
+    uint8_t packet_type;
+    uint32_t payload_bytes;
+    uint8_t * payload_data;
+};
 
-            if ( packet_bytes == 0 )
-                break;
+#define NETCODE_RECEIVE_BUFFER_HEADROOM 32
 
-            if ( client->config.auxiliary_command_function != NULL ) {
-                if ( client->config.auxiliary_command_function(
-                            client->config.auxiliary_command_context, 
-                            packet_data, 
-                            packet_bytes ))
-                {
-                    continue;
-                }
-            }
+struct netcode_connection_disconnect_packet_t
+{
+    uint8_t packet_type;
+};
 
-            uint64_t sequence;
-            void * packet = netcode_read_packet( packet_data, 
-                                                 packet_bytes, 
-                                                 &sequence, 
-                                                 client->context.read_packet_key, 
-                                                 client->connect_token.protocol_id, 
-                                                 current_timestamp, 
-                                                 NULL, 
-                                                 allowed_packets, 
-                                                 &client->replay_protection, 
-                                                 client->config.allocator_context, 
-                                                 client->config.allocate_function );
+struct netcode_connection_session_ticket_packet_t
+{
+    uint8_t packet_type;
+    uint64_t expire_timestamp;
+    uint8_t nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
+    int timeout_seconds;
+    int cipher_suite;
+    uint8_t client_to_server_key[NETCODE_KEY_BYTES];
+    uint8_t server_to_client_key[NETCODE_KEY_BYTES];
+    uint8_t ticket_data[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
+};
 
-            if ( !packet )
-                continue;
+struct netcode_connection_payload_packet_t * netcode_create_payload_packet( int payload_bytes, void * allocator_context, void* (*allocate_function)(void*,size_t) )
+{
+    netcode_assert( payload_bytes >= 0 );
+    netcode_assert( payload_bytes <= NETCODE_MAX_PAYLOAD_BYTES );
 
-            netcode_client_process_packet_internal( client, &from, (uint8_t*)packet, sequence );
-        }
-    }
-    else
+    if ( allocate_function == NULL )
     {
-        // process packets received from network simulator
+        allocate_function = netcode_default_allocate_function;
+    }
 
-        int num_packets_received = netcode_network_simulator_receive_packets( client->config.network_simulator, 
-                                                                              &client->address, 
-                                                                              NETCODE_CLIENT_MAX_RECEIVE_PACKETS, 
-                                                                              client->receive_packet_data, 
-                                                                              client->receive_packet_bytes, 
-                                                                              client->receive_from );
+    struct netcode_connection_payload_packet_t * packet = (struct netcode_connection_payload_packet_t*) 
+        allocate_function( allocator_context, sizeof( struct netcode_connection_payload_packet_t ) + payload_bytes );
 
-        int i;
-        for ( i = 0; i < num_packets_received; ++i )
-        {
-            uint64_t sequence;
+    if ( !packet )
+        return NULL;
+    
+    packet->packet_type = NETCODE_CONNECTION_PAYLOAD_PACKET;
+    packet->payload_bytes = payload_bytes;
+    packet->payload_data = (uint8_t*) ( packet + 1 );
 
-            void * packet = netcode_read_packet( client->receive_packet_data[i], 
-                                                 client->receive_packet_bytes[i], 
-                                                 &sequence, 
-                                                 client->context.read_packet_key, 
-                                                 client->connect_token.protocol_id, 
-                                                 current_timestamp, 
-                                                 NULL, 
-                                                 allowed_packets, 
-                                                 &client->replay_protection, 
-                                                 client->config.allocator_context, 
-                                                 client->config.allocate_function );
+    return packet;
+}
 
-            client->config.free_function( client->config.allocator_context, client->receive_packet_data[i] );
+struct netcode_context_t
+{
+    uint8_t write_packet_key[NETCODE_KEY_BYTES];
+    uint8_t read_packet_key[NETCODE_KEY_BYTES];
+    int cipher_suite;
+    struct netcode_packet_cipher_t write_packet_cipher;
+    struct netcode_packet_cipher_t read_packet_cipher;
+};
 
-            if ( !packet )
-                continue;
+void netcode_context_set_cipher_suite( struct netcode_context_t * context, int cipher_suite )
+{
+    netcode_assert( context );
+    netcode_assert( cipher_suite >= 0 );
+    netcode_assert( cipher_suite < NETCODE_NUM_CIPHER_SUITES );
 
-            netcode_client_process_packet_internal( client, &client->receive_from[i], (uint8_t*)packet, sequence );
-        }
-    }
+    context->cipher_suite = cipher_suite;
+
+    netcode_packet_cipher_init( &context->write_packet_cipher, cipher_suite, context->write_packet_key );
+    netcode_packet_cipher_init( &context->read_packet_cipher, cipher_suite, context->read_packet_key );
 }
 
-void netcode_client_send_packet_to_server_internal( struct netcode_client_t * client, void * packet )
+NETCODE_CONST struct netcode_packet_cipher_t * netcode_context_write_packet_cipher( struct netcode_context_t * context )
 {
-    netcode_assert( client );
-    netcode_assert( !client->loopback );
-    
-    uint8_t packet_data[NETCODE_MAX_PACKET_BYTES];
-
-    int packet_bytes = netcode_write_packet( packet, 
-                                             packet_data, 
-                                             NETCODE_MAX_PACKET_BYTES, 
-                                             client->sequence++, 
-                                             client->context.write_packet_key, 
-                                             client->connect_token.protocol_id );
+    return ( context->cipher_suite != NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 ) ? &context->write_packet_cipher : NULL;
+}
 
-    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_BYTES );
+NETCODE_CONST struct netcode_packet_cipher_t * netcode_context_read_packet_cipher( struct netcode_context_t * context )
+{
+    return ( context->cipher_suite != NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 ) ? &context->read_packet_cipher : NULL;
+}
 
-    if ( client->config.network_simulator )
-    {
-        netcode_network_simulator_send_packet( client->config.network_simulator, &client->address, &client->server_address, packet_data, packet_bytes );
-    }
-    else
+int netcode_sequence_number_bytes_required( uint64_t sequence )
+{
+    int i;
+    uint64_t mask = 0xFF00000000000000UL;
+    for ( i = 0; i < 7; ++i )
     {
-        if ( client->config.override_send_and_receive )
-        {
-            client->config.send_packet_override( client->config.callback_context, &client->server_address, packet_data, packet_bytes );
-        }
-        else if ( client->server_address.type == NETCODE_ADDRESS_IPV4 )
-        {
-            netcode_socket_send_packet( &client->socket_holder.ipv4, &client->server_address, packet_data, packet_bytes );
-        }
-        else if ( client->server_address.type == NETCODE_ADDRESS_IPV6 )
-        {
-            netcode_socket_send_packet( &client->socket_holder.ipv6, &client->server_address, packet_data, packet_bytes );
-        }
+        if ( sequence & mask )
+            break;
+        mask >>= 8;
     }
-
-    client->last_packet_send_time = client->time;
+    return 8 - i;
 }
 
-void netcode_client_send_packets( struct netcode_client_t * client )
+uint64_t netcode_connection_id( NETCODE_CONST uint8_t * client_to_server_key, int client_index )
 {
-    netcode_assert( client );
-    netcode_assert( !client->loopback );
+    netcode_assert( client_to_server_key );
+    netcode_assert( client_index >= 0 );
 
-    switch ( client->state )
-    {
-        case NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST:
-        {
-            if ( client->last_packet_send_time + ( 1.0 / NETCODE_PACKET_SEND_RATE ) >= client->time )
-                return;
+    // the low half is the client slot, so the server finds the client without a lookup. the high half is keyed on the
+    // connection, so a slot can't be claimed by guessing, and the top bit is set so a connection id is never zero
 
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client sent connection request packet to server\n" );
+    uint8_t hash[16];
+    crypto_generichash( hash, sizeof( hash ), (const unsigned char*) "netcode connection id", 21, client_to_server_key, NETCODE_KEY_BYTES );
 
-            struct netcode_connection_request_packet_t packet;
-            packet.packet_type = NETCODE_CONNECTION_REQUEST_PACKET;
-            memcpy( packet.version_info, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
-            packet.protocol_id = client->connect_token.protocol_id;
-            packet.connect_token_expire_timestamp = client->connect_token.expire_timestamp;
-            memcpy( packet.connect_token_nonce, client->connect_token.nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
-            memcpy( packet.connect_token_data, client->connect_token.private_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    uint8_t * p = hash;
+    uint32_t tag = netcode_read_uint32( &p ) | 0x80000000;
 
-            netcode_client_send_packet_to_server_internal( client, &packet );
-        }
-        break;
+    return ( ( (uint64_t) tag ) << 32 ) | (uint32_t) client_index;
+}
 
-        case NETCODE_CLIENT_STATE_SENDING_CONNECTION_RESPONSE:
-        {
-            if ( client->last_packet_send_time + ( 1.0 / NETCODE_PACKET_SEND_RATE ) >= client->time )
-                return;
+int netcode_packet_type_uses_connection_cipher( int packet_type )
+{
+    // handshake packets are always chacha20-poly1305. so is the session ticket, since it carries fresh keys for the next
+    // session and must stay secret even on a connection that only authenticates its packets
 
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client sent connection response packet to server\n" );
+    return packet_type >= NETCODE_CONNECTION_KEEP_ALIVE_PACKET && packet_type != NETCODE_CONNECTION_SESSION_TICKET_PACKET;
+}
 
-            struct netcode_connection_response_packet_t packet;
-            packet.packet_type = NETCODE_CONNECTION_RESPONSE_PACKET;
-            packet.challenge_token_sequence = client->challenge_token_sequence;
-            memcpy( packet.challenge_token_data, client->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
+int netcode_write_packet_with_connection_id( void * packet, 
+                                             uint8_t * buffer, 
+                                             int buffer_length, 
+                                             uint64_t sequence, 
+                                             uint8_t * write_packet_key, 
+                                             uint64_t protocol_id, 
+                                             uint64_t connection_id, 
+                                             NETCODE_CONST struct netcode_packet_cipher_t * write_packet_cipher )
+{
+    // write_packet_cipher is set once a connection has negotiated a cipher suite other than chacha20-poly1305. it protects keep-alive, payload
+    // and disconnect packets. the handshake packets before it always use chacha20-poly1305. a non-zero connection_id is written
+    // in front of the sequence of those same packets
 
-            netcode_client_send_packet_to_server_internal( client, &packet );
-        }
-        break;
+    netcode_assert( packet );
+    netcode_assert( buffer );
+    netcode_assert( write_packet_key );
 
-        case NETCODE_CLIENT_STATE_CONNECTED:
-        {
-            if ( client->last_packet_send_time + ( 1.0 / NETCODE_PACKET_SEND_RATE ) >= client->time )
-                return;
+    (void) buffer_length;
 
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client sent connection keep-alive packet to server\n" );
+    uint8_t packet_type = ((uint8_t*)packet)[0];
 
-            struct netcode_connection_keep_alive_packet_t packet;
-            packet.packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
-            packet.client_index = 0;
-            packet.max_clients = 0;
+    if ( packet_type == NETCODE_CONNECTION_REQUEST_PACKET )
+    {
+        // connection request packet: first byte is zero, except for the cipher suite the client proposes in the high bits
 
-            netcode_client_send_packet_to_server_internal( client, &packet );
-        }
-        break;
-        
-        default:
-            break;
-    }
-}
+        netcode_assert( buffer_length >= 1 + 13 + 8 + 8 + NETCODE_CONNECT_TOKEN_NONCE_BYTES + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
 
-int netcode_client_connect_to_next_server( struct netcode_client_t * client )
-{
-    netcode_assert( client );
+        struct netcode_connection_request_packet_t * p = (struct netcode_connection_request_packet_t*) packet;
 
-    if ( client->server_address_index + 1 >= client->connect_token.num_server_addresses )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client has no more servers to connect to\n" );
-        return 0;
+        netcode_assert( p->cipher_suite >= 0 );
+        netcode_assert( p->cipher_suite < NETCODE_NUM_CIPHER_SUITES );
+
+        uint8_t * start = buffer;
+
+        netcode_write_uint8( &buffer, (uint8_t) ( NETCODE_CONNECTION_REQUEST_PACKET | ( p->cipher_suite << 4 ) ) );
+        netcode_write_bytes( &buffer, p->version_info, NETCODE_VERSION_INFO_BYTES );
+        netcode_write_uint64( &buffer, p->protocol_id );
+        netcode_write_uint64( &buffer, p->connect_token_expire_timestamp );
+        netcode_write_bytes( &buffer, p->connect_token_nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+        netcode_write_bytes( &buffer, p->connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+
+        netcode_assert( buffer - start == 1 + 13 + 8 + 8 + NETCODE_CONNECT_TOKEN_NONCE_BYTES + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+
+        return (int) ( buffer - start );
     }
+    else
+    {
+        // *** encrypted packets ***
 
-    client->server_address_index++;
-    client->server_address = client->connect_token.server_addresses[client->server_address_index];
+        // write the prefix byte (this is a combination of the packet type and number of sequence bytes)
 
-    netcode_client_reset_before_next_connect( client );
+        uint8_t * start = buffer;
 
-    char server_address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+        uint8_t sequence_bytes = (uint8_t) netcode_sequence_number_bytes_required( sequence );
 
-    netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connecting to next server %s [%d/%d]\n", 
-        netcode_address_to_string( &client->server_address, server_address_string ), 
-        client->server_address_index + 1, 
-        client->connect_token.num_server_addresses );
+        netcode_assert( sequence_bytes >= 1 );
+        netcode_assert( sequence_bytes <= 8 );
 
-    netcode_client_set_state( client, NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST );
+        netcode_assert( packet_type < NETCODE_CONNECTION_ID_FLAG );
 
-    return 1;
-}
+        netcode_assert( connection_id == 0 || packet_type >= NETCODE_CONNECTION_KEEP_ALIVE_PACKET );
 
-void netcode_client_update( struct netcode_client_t * client, double time )
-{
-    netcode_assert( client );
+        uint8_t prefix_byte = packet_type | ( connection_id ? NETCODE_CONNECTION_ID_FLAG : 0 ) | ( sequence_bytes << 4 );
 
-    client->time = time;
+        netcode_write_uint8( &buffer, prefix_byte );
 
-    if ( client->loopback )
-        return;
+        if ( connection_id )
+        {
+            netcode_write_uint64( &buffer, connection_id );
+        }
 
-    netcode_client_receive_packets( client );
+        // write the variable length sequence number [1,8] bytes.
 
-    netcode_client_send_packets( client );
+        uint64_t sequence_temp = sequence;
 
-    if ( client->state > NETCODE_CLIENT_STATE_DISCONNECTED && client->state < NETCODE_CLIENT_STATE_CONNECTED )
-    {
-        uint64_t connect_token_expire_seconds = ( client->connect_token.expire_timestamp - client->connect_token.create_timestamp );            
-        if ( client->time - client->connect_start_time >= connect_token_expire_seconds )
+        int i;
+        for ( i = 0; i < sequence_bytes; ++i )
         {
-            netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connect failed. connect token expired\n" );
-            netcode_client_disconnect_internal( client, NETCODE_CLIENT_STATE_CONNECT_TOKEN_EXPIRED, 0 );
-            return;
+            netcode_write_uint8( &buffer, (uint8_t) ( sequence_temp & 0xFF ) );
+            sequence_temp >>= 8;
         }
-    }
 
-    if ( client->should_disconnect )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client should disconnect -> %s\n", netcode_client_state_name( client->should_disconnect_state ) );
-        if ( netcode_client_connect_to_next_server( client ) )
-            return;
-        netcode_client_disconnect_internal( client, client->should_disconnect_state, 0 );
-        return;
-    }
+        // write packet data according to type. this data will be encrypted.
 
-    switch ( client->state )
-    {
-        case NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST:
+        uint8_t * encrypted_start = buffer;
+
+        switch ( packet_type )
         {
-            if ( client->connect_token.timeout_seconds > 0 && client->last_packet_receive_time + client->connect_token.timeout_seconds < time )
+            case NETCODE_CONNECTION_DENIED_PACKET:
             {
-                netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connect failed. connection request timed out\n" );
-                if ( netcode_client_connect_to_next_server( client ) )
-                    return;
-                netcode_client_disconnect_internal( client, NETCODE_CLIENT_STATE_CONNECTION_REQUEST_TIMED_OUT, 0 );
-                return;
+                // ...
             }
-        }
-        break;
+            break;
 
-        case NETCODE_CLIENT_STATE_SENDING_CONNECTION_RESPONSE:
-        {
-            if ( client->connect_token.timeout_seconds > 0 && client->last_packet_receive_time + client->connect_token.timeout_seconds < time )
+            case NETCODE_CONNECTION_CHALLENGE_PACKET:
             {
-                netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connect failed. connection response timed out\n" );
-                if ( netcode_client_connect_to_next_server( client ) )
-                    return;
-                netcode_client_disconnect_internal( client, NETCODE_CLIENT_STATE_CONNECTION_RESPONSE_TIMED_OUT, 0 );
-                return;
+                struct netcode_connection_challenge_packet_t * p = (struct netcode_connection_challenge_packet_t*) packet;
+                netcode_write_uint64( &buffer, p->challenge_token_sequence );
+                netcode_write_bytes( &buffer, p->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
+                if ( p->cipher_suite != NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 )
+                {
+                    // only clients that proposed a cipher suite get this byte, so older clients see the challenge they expect
+                    netcode_write_uint8( &buffer, (uint8_t) p->cipher_suite );
+                }
             }
-        }
-        break;
+            break;
 
-        case NETCODE_CLIENT_STATE_CONNECTED:
-        {
-            if ( client->connect_token.timeout_seconds > 0 && client->last_packet_receive_time + client->connect_token.timeout_seconds < time )
+            case NETCODE_CONNECTION_RESPONSE_PACKET:
             {
-                netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connection timed out\n" );
-                netcode_client_disconnect_internal( client, NETCODE_CLIENT_STATE_CONNECTION_TIMED_OUT, 0 );
-                return;
+                struct netcode_connection_response_packet_t * p = (struct netcode_connection_response_packet_t*) packet;
+                netcode_write_uint64( &buffer, p->challenge_token_sequence );
+                netcode_write_bytes( &buffer, p->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
             }
-        }
-        break;
+            break;
 
-        default:
+            case NETCODE_CONNECTION_KEEP_ALIVE_PACKET:
+            {
+                struct netcode_connection_keep_alive_packet_t * p = (struct netcode_connection_keep_alive_packet_t*) packet;
+                netcode_write_uint32( &buffer, p->client_index );
+                netcode_write_uint32( &buffer, p->max_clients );
+            }
             break;
-    }
-}
 
-uint64_t netcode_client_next_packet_sequence( struct netcode_client_t * client )
-{
-    netcode_assert( client );
-    return client->sequence;  
-}
+            case NETCODE_CONNECTION_PAYLOAD_PACKET:
+            {
+                struct netcode_connection_payload_packet_t * p = (struct netcode_connection_payload_packet_t*) packet;
 
-void netcode_client_send_packet( struct netcode_client_t * client, NETCODE_CONST uint8_t * packet_data, int packet_bytes )
-{
-    netcode_assert( client );
-    netcode_assert( packet_data );
-    netcode_assert( packet_bytes >= 0 );
-    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_SIZE );
+                netcode_assert( p->payload_bytes <= NETCODE_MAX_PAYLOAD_BYTES );
 
-    if ( client->state != NETCODE_CLIENT_STATE_CONNECTED )
-        return;
+                netcode_write_bytes( &buffer, p->payload_data, p->payload_bytes );
+            }
+            break;
 
-    if ( !client->loopback )
-    {
-        uint8_t buffer[NETCODE_MAX_PAYLOAD_BYTES*2];
+            case NETCODE_CONNECTION_DISCONNECT_PACKET:
+            {
+                // ...
+            }
+            break;
 
-        struct netcode_connection_payload_packet_t * packet = (struct netcode_connection_payload_packet_t*) buffer;
+            case NETCODE_CONNECTION_SESSION_TICKET_PACKET:
+            {
+                struct netcode_connection_session_ticket_packet_t * p = (struct netcode_connection_session_ticket_packet_t*) packet;
+                netcode_write_uint64( &buffer, p->expire_timestamp );
+                netcode_write_bytes( &buffer, p->nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+                netcode_write_uint32( &buffer, p->timeout_seconds );
+                netcode_write_uint8( &buffer, (uint8_t) p->cipher_suite );
+                netcode_write_bytes( &buffer, p->client_to_server_key, NETCODE_KEY_BYTES );
+                netcode_write_bytes( &buffer, p->server_to_client_key, NETCODE_KEY_BYTES );
+                netcode_write_bytes( &buffer, p->ticket_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+            }
+            break;
 
-        packet->packet_type = NETCODE_CONNECTION_PAYLOAD_PACKET;
-        packet->payload_bytes = packet_bytes;
-        memcpy( packet->payload_data, packet_data, packet_bytes );
+            default:
+                netcode_assert( 0 );
+        }
 
-        netcode_client_send_packet_to_server_internal( client, packet );
-    }
-    else
-    {
-        client->config.send_loopback_packet_callback( client->config.callback_context, 
-                                                      client->client_index, 
-                                                      packet_data,
-                                                      packet_bytes,
-                                                      client->sequence++ );
-    }
-}
+        netcode_assert( buffer - start <= buffer_length - NETCODE_MAC_BYTES );
 
-uint8_t * netcode_client_receive_packet( struct netcode_client_t * client, int * packet_bytes, uint64_t * packet_sequence )
-{
-    netcode_assert( client );
-    netcode_assert( packet_bytes );
+        uint8_t * encrypted_finish = buffer;
 
-    struct netcode_connection_payload_packet_t * packet = (struct netcode_connection_payload_packet_t*) 
-        netcode_packet_queue_pop( &client->packet_receive_queue, packet_sequence );
-    
-    if ( packet )
-    {
-        netcode_assert( packet->packet_type == NETCODE_CONNECTION_PAYLOAD_PACKET );
-        *packet_bytes = packet->payload_bytes;
-        netcode_assert( *packet_bytes >= 0 );
-        netcode_assert( *packet_bytes <= NETCODE_MAX_PAYLOAD_BYTES );
-        return (uint8_t*) &packet->payload_data;
-    }
-    else
-    {
-        return NULL;
+        // encrypt the per-packet packet written with the prefix byte, protocol id and version as the associated data. this must match to decrypt.
+
+        uint8_t additional_data[NETCODE_VERSION_INFO_BYTES+8+1];
+        {
+            uint8_t * p = additional_data;
+            netcode_write_bytes( &p, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
+            netcode_write_uint64( &p, protocol_id );
+            netcode_write_uint8( &p, prefix_byte );
+        }
+
+        uint8_t nonce[12];
+        {
+            uint8_t * p = nonce;
+            netcode_write_uint32( &p, 0 );
+            netcode_write_uint64( &p, sequence );
+        }
+
+        if ( netcode_encrypt_packet_aead( encrypted_start, 
+                                          encrypted_start, 
+                                          encrypted_finish - encrypted_start, 
+                                          additional_data, sizeof( additional_data ), 
+                                          nonce, 
+                                          write_packet_key, 
+                                          netcode_packet_type_uses_connection_cipher( packet_type ) ? write_packet_cipher : NULL ) != NETCODE_OK )
+        {
+            return NETCODE_ERROR;
+        }
+
+        buffer += NETCODE_MAC_BYTES;
+
+        netcode_assert( buffer - start <= buffer_length );
+
+        return (int) ( buffer - start );
     }
 }
 
-void netcode_client_free_packet( struct netcode_client_t * client, void * packet )
+int netcode_write_packet( void * packet, 
+                          uint8_t * buffer, 
+                          int buffer_length, 
+                          uint64_t sequence, 
+                          uint8_t * write_packet_key, 
+                          uint64_t protocol_id, 
+                          NETCODE_CONST struct netcode_packet_cipher_t * write_packet_cipher )
 {
-    netcode_assert( client );
-    netcode_assert( packet );
-    uint8_t * packet_data = (uint8_t*) packet;
-    int offset = offsetof( struct netcode_connection_payload_packet_t, payload_data );
-    client->config.free_function( client->config.allocator_context, packet_data - offset );
+    return netcode_write_packet_with_connection_id( packet, buffer, buffer_length, sequence, write_packet_key, protocol_id, 0, write_packet_cipher );
 }
 
-void netcode_client_disconnect( struct netcode_client_t * client )
+int netcode_write_payload_packet_header( uint8_t * buffer, 
+                                         uint64_t sequence, 
+                                         uint64_t protocol_id, 
+                                         uint64_t connection_id, 
+                                         uint8_t * additional_data, 
+                                         uint8_t * nonce )
 {
-    netcode_assert( client );
-    netcode_assert( !client->loopback );
-    netcode_client_disconnect_internal( client, NETCODE_CLIENT_STATE_DISCONNECTED, 1 );
-}
+    // writes the prefix byte, connection id (when non-zero) and sequence of a payload packet, and fills in the
+    // associated data (NETCODE_VERSION_INFO_BYTES+8+1 bytes) and nonce (12 bytes) its payload must be encrypted with
 
-void netcode_client_disconnect_internal( struct netcode_client_t * client, int destination_state, int send_disconnect_packets )
-{
-    netcode_assert( !client->loopback );
-    netcode_assert( destination_state <= NETCODE_CLIENT_STATE_DISCONNECTED );
+    uint8_t * start = buffer;
 
-    if ( client->state <= NETCODE_CLIENT_STATE_DISCONNECTED || client->state == destination_state )
-        return;
+    uint8_t sequence_bytes = (uint8_t) netcode_sequence_number_bytes_required( sequence );
 
-    netcode_printf( NETCODE_LOG_LEVEL_INFO, "client disconnected\n" );
+    uint8_t prefix_byte = NETCODE_CONNECTION_PAYLOAD_PACKET | ( connection_id ? NETCODE_CONNECTION_ID_FLAG : 0 ) | ( sequence_bytes << 4 );
 
-    if ( !client->loopback && send_disconnect_packets && client->state > NETCODE_CLIENT_STATE_DISCONNECTED )
+    netcode_write_uint8( &buffer, prefix_byte );
+
+    if ( connection_id )
     {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client sent disconnect packets to server\n" );
+        netcode_write_uint64( &buffer, connection_id );
+    }
 
-        int i;
-        for ( i = 0; i < NETCODE_NUM_DISCONNECT_PACKETS; ++i )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client sent disconnect packet %d\n", i );
+    uint64_t sequence_temp = sequence;
 
-            struct netcode_connection_disconnect_packet_t packet;
-            packet.packet_type = NETCODE_CONNECTION_DISCONNECT_PACKET;
+    int i;
+    for ( i = 0; i < sequence_bytes; ++i )
+    {
+        netcode_write_uint8( &buffer, (uint8_t) ( sequence_temp & 0xFF ) );
+        sequence_temp >>= 8;
+    }
 
-            netcode_client_send_packet_to_server_internal( client, &packet );
-        }
+    {
+        uint8_t * p = additional_data;
+        netcode_write_bytes( &p, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
+        netcode_write_uint64( &p, protocol_id );
+        netcode_write_uint8( &p, prefix_byte );
     }
 
-    netcode_client_reset_connection_data( client, destination_state );
-}
+    {
+        uint8_t * p = nonce;
+        netcode_write_uint32( &p, 0 );
+        netcode_write_uint64( &p, sequence );
+    }
 
-int netcode_client_state( struct netcode_client_t * client )
-{
-    netcode_assert( client );
-    return client->state;
+    return (int) ( buffer - start );
 }
 
-int netcode_client_index( struct netcode_client_t * client )
+int netcode_write_payload_packet( uint8_t * buffer, 
+                                  NETCODE_CONST uint8_t * payload_data, 
+                                  int payload_bytes, 
+                                  uint64_t sequence, 
+                                  uint8_t * write_packet_key, 
+                                  uint64_t protocol_id, 
+                                  uint64_t connection_id, 
+                                  NETCODE_CONST struct netcode_packet_cipher_t * write_packet_cipher )
 {
-    netcode_assert( client );
-    return client->client_index;
-}
+    // same wire format as netcode_write_packet for a payload packet, but the payload is encrypted straight from
+    // payload_data into the buffer. when payload_data already sits just after the header, it is encrypted in place
 
-int netcode_client_max_clients( struct netcode_client_t * client )
-{   
-    netcode_assert( client );
-    return client->max_clients;
-}
+    netcode_assert( buffer );
+    netcode_assert( payload_data );
+    netcode_assert( payload_bytes > 0 );
+    netcode_assert( payload_bytes <= NETCODE_MAX_PAYLOAD_BYTES );
+    netcode_assert( write_packet_key );
 
-void netcode_client_connect_loopback( struct netcode_client_t * client, int client_index, int max_clients )
-{
-    netcode_assert( client );
-    netcode_assert( client->state <= NETCODE_CLIENT_STATE_DISCONNECTED );
-    netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connected to server via loopback as client %d\n", client_index );
-    client->state = NETCODE_CLIENT_STATE_CONNECTED;
-    client->client_index = client_index;
-    client->max_clients = max_clients;
-    client->loopback = 1;
-}
+    uint8_t additional_data[NETCODE_VERSION_INFO_BYTES+8+1];
+    uint8_t nonce[12];
 
-void netcode_client_disconnect_loopback( struct netcode_client_t * client )
-{
-    netcode_assert( client );
-    netcode_assert( client->loopback );
-    netcode_client_reset_connection_data( client, NETCODE_CLIENT_STATE_DISCONNECTED );
-}
+    int header_bytes = netcode_write_payload_packet_header( buffer, sequence, protocol_id, connection_id, additional_data, nonce );
 
-int netcode_client_loopback( struct netcode_client_t * client )
-{
-    netcode_assert( client );
-    return client->loopback;
+    uint8_t * encrypted_start = buffer + header_bytes;
+
+    netcode_assert( payload_data == encrypted_start || payload_data + payload_bytes <= encrypted_start || payload_data >= encrypted_start + payload_bytes + NETCODE_MAC_BYTES );
+
+    if ( netcode_encrypt_packet_aead( encrypted_start, payload_data, payload_bytes, additional_data, sizeof( additional_data ), nonce, write_packet_key, write_packet_cipher ) != NETCODE_OK )
+    {
+        return NETCODE_ERROR;
+    }
+
+    return header_bytes + payload_bytes + NETCODE_MAC_BYTES;
 }
 
-void netcode_client_process_loopback_packet( struct netcode_client_t * client, NETCODE_CONST uint8_t * packet_data, int packet_bytes, uint64_t packet_sequence )
+struct netcode_replay_protection_t
 {
-    netcode_assert( client );
-    netcode_assert( client->loopback );
-    struct netcode_connection_payload_packet_t * packet = netcode_create_payload_packet( packet_bytes, client->config.allocator_context, client->config.allocate_function );
-    if ( !packet )
-        return;
-    memcpy( packet->payload_data, packet_data, packet_bytes );
-    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client processing loopback packet from server\n" );
-    netcode_packet_queue_push( &client->packet_receive_queue, packet, packet_sequence );
-}
+    uint64_t most_recent_sequence;
+    uint64_t received_packet[NETCODE_REPLAY_PROTECTION_BUFFER_SIZE];
+};
 
-uint16_t netcode_client_get_port( struct netcode_client_t * client )
+void netcode_replay_protection_reset( struct netcode_replay_protection_t * replay_protection )
 {
-    netcode_assert( client );
-    return client->address.type == NETCODE_ADDRESS_IPV4 ? client->socket_holder.ipv4.address.port : client->socket_holder.ipv6.address.port;
+    netcode_assert( replay_protection );
+    replay_protection->most_recent_sequence = 0;
+    memset( replay_protection->received_packet, 0xFF, sizeof( replay_protection->received_packet ) );
 }
 
-struct netcode_address_t * netcode_client_server_address( struct netcode_client_t * client )
+int netcode_replay_protection_already_received( struct netcode_replay_protection_t * replay_protection, uint64_t sequence )
 {
-    netcode_assert( client );
-    return &client->server_address;
-}
+    netcode_assert( replay_protection );
 
-// ----------------------------------------------------------------
+    if ( sequence + NETCODE_REPLAY_PROTECTION_BUFFER_SIZE <= replay_protection->most_recent_sequence )
+        return 1;
+    
+    int index = (int) ( sequence % NETCODE_REPLAY_PROTECTION_BUFFER_SIZE );
 
-#define NETCODE_MAX_ENCRYPTION_MAPPINGS ( NETCODE_MAX_CLIENTS * 4 )
+    if ( replay_protection->received_packet[index] == UINT64_MAX )
+        return 0;
 
-struct netcode_encryption_manager_t
-{
-    int num_encryption_mappings;
-    int timeout[NETCODE_MAX_ENCRYPTION_MAPPINGS];
-    double expire_time[NETCODE_MAX_ENCRYPTION_MAPPINGS];
-    double last_access_time[NETCODE_MAX_ENCRYPTION_MAPPINGS];
-    struct netcode_address_t address[NETCODE_MAX_ENCRYPTION_MAPPINGS];
-    int client_index[NETCODE_MAX_ENCRYPTION_MAPPINGS];
-    uint8_t send_key[NETCODE_KEY_BYTES*NETCODE_MAX_ENCRYPTION_MAPPINGS];
-    uint8_t receive_key[NETCODE_KEY_BYTES*NETCODE_MAX_ENCRYPTION_MAPPINGS];
-};
+    if ( replay_protection->received_packet[index] >= sequence )
+        return 1;
 
-void netcode_encryption_manager_reset( struct netcode_encryption_manager_t * encryption_manager )
+    return 0;
+}
+
+void netcode_replay_protection_advance_sequence( struct netcode_replay_protection_t * replay_protection, uint64_t sequence )
 {
-    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "reset encryption manager\n" );
+    netcode_assert( replay_protection );
 
-    netcode_assert( encryption_manager );
+    if ( sequence > replay_protection->most_recent_sequence )
+        replay_protection->most_recent_sequence = sequence;
 
-    encryption_manager->num_encryption_mappings = 0;
-    
-    int i;
-    for ( i = 0; i < NETCODE_MAX_ENCRYPTION_MAPPINGS; ++i )
-    {
-        encryption_manager->client_index[i] = -1;
-        encryption_manager->expire_time[i] = -1.0;
-        encryption_manager->last_access_time[i] = -1000.0;
-        memset( &encryption_manager->address[i], 0, sizeof( struct netcode_address_t ) );
-    }
+    int index = (int) ( sequence % NETCODE_REPLAY_PROTECTION_BUFFER_SIZE );
 
-    memset( encryption_manager->timeout, 0, sizeof( encryption_manager->timeout ) );    
-    memset( encryption_manager->send_key, 0, sizeof( encryption_manager->send_key ) );
-    memset( encryption_manager->receive_key, 0, sizeof( encryption_manager->receive_key ) );
+    replay_protection->received_packet[index] = sequence;
 }
 
-int netcode_encryption_manager_entry_expired( struct netcode_encryption_manager_t * encryption_manager, int index, double time )
+void * netcode_read_packet_internal( uint8_t * buffer, 
+                                     int buffer_length, 
+                                     uint64_t * sequence, 
+                                     uint8_t * read_packet_key, 
+                                     uint64_t protocol_id, 
+                                     uint64_t current_timestamp, 
+                                     uint8_t * private_key, 
+                                     uint8_t * allowed_packets, 
+                                     struct netcode_replay_protection_t * replay_protection, 
+                                     void * allocator_context, 
+                                     void* (*allocate_function)(void*,size_t), 
+                                     int * buffer_adopted, 
+                                     int payload_decrypted, 
+                                     NETCODE_CONST struct netcode_packet_cipher_t * read_packet_cipher )
 {
-    return ( encryption_manager->timeout[index] > 0 && ( encryption_manager->last_access_time[index] + encryption_manager->timeout[index] ) < time ) ||
-           ( encryption_manager->expire_time[index] >= 0.0 && encryption_manager->expire_time[index] < time );
-}
+    netcode_assert( sequence );
+    netcode_assert( allowed_packets );
 
-int netcode_encryption_manager_add_encryption_mapping( struct netcode_encryption_manager_t * encryption_manager, 
-                                                       struct netcode_address_t * address, 
-                                                       uint8_t * send_key, 
-                                                       uint8_t * receive_key, 
-                                                       double time, 
-                                                       double expire_time,
-                                                       int timeout )
-{
-    int i;
-    for ( i = 0; i < encryption_manager->num_encryption_mappings; ++i )
+    *sequence = 0;
+
+    if ( buffer_adopted )
     {
-        if ( netcode_address_equal( &encryption_manager->address[i], address ) && !netcode_encryption_manager_entry_expired( encryption_manager, i, time ) )
-        {
-            encryption_manager->timeout[i] = timeout;
-            encryption_manager->expire_time[i] = expire_time;
-            encryption_manager->last_access_time[i] = time;
-            memcpy( encryption_manager->send_key + i * NETCODE_KEY_BYTES, send_key, NETCODE_KEY_BYTES );
-            memcpy( encryption_manager->receive_key + i * NETCODE_KEY_BYTES, receive_key, NETCODE_KEY_BYTES );
-            return 1;
-        }
+        *buffer_adopted = 0;
     }
 
-    for ( i = 0; i < NETCODE_MAX_ENCRYPTION_MAPPINGS; ++i )
+    if ( allocate_function == NULL )
     {
-        if ( encryption_manager->address[i].type == NETCODE_ADDRESS_NONE || 
-        	( netcode_encryption_manager_entry_expired( encryption_manager, i, time ) && encryption_manager->client_index[i] == -1 ) )
-        {
-            encryption_manager->timeout[i] = timeout;
-            encryption_manager->address[i] = *address;
-            encryption_manager->expire_time[i] = expire_time;
-            encryption_manager->last_access_time[i] = time;
-            memcpy( encryption_manager->send_key + i * NETCODE_KEY_BYTES, send_key, NETCODE_KEY_BYTES );
-            memcpy( encryption_manager->receive_key + i * NETCODE_KEY_BYTES, receive_key, NETCODE_KEY_BYTES );
-            if ( i + 1 > encryption_manager->num_encryption_mappings )
-                encryption_manager->num_encryption_mappings = i + 1;
-            return 1;
-        }
+        allocate_function = netcode_default_allocate_function;
     }
 
-    return 0;
-}
+    if ( buffer_length < 1 )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored packet. buffer length is less than 1\n" );
+        return NULL;
+    }
 
-int netcode_encryption_manager_remove_encryption_mapping( struct netcode_encryption_manager_t * encryption_manager, struct netcode_address_t * address, double time )
-{
-    netcode_assert( encryption_manager );
-    netcode_assert( address );
+    uint8_t * start = buffer;
 
-    int i;
-    for ( i = 0; i < encryption_manager->num_encryption_mappings; ++i )
+    uint8_t prefix_byte = netcode_read_uint8( &buffer );
+
+    if ( ( prefix_byte & 0xF ) == NETCODE_CONNECTION_REQUEST_PACKET )
     {
-        if ( netcode_address_equal( &encryption_manager->address[i], address ) )
-        {
-            encryption_manager->expire_time[i] = -1.0;
-            encryption_manager->last_access_time[i] = -1000.0;
-            memset( &encryption_manager->address[i], 0, sizeof( struct netcode_address_t ) );
-            memset( encryption_manager->send_key + i * NETCODE_KEY_BYTES, 0, NETCODE_KEY_BYTES );
-            memset( encryption_manager->receive_key + i * NETCODE_KEY_BYTES, 0, NETCODE_KEY_BYTES );
+        // connection request packet: first byte is zero, except for the cipher suite the client proposes in the high bits
 
-            if ( i + 1 == encryption_manager->num_encryption_mappings )
-            {
-                int index = i - 1;
-                while ( index >= 0 )
-                {
-                    if ( !netcode_encryption_manager_entry_expired( encryption_manager, index, time ) || encryption_manager->client_index[index] != -1 )
-                    {
-                        break;
-                    }
-                    encryption_manager->address[index].type = NETCODE_ADDRESS_NONE;
-                    index--;
-                }
-                encryption_manager->num_encryption_mappings = index + 1;
-            }
+        int cipher_suite = prefix_byte >> 4;
 
-            return 1;
+        if ( cipher_suite >= NETCODE_NUM_CIPHER_SUITES )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. unknown cipher suite %d\n", cipher_suite );
+            return NULL;
         }
+
+        if ( !allowed_packets[NETCODE_CONNECTION_REQUEST_PACKET] )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. packet type is not allowed\n" );
+            return NULL;
+        }
+
+        if ( buffer_length != 1 + NETCODE_VERSION_INFO_BYTES + 8 + 8 + NETCODE_CONNECT_TOKEN_NONCE_BYTES + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. bad packet length (expected %d, got %d)\n", 1 + NETCODE_VERSION_INFO_BYTES + 8 + 8 + 8 + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, buffer_length );
+            return NULL;
+        }
+
+        if ( !private_key )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. no private key\n" );
+            return NULL;
+        }
+
+        uint8_t version_info[NETCODE_VERSION_INFO_BYTES];
+        netcode_read_bytes( &buffer, version_info, NETCODE_VERSION_INFO_BYTES );
+        if ( version_info[0]  != 'N' || 
+             version_info[1]  != 'E' || 
+             version_info[2]  != 'T' || 
+             version_info[3]  != 'C' || 
+             version_info[4]  != 'O' ||
+             version_info[5]  != 'D' ||
+             version_info[6]  != 'E' ||
+             version_info[7]  != ' ' || 
+             version_info[8]  != '1' ||
+             version_info[9]  != '.' ||
+             version_info[10] != '0' ||
+             version_info[11] != '2' ||
+             version_info[12] != '\0' )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. bad version info\n" );
+            return NULL;
+        }
+
+        uint64_t packet_protocol_id = netcode_read_uint64( &buffer );
+        if ( packet_protocol_id != protocol_id )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. wrong protocol id. expected %.16" PRIx64 ", got %.16" PRIx64 "\n", 
+                protocol_id, packet_protocol_id );
+            return NULL;
+        }
+
+        uint64_t packet_connect_token_expire_timestamp = netcode_read_uint64( &buffer );
+        if ( packet_connect_token_expire_timestamp <= current_timestamp )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. connect token expired\n" );
+            return NULL;
+        }
+
+        uint8_t packet_connect_token_nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
+        netcode_read_bytes(&buffer, packet_connect_token_nonce, sizeof(packet_connect_token_nonce));
+
+        netcode_assert( buffer - start == 1 + NETCODE_VERSION_INFO_BYTES + 8 + 8 + NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+
+        if ( netcode_decrypt_connect_token_private( buffer, 
+                                                    NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, 
+                                                    version_info, 
+                                                    protocol_id, 
+                                                    packet_connect_token_expire_timestamp, 
+                                                    packet_connect_token_nonce, 
+                                                    private_key ) != NETCODE_OK )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. connect token failed to decrypt\n" );
+            return NULL;
+        }
+
+        struct netcode_connection_request_packet_t * packet = (struct netcode_connection_request_packet_t*) 
+            allocate_function( allocator_context, sizeof( struct netcode_connection_request_packet_t ) );
+
+        if ( !packet )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection request packet. failed to allocate packet\n" );
+            return NULL;
+        }
+
+        packet->packet_type = NETCODE_CONNECTION_REQUEST_PACKET;
+        packet->cipher_suite = cipher_suite;
+        memcpy( packet->version_info, version_info, NETCODE_VERSION_INFO_BYTES );
+        packet->protocol_id = packet_protocol_id;
+        packet->connect_token_expire_timestamp = packet_connect_token_expire_timestamp;
+        memcpy( packet->connect_token_nonce, packet_connect_token_nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+        netcode_read_bytes( &buffer, packet->connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+
+        netcode_assert( buffer - start == 1 + NETCODE_VERSION_INFO_BYTES + 8 + 8 + NETCODE_CONNECT_TOKEN_NONCE_BYTES + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+
+        return packet;
+    }
+    else
+    {
+        // *** encrypted packets ***
+
+        if ( !read_packet_key )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. no read packet key for this address\n" );
+            return NULL;
+        }
+
+        if ( buffer_length < 1 + 1 + NETCODE_MAC_BYTES )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. packet is too small to be valid (%d bytes)\n", buffer_length );
+            return NULL;
+        }
+
+        // extract the packet type and number of sequence bytes from the prefix byte
+
+        int packet_type = prefix_byte & 0xF;
+
+        const int connection_id_bytes = ( packet_type & NETCODE_CONNECTION_ID_FLAG ) ? NETCODE_CONNECTION_ID_BYTES : 0;
+
+        packet_type &= ~NETCODE_CONNECTION_ID_FLAG;
+
+        if ( packet_type >= NETCODE_CONNECTION_NUM_PACKETS || ( connection_id_bytes && packet_type < NETCODE_CONNECTION_KEEP_ALIVE_PACKET ) )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. packet type %d is invalid\n", packet_type );
+            return NULL;
+        }
+
+        if ( !allowed_packets[packet_type] )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. packet type %d is not allowed\n", packet_type );
+            return NULL;
+        }
+
+        int sequence_bytes = prefix_byte >> 4;
+
+        if ( sequence_bytes < 1 || sequence_bytes > 8 )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. sequence bytes %d is out of range [1,8]\n", sequence_bytes );
+            return NULL;
+        }
+
+        if ( buffer_length < 1 + connection_id_bytes + sequence_bytes + NETCODE_MAC_BYTES )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. buffer is too small for sequence bytes + encryption mac\n" );
+            return NULL;
+        }
+
+        // the connection id was used to find the connection this packet belongs to, if it was needed. skip over it
+
+        buffer += connection_id_bytes;
+
+        // read variable length sequence number [1,8]
+
+        int i;
+        for ( i = 0; i < sequence_bytes; ++i )
+        {
+            uint8_t value = netcode_read_uint8( &buffer );
+            (*sequence) |= ( uint64_t) ( value ) << ( 8 * i );
+        }
+
+        // ignore the packet if it has already been received
+
+        if ( replay_protection && packet_type >= NETCODE_CONNECTION_KEEP_ALIVE_PACKET )
+        {
+            if ( netcode_replay_protection_already_received( replay_protection, *sequence ) )
+            {
+                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored packet. sequence %.16" PRIx64 " already received (replay protection)\n", *sequence );
+                return NULL;
+            }
+        }
+
+        // decrypt the per-packet type data
+
+        uint8_t additional_data[NETCODE_VERSION_INFO_BYTES+8+1];
+        {
+            uint8_t * p = additional_data;
+            netcode_write_bytes( &p, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
+            netcode_write_uint64( &p, protocol_id );
+            netcode_write_uint8( &p, prefix_byte );
+        }
+
+        uint8_t nonce[12];
+        {
+            uint8_t * p = nonce;
+            netcode_write_uint32( &p, 0 );
+            netcode_write_uint64( &p, *sequence );
+        }
+
+        int encrypted_bytes = (int) ( buffer_length - ( buffer - start ) );
+
+        if ( encrypted_bytes < NETCODE_MAC_BYTES )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. encrypted payload is too small\n" );
+            return NULL;
+        }
+
+        if ( !( payload_decrypted && packet_type == NETCODE_CONNECTION_PAYLOAD_PACKET ) &&
+             netcode_decrypt_packet_aead( buffer, encrypted_bytes, additional_data, sizeof( additional_data ), nonce, read_packet_key, 
+                                          netcode_packet_type_uses_connection_cipher( packet_type ) ? read_packet_cipher : NULL ) != NETCODE_OK )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. failed to decrypt\n" );
+            return NULL;
+        }
+
+        int decrypted_bytes = encrypted_bytes - NETCODE_MAC_BYTES;
+
+        // update the latest replay protection sequence #
+
+        if ( replay_protection && packet_type >= NETCODE_CONNECTION_KEEP_ALIVE_PACKET )
+        {
+            netcode_replay_protection_advance_sequence( replay_protection, *sequence );
+        }
+
+        // process the per-packet type data that was just decrypted
+        
+        switch ( packet_type )
+        {
+            case NETCODE_CONNECTION_DENIED_PACKET:
+            {
+                if ( decrypted_bytes != 0 )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection denied packet. decrypted packet data is wrong size\n" );
+                    return NULL;
+                }
+
+                struct netcode_connection_denied_packet_t * packet = (struct netcode_connection_denied_packet_t*) 
+                    allocate_function( allocator_context, sizeof( struct netcode_connection_denied_packet_t ) );
+
+                if ( !packet )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection denied packet. could not allocate packet struct\n" );
+                    return NULL;
+                }
+                
+                packet->packet_type = NETCODE_CONNECTION_DENIED_PACKET;
+                
+                return packet;
+            }
+            break;
+
+            case NETCODE_CONNECTION_CHALLENGE_PACKET:
+            {
+                if ( decrypted_bytes != 8 + NETCODE_CHALLENGE_TOKEN_BYTES && decrypted_bytes != 8 + NETCODE_CHALLENGE_TOKEN_BYTES + 1 )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection challenge packet. decrypted packet data is wrong size\n" );
+                    return NULL;
+                }
+
+                const int cipher_suite = ( decrypted_bytes > 8 + NETCODE_CHALLENGE_TOKEN_BYTES ) ? buffer[8+NETCODE_CHALLENGE_TOKEN_BYTES] : NETCODE_CIPHER_SUITE_CHACHA20_POLY1305;
+
+                if ( cipher_suite >= NETCODE_NUM_CIPHER_SUITES )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection challenge packet. unknown cipher suite %d\n", cipher_suite );
+                    return NULL;
+                }
+
+                struct netcode_connection_challenge_packet_t * packet = (struct netcode_connection_challenge_packet_t*) 
+                    allocate_function( allocator_context, sizeof( struct netcode_connection_challenge_packet_t ) );
+
+                if ( !packet )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection challenge packet. could not allocate packet struct\n" );
+                    return NULL;
+                }
+                
+                packet->packet_type = NETCODE_CONNECTION_CHALLENGE_PACKET;
+                packet->challenge_token_sequence = netcode_read_uint64( &buffer );
+                netcode_read_bytes( &buffer, packet->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
+                packet->cipher_suite = cipher_suite;
+                
+                return packet;
+            }
+            break;
+
+            case NETCODE_CONNECTION_RESPONSE_PACKET:
+            {
+                if ( decrypted_bytes != 8 + NETCODE_CHALLENGE_TOKEN_BYTES )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection response packet. decrypted packet data is wrong size\n" );
+                    return NULL;
+                }
+
+                struct netcode_connection_response_packet_t * packet = (struct netcode_connection_response_packet_t*) 
+                    allocate_function( allocator_context, sizeof( struct netcode_connection_response_packet_t ) );
+
+                if ( !packet )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection response packet. could not allocate packet struct\n" );
+                    return NULL;
+                }
+                
+                packet->packet_type = NETCODE_CONNECTION_RESPONSE_PACKET;
+                packet->challenge_token_sequence = netcode_read_uint64( &buffer );
+                netcode_read_bytes( &buffer, packet->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
+                
+                return packet;
+            }
+            break;
+
+            case NETCODE_CONNECTION_KEEP_ALIVE_PACKET:
+            {
+                if ( decrypted_bytes != 8 )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection keep alive packet. decrypted packet data is wrong size\n" );
+                    return NULL;
+                }
+
+                struct netcode_connection_keep_alive_packet_t * packet = (struct netcode_connection_keep_alive_packet_t*) 
+                    allocate_function( allocator_context, sizeof( struct netcode_connection_keep_alive_packet_t ) );
+
+                if ( !packet )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection keep alive packet. could not allocate packet struct\n" );
+                    return NULL;
+                }
+                
+                packet->packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
+                packet->client_index = netcode_read_uint32( &buffer );
+                packet->max_clients = netcode_read_uint32( &buffer );
+                
+                return packet;
+            }
+            break;
+            
+            case NETCODE_CONNECTION_PAYLOAD_PACKET:
+            {
+                if ( decrypted_bytes < 1 )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection payload packet. payload is too small\n" );
+                    return NULL;
+                }
+
+                if ( decrypted_bytes > NETCODE_MAX_PAYLOAD_BYTES )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection payload packet. payload is too large\n" );
+                    return NULL;
+                }
+
+                if ( buffer_adopted )
+                {
+                    // the buffer is a pool receive buffer. write the packet header into the headroom in front of it
+                    // and hand out the payload where it was decrypted, instead of copying it into a new packet
+
+                    struct netcode_connection_payload_packet_t * packet = (struct netcode_connection_payload_packet_t*) ( start - NETCODE_RECEIVE_BUFFER_HEADROOM );
+                    packet->packet_type = NETCODE_CONNECTION_PAYLOAD_PACKET;
+                    packet->payload_bytes = decrypted_bytes;
+                    packet->payload_data = buffer;
+                    *buffer_adopted = 1;
+                    return packet;
+                }
+
+                struct netcode_connection_payload_packet_t * packet = netcode_create_payload_packet( decrypted_bytes, allocator_context, allocate_function );
+
+                if ( !packet )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection payload packet. could not allocate packet struct\n" );
+                    return NULL;
+                }
+                
+                memcpy( packet->payload_data, buffer, decrypted_bytes );
+                
+                return packet;
+            }
+            break;
+
+            case NETCODE_CONNECTION_DISCONNECT_PACKET:
+            {
+                if ( decrypted_bytes != 0 )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection disconnect packet. decrypted packet data is wrong size\n" );
+                    return NULL;
+                }
+
+                struct netcode_connection_disconnect_packet_t * packet = (struct netcode_connection_disconnect_packet_t*) 
+                    allocate_function( allocator_context, sizeof( struct netcode_connection_disconnect_packet_t ) );
+
+                if ( !packet )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored connection disconnect packet. could not allocate packet struct\n" );
+                    return NULL;
+                }
+                
+                packet->packet_type = NETCODE_CONNECTION_DISCONNECT_PACKET;
+                
+                return packet;
+            }
+            break;
+
+            case NETCODE_CONNECTION_SESSION_TICKET_PACKET:
+            {
+                if ( decrypted_bytes != NETCODE_SESSION_TICKET_PACKET_BYTES )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored session ticket packet. decrypted packet data is wrong size\n" );
+                    return NULL;
+                }
+
+                struct netcode_connection_session_ticket_packet_t * packet = (struct netcode_connection_session_ticket_packet_t*) 
+                    allocate_function( allocator_context, sizeof( struct netcode_connection_session_ticket_packet_t ) );
+
+                if ( !packet )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored session ticket packet. could not allocate packet struct\n" );
+                    return NULL;
+                }
+
+                packet->packet_type = NETCODE_CONNECTION_SESSION_TICKET_PACKET;
+                packet->expire_timestamp = netcode_read_uint64( &buffer );
+                netcode_read_bytes( &buffer, packet->nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+                packet->timeout_seconds = (int) netcode_read_uint32( &buffer );
+                packet->cipher_suite = netcode_read_uint8( &buffer );
+                netcode_read_bytes( &buffer, packet->client_to_server_key, NETCODE_KEY_BYTES );
+                netcode_read_bytes( &buffer, packet->server_to_client_key, NETCODE_KEY_BYTES );
+                netcode_read_bytes( &buffer, packet->ticket_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+
+                return packet;
+            }
+            break;
+
+            default:
+                return NULL;
+        }
+    }
+}
+
+void * netcode_read_packet( uint8_t * buffer, 
+                            int buffer_length, 
+                            uint64_t * sequence, 
+                            uint8_t * read_packet_key, 
+                            uint64_t protocol_id, 
+                            uint64_t current_timestamp, 
+                            uint8_t * private_key, 
+                            uint8_t * allowed_packets, 
+                            struct netcode_replay_protection_t * replay_protection, 
+                            void * allocator_context, 
+                            void* (*allocate_function)(void*,size_t), 
+                            NETCODE_CONST struct netcode_packet_cipher_t * read_packet_cipher )
+{
+    return netcode_read_packet_internal( buffer, 
+                                         buffer_length, 
+                                         sequence, 
+                                         read_packet_key, 
+                                         protocol_id, 
+                                         current_timestamp, 
+                                         private_key, 
+                                         allowed_packets, 
+                                         replay_protection, 
+                                         allocator_context, 
+                                         allocate_function, 
+                                         NULL, 
+                                         0, 
+                                         read_packet_cipher );
+}
+
+// ----------------------------------------------------------------
+
+struct netcode_connect_token_t
+{
+    uint8_t version_info[NETCODE_VERSION_INFO_BYTES];
+    uint64_t protocol_id;
+    uint64_t create_timestamp;
+    uint64_t expire_timestamp;
+    uint8_t nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
+    uint8_t private_data[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
+    int timeout_seconds;
+    int num_server_addresses;
+    struct netcode_address_t server_addresses[NETCODE_MAX_SERVERS_PER_CONNECT];
+    uint8_t client_to_server_key[NETCODE_KEY_BYTES];
+    uint8_t server_to_client_key[NETCODE_KEY_BYTES];
+    int cipher_suite;
+    int session_ticket;
+};
+
+void netcode_write_connect_token( struct netcode_connect_token_t * connect_token, uint8_t * buffer, int buffer_length )
+{
+    netcode_assert( connect_token );
+    netcode_assert( buffer );
+    netcode_assert( buffer_length >= NETCODE_CONNECT_TOKEN_BYTES );
+
+    uint8_t * start = buffer;
+
+    (void) start;
+    (void) buffer_length;
+
+    netcode_write_bytes( &buffer, connect_token->version_info, NETCODE_VERSION_INFO_BYTES );
+
+    netcode_write_uint64( &buffer, connect_token->protocol_id );
+
+    netcode_write_uint64( &buffer, connect_token->create_timestamp );
+
+    netcode_write_uint64( &buffer, connect_token->expire_timestamp );
+
+    netcode_write_bytes( &buffer, connect_token->nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+
+    netcode_write_bytes( &buffer, connect_token->private_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+
+    int i,j;
+
+    netcode_write_uint32( &buffer, connect_token->timeout_seconds );
+
+    netcode_write_uint32( &buffer, connect_token->num_server_addresses );
+
+    for ( i = 0; i < connect_token->num_server_addresses; ++i )
+    {
+        if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV4 )
+        {
+            netcode_write_uint8( &buffer, NETCODE_ADDRESS_IPV4 );
+            for ( j = 0; j < 4; ++j )
+            {
+                netcode_write_uint8( &buffer, connect_token->server_addresses[i].data.ipv4[j] );
+            }
+            netcode_write_uint16( &buffer, connect_token->server_addresses[i].port );
+        }
+        else if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV6 )
+        {
+            netcode_write_uint8( &buffer, NETCODE_ADDRESS_IPV6 );
+            for ( j = 0; j < 8; ++j )
+            {
+                netcode_write_uint16( &buffer, connect_token->server_addresses[i].data.ipv6[j] );
+            }
+            netcode_write_uint16( &buffer, connect_token->server_addresses[i].port );
+        }
+        else
+        {
+            netcode_assert( 0 );
+        }
+    }
+
+    netcode_write_bytes( &buffer, connect_token->client_to_server_key, NETCODE_KEY_BYTES );
+
+    netcode_write_bytes( &buffer, connect_token->server_to_client_key, NETCODE_KEY_BYTES );
+
+    netcode_write_uint8( &buffer, (uint8_t) connect_token->cipher_suite );
+
+    netcode_write_uint8( &buffer, (uint8_t) connect_token->session_ticket );
+
+    netcode_assert( buffer - start <= NETCODE_CONNECT_TOKEN_BYTES );
+
+    memset( buffer, 0, NETCODE_CONNECT_TOKEN_BYTES - ( buffer - start ) );
+}
+
+int netcode_read_connect_token( uint8_t * buffer, int buffer_length, struct netcode_connect_token_t * connect_token )
+{
+    netcode_assert( buffer );
+    netcode_assert( connect_token );
+
+    if ( buffer_length != NETCODE_CONNECT_TOKEN_BYTES )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: read connect data has bad buffer length (%d)\n", buffer_length );
+        return NETCODE_ERROR;
+    }
+
+    netcode_read_bytes( &buffer, connect_token->version_info, NETCODE_VERSION_INFO_BYTES );
+    if ( connect_token->version_info[0]  != 'N' || 
+         connect_token->version_info[1]  != 'E' || 
+         connect_token->version_info[2]  != 'T' || 
+         connect_token->version_info[3]  != 'C' || 
+         connect_token->version_info[4]  != 'O' ||
+         connect_token->version_info[5]  != 'D' ||
+         connect_token->version_info[6]  != 'E' ||
+         connect_token->version_info[7]  != ' ' || 
+         connect_token->version_info[8]  != '1' ||
+         connect_token->version_info[9]  != '.' ||
+         connect_token->version_info[10] != '0' ||
+         connect_token->version_info[11] != '2' ||
+         connect_token->version_info[12] != '\0' )
+    {
+        connect_token->version_info[12] = '\0';
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: read connect data has bad version info (got %s, expected %s)\n", connect_token->version_info, NETCODE_VERSION_INFO );
+        return NETCODE_ERROR;
+    }
+
+    connect_token->protocol_id = netcode_read_uint64( &buffer );
+
+    connect_token->create_timestamp = netcode_read_uint64( &buffer );
+
+    connect_token->expire_timestamp = netcode_read_uint64( &buffer );
+
+    if ( connect_token->create_timestamp > connect_token->expire_timestamp )
+        return NETCODE_ERROR;
+
+    netcode_read_bytes( &buffer, connect_token->nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+
+    netcode_read_bytes( &buffer, connect_token->private_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+
+    connect_token->timeout_seconds = (int) netcode_read_uint32( &buffer );
+
+    connect_token->num_server_addresses = netcode_read_uint32( &buffer );
+
+    if ( connect_token->num_server_addresses <= 0 || connect_token->num_server_addresses > NETCODE_MAX_SERVERS_PER_CONNECT )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: read connect data has bad number of server addresses (%d)\n", connect_token->num_server_addresses );
+        return NETCODE_ERROR;
+    }
+
+    int i,j;
+
+    for ( i = 0; i < connect_token->num_server_addresses; ++i )
+    {
+        connect_token->server_addresses[i].type = netcode_read_uint8( &buffer );
+
+        if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV4 )
+        {
+            for ( j = 0; j < 4; ++j )
+            {
+                connect_token->server_addresses[i].data.ipv4[j] = netcode_read_uint8( &buffer );
+            }
+            connect_token->server_addresses[i].port = netcode_read_uint16( &buffer );
+        }
+        else if ( connect_token->server_addresses[i].type == NETCODE_ADDRESS_IPV6 )
+        {
+            for ( j = 0; j < 8; ++j )
+            {
+                connect_token->server_addresses[i].data.ipv6[j] = netcode_read_uint16( &buffer );
+            }
+            connect_token->server_addresses[i].port = netcode_read_uint16( &buffer );
+        }
+        else
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: read connect data has bad address type (%d)\n", connect_token->server_addresses[i].type );
+            return NETCODE_ERROR;
+        }
+    }
+
+    netcode_read_bytes( &buffer, connect_token->client_to_server_key, NETCODE_KEY_BYTES );
+
+    netcode_read_bytes( &buffer, connect_token->server_to_client_key, NETCODE_KEY_BYTES );
+
+    connect_token->cipher_suite = netcode_read_uint8( &buffer );
+
+    if ( connect_token->cipher_suite >= NETCODE_NUM_CIPHER_SUITES )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: read connect data has bad cipher suite (%d)\n", connect_token->cipher_suite );
+        return NETCODE_ERROR;
+    }
+
+    connect_token->session_ticket = netcode_read_uint8( &buffer );
+    
+    return NETCODE_OK;
+}
+
+// ----------------------------------------------------------------
+
+struct netcode_packet_queue_t
+{
+    void * allocator_context;
+    void * (*allocate_function)(void*,size_t);
+    void (*free_function)(void*,void*);
+    int num_packets;
+    int start_index;
+    void * packet_data[NETCODE_PACKET_QUEUE_SIZE];
+    uint64_t packet_sequence[NETCODE_PACKET_QUEUE_SIZE];
+};
+
+void netcode_packet_queue_init( struct netcode_packet_queue_t * queue, 
+                                void * allocator_context, 
+                                void * (*allocate_function)(void*,size_t), 
+                                void (*free_function)(void*,void*) )
+{
+    if ( allocate_function == NULL )
+    {
+        allocate_function = netcode_default_allocate_function;
+    }
+
+    if ( free_function == NULL )
+    {
+        free_function = netcode_default_free_function;
+    }
+
+    netcode_assert( queue );
+
+    queue->allocator_context = allocator_context;
+    queue->allocate_function = allocate_function;
+    queue->free_function = free_function;
+    queue->num_packets = 0;
+    queue->start_index = 0;
+    memset( queue->packet_data, 0, sizeof( queue->packet_data ) );
+    memset( queue->packet_sequence, 0, sizeof( queue->packet_sequence ) );
+}
+
+void netcode_packet_queue_clear( struct netcode_packet_queue_t * queue )
+{
+    int i;
+    for ( i = 0; i < queue->num_packets; ++i )
+    {
+        queue->free_function( queue->allocator_context, queue->packet_data[i] );
+    }
+    queue->num_packets = 0;
+    queue->start_index = 0;
+    memset( queue->packet_data, 0, sizeof( queue->packet_data ) );
+    memset( queue->packet_sequence, 0, sizeof( queue->packet_sequence ) );
+}
+
+int netcode_packet_queue_push( struct netcode_packet_queue_t * queue, void * packet_data, uint64_t packet_sequence )
+{
+    netcode_assert( queue );
+    netcode_assert( packet_data );
+    if ( queue->num_packets == NETCODE_PACKET_QUEUE_SIZE )
+    {
+        queue->free_function( queue->allocator_context, packet_data );
+        return 0;
+    }
+    int index = ( queue->start_index + queue->num_packets ) % NETCODE_PACKET_QUEUE_SIZE;
+    queue->packet_data[index] = packet_data;
+    queue->packet_sequence[index] = packet_sequence;
+    queue->num_packets++;
+    return 1;
+}
+
+void * netcode_packet_queue_pop( struct netcode_packet_queue_t * queue, uint64_t * packet_sequence )
+{
+    if ( queue->num_packets == 0 )
+        return NULL;
+    void * packet = queue->packet_data[queue->start_index];
+    if ( packet_sequence )
+        *packet_sequence = queue->packet_sequence[queue->start_index];
+    queue->start_index = ( queue->start_index + 1 ) % NETCODE_PACKET_QUEUE_SIZE;
+    queue->num_packets--;
+    return packet;
+}
+
+// ----------------------------------------------------------------
+
+#define NETCODE_PACKET_POOL_BLOCK_BYTES ( ( NETCODE_RECEIVE_BUFFER_HEADROOM + NETCODE_MAX_PACKET_BYTES + 15 ) & ~15 )
+#define NETCODE_PACKET_POOL_CHUNK_BLOCKS 64
+#define NETCODE_PACKET_POOL_MAX_CHUNKS 16
+
+struct netcode_packet_pool_t
+{
+    void * allocator_context;
+    void * (*allocate_function)(void*,size_t);
+    void (*free_function)(void*,void*);
+    void * free_list;
+    int num_chunks;
+    int num_blocks_allocated;
+    uint8_t * chunk_memory[NETCODE_PACKET_POOL_MAX_CHUNKS];
+    uint8_t * chunk_blocks[NETCODE_PACKET_POOL_MAX_CHUNKS];
+    int chunk_num_blocks[NETCODE_PACKET_POOL_MAX_CHUNKS];
+};
+
+void netcode_packet_pool_init( struct netcode_packet_pool_t * pool, 
+                               void * allocator_context, 
+                               void * (*allocate_function)(void*,size_t), 
+                               void (*free_function)(void*,void*) )
+{
+    netcode_assert( pool );
+    netcode_assert( sizeof( struct netcode_connection_payload_packet_t ) <= NETCODE_RECEIVE_BUFFER_HEADROOM );
+    netcode_assert( sizeof( struct netcode_connection_request_packet_t ) <= NETCODE_PACKET_POOL_BLOCK_BYTES );
+
+    if ( allocate_function == NULL )
+    {
+        allocate_function = netcode_default_allocate_function;
+    }
+
+    if ( free_function == NULL )
+    {
+        free_function = netcode_default_free_function;
+    }
+
+    memset( pool, 0, sizeof( struct netcode_packet_pool_t ) );
+    pool->allocator_context = allocator_context;
+    pool->allocate_function = allocate_function;
+    pool->free_function = free_function;
+}
+
+void netcode_packet_pool_destroy( struct netcode_packet_pool_t * pool )
+{
+    netcode_assert( pool );
+    int i;
+    for ( i = 0; i < pool->num_chunks; ++i )
+    {
+        pool->free_function( pool->allocator_context, pool->chunk_memory[i] );
+    }
+    memset( pool, 0, sizeof( struct netcode_packet_pool_t ) );
+}
+
+int netcode_packet_pool_grow( struct netcode_packet_pool_t * pool )
+{
+    netcode_assert( pool );
+
+    if ( pool->num_chunks == NETCODE_PACKET_POOL_MAX_CHUNKS )
+        return 0;
+
+    // each chunk doubles the size of the pool, so a busy server settles after a handful of allocations
+
+    const int num_blocks = NETCODE_PACKET_POOL_CHUNK_BLOCKS << pool->num_chunks;
+
+    uint8_t * memory = (uint8_t*) pool->allocate_function( pool->allocator_context, (size_t) num_blocks * NETCODE_PACKET_POOL_BLOCK_BYTES + 15 );
+    if ( !memory )
+        return 0;
+
+    uint8_t * blocks = (uint8_t*) ( ( (uintptr_t) memory + 15 ) & ~( (uintptr_t) 15 ) );
+
+    int i;
+    for ( i = num_blocks - 1; i >= 0; --i )
+    {
+        void ** block = (void**) ( blocks + (size_t) i * NETCODE_PACKET_POOL_BLOCK_BYTES );
+        *block = pool->free_list;
+        pool->free_list = block;
+    }
+
+    pool->chunk_memory[pool->num_chunks] = memory;
+    pool->chunk_blocks[pool->num_chunks] = blocks;
+    pool->chunk_num_blocks[pool->num_chunks] = num_blocks;
+    pool->num_chunks++;
+
+    return 1;
+}
+
+void * netcode_packet_pool_allocate( void * context, size_t bytes )
+{
+    struct netcode_packet_pool_t * pool = (struct netcode_packet_pool_t*) context;
+
+    netcode_assert( pool );
+    netcode_assert( bytes <= NETCODE_PACKET_POOL_BLOCK_BYTES );
+
+    if ( bytes > NETCODE_PACKET_POOL_BLOCK_BYTES )
+        return NULL;
+
+    if ( !pool->free_list && !netcode_packet_pool_grow( pool ) )
+        return NULL;
+
+    void ** block = (void**) pool->free_list;
+    pool->free_list = *block;
+    pool->num_blocks_allocated++;
+    return block;
+}
+
+void netcode_packet_pool_free( void * context, void * pointer )
+{
+    struct netcode_packet_pool_t * pool = (struct netcode_packet_pool_t*) context;
+
+    netcode_assert( pool );
+    netcode_assert( pointer );
+
+    // pointers anywhere inside a block are accepted, so payload pointers handed out to the user can be freed directly
+
+    uint8_t * p = (uint8_t*) pointer;
+
+    int i;
+    for ( i = 0; i < pool->num_chunks; ++i )
+    {
+        uint8_t * blocks = pool->chunk_blocks[i];
+        if ( p >= blocks && p < blocks + (size_t) pool->chunk_num_blocks[i] * NETCODE_PACKET_POOL_BLOCK_BYTES )
+        {
+            void ** block = (void**) ( blocks + ( (size_t) ( p - blocks ) / NETCODE_PACKET_POOL_BLOCK_BYTES ) * NETCODE_PACKET_POOL_BLOCK_BYTES );
+            *block = pool->free_list;
+            pool->free_list = block;
+            pool->num_blocks_allocated--;
+            return;
+        }
+    }
+
+    netcode_assert( !"pointer was not allocated from this packet pool" );
+}
+
+uint8_t * netcode_packet_pool_allocate_receive_buffer( struct netcode_packet_pool_t * pool )
+{
+    // receive buffers leave room in front for a payload packet header, so payloads can be handed out without a copy
+
+    uint8_t * block = (uint8_t*) netcode_packet_pool_allocate( pool, NETCODE_PACKET_POOL_BLOCK_BYTES );
+    return block ? block + NETCODE_RECEIVE_BUFFER_HEADROOM : NULL;
+}
+
+// ----------------------------------------------------------------
+
+#define NETCODE_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES ( NETCODE_MAX_CLIENTS * 256 )
+#define NETCODE_NETWORK_SIMULATOR_NUM_PENDING_RECEIVE_PACKETS ( NETCODE_MAX_CLIENTS * 64 )
+
+struct netcode_network_simulator_packet_entry_t
+{
+    struct netcode_address_t from;
+    struct netcode_address_t to;
+    double delivery_time;
+    uint8_t * packet_data;
+    int packet_bytes;
+};
+
+struct netcode_network_simulator_t
+{
+    void * allocator_context;
+    void * (*allocate_function)(void*,size_t);
+    void (*free_function)(void*,void*);
+    float latency_milliseconds;
+    float jitter_milliseconds;
+    float packet_loss_percent;
+    float duplicate_packet_percent;
+    double time;
+    int current_index;
+    int num_pending_receive_packets;
+    struct netcode_network_simulator_packet_entry_t packet_entries[NETCODE_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES];
+    struct netcode_network_simulator_packet_entry_t pending_receive_packets[NETCODE_NETWORK_SIMULATOR_NUM_PENDING_RECEIVE_PACKETS];
+};
+
+struct netcode_network_simulator_t * netcode_network_simulator_create( void * allocator_context, 
+                                                                       void * (*allocate_function)(void*,size_t), 
+                                                                       void (*free_function)(void*,void*) )
+{
+    if ( allocate_function == NULL )
+    {
+        allocate_function = netcode_default_allocate_function;
+    }
+
+    if ( free_function == NULL )
+    {
+        free_function = netcode_default_free_function;
+    }
+
+    struct netcode_network_simulator_t * network_simulator = (struct netcode_network_simulator_t*) 
+        allocate_function( allocator_context, sizeof( struct netcode_network_simulator_t ) );
+
+    netcode_assert( network_simulator );
+
+    memset( network_simulator, 0, sizeof( struct netcode_network_simulator_t ) );
+
+    network_simulator->allocator_context = allocator_context;
+    network_simulator->allocate_function = allocate_function;
+    network_simulator->free_function = free_function;
+
+    return network_simulator;
+}
+
+void netcode_network_simulator_reset( struct netcode_network_simulator_t * network_simulator )
+{
+    netcode_assert( network_simulator );
+
+    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "network simulator reset\n" );
+
+    int i;
+    for ( i = 0; i < NETCODE_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES; ++i )
+    {
+        network_simulator->free_function( network_simulator->allocator_context, network_simulator->packet_entries[i].packet_data );
+        memset( &network_simulator->packet_entries[i], 0, sizeof( struct netcode_network_simulator_packet_entry_t ) );
+    }
+
+    for ( i = 0; i < network_simulator->num_pending_receive_packets; ++i )
+    {
+        network_simulator->free_function( network_simulator->allocator_context, network_simulator->pending_receive_packets[i].packet_data );
+        memset( &network_simulator->pending_receive_packets[i], 0, sizeof( struct netcode_network_simulator_packet_entry_t ) );
+    }
+
+    network_simulator->current_index = 0;
+    network_simulator->num_pending_receive_packets = 0;
+}
+
+void netcode_network_simulator_destroy( struct netcode_network_simulator_t * network_simulator )
+{
+    netcode_assert( network_simulator );
+    netcode_network_simulator_reset( network_simulator );
+    network_simulator->free_function( network_simulator->allocator_context, network_simulator );
+}
+
+float netcode_random_float( float a, float b )
+{
+    netcode_assert( a < b );
+    float random = ( (float) rand() ) / (float) RAND_MAX;
+    float diff = b - a;
+    float r = random * diff;
+    return a + r;
+}
+
+void netcode_network_simulator_queue_packet( struct netcode_network_simulator_t * network_simulator, 
+                                             struct netcode_address_t * from, 
+                                             struct netcode_address_t * to, 
+                                             uint8_t * packet_data, 
+                                             int packet_bytes, 
+                                             float delay )
+{
+    network_simulator->packet_entries[network_simulator->current_index].from = *from;
+    network_simulator->packet_entries[network_simulator->current_index].to = *to;
+    network_simulator->packet_entries[network_simulator->current_index].packet_data = 
+        (uint8_t*) network_simulator->allocate_function( network_simulator->allocator_context, packet_bytes );
+    memcpy( network_simulator->packet_entries[network_simulator->current_index].packet_data, packet_data, packet_bytes );
+    network_simulator->packet_entries[network_simulator->current_index].packet_bytes = packet_bytes;
+    network_simulator->packet_entries[network_simulator->current_index].delivery_time = network_simulator->time + delay;
+    network_simulator->current_index++;
+    network_simulator->current_index %= NETCODE_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES;
+}
+
+void netcode_network_simulator_send_packet( struct netcode_network_simulator_t * network_simulator, 
+                                            struct netcode_address_t * from, 
+                                            struct netcode_address_t * to, 
+                                            uint8_t * packet_data, 
+                                            int packet_bytes )
+{
+    netcode_assert( network_simulator );
+    netcode_assert( from );
+    netcode_assert( from->type != 0 );
+    netcode_assert( to );
+    netcode_assert( to->type != 0 );
+    netcode_assert( packet_data );
+    netcode_assert( packet_bytes > 0 );
+    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_BYTES );
+
+    if ( netcode_random_float( 0.0f, 100.0f ) <= network_simulator->packet_loss_percent )
+        return;
+
+    if ( network_simulator->packet_entries[network_simulator->current_index].packet_data )
+    {
+        network_simulator->free_function( network_simulator->allocator_context, network_simulator->packet_entries[network_simulator->current_index].packet_data );
+        network_simulator->packet_entries[network_simulator->current_index].packet_data = NULL;
+    }
+
+    float delay = network_simulator->latency_milliseconds / 1000.0f;
+
+    if ( network_simulator->jitter_milliseconds > 0.0 )
+        delay += netcode_random_float( -network_simulator->jitter_milliseconds, +network_simulator->jitter_milliseconds ) / 1000.0f;
+
+    netcode_network_simulator_queue_packet( network_simulator, from, to, packet_data, packet_bytes, delay );
+
+    if ( netcode_random_float( 0.0f, 100.0f ) <= network_simulator->duplicate_packet_percent )
+    {
+        netcode_network_simulator_queue_packet( network_simulator, from, to, packet_data, packet_bytes, delay + netcode_random_float( 0, 1.0 ) );
+    }
+}
+
+int netcode_network_simulator_receive_packets( struct netcode_network_simulator_t * network_simulator, 
+                                               struct netcode_address_t * to, 
+                                               int max_packets, 
+                                               uint8_t ** packet_data, 
+                                               int * packet_bytes, 
+                                               struct netcode_address_t * from )
+{
+    netcode_assert( network_simulator );
+    netcode_assert( max_packets >= 0 );
+    netcode_assert( packet_data );
+    netcode_assert( packet_bytes );
+    netcode_assert( from );
+    netcode_assert( to );
+
+    int num_packets = 0;
+
+    int i;
+    for ( i = 0; i < network_simulator->num_pending_receive_packets; ++i )
+    {
+        if ( num_packets == max_packets )
+            break;
+
+        if ( !network_simulator->pending_receive_packets[i].packet_data )
+            continue;
+
+        if ( !netcode_address_equal( &network_simulator->pending_receive_packets[i].to, to ) )
+            continue;
+
+        packet_data[num_packets] = network_simulator->pending_receive_packets[i].packet_data;
+        packet_bytes[num_packets] = network_simulator->pending_receive_packets[i].packet_bytes;
+        from[num_packets] = network_simulator->pending_receive_packets[i].from;
+
+        network_simulator->pending_receive_packets[i].packet_data = NULL;
+
+        num_packets++;
+    }
+
+    netcode_assert( num_packets <= max_packets );
+
+    return num_packets;
+}
+
+void netcode_network_simulator_update( struct netcode_network_simulator_t * network_simulator, double time )
+{   
+    netcode_assert( network_simulator );
+
+    network_simulator->time = time;
+
+    // discard any pending receive packets that are still in the buffer
+
+    int i;
+    for ( i = 0; i < network_simulator->num_pending_receive_packets; ++i )
+    {
+        if ( network_simulator->pending_receive_packets[i].packet_data )
+        {
+            network_simulator->free_function( network_simulator->allocator_context, network_simulator->pending_receive_packets[i].packet_data );
+            network_simulator->pending_receive_packets[i].packet_data = NULL;
+        }
+    }
+
+    network_simulator->num_pending_receive_packets = 0;
+
+    // walk across packet entries and move any that are ready to be received into the pending receive buffer
+
+    for ( i = 0; i < NETCODE_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES; ++i )
+    {
+        if ( !network_simulator->packet_entries[i].packet_data )
+            continue;
+
+        if ( network_simulator->num_pending_receive_packets == NETCODE_NETWORK_SIMULATOR_NUM_PENDING_RECEIVE_PACKETS )
+            break;
+
+        if ( network_simulator->packet_entries[i].packet_data && network_simulator->packet_entries[i].delivery_time <= time )
+        {
+            network_simulator->pending_receive_packets[network_simulator->num_pending_receive_packets] = network_simulator->packet_entries[i];
+            network_simulator->num_pending_receive_packets++;
+            network_simulator->packet_entries[i].packet_data = NULL;
+        }
+    }
+}
+
+// ----------------------------------------------------------------
+    
+NETCODE_CONST char * netcode_client_state_name( int client_state )
+{
+    switch ( client_state )
+    {
+        case NETCODE_CLIENT_STATE_CONNECT_TOKEN_EXPIRED:                return "connect token expired";
+        case NETCODE_CLIENT_STATE_INVALID_CONNECT_TOKEN:                return "invalid connect token";
+        case NETCODE_CLIENT_STATE_CONNECTION_TIMED_OUT:                 return "connection timed out";
+        case NETCODE_CLIENT_STATE_CONNECTION_REQUEST_TIMED_OUT:         return "connection request timed out";
+        case NETCODE_CLIENT_STATE_CONNECTION_RESPONSE_TIMED_OUT:        return "connection response timed out";
+        case NETCODE_CLIENT_STATE_CONNECTION_DENIED:                    return "connection denied";
+        case NETCODE_CLIENT_STATE_DISCONNECTED:                         return "disconnected";
+        case NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST:           return "sending connection request";
+        case NETCODE_CLIENT_STATE_SENDING_CONNECTION_RESPONSE:          return "sending connection response";
+        case NETCODE_CLIENT_STATE_CONNECTED:                            return "connected";
+        default:
+            netcode_assert( 0 );
+            return "???";
+    }
+}
+
+void netcode_default_client_config( struct netcode_client_config_t * config )
+{
+    netcode_assert( config );
+    config->allocator_context = NULL;
+    config->allocate_function = netcode_default_allocate_function;
+    config->free_function = netcode_default_free_function;
+    config->network_simulator = NULL;
+    config->callback_context = NULL;
+    config->state_change_callback = NULL;
+    config->send_loopback_packet_callback = NULL;
+    config->override_send_and_receive = 0;
+    config->send_packet_override = NULL;
+    config->receive_packet_override = NULL;
+    config->auxiliary_command_function = NULL;
+    config->auxiliary_command_context = NULL;
+    config->adaptive_handshake = 0;
+    config->race_connect_servers = 0;
+    config->connection_id = 0;
+};
+
+struct netcode_client_t
+{
+    struct netcode_client_config_t config;
+    int state;
+    double time;
+    double connect_start_time;
+    double last_packet_send_time;
+    double last_packet_receive_time;
+    double handshake_retry_time;
+    int should_disconnect;
+    int should_disconnect_state;
+    uint64_t sequence;
+    int client_index;
+    int max_clients;
+    int server_address_index;
+    int next_server_address_index;
+    uint32_t racing_server_mask;
+    uint64_t connection_id;
+    struct netcode_address_t address;
+    struct netcode_address_t server_address;
+    struct netcode_connect_token_t connect_token;
+    struct netcode_connect_token_t session_ticket;
+    int has_session_ticket;
+    struct netcode_socket_holder_t socket_holder;
+    struct netcode_context_t context;
+    struct netcode_replay_protection_t replay_protection;
+    struct netcode_packet_queue_t packet_receive_queue;
+    uint64_t challenge_token_sequence;
+    uint8_t challenge_token_data[NETCODE_CHALLENGE_TOKEN_BYTES];
+    uint8_t * receive_packet_data[NETCODE_CLIENT_MAX_RECEIVE_PACKETS];
+    int receive_packet_bytes[NETCODE_CLIENT_MAX_RECEIVE_PACKETS];
+    struct netcode_address_t receive_from[NETCODE_CLIENT_MAX_RECEIVE_PACKETS];
+    struct netcode_packet_pool_t packet_pool;
+    uint8_t * receive_buffer;
+    int loopback;
+};
+
+int netcode_client_socket_create( struct netcode_socket_t * socket,
+                                  struct netcode_address_t * address,
+                                  int send_buffer_size,
+                                  int receive_buffer_size,
+                                  NETCODE_CONST struct netcode_client_config_t * config )
+{
+    netcode_assert( socket );
+    netcode_assert( address );
+    netcode_assert( config );
+
+    if ( !config->network_simulator )
+    {
+        if ( !config->override_send_and_receive )
+        {
+            if ( netcode_socket_create( socket, address, send_buffer_size, receive_buffer_size, 0 ) != NETCODE_SOCKET_ERROR_NONE )
+            {
+                return 0;
+            }
+        }
+    }
+    else
+    {
+        if ( address->port == 0 )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: must bind to a specific port when using network simulator\n" );
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+struct netcode_client_t * netcode_client_create_overload( NETCODE_CONST char * address1_string,
+                                                          NETCODE_CONST char * address2_string,
+                                                          NETCODE_CONST struct netcode_client_config_t * config,
+                                                          double time )
+{
+    netcode_assert( config );
+    netcode_assert( netcode.initialized );
+
+    struct netcode_address_t address1;
+    struct netcode_address_t address2;
+
+    memset( &address1, 0, sizeof( address1 ) );
+    memset( &address2, 0, sizeof( address2 ) );
+
+    if ( netcode_parse_address( address1_string, &address1 ) != NETCODE_OK )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: failed to parse client address\n" );
+        return NULL;
+    }
+
+    if ( address2_string != NULL && netcode_parse_address( address2_string, &address2 ) != NETCODE_OK )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: failed to parse client address2\n" );
+        return NULL;
+    }
+
+
+    struct netcode_socket_t socket_ipv4;
+    struct netcode_socket_t socket_ipv6;
+
+    memset( &socket_ipv4, 0, sizeof( socket_ipv4 ) );
+    memset( &socket_ipv6, 0, sizeof( socket_ipv6 ) );
+
+    if ( address1.type == NETCODE_ADDRESS_IPV4 || address2.type == NETCODE_ADDRESS_IPV4 )
+    {
+        if ( !netcode_client_socket_create( &socket_ipv4, address1.type == NETCODE_ADDRESS_IPV4 ? &address1 : &address2, NETCODE_CLIENT_SOCKET_SNDBUF_SIZE, NETCODE_CLIENT_SOCKET_RCVBUF_SIZE, config ) )
+        {
+            return NULL;
+        }
+    }
+
+    if ( address1.type == NETCODE_ADDRESS_IPV6 || address2.type == NETCODE_ADDRESS_IPV6 )
+    {
+        if ( !netcode_client_socket_create( &socket_ipv6, address1.type == NETCODE_ADDRESS_IPV6 ? &address1 : &address2, NETCODE_CLIENT_SOCKET_SNDBUF_SIZE, NETCODE_CLIENT_SOCKET_RCVBUF_SIZE, config ) )
+        {
+            return NULL;
+        }
+    }
+
+    struct netcode_client_t * client = (struct netcode_client_t*) config->allocate_function( config->allocator_context, sizeof( struct netcode_client_t ) );
+
+    if ( !client )
+    {
+        netcode_socket_destroy( &socket_ipv4 );
+        netcode_socket_destroy( &socket_ipv6 );
+        return NULL;
+    }
+
+    struct netcode_address_t socket_address = address1.type == NETCODE_ADDRESS_IPV4 ? socket_ipv4.address : socket_ipv6.address;
+
+    if ( !config->network_simulator )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_INFO, "client started on port %d\n", socket_address.port );
+    }
+    else
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_INFO, "client started on port %d (network simulator)\n", socket_address.port );
+    }
+
+    client->config = *config;
+    client->socket_holder.ipv4 = socket_ipv4;
+    client->socket_holder.ipv6 = socket_ipv6;
+    client->address = config->network_simulator ? address1 : socket_address;
+    client->state = NETCODE_CLIENT_STATE_DISCONNECTED;
+    client->time = time;
+    client->connect_start_time = 0.0;
+    client->last_packet_send_time = -1000.0;
+    client->last_packet_receive_time = -1000.0;
+    client->should_disconnect = 0;
+    client->should_disconnect_state = NETCODE_CLIENT_STATE_DISCONNECTED;
+    client->sequence = 0;
+    client->client_index = 0;
+    client->max_clients = 0;
+    client->server_address_index = 0;
+    client->next_server_address_index = 0;
+    client->racing_server_mask = 0;
+    client->connection_id = 0;
+    client->challenge_token_sequence = 0;
+    client->loopback = 0;
+    memset( &client->server_address, 0, sizeof( struct netcode_address_t ) );
+    memset( &client->connect_token, 0, sizeof( struct netcode_connect_token_t ) );
+    memset( &client->session_ticket, 0, sizeof( struct netcode_connect_token_t ) );
+    client->has_session_ticket = 0;
+    memset( &client->context, 0, sizeof( struct netcode_context_t ) );
+    memset( client->challenge_token_data, 0, NETCODE_CHALLENGE_TOKEN_BYTES );
+
+    netcode_packet_pool_init( &client->packet_pool, config->allocator_context, config->allocate_function, config->free_function );
+
+    netcode_packet_queue_init( &client->packet_receive_queue, &client->packet_pool, netcode_packet_pool_allocate, netcode_packet_pool_free );
+
+    client->receive_buffer = netcode_packet_pool_allocate_receive_buffer( &client->packet_pool );
+
+    netcode_replay_protection_reset( &client->replay_protection );
+
+    return client;
+}
+
+struct netcode_client_t * netcode_client_create( NETCODE_CONST char * address,
+                                                 NETCODE_CONST struct netcode_client_config_t * config,
+                                                 double time )
+{
+    return netcode_client_create_overload( address, NULL, config, time );
+}
+
+void netcode_client_destroy( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+    if ( !client->loopback )
+        netcode_client_disconnect( client );
+    else
+        netcode_client_disconnect_loopback( client );
+    netcode_socket_destroy( &client->socket_holder.ipv4 );
+    netcode_socket_destroy( &client->socket_holder.ipv6 );
+    netcode_packet_queue_clear( &client->packet_receive_queue );
+    if ( client->receive_buffer )
+        netcode_packet_pool_free( &client->packet_pool, client->receive_buffer );
+    netcode_packet_pool_destroy( &client->packet_pool );
+    client->config.free_function( client->config.allocator_context, client );
+}
+
+void netcode_client_set_state( struct netcode_client_t * client, int client_state )
+{
+    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client changed state from '%s' to '%s'\n", 
+        netcode_client_state_name( client->state ), netcode_client_state_name( client_state ) );
+
+    if ( client->config.state_change_callback )
+    {
+        client->config.state_change_callback( client->config.callback_context, client->state, client_state );
+    }
+
+    client->state = client_state;
+}
+
+void netcode_client_reset_before_next_connect( struct netcode_client_t * client )
+{
+    client->connect_start_time = client->time;
+    client->last_packet_send_time = client->time - 1.0f;
+    client->last_packet_receive_time = client->time;
+    client->handshake_retry_time = NETCODE_HANDSHAKE_RETRY_TIME;
+    client->should_disconnect = 0;
+    client->should_disconnect_state = NETCODE_CLIENT_STATE_DISCONNECTED;
+    client->challenge_token_sequence = 0;
+
+    memset( client->challenge_token_data, 0, NETCODE_CHALLENGE_TOKEN_BYTES );
+
+    netcode_context_set_cipher_suite( &client->context, NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 );
+
+    netcode_replay_protection_reset( &client->replay_protection );
+}
+
+void netcode_client_reset_connection_data( struct netcode_client_t * client, int client_state )
+{
+    netcode_assert( client );
+
+    client->sequence = 0;
+    client->loopback = 0;
+    client->client_index = 0;
+    client->max_clients = 0;
+    client->connect_start_time = 0.0;
+    client->server_address_index = 0;
+    client->next_server_address_index = 0;
+    client->racing_server_mask = 0;
+    client->connection_id = 0;
+    memset( &client->server_address, 0, sizeof( struct netcode_address_t ) );
+    memset( &client->connect_token, 0, sizeof( struct netcode_connect_token_t ) );
+    memset( &client->context, 0, sizeof( struct netcode_context_t ) );
+
+    netcode_client_set_state( client, client_state );
+
+    netcode_client_reset_before_next_connect( client );
+
+    while ( 1 )
+    {
+        void * packet = netcode_packet_queue_pop( &client->packet_receive_queue, NULL );
+        if ( !packet )
+            break;
+        netcode_packet_pool_free( &client->packet_pool, packet );
+    }
+
+    netcode_packet_queue_clear( &client->packet_receive_queue );
+}
+
+void netcode_client_disconnect_internal( struct netcode_client_t * client, int destination_state, int send_disconnect_packets );
+
+void netcode_client_select_servers( struct netcode_client_t * client, int server_address_index )
+{
+    netcode_assert( client );
+    netcode_assert( server_address_index >= 0 );
+    netcode_assert( server_address_index < client->connect_token.num_server_addresses );
+
+    // with race_connect_servers above one, the next attempt sends connection requests to that many servers at once
+    // and commits to whichever answers with a challenge first. otherwise it is one server at a time, like always
+
+    int num_servers = client->config.race_connect_servers;
+    if ( num_servers > client->connect_token.num_server_addresses - server_address_index )
+        num_servers = client->connect_token.num_server_addresses - server_address_index;
+    if ( num_servers < 1 )
+        num_servers = 1;
+
+    client->server_address_index = server_address_index;
+    client->server_address = client->connect_token.server_addresses[server_address_index];
+    client->next_server_address_index = server_address_index + num_servers;
+    client->racing_server_mask = 0;
+
+    if ( num_servers > 1 )
+    {
+        int i;
+        for ( i = server_address_index; i < server_address_index + num_servers; ++i )
+            client->racing_server_mask |= 1U << i;
+    }
+}
+
+void netcode_client_connect( struct netcode_client_t * client, uint8_t * connect_token )
+{
+    netcode_assert( client );
+    netcode_assert( connect_token );
+
+    netcode_client_disconnect( client );
+
+    if ( netcode_read_connect_token( connect_token, NETCODE_CONNECT_TOKEN_BYTES, &client->connect_token ) != NETCODE_OK )
+    {
+        netcode_client_set_state( client, NETCODE_CLIENT_STATE_INVALID_CONNECT_TOKEN );
+        return;
+    }
+
+    netcode_client_select_servers( client, 0 );
+
+    char server_address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+
+    netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connecting to server %s [%d-%d/%d]\n", 
+        netcode_address_to_string( &client->server_address, server_address_string ), client->server_address_index + 1, client->next_server_address_index, client->connect_token.num_server_addresses );
+
+    memcpy( client->context.read_packet_key, client->connect_token.server_to_client_key, NETCODE_KEY_BYTES );
+    memcpy( client->context.write_packet_key, client->connect_token.client_to_server_key, NETCODE_KEY_BYTES );
+
+    netcode_client_reset_before_next_connect( client );
+
+    if ( client->connect_token.session_ticket && netcode_cipher_suite_supported( client->connect_token.cipher_suite ) )
+    {
+        // the server resumes a session ticket on the cipher suite it negotiated before, with no challenge to say so
+
+        netcode_context_set_cipher_suite( &client->context, client->connect_token.cipher_suite );
+    }
+
+    netcode_client_set_state( client, NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST );
+}
+
+int netcode_client_proposed_cipher_suite( struct netcode_client_t * client )
+{
+    // the client proposes what the connect token asks for, if it can run it. the server has the final say in the challenge
+
+    netcode_assert( client );
+
+    if ( netcode_cipher_suite_supported( client->connect_token.cipher_suite ) )
+        return client->connect_token.cipher_suite;
+
+    return NETCODE_CIPHER_SUITE_CHACHA20_POLY1305;
+}
+
+int netcode_client_handshake_server_index( struct netcode_client_t * client, struct netcode_address_t * from )
+{
+    netcode_assert( client );
+    netcode_assert( from );
+
+    // while racing, any server still in the race may answer. otherwise only the server we are connecting to
+
+    if ( !client->racing_server_mask )
+        return netcode_address_equal( from, &client->server_address ) ? client->server_address_index : -1;
+
+    int i;
+    for ( i = 0; i < client->connect_token.num_server_addresses; ++i )
+    {
+        if ( ( client->racing_server_mask & ( 1U << i ) ) && netcode_address_equal( from, &client->connect_token.server_addresses[i] ) )
+            return i;
+    }
+
+    return -1;
+}
+
+void netcode_client_send_packet_to_address_internal( struct netcode_client_t * client, struct netcode_address_t * to, void * packet );
+
+void netcode_client_abandon_racing_servers( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+
+    // the servers that lost the race each hold an encryption mapping for us. a disconnect lets them drop it now,
+    // and if it gets lost the mapping just times out like any other abandoned handshake
+
+    int i;
+    for ( i = 0; i < client->connect_token.num_server_addresses; ++i )
+    {
+        if ( ( client->racing_server_mask & ( 1U << i ) ) == 0 || netcode_address_equal( &client->connect_token.server_addresses[i], &client->server_address ) )
+            continue;
+
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client sent disconnect packet to abandoned server %d\n", i + 1 );
+
+        struct netcode_connection_disconnect_packet_t packet;
+        packet.packet_type = NETCODE_CONNECTION_DISCONNECT_PACKET;
+
+        netcode_client_send_packet_to_address_internal( client, &client->connect_token.server_addresses[i], &packet );
+    }
+
+    client->racing_server_mask = 0;
+}
+
+void netcode_client_process_packet_internal( struct netcode_client_t * client, struct netcode_address_t * from, uint8_t * packet, uint64_t sequence )
+{
+    netcode_assert( client );
+    netcode_assert( packet );
+
+    uint8_t packet_type = ( (uint8_t*) packet ) [0];
+
+    switch ( packet_type )
+    {
+        case NETCODE_CONNECTION_DENIED_PACKET:
+        {
+            const int server_index = netcode_client_handshake_server_index( client, from );
+
+            if ( ( client->state == NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST || 
+                   client->state == NETCODE_CLIENT_STATE_SENDING_CONNECTION_RESPONSE ) 
+                                                && 
+                      server_index != -1 )
+            {
+                if ( client->racing_server_mask )
+                {
+                    client->racing_server_mask &= ~( 1U << server_index );
+
+                    if ( client->racing_server_mask )
+                    {
+                        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client was denied by server %d. still racing the others\n", server_index + 1 );
+                        break;
+                    }
+                }
+
+                client->should_disconnect = 1;
+                client->should_disconnect_state = NETCODE_CLIENT_STATE_CONNECTION_DENIED;
+                client->last_packet_receive_time = client->time;
+            }
+        }
+        break;
+
+        case NETCODE_CONNECTION_CHALLENGE_PACKET:
+        {
+            const int server_index = netcode_client_handshake_server_index( client, from );
+
+            if ( client->state == NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST && server_index != -1 )
+            {
+                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client received connection challenge packet from server\n" );
+
+                struct netcode_connection_challenge_packet_t * p = (struct netcode_connection_challenge_packet_t*) packet;
+
+                if ( p->cipher_suite != NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 && p->cipher_suite != netcode_client_proposed_cipher_suite( client ) )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client ignored connection challenge packet. server picked cipher suite %d, which the client did not propose\n", p->cipher_suite );
+                    break;
+                }
+
+                if ( client->racing_server_mask )
+                {
+                    char server_address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+                    netcode_printf( NETCODE_LOG_LEVEL_INFO, "client committed to server %s [%d/%d]\n", 
+                        netcode_address_to_string( from, server_address_string ), server_index + 1, client->connect_token.num_server_addresses );
+
+                    client->server_address_index = server_index;
+                    client->server_address = client->connect_token.server_addresses[server_index];
+
+                    netcode_client_abandon_racing_servers( client );
+                }
+
+                netcode_context_set_cipher_suite( &client->context, p->cipher_suite );
+
+                client->challenge_token_sequence = p->challenge_token_sequence;
+                memcpy( client->challenge_token_data, p->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
+                client->last_packet_receive_time = client->time;
+
+                if ( client->config.adaptive_handshake )
+                {
+                    // answer the challenge in this update instead of waiting out the request retry timer
+
+                    client->last_packet_send_time = client->time - 1.0;
+                    client->handshake_retry_time = NETCODE_HANDSHAKE_RETRY_TIME;
+                }
+
+                netcode_client_set_state( client, NETCODE_CLIENT_STATE_SENDING_CONNECTION_RESPONSE );
+            }
+        }
+        break;
+
+        case NETCODE_CONNECTION_KEEP_ALIVE_PACKET:
+        {
+            if ( netcode_address_equal( from, &client->server_address ) )
+            {
+                struct netcode_connection_keep_alive_packet_t * p = (struct netcode_connection_keep_alive_packet_t*) packet;
+
+                if ( client->state == NETCODE_CLIENT_STATE_CONNECTED )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client received connection keep alive packet from server\n" );
+
+                    client->last_packet_receive_time = client->time;
+                }
+                else if ( client->state == NETCODE_CLIENT_STATE_SENDING_CONNECTION_RESPONSE || 
+                          ( client->state == NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST && client->connect_token.session_ticket ) )
+                {
+                    // with a session ticket the server skips the challenge, so the keep-alive answers the request
+
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client received connection keep alive packet from server\n" );
+
+                    client->last_packet_receive_time = client->time;
+                    client->client_index = p->client_index;
+                    client->max_clients = p->max_clients;
+
+                    if ( client->config.connection_id )
+                    {
+                        // from here on the server can tell our packets apart by connection id, even if our address changes
+
+                        client->connection_id = netcode_connection_id( client->context.write_packet_key, client->client_index );
+                    }
+
+                    netcode_client_set_state( client, NETCODE_CLIENT_STATE_CONNECTED );
+
+                    netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connected to server\n" );
+                }
+            }
+        }
+        break;
+
+        case NETCODE_CONNECTION_PAYLOAD_PACKET:
+        {
+            if ( client->state == NETCODE_CLIENT_STATE_CONNECTED && netcode_address_equal( from, &client->server_address ) )
+            {
+                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client received connection payload packet from server\n" );
+
+                netcode_packet_queue_push( &client->packet_receive_queue, packet, sequence );
+
+                client->last_packet_receive_time = client->time;
+
+                return;
+            }
+
+            if ( client->state == NETCODE_CLIENT_STATE_SENDING_CONNECTION_RESPONSE && client->config.adaptive_handshake && netcode_address_equal( from, &client->server_address ) )
+            {
+                // the server sends its first payload right behind the keep-alive that confirms us. if the payload
+                // gets here first, hold on to it until the keep-alive arrives instead of dropping it
+
+                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client received connection payload packet from server before keep-alive\n" );
+
+                netcode_packet_queue_push( &client->packet_receive_queue, packet, sequence );
+
+                return;
+            }
+        }
+        break;
+
+        case NETCODE_CONNECTION_SESSION_TICKET_PACKET:
+        {
+            struct netcode_connection_session_ticket_packet_t * p = (struct netcode_connection_session_ticket_packet_t*) packet;
+
+            if ( client->state == NETCODE_CLIENT_STATE_CONNECTED && netcode_address_equal( from, &client->server_address ) && p->cipher_suite < NETCODE_NUM_CIPHER_SUITES )
+            {
+                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client received session ticket packet from server\n" );
+
+                // wrap the ticket in a connect token for the server we are connected to, so reconnecting with it
+                // goes through netcode_client_connect like any other token
+
+                uint64_t current_timestamp = (uint64_t) time( NULL );
+
+                struct netcode_connect_token_t * ticket = &client->session_ticket;
+                memcpy( ticket->version_info, client->connect_token.version_info, NETCODE_VERSION_INFO_BYTES );
+                ticket->protocol_id = client->connect_token.protocol_id;
+                ticket->create_timestamp = current_timestamp < p->expire_timestamp ? current_timestamp : p->expire_timestamp;
+                ticket->expire_timestamp = p->expire_timestamp;
+                memcpy( ticket->nonce, p->nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+                memcpy( ticket->private_data, p->ticket_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+                ticket->timeout_seconds = p->timeout_seconds;
+                ticket->num_server_addresses = 1;
+                ticket->server_addresses[0] = client->server_address;
+                memcpy( ticket->client_to_server_key, p->client_to_server_key, NETCODE_KEY_BYTES );
+                memcpy( ticket->server_to_client_key, p->server_to_client_key, NETCODE_KEY_BYTES );
+                ticket->cipher_suite = p->cipher_suite;
+                ticket->session_ticket = 1;
+
+                client->has_session_ticket = 1;
+                client->last_packet_receive_time = client->time;
+            }
+        }
+        break;
+
+        case NETCODE_CONNECTION_DISCONNECT_PACKET:
+        {
+            if ( client->state == NETCODE_CLIENT_STATE_CONNECTED && netcode_address_equal( from, &client->server_address ) )
+            {
+                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client received disconnect packet from server\n" );
+
+                client->should_disconnect = 1;
+                client->should_disconnect_state = NETCODE_CLIENT_STATE_DISCONNECTED;
+                client->last_packet_receive_time = client->time;
+            }
+        }
+        break;
+
+        default:
+            break;
+    }
+
+    netcode_packet_pool_free( &client->packet_pool, packet );
+}
+
+void netcode_client_process_packet( struct netcode_client_t * client, struct netcode_address_t * from, uint8_t * packet_data, int packet_bytes )
+{
+    (void) client;
+    (void) from;
+    (void) packet_data;
+    (void) packet_bytes;
+
+    uint8_t allowed_packets[NETCODE_CONNECTION_NUM_PACKETS];
+    memset( allowed_packets, 0, sizeof( allowed_packets ) );
+    allowed_packets[NETCODE_CONNECTION_DENIED_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_CHALLENGE_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_KEEP_ALIVE_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_PAYLOAD_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_DISCONNECT_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_SESSION_TICKET_PACKET] = 1;
+
+    uint64_t current_timestamp = (uint64_t) time( NULL );
+
+    uint64_t sequence;
+
+    void * packet = netcode_read_packet( packet_data, 
+                                         packet_bytes, 
+                                         &sequence, 
+                                         client->context.read_packet_key, 
+                                         client->connect_token.protocol_id, 
+                                         current_timestamp, 
+                                         NULL, 
+                                         allowed_packets, 
+                                         &client->replay_protection, 
+                                         &client->packet_pool, 
+                                         netcode_packet_pool_allocate, 
+                                         netcode_context_read_packet_cipher( &client->context ) );
+
+    if ( !packet )
+        return;
+    
+    netcode_client_process_packet_internal( client, from, (uint8_t*)packet, sequence );
+}
+
+void netcode_client_receive_packets( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+    netcode_assert( !client->loopback );
+
+    uint8_t allowed_packets[NETCODE_CONNECTION_NUM_PACKETS];
+    memset( allowed_packets, 0, sizeof( allowed_packets ) );
+    allowed_packets[NETCODE_CONNECTION_DENIED_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_CHALLENGE_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_KEEP_ALIVE_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_PAYLOAD_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_DISCONNECT_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_SESSION_TICKET_PACKET] = 1;
+
+    uint64_t current_timestamp = (uint64_t) time( NULL );
+
+    if ( !client->config.network_simulator )
+    {
+        // process packets received from socket
+
+        while ( 1 )
+        {
+            // receive straight into a pool buffer. payload packets keep the buffer, so only swap in a new one when that happens
+
+            if ( !client->receive_buffer )
+            {
+                client->receive_buffer = netcode_packet_pool_allocate_receive_buffer( &client->packet_pool );
+                if ( !client->receive_buffer )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: client could not allocate receive buffer\n" );
+                    break;
+                }
+            }
+
+            struct netcode_address_t from;
+            uint8_t * packet_data = client->receive_buffer;
+            int packet_bytes = 0;
+
+            if ( client->config.override_send_and_receive )
+            {
+                packet_bytes = client->config.receive_packet_override( client->config.callback_context, &from, packet_data, NETCODE_MAX_PACKET_BYTES );
+            }
+            else if ( client->server_address.type == NETCODE_ADDRESS_IPV4 )
+            {
+                packet_bytes = netcode_socket_receive_packet( &client->socket_holder.ipv4, &from, packet_data, NETCODE_MAX_PACKET_BYTES );
+            }
+            else if ( client->server_address.type == NETCODE_ADDRESS_IPV6 )
+            {
+                packet_bytes = netcode_socket_receive_packet( &client->socket_holder.ipv6, &from, packet_data, NETCODE_MAX_PACKET_BYTES );
+            }
+
+            if ( packet_bytes == 0 )
+                break;
+
+            if ( client->config.auxiliary_command_function != NULL ) {
+                if ( client->config.auxiliary_command_function(
+                            client->config.auxiliary_command_context, 
+                            packet_data, 
+                            packet_bytes ))
+                {
+                    continue;
+                }
+            }
+
+            uint64_t sequence;
+            int buffer_adopted = 0;
+            void * packet = netcode_read_packet_internal( packet_data, 
+                                                          packet_bytes, 
+                                                          &sequence, 
+                                                          client->context.read_packet_key, 
+                                                          client->connect_token.protocol_id, 
+                                                          current_timestamp, 
+                                                          NULL, 
+                                                          allowed_packets, 
+                                                          &client->replay_protection, 
+                                                          &client->packet_pool, 
+                                                          netcode_packet_pool_allocate, 
+                                                          &buffer_adopted, 
+                                                          0, 
+                                                          netcode_context_read_packet_cipher( &client->context ) );
+
+            if ( buffer_adopted )
+                client->receive_buffer = NULL;
+
+            if ( !packet )
+                continue;
+
+            netcode_client_process_packet_internal( client, &from, (uint8_t*)packet, sequence );
+        }
+    }
+    else
+    {
+        // process packets received from network simulator
+
+        int num_packets_received = netcode_network_simulator_receive_packets( client->config.network_simulator, 
+                                                                              &client->address, 
+                                                                              NETCODE_CLIENT_MAX_RECEIVE_PACKETS, 
+                                                                              client->receive_packet_data, 
+                                                                              client->receive_packet_bytes, 
+                                                                              client->receive_from );
+
+        int i;
+        for ( i = 0; i < num_packets_received; ++i )
+        {
+            uint64_t sequence;
+
+            void * packet = netcode_read_packet( client->receive_packet_data[i], 
+                                                 client->receive_packet_bytes[i], 
+                                                 &sequence, 
+                                                 client->context.read_packet_key, 
+                                                 client->connect_token.protocol_id, 
+                                                 current_timestamp, 
+                                                 NULL, 
+                                                 allowed_packets, 
+                                                 &client->replay_protection, 
+                                                 &client->packet_pool, 
+                                                 netcode_packet_pool_allocate, 
+                                                 netcode_context_read_packet_cipher( &client->context ) );
+
+            client->config.free_function( client->config.allocator_context, client->receive_packet_data[i] );
+
+            if ( !packet )
+                continue;
+
+            netcode_client_process_packet_internal( client, &client->receive_from[i], (uint8_t*)packet, sequence );
+        }
+    }
+}
+
+void netcode_client_send_packet_data( struct netcode_client_t * client, struct netcode_address_t * to, uint8_t * packet_data, int packet_bytes )
+{
+    netcode_assert( to );
+    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_BYTES );
+
+    if ( client->config.network_simulator )
+    {
+        netcode_network_simulator_send_packet( client->config.network_simulator, &client->address, to, packet_data, packet_bytes );
+    }
+    else
+    {
+        if ( client->config.override_send_and_receive )
+        {
+            client->config.send_packet_override( client->config.callback_context, to, packet_data, packet_bytes );
+        }
+        else if ( to->type == NETCODE_ADDRESS_IPV4 )
+        {
+            netcode_socket_send_packet( &client->socket_holder.ipv4, to, packet_data, packet_bytes );
+        }
+        else if ( to->type == NETCODE_ADDRESS_IPV6 )
+        {
+            netcode_socket_send_packet( &client->socket_holder.ipv6, to, packet_data, packet_bytes );
+        }
+    }
+
+    client->last_packet_send_time = client->time;
+}
+
+void netcode_client_send_packet_to_address_internal( struct netcode_client_t * client, struct netcode_address_t * to, void * packet )
+{
+    netcode_assert( client );
+    netcode_assert( !client->loopback );
+    
+    uint8_t packet_data[NETCODE_MAX_PACKET_BYTES];
+
+    const uint64_t connection_id = ( ( (uint8_t*) packet )[0] >= NETCODE_CONNECTION_KEEP_ALIVE_PACKET ) ? client->connection_id : 0;
+
+    int packet_bytes = netcode_write_packet_with_connection_id( packet, 
+                                                                packet_data, 
+                                                                NETCODE_MAX_PACKET_BYTES, 
+                                                                client->sequence++, 
+                                                                client->context.write_packet_key, 
+                                                                client->connect_token.protocol_id, 
+                                                                connection_id, 
+                                                                netcode_context_write_packet_cipher( &client->context ) );
+
+    netcode_client_send_packet_data( client, to, packet_data, packet_bytes );
+}
+
+void netcode_client_send_packet_to_server_internal( struct netcode_client_t * client, void * packet )
+{
+    netcode_client_send_packet_to_address_internal( client, &client->server_address, packet );
+}
+
+int netcode_client_handshake_packet_due( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+
+    // with the adaptive handshake, retries start fast and back off to the regular send rate,
+    // so one lost handshake packet costs tens of milliseconds instead of a full send interval
+
+    double retry_time = 1.0 / NETCODE_PACKET_SEND_RATE;
+
+    if ( client->config.adaptive_handshake && client->handshake_retry_time < retry_time )
+        retry_time = client->handshake_retry_time;
+
+    if ( client->last_packet_send_time + retry_time >= client->time )
+        return 0;
+
+    client->handshake_retry_time = retry_time * 2.0;
+
+    return 1;
+}
+
+void netcode_client_send_packets( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+    netcode_assert( !client->loopback );
+
+    switch ( client->state )
+    {
+        case NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST:
+        {
+            if ( !netcode_client_handshake_packet_due( client ) )
+                return;
+
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client sent connection request packet to server\n" );
+
+            struct netcode_connection_request_packet_t packet;
+            packet.packet_type = NETCODE_CONNECTION_REQUEST_PACKET;
+            memcpy( packet.version_info, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
+            packet.protocol_id = client->connect_token.protocol_id;
+            packet.connect_token_expire_timestamp = client->connect_token.expire_timestamp;
+            memcpy( packet.connect_token_nonce, client->connect_token.nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+            memcpy( packet.connect_token_data, client->connect_token.private_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+            packet.cipher_suite = netcode_client_proposed_cipher_suite( client );
+
+            if ( !client->racing_server_mask )
+            {
+                netcode_client_send_packet_to_server_internal( client, &packet );
+                break;
+            }
+
+            int i;
+            for ( i = 0; i < client->connect_token.num_server_addresses; ++i )
+            {
+                if ( client->racing_server_mask & ( 1U << i ) )
+                    netcode_client_send_packet_to_address_internal( client, &client->connect_token.server_addresses[i], &packet );
+            }
+        }
+        break;
+
+        case NETCODE_CLIENT_STATE_SENDING_CONNECTION_RESPONSE:
+        {
+            if ( !netcode_client_handshake_packet_due( client ) )
+                return;
+
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client sent connection response packet to server\n" );
+
+            struct netcode_connection_response_packet_t packet;
+            packet.packet_type = NETCODE_CONNECTION_RESPONSE_PACKET;
+            packet.challenge_token_sequence = client->challenge_token_sequence;
+            memcpy( packet.challenge_token_data, client->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
+
+            netcode_client_send_packet_to_server_internal( client, &packet );
+        }
+        break;
+
+        case NETCODE_CLIENT_STATE_CONNECTED:
+        {
+            if ( client->last_packet_send_time + ( 1.0 / NETCODE_PACKET_SEND_RATE ) >= client->time )
+                return;
+
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client sent connection keep-alive packet to server\n" );
+
+            struct netcode_connection_keep_alive_packet_t packet;
+            packet.packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
+            packet.client_index = 0;
+            packet.max_clients = 0;
+
+            netcode_client_send_packet_to_server_internal( client, &packet );
+        }
+        break;
+        
+        default:
+            break;
+    }
+}
+
+int netcode_client_connect_to_next_server( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+
+    if ( client->next_server_address_index >= client->connect_token.num_server_addresses )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client has no more servers to connect to\n" );
+        return 0;
+    }
+
+    netcode_client_select_servers( client, client->next_server_address_index );
+
+    netcode_client_reset_before_next_connect( client );
+
+    char server_address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+
+    netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connecting to next server %s [%d-%d/%d]\n", 
+        netcode_address_to_string( &client->server_address, server_address_string ), 
+        client->server_address_index + 1, 
+        client->next_server_address_index,
+        client->connect_token.num_server_addresses );
+
+    netcode_client_set_state( client, NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST );
+
+    return 1;
+}
+
+void netcode_client_update( struct netcode_client_t * client, double time )
+{
+    netcode_assert( client );
+
+    client->time = time;
+
+    if ( client->loopback )
+        return;
+
+    netcode_client_receive_packets( client );
+
+    netcode_client_send_packets( client );
+
+    if ( client->state > NETCODE_CLIENT_STATE_DISCONNECTED && client->state < NETCODE_CLIENT_STATE_CONNECTED )
+    {
+        uint64_t connect_token_expire_seconds = ( client->connect_token.expire_timestamp - client->connect_token.create_timestamp );            
+        if ( client->time - client->connect_start_time >= connect_token_expire_seconds )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connect failed. connect token expired\n" );
+            netcode_client_disconnect_internal( client, NETCODE_CLIENT_STATE_CONNECT_TOKEN_EXPIRED, 0 );
+            return;
+        }
+    }
+
+    if ( client->should_disconnect )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client should disconnect -> %s\n", netcode_client_state_name( client->should_disconnect_state ) );
+        if ( netcode_client_connect_to_next_server( client ) )
+            return;
+        netcode_client_disconnect_internal( client, client->should_disconnect_state, 0 );
+        return;
+    }
+
+    switch ( client->state )
+    {
+        case NETCODE_CLIENT_STATE_SENDING_CONNECTION_REQUEST:
+        {
+            if ( client->connect_token.timeout_seconds > 0 && client->last_packet_receive_time + client->connect_token.timeout_seconds < time )
+            {
+                netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connect failed. connection request timed out\n" );
+                if ( netcode_client_connect_to_next_server( client ) )
+                    return;
+                netcode_client_disconnect_internal( client, NETCODE_CLIENT_STATE_CONNECTION_REQUEST_TIMED_OUT, 0 );
+                return;
+            }
+        }
+        break;
+
+        case NETCODE_CLIENT_STATE_SENDING_CONNECTION_RESPONSE:
+        {
+            if ( client->connect_token.timeout_seconds > 0 && client->last_packet_receive_time + client->connect_token.timeout_seconds < time )
+            {
+                netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connect failed. connection response timed out\n" );
+                if ( netcode_client_connect_to_next_server( client ) )
+                    return;
+                netcode_client_disconnect_internal( client, NETCODE_CLIENT_STATE_CONNECTION_RESPONSE_TIMED_OUT, 0 );
+                return;
+            }
+        }
+        break;
+
+        case NETCODE_CLIENT_STATE_CONNECTED:
+        {
+            if ( client->connect_token.timeout_seconds > 0 && client->last_packet_receive_time + client->connect_token.timeout_seconds < time )
+            {
+                netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connection timed out\n" );
+                netcode_client_disconnect_internal( client, NETCODE_CLIENT_STATE_CONNECTION_TIMED_OUT, 0 );
+                return;
+            }
+        }
+        break;
+
+        default:
+            break;
+    }
+}
+
+uint64_t netcode_client_next_packet_sequence( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+    return client->sequence;  
+}
+
+void netcode_client_send_packet( struct netcode_client_t * client, NETCODE_CONST uint8_t * packet_data, int packet_bytes )
+{
+    netcode_assert( client );
+    netcode_assert( packet_data );
+    netcode_assert( packet_bytes >= 0 );
+    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_SIZE );
+
+    if ( client->state != NETCODE_CLIENT_STATE_CONNECTED )
+        return;
+
+    if ( !client->loopback )
+    {
+        // the payload is encrypted straight out of the caller's buffer
+
+        struct netcode_connection_payload_packet_t payload_packet;
+        payload_packet.packet_type = NETCODE_CONNECTION_PAYLOAD_PACKET;
+        payload_packet.payload_bytes = packet_bytes;
+        payload_packet.payload_data = (uint8_t*) packet_data;
+
+        struct netcode_connection_payload_packet_t * packet = &payload_packet;
+
+        netcode_client_send_packet_to_server_internal( client, packet );
+    }
+    else
+    {
+        client->config.send_loopback_packet_callback( client->config.callback_context, 
+                                                      client->client_index, 
+                                                      packet_data,
+                                                      packet_bytes,
+                                                      client->sequence++ );
+    }
+}
+
+void netcode_client_send_packet_in_place( struct netcode_client_t * client, uint8_t * packet_data, int packet_bytes )
+{
+    netcode_assert( client );
+    netcode_assert( packet_data );
+    netcode_assert( packet_bytes > 0 );
+    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_SIZE );
+
+    if ( client->state != NETCODE_CLIENT_STATE_CONNECTED )
+        return;
+
+    if ( client->loopback )
+    {
+        netcode_client_send_packet( client, packet_data, packet_bytes );
+        return;
+    }
+
+    // the packet header goes into the headroom in front of the payload and the mac into the tailroom after it
+
+    uint64_t sequence = client->sequence++;
+
+    uint8_t * packet_start = packet_data - ( 1 + ( client->connection_id ? NETCODE_CONNECTION_ID_BYTES : 0 ) + netcode_sequence_number_bytes_required( sequence ) );
+
+    int bytes = netcode_write_payload_packet( packet_start, packet_data, packet_bytes, sequence, client->context.write_packet_key, client->connect_token.protocol_id, client->connection_id, netcode_context_write_packet_cipher( &client->context ) );
+    if ( bytes <= 0 )
+        return;
+
+    netcode_client_send_packet_data( client, &client->server_address, packet_start, bytes );
+}
+
+uint8_t * netcode_client_receive_packet( struct netcode_client_t * client, int * packet_bytes, uint64_t * packet_sequence )
+{
+    netcode_assert( client );
+    netcode_assert( packet_bytes );
+
+    if ( client->state != NETCODE_CLIENT_STATE_CONNECTED )
+        return NULL;
+
+    struct netcode_connection_payload_packet_t * packet = (struct netcode_connection_payload_packet_t*) 
+        netcode_packet_queue_pop( &client->packet_receive_queue, packet_sequence );
+    
+    if ( packet )
+    {
+        netcode_assert( packet->packet_type == NETCODE_CONNECTION_PAYLOAD_PACKET );
+        *packet_bytes = packet->payload_bytes;
+        netcode_assert( *packet_bytes >= 0 );
+        netcode_assert( *packet_bytes <= NETCODE_MAX_PAYLOAD_BYTES );
+        return packet->payload_data;
+    }
+    else
+    {
+        return NULL;
+    }
+}
+
+void netcode_client_free_packet( struct netcode_client_t * client, void * packet )
+{
+    netcode_assert( client );
+    netcode_assert( packet );
+    netcode_packet_pool_free( &client->packet_pool, packet );
+}
+
+void netcode_client_disconnect( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+    netcode_assert( !client->loopback );
+    netcode_client_disconnect_internal( client, NETCODE_CLIENT_STATE_DISCONNECTED, 1 );
+}
+
+void netcode_client_disconnect_internal( struct netcode_client_t * client, int destination_state, int send_disconnect_packets )
+{
+    netcode_assert( !client->loopback );
+    netcode_assert( destination_state <= NETCODE_CLIENT_STATE_DISCONNECTED );
+
+    if ( client->state <= NETCODE_CLIENT_STATE_DISCONNECTED || client->state == destination_state )
+        return;
+
+    netcode_printf( NETCODE_LOG_LEVEL_INFO, "client disconnected\n" );
+
+    if ( !client->loopback && send_disconnect_packets && client->state > NETCODE_CLIENT_STATE_DISCONNECTED )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client sent disconnect packets to server\n" );
+
+        int i;
+        for ( i = 0; i < NETCODE_NUM_DISCONNECT_PACKETS; ++i )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client sent disconnect packet %d\n", i );
+
+            struct netcode_connection_disconnect_packet_t packet;
+            packet.packet_type = NETCODE_CONNECTION_DISCONNECT_PACKET;
+
+            netcode_client_send_packet_to_server_internal( client, &packet );
+        }
+    }
+
+    netcode_client_reset_connection_data( client, destination_state );
+}
+
+int netcode_client_state( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+    return client->state;
+}
+
+int netcode_client_index( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+    return client->client_index;
+}
+
+int netcode_client_max_clients( struct netcode_client_t * client )
+{   
+    netcode_assert( client );
+    return client->max_clients;
+}
+
+void netcode_client_connect_loopback( struct netcode_client_t * client, int client_index, int max_clients )
+{
+    netcode_assert( client );
+    netcode_assert( client->state <= NETCODE_CLIENT_STATE_DISCONNECTED );
+    netcode_printf( NETCODE_LOG_LEVEL_INFO, "client connected to server via loopback as client %d\n", client_index );
+    client->state = NETCODE_CLIENT_STATE_CONNECTED;
+    client->client_index = client_index;
+    client->max_clients = max_clients;
+    client->loopback = 1;
+}
+
+void netcode_client_disconnect_loopback( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+    netcode_assert( client->loopback );
+    netcode_client_reset_connection_data( client, NETCODE_CLIENT_STATE_DISCONNECTED );
+}
+
+int netcode_client_loopback( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+    return client->loopback;
+}
+
+void netcode_client_process_loopback_packet( struct netcode_client_t * client, NETCODE_CONST uint8_t * packet_data, int packet_bytes, uint64_t packet_sequence )
+{
+    netcode_assert( client );
+    netcode_assert( client->loopback );
+    struct netcode_connection_payload_packet_t * packet = netcode_create_payload_packet( packet_bytes, &client->packet_pool, netcode_packet_pool_allocate );
+    if ( !packet )
+        return;
+    memcpy( packet->payload_data, packet_data, packet_bytes );
+    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "client processing loopback packet from server\n" );
+    netcode_packet_queue_push( &client->packet_receive_queue, packet, packet_sequence );
+}
+
+uint16_t netcode_client_get_port( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+    return client->address.type == NETCODE_ADDRESS_IPV4 ? client->socket_holder.ipv4.address.port : client->socket_holder.ipv6.address.port;
+}
+
+uint64_t netcode_client_socket_handle( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+    return client->server_address.type == NETCODE_ADDRESS_IPV6 ? (uint64_t) client->socket_holder.ipv6.handle : (uint64_t) client->socket_holder.ipv4.handle;
+}
+
+int netcode_client_wait( struct netcode_client_t * client, double timeout )
+{
+    netcode_assert( client );
+
+    if ( client->loopback || client->config.network_simulator || client->config.override_send_and_receive )
+        return 1;
+
+    netcode_socket_handle_t handle = client->server_address.type == NETCODE_ADDRESS_IPV6 ? client->socket_holder.ipv6.handle : client->socket_holder.ipv4.handle;
+    if ( handle == 0 )
+        return 1;
+
+    return netcode_socket_wait( &handle, 1, timeout );
+}
+
+int netcode_client_session_ticket( struct netcode_client_t * client, uint8_t * session_ticket )
+{
+    netcode_assert( client );
+    netcode_assert( session_ticket );
+
+    // writes the latest session ticket from the server as a connect token. it outlives the connection,
+    // so it can be read after a disconnect and passed to netcode_client_connect to get back in quickly
+
+    if ( !client->has_session_ticket )
+        return 0;
+
+    netcode_write_connect_token( &client->session_ticket, session_ticket, NETCODE_CONNECT_TOKEN_BYTES );
+
+    return 1;
+}
+
+struct netcode_address_t * netcode_client_server_address( struct netcode_client_t * client )
+{
+    netcode_assert( client );
+    return &client->server_address;
+}
+
+// ----------------------------------------------------------------
+
+#define NETCODE_ADDRESS_MAP_EMPTY -1
+
+struct netcode_address_map_t
+{
+    uint64_t seed;
+    int num_buckets;
+    int * buckets;
+};
+
+uint64_t netcode_address_map_mix( uint64_t x )
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+uint32_t netcode_address_hash( uint64_t seed, struct netcode_address_t * address )
+{
+    uint64_t hash = seed ^ ( ( (uint64_t) address->type ) << 16 ) ^ address->port;
+
+    if ( address->type == NETCODE_ADDRESS_IPV4 )
+    {
+        hash ^= ( (uint64_t) address->data.ipv4[0] << 32 ) | 
+                ( (uint64_t) address->data.ipv4[1] << 40 ) | 
+                ( (uint64_t) address->data.ipv4[2] << 48 ) | 
+                ( (uint64_t) address->data.ipv4[3] << 56 );
+        hash = netcode_address_map_mix( hash );
+    }
+    else
+    {
+        hash = netcode_address_map_mix( hash ^ ( ( (uint64_t) address->data.ipv6[0] )       | 
+                                                 ( (uint64_t) address->data.ipv6[1] << 16 ) | 
+                                                 ( (uint64_t) address->data.ipv6[2] << 32 ) | 
+                                                 ( (uint64_t) address->data.ipv6[3] << 48 ) ) );
+        hash = netcode_address_map_mix( hash ^ ( ( (uint64_t) address->data.ipv6[4] )       | 
+                                                 ( (uint64_t) address->data.ipv6[5] << 16 ) | 
+                                                 ( (uint64_t) address->data.ipv6[6] << 32 ) | 
+                                                 ( (uint64_t) address->data.ipv6[7] << 48 ) ) );
+    }
+
+    return (uint32_t) hash;
+}
+
+uint32_t netcode_address_map_hash( struct netcode_address_map_t * map, struct netcode_address_t * address )
+{
+    return netcode_address_hash( map->seed, address );
+}
+
+void netcode_address_map_reset( struct netcode_address_map_t * map, int * buckets, int num_buckets )
+{
+    netcode_assert( map );
+    netcode_assert( buckets );
+    netcode_assert( num_buckets > 0 );
+    netcode_assert( ( num_buckets & ( num_buckets - 1 ) ) == 0 );
+
+    // IMPORTANT: the seed is random so remote peers can't pick addresses that collide into one long probe sequence
+
+    netcode_random_bytes( (uint8_t*) &map->seed, sizeof( map->seed ) );
+    map->num_buckets = num_buckets;
+    map->buckets = buckets;
+
+    int i;
+    for ( i = 0; i < num_buckets; ++i )
+        map->buckets[i] = NETCODE_ADDRESS_MAP_EMPTY;
+}
+
+void netcode_address_map_insert( struct netcode_address_map_t * map, struct netcode_address_t * keys, int index )
+{
+    netcode_assert( map );
+    netcode_assert( keys );
+    netcode_assert( index >= 0 );
+
+    if ( keys[index].type == NETCODE_ADDRESS_NONE )
+        return;
+
+    const int mask = map->num_buckets - 1;
+    int bucket = netcode_address_map_hash( map, &keys[index] ) & mask;
+    int i;
+    for ( i = 0; i < map->num_buckets; ++i )
+    {
+        if ( map->buckets[bucket] == NETCODE_ADDRESS_MAP_EMPTY )
+        {
+            map->buckets[bucket] = index;
+            return;
+        }
+        netcode_assert( map->buckets[bucket] != index );
+        bucket = ( bucket + 1 ) & mask;
+    }
+
+    netcode_assert( !"address map is full" );
+}
+
+void netcode_address_map_remove( struct netcode_address_map_t * map, struct netcode_address_t * keys, int index )
+{
+    netcode_assert( map );
+    netcode_assert( keys );
+    netcode_assert( index >= 0 );
+
+    // IMPORTANT: call this before keys[index] is modified, the key is needed to find the bucket
+
+    if ( keys[index].type == NETCODE_ADDRESS_NONE )
+        return;
+
+    const int mask = map->num_buckets - 1;
+    int hole = netcode_address_map_hash( map, &keys[index] ) & mask;
+    while ( map->buckets[hole] != index )
+    {
+        if ( map->buckets[hole] == NETCODE_ADDRESS_MAP_EMPTY )
+            return;
+        hole = ( hole + 1 ) & mask;
+    }
+
+    // backward shift deletion: pull later entries of the probe sequence into the hole so no tombstones are needed
+
+    int next = ( hole + 1 ) & mask;
+    while ( map->buckets[next] != NETCODE_ADDRESS_MAP_EMPTY )
+    {
+        const int home = netcode_address_map_hash( map, &keys[map->buckets[next]] ) & mask;
+        if ( ( ( next - home ) & mask ) >= ( ( next - hole ) & mask ) )
+        {
+            map->buckets[hole] = map->buckets[next];
+            hole = next;
+        }
+        next = ( next + 1 ) & mask;
+    }
+
+    map->buckets[hole] = NETCODE_ADDRESS_MAP_EMPTY;
+}
+
+int netcode_address_map_num_buckets( int max_keys )
+{
+    netcode_assert( max_keys > 0 );
+
+    // at most half full, rounded up to a power of two so the bucket index is a mask
+
+    int num_buckets = 1;
+    while ( num_buckets < max_keys * 2 )
+        num_buckets *= 2;
+    return num_buckets;
+}
+
+int netcode_address_map_find( struct netcode_address_map_t * map, struct netcode_address_t * keys, struct netcode_address_t * address, int * iterator )
+{
+    netcode_assert( map );
+    netcode_assert( keys );
+    netcode_assert( address );
+    netcode_assert( iterator );
+
+    // returns each index with a matching key in turn. start with *iterator = -1, returns -1 when there are no more matches
+
+    const int mask = map->num_buckets - 1;
+    int bucket = ( *iterator < 0 ) ? (int) ( netcode_address_map_hash( map, address ) & mask ) : ( ( *iterator + 1 ) & mask );
+    while ( map->buckets[bucket] != NETCODE_ADDRESS_MAP_EMPTY )
+    {
+        const int index = map->buckets[bucket];
+        if ( netcode_address_equal( &keys[index], address ) )
+        {
+            *iterator = bucket;
+            return index;
+        }
+        bucket = ( bucket + 1 ) & mask;
+    }
+
+    return -1;
+}
+
+// ----------------------------------------------------------------
+
+#define NETCODE_ENCRYPTION_MAPPINGS_PER_CLIENT 4
+
+struct netcode_encryption_manager_t
+{
+    int num_encryption_mappings;
+    int max_encryption_mappings;
+    void * allocator_context;
+    void * (*allocate_function)(void*,size_t);
+    void (*free_function)(void*,void*);
+    int * timeout;
+    double * expire_time;
+    double * last_access_time;
+    struct netcode_address_t * address;
+    int * client_index;
+    uint8_t * send_key;
+    uint8_t * receive_key;
+    int * address_buckets;
+    struct netcode_address_map_t address_map;
+};
+
+void netcode_encryption_manager_reset( struct netcode_encryption_manager_t * encryption_manager );
+
+void netcode_encryption_manager_destroy( struct netcode_encryption_manager_t * encryption_manager )
+{
+    netcode_assert( encryption_manager );
+
+    if ( !encryption_manager->free_function )
+        return;
+
+    void * tables[] = { encryption_manager->timeout, 
+                        encryption_manager->expire_time, 
+                        encryption_manager->last_access_time, 
+                        encryption_manager->address, 
+                        encryption_manager->client_index, 
+                        encryption_manager->send_key, 
+                        encryption_manager->receive_key, 
+                        encryption_manager->address_buckets };
+
+    int i;
+    for ( i = 0; i < (int) ( sizeof( tables ) / sizeof( tables[0] ) ); ++i )
+    {
+        if ( tables[i] )
+            encryption_manager->free_function( encryption_manager->allocator_context, tables[i] );
+    }
+
+    memset( encryption_manager, 0, sizeof( struct netcode_encryption_manager_t ) );
+}
+
+int netcode_encryption_manager_create( struct netcode_encryption_manager_t * encryption_manager, 
+                                       int max_encryption_mappings, 
+                                       void * allocator_context, 
+                                       void * (*allocate_function)(void*,size_t), 
+                                       void (*free_function)(void*,void*) )
+{
+    netcode_assert( encryption_manager );
+    netcode_assert( max_encryption_mappings > 0 );
+
+    if ( allocate_function == NULL )
+    {
+        allocate_function = netcode_default_allocate_function;
+    }
+
+    if ( free_function == NULL )
+    {
+        free_function = netcode_default_free_function;
+    }
+
+    memset( encryption_manager, 0, sizeof( struct netcode_encryption_manager_t ) );
+
+    const int num_buckets = netcode_address_map_num_buckets( max_encryption_mappings );
+
+    encryption_manager->max_encryption_mappings = max_encryption_mappings;
+    encryption_manager->allocator_context = allocator_context;
+    encryption_manager->allocate_function = allocate_function;
+    encryption_manager->free_function = free_function;
+    encryption_manager->timeout = (int*) allocate_function( allocator_context, sizeof( int ) * max_encryption_mappings );
+    encryption_manager->expire_time = (double*) allocate_function( allocator_context, sizeof( double ) * max_encryption_mappings );
+    encryption_manager->last_access_time = (double*) allocate_function( allocator_context, sizeof( double ) * max_encryption_mappings );
+    encryption_manager->address = (struct netcode_address_t*) allocate_function( allocator_context, sizeof( struct netcode_address_t ) * max_encryption_mappings );
+    encryption_manager->client_index = (int*) allocate_function( allocator_context, sizeof( int ) * max_encryption_mappings );
+    encryption_manager->send_key = (uint8_t*) allocate_function( allocator_context, NETCODE_KEY_BYTES * max_encryption_mappings );
+    encryption_manager->receive_key = (uint8_t*) allocate_function( allocator_context, NETCODE_KEY_BYTES * max_encryption_mappings );
+    encryption_manager->address_buckets = (int*) allocate_function( allocator_context, sizeof( int ) * num_buckets );
+    encryption_manager->address_map.num_buckets = num_buckets;
+
+    if ( !encryption_manager->timeout || 
+         !encryption_manager->expire_time || 
+         !encryption_manager->last_access_time || 
+         !encryption_manager->address || 
+         !encryption_manager->client_index || 
+         !encryption_manager->send_key || 
+         !encryption_manager->receive_key || 
+         !encryption_manager->address_buckets )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: failed to allocate encryption manager\n" );
+        netcode_encryption_manager_destroy( encryption_manager );
+        return NETCODE_ERROR;
+    }
+
+    netcode_encryption_manager_reset( encryption_manager );
+
+    return NETCODE_OK;
+}
+
+void netcode_encryption_manager_reset( struct netcode_encryption_manager_t * encryption_manager )
+{
+    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "reset encryption manager\n" );
+
+    netcode_assert( encryption_manager );
+
+    encryption_manager->num_encryption_mappings = 0;
+    
+    int i;
+    for ( i = 0; i < encryption_manager->max_encryption_mappings; ++i )
+    {
+        encryption_manager->client_index[i] = -1;
+        encryption_manager->expire_time[i] = -1.0;
+        encryption_manager->last_access_time[i] = -1000.0;
+        memset( &encryption_manager->address[i], 0, sizeof( struct netcode_address_t ) );
+    }
+
+    memset( encryption_manager->timeout, 0, sizeof( int ) * encryption_manager->max_encryption_mappings );    
+    memset( encryption_manager->send_key, 0, NETCODE_KEY_BYTES * encryption_manager->max_encryption_mappings );
+    memset( encryption_manager->receive_key, 0, NETCODE_KEY_BYTES * encryption_manager->max_encryption_mappings );
+
+    netcode_address_map_reset( &encryption_manager->address_map, encryption_manager->address_buckets, encryption_manager->address_map.num_buckets );
+}
+
+int netcode_encryption_manager_entry_expired( struct netcode_encryption_manager_t * encryption_manager, int index, double time )
+{
+    return ( encryption_manager->timeout[index] > 0 && ( encryption_manager->last_access_time[index] + encryption_manager->timeout[index] ) < time ) ||
+           ( encryption_manager->expire_time[index] >= 0.0 && encryption_manager->expire_time[index] < time );
+}
+
+int netcode_encryption_manager_find_live_mapping( struct netcode_encryption_manager_t * encryption_manager, struct netcode_address_t * address, double time )
+{
+    // the same address can have expired mappings alongside the live one. prefer the lowest index, like a linear scan would
+
+    int result = -1;
+    int iterator = -1;
+    while ( 1 )
+    {
+        int index = netcode_address_map_find( &encryption_manager->address_map, encryption_manager->address, address, &iterator );
+        if ( index == -1 )
+            break;
+        if ( ( result == -1 || index < result ) && !netcode_encryption_manager_entry_expired( encryption_manager, index, time ) )
+            result = index;
+    }
+    return result;
+}
+
+int netcode_encryption_manager_add_encryption_mapping( struct netcode_encryption_manager_t * encryption_manager, 
+                                                       struct netcode_address_t * address, 
+                                                       uint8_t * send_key, 
+                                                       uint8_t * receive_key, 
+                                                       double time, 
+                                                       double expire_time,
+                                                       int timeout )
+{
+    int i = netcode_encryption_manager_find_live_mapping( encryption_manager, address, time );
+    if ( i != -1 )
+    {
+        encryption_manager->timeout[i] = timeout;
+        encryption_manager->expire_time[i] = expire_time;
+        encryption_manager->last_access_time[i] = time;
+        memcpy( encryption_manager->send_key + i * NETCODE_KEY_BYTES, send_key, NETCODE_KEY_BYTES );
+        memcpy( encryption_manager->receive_key + i * NETCODE_KEY_BYTES, receive_key, NETCODE_KEY_BYTES );
+        return 1;
+    }
+
+    for ( i = 0; i < encryption_manager->max_encryption_mappings; ++i )
+    {
+        if ( encryption_manager->address[i].type == NETCODE_ADDRESS_NONE || 
+        	( netcode_encryption_manager_entry_expired( encryption_manager, i, time ) && encryption_manager->client_index[i] == -1 ) )
+        {
+            netcode_address_map_remove( &encryption_manager->address_map, encryption_manager->address, i );
+            encryption_manager->timeout[i] = timeout;
+            encryption_manager->address[i] = *address;
+            netcode_address_map_insert( &encryption_manager->address_map, encryption_manager->address, i );
+            encryption_manager->expire_time[i] = expire_time;
+            encryption_manager->last_access_time[i] = time;
+            memcpy( encryption_manager->send_key + i * NETCODE_KEY_BYTES, send_key, NETCODE_KEY_BYTES );
+            memcpy( encryption_manager->receive_key + i * NETCODE_KEY_BYTES, receive_key, NETCODE_KEY_BYTES );
+            if ( i + 1 > encryption_manager->num_encryption_mappings )
+                encryption_manager->num_encryption_mappings = i + 1;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int netcode_encryption_manager_remove_encryption_mapping( struct netcode_encryption_manager_t * encryption_manager, struct netcode_address_t * address, double time )
+{
+    netcode_assert( encryption_manager );
+    netcode_assert( address );
+
+    int i = -1;
+    int iterator = -1;
+    while ( 1 )
+    {
+        int index = netcode_address_map_find( &encryption_manager->address_map, encryption_manager->address, address, &iterator );
+        if ( index == -1 )
+            break;
+        if ( i == -1 || index < i )
+            i = index;
+    }
+
+    if ( i != -1 )
+    {
+        encryption_manager->expire_time[i] = -1.0;
+        encryption_manager->last_access_time[i] = -1000.0;
+        netcode_address_map_remove( &encryption_manager->address_map, encryption_manager->address, i );
+        memset( &encryption_manager->address[i], 0, sizeof( struct netcode_address_t ) );
+        memset( encryption_manager->send_key + i * NETCODE_KEY_BYTES, 0, NETCODE_KEY_BYTES );
+        memset( encryption_manager->receive_key + i * NETCODE_KEY_BYTES, 0, NETCODE_KEY_BYTES );
+
+        if ( i + 1 == encryption_manager->num_encryption_mappings )
+        {
+            int index = i - 1;
+            while ( index >= 0 )
+            {
+                if ( !netcode_encryption_manager_entry_expired( encryption_manager, index, time ) || encryption_manager->client_index[index] != -1 )
+                {
+                    break;
+                }
+                netcode_address_map_remove( &encryption_manager->address_map, encryption_manager->address, index );
+                encryption_manager->address[index].type = NETCODE_ADDRESS_NONE;
+                index--;
+            }
+            encryption_manager->num_encryption_mappings = index + 1;
+        }
+
+        return 1;
+    }
+
+    return 0;
+}
+
+int netcode_encryption_manager_find_encryption_mapping( struct netcode_encryption_manager_t * encryption_manager, struct netcode_address_t * address, double time )
+{
+    int i = netcode_encryption_manager_find_live_mapping( encryption_manager, address, time );
+    if ( i != -1 )
+    {
+        encryption_manager->last_access_time[i] = time;
+    }
+    return i;
+}
+
+int netcode_encryption_manager_touch( struct netcode_encryption_manager_t * encryption_manager, int index, struct netcode_address_t * address, double time )
+{
+    netcode_assert( index >= 0 );
+    netcode_assert( index < encryption_manager->num_encryption_mappings );
+    if ( !netcode_address_equal( &encryption_manager->address[index], address ) )
+        return 0;
+    encryption_manager->last_access_time[index] = time;
+    return 1;
+}
+
+void netcode_encryption_manager_set_address( struct netcode_encryption_manager_t * encryption_manager, int index, struct netcode_address_t * address )
+{
+    netcode_assert( index >= 0 );
+    netcode_assert( index < encryption_manager->num_encryption_mappings );
+    netcode_assert( address );
+    netcode_address_map_remove( &encryption_manager->address_map, encryption_manager->address, index );
+    encryption_manager->address[index] = *address;
+    netcode_address_map_insert( &encryption_manager->address_map, encryption_manager->address, index );
+}
+
+void netcode_encryption_manager_set_expire_time( struct netcode_encryption_manager_t * encryption_manager, int index, double expire_time )
+{
+    netcode_assert( index >= 0 );
+    netcode_assert( index < encryption_manager->num_encryption_mappings );
+    encryption_manager->expire_time[index] = expire_time;
+}
+
+
+uint8_t * netcode_encryption_manager_get_send_key( struct netcode_encryption_manager_t * encryption_manager, int index )
+{
+    netcode_assert( encryption_manager );
+    if ( index == -1 )
+        return NULL;
+    netcode_assert( index >= 0 );
+    netcode_assert( index < encryption_manager->num_encryption_mappings );
+    return encryption_manager->send_key + index * NETCODE_KEY_BYTES;
+}
+
+uint8_t * netcode_encryption_manager_get_receive_key( struct netcode_encryption_manager_t * encryption_manager, int index )
+{
+    netcode_assert( encryption_manager );
+    if ( index == -1 )
+        return NULL;
+    netcode_assert( index >= 0 );
+    netcode_assert( index < encryption_manager->num_encryption_mappings );
+    return encryption_manager->receive_key + index * NETCODE_KEY_BYTES;
+}
+
+int netcode_encryption_manager_get_timeout( struct netcode_encryption_manager_t * encryption_manager, int index )
+{
+    netcode_assert( encryption_manager );
+    if ( index == -1 )
+        return 0;
+    netcode_assert( index >= 0 );
+    netcode_assert( index < encryption_manager->num_encryption_mappings );
+    return encryption_manager->timeout[index];
+}
+
+// ----------------------------------------------------------------
+
+#define NETCODE_CONNECT_TOKEN_ENTRIES_PER_CLIENT 8
+
+struct netcode_connect_token_entry_t
+{
+    double time;
+    uint8_t mac[NETCODE_MAC_BYTES];
+    struct netcode_address_t address;
+};
+
+void netcode_connect_token_entries_reset( struct netcode_connect_token_entry_t * connect_token_entries, int num_connect_token_entries )
+{
+    int i;
+    for ( i = 0; i < num_connect_token_entries; ++i )
+    {
+        connect_token_entries[i].time = -1000.0;
+        memset( connect_token_entries[i].mac, 0, NETCODE_MAC_BYTES );
+        memset( &connect_token_entries[i].address, 0, sizeof( struct netcode_address_t ) );
+    }
+}
+
+int netcode_connect_token_entries_find_or_add( struct netcode_connect_token_entry_t * connect_token_entries, 
+                                               int num_connect_token_entries, 
+                                               struct netcode_address_t * address, 
+                                               uint8_t * mac, 
+                                               double time )
+{
+    netcode_assert( connect_token_entries );
+    netcode_assert( address );
+    netcode_assert( mac );
+
+    // find the matching entry for the token mac and the oldest token entry. constant time worst case. This is intentional!
+
+    int matching_token_index = -1;
+    int oldest_token_index = -1;
+    double oldest_token_time = 0.0;
+
+    int i;
+    for ( i = 0; i < num_connect_token_entries; ++i )
+    {
+        if ( memcmp( mac, connect_token_entries[i].mac, NETCODE_MAC_BYTES ) == 0 )
+            matching_token_index = i;
+        
+        if ( oldest_token_index == -1 || connect_token_entries[i].time < oldest_token_time )
+        {
+            oldest_token_time = connect_token_entries[i].time;
+            oldest_token_index = i;
+        }
+    }
+
+    // if no entry is found with the mac, this is a new connect token. replace the oldest token entry.
+
+    netcode_assert( oldest_token_index != -1 );
+
+    if ( matching_token_index == -1 )
+    {
+        connect_token_entries[oldest_token_index].time = time;
+        connect_token_entries[oldest_token_index].address = *address;
+        memcpy( connect_token_entries[oldest_token_index].mac, mac, NETCODE_MAC_BYTES );
+        return 1;
+    }
+
+    // allow connect tokens we have already seen from the same address
+
+    netcode_assert( matching_token_index >= 0 );
+    netcode_assert( matching_token_index < num_connect_token_entries );
+    if ( netcode_address_equal( &connect_token_entries[matching_token_index].address, address ) )
+        return 1;
+
+    return 0;
+}
+
+#define NETCODE_CONNECT_TOKEN_TABLE_EMPTY -1
+
+struct netcode_connect_token_table_t
+{
+    int scan;
+    int num_entries;
+    int next_entry;
+    struct netcode_connect_token_entry_t * entries;
+    uint64_t seed;
+    int num_buckets;
+    int * buckets;
+    void * allocator_context;
+    void (*free_function)(void*,void*);
+};
+
+void netcode_connect_token_table_reset( struct netcode_connect_token_table_t * table );
+
+void netcode_connect_token_table_destroy( struct netcode_connect_token_table_t * table )
+{
+    netcode_assert( table );
+
+    if ( table->free_function )
+    {
+        if ( table->entries )
+            table->free_function( table->allocator_context, table->entries );
+        if ( table->buckets )
+            table->free_function( table->allocator_context, table->buckets );
+    }
+
+    memset( table, 0, sizeof( struct netcode_connect_token_table_t ) );
+}
+
+int netcode_connect_token_table_create( struct netcode_connect_token_table_t * table, 
+                                        int num_entries, 
+                                        void * allocator_context, 
+                                        void * (*allocate_function)(void*,size_t), 
+                                        void (*free_function)(void*,void*) )
+{
+    netcode_assert( table );
+    netcode_assert( num_entries > 0 );
+
+    if ( allocate_function == NULL )
+    {
+        allocate_function = netcode_default_allocate_function;
+    }
+
+    if ( free_function == NULL )
+    {
+        free_function = netcode_default_free_function;
+    }
+
+    memset( table, 0, sizeof( struct netcode_connect_token_table_t ) );
+
+    table->num_entries = num_entries;
+    table->num_buckets = netcode_address_map_num_buckets( num_entries );
+    table->allocator_context = allocator_context;
+    table->free_function = free_function;
+    table->entries = (struct netcode_connect_token_entry_t*) allocate_function( allocator_context, sizeof( struct netcode_connect_token_entry_t ) * num_entries );
+    table->buckets = (int*) allocate_function( allocator_context, sizeof( int ) * table->num_buckets );
+
+    if ( !table->entries || !table->buckets )
+    {
+        netcode_connect_token_table_destroy( table );
+        return NETCODE_ERROR;
+    }
+
+    netcode_connect_token_table_reset( table );
+
+    return NETCODE_OK;
+}
+
+void netcode_connect_token_table_reset( struct netcode_connect_token_table_t * table )
+{
+    netcode_assert( table );
+
+    netcode_connect_token_entries_reset( table->entries, table->num_entries );
+
+    netcode_random_bytes( (uint8_t*) &table->seed, sizeof( table->seed ) );
+
+    table->next_entry = 0;
+
+    int i;
+    for ( i = 0; i < table->num_buckets; ++i )
+        table->buckets[i] = NETCODE_CONNECT_TOKEN_TABLE_EMPTY;
+}
+
+int netcode_connect_token_table_home( struct netcode_connect_token_table_t * table, uint8_t * mac )
+{
+    // macs are poly1305 tags of tokens only the backend can make, but the seed keeps the buckets unpredictable anyway
+
+    uint64_t key;
+    memcpy( &key, mac, sizeof( key ) );
+    return (int) ( netcode_address_map_mix( key ^ table->seed ) & (uint64_t) ( table->num_buckets - 1 ) );
+}
+
+int netcode_connect_token_table_find( struct netcode_connect_token_table_t * table, uint8_t * mac )
+{
+    const int mask = table->num_buckets - 1;
+    int bucket = netcode_connect_token_table_home( table, mac );
+    while ( table->buckets[bucket] != NETCODE_CONNECT_TOKEN_TABLE_EMPTY )
+    {
+        const int index = table->buckets[bucket];
+        if ( memcmp( table->entries[index].mac, mac, NETCODE_MAC_BYTES ) == 0 )
+            return index;
+        bucket = ( bucket + 1 ) & mask;
+    }
+    return -1;
+}
+
+void netcode_connect_token_table_remove( struct netcode_connect_token_table_t * table, int index )
+{
+    const int mask = table->num_buckets - 1;
+    int hole = netcode_connect_token_table_home( table, table->entries[index].mac );
+    while ( table->buckets[hole] != index )
+    {
+        if ( table->buckets[hole] == NETCODE_CONNECT_TOKEN_TABLE_EMPTY )
+            return;
+        hole = ( hole + 1 ) & mask;
+    }
+
+    // backward shift deletion, the same as the address map
+
+    int next = ( hole + 1 ) & mask;
+    while ( table->buckets[next] != NETCODE_CONNECT_TOKEN_TABLE_EMPTY )
+    {
+        const int home = netcode_connect_token_table_home( table, table->entries[table->buckets[next]].mac );
+        if ( ( ( next - home ) & mask ) >= ( ( next - hole ) & mask ) )
+        {
+            table->buckets[hole] = table->buckets[next];
+            hole = next;
+        }
+        next = ( next + 1 ) & mask;
+    }
+
+    table->buckets[hole] = NETCODE_CONNECT_TOKEN_TABLE_EMPTY;
+}
+
+void netcode_connect_token_table_insert( struct netcode_connect_token_table_t * table, int index )
+{
+    const int mask = table->num_buckets - 1;
+    int bucket = netcode_connect_token_table_home( table, table->entries[index].mac );
+    while ( table->buckets[bucket] != NETCODE_CONNECT_TOKEN_TABLE_EMPTY )
+        bucket = ( bucket + 1 ) & mask;
+    table->buckets[bucket] = index;
+}
+
+int netcode_connect_token_table_find_or_add( struct netcode_connect_token_table_t * table, 
+                                             struct netcode_address_t * address, 
+                                             uint8_t * mac, 
+                                             double time )
+{
+    netcode_assert( table );
+    netcode_assert( address );
+    netcode_assert( mac );
+
+    if ( table->scan )
+        return netcode_connect_token_entries_find_or_add( table->entries, table->num_entries, address, mac, time );
+
+    // same answers as the scan, but the mac is looked up in a hash index. entries are replaced in the order they
+    // were added, which is the oldest entry the scan would pick, since entries are stamped with the time they were added
+
+    const int matching_token_index = netcode_connect_token_table_find( table, mac );
+
+    if ( matching_token_index == -1 )
+    {
+        const int index = table->next_entry;
+
+        table->next_entry = ( table->next_entry + 1 ) % table->num_entries;
+
+        struct netcode_connect_token_entry_t * entry = &table->entries[index];
+
+        if ( entry->address.type != NETCODE_ADDRESS_NONE )
+            netcode_connect_token_table_remove( table, index );
+
+        entry->time = time;
+        entry->address = *address;
+        memcpy( entry->mac, mac, NETCODE_MAC_BYTES );
+
+        netcode_connect_token_table_insert( table, index );
+
+        return 1;
+    }
+
+    // allow connect tokens we have already seen from the same address
+
+    return netcode_address_equal( &table->entries[matching_token_index].address, address );
+}
+
+// ----------------------------------------------------------------
+
+#define NETCODE_SESSION_TICKET_ENTRIES_PER_CLIENT 8
+
+#define NETCODE_SESSION_TICKET_TABLE_EMPTY -1
+
+struct netcode_session_ticket_table_t
+{
+    int num_entries;
+    int next_entry;
+    uint64_t * sequence;
+    double * expire_time;
+    uint64_t seed;
+    int num_buckets;
+    int * buckets;
+    void * allocator_context;
+    void (*free_function)(void*,void*);
+};
+
+void netcode_session_ticket_table_reset( struct netcode_session_ticket_table_t * table );
+
+void netcode_session_ticket_table_destroy( struct netcode_session_ticket_table_t * table )
+{
+    netcode_assert( table );
+
+    if ( table->free_function )
+    {
+        if ( table->sequence )
+            table->free_function( table->allocator_context, table->sequence );
+        if ( table->expire_time )
+            table->free_function( table->allocator_context, table->expire_time );
+        if ( table->buckets )
+            table->free_function( table->allocator_context, table->buckets );
+    }
+
+    memset( table, 0, sizeof( struct netcode_session_ticket_table_t ) );
+}
+
+int netcode_session_ticket_table_create( struct netcode_session_ticket_table_t * table, 
+                                         int num_entries, 
+                                         void * allocator_context, 
+                                         void * (*allocate_function)(void*,size_t), 
+                                         void (*free_function)(void*,void*) )
+{
+    netcode_assert( table );
+    netcode_assert( num_entries > 0 );
+
+    if ( allocate_function == NULL )
+    {
+        allocate_function = netcode_default_allocate_function;
+    }
+
+    if ( free_function == NULL )
+    {
+        free_function = netcode_default_free_function;
+    }
+
+    memset( table, 0, sizeof( struct netcode_session_ticket_table_t ) );
+
+    table->num_entries = num_entries;
+    table->num_buckets = netcode_address_map_num_buckets( num_entries );
+    table->allocator_context = allocator_context;
+    table->free_function = free_function;
+    table->sequence = (uint64_t*) allocate_function( allocator_context, sizeof( uint64_t ) * num_entries );
+    table->expire_time = (double*) allocate_function( allocator_context, sizeof( double ) * num_entries );
+    table->buckets = (int*) allocate_function( allocator_context, sizeof( int ) * table->num_buckets );
+
+    if ( !table->sequence || !table->expire_time || !table->buckets )
+    {
+        netcode_session_ticket_table_destroy( table );
+        return NETCODE_ERROR;
+    }
+
+    netcode_session_ticket_table_reset( table );
+
+    return NETCODE_OK;
+}
+
+void netcode_session_ticket_table_reset( struct netcode_session_ticket_table_t * table )
+{
+    netcode_assert( table );
+
+    netcode_random_bytes( (uint8_t*) &table->seed, sizeof( table->seed ) );
+
+    table->next_entry = 0;
+
+    int i;
+    for ( i = 0; i < table->num_entries; ++i )
+    {
+        table->sequence[i] = 0;
+        table->expire_time[i] = -1.0;
+    }
+
+    for ( i = 0; i < table->num_buckets; ++i )
+        table->buckets[i] = NETCODE_SESSION_TICKET_TABLE_EMPTY;
+}
+
+int netcode_session_ticket_table_home( struct netcode_session_ticket_table_t * table, uint64_t sequence )
+{
+    return (int) ( netcode_address_map_mix( sequence ^ table->seed ) & (uint64_t) ( table->num_buckets - 1 ) );
+}
+
+int netcode_session_ticket_table_find( struct netcode_session_ticket_table_t * table, uint64_t sequence )
+{
+    const int mask = table->num_buckets - 1;
+    int bucket = netcode_session_ticket_table_home( table, sequence );
+    while ( table->buckets[bucket] != NETCODE_SESSION_TICKET_TABLE_EMPTY )
+    {
+        const int index = table->buckets[bucket];
+        if ( table->sequence[index] == sequence )
+            return index;
+        bucket = ( bucket + 1 ) & mask;
+    }
+    return -1;
+}
+
+void netcode_session_ticket_table_remove( struct netcode_session_ticket_table_t * table, int index )
+{
+    const int mask = table->num_buckets - 1;
+    int hole = netcode_session_ticket_table_home( table, table->sequence[index] );
+    while ( table->buckets[hole] != index )
+    {
+        if ( table->buckets[hole] == NETCODE_SESSION_TICKET_TABLE_EMPTY )
+            return;
+        hole = ( hole + 1 ) & mask;
+    }
+
+    // backward shift deletion, the same as the address map
+
+    int next = ( hole + 1 ) & mask;
+    while ( table->buckets[next] != NETCODE_SESSION_TICKET_TABLE_EMPTY )
+    {
+        const int home = netcode_session_ticket_table_home( table, table->sequence[table->buckets[next]] );
+        if ( ( ( next - home ) & mask ) >= ( ( next - hole ) & mask ) )
+        {
+            table->buckets[hole] = table->buckets[next];
+            hole = next;
+        }
+        next = ( next + 1 ) & mask;
+    }
+
+    table->buckets[hole] = NETCODE_SESSION_TICKET_TABLE_EMPTY;
+}
+
+int netcode_session_ticket_table_spent( struct netcode_session_ticket_table_t * table, uint64_t sequence, double time )
+{
+    netcode_assert( table );
+
+    const int index = netcode_session_ticket_table_find( table, sequence );
+
+    return index != -1 && table->expire_time[index] > time;
+}
+
+int netcode_session_ticket_table_full( struct netcode_session_ticket_table_t * table, double time )
+{
+    netcode_assert( table );
+
+    // entries all live for the same time, so they expire in the order they were added. the next one to be
+    // replaced is the oldest, and the table is full while it still holds a ticket that hasn't expired
+
+    return table->expire_time[table->next_entry] > time;
+}
+
+int netcode_session_ticket_table_add( struct netcode_session_ticket_table_t * table, uint64_t sequence, double time, double expire_time )
+{
+    netcode_assert( table );
+
+    if ( netcode_session_ticket_table_full( table, time ) )
+        return NETCODE_ERROR;
+
+    const int index = table->next_entry;
+
+    table->next_entry = ( table->next_entry + 1 ) % table->num_entries;
+
+    if ( table->expire_time[index] >= 0.0 )
+        netcode_session_ticket_table_remove( table, index );
+
+    table->sequence[index] = sequence;
+    table->expire_time[index] = expire_time;
+
+    const int mask = table->num_buckets - 1;
+    int bucket = netcode_session_ticket_table_home( table, sequence );
+    while ( table->buckets[bucket] != NETCODE_SESSION_TICKET_TABLE_EMPTY )
+        bucket = ( bucket + 1 ) & mask;
+    table->buckets[bucket] = index;
+
+    return NETCODE_OK;
+}
+
+// ----------------------------------------------------------------
+
+#if NETCODE_PLATFORM == NETCODE_PLATFORM_WINDOWS
+
+typedef CRITICAL_SECTION netcode_mutex_t;
+
+void netcode_mutex_create( netcode_mutex_t * mutex )
+{
+    InitializeCriticalSection( mutex );
+}
+
+void netcode_mutex_destroy( netcode_mutex_t * mutex )
+{
+    DeleteCriticalSection( mutex );
+}
+
+void netcode_mutex_lock( netcode_mutex_t * mutex )
+{
+    EnterCriticalSection( mutex );
+}
+
+void netcode_mutex_unlock( netcode_mutex_t * mutex )
+{
+    LeaveCriticalSection( mutex );
+}
+
+typedef CONDITION_VARIABLE netcode_condition_t;
+
+void netcode_condition_create( netcode_condition_t * condition )
+{
+    InitializeConditionVariable( condition );
+}
+
+void netcode_condition_destroy( netcode_condition_t * condition )
+{
+    (void) condition;
+}
+
+void netcode_condition_wait( netcode_condition_t * condition, netcode_mutex_t * mutex )
+{
+    SleepConditionVariableCS( condition, mutex, INFINITE );
+}
+
+void netcode_condition_signal( netcode_condition_t * condition )
+{
+    WakeConditionVariable( condition );
+}
+
+typedef HANDLE netcode_thread_t;
+
+struct netcode_thread_start_t
+{
+    void (*function)(void*);
+    void * context;
+};
+
+static DWORD WINAPI netcode_thread_start( LPVOID param )
+{
+    struct netcode_thread_start_t * start = (struct netcode_thread_start_t*) param;
+    void (*function)(void*) = start->function;
+    void * context = start->context;
+    free( start );
+    function( context );
+    return 0;
+}
+
+int netcode_thread_create( netcode_thread_t * thread, void (*function)(void*), void * context )
+{
+    struct netcode_thread_start_t * start = (struct netcode_thread_start_t*) malloc( sizeof( struct netcode_thread_start_t ) );
+    if ( !start )
+        return NETCODE_ERROR;
+    start->function = function;
+    start->context = context;
+    *thread = CreateThread( NULL, 0, netcode_thread_start, start, 0, NULL );
+    if ( *thread == NULL )
+    {
+        free( start );
+        return NETCODE_ERROR;
+    }
+    return NETCODE_OK;
+}
+
+void netcode_thread_join( netcode_thread_t * thread )
+{
+    WaitForSingleObject( *thread, INFINITE );
+    CloseHandle( *thread );
+}
+
+#else // #if NETCODE_PLATFORM == NETCODE_PLATFORM_WINDOWS
+
+typedef pthread_mutex_t netcode_mutex_t;
+
+void netcode_mutex_create( netcode_mutex_t * mutex )
+{
+    pthread_mutex_init( mutex, NULL );
+}
+
+void netcode_mutex_destroy( netcode_mutex_t * mutex )
+{
+    pthread_mutex_destroy( mutex );
+}
+
+void netcode_mutex_lock( netcode_mutex_t * mutex )
+{
+    pthread_mutex_lock( mutex );
+}
+
+void netcode_mutex_unlock( netcode_mutex_t * mutex )
+{
+    pthread_mutex_unlock( mutex );
+}
+
+typedef pthread_cond_t netcode_condition_t;
+
+void netcode_condition_create( netcode_condition_t * condition )
+{
+    pthread_cond_init( condition, NULL );
+}
+
+void netcode_condition_destroy( netcode_condition_t * condition )
+{
+    pthread_cond_destroy( condition );
+}
+
+void netcode_condition_wait( netcode_condition_t * condition, netcode_mutex_t * mutex )
+{
+    pthread_cond_wait( condition, mutex );
+}
+
+void netcode_condition_signal( netcode_condition_t * condition )
+{
+    pthread_cond_signal( condition );
+}
+
+typedef pthread_t netcode_thread_t;
+
+struct netcode_thread_start_t
+{
+    void (*function)(void*);
+    void * context;
+};
+
+static void * netcode_thread_start( void * param )
+{
+    struct netcode_thread_start_t * start = (struct netcode_thread_start_t*) param;
+    void (*function)(void*) = start->function;
+    void * context = start->context;
+    free( start );
+    function( context );
+    return NULL;
+}
+
+int netcode_thread_create( netcode_thread_t * thread, void (*function)(void*), void * context )
+{
+    struct netcode_thread_start_t * start = (struct netcode_thread_start_t*) malloc( sizeof( struct netcode_thread_start_t ) );
+    if ( !start )
+        return NETCODE_ERROR;
+    start->function = function;
+    start->context = context;
+    if ( pthread_create( thread, NULL, netcode_thread_start, start ) != 0 )
+    {
+        free( start );
+        return NETCODE_ERROR;
+    }
+    return NETCODE_OK;
+}
+
+void netcode_thread_join( netcode_thread_t * thread )
+{
+    pthread_join( *thread, NULL );
+}
+
+#endif // #if NETCODE_PLATFORM == NETCODE_PLATFORM_WINDOWS
+
+// ----------------------------------------------------------------
+
+#define NETCODE_HANDSHAKE_RESULT_NONE           0
+#define NETCODE_HANDSHAKE_RESULT_REQUEST        1
+#define NETCODE_HANDSHAKE_RESULT_RESPONSE       2
+
+struct netcode_handshake_job_t
+{
+    struct netcode_address_t from;
+    int encryption_index;
+    uint8_t read_packet_key[NETCODE_KEY_BYTES];
+    int packet_bytes;
+    uint8_t packet_data[NETCODE_MAX_PACKET_BYTES];
+    union
+    {
+        struct netcode_connection_request_packet_t request;
+        struct netcode_connection_response_packet_t response;
+    } packet;
+    int result;
+    struct netcode_connect_token_private_t connect_token_private;
+    uint8_t connect_token_mac[NETCODE_MAC_BYTES];
+    struct netcode_challenge_token_t challenge_token;
+};
+
+struct netcode_handshake_queue_t
+{
+    // jobs in [head,processed) are done and wait for the game thread, jobs in [processed,tail) wait for the worker.
+    // only the game thread moves head and tail, only the worker moves processed, and both read them under the mutex
+
+    netcode_mutex_t mutex;
+    netcode_condition_t job_added;
+    netcode_condition_t job_done;
+    netcode_thread_t thread;
+    int quit;
+    uint64_t head;
+    uint64_t processed;
+    uint64_t tail;
+    uint64_t packet_sequence;
+    struct netcode_handshake_job_t jobs[NETCODE_HANDSHAKE_QUEUE_SIZE];
+};
+
+// ----------------------------------------------------------------
+
+struct netcode_admission_bucket_t
+{
+    struct netcode_address_t address;
+    double last_time;
+    double tokens;
+};
+
+// ----------------------------------------------------------------
+
+struct netcode_server_shard_client_t
+{
+    uint64_t client_id;
+    void * owner;
+};
+
+struct netcode_server_shard_group_t
+{
+    void * allocator_context;
+    void * (*allocate_function)(void*,size_t);
+    void (*free_function)(void*,void*);
+    netcode_mutex_t mutex;
+    int max_clients;
+    struct netcode_server_shard_client_t * clients;
+    struct netcode_connect_token_table_t connect_token_table;
+};
+
+struct netcode_server_shard_group_t * netcode_server_shard_group_create( int max_clients, 
+                                                                         void * allocator_context, 
+                                                                         void * (*allocate_function)(void*,size_t), 
+                                                                         void (*free_function)(void*,void*) )
+{
+    netcode_assert( max_clients > 0 );
+
+    if ( allocate_function == NULL )
+    {
+        allocate_function = netcode_default_allocate_function;
+    }
+
+    if ( free_function == NULL )
+    {
+        free_function = netcode_default_free_function;
+    }
+
+    struct netcode_server_shard_group_t * group = (struct netcode_server_shard_group_t*) 
+        allocate_function( allocator_context, sizeof( struct netcode_server_shard_group_t ) );
+    if ( !group )
+        return NULL;
+
+    memset( group, 0, sizeof( struct netcode_server_shard_group_t ) );
+
+    group->allocator_context = allocator_context;
+    group->allocate_function = allocate_function;
+    group->free_function = free_function;
+    group->max_clients = max_clients;
+    group->clients = (struct netcode_server_shard_client_t*) allocate_function( allocator_context, sizeof( struct netcode_server_shard_client_t ) * max_clients );
+
+    if ( !group->clients || 
+         netcode_connect_token_table_create( &group->connect_token_table, 
+                                             max_clients * NETCODE_CONNECT_TOKEN_ENTRIES_PER_CLIENT, 
+                                             allocator_context, 
+                                             allocate_function, 
+                                             free_function ) != NETCODE_OK )
+    {
+        if ( group->clients )
+            free_function( allocator_context, group->clients );
+        free_function( allocator_context, group );
+        return NULL;
+    }
+
+    memset( group->clients, 0, sizeof( struct netcode_server_shard_client_t ) * max_clients );
+
+    netcode_mutex_create( &group->mutex );
+
+    return group;
+}
+
+void netcode_server_shard_group_destroy( struct netcode_server_shard_group_t * group )
+{
+    netcode_assert( group );
+
+    netcode_mutex_destroy( &group->mutex );
+
+    group->free_function( group->allocator_context, group->clients );
+    netcode_connect_token_table_destroy( &group->connect_token_table );
+    group->free_function( group->allocator_context, group );
+}
+
+int netcode_server_shard_group_connect_token_find_or_add( struct netcode_server_shard_group_t * group, 
+                                                          struct netcode_address_t * address, 
+                                                          uint8_t * mac, 
+                                                          double time )
+{
+    netcode_assert( group );
+
+    netcode_mutex_lock( &group->mutex );
+
+    int result = netcode_connect_token_table_find_or_add( &group->connect_token_table, address, mac, time );
+
+    netcode_mutex_unlock( &group->mutex );
+
+    return result;
+}
+
+int netcode_server_shard_group_find_client_id_internal( struct netcode_server_shard_group_t * group, uint64_t client_id )
+{
+    int i;
+    for ( i = 0; i < group->max_clients; ++i )
+    {
+        if ( group->clients[i].owner && group->clients[i].client_id == client_id )
+            return i;
+    }
+    return -1;
+}
+
+int netcode_server_shard_group_client_id_connected( struct netcode_server_shard_group_t * group, uint64_t client_id, void * owner )
+{
+    netcode_assert( group );
+    netcode_assert( owner );
+
+    netcode_mutex_lock( &group->mutex );
+
+    int index = netcode_server_shard_group_find_client_id_internal( group, client_id );
+
+    int result = index != -1 && group->clients[index].owner != owner;
+
+    netcode_mutex_unlock( &group->mutex );
+
+    return result;
+}
+
+int netcode_server_shard_group_claim_client_id( struct netcode_server_shard_group_t * group, uint64_t client_id, void * owner )
+{
+    netcode_assert( group );
+    netcode_assert( owner );
+
+    // IMPORTANT: check and claim under one lock, otherwise two shards can both accept the same client id
+
+    netcode_mutex_lock( &group->mutex );
+
+    int result = 0;
+
+    if ( netcode_server_shard_group_find_client_id_internal( group, client_id ) == -1 )
+    {
+        int i;
+        for ( i = 0; i < group->max_clients; ++i )
+        {
+            if ( !group->clients[i].owner )
+            {
+                group->clients[i].client_id = client_id;
+                group->clients[i].owner = owner;
+                result = 1;
+                break;
+            }
+        }
+    }
+
+    netcode_mutex_unlock( &group->mutex );
+
+    return result;
+}
+
+void netcode_server_shard_group_release_client_id( struct netcode_server_shard_group_t * group, uint64_t client_id, void * owner )
+{
+    netcode_assert( group );
+    netcode_assert( owner );
+
+    netcode_mutex_lock( &group->mutex );
+
+    int index = netcode_server_shard_group_find_client_id_internal( group, client_id );
+    if ( index != -1 && group->clients[index].owner == owner )
+    {
+        group->clients[index].client_id = 0;
+        group->clients[index].owner = NULL;
+    }
+
+    netcode_mutex_unlock( &group->mutex );
+}
+
+// ----------------------------------------------------------------
+
+#define NETCODE_SERVER_FLAG_IGNORE_CONNECTION_REQUEST_PACKETS       1
+#define NETCODE_SERVER_FLAG_IGNORE_CONNECTION_RESPONSE_PACKETS      (1<<1)
+
+void netcode_default_server_config( struct netcode_server_config_t * config )
+{
+    netcode_assert( config );
+    config->allocator_context = NULL;
+    config->allocate_function = netcode_default_allocate_function;
+    config->free_function = netcode_default_free_function;
+    config->network_simulator = NULL;
+    config->callback_context = NULL;
+    config->connect_disconnect_callback = NULL;
+    config->send_loopback_packet_callback = NULL;
+    config->override_send_and_receive = 0;
+    config->send_packet_override = NULL;
+    config->aux_receive_packet = NULL;
+    config->aux_send_packet = NULL;
+    config->receive_packet_override = NULL;
+    config->auxiliary_command_function = NULL;
+    config->auxiliary_command_context = NULL;
+    config->batch_socket_io = 1;
+    config->max_clients = NETCODE_MAX_CLIENTS;
+    config->shard_group = NULL;
+    config->io_uring_socket_io = 0;
+    config->udp_offload = 0;
+    config->cipher_suite = NETCODE_CIPHER_SUITE_CHACHA20_POLY1305;
+    config->handshake_thread = 0;
+    config->admission_control = 1;
+    config->max_connection_requests_per_second = 0;
+    config->connect_token_scan = 0;
+    config->adaptive_handshake = 0;
+    config->session_ticket_seconds = 0;
+    config->connection_ids = 0;
+};
+
+struct netcode_server_t
+{
+    struct netcode_server_config_t config;
+    struct netcode_socket_holder_t socket_holder;
+    struct netcode_address_t address;
+    uint32_t flags;
+    double time;
+    int running;
+    int max_clients;
+    int num_connected_clients;
+    uint64_t global_sequence;
+    uint64_t challenge_sequence;
+    uint8_t challenge_key[NETCODE_KEY_BYTES];
+    int * client_connected;
+    int * client_timeout;
+    int * client_loopback;
+    int * client_confirmed;
+    int * client_encryption_index;
+    int * client_cipher_suite;
+    struct netcode_packet_cipher_t * client_write_packet_cipher;
+    struct netcode_packet_cipher_t * client_read_packet_cipher;
+    uint64_t * client_id;
+    uint64_t * client_sequence;
+    double * client_last_packet_send_time;
+    double * client_last_packet_receive_time;
+    uint8_t (*client_user_data)[NETCODE_USER_DATA_BYTES];
+    struct netcode_replay_protection_t * client_replay_protection;
+    struct netcode_packet_queue_t * client_packet_queue;
+    struct netcode_address_t * client_address;
+    int * client_address_buckets;
+    struct netcode_address_map_t client_address_map;
+    struct netcode_connect_token_table_t connect_token_table;
+    struct netcode_encryption_manager_t encryption_manager;
+    int max_receive_packets;
+    uint8_t ** receive_packet_data;
+    int * receive_packet_bytes;
+    struct netcode_address_t * receive_from;
+    uint64_t counters[NETCODE_SERVER_NUM_COUNTERS];
+    struct netcode_packet_pool_t packet_pool;
+    uint8_t * receive_buffer;
+#if NETCODE_SOCKET_BATCHING
+    struct netcode_socket_receive_batch_t receive_batch;
+    struct netcode_socket_batch_t send_batch_ipv4;
+    struct netcode_socket_batch_t send_batch_ipv6;
+#endif // #if NETCODE_SOCKET_BATCHING
+#if NETCODE_IO_URING
+    struct netcode_io_uring_t * io_uring_ipv4;
+    struct netcode_io_uring_t * io_uring_ipv6;
+#endif // #if NETCODE_IO_URING
+#if NETCODE_UDP_OFFLOAD
+    int udp_offload;
+    struct netcode_socket_coalesced_batch_t * coalesced_receive_batch;
+#endif // #if NETCODE_UDP_OFFLOAD
+    struct netcode_handshake_queue_t * handshake_queue;
+    struct netcode_admission_bucket_t * admission_buckets;
+    uint64_t admission_seed;
+    double connection_request_tokens;
+    double connection_request_time;
+    double * client_session_ticket_time;
+    uint64_t * client_connection_id;
+    uint64_t session_ticket_sequence;
+    uint64_t session_ticket_first_sequence;
+    struct netcode_session_ticket_table_t session_ticket_table;
+};
+
+int netcode_server_socket_create( struct netcode_socket_t * socket,
+                                  struct netcode_address_t * address,
+                                  int send_buffer_size,
+                                  int receive_buffer_size,
+                                  NETCODE_CONST struct netcode_server_config_t * config )
+{
+    netcode_assert( socket );
+    netcode_assert( address );
+    netcode_assert( config );
+
+    if ( !config->network_simulator )
+    {
+        if ( !config->override_send_and_receive )
+        {
+            if ( netcode_socket_create( socket, address, send_buffer_size, receive_buffer_size, config->shard_group != NULL ) != NETCODE_SOCKET_ERROR_NONE )
+            {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+void netcode_server_free_table( struct netcode_server_t * server, void * table )
+{
+    // tables may be missing when allocation failed part way through create
+
+    if ( table )
+        server->config.free_function( server->config.allocator_context, table );
+}
+
+void netcode_server_free_client_tables( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    netcode_server_free_table( server, server->client_connected );
+    netcode_server_free_table( server, server->client_timeout );
+    netcode_server_free_table( server, server->client_loopback );
+    netcode_server_free_table( server, server->client_confirmed );
+    netcode_server_free_table( server, server->client_encryption_index );
+    netcode_server_free_table( server, server->client_cipher_suite );
+    netcode_server_free_table( server, server->client_write_packet_cipher );
+    netcode_server_free_table( server, server->client_read_packet_cipher );
+    netcode_server_free_table( server, server->client_id );
+    netcode_server_free_table( server, server->client_sequence );
+    netcode_server_free_table( server, server->client_last_packet_send_time );
+    netcode_server_free_table( server, server->client_last_packet_receive_time );
+    netcode_server_free_table( server, server->client_user_data );
+    netcode_server_free_table( server, server->client_replay_protection );
+    netcode_server_free_table( server, server->client_packet_queue );
+    netcode_server_free_table( server, server->client_address );
+    netcode_server_free_table( server, server->client_address_buckets );
+    netcode_connect_token_table_destroy( &server->connect_token_table );
+    netcode_session_ticket_table_destroy( &server->session_ticket_table );
+    netcode_server_free_table( server, server->receive_packet_data );
+    netcode_server_free_table( server, server->receive_packet_bytes );
+    netcode_server_free_table( server, server->receive_from );
+    netcode_server_free_table( server, server->admission_buckets );
+    netcode_server_free_table( server, server->client_session_ticket_time );
+    netcode_server_free_table( server, server->client_connection_id );
+
+    netcode_encryption_manager_destroy( &server->encryption_manager );
+}
+
+int netcode_server_allocate_client_tables( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    // per-client state is sized by config.max_clients so servers can go past NETCODE_MAX_CLIENTS,
+    // and servers that need fewer slots don't pay for the default capacity
+
+    void * allocator_context = server->config.allocator_context;
+    void * (*allocate_function)(void*,size_t) = server->config.allocate_function;
+
+    const int max_clients = server->config.max_clients;
+
+    server->client_connected = (int*) allocate_function( allocator_context, sizeof( int ) * max_clients );
+    server->client_timeout = (int*) allocate_function( allocator_context, sizeof( int ) * max_clients );
+    server->client_loopback = (int*) allocate_function( allocator_context, sizeof( int ) * max_clients );
+    server->client_confirmed = (int*) allocate_function( allocator_context, sizeof( int ) * max_clients );
+    server->client_encryption_index = (int*) allocate_function( allocator_context, sizeof( int ) * max_clients );
+    server->client_cipher_suite = (int*) allocate_function( allocator_context, sizeof( int ) * max_clients );
+    server->client_id = (uint64_t*) allocate_function( allocator_context, sizeof( uint64_t ) * max_clients );
+    server->client_sequence = (uint64_t*) allocate_function( allocator_context, sizeof( uint64_t ) * max_clients );
+    server->client_last_packet_send_time = (double*) allocate_function( allocator_context, sizeof( double ) * max_clients );
+    server->client_last_packet_receive_time = (double*) allocate_function( allocator_context, sizeof( double ) * max_clients );
+    server->client_user_data = (uint8_t(*)[NETCODE_USER_DATA_BYTES]) allocate_function( allocator_context, NETCODE_USER_DATA_BYTES * max_clients );
+    server->client_replay_protection = (struct netcode_replay_protection_t*) allocate_function( allocator_context, sizeof( struct netcode_replay_protection_t ) * max_clients );
+    server->client_packet_queue = (struct netcode_packet_queue_t*) allocate_function( allocator_context, sizeof( struct netcode_packet_queue_t ) * max_clients );
+    server->client_address = (struct netcode_address_t*) allocate_function( allocator_context, sizeof( struct netcode_address_t ) * max_clients );
+    server->client_session_ticket_time = (double*) allocate_function( allocator_context, sizeof( double ) * max_clients );
+    server->client_connection_id = (uint64_t*) allocate_function( allocator_context, sizeof( uint64_t ) * max_clients );
+
+    const int num_client_address_buckets = netcode_address_map_num_buckets( max_clients );
+    server->client_address_buckets = (int*) allocate_function( allocator_context, sizeof( int ) * num_client_address_buckets );
+    server->client_address_map.num_buckets = num_client_address_buckets;
+
+    if ( netcode_connect_token_table_create( &server->connect_token_table, 
+                                             max_clients * NETCODE_CONNECT_TOKEN_ENTRIES_PER_CLIENT, 
+                                             allocator_context, 
+                                             allocate_function, 
+                                             server->config.free_function ) != NETCODE_OK )
+    {
+        return 0;
+    }
+
+    server->connect_token_table.scan = server->config.connect_token_scan;
+
+    if ( netcode_session_ticket_table_create( &server->session_ticket_table, 
+                                              max_clients * NETCODE_SESSION_TICKET_ENTRIES_PER_CLIENT, 
+                                              allocator_context, 
+                                              allocate_function, 
+                                              server->config.free_function ) != NETCODE_OK )
+    {
+        return 0;
+    }
+
+    if ( server->config.cipher_suite != NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 )
+    {
+        // expanded aes keys are large, so only servers that can negotiate another cipher suite pay for them
+
+        server->client_write_packet_cipher = (struct netcode_packet_cipher_t*) allocate_function( allocator_context, sizeof( struct netcode_packet_cipher_t ) * max_clients );
+        server->client_read_packet_cipher = (struct netcode_packet_cipher_t*) allocate_function( allocator_context, sizeof( struct netcode_packet_cipher_t ) * max_clients );
+        if ( !server->client_write_packet_cipher || !server->client_read_packet_cipher )
+            return 0;
+    }
+
+    if ( server->config.admission_control )
+    {
+        server->admission_buckets = (struct netcode_admission_bucket_t*) allocate_function( allocator_context, sizeof( struct netcode_admission_bucket_t ) * NETCODE_ADMISSION_ADDRESS_BUCKETS );
+        if ( !server->admission_buckets )
+            return 0;
+    }
+
+    if ( server->config.network_simulator )
+    {
+        server->max_receive_packets = max_clients * NETCODE_SERVER_RECEIVE_PACKETS_PER_CLIENT;
+        server->receive_packet_data = (uint8_t**) allocate_function( allocator_context, sizeof( uint8_t* ) * server->max_receive_packets );
+        server->receive_packet_bytes = (int*) allocate_function( allocator_context, sizeof( int ) * server->max_receive_packets );
+        server->receive_from = (struct netcode_address_t*) allocate_function( allocator_context, sizeof( struct netcode_address_t ) * server->max_receive_packets );
+        if ( !server->receive_packet_data || !server->receive_packet_bytes || !server->receive_from )
+            return 0;
+    }
+
+    if ( netcode_encryption_manager_create( &server->encryption_manager, 
+                                            max_clients * NETCODE_ENCRYPTION_MAPPINGS_PER_CLIENT, 
+                                            allocator_context, 
+                                            allocate_function, 
+                                            server->config.free_function ) != NETCODE_OK )
+    {
+        return 0;
+    }
+
+    return server->client_connected && 
+           server->client_timeout && 
+           server->client_loopback && 
+           server->client_confirmed && 
+           server->client_encryption_index && 
+           server->client_cipher_suite && 
+           server->client_id && 
+           server->client_sequence && 
+           server->client_last_packet_send_time && 
+           server->client_last_packet_receive_time && 
+           server->client_user_data && 
+           server->client_replay_protection && 
+           server->client_packet_queue && 
+           server->client_address && 
+           server->client_address_buckets && 
+           server->client_session_ticket_time && 
+           server->client_connection_id;
+}
+
+#if NETCODE_IO_URING
+
+void netcode_server_destroy_io_uring( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    if ( server->io_uring_ipv4 )
+    {
+        netcode_io_uring_destroy( server->io_uring_ipv4 );
+        server->io_uring_ipv4 = NULL;
+    }
+
+    if ( server->io_uring_ipv6 )
+    {
+        netcode_io_uring_destroy( server->io_uring_ipv6 );
+        server->io_uring_ipv6 = NULL;
+    }
+}
+
+#endif // #if NETCODE_IO_URING
+
+int netcode_server_io_uring_active( struct netcode_server_t * server );
+
+#if NETCODE_UDP_OFFLOAD
+
+void netcode_server_enable_udp_offload( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    struct netcode_socket_t * sockets[2] = { &server->socket_holder.ipv4, &server->socket_holder.ipv6 };
+
+    int supported = 1;
+
+    int i;
+    for ( i = 0; i < 2; ++i )
+    {
+        if ( sockets[i]->handle != 0 && !netcode_socket_udp_offload_supported( sockets[i] ) )
+            supported = 0;
+    }
+
+    if ( supported )
+    {
+        server->coalesced_receive_batch = (struct netcode_socket_coalesced_batch_t*) 
+            server->config.allocate_function( server->config.allocator_context, sizeof( struct netcode_socket_coalesced_batch_t ) );
+
+        supported = server->coalesced_receive_batch != NULL;
+    }
+
+    for ( i = 0; i < 2 && supported; ++i )
+    {
+        if ( sockets[i]->handle != 0 && netcode_socket_set_udp_gro( sockets[i], 1 ) != NETCODE_OK )
+            supported = 0;
+    }
+
+    if ( !supported )
+    {
+        // IMPORTANT: coalesced datagrams don't fit the regular receive batch, so receive coalescing must be off on every socket
+
+        netcode_printf( NETCODE_LOG_LEVEL_INFO, "server could not enable udp offload. falling back to batched socket io\n" );
+
+        for ( i = 0; i < 2; ++i )
+        {
+            if ( sockets[i]->handle != 0 )
+                netcode_socket_set_udp_gro( sockets[i], 0 );
+        }
+
+        if ( server->coalesced_receive_batch )
+        {
+            server->config.free_function( server->config.allocator_context, server->coalesced_receive_batch );
+            server->coalesced_receive_batch = NULL;
+        }
+
+        return;
+    }
+
+    server->udp_offload = 1;
+}
+
+#endif // #if NETCODE_UDP_OFFLOAD
+
+int netcode_server_create_handshake_queue( struct netcode_server_t * server );
+
+void netcode_server_destroy_handshake_queue( struct netcode_server_t * server );
+
+void netcode_server_discard_handshakes( struct netcode_server_t * server );
+
+void netcode_server_reset_admission( struct netcode_server_t * server );
+
+struct netcode_server_t * netcode_server_create_overload( NETCODE_CONST char * server_address1_string, NETCODE_CONST char * server_address2_string, NETCODE_CONST struct netcode_server_config_t * config, double time )
+{
+    netcode_assert( config );
+    netcode_assert( netcode.initialized );
+
+    if ( config->max_clients <= 0 )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: server config max clients must be greater than zero\n" );
+        return NULL;
+    }
+
+    struct netcode_address_t server_address1;
+    struct netcode_address_t server_address2;
+
+    memset( &server_address1, 0, sizeof( server_address1 ) );
+    memset( &server_address2, 0, sizeof( server_address2 ) );
+
+    if ( netcode_parse_address( server_address1_string, &server_address1 ) != NETCODE_OK )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: failed to parse server public address\n" );
+        return NULL;
+    }
+
+    if ( server_address2_string != NULL && netcode_parse_address( server_address2_string, &server_address2 ) != NETCODE_OK )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: failed to parse server public address2\n" );
+        return NULL;
+    }
+
+    if ( config->shard_group && ( server_address1.port == 0 || ( server_address2.type != NETCODE_ADDRESS_NONE && server_address2.port == 0 ) ) )
+    {
+        // every shard has to bind the same port, so an ephemeral port can't work
+
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: sharded server must bind an explicit port\n" );
+        return NULL;
+    }
+
+    if ( config->shard_group && config->connect_token_scan )
+    {
+        // shards share one replay table, so any shard asking for the constant time scan switches the whole group over
+
+        netcode_mutex_lock( &config->shard_group->mutex );
+        config->shard_group->connect_token_table.scan = 1;
+        netcode_mutex_unlock( &config->shard_group->mutex );
+    }
+
+    struct netcode_address_t bind_address_ipv4;
+    struct netcode_address_t bind_address_ipv6;
+
+    memset( &bind_address_ipv4, 0, sizeof( bind_address_ipv4 ) );
+    memset( &bind_address_ipv6, 0, sizeof( bind_address_ipv6 ) );
+
+    struct netcode_socket_t socket_ipv4;
+    struct netcode_socket_t socket_ipv6;
+
+    memset( &socket_ipv4, 0, sizeof( socket_ipv4 ) );
+    memset( &socket_ipv6, 0, sizeof( socket_ipv6 ) );
+
+    if ( server_address1.type == NETCODE_ADDRESS_IPV4 || server_address2.type == NETCODE_ADDRESS_IPV4 )
+    {
+        bind_address_ipv4.type = NETCODE_ADDRESS_IPV4;
+        bind_address_ipv4.port = server_address1.type == NETCODE_ADDRESS_IPV4 ? server_address1.port : server_address2.port;
+
+        if ( !netcode_server_socket_create( &socket_ipv4, &bind_address_ipv4, NETCODE_SERVER_SOCKET_SNDBUF_SIZE, NETCODE_SERVER_SOCKET_RCVBUF_SIZE, config ) )
+        {
+            return NULL;
+        }
+    }
+
+    if ( server_address1.type == NETCODE_ADDRESS_IPV6 || server_address2.type == NETCODE_ADDRESS_IPV6 )
+    {
+        bind_address_ipv6.type = NETCODE_ADDRESS_IPV6;
+        bind_address_ipv6.port = server_address1.type == NETCODE_ADDRESS_IPV6 ? server_address1.port : server_address2.port;
+
+        if ( !netcode_server_socket_create( &socket_ipv6, &bind_address_ipv6, NETCODE_SERVER_SOCKET_SNDBUF_SIZE, NETCODE_SERVER_SOCKET_RCVBUF_SIZE, config ) )
+        {
+            return NULL;
+        }
+    }
+
+    struct netcode_server_t * server = (struct netcode_server_t*) config->allocate_function( config->allocator_context, sizeof( struct netcode_server_t ) );
+    if ( !server )
+    {
+        netcode_socket_destroy( &socket_ipv4 );
+        netcode_socket_destroy( &socket_ipv6 );
+        return NULL;
+    }
+
+    memset( server, 0, sizeof( struct netcode_server_t ) );
+
+    server->config = *config;
+
+    if ( !netcode_server_allocate_client_tables( server ) )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: failed to allocate server client tables\n" );
+        netcode_server_free_client_tables( server );
+        netcode_socket_destroy( &socket_ipv4 );
+        netcode_socket_destroy( &socket_ipv6 );
+        config->free_function( config->allocator_context, server );
+        return NULL;
+    }
+
+    if ( !config->network_simulator )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_INFO, "server listening on %s\n", server_address1_string );
+    }
+    else
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_INFO, "server listening on %s (network simulator)\n", server_address1_string );
+    }
+
+    server->socket_holder.ipv4 = socket_ipv4;
+    server->socket_holder.ipv6 = socket_ipv6;
+    server->address = server_address1;
+    server->flags = 0;
+    server->time = time;
+    server->running = 0;
+    server->max_clients = 0;
+    server->num_connected_clients = 0;
+    server->global_sequence = 1ULL << 63;
+
+    const int max_clients = config->max_clients;
+
+    memset( server->client_connected, 0, sizeof( int ) * max_clients );
+    memset( server->client_timeout, 0, sizeof( int ) * max_clients );
+    memset( server->client_loopback, 0, sizeof( int ) * max_clients );
+    memset( server->client_confirmed, 0, sizeof( int ) * max_clients );
+    memset( server->client_cipher_suite, 0, sizeof( int ) * max_clients );
+    memset( server->client_id, 0, sizeof( uint64_t ) * max_clients );
+    memset( server->client_sequence, 0, sizeof( uint64_t ) * max_clients );
+    memset( server->client_last_packet_send_time, 0, sizeof( double ) * max_clients );
+    memset( server->client_last_packet_receive_time, 0, sizeof( double ) * max_clients );
+    memset( server->client_address, 0, sizeof( struct netcode_address_t ) * max_clients );
+    memset( server->client_user_data, 0, NETCODE_USER_DATA_BYTES * max_clients );
+    memset( server->client_session_ticket_time, 0, sizeof( double ) * max_clients );
+    memset( server->client_connection_id, 0, sizeof( uint64_t ) * max_clients );
+
+    int i;
+    for ( i = 0; i < max_clients; ++i )
+        server->client_encryption_index[i] = -1;
+
+    netcode_address_map_reset( &server->client_address_map, server->client_address_buckets, server->client_address_map.num_buckets );
+
+    netcode_connect_token_table_reset( &server->connect_token_table );
+
+    for ( i = 0; i < max_clients; ++i )
+        netcode_replay_protection_reset( &server->client_replay_protection[i] );
+
+    memset( server->client_packet_queue, 0, sizeof( struct netcode_packet_queue_t ) * max_clients );
+
+    memset( server->counters, 0, sizeof( server->counters ) );
+
+    netcode_server_reset_admission( server );
+
+    netcode_packet_pool_init( &server->packet_pool, config->allocator_context, config->allocate_function, config->free_function );
+
+    server->receive_buffer = NULL;
+
+#if NETCODE_SOCKET_BATCHING
+    memset( &server->receive_batch, 0, sizeof( server->receive_batch ) );
+    server->send_batch_ipv4.num_packets = 0;
+    server->send_batch_ipv6.num_packets = 0;
+#endif // #if NETCODE_SOCKET_BATCHING
+
+#if NETCODE_IO_URING
+    if ( config->io_uring_socket_io && config->batch_socket_io && !config->network_simulator && !config->override_send_and_receive )
+    {
+        // io_uring is optional. if the kernel doesn't support it, or it is disabled, keep using recvmmsg/sendmmsg
+
+        if ( socket_ipv4.handle != 0 )
+            server->io_uring_ipv4 = netcode_io_uring_create( &socket_ipv4, config->allocator_context, config->allocate_function, config->free_function );
+
+        if ( socket_ipv6.handle != 0 )
+            server->io_uring_ipv6 = netcode_io_uring_create( &socket_ipv6, config->allocator_context, config->allocate_function, config->free_function );
+
+        if ( ( socket_ipv4.handle != 0 && !server->io_uring_ipv4 ) || ( socket_ipv6.handle != 0 && !server->io_uring_ipv6 ) )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_INFO, "server could not create io_uring. falling back to batched socket io\n" );
+            netcode_server_destroy_io_uring( server );
+        }
+    }
+#endif // #if NETCODE_IO_URING
+
+#if NETCODE_UDP_OFFLOAD
+    if ( config->udp_offload && config->batch_socket_io && !config->network_simulator && !config->override_send_and_receive && !netcode_server_io_uring_active( server ) )
+    {
+        netcode_server_enable_udp_offload( server );
+    }
+#endif // #if NETCODE_UDP_OFFLOAD
+
+    if ( config->handshake_thread && netcode_server_create_handshake_queue( server ) != NETCODE_OK )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_INFO, "server could not create handshake thread. processing connection handshakes inline\n" );
+    }
+
+    return server;
+}
+
+struct netcode_server_t * netcode_server_create( NETCODE_CONST char * server_address_string, NETCODE_CONST struct netcode_server_config_t * config, double time )
+{
+    return netcode_server_create_overload( server_address_string, NULL, config, time );
+}
+
+void netcode_server_stop( struct netcode_server_t * server );
+
+void netcode_server_destroy( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    netcode_server_stop( server );
+
+    netcode_server_destroy_handshake_queue( server );
+
+    netcode_server_flush_packets( server );
+
+#if NETCODE_IO_URING
+    netcode_server_destroy_io_uring( server );
+#endif // #if NETCODE_IO_URING
+
+#if NETCODE_UDP_OFFLOAD
+    if ( server->coalesced_receive_batch )
+    {
+        server->config.free_function( server->config.allocator_context, server->coalesced_receive_batch );
+    }
+#endif // #if NETCODE_UDP_OFFLOAD
+
+    netcode_socket_destroy( &server->socket_holder.ipv4 );
+    netcode_socket_destroy( &server->socket_holder.ipv6 );
+
+    netcode_server_free_client_tables( server );
+
+    if ( server->receive_buffer )
+        netcode_packet_pool_free( &server->packet_pool, server->receive_buffer );
+
+#if NETCODE_SOCKET_BATCHING
+    int i;
+    for ( i = 0; i < NETCODE_SOCKET_BATCH_SIZE; ++i )
+    {
+        if ( server->receive_batch.packet_data[i] )
+            netcode_packet_pool_free( &server->packet_pool, server->receive_batch.packet_data[i] );
+    }
+#endif // #if NETCODE_SOCKET_BATCHING
+
+    netcode_packet_pool_destroy( &server->packet_pool );
+
+    server->config.free_function( server->config.allocator_context, server );
+}
+
+void netcode_server_start( struct netcode_server_t * server, int max_clients )
+{
+    netcode_assert( server );
+    netcode_assert( max_clients > 0 );
+    netcode_assert( max_clients <= server->config.max_clients );
+
+    if ( server->running )
+        netcode_server_stop( server );
+
+    netcode_printf( NETCODE_LOG_LEVEL_INFO, "server started with %d client slots\n", max_clients );
+
+    server->running = 1;
+    server->max_clients = max_clients;
+    server->num_connected_clients = 0;
+    server->challenge_sequence = 0;    
+    netcode_generate_key( server->challenge_key );
+
+    // session tickets are redeemed at most once. their sequence is seeded from the wall clock so it keeps
+    // moving forward when the server is restarted with the same private key, and tickets from before are refused
+
+    server->session_ticket_sequence = ( (uint64_t) time( NULL ) ) << 20;
+    server->session_ticket_first_sequence = server->session_ticket_sequence;
+    netcode_session_ticket_table_reset( &server->session_ticket_table );
+
+    int i;
+    for ( i = 0; i < server->max_clients; ++i )
+    {
+        netcode_packet_queue_init( &server->client_packet_queue[i], &server->packet_pool, netcode_packet_pool_allocate, netcode_packet_pool_free );
+    }
+}
+
+#if NETCODE_SOCKET_BATCHING
+
+void netcode_server_flush_send_batch( struct netcode_server_t * server, struct netcode_socket_t * socket, struct netcode_socket_batch_t * batch )
+{
+    netcode_assert( server );
+    netcode_assert( socket );
+    netcode_assert( batch );
+
+    int num_packets_sent = 0;
+
+#if NETCODE_IO_URING
+    struct netcode_io_uring_t * ring = ( socket == &server->socket_holder.ipv6 ) ? server->io_uring_ipv6 : server->io_uring_ipv4;
+#endif // #if NETCODE_IO_URING
+
+    while ( num_packets_sent < batch->num_packets )
+    {
+        int result;
+#if NETCODE_IO_URING
+        if ( ring )
+            result = netcode_io_uring_send_packets( ring, batch, num_packets_sent );
+        else
+#endif // #if NETCODE_IO_URING
+#if NETCODE_UDP_OFFLOAD
+        if ( server->udp_offload )
+            result = netcode_socket_send_packets_segmented( socket, batch, num_packets_sent );
+        else
+#endif // #if NETCODE_UDP_OFFLOAD
+            result = netcode_socket_send_packets( socket, batch, num_packets_sent );
+
+        server->counters[NETCODE_SERVER_COUNTER_NUM_SOCKET_SEND_CALLS]++;
+
+        if ( result <= 0 )
+        {
+            // IMPORTANT: the socket send buffer is full or the send failed. drop the rest, just like sendto would.
+            break;
+        }
+
+        num_packets_sent += result;
+    }
+
+    batch->num_packets = 0;
+}
+
+#endif // #if NETCODE_SOCKET_BATCHING
+
+void netcode_server_socket_send_packet( struct netcode_server_t * server, struct netcode_socket_t * socket, struct netcode_address_t * to, uint8_t * packet_data, int packet_bytes )
+{
+    netcode_assert( server );
+    netcode_assert( socket );
+    netcode_assert( to );
+    netcode_assert( packet_data );
+    netcode_assert( packet_bytes > 0 );
+    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_BYTES );
+
+    server->counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_SENT]++;
+
+#if NETCODE_SOCKET_BATCHING
+    if ( server->config.batch_socket_io )
+    {
+        struct netcode_socket_batch_t * batch = ( socket == &server->socket_holder.ipv6 ) ? &server->send_batch_ipv6 : &server->send_batch_ipv4;
+
+        if ( batch->num_packets == NETCODE_SOCKET_BATCH_SIZE )
+        {
+            netcode_server_flush_send_batch( server, socket, batch );
+        }
+
+        batch->address[batch->num_packets] = *to;
+        batch->packet_bytes[batch->num_packets] = packet_bytes;
+        memcpy( batch->packet_data[batch->num_packets], packet_data, packet_bytes );
+        batch->num_packets++;
+
+        return;
+    }
+#endif // #if NETCODE_SOCKET_BATCHING
+
+    netcode_socket_send_packet( socket, to, packet_data, packet_bytes );
+
+    server->counters[NETCODE_SERVER_COUNTER_NUM_SOCKET_SEND_CALLS]++;
+}
+
+void netcode_server_flush_packets( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+#if NETCODE_SOCKET_BATCHING
+    if ( server->send_batch_ipv4.num_packets > 0 )
+    {
+        netcode_server_flush_send_batch( server, &server->socket_holder.ipv4, &server->send_batch_ipv4 );
+    }
+
+    if ( server->send_batch_ipv6.num_packets > 0 )
+    {
+        netcode_server_flush_send_batch( server, &server->socket_holder.ipv6, &server->send_batch_ipv6 );
+    }
+#else // #if NETCODE_SOCKET_BATCHING
+    (void) server;
+#endif // #if NETCODE_SOCKET_BATCHING
+}
+
+NETCODE_CONST struct netcode_packet_cipher_t * netcode_server_client_write_packet_cipher( struct netcode_server_t * server, int client_index )
+{
+    if ( client_index == -1 || server->client_cipher_suite[client_index] == NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 )
+        return NULL;
+    return &server->client_write_packet_cipher[client_index];
+}
+
+NETCODE_CONST struct netcode_packet_cipher_t * netcode_server_client_read_packet_cipher( struct netcode_server_t * server, int client_index )
+{
+    if ( client_index == -1 || server->client_cipher_suite[client_index] == NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 )
+        return NULL;
+    return &server->client_read_packet_cipher[client_index];
+}
+
+void netcode_server_send_global_packet_data( struct netcode_server_t * server, struct netcode_address_t * to, uint8_t * packet_data, int packet_bytes )
+{
+    netcode_assert( server );
+    netcode_assert( to );
+    netcode_assert( packet_data );
+    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_BYTES );
+
+    if ( server->config.network_simulator )
+    {
+        netcode_network_simulator_send_packet( server->config.network_simulator, &server->address, to, packet_data, packet_bytes );
+    }
+    else
+    {
+        if ( server->config.override_send_and_receive )
+        {
+            server->config.send_packet_override( server->config.callback_context, to, packet_data, packet_bytes );
+        }
+        else if ( to->type == NETCODE_ADDRESS_IPV4 )
+        {
+            bool send_real_packet = true;
+
+            if ( server->config.aux_send_packet != NULL )
+            {
+                if ( server->config.aux_send_packet(server->config.callback_context, to, packet_data, packet_bytes ) )
+                {
+                    send_real_packet = false;
+                }
+            }
+
+            if ( send_real_packet )
+            {
+                netcode_server_socket_send_packet( server, &server->socket_holder.ipv4, to, packet_data, packet_bytes );
+            }
+        }
+        else if ( to->type == NETCODE_ADDRESS_IPV6 )
+        {
+            netcode_server_socket_send_packet( server, &server->socket_holder.ipv6, to, packet_data, packet_bytes );
+        }
+    }
+}
+
+void netcode_server_send_global_packet( struct netcode_server_t * server, void * packet, struct netcode_address_t * to, uint8_t * packet_key )
+{
+    netcode_assert( server );
+    netcode_assert( packet );
+    netcode_assert( to );
+    netcode_assert( packet_key );
+
+    uint8_t packet_data[NETCODE_MAX_PACKET_BYTES];
+
+    int packet_bytes = netcode_write_packet( packet, packet_data, NETCODE_MAX_PACKET_BYTES, server->global_sequence, packet_key, server->config.protocol_id, NULL );
+
+    netcode_server_send_global_packet_data( server, to, packet_data, packet_bytes );
+
+    server->global_sequence++;
+}
+
+void netcode_server_dispatch_client_packet_data( struct netcode_server_t * server, int client_index, uint8_t * packet_data, int packet_bytes )
+{
+    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_BYTES );
+
+    if ( server->config.network_simulator )
+    {
+        netcode_network_simulator_send_packet( server->config.network_simulator, &server->address, &server->client_address[client_index], packet_data, packet_bytes );
+    }
+    else
+    {
+        if ( server->config.override_send_and_receive )
+        {
+            server->config.send_packet_override( server->config.callback_context, &server->client_address[client_index], packet_data, packet_bytes );
+        }
+        else
+        {
+            if ( server->client_address[client_index].type == NETCODE_ADDRESS_IPV4 )
+            {
+                bool send_real_packet = true;
+
+                if ( server->config.aux_send_packet != NULL )
+                {
+                    if ( server->config.aux_send_packet(server->config.callback_context, &server->client_address[client_index], packet_data, packet_bytes ) )
+                    {
+                        send_real_packet = false;
+                    }
+                }
+
+                if ( send_real_packet )
+                {
+                    netcode_server_socket_send_packet( server, &server->socket_holder.ipv4, &server->client_address[client_index], packet_data, packet_bytes );
+                }
+            }
+            else if ( server->client_address[client_index].type == NETCODE_ADDRESS_IPV6 )
+            {
+                netcode_server_socket_send_packet( server, &server->socket_holder.ipv6, &server->client_address[client_index], packet_data, packet_bytes );
+            }
+        }
+    }
+}
+
+void netcode_server_send_client_packet_data( struct netcode_server_t * server, int client_index, uint8_t * packet_data, int packet_bytes )
+{
+    netcode_server_dispatch_client_packet_data( server, client_index, packet_data, packet_bytes );
+
+    server->client_sequence[client_index]++;
+
+    server->client_last_packet_send_time[client_index] = server->time;
+}
+
+void netcode_server_send_client_packet( struct netcode_server_t * server, void * packet, int client_index )
+{
+    netcode_assert( server );
+    netcode_assert( packet );
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    netcode_assert( server->client_connected[client_index] );
+    netcode_assert( !server->client_loopback[client_index] );
+
+    uint8_t packet_data[NETCODE_MAX_PACKET_BYTES];
+
+    if ( !netcode_encryption_manager_touch( &server->encryption_manager, 
+                                            server->client_encryption_index[client_index], 
+                                            &server->client_address[client_index], 
+                                            server->time ) )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: encryption mapping is out of date for client %d\n", client_index );
+        return;
+    }
+
+    uint8_t * packet_key = netcode_encryption_manager_get_send_key( &server->encryption_manager, server->client_encryption_index[client_index] );
+
+    int packet_bytes = netcode_write_packet( packet, packet_data, NETCODE_MAX_PACKET_BYTES, server->client_sequence[client_index], packet_key, server->config.protocol_id, netcode_server_client_write_packet_cipher( server, client_index ) );
+
+    netcode_server_send_client_packet_data( server, client_index, packet_data, packet_bytes );
+}
+
+void netcode_server_disconnect_client_internal( struct netcode_server_t * server, int client_index, int send_disconnect_packets )
+{
+    netcode_assert( server );
+    netcode_assert( server->running );
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    netcode_assert( server->client_connected[client_index] );
+    netcode_assert( !server->client_loopback[client_index] );
+    netcode_assert( server->encryption_manager.client_index[server->client_encryption_index[client_index]] == client_index );
+
+    netcode_printf( NETCODE_LOG_LEVEL_INFO, "server disconnected client %d\n", client_index );
+
+    if ( server->config.connect_disconnect_callback )
+    {
+        server->config.connect_disconnect_callback( server->config.callback_context, client_index, 0 );
+    }
+
+    (void)send_disconnect_packets;
+
+    while ( 1 )
+    {
+        void * packet = netcode_packet_queue_pop( &server->client_packet_queue[client_index], NULL );
+        if ( !packet )
+            break;
+        netcode_packet_pool_free( &server->packet_pool, packet );
+    }
+
+    netcode_packet_queue_clear( &server->client_packet_queue[client_index] );
+
+    netcode_replay_protection_reset( &server->client_replay_protection[client_index] );
+
+    server->encryption_manager.client_index[server->client_encryption_index[client_index]] = -1;
+
+    netcode_encryption_manager_remove_encryption_mapping( &server->encryption_manager, &server->client_address[client_index], server->time );
+
+    if ( server->config.shard_group )
+    {
+        netcode_server_shard_group_release_client_id( server->config.shard_group, server->client_id[client_index], server );
+    }
+
+    server->client_connected[client_index] = 0;
+    server->client_confirmed[client_index] = 0;
+    server->client_id[client_index] = 0;
+    server->client_sequence[client_index] = 0;
+    server->client_last_packet_send_time[client_index] = 0.0;
+    server->client_last_packet_receive_time[client_index] = 0.0;
+    server->client_session_ticket_time[client_index] = 0.0;
+    server->client_connection_id[client_index] = 0;
+    netcode_address_map_remove( &server->client_address_map, server->client_address, client_index );
+    memset( &server->client_address[client_index], 0, sizeof( struct netcode_address_t ) );
+    server->client_encryption_index[client_index] = -1;
+    server->client_cipher_suite[client_index] = NETCODE_CIPHER_SUITE_CHACHA20_POLY1305;
+    memset( server->client_user_data[client_index], 0, NETCODE_USER_DATA_BYTES );
+
+    server->num_connected_clients--;
+
+    netcode_assert( server->num_connected_clients >= 0 );
+}
+
+void netcode_server_disconnect_client( struct netcode_server_t * server, int client_index )
+{
+    netcode_assert( server );
+
+    if ( !server->running )
+        return;
+
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    netcode_assert( server->client_loopback[client_index] == 0 );
+
+    if ( !server->client_connected[client_index] )
+        return;
+
+    if ( server->client_loopback[client_index] )
+        return;
+
+    netcode_server_disconnect_client_internal( server, client_index, 1 );
+}
+
+void netcode_server_disconnect_all_clients( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    if ( !server->running )
+        return;
+
+    int i;
+    for ( i = 0; i < server->max_clients; ++i )
+    {
+        if ( server->client_connected[i] && !server->client_loopback[i] )
+        {
+            netcode_server_disconnect_client_internal( server, i, 1 );
+        }
+    }
+}
+
+void netcode_server_stop( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    if ( !server->running )
+        return;
+
+    netcode_server_discard_handshakes( server );
+
+    netcode_server_disconnect_all_clients( server );
+
+    server->running = 0;
+    server->max_clients = 0;
+    server->num_connected_clients = 0;
+
+    server->global_sequence = 0;
+    server->challenge_sequence = 0;
+    memset( server->challenge_key, 0, NETCODE_KEY_BYTES );
+
+    netcode_connect_token_table_reset( &server->connect_token_table );
+
+    netcode_encryption_manager_reset( &server->encryption_manager );
+
+    netcode_address_map_reset( &server->client_address_map, server->client_address_buckets, server->client_address_map.num_buckets );
+
+    netcode_printf( NETCODE_LOG_LEVEL_INFO, "server stopped\n" );
+}
+
+int netcode_server_find_client_index_by_id( struct netcode_server_t * server, uint64_t client_id )
+{
+    netcode_assert( server );
+
+    int i;
+    for ( i = 0; i < server->max_clients; ++i )
+    {   
+        if ( server->client_connected[i] && server->client_id[i] == client_id )
+            return i;
+    }
+
+    return -1;
+}
+
+int netcode_server_find_client_index_by_address( struct netcode_server_t * server, struct netcode_address_t * address )
+{
+    netcode_assert( server );
+    netcode_assert( address );
+
+    if ( address->type == 0 )
+        return -1;
+
+    int iterator = -1;
+    while ( 1 )
+    {
+        int i = netcode_address_map_find( &server->client_address_map, server->client_address, address, &iterator );
+        if ( i == -1 )
+            break;
+        if ( server->client_connected[i] )
+            return i;
+    }
+
+    return -1;
+}
+
+int netcode_server_find_client_index_by_connection_id( struct netcode_server_t * server, uint8_t * packet_data, int packet_bytes )
+{
+    netcode_assert( server );
+    netcode_assert( packet_data );
+
+    // only a hint for which key to try. the packet still has to decrypt with that client's key before anything trusts it
+
+    if ( !server->config.connection_ids || packet_bytes < 1 + NETCODE_CONNECTION_ID_BYTES || ( packet_data[0] & NETCODE_CONNECTION_ID_FLAG ) == 0 )
+        return -1;
+
+    const int packet_type = packet_data[0] & 0x7;
+    if ( packet_type != NETCODE_CONNECTION_KEEP_ALIVE_PACKET && packet_type != NETCODE_CONNECTION_PAYLOAD_PACKET && packet_type != NETCODE_CONNECTION_DISCONNECT_PACKET )
+        return -1;
+
+    uint8_t * p = packet_data + 1;
+    uint64_t connection_id = netcode_read_uint64( &p );
+
+    const uint32_t client_index = (uint32_t) ( connection_id & 0xFFFFFFFF );
+    if ( client_index >= (uint32_t) server->max_clients )
+        return -1;
+
+    if ( !server->client_connected[client_index] || server->client_loopback[client_index] || server->client_connection_id[client_index] != connection_id )
+        return -1;
+
+    return (int) client_index;
+}
+
+void netcode_server_migrate_client( struct netcode_server_t * server, int client_index, struct netcode_address_t * address )
+{
+    netcode_assert( server );
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    netcode_assert( server->client_connected[client_index] );
+    netcode_assert( address );
+
+    char old_address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+    char new_address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+    netcode_printf( NETCODE_LOG_LEVEL_INFO, "server migrated client %d from %s to %s\n", client_index, 
+        netcode_address_to_string( &server->client_address[client_index], old_address_string ), 
+        netcode_address_to_string( address, new_address_string ) );
+
+    while ( netcode_encryption_manager_remove_encryption_mapping( &server->encryption_manager, address, server->time ) ) {}
+
+    netcode_encryption_manager_set_address( &server->encryption_manager, server->client_encryption_index[client_index], address );
+
+    netcode_address_map_remove( &server->client_address_map, server->client_address, client_index );
+    server->client_address[client_index] = *address;
+    netcode_address_map_insert( &server->client_address_map, server->client_address, client_index );
+
+    server->counters[NETCODE_SERVER_COUNTER_NUM_CLIENTS_MIGRATED]++;
+}
+
+void netcode_server_reset_admission( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    if ( server->admission_buckets )
+    {
+        memset( server->admission_buckets, 0, sizeof( struct netcode_admission_bucket_t ) * NETCODE_ADMISSION_ADDRESS_BUCKETS );
+    }
+
+    netcode_random_bytes( (uint8_t*) &server->admission_seed, sizeof( server->admission_seed ) );
+
+    server->connection_request_tokens = server->config.max_connection_requests_per_second;
+    server->connection_request_time = server->time;
+}
+
+int netcode_server_admission_take_token( struct netcode_server_t * server, struct netcode_address_t * from )
+{
+    netcode_assert( server );
+    netcode_assert( server->admission_buckets );
+    netcode_assert( from );
+
+    // buckets are direct mapped. an address that collides with another takes the slot over with a full bucket,
+    // so spraying addresses can't starve anybody, and the global connection request cap bounds the total
+
+    const uint32_t hash = netcode_address_hash( server->admission_seed, from );
+
+    struct netcode_admission_bucket_t * bucket = &server->admission_buckets[hash % NETCODE_ADMISSION_ADDRESS_BUCKETS];
+
+    if ( !netcode_address_equal( &bucket->address, from ) )
+    {
+        bucket->address = *from;
+        bucket->last_time = server->time;
+        bucket->tokens = NETCODE_ADMISSION_PACKET_BURST;
+    }
+    else if ( server->time > bucket->last_time )
+    {
+        bucket->tokens += ( server->time - bucket->last_time ) * NETCODE_ADMISSION_PACKETS_PER_SECOND;
+        if ( bucket->tokens > NETCODE_ADMISSION_PACKET_BURST )
+            bucket->tokens = NETCODE_ADMISSION_PACKET_BURST;
+        bucket->last_time = server->time;
+    }
+
+    if ( bucket->tokens < 1.0 )
+        return 0;
+
+    bucket->tokens -= 1.0;
+
+    return 1;
+}
+
+int netcode_server_admission_take_connection_request_token( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    const double rate = server->config.max_connection_requests_per_second;
+
+    if ( rate <= 0.0 )
+        return 1;
+
+    if ( server->time > server->connection_request_time )
+    {
+        server->connection_request_tokens += ( server->time - server->connection_request_time ) * rate;
+        if ( server->connection_request_tokens > rate )
+            server->connection_request_tokens = rate;
+        server->connection_request_time = server->time;
+    }
+
+    if ( server->connection_request_tokens < 1.0 )
+        return 0;
+
+    server->connection_request_tokens -= 1.0;
+
+    return 1;
+}
+
+void netcode_server_resend_confirmation( struct netcode_server_t * server, int client_index )
+{
+    netcode_assert( server );
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+
+    // a connection response from a client we already connected means our keep-alive was lost. with the adaptive
+    // handshake, answer it right away instead of leaving the client to wait for the next regular keep-alive
+
+    if ( !server->config.adaptive_handshake || server->client_confirmed[client_index] || server->client_loopback[client_index] )
+        return;
+
+    if ( server->client_last_packet_send_time[client_index] + NETCODE_HANDSHAKE_RETRY_TIME > server->time )
+        return;
+
+    struct netcode_connection_keep_alive_packet_t keep_alive_packet;
+    keep_alive_packet.packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
+    keep_alive_packet.client_index = client_index;
+    keep_alive_packet.max_clients = server->max_clients;
+    netcode_server_send_client_packet( server, &keep_alive_packet, client_index );
+}
+
+int netcode_server_admit_packet( struct netcode_server_t * server,
+                                 struct netcode_address_t * from,
+                                 uint8_t * packet_data,
+                                 int packet_bytes,
+                                 int client_index,
+                                 int has_read_packet_key )
+{
+    netcode_assert( server );
+    netcode_assert( from );
+    netcode_assert( packet_data );
+
+    if ( packet_bytes < 1 )
+    {
+        server->counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_MALFORMED]++;
+        return 0;
+    }
+
+    // cheap checks that run before a packet is decrypted or queued for the handshake thread, so each packet in a flood
+    // costs a few compares and a hash lookup instead of an aead decrypt. returns 1 if the packet should be read
+
+    const int packet_type = packet_data[0] & 0xF & ~NETCODE_CONNECTION_ID_FLAG;
+    const int connection_id_bytes = ( packet_data[0] & NETCODE_CONNECTION_ID_FLAG ) ? NETCODE_CONNECTION_ID_BYTES : 0;
+
+    if ( !has_read_packet_key && packet_type != NETCODE_CONNECTION_REQUEST_PACKET )
+    {
+        char address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server could not process packet because no encryption mapping exists for %s\n", netcode_address_to_string( from, address_string ) );
+        server->counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_NO_MAPPING]++;
+        return 0;
+    }
+
+    if ( !server->config.admission_control )
+        return 1;
+
+    // the same size and prefix checks netcode_read_packet does, but counted
+
+    if ( packet_type == NETCODE_CONNECTION_REQUEST_PACKET && !connection_id_bytes )
+    {
+        if ( packet_bytes != 1 + NETCODE_VERSION_INFO_BYTES + 8 + 8 + NETCODE_CONNECT_TOKEN_NONCE_BYTES + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES ||
+             ( packet_data[0] >> 4 ) >= NETCODE_NUM_CIPHER_SUITES )
+        {
+            server->counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_MALFORMED]++;
+            return 0;
+        }
+    }
+    else
+    {
+        const int sequence_bytes = packet_data[0] >> 4;
+        if ( packet_type >= NETCODE_CONNECTION_NUM_PACKETS ||
+             ( connection_id_bytes && packet_type < NETCODE_CONNECTION_KEEP_ALIVE_PACKET ) ||
+             sequence_bytes < 1 || sequence_bytes > 8 ||
+             packet_bytes < 1 + connection_id_bytes + sequence_bytes + NETCODE_MAC_BYTES ||
+             packet_bytes > NETCODE_MAX_PACKET_BYTES )
+        {
+            server->counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_MALFORMED]++;
+            return 0;
+        }
+    }
+
+    // packets the server would decrypt only to ignore: handshake packets from connected clients,
+    // connected packets from addresses that aren't, and packet types only the server sends.
+    // a pending client may still disconnect, when it raced us against other servers and lost interest
+
+    const int handshake_packet = packet_type == NETCODE_CONNECTION_REQUEST_PACKET || packet_type == NETCODE_CONNECTION_RESPONSE_PACKET;
+    const int pending_disconnect = client_index == -1 && packet_type == NETCODE_CONNECTION_DISCONNECT_PACKET;
+
+    if ( packet_type == NETCODE_CONNECTION_DENIED_PACKET ||
+         packet_type == NETCODE_CONNECTION_CHALLENGE_PACKET ||
+         ( ( client_index != -1 ) == handshake_packet && !pending_disconnect ) )
+    {
+        if ( client_index != -1 && packet_type == NETCODE_CONNECTION_RESPONSE_PACKET )
+            netcode_server_resend_confirmation( server, client_index );
+
+        server->counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_UNEXPECTED]++;
+        return 0;
+    }
+
+    if ( client_index != -1 )
+        return 1;
+
+    if ( !netcode_server_admission_take_token( server, from ) )
+    {
+        server->counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_ADDRESS_RATE]++;
+        return 0;
+    }
+
+    if ( packet_type == NETCODE_CONNECTION_REQUEST_PACKET && !netcode_server_admission_take_connection_request_token( server ) )
+    {
+        server->counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_REQUEST_RATE]++;
+        return 0;
+    }
+
+    return 1;
+}
+
+int netcode_server_session_ticket_valid( struct netcode_server_t * server, struct netcode_connect_token_private_t * connect_token_private )
+{
+    netcode_assert( server );
+    netcode_assert( connect_token_private );
+    netcode_assert( connect_token_private->session_ticket );
+
+    // a session ticket is only good on a server that hands them out, and only once. it must also ask for the cipher
+    // suite this server negotiated for it, since the client resumes on that cipher suite without a challenge
+
+    if ( server->config.session_ticket_seconds <= 0 || server->config.shard_group )
+        return 0;
+
+    if ( connect_token_private->cipher_suite != NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 && 
+         ( connect_token_private->cipher_suite != server->config.cipher_suite || !netcode_cipher_suite_supported( connect_token_private->cipher_suite ) ) )
+    {
+        return 0;
+    }
+
+    // redeemed tickets are remembered until they would have expired anyway. if that many tickets were redeemed
+    // recently that there is no room to remember another, the client is sent back for a fresh connect token
+
+    if ( connect_token_private->session_ticket_sequence < server->session_ticket_first_sequence )
+        return 0;
+
+    if ( netcode_session_ticket_table_spent( &server->session_ticket_table, connect_token_private->session_ticket_sequence, server->time ) )
+        return 0;
+
+    return !netcode_session_ticket_table_full( &server->session_ticket_table, server->time );
+}
+
+int netcode_server_admit_connection_request( struct netcode_server_t * server, 
+                                             struct netcode_address_t * from, 
+                                             struct netcode_connect_token_private_t * connect_token_private, 
+                                             uint8_t * connect_token_mac )
+{
+    netcode_assert( server );
+    netcode_assert( from );
+    netcode_assert( connect_token_private );
+    netcode_assert( connect_token_mac );
+
+    // everything about a connection request that touches server state. returns NETCODE_OK if a challenge should be sent
+
+    if ( netcode_server_find_client_index_by_address( server, from ) != -1 )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection request. a client with this address is already connected\n" );
+        return NETCODE_ERROR;
+    }
+
+    if ( netcode_server_find_client_index_by_id( server, connect_token_private->client_id ) != -1 )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection request. a client with this id is already connected\n" );
+        return NETCODE_ERROR;
+    }
+
+    if ( server->config.shard_group && netcode_server_shard_group_client_id_connected( server->config.shard_group, connect_token_private->client_id, server ) )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection request. a client with this id is connected to another shard\n" );
+        return NETCODE_ERROR;
+    }
+
+    // IMPORTANT: shards share one replay table, otherwise a token replayed from another address
+    // would be accepted by whichever shard the kernel hashes the new address to
+
+    int connect_token_accepted = server->config.shard_group ? 
+        netcode_server_shard_group_connect_token_find_or_add( server->config.shard_group, from, connect_token_mac, server->time ) :
+        netcode_connect_token_table_find_or_add( &server->connect_token_table, from, connect_token_mac, server->time );
+
+    if ( !connect_token_accepted )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection request. connect token has already been used\n" );
+        return NETCODE_ERROR;
+    }
+
+    if ( connect_token_private->session_ticket && !netcode_server_session_ticket_valid( server, connect_token_private ) )
+    {
+        // deny instead of ignoring, so the client goes back for a fresh connect token right away
+
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server denied connection request. session ticket is spent or not accepted here\n" );
+
+        struct netcode_connection_denied_packet_t p;
+        p.packet_type = NETCODE_CONNECTION_DENIED_PACKET;
+        
+        netcode_server_send_global_packet( server, &p, from, connect_token_private->server_to_client_key );
+
+        return NETCODE_ERROR;
+    }
+
+    if ( server->num_connected_clients == server->max_clients )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server denied connection request. server is full\n" );
+
+        struct netcode_connection_denied_packet_t p;
+        p.packet_type = NETCODE_CONNECTION_DENIED_PACKET;
+        
+        netcode_server_send_global_packet( server, &p, from, connect_token_private->server_to_client_key );
+
+        return NETCODE_ERROR;
+    }
+
+    double expire_time = ( connect_token_private->timeout_seconds >= 0 ) ? server->time + connect_token_private->timeout_seconds : -1.0;
+
+    if ( !netcode_encryption_manager_add_encryption_mapping( &server->encryption_manager, 
+                                                             from, 
+                                                             connect_token_private->server_to_client_key, 
+                                                             connect_token_private->client_to_server_key, 
+                                                             server->time, 
+                                                             expire_time,
+                                                             connect_token_private->timeout_seconds ) )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection request. failed to add encryption mapping\n" );
+        return NETCODE_ERROR;
+    }
+
+    return NETCODE_OK;
+}
+
+int netcode_server_write_connection_challenge( struct netcode_server_t * server, 
+                                               struct netcode_connection_request_packet_t * packet, 
+                                               struct netcode_connect_token_private_t * connect_token_private, 
+                                               struct netcode_connection_challenge_packet_t * challenge_packet )
+{
+    netcode_assert( server );
+    netcode_assert( packet );
+    netcode_assert( connect_token_private );
+    netcode_assert( challenge_packet );
+
+    // another cipher suite is only used when the backend asked for it, the client proposed it and this server is
+    // configured for it and can run it. anything else falls back to chacha20-poly1305, which every peer understands.
+    // integrity only links are never the result of a client proposal alone, since the token is signed by the backend
+
+    int cipher_suite = NETCODE_CIPHER_SUITE_CHACHA20_POLY1305;
+    if ( packet->cipher_suite == connect_token_private->cipher_suite && 
+         server->config.cipher_suite == connect_token_private->cipher_suite && 
+         netcode_cipher_suite_supported( connect_token_private->cipher_suite ) )
+    {
+        cipher_suite = connect_token_private->cipher_suite;
+    }
+
+    struct netcode_challenge_token_t challenge_token;
+    challenge_token.client_id = connect_token_private->client_id;
+    memcpy( challenge_token.user_data, connect_token_private->user_data, NETCODE_USER_DATA_BYTES );
+    challenge_token.cipher_suite = cipher_suite;
+
+    challenge_packet->packet_type = NETCODE_CONNECTION_CHALLENGE_PACKET;
+    challenge_packet->cipher_suite = cipher_suite;
+    challenge_packet->challenge_token_sequence = server->challenge_sequence;
+    netcode_write_challenge_token( &challenge_token, challenge_packet->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
+    if ( netcode_encrypt_challenge_token( challenge_packet->challenge_token_data, 
+                                          NETCODE_CHALLENGE_TOKEN_BYTES, 
+                                          server->challenge_sequence, 
+                                          server->challenge_key ) != NETCODE_OK )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection request. failed to encrypt challenge token\n" );
+        return NETCODE_ERROR;
+    }
+
+    server->challenge_sequence++;
+
+    return NETCODE_OK;
+}
+
+void netcode_server_resume_session( struct netcode_server_t * server, struct netcode_address_t * from, struct netcode_connect_token_private_t * connect_token_private );
+
+void netcode_server_process_connection_request_packet( struct netcode_server_t * server, 
+                                                       struct netcode_address_t * from, 
+                                                       struct netcode_connection_request_packet_t * packet )
+{
+    netcode_assert( server );
+
+    struct netcode_connect_token_private_t connect_token_private;
+    if ( netcode_read_connect_token_private( packet->connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, &connect_token_private ) != NETCODE_OK )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection request. failed to read connect token\n" );
+        return;
+    }
+
+    uint8_t * connect_token_mac = packet->connect_token_data + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES - NETCODE_MAC_BYTES;
+
+    if ( netcode_server_admit_connection_request( server, from, &connect_token_private, connect_token_mac ) != NETCODE_OK )
+        return;
+
+    if ( connect_token_private.session_ticket )
+    {
+        netcode_server_resume_session( server, from, &connect_token_private );
+        return;
+    }
+
+    struct netcode_connection_challenge_packet_t challenge_packet;
+    if ( netcode_server_write_connection_challenge( server, packet, &connect_token_private, &challenge_packet ) != NETCODE_OK )
+        return;
+
+    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server sent connection challenge packet\n" );
+
+    netcode_server_send_global_packet( server, &challenge_packet, from, connect_token_private.server_to_client_key );
+}
+
+int netcode_server_find_free_client_index( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    int i;
+    for ( i = 0; i < server->max_clients; ++i )
+    {
+        if ( !server->client_connected[i] )
+            return i;
+    }
+
+    return -1;
+}
+
+void netcode_server_connect_client( struct netcode_server_t * server, 
+                                    int client_index, 
+                                    struct netcode_address_t * address, 
+                                    uint64_t client_id, 
+                                    int encryption_index,
+                                    int timeout_seconds, 
+                                    int cipher_suite, 
+                                    void * user_data )
+{
+    netcode_assert( server );
+    netcode_assert( server->running );
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    netcode_assert( address );
+    netcode_assert( encryption_index != -1 );
+    netcode_assert( user_data );
+    netcode_assert( server->encryption_manager.client_index[encryption_index] == -1 );
+    netcode_assert( cipher_suite == NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 || server->client_write_packet_cipher );
+
+    server->num_connected_clients++;
+
+    netcode_assert( server->num_connected_clients <= server->max_clients );
+
+    netcode_assert( server->client_connected[client_index] == 0 );
+
+    netcode_encryption_manager_set_expire_time( &server->encryption_manager, encryption_index, -1.0 );
+    
+    server->encryption_manager.client_index[encryption_index] = client_index;
+
+    server->client_connected[client_index] = 1;
+    server->client_timeout[client_index] = timeout_seconds;
+    server->client_encryption_index[client_index] = encryption_index;
+    server->client_id[client_index] = client_id;
+    server->client_sequence[client_index] = 0;
+    server->client_address[client_index] = *address;
+    netcode_address_map_insert( &server->client_address_map, server->client_address, client_index );
+    server->client_last_packet_send_time[client_index] = server->time;
+    server->client_last_packet_receive_time[client_index] = server->time;
+    server->client_session_ticket_time[client_index] = server->time - server->config.session_ticket_seconds;
+    server->client_connection_id[client_index] = server->config.connection_ids ? netcode_connection_id( netcode_encryption_manager_get_receive_key( &server->encryption_manager, encryption_index ), client_index ) : 0;
+    memcpy( server->client_user_data[client_index], user_data, NETCODE_USER_DATA_BYTES );
+
+    server->client_cipher_suite[client_index] = cipher_suite;
+    if ( cipher_suite != NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 )
+    {
+        netcode_packet_cipher_init( &server->client_write_packet_cipher[client_index], cipher_suite, netcode_encryption_manager_get_send_key( &server->encryption_manager, encryption_index ) );
+        netcode_packet_cipher_init( &server->client_read_packet_cipher[client_index], cipher_suite, netcode_encryption_manager_get_receive_key( &server->encryption_manager, encryption_index ) );
+    }
+
+    char address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+
+    netcode_printf( NETCODE_LOG_LEVEL_INFO, "server accepted client %s %.16" PRIx64 " in slot %d\n", 
+        netcode_address_to_string( address, address_string ), client_id, client_index );
+
+    struct netcode_connection_keep_alive_packet_t packet;
+    packet.packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
+    packet.client_index = client_index;
+    packet.max_clients = server->max_clients;
+
+    netcode_server_send_client_packet( server, &packet, client_index );
+
+    if ( server->config.connect_disconnect_callback )
+    {
+        server->config.connect_disconnect_callback( server->config.callback_context, client_index, 1 );
+    }
+}
+
+void netcode_server_accept_connection_response( struct netcode_server_t * server, 
+                                                struct netcode_address_t * from, 
+                                                struct netcode_challenge_token_t * challenge_token, 
+                                                int encryption_index )
+{
+    netcode_assert( server );
+    netcode_assert( from );
+    netcode_assert( challenge_token );
+
+    uint8_t * packet_send_key = netcode_encryption_manager_get_send_key( &server->encryption_manager, encryption_index );
+
+    if ( !packet_send_key )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection response. no packet send key\n" );
+        return;
+    }
+
+    int existing_client_index = netcode_server_find_client_index_by_address( server, from );
+    if ( existing_client_index != -1 )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection response. a client with this address is already connected\n" );
+        netcode_server_resend_confirmation( server, existing_client_index );
+        return;
+    }
+
+    if ( netcode_server_find_client_index_by_id( server, challenge_token->client_id ) != -1 )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection response. a client with this id is already connected\n" );
+        return;
+    }
+
+    if ( server->num_connected_clients == server->max_clients )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server denied connection response. server is full\n" );
+
+        struct netcode_connection_denied_packet_t p;
+        p.packet_type = NETCODE_CONNECTION_DENIED_PACKET;
+
+        netcode_server_send_global_packet( server, &p, from, packet_send_key );
+
+        return;
+    }
+
+    if ( server->config.shard_group && !netcode_server_shard_group_claim_client_id( server->config.shard_group, challenge_token->client_id, server ) )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection response. a client with this id is connected to another shard\n" );
+        return;
+    }
+
+    int client_index = netcode_server_find_free_client_index( server );
+
+    netcode_assert( client_index != -1 );
+
+    int timeout_seconds = netcode_encryption_manager_get_timeout( &server->encryption_manager, encryption_index );
+
+    netcode_server_connect_client( server, client_index, from, challenge_token->client_id, encryption_index, timeout_seconds, challenge_token->cipher_suite, challenge_token->user_data );
+}
+
+void netcode_server_process_connection_response_packet( struct netcode_server_t * server, 
+                                                        struct netcode_address_t * from, 
+                                                        struct netcode_connection_response_packet_t * packet, 
+                                                        int encryption_index )
+{
+    netcode_assert( server );
+
+    if ( netcode_decrypt_challenge_token( packet->challenge_token_data, 
+                                          NETCODE_CHALLENGE_TOKEN_BYTES, 
+                                          packet->challenge_token_sequence, 
+                                          server->challenge_key ) != NETCODE_OK )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection response. failed to decrypt challenge token\n" );
+        return;
+    }
+
+    struct netcode_challenge_token_t challenge_token;
+    if ( netcode_read_challenge_token( packet->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES, &challenge_token ) != NETCODE_OK )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection response. failed to read challenge token\n" );
+        return;
+    }
+
+    netcode_server_accept_connection_response( server, from, &challenge_token, encryption_index );
+}
+
+void netcode_server_resume_session( struct netcode_server_t * server, struct netcode_address_t * from, struct netcode_connect_token_private_t * connect_token_private )
+{
+    netcode_assert( server );
+    netcode_assert( from );
+    netcode_assert( connect_token_private );
+    netcode_assert( connect_token_private->session_ticket );
+
+    // a session ticket was minted by this server for a client that already proved it owns its address, so the
+    // challenge round trip is skipped and the client is connected straight from the connection request
+
+    int encryption_index = netcode_encryption_manager_find_encryption_mapping( &server->encryption_manager, from, server->time );
+    if ( encryption_index == -1 )
+        return;
+
+    struct netcode_challenge_token_t challenge_token;
+    challenge_token.client_id = connect_token_private->client_id;
+    memcpy( challenge_token.user_data, connect_token_private->user_data, NETCODE_USER_DATA_BYTES );
+    challenge_token.cipher_suite = connect_token_private->cipher_suite;
+
+    netcode_server_accept_connection_response( server, from, &challenge_token, encryption_index );
+
+    if ( netcode_server_find_client_index_by_address( server, from ) != -1 )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server resumed session from session ticket %.16" PRIx64 "\n", connect_token_private->session_ticket_sequence );
+        netcode_session_ticket_table_add( &server->session_ticket_table, 
+                                          connect_token_private->session_ticket_sequence, 
+                                          server->time, 
+                                          server->time + server->config.session_ticket_seconds );
+    }
+}
+
+// ----------------------------------------------------------------
+
+void * netcode_handshake_job_allocate( void * context, size_t bytes )
+{
+    // the handshake thread reads packets into the job itself, since the server allocator may not be thread safe
+
+    struct netcode_handshake_job_t * job = (struct netcode_handshake_job_t*) context;
+    netcode_assert( bytes <= sizeof( job->packet ) );
+    (void) bytes;
+    return &job->packet;
+}
+
+void netcode_server_process_handshake_job( struct netcode_server_t * server, struct netcode_handshake_queue_t * queue, struct netcode_handshake_job_t * job )
+{
+    netcode_assert( server );
+    netcode_assert( queue );
+    netcode_assert( job );
+
+    // runs on the handshake thread. only the crypto happens here: everything that touches server state
+    // is left to the game thread when it completes the job. challenge_sequence and challenge_key belong
+    // to this thread while the handshake queue exists, and are only reset while it is idle
+
+    job->result = NETCODE_HANDSHAKE_RESULT_NONE;
+
+    uint8_t allowed_packets[NETCODE_CONNECTION_NUM_PACKETS];
+    memset( allowed_packets, 0, sizeof( allowed_packets ) );
+    allowed_packets[NETCODE_CONNECTION_REQUEST_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_RESPONSE_PACKET] = 1;
+
+    uint64_t sequence;
+
+    void * packet = netcode_read_packet( job->packet_data, 
+                                         job->packet_bytes, 
+                                         &sequence, 
+                                         job->read_packet_key, 
+                                         server->config.protocol_id, 
+                                         (uint64_t) time( NULL ), 
+                                         server->config.private_key, 
+                                         allowed_packets, 
+                                         NULL, 
+                                         job, 
+                                         netcode_handshake_job_allocate, 
+                                         NULL );
+    if ( !packet )
+        return;
+
+    if ( ( (uint8_t*) packet )[0] == NETCODE_CONNECTION_REQUEST_PACKET )
+    {
+        struct netcode_connection_request_packet_t * request = (struct netcode_connection_request_packet_t*) packet;
+
+        if ( netcode_read_connect_token_private( request->connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, &job->connect_token_private ) != NETCODE_OK )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection request. failed to read connect token\n" );
+            return;
+        }
+
+        memcpy( job->connect_token_mac, request->connect_token_data + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES - NETCODE_MAC_BYTES, NETCODE_MAC_BYTES );
+
+        // the challenge goes out with a sequence from its own range, so it never shares a nonce with
+        // a denied packet the game thread sends under the same key
+
+        struct netcode_connection_challenge_packet_t challenge_packet;
+        if ( netcode_server_write_connection_challenge( server, request, &job->connect_token_private, &challenge_packet ) != NETCODE_OK )
+            return;
+
+        job->packet_bytes = netcode_write_packet( &challenge_packet, 
+                                                  job->packet_data, 
+                                                  NETCODE_MAX_PACKET_BYTES, 
+                                                  queue->packet_sequence++, 
+                                                  job->connect_token_private.server_to_client_key, 
+                                                  server->config.protocol_id, 
+                                                  NULL );
+
+        job->result = NETCODE_HANDSHAKE_RESULT_REQUEST;
+    }
+    else
+    {
+        struct netcode_connection_response_packet_t * response = (struct netcode_connection_response_packet_t*) packet;
+
+        if ( netcode_decrypt_challenge_token( response->challenge_token_data, 
+                                              NETCODE_CHALLENGE_TOKEN_BYTES, 
+                                              response->challenge_token_sequence, 
+                                              server->challenge_key ) != NETCODE_OK )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection response. failed to decrypt challenge token\n" );
+            return;
+        }
+
+        if ( netcode_read_challenge_token( response->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES, &job->challenge_token ) != NETCODE_OK )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection response. failed to read challenge token\n" );
+            return;
+        }
+
+        job->result = NETCODE_HANDSHAKE_RESULT_RESPONSE;
+    }
+}
+
+void netcode_server_handshake_thread( void * context )
+{
+    struct netcode_server_t * server = (struct netcode_server_t*) context;
+    struct netcode_handshake_queue_t * queue = server->handshake_queue;
+
+    netcode_mutex_lock( &queue->mutex );
+
+    while ( 1 )
+    {
+        while ( queue->processed == queue->tail && !queue->quit )
+            netcode_condition_wait( &queue->job_added, &queue->mutex );
+
+        if ( queue->processed == queue->tail )
+            break;
+
+        struct netcode_handshake_job_t * job = &queue->jobs[queue->processed % NETCODE_HANDSHAKE_QUEUE_SIZE];
+
+        netcode_mutex_unlock( &queue->mutex );
+
+        netcode_server_process_handshake_job( server, queue, job );
+
+        netcode_mutex_lock( &queue->mutex );
+
+        queue->processed++;
+
+        netcode_condition_signal( &queue->job_done );
+    }
+
+    netcode_mutex_unlock( &queue->mutex );
+}
+
+int netcode_server_create_handshake_queue( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+    netcode_assert( !server->handshake_queue );
+
+    struct netcode_handshake_queue_t * queue = (struct netcode_handshake_queue_t*) 
+        server->config.allocate_function( server->config.allocator_context, sizeof( struct netcode_handshake_queue_t ) );
+
+    if ( !queue )
+        return NETCODE_ERROR;
+
+    memset( queue, 0, sizeof( struct netcode_handshake_queue_t ) );
+
+    queue->packet_sequence = ( 1ULL << 63 ) | ( 1ULL << 62 );
+
+    netcode_mutex_create( &queue->mutex );
+    netcode_condition_create( &queue->job_added );
+    netcode_condition_create( &queue->job_done );
+
+    server->handshake_queue = queue;
+
+    if ( netcode_thread_create( &queue->thread, netcode_server_handshake_thread, server ) != NETCODE_OK )
+    {
+        server->handshake_queue = NULL;
+        netcode_condition_destroy( &queue->job_done );
+        netcode_condition_destroy( &queue->job_added );
+        netcode_mutex_destroy( &queue->mutex );
+        server->config.free_function( server->config.allocator_context, queue );
+        return NETCODE_ERROR;
+    }
+
+    return NETCODE_OK;
+}
+
+void netcode_server_destroy_handshake_queue( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    struct netcode_handshake_queue_t * queue = server->handshake_queue;
+    if ( !queue )
+        return;
+
+    netcode_mutex_lock( &queue->mutex );
+    queue->quit = 1;
+    netcode_condition_signal( &queue->job_added );
+    netcode_mutex_unlock( &queue->mutex );
+
+    netcode_thread_join( &queue->thread );
+
+    netcode_condition_destroy( &queue->job_done );
+    netcode_condition_destroy( &queue->job_added );
+    netcode_mutex_destroy( &queue->mutex );
+
+    server->config.free_function( server->config.allocator_context, queue );
+
+    server->handshake_queue = NULL;
+}
+
+void netcode_server_discard_handshakes( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    // wait for the handshake thread to go idle and throw away whatever it finished. 
+    // called on stop, so nothing from before a restart can connect under the new challenge key
+
+    struct netcode_handshake_queue_t * queue = server->handshake_queue;
+    if ( !queue )
+        return;
+
+    netcode_mutex_lock( &queue->mutex );
+    netcode_condition_signal( &queue->job_added );
+    while ( queue->processed != queue->tail )
+        netcode_condition_wait( &queue->job_done, &queue->mutex );
+    netcode_mutex_unlock( &queue->mutex );
+
+    queue->head = queue->tail;
+}
+
+int netcode_server_queue_handshake_packet( struct netcode_server_t * server, 
+                                           struct netcode_address_t * from, 
+                                           uint8_t * packet_data, 
+                                           int packet_bytes, 
+                                           int client_index, 
+                                           int encryption_index, 
+                                           uint8_t * read_packet_key )
+{
+    netcode_assert( server );
+    netcode_assert( server->handshake_queue );
+    netcode_assert( from );
+    netcode_assert( packet_data );
+
+    // returns 1 if the packet was taken by the handshake queue, queued or dropped, and 0 if it should be read inline
+
+    const int packet_type = packet_data[0] & 0xF;
+
+    if ( packet_type != NETCODE_CONNECTION_REQUEST_PACKET && packet_type != NETCODE_CONNECTION_RESPONSE_PACKET )
+        return 0;
+
+    if ( !server->running || client_index != -1 || packet_bytes > NETCODE_MAX_PACKET_BYTES )
+        return 1;
+
+    if ( packet_type == NETCODE_CONNECTION_REQUEST_PACKET && ( server->flags & NETCODE_SERVER_FLAG_IGNORE_CONNECTION_REQUEST_PACKETS ) )
+        return 1;
+
+    if ( packet_type == NETCODE_CONNECTION_RESPONSE_PACKET && ( server->flags & NETCODE_SERVER_FLAG_IGNORE_CONNECTION_RESPONSE_PACKETS ) )
+        return 1;
+
+    struct netcode_handshake_queue_t * queue = server->handshake_queue;
+
+    if ( queue->tail - queue->head == NETCODE_HANDSHAKE_QUEUE_SIZE )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server dropped connection handshake packet. handshake queue is full\n" );
+        server->counters[NETCODE_SERVER_COUNTER_NUM_HANDSHAKES_DROPPED]++;
+        return 1;
+    }
+
+    // the slot at tail is not visible to the handshake thread until tail moves past it, so it is filled outside the lock
+
+    struct netcode_handshake_job_t * job = &queue->jobs[queue->tail % NETCODE_HANDSHAKE_QUEUE_SIZE];
+
+    job->from = *from;
+    job->encryption_index = encryption_index;
+    if ( read_packet_key )
+        memcpy( job->read_packet_key, read_packet_key, NETCODE_KEY_BYTES );
+    else
+        memset( job->read_packet_key, 0, NETCODE_KEY_BYTES );
+    job->packet_bytes = packet_bytes;
+    memcpy( job->packet_data, packet_data, packet_bytes );
+
+    // the handshake thread is woken once per receive, in netcode_server_complete_handshakes, rather than once per packet
+
+    netcode_mutex_lock( &queue->mutex );
+    queue->tail++;
+    netcode_mutex_unlock( &queue->mutex );
+
+    return 1;
+}
+
+void netcode_server_complete_handshakes( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    struct netcode_handshake_queue_t * queue = server->handshake_queue;
+    if ( !queue )
+        return;
+
+    netcode_mutex_lock( &queue->mutex );
+    const uint64_t processed = queue->processed;
+    if ( processed != queue->tail )
+        netcode_condition_signal( &queue->job_added );
+    netcode_mutex_unlock( &queue->mutex );
+
+    while ( queue->head != processed )
+    {
+        struct netcode_handshake_job_t * job = &queue->jobs[queue->head % NETCODE_HANDSHAKE_QUEUE_SIZE];
+
+        if ( job->result == NETCODE_HANDSHAKE_RESULT_REQUEST )
+        {
+            if ( netcode_server_admit_connection_request( server, &job->from, &job->connect_token_private, job->connect_token_mac ) == NETCODE_OK )
+            {
+                if ( job->connect_token_private.session_ticket )
+                {
+                    netcode_server_resume_session( server, &job->from, &job->connect_token_private );
+                }
+                else
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server sent connection challenge packet\n" );
+                    netcode_server_send_global_packet_data( server, &job->from, job->packet_data, job->packet_bytes );
+                }
+            }
+        }
+        else if ( job->result == NETCODE_HANDSHAKE_RESULT_RESPONSE )
+        {
+            // the response was authenticated against the mapping at the time it was queued. 
+            // only accept it if that mapping is still the one for this address
+
+            int encryption_index = netcode_encryption_manager_find_encryption_mapping( &server->encryption_manager, &job->from, server->time );
+            uint8_t * read_packet_key = netcode_encryption_manager_get_receive_key( &server->encryption_manager, encryption_index );
+
+            if ( encryption_index == job->encryption_index && read_packet_key && memcmp( read_packet_key, job->read_packet_key, NETCODE_KEY_BYTES ) == 0 )
+            {
+                netcode_server_accept_connection_response( server, &job->from, &job->challenge_token, encryption_index );
+            }
+            else
+            {
+                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection response. encryption mapping changed\n" );
+            }
+        }
+
+        queue->head++;
+    }
+}
+
+void netcode_server_process_packet_internal( struct netcode_server_t * server, 
+                                             struct netcode_address_t * from, 
+                                             void * packet, 
+                                             uint64_t sequence, 
+                                             int encryption_index, 
+                                             int client_index )
+{
+    netcode_assert( server );
+    netcode_assert( packet );
+
+    (void) from;
+    (void) sequence;
+
+    uint8_t packet_type = ( (uint8_t*) packet ) [0];
+
+    switch ( packet_type )
+    {
+        case NETCODE_CONNECTION_REQUEST_PACKET:
+        {    
+            if ( ( server->flags & NETCODE_SERVER_FLAG_IGNORE_CONNECTION_REQUEST_PACKETS ) == 0 )
+            {
+                char from_address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server received connection request from %s\n", netcode_address_to_string( from, from_address_string ) );
+                netcode_server_process_connection_request_packet( server, from, (struct netcode_connection_request_packet_t*) packet );
+            }
+        }
+        break;
+
+        case NETCODE_CONNECTION_RESPONSE_PACKET:
+        {    
+            if ( ( server->flags & NETCODE_SERVER_FLAG_IGNORE_CONNECTION_RESPONSE_PACKETS ) == 0 )
+            {
+                char from_address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server received connection response from %s\n", netcode_address_to_string( from, from_address_string ) );
+                netcode_server_process_connection_response_packet( server, from, (struct netcode_connection_response_packet_t*) packet, encryption_index );
+            }
+        }
+        break;
+
+        case NETCODE_CONNECTION_KEEP_ALIVE_PACKET:
+        {
+            if ( client_index != -1 )
+            {
+                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server received connection keep alive packet from client %d\n", client_index );
+                server->client_last_packet_receive_time[client_index] = server->time;
+                if ( !server->client_confirmed[client_index] )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server confirmed connection with client %d\n", client_index );
+                    server->client_confirmed[client_index] = 1;
+                }
+            }
+        }
+        break;
+
+        case NETCODE_CONNECTION_PAYLOAD_PACKET:
+        {
+            if ( client_index != -1 )
+            {
+                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server received connection payload packet from client %d\n", client_index );
+                server->client_last_packet_receive_time[client_index] = server->time;
+                if ( !server->client_confirmed[client_index] )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server confirmed connection with client %d\n", client_index );
+                    server->client_confirmed[client_index] = 1;
+                }
+                netcode_packet_queue_push( &server->client_packet_queue[client_index], packet, sequence );
+                return;
+            }
+        }
+        break;
+
+        case NETCODE_CONNECTION_DISCONNECT_PACKET:
+        {
+            if ( client_index != -1 )
+            {
+                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server received disconnect packet from client %d\n", client_index );
+                netcode_server_disconnect_client_internal( server, client_index, 0 );
+            }
+            else if ( encryption_index != -1 )
+            {
+                // a client that raced us against other servers and connected elsewhere. drop its pending mapping
+
+                char from_address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server received disconnect packet from pending client %s\n", netcode_address_to_string( from, from_address_string ) );
+                netcode_encryption_manager_remove_encryption_mapping( &server->encryption_manager, from, server->time );
+            }
+        }
+        break;
+
+        default:
+            break;
+    }
+
+    netcode_packet_pool_free( &server->packet_pool, packet );
+}
+
+void netcode_server_process_packet( struct netcode_server_t * server, struct netcode_address_t * from, uint8_t * packet_data, int packet_bytes )
+{
+    uint8_t allowed_packets[NETCODE_CONNECTION_NUM_PACKETS];
+    memset( allowed_packets, 0, sizeof( allowed_packets ) );
+    allowed_packets[NETCODE_CONNECTION_REQUEST_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_RESPONSE_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_KEEP_ALIVE_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_PAYLOAD_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_DISCONNECT_PACKET] = 1;
+
+    uint64_t current_timestamp = (uint64_t) time( NULL );
+
+    uint64_t sequence;
+
+    int encryption_index = -1;
+    int migrating = 0;
+    int client_index = netcode_server_find_client_index_by_address( server, from );
+    if ( client_index == -1 )
+    {
+        client_index = netcode_server_find_client_index_by_connection_id( server, packet_data, packet_bytes );
+        migrating = client_index != -1;
+    }
+    if ( client_index != -1 )
+    {
+        netcode_assert( client_index >= 0 );
+        netcode_assert( client_index < server->max_clients );
+        encryption_index = server->client_encryption_index[client_index];
+    }
+    else
+    {
+        encryption_index = netcode_encryption_manager_find_encryption_mapping( &server->encryption_manager, from, server->time );
+    }
+    
+    uint8_t * read_packet_key = netcode_encryption_manager_get_receive_key( &server->encryption_manager, encryption_index );
+
+    if ( !netcode_server_admit_packet( server, from, packet_data, packet_bytes, client_index, read_packet_key != NULL ) )
+        return;
+
+    if ( server->handshake_queue && netcode_server_queue_handshake_packet( server, from, packet_data, packet_bytes, client_index, encryption_index, read_packet_key ) )
+        return;
+
+    void * packet = netcode_read_packet( packet_data, 
+                                         packet_bytes, 
+                                         &sequence, 
+                                         read_packet_key, 
+                                         server->config.protocol_id, 
+                                         current_timestamp, 
+                                         server->config.private_key, 
+                                         allowed_packets, 
+                                         ( client_index != -1 ) ? &server->client_replay_protection[client_index] : NULL, 
+                                         &server->packet_pool, 
+                                         netcode_packet_pool_allocate, 
+                                         netcode_server_client_read_packet_cipher( server, client_index ) );
+
+    if ( !packet )
+        return;
+
+    // a client that shows up at a new address under its connection id moves there, but only on the newest packet
+    // it has sent. an old packet replayed from somewhere else authenticates fine and still must not pull it back
+
+    if ( migrating && server->client_replay_protection[client_index].most_recent_sequence == sequence )
+    {
+        netcode_server_migrate_client( server, client_index, from );
+    }
+
+    netcode_server_process_packet_internal( server, from, packet, sequence, encryption_index, client_index );
+}
+
+void netcode_server_read_and_process_packet( struct netcode_server_t * server, 
+                                             struct netcode_address_t * from, 
+                                             uint8_t * packet_data, 
+                                             int packet_bytes, 
+                                             uint64_t current_timestamp, 
+                                             uint8_t * allowed_packets, 
+                                             int * buffer_adopted, 
+                                             int decrypted_encryption_index )
+{
+    // buffer_adopted is non-NULL when packet_data is a receive buffer from the server packet pool.
+    // it is set if a payload packet took ownership of the buffer, and the caller must replace it.
+    // decrypted_encryption_index is the encryption mapping a batch already authenticated and decrypted this payload packet
+    // under, or -1 if it did not
+
+    if ( buffer_adopted )
+    {
+        *buffer_adopted = 0;
+    }
+
+    if ( !server->running )
+        return;
+
+    if ( packet_bytes <= 1 )
+        return;
+
+    if ( server->config.auxiliary_command_function != NULL ) {
+		if (server->config.auxiliary_command_function(
+			server->config.auxiliary_command_context, 
+			from, 
+			packet_data, 
+			packet_bytes
+		)) {
+			return;
+		}
+	}
+
+    uint64_t sequence;
+
+    int encryption_index = -1;
+    int migrating = 0;
+    int client_index = netcode_server_find_client_index_by_address( server, from );
+    if ( client_index == -1 )
+    {
+        client_index = netcode_server_find_client_index_by_connection_id( server, packet_data, packet_bytes );
+        migrating = client_index != -1;
+    }
+    if ( client_index != -1 )
+    {
+        netcode_assert( client_index >= 0 );
+        netcode_assert( client_index < server->max_clients );
+        encryption_index = server->client_encryption_index[client_index];
+    }
+    else
+    {
+        encryption_index = netcode_encryption_manager_find_encryption_mapping( &server->encryption_manager, from, server->time );
+    }
+    
+    // packets earlier in the batch can disconnect or move clients. a packet decrypted under a key that no longer belongs
+    // to whoever sent it is dropped, rather than read as authenticated
+
+    const int payload_decrypted = decrypted_encryption_index != -1;
+
+    if ( payload_decrypted && ( client_index == -1 || encryption_index != decrypted_encryption_index ) )
+        return;
+
+    uint8_t * read_packet_key = netcode_encryption_manager_get_receive_key( &server->encryption_manager, encryption_index );
+
+    if ( !netcode_server_admit_packet( server, from, packet_data, packet_bytes, client_index, read_packet_key != NULL ) )
+        return;
+
+    if ( server->handshake_queue && netcode_server_queue_handshake_packet( server, from, packet_data, packet_bytes, client_index, encryption_index, read_packet_key ) )
+        return;
+
+    void * packet = netcode_read_packet_internal( packet_data, 
+                                                  packet_bytes, 
+                                                  &sequence, 
+                                                  read_packet_key, 
+                                                  server->config.protocol_id, 
+                                                  current_timestamp, 
+                                                  server->config.private_key, 
+                                                  allowed_packets, 
+                                                  ( client_index != -1 ) ? &server->client_replay_protection[client_index] : NULL, 
+                                                  &server->packet_pool, 
+                                                  netcode_packet_pool_allocate, 
+                                                  buffer_adopted, 
+                                                  payload_decrypted, 
+                                                  netcode_server_client_read_packet_cipher( server, client_index ) );
+
+    if ( !packet )
+        return;
+
+    // a client that shows up at a new address under its connection id moves there, but only on the newest packet
+    // it has sent. an old packet replayed from somewhere else authenticates fine and still must not pull it back
+
+    if ( migrating && server->client_replay_protection[client_index].most_recent_sequence == sequence )
+    {
+        netcode_server_migrate_client( server, client_index, from );
+    }
+
+    netcode_server_process_packet_internal( server, from, packet, sequence, encryption_index, client_index );
+}
+
+#if NETCODE_SOCKET_BATCHING
+
+void netcode_server_decrypt_receive_batch( struct netcode_server_t * server, struct netcode_socket_receive_batch_t * batch, int * decrypted_encryption_index )
+{
+    // authenticate and decrypt the payload packets from connected clients in one go, before they are read one by one.
+    // packets that fail are dropped here. anything else is left alone and read the regular way
+
+    int message_index[NETCODE_SOCKET_BATCH_SIZE];
+    int message_encryption_index[NETCODE_SOCKET_BATCH_SIZE];
+    uint8_t * message[NETCODE_SOCKET_BATCH_SIZE];
+    uint64_t message_length[NETCODE_SOCKET_BATCH_SIZE];
+    uint8_t additional_data[NETCODE_SOCKET_BATCH_SIZE][NETCODE_VERSION_INFO_BYTES+8+1];
+    uint8_t * additional[NETCODE_SOCKET_BATCH_SIZE];
+    uint64_t additional_length[NETCODE_SOCKET_BATCH_SIZE];
+    uint8_t nonce_data[NETCODE_SOCKET_BATCH_SIZE][12];
+    uint8_t * nonce[NETCODE_SOCKET_BATCH_SIZE];
+    uint8_t * key[NETCODE_SOCKET_BATCH_SIZE];
+    int result[NETCODE_SOCKET_BATCH_SIZE];
+
+    int num_messages = 0;
+
+    int i;
+    for ( i = 0; i < batch->num_packets; ++i )
+    {
+        decrypted_encryption_index[i] = -1;
+
+        if ( !server->running || server->config.auxiliary_command_function != NULL )
+            continue;
+
+        uint8_t * packet_data = batch->packet_data[i];
+        const int packet_bytes = batch->packet_bytes[i];
+
+        if ( packet_bytes < 1 || ( packet_data[0] & 0xF & ~NETCODE_CONNECTION_ID_FLAG ) != NETCODE_CONNECTION_PAYLOAD_PACKET )
+            continue;
+
+        const int connection_id_bytes = ( packet_data[0] & NETCODE_CONNECTION_ID_FLAG ) ? NETCODE_CONNECTION_ID_BYTES : 0;
+        const int sequence_bytes = packet_data[0] >> 4;
+        if ( sequence_bytes < 1 || sequence_bytes > 8 || packet_bytes < 1 + connection_id_bytes + sequence_bytes + NETCODE_MAC_BYTES )
+            continue;
+
+        int client_index = netcode_server_find_client_index_by_address( server, &batch->address[i] );
+        if ( client_index == -1 )
+        {
+            client_index = netcode_server_find_client_index_by_connection_id( server, packet_data, packet_bytes );
+        }
+        if ( client_index == -1 || server->client_cipher_suite[client_index] != NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 )
+            continue;
+
+        const int encryption_index = server->client_encryption_index[client_index];
+        uint8_t * read_packet_key = netcode_encryption_manager_get_receive_key( &server->encryption_manager, encryption_index );
+        if ( !read_packet_key )
+            continue;
+
+        uint64_t sequence = 0;
+        int j;
+        for ( j = 0; j < sequence_bytes; ++j )
+        {
+            sequence |= ( (uint64_t) packet_data[1+connection_id_bytes+j] ) << ( 8 * j );
+        }
+
+        if ( netcode_replay_protection_already_received( &server->client_replay_protection[client_index], sequence ) )
+            continue;
+
+        {
+            uint8_t * p = additional_data[num_messages];
+            netcode_write_bytes( &p, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
+            netcode_write_uint64( &p, server->config.protocol_id );
+            netcode_write_uint8( &p, packet_data[0] );
+        }
+
+        {
+            uint8_t * p = nonce_data[num_messages];
+            netcode_write_uint32( &p, 0 );
+            netcode_write_uint64( &p, sequence );
+        }
+
+        message_index[num_messages] = i;
+        message_encryption_index[num_messages] = encryption_index;
+        message[num_messages] = packet_data + 1 + connection_id_bytes + sequence_bytes;
+        message_length[num_messages] = (uint64_t) ( packet_bytes - 1 - connection_id_bytes - sequence_bytes );
+        additional[num_messages] = additional_data[num_messages];
+        additional_length[num_messages] = sizeof( additional_data[num_messages] );
+        nonce[num_messages] = nonce_data[num_messages];
+        key[num_messages] = read_packet_key;
+        num_messages++;
+    }
+
+    if ( num_messages == 0 )
+        return;
+
+    netcode_decrypt_aead_batch( num_messages, message, message_length, additional, additional_length, nonce, key, result );
+
+    for ( i = 0; i < num_messages; ++i )
+    {
+        if ( result[i] == NETCODE_OK )
+        {
+            decrypted_encryption_index[message_index[i]] = message_encryption_index[i];
+        }
+        else
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "ignored encrypted packet. failed to decrypt\n" );
+            batch->packet_bytes[message_index[i]] = 0;
+        }
+    }
+}
+
+void netcode_server_receive_socket_batches( struct netcode_server_t * server, 
+                                            struct netcode_socket_t * socket, 
+                                            uint64_t current_timestamp, 
+                                            uint8_t * allowed_packets )
+{
+    netcode_assert( server );
+    netcode_assert( socket );
+
+    struct netcode_socket_receive_batch_t * batch = &server->receive_batch;
+
+    while ( 1 )
+    {
+        // every slot needs a pool buffer before the next recvmmsg, payload packets take theirs with them
+
+        int i;
+        for ( i = 0; i < NETCODE_SOCKET_BATCH_SIZE; ++i )
+        {
+            if ( !batch->packet_data[i] )
+            {
+                batch->packet_data[i] = netcode_packet_pool_allocate_receive_buffer( &server->packet_pool );
+                if ( !batch->packet_data[i] )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: server could not allocate receive buffer\n" );
+                    return;
+                }
+            }
+        }
+
+        int num_datagrams = netcode_socket_receive_packets( socket, batch );
+
+        server->counters[NETCODE_SERVER_COUNTER_NUM_SOCKET_RECEIVE_CALLS]++;
+        server->counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_RECEIVED] += batch->num_packets;
+
+        int decrypted_encryption_index[NETCODE_SOCKET_BATCH_SIZE];
+        netcode_server_decrypt_receive_batch( server, batch, decrypted_encryption_index );
+
+        for ( i = 0; i < batch->num_packets; ++i )
+        {
+            int buffer_adopted = 0;
+
+            netcode_server_read_and_process_packet( server, 
+                                                    &batch->address[i], 
+                                                    batch->packet_data[i], 
+                                                    batch->packet_bytes[i], 
+                                                    current_timestamp, 
+                                                    allowed_packets, 
+                                                    &buffer_adopted, 
+                                                    decrypted_encryption_index[i] );
+
+            if ( buffer_adopted )
+                batch->packet_data[i] = NULL;
+        }
+
+        if ( num_datagrams < NETCODE_SOCKET_BATCH_SIZE )
+            break;
+    }
+}
+
+#if NETCODE_UDP_OFFLOAD
+
+void netcode_server_receive_socket_coalesced_batches( struct netcode_server_t * server, 
+                                                      struct netcode_socket_t * socket, 
+                                                      uint64_t current_timestamp, 
+                                                      uint8_t * allowed_packets )
+{
+    netcode_assert( server );
+    netcode_assert( socket );
+    netcode_assert( server->coalesced_receive_batch );
+
+    struct netcode_socket_coalesced_batch_t * batch = server->coalesced_receive_batch;
+
+    while ( 1 )
+    {
+        int num_messages = netcode_socket_receive_packets_coalesced( socket, batch );
+
+        server->counters[NETCODE_SERVER_COUNTER_NUM_SOCKET_RECEIVE_CALLS]++;
+
+        int i;
+        for ( i = 0; i < batch->num_packets; ++i )
+        {
+            // split each coalesced buffer back into the datagrams it was built from
+
+            uint8_t * packet_data = batch->packet_data[i];
+            int bytes_remaining = batch->packet_bytes[i];
+
+            while ( bytes_remaining > 0 )
+            {
+                const int packet_bytes = bytes_remaining < batch->segment_bytes[i] ? bytes_remaining : batch->segment_bytes[i];
+
+                server->counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_RECEIVED]++;
+
+                netcode_server_read_and_process_packet( server, &batch->address[i], packet_data, packet_bytes, current_timestamp, allowed_packets, NULL, -1 );
+
+                packet_data += packet_bytes;
+                bytes_remaining -= packet_bytes;
+            }
+        }
+
+        if ( num_messages < NETCODE_SOCKET_COALESCED_BATCH_SIZE )
+            break;
+    }
+}
+
+#endif // #if NETCODE_UDP_OFFLOAD
+
+#endif // #if NETCODE_SOCKET_BATCHING
+
+#if NETCODE_IO_URING
+
+void netcode_server_receive_io_uring( struct netcode_server_t * server, 
+                                      struct netcode_io_uring_t * ring, 
+                                      uint64_t current_timestamp, 
+                                      uint8_t * allowed_packets )
+{
+    netcode_assert( server );
+    netcode_assert( ring );
+
+    while ( 1 )
+    {
+        netcode_io_uring_submit_receive( ring );
+
+        server->counters[NETCODE_SERVER_COUNTER_NUM_SOCKET_RECEIVE_CALLS]++;
+
+        int num_packets = 0;
+
+        while ( 1 )
+        {
+            // packets are read and decrypted in place, straight out of the kernel provided buffer
+
+            struct netcode_address_t from;
+            uint8_t * packet_data = NULL;
+            int buffer_id = -1;
+
+            int packet_bytes = netcode_io_uring_receive_packet( ring, &from, &packet_data, &buffer_id );
+            if ( packet_bytes == 0 )
+                break;
+
+            server->counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_RECEIVED]++;
+
+            netcode_server_read_and_process_packet( server, &from, packet_data, packet_bytes, current_timestamp, allowed_packets, NULL, -1 );
+
+            netcode_io_uring_recycle_buffer( ring, buffer_id );
+
+            num_packets++;
+        }
+
+        if ( num_packets == 0 )
+            break;
+    }
+}
+
+#endif // #if NETCODE_IO_URING
+
+void netcode_server_receive_packets( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    uint8_t allowed_packets[NETCODE_CONNECTION_NUM_PACKETS];
+    memset( allowed_packets, 0, sizeof( allowed_packets ) );
+    allowed_packets[NETCODE_CONNECTION_REQUEST_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_RESPONSE_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_KEEP_ALIVE_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_PAYLOAD_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_DISCONNECT_PACKET] = 1;
+
+    uint64_t current_timestamp = (uint64_t) time( NULL );
+
+    // handshakes finished since the last receive are completed first, so their slots are free for this one
+
+    netcode_server_complete_handshakes( server );
+
+    if ( !server->config.network_simulator )
+    {
+        int receive_from_sockets = 1;
+
+#if NETCODE_SOCKET_BATCHING
+        if ( server->config.batch_socket_io && !server->config.override_send_and_receive )
+        {
+            // drain each socket in blocks of datagrams, one recvmmsg per block
+
+#if NETCODE_IO_URING
+            if ( server->io_uring_ipv4 )
+                netcode_server_receive_io_uring( server, server->io_uring_ipv4, current_timestamp, allowed_packets );
+            else
+#endif // #if NETCODE_IO_URING
+#if NETCODE_UDP_OFFLOAD
+            if ( server->udp_offload && server->socket_holder.ipv4.handle != 0 )
+                netcode_server_receive_socket_coalesced_batches( server, &server->socket_holder.ipv4, current_timestamp, allowed_packets );
+            else
+#endif // #if NETCODE_UDP_OFFLOAD
+            if ( server->socket_holder.ipv4.handle != 0 )
+                netcode_server_receive_socket_batches( server, &server->socket_holder.ipv4, current_timestamp, allowed_packets );
+
+#if NETCODE_IO_URING
+            if ( server->io_uring_ipv6 )
+                netcode_server_receive_io_uring( server, server->io_uring_ipv6, current_timestamp, allowed_packets );
+            else
+#endif // #if NETCODE_IO_URING
+#if NETCODE_UDP_OFFLOAD
+            if ( server->udp_offload && server->socket_holder.ipv6.handle != 0 )
+                netcode_server_receive_socket_coalesced_batches( server, &server->socket_holder.ipv6, current_timestamp, allowed_packets );
+            else
+#endif // #if NETCODE_UDP_OFFLOAD
+            if ( server->socket_holder.ipv6.handle != 0 )
+                netcode_server_receive_socket_batches( server, &server->socket_holder.ipv6, current_timestamp, allowed_packets );
+
+            receive_from_sockets = 0;
+        }
+#endif // #if NETCODE_SOCKET_BATCHING
+
+        // process packets received from socket
+
+        while ( 1 )
+        {
+            // receive straight into a pool buffer. payload packets keep the buffer, so only swap in a new one when that happens
+
+            if ( !server->receive_buffer )
+            {
+                server->receive_buffer = netcode_packet_pool_allocate_receive_buffer( &server->packet_pool );
+                if ( !server->receive_buffer )
+                {
+                    netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: server could not allocate receive buffer\n" );
+                    break;
+                }
+            }
+
+            struct netcode_address_t from;
+            
+            uint8_t * packet_data = server->receive_buffer;
+            
+            int packet_bytes = 0;
+            
+            if ( server->config.override_send_and_receive )
+            {
+                packet_bytes = server->config.receive_packet_override( server->config.callback_context, &from, packet_data, NETCODE_MAX_PACKET_BYTES );
+            }
+            else
+            {
+                if ( receive_from_sockets && server->socket_holder.ipv4.handle != 0 )
+                {
+                    packet_bytes = netcode_socket_receive_packet( &server->socket_holder.ipv4, &from, packet_data, NETCODE_MAX_PACKET_BYTES );
+                    server->counters[NETCODE_SERVER_COUNTER_NUM_SOCKET_RECEIVE_CALLS]++;
+                }
+
+                if ( receive_from_sockets && packet_bytes == 0 && server->socket_holder.ipv6.handle != 0 )
+                {
+                    packet_bytes = netcode_socket_receive_packet( &server->socket_holder.ipv6, &from, packet_data, NETCODE_MAX_PACKET_BYTES );
+                    server->counters[NETCODE_SERVER_COUNTER_NUM_SOCKET_RECEIVE_CALLS]++;
+                }
+
+                if ( packet_bytes == 0 && server->config.aux_receive_packet != NULL )
+                    packet_bytes = server->config.aux_receive_packet( server->config.callback_context, &from, packet_data, NETCODE_MAX_PACKET_BYTES );
+            }
+
+            if ( packet_bytes == 0 )
+                break;
+
+            server->counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_RECEIVED]++;
+
+            int buffer_adopted = 0;
+
+            netcode_server_read_and_process_packet( server, &from, packet_data, packet_bytes, current_timestamp, allowed_packets, &buffer_adopted, -1 );
+
+            if ( buffer_adopted )
+                server->receive_buffer = NULL;
+        }
+    }
+    else
+    {
+        // process packets received from network simulator
+
+        int num_packets_received = netcode_network_simulator_receive_packets( server->config.network_simulator, 
+                                                                              &server->address, 
+                                                                              server->max_receive_packets, 
+                                                                              server->receive_packet_data, 
+                                                                              server->receive_packet_bytes, 
+                                                                              server->receive_from );
+
+        int i;
+        for ( i = 0; i < num_packets_received; ++i )
+        {
+            netcode_server_read_and_process_packet( server, 
+                                                    &server->receive_from[i], 
+                                                    server->receive_packet_data[i], 
+                                                    server->receive_packet_bytes[i], 
+                                                    current_timestamp, 
+                                                    allowed_packets, 
+                                                    NULL, 
+                                                    -1 );
+
+            server->config.free_function( server->config.allocator_context, server->receive_packet_data[i] );
+        }
+    }
+
+    netcode_server_complete_handshakes( server );
+}
+
+void netcode_server_send_session_ticket( struct netcode_server_t * server, int client_index )
+{
+    netcode_assert( server );
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    netcode_assert( server->client_connected[client_index] );
+
+    // a session ticket is a connect token for this server only, minted by the server itself with fresh keys.
+    // the client can hand it back after a disconnect to reconnect in one round trip, without the backend
+
+    struct netcode_connect_token_private_t connect_token_private;
+    netcode_generate_connect_token_private( &connect_token_private, 
+                                            server->client_id[client_index], 
+                                            server->client_timeout[client_index], 
+                                            1, 
+                                            &server->address, 
+                                            server->client_user_data[client_index] );
+    connect_token_private.cipher_suite = server->client_cipher_suite[client_index];
+    connect_token_private.session_ticket = 1;
+    connect_token_private.session_ticket_sequence = server->session_ticket_sequence++;
+
+    struct netcode_connection_session_ticket_packet_t packet;
+    packet.packet_type = NETCODE_CONNECTION_SESSION_TICKET_PACKET;
+    packet.expire_timestamp = (uint64_t) time( NULL ) + server->config.session_ticket_seconds;
+    netcode_generate_nonce( packet.nonce );
+    packet.timeout_seconds = connect_token_private.timeout_seconds;
+    packet.cipher_suite = connect_token_private.cipher_suite;
+    memcpy( packet.client_to_server_key, connect_token_private.client_to_server_key, NETCODE_KEY_BYTES );
+    memcpy( packet.server_to_client_key, connect_token_private.server_to_client_key, NETCODE_KEY_BYTES );
+
+    netcode_write_connect_token_private( &connect_token_private, packet.ticket_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+
+    if ( netcode_encrypt_connect_token_private( packet.ticket_data, 
+                                                NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, 
+                                                NETCODE_VERSION_INFO, 
+                                                server->config.protocol_id, 
+                                                packet.expire_timestamp, 
+                                                packet.nonce, 
+                                                server->config.private_key ) != NETCODE_OK )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: server failed to encrypt session ticket\n" );
+        return;
+    }
+
+    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server sent session ticket packet to client %d\n", client_index );
+
+    netcode_server_send_client_packet( server, &packet, client_index );
+
+    server->client_session_ticket_time[client_index] = server->time;
+}
+
+void netcode_server_send_packets( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    if ( !server->running )
+        return;
+
+    int i;
+    for ( i = 0; i < server->max_clients; ++i )
+    {
+        if ( server->client_connected[i] && !server->client_loopback[i] &&
+             ( server->client_last_packet_send_time[i] + ( 1.0 / NETCODE_PACKET_SEND_RATE ) <= server->time ) )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server sent connection keep alive packet to client %d\n", i );
+            struct netcode_connection_keep_alive_packet_t packet;
+            packet.packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
+            packet.client_index = i;
+            packet.max_clients = server->max_clients;
+            netcode_server_send_client_packet( server, &packet, i );
+        }
+
+        // hand out a fresh session ticket at the half life of the last one, so the client always holds one that
+        // has a while left to run. only once the client is confirmed, since the ticket rides on its connection
+
+        if ( server->config.session_ticket_seconds > 0 && !server->config.shard_group && 
+             server->client_connected[i] && server->client_confirmed[i] && !server->client_loopback[i] &&
+             ( server->client_session_ticket_time[i] + server->config.session_ticket_seconds * 0.5 <= server->time ) )
+        {
+            netcode_server_send_session_ticket( server, i );
+        }
+    }
+}
+
+void netcode_server_check_for_timeouts( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+
+    if ( !server->running )
+        return;
+
+    int i;
+    for ( i = 0; i < server->max_clients; ++i )
+    {
+        if ( server->client_connected[i] && server->client_timeout[i] > 0 && !server->client_loopback[i] &&
+             ( server->client_last_packet_receive_time[i] + server->client_timeout[i] <= server->time ) )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_INFO, "server timed out client %d\n", i );
+            netcode_server_disconnect_client_internal( server, i, 0 );
+        }
+    }
+}
+
+int netcode_server_client_connected( struct netcode_server_t * server, int client_index )
+{
+    netcode_assert( server );
+
+    if ( !server->running )
+        return 0;
+
+    if ( client_index < 0 || client_index >= server->max_clients )
+        return 0;
+
+    return server->client_connected[client_index];
+}
+
+uint64_t netcode_server_client_id( struct netcode_server_t * server, int client_index )
+{
+    netcode_assert( server );
+
+    if ( !server->running )
+        return 0;
+
+    if ( client_index < 0 || client_index >= server->max_clients )
+        return 0;
+
+    return server->client_id[client_index];
+}
+
+struct netcode_address_t * netcode_server_client_address( struct netcode_server_t * server, int client_index )
+{
+    netcode_assert( server );
+
+    if (!server->running)
+        return NULL;
+
+    if (client_index < 0 || client_index >= server->max_clients)
+        return NULL;
+
+    return &server->client_address[client_index];
+}
+
+uint64_t netcode_server_next_packet_sequence( struct netcode_server_t * server, int client_index )
+{
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    if ( !server->client_connected[client_index] )
+        return 0;
+    return server->client_sequence[client_index];    
+}
+
+void netcode_server_send_packet( struct netcode_server_t * server, int client_index, NETCODE_CONST uint8_t * packet_data, int packet_bytes )
+{
+    netcode_assert( server );
+    netcode_assert( packet_data );
+    netcode_assert( packet_bytes >= 0 );
+    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_SIZE );
+
+    if ( !server->running )
+        return;
+
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    if ( !server->client_connected[client_index] )
+        return;
+
+    if ( !server->client_loopback[client_index] )
+    {
+        // the payload is encrypted straight out of the caller's buffer
+
+        struct netcode_connection_payload_packet_t payload_packet;
+        payload_packet.packet_type = NETCODE_CONNECTION_PAYLOAD_PACKET;
+        payload_packet.payload_bytes = packet_bytes;
+        payload_packet.payload_data = (uint8_t*) packet_data;
+
+        struct netcode_connection_payload_packet_t * packet = &payload_packet;
+
+        if ( !server->client_confirmed[client_index] )
+        {
+            struct netcode_connection_keep_alive_packet_t keep_alive_packet;
+            keep_alive_packet.packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
+            keep_alive_packet.client_index = client_index;
+            keep_alive_packet.max_clients = server->max_clients;
+            netcode_server_send_client_packet( server, &keep_alive_packet, client_index );
+        }
+
+        netcode_server_send_client_packet( server, packet, client_index );
+    }
+    else
+    {
+        netcode_assert( server->config.send_loopback_packet_callback );
+
+        server->config.send_loopback_packet_callback( server->config.callback_context,
+                                                      client_index, 
+                                                      packet_data, 
+                                                      packet_bytes, 
+                                                      server->client_sequence[client_index]++ );
+
+        server->client_last_packet_send_time[client_index] = server->time;
+    }
+}
+
+void netcode_server_send_packet_in_place( struct netcode_server_t * server, int client_index, uint8_t * packet_data, int packet_bytes )
+{
+    netcode_assert( server );
+    netcode_assert( packet_data );
+    netcode_assert( packet_bytes > 0 );
+    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_SIZE );
+
+    if ( !server->running )
+        return;
+
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    if ( !server->client_connected[client_index] )
+        return;
+
+    if ( server->client_loopback[client_index] )
+    {
+        netcode_server_send_packet( server, client_index, packet_data, packet_bytes );
+        return;
+    }
+
+    if ( !server->client_confirmed[client_index] )
+    {
+        struct netcode_connection_keep_alive_packet_t keep_alive_packet;
+        keep_alive_packet.packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
+        keep_alive_packet.client_index = client_index;
+        keep_alive_packet.max_clients = server->max_clients;
+        netcode_server_send_client_packet( server, &keep_alive_packet, client_index );
+    }
+
+    if ( !netcode_encryption_manager_touch( &server->encryption_manager, 
+                                            server->client_encryption_index[client_index], 
+                                            &server->client_address[client_index], 
+                                            server->time ) )
+    {
+        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: encryption mapping is out of date for client %d\n", client_index );
+        return;
+    }
+
+    uint8_t * packet_key = netcode_encryption_manager_get_send_key( &server->encryption_manager, server->client_encryption_index[client_index] );
+
+    uint64_t sequence = server->client_sequence[client_index];
+
+#if NETCODE_SOCKET_BATCHING
+    if ( server->config.batch_socket_io && !server->config.network_simulator && !server->config.override_send_and_receive && server->config.aux_send_packet == NULL )
+    {
+        // the batch has to hold on to the datagram until it is flushed, so encrypt straight into the batch rather than in place
+
+        struct netcode_socket_t * socket = ( server->client_address[client_index].type == NETCODE_ADDRESS_IPV6 ) ? &server->socket_holder.ipv6 : &server->socket_holder.ipv4;
+        struct netcode_socket_batch_t * batch = ( socket == &server->socket_holder.ipv6 ) ? &server->send_batch_ipv6 : &server->send_batch_ipv4;
+
+        if ( batch->num_packets == NETCODE_SOCKET_BATCH_SIZE )
+        {
+            netcode_server_flush_send_batch( server, socket, batch );
+        }
+
+        int bytes = netcode_write_payload_packet( batch->packet_data[batch->num_packets], packet_data, packet_bytes, sequence, packet_key, server->config.protocol_id, 0, netcode_server_client_write_packet_cipher( server, client_index ) );
+        if ( bytes <= 0 )
+            return;
+
+        batch->address[batch->num_packets] = server->client_address[client_index];
+        batch->packet_bytes[batch->num_packets] = bytes;
+        batch->num_packets++;
+
+        server->counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_SENT]++;
+        server->client_sequence[client_index]++;
+        server->client_last_packet_send_time[client_index] = server->time;
+        return;
+    }
+#endif // #if NETCODE_SOCKET_BATCHING
+
+    // the packet header goes into the headroom in front of the payload and the mac into the tailroom after it
+
+    uint8_t * packet_start = packet_data - ( 1 + netcode_sequence_number_bytes_required( sequence ) );
+
+    int bytes = netcode_write_payload_packet( packet_start, packet_data, packet_bytes, sequence, packet_key, server->config.protocol_id, 0, netcode_server_client_write_packet_cipher( server, client_index ) );
+    if ( bytes <= 0 )
+        return;
+
+    netcode_server_send_client_packet_data( server, client_index, packet_start, bytes );
+}
+
+void netcode_server_send_packets_together( struct netcode_server_t * server, int client_index, NETCODE_CONST uint8_t ** packet_data, NETCODE_CONST int * packet_bytes, int num_packets )
+{
+    netcode_assert( server );
+    netcode_assert( packet_data );
+    netcode_assert( packet_bytes );
+    netcode_assert( num_packets >= 0 );
+
+    if ( !server->running )
+        return;
+
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    if ( !server->client_connected[client_index] )
+        return;
+
+#if NETCODE_SOCKET_BATCHING
+    if ( server->config.batch_socket_io && !server->client_loopback[client_index] && num_packets <= NETCODE_SOCKET_BATCH_SIZE )
+    {
+        // keep the packets together in one send batch, so they can leave in a single segmented send
+
+        struct netcode_socket_batch_t * batch = ( server->client_address[client_index].type == NETCODE_ADDRESS_IPV6 ) ? &server->send_batch_ipv6 : &server->send_batch_ipv4;
+        struct netcode_socket_t * socket = ( server->client_address[client_index].type == NETCODE_ADDRESS_IPV6 ) ? &server->socket_holder.ipv6 : &server->socket_holder.ipv4;
+
+        if ( batch->num_packets > 0 && batch->num_packets + num_packets > NETCODE_SOCKET_BATCH_SIZE )
+        {
+            netcode_server_flush_send_batch( server, socket, batch );
+        }
+    }
+#endif // #if NETCODE_SOCKET_BATCHING
+
+    int i;
+    for ( i = 0; i < num_packets; ++i )
+    {
+        netcode_server_send_packet( server, client_index, packet_data[i], packet_bytes[i] );
+    }
+}
+
+void netcode_server_send_packets_batch( struct netcode_server_t * server, NETCODE_CONST int * client_index, NETCODE_CONST uint8_t ** packet_data, NETCODE_CONST int * packet_bytes, int num_packets )
+{
+    netcode_assert( server );
+    netcode_assert( client_index );
+    netcode_assert( packet_data );
+    netcode_assert( packet_bytes );
+    netcode_assert( num_packets >= 0 );
+
+    if ( !server->running )
+        return;
+
+    int send_batch_direct = 0;
+
+#if NETCODE_SOCKET_BATCHING
+    send_batch_direct = server->config.batch_socket_io && !server->config.network_simulator && !server->config.override_send_and_receive && server->config.aux_send_packet == NULL;
+#else // #if NETCODE_SOCKET_BATCHING
+    (void) send_batch_direct;
+#endif // #if NETCODE_SOCKET_BATCHING
+
+    // gather up to a full set of lanes worth of packets, encrypt them together, then send them. when sending
+    // through the socket batch, packets are encrypted straight into their batch slots, otherwise into scratch
+
+    uint8_t scratch[NETCODE_AEAD_BATCH_LANES][NETCODE_MAX_PACKET_BYTES];
+
+    int next = 0;
+    while ( next < num_packets )
+    {
+#if NETCODE_SOCKET_BATCHING
+        if ( send_batch_direct )
+        {
+            // slots handed out below must stay put until the whole group is encrypted. leave room for a keep alive
+            // per lane too, so nothing sent while gathering can trigger a flush
+
+            if ( server->send_batch_ipv4.num_packets + 2 * NETCODE_AEAD_BATCH_LANES > NETCODE_SOCKET_BATCH_SIZE )
+                netcode_server_flush_send_batch( server, &server->socket_holder.ipv4, &server->send_batch_ipv4 );
+            if ( server->send_batch_ipv6.num_packets + 2 * NETCODE_AEAD_BATCH_LANES > NETCODE_SOCKET_BATCH_SIZE )
+                netcode_server_flush_send_batch( server, &server->socket_holder.ipv6, &server->send_batch_ipv6 );
+        }
+#endif // #if NETCODE_SOCKET_BATCHING
+
+        int lane_client_index[NETCODE_AEAD_BATCH_LANES];
+        uint8_t * lane_packet_start[NETCODE_AEAD_BATCH_LANES];
+#if NETCODE_SOCKET_BATCHING
+        int lane_batch_slot[NETCODE_AEAD_BATCH_LANES];
+#endif // #if NETCODE_SOCKET_BATCHING
+        int lane_header_bytes[NETCODE_AEAD_BATCH_LANES];
+        uint8_t lane_additional_data[NETCODE_AEAD_BATCH_LANES][NETCODE_VERSION_INFO_BYTES+8+1];
+        uint8_t lane_nonce[NETCODE_AEAD_BATCH_LANES][12];
+
+        uint8_t * output[NETCODE_AEAD_BATCH_LANES];
+        uint8_t * message[NETCODE_AEAD_BATCH_LANES];
+        uint64_t message_length[NETCODE_AEAD_BATCH_LANES];
+        uint8_t * additional[NETCODE_AEAD_BATCH_LANES];
+        uint64_t additional_length[NETCODE_AEAD_BATCH_LANES];
+        uint8_t * nonce[NETCODE_AEAD_BATCH_LANES];
+        uint8_t * key[NETCODE_AEAD_BATCH_LANES];
+
+        int num_lanes = 0;
+
+        while ( next < num_packets && num_lanes < NETCODE_AEAD_BATCH_LANES )
+        {
+            const int index = client_index[next];
+            NETCODE_CONST uint8_t * data = packet_data[next];
+            const int bytes = packet_bytes[next];
+            next++;
+
+            netcode_assert( index >= 0 );
+            netcode_assert( index < server->max_clients );
+            netcode_assert( data );
+            netcode_assert( bytes > 0 );
+            netcode_assert( bytes <= NETCODE_MAX_PACKET_SIZE );
+
+            if ( !server->client_connected[index] )
+                continue;
+
+            if ( server->client_loopback[index] )
+            {
+                netcode_server_send_packet( server, index, data, bytes );
+                continue;
+            }
+
+            if ( server->client_cipher_suite[index] != NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 )
+            {
+                // the lanes only run chacha20-poly1305, so these packets go out one at a time. that can use up send batch
+                // slots, so do it with no lanes gathered and end the group, letting the next one reserve its slots again
+
+                if ( num_lanes > 0 )
+                {
+                    next--;
+                    break;
+                }
+
+                netcode_server_send_packet( server, index, data, bytes );
+                break;
+            }
+
+            if ( !server->client_confirmed[index] )
+            {
+                struct netcode_connection_keep_alive_packet_t keep_alive_packet;
+                keep_alive_packet.packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
+                keep_alive_packet.client_index = index;
+                keep_alive_packet.max_clients = server->max_clients;
+                netcode_server_send_client_packet( server, &keep_alive_packet, index );
+            }
+
+            if ( !netcode_encryption_manager_touch( &server->encryption_manager,
+                                                    server->client_encryption_index[index],
+                                                    &server->client_address[index], 
+                                                    server->time ) )
+            {
+                netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: encryption mapping is out of date for client %d\n", index );
+                continue;
+            }
+
+            uint8_t * packet_start = scratch[num_lanes];
+
+#if NETCODE_SOCKET_BATCHING
+            if ( send_batch_direct )
+            {
+                struct netcode_socket_batch_t * batch = ( server->client_address[index].type == NETCODE_ADDRESS_IPV6 ) ? &server->send_batch_ipv6 : &server->send_batch_ipv4;
+                netcode_assert( batch->num_packets < NETCODE_SOCKET_BATCH_SIZE );
+                const int batch_slot = batch->num_packets++;
+                packet_start = batch->packet_data[batch_slot];
+                batch->address[batch_slot] = server->client_address[index];
+                batch->packet_bytes[batch_slot] = 0;
+                lane_batch_slot[num_lanes] = batch_slot;
+            }
+#endif // #if NETCODE_SOCKET_BATCHING
+
+            // the sequence is taken now, so the same client can show up more than once in a batch
+
+            const uint64_t sequence = server->client_sequence[index]++;
+
+            const int lane = num_lanes++;
+            lane_client_index[lane] = index;
+            lane_packet_start[lane] = packet_start;
+            lane_header_bytes[lane] = netcode_write_payload_packet_header( packet_start, sequence, server->config.protocol_id, 0, lane_additional_data[lane], lane_nonce[lane] );
+
+            output[lane] = packet_start + lane_header_bytes[lane];
+            message[lane] = (uint8_t*) data;
+            message_length[lane] = (uint64_t) bytes;
+            additional[lane] = lane_additional_data[lane];
+            additional_length[lane] = sizeof( lane_additional_data[lane] );
+            nonce[lane] = lane_nonce[lane];
+            key[lane] = netcode_encryption_manager_get_send_key( &server->encryption_manager, server->client_encryption_index[index] );
+        }
+
+        if ( num_lanes == 0 )
+            continue;
+
+        const int encrypt_result = netcode_encrypt_aead_batch( num_lanes, output, message, message_length, additional, additional_length, nonce, key );
+
+        int lane;
+
+        if ( encrypt_result != NETCODE_OK )
+        {
+            netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: failed to encrypt batch of %d packets\n", num_lanes );
+
+#if NETCODE_SOCKET_BATCHING
+            if ( send_batch_direct )
+            {
+                // take the claimed slots back out of the send batches. walk backwards so the slots still to visit don't move
+
+                for ( lane = num_lanes - 1; lane >= 0; --lane )
+                {
+                    const int index = lane_client_index[lane];
+                    struct netcode_socket_batch_t * batch = ( server->client_address[index].type == NETCODE_ADDRESS_IPV6 ) ? &server->send_batch_ipv6 : &server->send_batch_ipv4;
+                    int i;
+                    for ( i = lane_batch_slot[lane]; i < batch->num_packets - 1; ++i )
+                    {
+                        batch->address[i] = batch->address[i+1];
+                        batch->packet_bytes[i] = batch->packet_bytes[i+1];
+                        memcpy( batch->packet_data[i], batch->packet_data[i+1], batch->packet_bytes[i+1] );
+                    }
+                    batch->num_packets--;
+                }
+            }
+#endif // #if NETCODE_SOCKET_BATCHING
+
+            continue;
+        }
+
+        for ( lane = 0; lane < num_lanes; ++lane )
+        {
+            const int index = lane_client_index[lane];
+            const int bytes = lane_header_bytes[lane] + (int) message_length[lane] + NETCODE_MAC_BYTES;
+
+            server->client_last_packet_send_time[index] = server->time;
+
+#if NETCODE_SOCKET_BATCHING
+            if ( send_batch_direct )
+            {
+                struct netcode_socket_batch_t * batch = ( server->client_address[index].type == NETCODE_ADDRESS_IPV6 ) ? &server->send_batch_ipv6 : &server->send_batch_ipv4;
+                netcode_assert( lane_batch_slot[lane] >= 0 && lane_batch_slot[lane] < batch->num_packets );
+                batch->packet_bytes[lane_batch_slot[lane]] = bytes;
+                server->counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_SENT]++;
+                continue;
+            }
+#endif // #if NETCODE_SOCKET_BATCHING
+
+            netcode_server_dispatch_client_packet_data( server, index, lane_packet_start[lane], bytes );
+        }
+    }
+}
+
+uint8_t * netcode_server_receive_packet( struct netcode_server_t * server, int client_index, int * packet_bytes, uint64_t * packet_sequence )
+{
+    netcode_assert( server );
+    netcode_assert( packet_bytes );
+
+    if ( !server->running )
+        return NULL;
+
+    if ( !server->client_connected[client_index] )
+        return NULL;
+
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+
+    struct netcode_connection_payload_packet_t * packet = (struct netcode_connection_payload_packet_t*) 
+        netcode_packet_queue_pop( &server->client_packet_queue[client_index], packet_sequence );
+    
+    if ( packet )
+    {
+        netcode_assert( packet->packet_type == NETCODE_CONNECTION_PAYLOAD_PACKET );
+        *packet_bytes = packet->payload_bytes;
+        netcode_assert( *packet_bytes >= 0 );
+        netcode_assert( *packet_bytes <= NETCODE_MAX_PAYLOAD_BYTES );
+        return packet->payload_data;
+    }
+    else
+    {
+        return NULL;
+    }
+}
+
+void netcode_server_free_packet( struct netcode_server_t * server, void * packet )
+{
+    netcode_assert( server );
+    netcode_assert( packet );
+    netcode_packet_pool_free( &server->packet_pool, packet );
+}
+
+int netcode_server_num_connected_clients( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+    return server->num_connected_clients;
+}
+
+void * netcode_server_client_user_data( struct netcode_server_t * server, int client_index )
+{
+    netcode_assert( server );
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    return server->client_user_data[client_index];
+}
+
+int netcode_server_running( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+    return server->running;
+}
+
+int netcode_server_max_clients( struct netcode_server_t * server )
+{
+    return server->max_clients;
+}
+
+void netcode_server_update( struct netcode_server_t * server, double time )
+{
+    netcode_assert( server );
+    server->time = time;
+    netcode_server_receive_packets( server );
+    netcode_server_send_packets( server );
+    netcode_server_check_for_timeouts( server );
+    netcode_server_flush_packets( server );
+}
+
+void netcode_server_connect_loopback_client( struct netcode_server_t * server, int client_index, uint64_t client_id, NETCODE_CONST uint8_t * user_data )
+{
+    netcode_assert( server );
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    netcode_assert( server->running );
+    netcode_assert( !server->client_connected[client_index] );
+
+    server->num_connected_clients++;
+
+    netcode_assert( server->num_connected_clients <= server->max_clients );
+
+    server->client_loopback[client_index] = 1;
+    server->client_connected[client_index] = 1;
+    server->client_confirmed[client_index] = 1;
+    server->client_encryption_index[client_index] = -1;
+    server->client_id[client_index] = client_id;
+    server->client_sequence[client_index] = 0;
+    memset( &server->client_address[client_index], 0, sizeof( struct netcode_address_t ) );
+    server->client_last_packet_send_time[client_index] = server->time;
+    server->client_last_packet_receive_time[client_index] = server->time;
+
+    if ( user_data )
+    {
+        memcpy( server->client_user_data[client_index], user_data, NETCODE_USER_DATA_BYTES );
+    }
+    else
+    {
+        memset( server->client_user_data[client_index], 0, NETCODE_USER_DATA_BYTES );
+    }
+
+    netcode_printf( NETCODE_LOG_LEVEL_INFO, "server connected loopback client %.16" PRIx64 " in slot %d\n", client_id, client_index );
+
+    if ( server->config.connect_disconnect_callback )
+    {
+        server->config.connect_disconnect_callback( server->config.callback_context, client_index, 1 );
+    }
+}
+
+void netcode_server_disconnect_loopback_client( struct netcode_server_t * server, int client_index )
+{
+    netcode_assert( server );
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    netcode_assert( server->running );
+    netcode_assert( server->client_connected[client_index] );
+    netcode_assert( server->client_loopback[client_index] );
+
+    netcode_printf( NETCODE_LOG_LEVEL_INFO, "server disconnected loopback client %d\n", client_index );
+
+    if ( server->config.connect_disconnect_callback )
+    {
+        server->config.connect_disconnect_callback( server->config.callback_context, client_index, 0 );
+    }
+
+    while ( 1 )
+    {
+        void * packet = netcode_packet_queue_pop( &server->client_packet_queue[client_index], NULL );
+        if ( !packet )
+            break;
+        netcode_packet_pool_free( &server->packet_pool, packet );
+    }
+
+    netcode_packet_queue_clear( &server->client_packet_queue[client_index] );
+
+    server->client_connected[client_index] = 0;
+    server->client_loopback[client_index] = 0;
+    server->client_confirmed[client_index] = 0;
+    server->client_id[client_index] = 0;
+    server->client_sequence[client_index] = 0;
+    server->client_last_packet_send_time[client_index] = 0.0;
+    server->client_last_packet_receive_time[client_index] = 0.0;
+    memset( &server->client_address[client_index], 0, sizeof( struct netcode_address_t ) );
+    server->client_encryption_index[client_index] = -1;
+    server->client_cipher_suite[client_index] = NETCODE_CIPHER_SUITE_CHACHA20_POLY1305;
+    memset( server->client_user_data[client_index], 0, NETCODE_USER_DATA_BYTES );
+
+    server->num_connected_clients--;
+
+    netcode_assert( server->num_connected_clients >= 0 );
+}
+
+int netcode_server_client_loopback( struct netcode_server_t * server, int client_index )
+{
+    netcode_assert( server );
+    netcode_assert( server->running );
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    return server->client_loopback[client_index];
+}
+
+void netcode_server_process_loopback_packet( struct netcode_server_t * server, int client_index, NETCODE_CONST uint8_t * packet_data, int packet_bytes, uint64_t packet_sequence )
+{
+    netcode_assert( server );
+    netcode_assert( client_index >= 0 );
+    netcode_assert( client_index < server->max_clients );
+    netcode_assert( packet_data );
+    netcode_assert( packet_bytes >= 0 );
+    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_SIZE );
+    netcode_assert( server->client_connected[client_index] );
+    netcode_assert( server->client_loopback[client_index] );
+    netcode_assert( server->running );
+
+    struct netcode_connection_payload_packet_t * packet = netcode_create_payload_packet( packet_bytes, &server->packet_pool, netcode_packet_pool_allocate );
+    if ( !packet )
+        return;
+
+    memcpy( packet->payload_data, packet_data, packet_bytes );
+
+    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server processing loopback packet from client %d\n", client_index );
+
+    server->client_last_packet_receive_time[client_index] = server->time;
+
+    netcode_packet_queue_push( &server->client_packet_queue[client_index], packet, packet_sequence );
+}
+
+uint16_t netcode_server_get_port( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+    return server->address.type == NETCODE_ADDRESS_IPV4 ? server->socket_holder.ipv4.address.port : server->socket_holder.ipv6.address.port;
+}
+
+uint64_t netcode_server_socket_handle( struct netcode_server_t * server, int address_type )
+{
+    netcode_assert( server );
+    netcode_assert( address_type == NETCODE_ADDRESS_IPV4 || address_type == NETCODE_ADDRESS_IPV6 );
+
+#if NETCODE_IO_URING
+    // multishot receives drain the socket into the ring, so the socket never becomes readable. hand out the ring
+    // instead, with its receive armed. it is readable whenever a completion is waiting for netcode_server_update
+
+    struct netcode_io_uring_t * ring = address_type == NETCODE_ADDRESS_IPV6 ? server->io_uring_ipv6 : server->io_uring_ipv4;
+    if ( ring )
+    {
+        if ( !ring->receive_armed )
+            netcode_io_uring_submit_receive( ring );
+        return (uint64_t) ring->receive_queue.fd;
+    }
+#endif // #if NETCODE_IO_URING
+
+    return address_type == NETCODE_ADDRESS_IPV6 ? (uint64_t) server->socket_holder.ipv6.handle : (uint64_t) server->socket_holder.ipv4.handle;
+}
+
+int netcode_server_wait( struct netcode_server_t * server, double timeout )
+{
+    netcode_assert( server );
+
+    if ( server->config.network_simulator || server->config.override_send_and_receive )
+        return 1;
+
+    netcode_socket_handle_t handles[2];
+    handles[0] = server->socket_holder.ipv4.handle;
+    handles[1] = server->socket_holder.ipv6.handle;
+
+#if NETCODE_IO_URING
+    // multishot receives drain the socket into the ring, so wait on the ring instead of the socket
+
+    struct netcode_io_uring_t * rings[2] = { server->io_uring_ipv4, server->io_uring_ipv6 };
+    int i;
+    for ( i = 0; i < 2; i++ )
+    {
+        if ( !rings[i] )
+            continue;
+        if ( !rings[i]->receive_armed )
+            netcode_io_uring_submit_receive( rings[i] );
+        struct netcode_io_uring_queue_t * queue = &rings[i]->receive_queue;
+        if ( *queue->cq_head != __atomic_load_n( queue->cq_tail, __ATOMIC_ACQUIRE ) )
+            return 1;
+        handles[i] = (netcode_socket_handle_t) queue->fd;
+    }
+#endif // #if NETCODE_IO_URING
+
+    if ( handles[0] == 0 && handles[1] == 0 )
+        return 1;
+
+    return netcode_socket_wait( handles, 2, timeout );
+}
+
+NETCODE_CONST uint64_t * netcode_server_counters( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+    return server->counters;
+}
+
+int netcode_server_udp_offload_active( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+#if NETCODE_UDP_OFFLOAD
+    return server->udp_offload;
+#else // #if NETCODE_UDP_OFFLOAD
+    return 0;
+#endif // #if NETCODE_UDP_OFFLOAD
+}
+
+int netcode_server_io_uring_active( struct netcode_server_t * server )
+{
+    netcode_assert( server );
+#if NETCODE_IO_URING
+    return server->io_uring_ipv4 != NULL || server->io_uring_ipv6 != NULL;
+#else // #if NETCODE_IO_URING
+    return 0;
+#endif // #if NETCODE_IO_URING
+}
+
+// ----------------------------------------------------------------
+
+int netcode_generate_connect_token( int num_server_addresses, 
+                                    NETCODE_CONST char ** public_server_addresses, 
+                                    NETCODE_CONST char ** internal_server_addresses, 
+                                    int expire_seconds, 
+                                    int timeout_seconds,
+                                    uint64_t client_id, 
+                                    uint64_t protocol_id, 
+                                    NETCODE_CONST uint8_t * private_key, 
+                                    uint8_t * user_data, 
+                                    uint8_t * output_buffer )
+{
+    return netcode_generate_connect_token_with_cipher_suite( num_server_addresses, 
+                                                             public_server_addresses, 
+                                                             internal_server_addresses, 
+                                                             expire_seconds, 
+                                                             timeout_seconds, 
+                                                             client_id, 
+                                                             protocol_id, 
+                                                             private_key, 
+                                                             user_data, 
+                                                             NETCODE_CIPHER_SUITE_CHACHA20_POLY1305, 
+                                                             output_buffer );
+}
+
+int netcode_generate_connect_token_with_cipher_suite( int num_server_addresses, 
+                                                      NETCODE_CONST char ** public_server_addresses, 
+                                                      NETCODE_CONST char ** internal_server_addresses, 
+                                                      int expire_seconds, 
+                                                      int timeout_seconds,
+                                                      uint64_t client_id, 
+                                                      uint64_t protocol_id, 
+                                                      NETCODE_CONST uint8_t * private_key, 
+                                                      uint8_t * user_data, 
+                                                      int cipher_suite, 
+                                                      uint8_t * output_buffer )
+{
+    netcode_assert( num_server_addresses > 0 );
+    netcode_assert( num_server_addresses <= NETCODE_MAX_SERVERS_PER_CONNECT );
+    netcode_assert( public_server_addresses );
+    netcode_assert( internal_server_addresses );
+    netcode_assert( private_key );
+    netcode_assert( user_data );
+    netcode_assert( cipher_suite >= 0 );
+    netcode_assert( cipher_suite < NETCODE_NUM_CIPHER_SUITES );
+    netcode_assert( output_buffer );
+
+    // parse public server addresses
+
+    struct netcode_address_t parsed_public_server_addresses[NETCODE_MAX_SERVERS_PER_CONNECT];
+    int i;
+    for ( i = 0; i < num_server_addresses; ++i )
+    {
+        if ( netcode_parse_address( public_server_addresses[i], &parsed_public_server_addresses[i] ) != NETCODE_OK )
+        {
+            return NETCODE_ERROR;
+        }
+    }
+
+    // parse internal server addresses
+
+     struct netcode_address_t parsed_internal_server_addresses[NETCODE_MAX_SERVERS_PER_CONNECT];
+    for ( i = 0; i < num_server_addresses; ++i )
+    {
+        if ( netcode_parse_address( internal_server_addresses[i], &parsed_internal_server_addresses[i] ) != NETCODE_OK )
+        {
+            return NETCODE_ERROR;
+        }
+    }
+
+    // generate a connect token
+
+    uint8_t nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
+    netcode_generate_nonce(nonce);
+
+    struct netcode_connect_token_private_t connect_token_private;
+    netcode_generate_connect_token_private( &connect_token_private, client_id, timeout_seconds, num_server_addresses, parsed_internal_server_addresses, user_data );
+    connect_token_private.cipher_suite = cipher_suite;
+
+    // write it to a buffer
+
+    uint8_t connect_token_data[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
+    netcode_write_connect_token_private( &connect_token_private, connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+
+    // encrypt the buffer
+
+    uint64_t create_timestamp = time( NULL );
+    uint64_t expire_timestamp = ( expire_seconds >= 0 ) ? ( create_timestamp + expire_seconds ) : 0xFFFFFFFFFFFFFFFFULL;
+    if ( netcode_encrypt_connect_token_private( connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, NETCODE_VERSION_INFO, protocol_id, expire_timestamp, nonce, private_key ) != NETCODE_OK )
+        return NETCODE_ERROR;
+
+    // wrap a connect token around the private connect token data
+
+    struct netcode_connect_token_t connect_token;
+    memcpy( connect_token.version_info, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
+    connect_token.protocol_id = protocol_id;
+    connect_token.create_timestamp = create_timestamp;
+    connect_token.expire_timestamp = expire_timestamp;
+    memcpy( connect_token.nonce, nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+    memcpy( connect_token.private_data, connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    connect_token.num_server_addresses = num_server_addresses;
+    for ( i = 0; i < num_server_addresses; ++i )
+        connect_token.server_addresses[i] = parsed_public_server_addresses[i];
+    memcpy( connect_token.client_to_server_key, connect_token_private.client_to_server_key, NETCODE_KEY_BYTES );
+    memcpy( connect_token.server_to_client_key, connect_token_private.server_to_client_key, NETCODE_KEY_BYTES );
+    connect_token.timeout_seconds = timeout_seconds;
+    connect_token.cipher_suite = cipher_suite;
+
+    // write the connect token to the output buffer
+
+    netcode_write_connect_token( &connect_token, output_buffer, NETCODE_CONNECT_TOKEN_BYTES );
+
+    return NETCODE_OK;
+}
+
+// ---------------------------------------------------------------
+
+#if __APPLE__
+
+// MacOS
+
+#include <unistd.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+
+void netcode_sleep( double time )
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t) time;
+    ts.tv_nsec = (long) ((time - (double) ( ts.tv_sec )) * 1000000000.0);
+    nanosleep( &ts, NULL );
+}
+
+static uint64_t start = 0;
+static mach_timebase_info_data_t timebase_info;
+
+double netcode_time()
+{
+    if ( start == 0 )
+    {
+        mach_timebase_info( &timebase_info );
+        start = mach_absolute_time();
+        return 0.0;
+    }
+    uint64_t current = mach_absolute_time();
+    return ( (double) ( current - start ) ) * ( (double) timebase_info.numer ) / ( (double) timebase_info.denom ) / 1000000000.0;
+}
+
+#elif __linux
+
+// linux
+
+#include <unistd.h>
+
+void netcode_sleep( double time )
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t) time;
+    ts.tv_nsec = (long) ((time - (double) ( ts.tv_sec )) * 1000000000.0);
+    nanosleep( &ts, NULL );
+}
+
+double netcode_time()
+{
+    static double start = -1;
+    if ( start == -1 )
+    {
+        struct timespec ts;
+        clock_gettime( CLOCK_MONOTONIC_RAW, &ts );
+        start = ts.tv_sec + ( (double) ( ts.tv_nsec ) ) / 1000000000.0;
+        return 0.0;
+    }
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC_RAW, &ts );
+    double current = ts.tv_sec + ( (double) ( ts.tv_nsec ) ) / 1000000000.0;
+    return current - start;
+}
+
+#elif defined(__EMSCRIPTEN__)
+
+#elif defined( _WIN32 )
+
+// windows
+
+#define NOMINMAX
+#include <windows.h>
+
+void netcode_sleep( double time )
+{
+    int milliseconds = (int) ( time * 1000 );
+    Sleep( milliseconds );
+}
+
+static int timer_initialized = 0;
+static LARGE_INTEGER timer_frequency;
+static LARGE_INTEGER timer_start;
+
+double netcode_time()
+{
+    if ( !timer_initialized )
+    {
+        QueryPerformanceFrequency( &timer_frequency );
+        QueryPerformanceCounter( &timer_start );
+        timer_initialized = 1;
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter( &now );
+    return ( (double) ( now.QuadPart - timer_start.QuadPart ) ) / ( (double) ( timer_frequency.QuadPart ) );
+}
+
+#elif defined(__EMSCRIPTEN__)
+
+#else
+
+#error unsupported platform!
+
+#endif
+
+// ---------------------------------------------------------------
+
+#if NETCODE_ENABLE_TESTS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <time.h>
+
+static void check_handler( NETCODE_CONST char * condition, 
+                           NETCODE_CONST char * function,
+                           NETCODE_CONST char * file,
+                           int line )
+{
+    printf( "check failed: ( %s ), function %s, file %s, line %d\n", condition, function, file, line );
+#ifdef NETCODE_DEBUG
+    #if defined( __GNUC__ )
+        __builtin_trap();
+    #elif defined( _MSC_VER )
+        __debugbreak();
+    #endif
+#endif
+    exit( 1 );
+}
+
+#define check( condition )                                                                                      \
+do                                                                                                              \
+{                                                                                                               \
+    if ( !(condition) )                                                                                         \
+    {                                                                                                           \
+        check_handler( #condition, (NETCODE_CONST char*) __FUNCTION__, (char*) __FILE__, __LINE__ );            \
+    }                                                                                                           \
+} while(0)
+
+static void test_queue()
+{
+    struct netcode_packet_queue_t queue;
+
+    netcode_packet_queue_init( &queue, NULL, NULL, NULL );
+
+    check( queue.num_packets == 0 );
+    check( queue.start_index == 0 );
+
+    // attempting to pop a packet off an empty queue should return NULL
+
+    check( netcode_packet_queue_pop( &queue, NULL ) == NULL );
+
+    // add some packets to the queue and make sure they pop off in the correct order
+    {
+        #define NUM_PACKETS 100
+
+        void * packets[NUM_PACKETS];
+
+        int i;
+        for ( i = 0; i < NUM_PACKETS; ++i )
+        {
+            packets[i] = malloc( (i+1) * 256 );
+            check( netcode_packet_queue_push( &queue, packets[i], (uint64_t) i ) == 1 );
+        }
+
+        check( queue.num_packets == NUM_PACKETS );
+
+        for ( i = 0; i < NUM_PACKETS; ++i )
+        {
+            uint64_t sequence = 0;
+            void * packet = netcode_packet_queue_pop( &queue, &sequence );
+            check( sequence == (uint64_t) i ) ;
+            check( packet == packets[i] );
+            free( packet );
+        }
+    }
+
+    // after all entries are popped off, the queue is empty, so calls to pop should return NULL
+
+    check( queue.num_packets == 0 );
+
+    check( netcode_packet_queue_pop( &queue, NULL ) == NULL );
+
+    // test that the packet queue can be filled to max capacity
+
+    void * packets[NETCODE_PACKET_QUEUE_SIZE];
+
+    int i;
+    for ( i = 0; i < NETCODE_PACKET_QUEUE_SIZE; ++i )
+    {
+        packets[i] = malloc( i * 256 );
+        check( netcode_packet_queue_push( &queue, packets[i], (uint64_t) i ) == 1 );
+    }
+
+    check( queue.num_packets == NETCODE_PACKET_QUEUE_SIZE );
+
+    // when the queue is full, attempting to push a packet should fail and return 0
+
+    check( netcode_packet_queue_push( &queue, malloc( 100 ), 0 ) == 0 );
+
+    // make sure all packets pop off in the correct order
+
+    for ( i = 0; i < NETCODE_PACKET_QUEUE_SIZE; ++i )
+    {
+        uint64_t sequence = 0;
+        void * packet = netcode_packet_queue_pop( &queue, &sequence );
+        check( sequence == (uint64_t) i );
+        check( packet == packets[i] );
+        free( packet );
+    }
+
+    // add some packets again
+
+    for ( i = 0; i < NETCODE_PACKET_QUEUE_SIZE; ++i )
+    {
+        packets[i] = malloc( i * 256 );
+        check( netcode_packet_queue_push( &queue, packets[i], (uint64_t) i ) == 1 );
+    }
+
+    // clear the queue and make sure that all packets are freed
+
+    netcode_packet_queue_clear( &queue );
+
+    check( queue.start_index == 0 );
+    check( queue.num_packets == 0 );
+    for ( i = 0; i < NETCODE_PACKET_QUEUE_SIZE; ++i )
+        check( queue.packet_data[i] == NULL );
+}
+
+static void test_endian()
+{
+    uint32_t value = 0x11223344;
+
+    char * bytes = (char*) &value;
+
+#if NETCODE_LITTLE_ENDIAN
+
+    check( bytes[0] == 0x44 );
+    check( bytes[1] == 0x33 );
+    check( bytes[2] == 0x22 );
+    check( bytes[3] == 0x11 );
+
+#else // #if NETCODE_LITTLE_ENDIAN
+
+    check( bytes[3] == 0x44 );
+    check( bytes[2] == 0x33 );
+    check( bytes[1] == 0x22 );
+    check( bytes[0] == 0x11 );
+
+#endif // #if NETCODE_LITTLE_ENDIAN
+}
+
+static void test_sequence()
+{
+    check( netcode_sequence_number_bytes_required( 0 ) == 1 );
+    check( netcode_sequence_number_bytes_required( 0x11 ) == 1 );
+    check( netcode_sequence_number_bytes_required( 0x1122 ) == 2 );
+    check( netcode_sequence_number_bytes_required( 0x112233 ) == 3 );
+    check( netcode_sequence_number_bytes_required( 0x11223344 ) == 4 );
+    check( netcode_sequence_number_bytes_required( 0x1122334455 ) == 5 );
+    check( netcode_sequence_number_bytes_required( 0x112233445566 ) == 6 );
+    check( netcode_sequence_number_bytes_required( 0x11223344556677 ) == 7 );
+    check( netcode_sequence_number_bytes_required( 0x1122334455667788 ) == 8 );
+}
+
+static void test_address()
+{
+    {
+        struct netcode_address_t address;
+        check( netcode_parse_address( "", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( "[", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( "[]", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( "[]:", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( ":", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( "1", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( "12", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( "123", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( "1234", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( "1234.0.12313.0000", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( "1234.0.12313.0000.0.0.0.0.0", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( "1312313:123131:1312313:123131:1312313:123131:1312313:123131:1312313:123131:1312313:123131", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( ".", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( "..", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( "...", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( "....", &address ) == NETCODE_ERROR );
+        check( netcode_parse_address( ".....", &address ) == NETCODE_ERROR );
+    }
+
+    {
+        struct netcode_address_t address;
+        check( netcode_parse_address( "107.77.207.77", &address ) == NETCODE_OK );
+        check( address.type == NETCODE_ADDRESS_IPV4 );
+        check( address.port == 0 );
+        check( address.data.ipv4[0] == 107 );
+        check( address.data.ipv4[1] == 77 );
+        check( address.data.ipv4[2] == 207 );
+        check( address.data.ipv4[3] == 77 );
+    }
+
+    {
+        struct netcode_address_t address;
+        check( netcode_parse_address( "127.0.0.1", &address ) == NETCODE_OK );
+        check( address.type == NETCODE_ADDRESS_IPV4 );
+        check( address.port == 0 );
+        check( address.data.ipv4[0] == 127 );
+        check( address.data.ipv4[1] == 0 );
+        check( address.data.ipv4[2] == 0 );
+        check( address.data.ipv4[3] == 1 );
+    }
+
+    {
+        struct netcode_address_t address;
+        check( netcode_parse_address( "107.77.207.77:40000", &address ) == NETCODE_OK );
+        check( address.type == NETCODE_ADDRESS_IPV4 );
+        check( address.port == 40000 );
+        check( address.data.ipv4[0] == 107 );
+        check( address.data.ipv4[1] == 77 );
+        check( address.data.ipv4[2] == 207 );
+        check( address.data.ipv4[3] == 77 );
+    }
+
+    {
+        struct netcode_address_t address;
+        check( netcode_parse_address( "127.0.0.1:40000", &address ) == NETCODE_OK );
+        check( address.type == NETCODE_ADDRESS_IPV4 );
+        check( address.port == 40000 );
+        check( address.data.ipv4[0] == 127 );
+        check( address.data.ipv4[1] == 0 );
+        check( address.data.ipv4[2] == 0 );
+        check( address.data.ipv4[3] == 1 );
+    }
+
+    {
+        struct netcode_address_t address;
+        check( netcode_parse_address( "fe80::202:b3ff:fe1e:8329", &address ) == NETCODE_OK );
+        check( address.type == NETCODE_ADDRESS_IPV6 );
+        check( address.port == 0 );
+        check( address.data.ipv6[0] == 0xfe80 );
+        check( address.data.ipv6[1] == 0x0000 );
+        check( address.data.ipv6[2] == 0x0000 );
+        check( address.data.ipv6[3] == 0x0000 );
+        check( address.data.ipv6[4] == 0x0202 );
+        check( address.data.ipv6[5] == 0xb3ff );
+        check( address.data.ipv6[6] == 0xfe1e );
+        check( address.data.ipv6[7] == 0x8329 );
+    }
+
+    {
+        struct netcode_address_t address;
+        check( netcode_parse_address( "::", &address ) == NETCODE_OK );
+        check( address.type == NETCODE_ADDRESS_IPV6 );
+        check( address.port == 0 );
+        check( address.data.ipv6[0] == 0x0000 );
+        check( address.data.ipv6[1] == 0x0000 );
+        check( address.data.ipv6[2] == 0x0000 );
+        check( address.data.ipv6[3] == 0x0000 );
+        check( address.data.ipv6[4] == 0x0000 );
+        check( address.data.ipv6[5] == 0x0000 );
+        check( address.data.ipv6[6] == 0x0000 );
+        check( address.data.ipv6[7] == 0x0000 );
+    }
+
+    {
+        struct netcode_address_t address;
+        check( netcode_parse_address( "::1", &address ) == NETCODE_OK );
+        check( address.type == NETCODE_ADDRESS_IPV6 );
+        check( address.port == 0 );
+        check( address.data.ipv6[0] == 0x0000 );
+        check( address.data.ipv6[1] == 0x0000 );
+        check( address.data.ipv6[2] == 0x0000 );
+        check( address.data.ipv6[3] == 0x0000 );
+        check( address.data.ipv6[4] == 0x0000 );
+        check( address.data.ipv6[5] == 0x0000 );
+        check( address.data.ipv6[6] == 0x0000 );
+        check( address.data.ipv6[7] == 0x0001 );
+    }
+
+    {
+        struct netcode_address_t address;
+        check( netcode_parse_address( "[fe80::202:b3ff:fe1e:8329]:40000", &address ) == NETCODE_OK );
+        check( address.type == NETCODE_ADDRESS_IPV6 );
+        check( address.port == 40000 );
+        check( address.data.ipv6[0] == 0xfe80 );
+        check( address.data.ipv6[1] == 0x0000 );
+        check( address.data.ipv6[2] == 0x0000 );
+        check( address.data.ipv6[3] == 0x0000 );
+        check( address.data.ipv6[4] == 0x0202 );
+        check( address.data.ipv6[5] == 0xb3ff );
+        check( address.data.ipv6[6] == 0xfe1e );
+        check( address.data.ipv6[7] == 0x8329 );
+    }
+
+    {
+        struct netcode_address_t address;
+        check( netcode_parse_address( "[::]:40000", &address ) == NETCODE_OK );
+        check( address.type == NETCODE_ADDRESS_IPV6 );
+        check( address.port == 40000 );
+        check( address.data.ipv6[0] == 0x0000 );
+        check( address.data.ipv6[1] == 0x0000 );
+        check( address.data.ipv6[2] == 0x0000 );
+        check( address.data.ipv6[3] == 0x0000 );
+        check( address.data.ipv6[4] == 0x0000 );
+        check( address.data.ipv6[5] == 0x0000 );
+        check( address.data.ipv6[6] == 0x0000 );
+        check( address.data.ipv6[7] == 0x0000 );
+    }
+
+    {
+        struct netcode_address_t address;
+        check( netcode_parse_address( "[::1]:40000", &address ) == NETCODE_OK );
+        check( address.type == NETCODE_ADDRESS_IPV6 );
+        check( address.port == 40000 );
+        check( address.data.ipv6[0] == 0x0000 );
+        check( address.data.ipv6[1] == 0x0000 );
+        check( address.data.ipv6[2] == 0x0000 );
+        check( address.data.ipv6[3] == 0x0000 );
+        check( address.data.ipv6[4] == 0x0000 );
+        check( address.data.ipv6[5] == 0x0000 );
+        check( address.data.ipv6[6] == 0x0000 );
+        check( address.data.ipv6[7] == 0x0001 );
+    }
+}
+
+#define TEST_PROTOCOL_ID            0x1122334455667788ULL
+#define TEST_CLIENT_ID              0x1ULL
+#define TEST_SERVER_PORT            40000
+#define TEST_CONNECT_TOKEN_EXPIRY   30
+#define TEST_TIMEOUT_SECONDS        15
+
+static void test_connect_token()
+{
+    // generate a connect token
+
+    struct netcode_address_t server_address;
+    server_address.type = NETCODE_ADDRESS_IPV4;
+    server_address.data.ipv4[0] = 127;
+    server_address.data.ipv4[1] = 0;
+    server_address.data.ipv4[2] = 0;
+    server_address.data.ipv4[3] = 1;
+    server_address.port = TEST_SERVER_PORT;
+
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    netcode_random_bytes( user_data, NETCODE_USER_DATA_BYTES );
+
+    struct netcode_connect_token_private_t input_token;
+
+    netcode_generate_connect_token_private( &input_token, TEST_CLIENT_ID, TEST_TIMEOUT_SECONDS, 1, &server_address, user_data );
+
+    check( input_token.client_id == TEST_CLIENT_ID );
+    check( input_token.num_server_addresses == 1 );
+    check( memcmp( input_token.user_data, user_data, NETCODE_USER_DATA_BYTES ) == 0 );
+    check( netcode_address_equal( &input_token.server_addresses[0], &server_address ) );
+    check( input_token.cipher_suite == NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 );
+
+    input_token.cipher_suite = NETCODE_CIPHER_SUITE_AES256_GCM;
+
+    // write it to a buffer
+
+    uint8_t buffer[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
+
+    netcode_write_connect_token_private( &input_token, buffer, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+
+    // encrypt the buffer
+
+    uint64_t expire_timestamp = time( NULL ) + 30;
+    uint8_t nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
+    netcode_generate_nonce(nonce);
+    uint8_t key[NETCODE_KEY_BYTES];
+    netcode_generate_key( key );    
+
+    check( netcode_encrypt_connect_token_private( buffer, 
+                                                  NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, 
+                                                  NETCODE_VERSION_INFO, 
+                                                  TEST_PROTOCOL_ID, 
+                                                  expire_timestamp, 
+                                                  nonce, 
+                                                  key ) == NETCODE_OK );
+
+    // decrypt the buffer
+
+    check( netcode_decrypt_connect_token_private( buffer, 
+                                                  NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, 
+                                                  NETCODE_VERSION_INFO, 
+                                                  TEST_PROTOCOL_ID, 
+                                                  expire_timestamp, 
+                                                  nonce, 
+                                                  key ) == NETCODE_OK );
+
+    // read the connect token back in
+
+    struct netcode_connect_token_private_t output_token;
+
+    check( netcode_read_connect_token_private( buffer, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, &output_token ) == NETCODE_OK );
+
+    // make sure that everything matches the original connect token
+
+    check( output_token.client_id == input_token.client_id );
+    check( output_token.timeout_seconds == input_token.timeout_seconds );
+    check( output_token.num_server_addresses == input_token.num_server_addresses );
+    check( netcode_address_equal( &output_token.server_addresses[0], &input_token.server_addresses[0] ) );
+    check( memcmp( output_token.client_to_server_key, input_token.client_to_server_key, NETCODE_KEY_BYTES ) == 0 );
+    check( memcmp( output_token.server_to_client_key, input_token.server_to_client_key, NETCODE_KEY_BYTES ) == 0 );
+    check( memcmp( output_token.user_data, input_token.user_data, NETCODE_USER_DATA_BYTES ) == 0 );
+    check( output_token.cipher_suite == input_token.cipher_suite );
+}
+
+static void test_challenge_token()
+{
+    // generate a challenge token
+
+    struct netcode_challenge_token_t input_token;
+
+    input_token.client_id = TEST_CLIENT_ID;
+    netcode_random_bytes( input_token.user_data, NETCODE_USER_DATA_BYTES );
+    input_token.cipher_suite = NETCODE_CIPHER_SUITE_AES256_GCM;
+
+    // write it to a buffer
+
+    uint8_t buffer[NETCODE_CHALLENGE_TOKEN_BYTES];
+
+    netcode_write_challenge_token( &input_token, buffer, NETCODE_CHALLENGE_TOKEN_BYTES );
+
+    // encrypt the buffer
+
+    uint64_t sequence = 1000;
+    uint8_t key[NETCODE_KEY_BYTES]; 
+    netcode_generate_key( key );    
+
+    check( netcode_encrypt_challenge_token( buffer, NETCODE_CHALLENGE_TOKEN_BYTES, sequence, key ) == NETCODE_OK );
+
+    // decrypt the buffer
+
+    check( netcode_decrypt_challenge_token( buffer, NETCODE_CHALLENGE_TOKEN_BYTES, sequence, key ) == NETCODE_OK );
+
+    // read the challenge token back in
+
+    struct netcode_challenge_token_t output_token;
+
+    check( netcode_read_challenge_token( buffer, NETCODE_CHALLENGE_TOKEN_BYTES, &output_token ) == NETCODE_OK );
+
+    // make sure that everything matches the original challenge token
+
+    check( output_token.client_id == input_token.client_id );
+    check( memcmp( output_token.user_data, input_token.user_data, NETCODE_USER_DATA_BYTES ) == 0 );
+    check( output_token.cipher_suite == input_token.cipher_suite );
+}
+
+static void test_connection_request_packet()
+{
+    // generate a connect token
+
+    struct netcode_address_t server_address;
+    server_address.type = NETCODE_ADDRESS_IPV4;
+    server_address.data.ipv4[0] = 127;
+    server_address.data.ipv4[1] = 0;
+    server_address.data.ipv4[2] = 0;
+    server_address.data.ipv4[3] = 1;
+    server_address.port = TEST_SERVER_PORT;
+
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    netcode_random_bytes( user_data, NETCODE_USER_DATA_BYTES );
+
+    struct netcode_connect_token_private_t input_token;
+
+    netcode_generate_connect_token_private( &input_token, TEST_CLIENT_ID, TEST_TIMEOUT_SECONDS, 1, &server_address, user_data );
+
+    check( input_token.client_id == TEST_CLIENT_ID );
+    check( input_token.num_server_addresses == 1 );
+    check( memcmp( input_token.user_data, user_data, NETCODE_USER_DATA_BYTES ) == 0 );
+    check( netcode_address_equal( &input_token.server_addresses[0], &server_address ) );
+
+    // write the conect token to a buffer (non-encrypted)
+
+    uint8_t connect_token_data[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
+
+    netcode_write_connect_token_private( &input_token, connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+
+    // copy to a second buffer then encrypt it in place (we need the unencrypted token for verification later on)
+
+    uint8_t encrypted_connect_token_data[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
+
+    memcpy( encrypted_connect_token_data, connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+
+    uint64_t connect_token_expire_timestamp = time( NULL ) + 30;
+    uint8_t connect_token_nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
+    netcode_generate_nonce(connect_token_nonce);
+    uint8_t connect_token_key[NETCODE_KEY_BYTES];
+    netcode_generate_key( connect_token_key );
+
+    check( netcode_encrypt_connect_token_private( encrypted_connect_token_data, 
+                                                  NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, 
+                                                  NETCODE_VERSION_INFO, 
+                                                  TEST_PROTOCOL_ID, 
+                                                  connect_token_expire_timestamp, 
+                                                  connect_token_nonce, 
+                                                  connect_token_key ) == NETCODE_OK );
+
+    // setup a connection request packet wrapping the encrypted connect token
+
+    struct netcode_connection_request_packet_t input_packet;
+
+    input_packet.packet_type = NETCODE_CONNECTION_REQUEST_PACKET;
+    memcpy( input_packet.version_info, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
+    input_packet.protocol_id = TEST_PROTOCOL_ID;
+    input_packet.connect_token_expire_timestamp = connect_token_expire_timestamp;
+    memcpy( input_packet.connect_token_nonce, connect_token_nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+    memcpy( input_packet.connect_token_data, encrypted_connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    input_packet.cipher_suite = NETCODE_CIPHER_SUITE_AES256_GCM;
+
+    // write the connection request packet to a buffer
+
+    uint8_t buffer[2048];
+
+    uint8_t packet_key[NETCODE_KEY_BYTES];
+
+    netcode_generate_key( packet_key );
+
+    int bytes_written = netcode_write_packet( &input_packet, buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID, NULL );
+
+    check( bytes_written > 0 );
+
+    // read the connection request packet back in from the buffer (the connect token data is decrypted as part of the read packet validation)
+
+    uint64_t sequence = 1000;
+
+    uint8_t allowed_packets[NETCODE_CONNECTION_NUM_PACKETS];
+    memset( allowed_packets, 1, sizeof( allowed_packets ) );
+
+    struct netcode_connection_request_packet_t * output_packet = (struct netcode_connection_request_packet_t*) 
+        netcode_read_packet( buffer, bytes_written, &sequence, packet_key, TEST_PROTOCOL_ID, time( NULL ), connect_token_key, allowed_packets, NULL, NULL, NULL, NULL );
+
+    check( output_packet );
+
+    // make sure the read packet matches what was written
+    
+    check( output_packet->packet_type == NETCODE_CONNECTION_REQUEST_PACKET );
+    check( memcmp( output_packet->version_info, input_packet.version_info, NETCODE_VERSION_INFO_BYTES ) == 0 );
+    check( output_packet->protocol_id == input_packet.protocol_id );
+    check( output_packet->connect_token_expire_timestamp == input_packet.connect_token_expire_timestamp );
+    check( memcmp( output_packet->connect_token_nonce, input_packet.connect_token_nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES ) == 0 );
+    check( memcmp( output_packet->connect_token_data, connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES - NETCODE_MAC_BYTES ) == 0 );
+    check( output_packet->cipher_suite == input_packet.cipher_suite );
+
+    free( output_packet );
+}
+
+void test_connection_denied_packet()
+{
+    // setup a connection denied packet
+
+    struct netcode_connection_denied_packet_t input_packet;
+
+    input_packet.packet_type = NETCODE_CONNECTION_DENIED_PACKET;
+
+    // write the packet to a buffer
+
+    uint8_t buffer[NETCODE_MAX_PACKET_BYTES];
+
+    uint8_t packet_key[NETCODE_KEY_BYTES];
+
+    netcode_generate_key( packet_key );
+
+    int bytes_written = netcode_write_packet( &input_packet, buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID, NULL );
+
+    check( bytes_written > 0 );
+
+    // read the packet back in from the buffer
+
+    uint64_t sequence;
+
+    uint8_t allowed_packet_types[NETCODE_CONNECTION_NUM_PACKETS];
+    memset( allowed_packet_types, 1, sizeof( allowed_packet_types ) );
+
+    struct netcode_connection_denied_packet_t * output_packet = (struct netcode_connection_denied_packet_t*) 
+        netcode_read_packet( buffer, bytes_written, &sequence, packet_key, TEST_PROTOCOL_ID, time( NULL ), NULL, allowed_packet_types, NULL, NULL, NULL, NULL );
+
+    check( output_packet );
+
+    // make sure the read packet matches what was written
+    
+    check( output_packet->packet_type == NETCODE_CONNECTION_DENIED_PACKET );
+
+    free( output_packet );
+}
+
+void test_connection_challenge_packet()
+{
+    // setup a connection challenge packet
+
+    struct netcode_connection_challenge_packet_t input_packet;
+
+    input_packet.packet_type = NETCODE_CONNECTION_CHALLENGE_PACKET;
+    input_packet.challenge_token_sequence = 0;
+    netcode_random_bytes( input_packet.challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
+    input_packet.cipher_suite = NETCODE_CIPHER_SUITE_AES256_GCM;
+
+    // write the packet to a buffer
+
+    uint8_t buffer[NETCODE_MAX_PACKET_BYTES];
+
+    uint8_t packet_key[NETCODE_KEY_BYTES];
+
+    netcode_generate_key( packet_key );
+
+    int bytes_written = netcode_write_packet( &input_packet, buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID, NULL );
+
+    check( bytes_written > 0 );
+
+    // read the packet back in from the buffer
+
+    uint64_t sequence;
+
+    uint8_t allowed_packet_types[NETCODE_CONNECTION_NUM_PACKETS];
+    memset( allowed_packet_types, 1, sizeof( allowed_packet_types ) );
+
+    struct netcode_connection_challenge_packet_t * output_packet = (struct netcode_connection_challenge_packet_t*) 
+        netcode_read_packet( buffer, bytes_written, &sequence, packet_key, TEST_PROTOCOL_ID, time( NULL ), NULL, allowed_packet_types, NULL, NULL, NULL, NULL );
+
+    check( output_packet );
+
+    // make sure the read packet packet matches what was written
+    
+    check( output_packet->packet_type == NETCODE_CONNECTION_CHALLENGE_PACKET );
+    check( output_packet->challenge_token_sequence == input_packet.challenge_token_sequence );
+    check( memcmp( output_packet->challenge_token_data, input_packet.challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES ) == 0 );
+    check( output_packet->cipher_suite == input_packet.cipher_suite );
+
+    free( output_packet );
+}
+
+void test_connection_response_packet()
+{
+    // setup a connection response packet
+
+    struct netcode_connection_response_packet_t input_packet;
+
+    input_packet.packet_type = NETCODE_CONNECTION_RESPONSE_PACKET;
+    input_packet.challenge_token_sequence = 0;
+    netcode_random_bytes( input_packet.challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
+
+    // write the packet to a buffer
+
+    uint8_t buffer[NETCODE_MAX_PACKET_BYTES];
+
+    uint8_t packet_key[NETCODE_KEY_BYTES];
+
+    netcode_generate_key( packet_key );
+    
+    int bytes_written = netcode_write_packet( &input_packet, buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID, NULL );
+
+    check( bytes_written > 0 );
+
+    // read the packet back in from the buffer
+
+    uint64_t sequence;
+
+    uint8_t allowed_packet_types[NETCODE_CONNECTION_NUM_PACKETS];
+    memset( allowed_packet_types, 1, sizeof( allowed_packet_types ) );
+
+    struct netcode_connection_response_packet_t * output_packet = (struct netcode_connection_response_packet_t*) 
+        netcode_read_packet( buffer, bytes_written, &sequence, packet_key, TEST_PROTOCOL_ID, time( NULL ), NULL, allowed_packet_types, NULL, NULL, NULL, NULL );
+
+    check( output_packet );
+
+    // make sure the read packet matches what was written
+    
+    check( output_packet->packet_type == NETCODE_CONNECTION_RESPONSE_PACKET );
+    check( output_packet->challenge_token_sequence == input_packet.challenge_token_sequence );
+    check( memcmp( output_packet->challenge_token_data, input_packet.challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES ) == 0 );
+
+    free( output_packet );
+}
+
+void test_connection_keep_alive_packet()
+{
+    // setup a connection keep alive packet
+
+    struct netcode_connection_keep_alive_packet_t input_packet;
+
+    input_packet.packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
+    input_packet.client_index = 10;
+    input_packet.max_clients = 16;
+
+    // write the packet to a buffer
+
+    uint8_t buffer[NETCODE_MAX_PACKET_BYTES];
+
+    uint8_t packet_key[NETCODE_KEY_BYTES];
+
+    netcode_generate_key( packet_key );
+
+    int bytes_written = netcode_write_packet( &input_packet, buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID, NULL );
+
+    check( bytes_written > 0 );
+
+    // read the packet back in from the buffer
+
+    uint64_t sequence;
+
+    uint8_t allowed_packet_types[NETCODE_CONNECTION_NUM_PACKETS];
+    memset( allowed_packet_types, 1, sizeof( allowed_packet_types ) );
+    
+    struct netcode_connection_keep_alive_packet_t * output_packet = (struct netcode_connection_keep_alive_packet_t*) 
+        netcode_read_packet( buffer, bytes_written, &sequence, packet_key, TEST_PROTOCOL_ID, time( NULL ), NULL, allowed_packet_types, NULL, NULL, NULL, NULL );
+
+    check( output_packet );
+
+    // make sure the read packet matches what was written
+    
+    check( output_packet->packet_type == NETCODE_CONNECTION_KEEP_ALIVE_PACKET );
+    check( output_packet->client_index == input_packet.client_index );
+    check( output_packet->max_clients == input_packet.max_clients );
+
+    free( output_packet );
+}
+
+void test_connection_payload_packet()
+{
+    // setup a connection payload packet
+
+    struct netcode_connection_payload_packet_t * input_packet = netcode_create_payload_packet( NETCODE_MAX_PAYLOAD_BYTES, NULL, NULL );
+
+    check( input_packet->packet_type == NETCODE_CONNECTION_PAYLOAD_PACKET );
+    check( input_packet->payload_bytes == NETCODE_MAX_PAYLOAD_BYTES );
+
+    netcode_random_bytes( input_packet->payload_data, NETCODE_MAX_PAYLOAD_BYTES );
+    
+    // write the packet to a buffer
+
+    uint8_t buffer[NETCODE_MAX_PACKET_BYTES];
+
+    uint8_t packet_key[NETCODE_KEY_BYTES];
+
+    netcode_generate_key( packet_key );
+
+    int bytes_written = netcode_write_packet( input_packet, buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID, NULL );
+
+    check( bytes_written > 0 );
+
+    // read the packet back in from the buffer
+
+    uint64_t sequence;
+
+    uint8_t allowed_packet_types[NETCODE_CONNECTION_NUM_PACKETS];
+    memset( allowed_packet_types, 1, sizeof( allowed_packet_types ) );
+
+    struct netcode_connection_payload_packet_t * output_packet = (struct netcode_connection_payload_packet_t*) 
+        netcode_read_packet( buffer, bytes_written, &sequence, packet_key, TEST_PROTOCOL_ID, time( NULL ), NULL, allowed_packet_types, NULL, NULL, NULL, NULL );
+
+    check( output_packet );
+
+    // make sure the read packet matches what was written
+    
+    check( output_packet->packet_type == NETCODE_CONNECTION_PAYLOAD_PACKET );
+    check( output_packet->payload_bytes == input_packet->payload_bytes );
+    check( memcmp( output_packet->payload_data, input_packet->payload_data, NETCODE_MAX_PAYLOAD_BYTES ) == 0 );
+
+    free( input_packet );
+    free( output_packet );
+}
+
+void test_connection_disconnect_packet()
+{
+    // setup a connection disconnect packet
+
+    struct netcode_connection_disconnect_packet_t input_packet;
+
+    input_packet.packet_type = NETCODE_CONNECTION_DISCONNECT_PACKET;
+
+    // write the packet to a buffer
+
+    uint8_t buffer[NETCODE_MAX_PACKET_BYTES];
+
+    uint8_t packet_key[NETCODE_KEY_BYTES];
+
+    netcode_generate_key( packet_key );
+
+    int bytes_written = netcode_write_packet( &input_packet, buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID, NULL );
+
+    check( bytes_written > 0 );
+
+    // read the packet back in from the buffer
+
+    uint64_t sequence;
+
+    uint8_t allowed_packet_types[NETCODE_CONNECTION_NUM_PACKETS];
+    memset( allowed_packet_types, 1, sizeof( allowed_packet_types ) );
+
+    struct netcode_connection_disconnect_packet_t * output_packet = (struct netcode_connection_disconnect_packet_t*) 
+        netcode_read_packet( buffer, bytes_written, &sequence, packet_key, TEST_PROTOCOL_ID, time( NULL ), NULL, allowed_packet_types, NULL, NULL, NULL, NULL );
+
+    check( output_packet );
+
+    // make sure the read packet matches what was written
+    
+    check( output_packet->packet_type == NETCODE_CONNECTION_DISCONNECT_PACKET );
+
+    free( output_packet );
+}
+
+void test_connect_token_public()
+{
+    // generate a private connect token
+
+    struct netcode_address_t server_address;
+    server_address.type = NETCODE_ADDRESS_IPV4;
+    server_address.data.ipv4[0] = 127;
+    server_address.data.ipv4[1] = 0;
+    server_address.data.ipv4[2] = 0;
+    server_address.data.ipv4[3] = 1;
+    server_address.port = TEST_SERVER_PORT;
+
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    netcode_random_bytes( user_data, NETCODE_USER_DATA_BYTES );
+
+    struct netcode_connect_token_private_t connect_token_private;
+
+    netcode_generate_connect_token_private( &connect_token_private, TEST_CLIENT_ID, TEST_TIMEOUT_SECONDS, 1, &server_address, user_data );
+
+    check( connect_token_private.client_id == TEST_CLIENT_ID );
+    check( connect_token_private.num_server_addresses == 1 );
+    check( memcmp( connect_token_private.user_data, user_data, NETCODE_USER_DATA_BYTES ) == 0 );
+    check( netcode_address_equal( &connect_token_private.server_addresses[0], &server_address ) );
+
+    // write it to a buffer
+
+    uint8_t connect_token_private_data[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
+    netcode_write_connect_token_private( &connect_token_private, connect_token_private_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+
+    // encrypt the buffer
+
+    uint64_t create_timestamp = time( NULL );
+    uint64_t expire_timestamp = create_timestamp + 30;
+    uint8_t connect_token_nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
+    netcode_generate_nonce( connect_token_nonce );    
+    uint8_t key[NETCODE_KEY_BYTES];
+    netcode_generate_key( key );    
+    check( netcode_encrypt_connect_token_private( connect_token_private_data, 
+                                                  NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, 
+                                                  NETCODE_VERSION_INFO, 
+                                                  TEST_PROTOCOL_ID, 
+                                                  expire_timestamp, 
+                                                  connect_token_nonce, 
+                                                  key ) == 1 );
+
+    // wrap a public connect token around the private connect token data
+
+    struct netcode_connect_token_t input_connect_token;
+    memset( &input_connect_token, 0, sizeof( struct netcode_connect_token_t ) );
+    memcpy( input_connect_token.version_info, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
+    input_connect_token.protocol_id = TEST_PROTOCOL_ID;
+    input_connect_token.create_timestamp = create_timestamp;
+    input_connect_token.expire_timestamp = expire_timestamp;
+    memcpy( input_connect_token.nonce, connect_token_nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+    memcpy( input_connect_token.private_data, connect_token_private_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    input_connect_token.num_server_addresses = 1;
+    input_connect_token.server_addresses[0] = server_address;
+    memcpy( input_connect_token.client_to_server_key, connect_token_private.client_to_server_key, NETCODE_KEY_BYTES );
+    memcpy( input_connect_token.server_to_client_key, connect_token_private.server_to_client_key, NETCODE_KEY_BYTES );
+    input_connect_token.timeout_seconds = (int) TEST_TIMEOUT_SECONDS;
+    input_connect_token.cipher_suite = NETCODE_CIPHER_SUITE_AES256_GCM;
+
+    // write the connect token to a buffer
+
+    uint8_t buffer[NETCODE_CONNECT_TOKEN_BYTES];
+    netcode_write_connect_token( &input_connect_token, buffer, NETCODE_CONNECT_TOKEN_BYTES );
+
+    // read the buffer back in
+
+    struct netcode_connect_token_t output_connect_token;
+    memset( &output_connect_token, 0, sizeof( struct netcode_connect_token_t ) );
+    check( netcode_read_connect_token( buffer, NETCODE_CONNECT_TOKEN_BYTES, &output_connect_token ) == 1 );
+
+    // make sure the public connect token matches what was written
+
+    check( memcmp( output_connect_token.version_info, input_connect_token.version_info, NETCODE_VERSION_INFO_BYTES ) == 0 );
+    check( output_connect_token.protocol_id == input_connect_token.protocol_id );
+    check( output_connect_token.create_timestamp == input_connect_token.create_timestamp );
+    check( output_connect_token.expire_timestamp == input_connect_token.expire_timestamp );
+    check( memcmp( output_connect_token.nonce, input_connect_token.nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES ) == 0 );
+    check( memcmp( output_connect_token.private_data, input_connect_token.private_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES ) == 0 );
+    check( output_connect_token.num_server_addresses == input_connect_token.num_server_addresses );
+    check( netcode_address_equal( &output_connect_token.server_addresses[0], &input_connect_token.server_addresses[0] ) );
+    check( memcmp( output_connect_token.client_to_server_key, input_connect_token.client_to_server_key, NETCODE_KEY_BYTES ) == 0 );
+    check( memcmp( output_connect_token.server_to_client_key, input_connect_token.server_to_client_key, NETCODE_KEY_BYTES ) == 0 );
+    check( output_connect_token.timeout_seconds == input_connect_token.timeout_seconds );
+    check( output_connect_token.cipher_suite == input_connect_token.cipher_suite );
+}
+
+void test_encryption_manager()
+{
+    struct netcode_encryption_manager_t encryption_manager;
+
+    check( netcode_encryption_manager_create( &encryption_manager, NETCODE_MAX_CLIENTS * NETCODE_ENCRYPTION_MAPPINGS_PER_CLIENT, NULL, NULL, NULL ) == NETCODE_OK );
+
+    double time = 100.0;
+
+    // generate some test encryption mappings
+
+    struct encryption_mapping_t
+    {
+        struct netcode_address_t address;
+        uint8_t send_key[NETCODE_KEY_BYTES];
+        uint8_t receive_key[NETCODE_KEY_BYTES];
+    };
+
+    #define NUM_ENCRYPTION_MAPPINGS 5
+
+    struct encryption_mapping_t encryption_mapping[NUM_ENCRYPTION_MAPPINGS];
+    memset( encryption_mapping, 0, sizeof( encryption_mapping ) );
+    int i;
+    for ( i = 0; i < NUM_ENCRYPTION_MAPPINGS; ++i )
+    {
+        encryption_mapping[i].address.type = NETCODE_ADDRESS_IPV6;
+        encryption_mapping[i].address.data.ipv6[7] = 1;
+        encryption_mapping[i].address.port = ( uint16_t) ( 20000 + i );
+        netcode_generate_key( encryption_mapping[i].send_key );
+        netcode_generate_key( encryption_mapping[i].receive_key );
+    }
+
+    // add the encryption mappings to the manager and make sure they can be looked up by address
+
+    for ( i = 0; i < NUM_ENCRYPTION_MAPPINGS; ++i )
+    {
+        int encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+
+        check( encryption_index == -1 );
+
+        check( netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index ) == NULL );
+        check( netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index ) == NULL );
+
+        check( netcode_encryption_manager_add_encryption_mapping( &encryption_manager, 
+                                                                  &encryption_mapping[i].address, 
+                                                                  encryption_mapping[i].send_key, 
+                                                                  encryption_mapping[i].receive_key, 
+                                                                  time, 
+                                                                  -1.0,
+                                                                  TEST_TIMEOUT_SECONDS ) );
+
+        encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+
+        uint8_t * send_key = netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index );
+        uint8_t * receive_key = netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+
+        check( send_key );
+        check( receive_key );
+
+        check( memcmp( send_key, encryption_mapping[i].send_key, NETCODE_KEY_BYTES ) == 0 );
+        check( memcmp( receive_key, encryption_mapping[i].receive_key, NETCODE_KEY_BYTES ) == 0 );
+    }
+
+    // removing an encryption mapping that doesn't exist should return 0
+    {
+        struct netcode_address_t address;
+        address.type = NETCODE_ADDRESS_IPV6;
+        address.data.ipv6[7] = 1;
+        address.port = 50000;
+
+        check( netcode_encryption_manager_remove_encryption_mapping( &encryption_manager, &address, time ) == 0 );
+    }
+
+    // remove the first and last encryption mappings
+
+    check( netcode_encryption_manager_remove_encryption_mapping( &encryption_manager, &encryption_mapping[0].address, time ) == 1 );
+
+    check( netcode_encryption_manager_remove_encryption_mapping( &encryption_manager, &encryption_mapping[NUM_ENCRYPTION_MAPPINGS-1].address, time ) == 1 );
+
+    // make sure the encryption mappings that were removed can no longer be looked up by address
+
+    for ( i = 0; i < NUM_ENCRYPTION_MAPPINGS; ++i )
+    {
+        int encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+
+        uint8_t * send_key = netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index );
+        uint8_t * receive_key = netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+
+        if ( i != 0 && i != NUM_ENCRYPTION_MAPPINGS - 1 )
+        {
+            check( send_key );
+            check( receive_key );
+
+            check( memcmp( send_key, encryption_mapping[i].send_key, NETCODE_KEY_BYTES ) == 0 );
+            check( memcmp( receive_key, encryption_mapping[i].receive_key, NETCODE_KEY_BYTES ) == 0 );
+        }
+        else
+        {
+            check( !send_key );
+            check( !receive_key );
+        }
+    }
+
+    // add the encryption mappings back in
+    
+    check( netcode_encryption_manager_add_encryption_mapping( &encryption_manager, 
+                                                              &encryption_mapping[0].address, 
+                                                              encryption_mapping[0].send_key, 
+                                                              encryption_mapping[0].receive_key, 
+                                                              time, 
+                                                              -1.0,
+                                                              TEST_TIMEOUT_SECONDS ) );
+    
+    check( netcode_encryption_manager_add_encryption_mapping( &encryption_manager, 
+                                                              &encryption_mapping[NUM_ENCRYPTION_MAPPINGS-1].address, 
+                                                              encryption_mapping[NUM_ENCRYPTION_MAPPINGS-1].send_key, 
+                                                              encryption_mapping[NUM_ENCRYPTION_MAPPINGS-1].receive_key, 
+                                                              time, 
+                                                              -1.0,
+                                                              TEST_TIMEOUT_SECONDS ) );
+
+    // all encryption mappings should be able to be looked up by address again
+
+    for ( i = 0; i < NUM_ENCRYPTION_MAPPINGS; ++i )
+    {
+        int encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+
+        uint8_t * send_key = netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index );
+        uint8_t * receive_key = netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+
+        check( send_key );
+        check( receive_key );
+
+        check( memcmp( send_key, encryption_mapping[i].send_key, NETCODE_KEY_BYTES ) == 0 );
+        check( memcmp( receive_key, encryption_mapping[i].receive_key, NETCODE_KEY_BYTES ) == 0 );
+    }
+
+    // check that encryption mappings time out properly
+
+    time += TEST_TIMEOUT_SECONDS * 2;
+
+    for ( i = 0; i < NUM_ENCRYPTION_MAPPINGS; ++i )
+    {
+        int encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+
+        uint8_t * send_key = netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index );
+        uint8_t * receive_key = netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+
+        check( !send_key );
+        check( !receive_key );
+    }
+
+    // add the same encryption mappings after timeout
+
+    for ( i = 0; i < NUM_ENCRYPTION_MAPPINGS; ++i )
+    {
+        int encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+
+        check( encryption_index == -1 );
+
+        check( netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index ) == NULL );
+        check( netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index ) == NULL );
+
+        check( netcode_encryption_manager_add_encryption_mapping( &encryption_manager, 
+                                                                  &encryption_mapping[i].address, 
+                                                                  encryption_mapping[i].send_key, 
+                                                                  encryption_mapping[i].receive_key, 
+                                                                  time, 
+                                                                  -1.0,
+                                                                  TEST_TIMEOUT_SECONDS ) );
+
+        encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+
+        uint8_t * send_key = netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index );
+        uint8_t * receive_key = netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+
+        check( send_key );
+        check( receive_key );
+
+        check( memcmp( send_key, encryption_mapping[i].send_key, NETCODE_KEY_BYTES ) == 0 );
+        check( memcmp( receive_key, encryption_mapping[i].receive_key, NETCODE_KEY_BYTES ) == 0 );
+    }
+
+    // reset the encryption mapping and verify that all encryption mappings have been removed
+
+    netcode_encryption_manager_reset( &encryption_manager );
+
+    for ( i = 0; i < NUM_ENCRYPTION_MAPPINGS; ++i )
+    {
+        int encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+
+        uint8_t * send_key = netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index );
+        uint8_t * receive_key = netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+
+        check( !send_key );
+        check( !receive_key );
+    }
+
+    // test the expire time for encryption mapping works as expected
+
+    check( netcode_encryption_manager_add_encryption_mapping( &encryption_manager, 
+                                                              &encryption_mapping[0].address, 
+                                                              encryption_mapping[0].send_key, 
+                                                              encryption_mapping[0].receive_key, 
+                                                              time, 
+                                                              time + 1.0,
+                                                              TEST_TIMEOUT_SECONDS ) );
+
+    int encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[0].address, time );
+
+    check( encryption_index != -1 );
+
+    check( netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[0].address, time + 1.1f ) == -1 );
+
+    netcode_encryption_manager_set_expire_time( &encryption_manager, encryption_index, -1.0 );
+
+    check( netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[0].address, time ) == encryption_index );
+
+    netcode_encryption_manager_destroy( &encryption_manager );
+}
+
+void test_address_map()
+{
+    #define NUM_ADDRESS_MAP_KEYS 12
+    #define NUM_ADDRESS_MAP_BUCKETS 16
+
+    struct netcode_address_t keys[NUM_ADDRESS_MAP_KEYS];
+    int buckets[NUM_ADDRESS_MAP_BUCKETS];
+    struct netcode_address_map_t map;
+
+    memset( keys, 0, sizeof( keys ) );
+
+    netcode_address_map_reset( &map, buckets, NUM_ADDRESS_MAP_BUCKETS );
+
+    // a handful of distinct addresses, so keys collide on the address as well as the bucket
+
+    struct netcode_address_t addresses[4];
+    check( netcode_parse_address( "127.0.0.1:40000", &addresses[0] ) == NETCODE_OK );
+    check( netcode_parse_address( "127.0.0.1:40001", &addresses[1] ) == NETCODE_OK );
+    check( netcode_parse_address( "[::1]:40000", &addresses[2] ) == NETCODE_OK );
+    check( netcode_parse_address( "10.0.0.1:50000", &addresses[3] ) == NETCODE_OK );
+
+    int iteration;
+    for ( iteration = 0; iteration < 10000; ++iteration )
+    {
+        int index = rand() % NUM_ADDRESS_MAP_KEYS;
+
+        netcode_address_map_remove( &map, keys, index );
+
+        if ( rand() % 3 )
+        {
+            keys[index] = addresses[rand() % 4];
+            netcode_address_map_insert( &map, keys, index );
+        }
+        else
+        {
+            memset( &keys[index], 0, sizeof( struct netcode_address_t ) );
+        }
+
+        // the map must return exactly the keys a linear scan finds
+
+        int j;
+        for ( j = 0; j < 4; ++j )
+        {
+            int found[NUM_ADDRESS_MAP_KEYS];
+            memset( found, 0, sizeof( found ) );
+
+            int iterator = -1;
+            while ( 1 )
+            {
+                int i = netcode_address_map_find( &map, keys, &addresses[j], &iterator );
+                if ( i == -1 )
+                    break;
+                check( i >= 0 );
+                check( i < NUM_ADDRESS_MAP_KEYS );
+                check( found[i] == 0 );
+                found[i] = 1;
+            }
+
+            int i;
+            for ( i = 0; i < NUM_ADDRESS_MAP_KEYS; ++i )
+            {
+                check( found[i] == netcode_address_equal( &keys[i], &addresses[j] ) );
+            }
+        }
+    }
+}
+
+void test_connect_token_table()
+{
+    #define NUM_CONNECT_TOKEN_TABLE_ENTRIES 16
+    #define NUM_CONNECT_TOKEN_TABLE_MACS 40
+
+    struct netcode_connect_token_table_t table;
+    struct netcode_connect_token_table_t scan_table;
+
+    check( netcode_connect_token_table_create( &table, NUM_CONNECT_TOKEN_TABLE_ENTRIES, NULL, NULL, NULL ) == NETCODE_OK );
+    check( netcode_connect_token_table_create( &scan_table, NUM_CONNECT_TOKEN_TABLE_ENTRIES, NULL, NULL, NULL ) == NETCODE_OK );
+
+    scan_table.scan = 1;
+
+    // more macs than entries, so entries get evicted, and a few addresses so tokens get replayed from elsewhere
+
+    uint8_t macs[NUM_CONNECT_TOKEN_TABLE_MACS][NETCODE_MAC_BYTES];
+    netcode_random_bytes( (uint8_t*) macs, sizeof( macs ) );
+
+    struct netcode_address_t addresses[3];
+    check( netcode_parse_address( "127.0.0.1:40000", &addresses[0] ) == NETCODE_OK );
+    check( netcode_parse_address( "127.0.0.1:40001", &addresses[1] ) == NETCODE_OK );
+    check( netcode_parse_address( "[::1]:40000", &addresses[2] ) == NETCODE_OK );
+
+    // the hash index must give the same answers as the scan
+
+    double time = 0.0;
+
+    int iteration;
+    for ( iteration = 0; iteration < 10000; ++iteration )
+    {
+        uint8_t * mac = macs[rand() % NUM_CONNECT_TOKEN_TABLE_MACS];
+        struct netcode_address_t * address = &addresses[rand() % 3];
+
+        const int result = netcode_connect_token_table_find_or_add( &table, address, mac, time );
+        const int scan_result = netcode_connect_token_table_find_or_add( &scan_table, address, mac, time );
+
+        check( result == scan_result );
+
+        time += 0.01;
+    }
+
+    // a token seen from one address is rejected from another, until it is evicted
+
+    netcode_connect_token_table_reset( &table );
+
+    check( netcode_connect_token_table_find_or_add( &table, &addresses[0], macs[0], time ) );
+    check( netcode_connect_token_table_find_or_add( &table, &addresses[0], macs[0], time ) );
+    check( !netcode_connect_token_table_find_or_add( &table, &addresses[1], macs[0], time ) );
+
+    int i;
+    for ( i = 1; i <= NUM_CONNECT_TOKEN_TABLE_ENTRIES; ++i )
+        check( netcode_connect_token_table_find_or_add( &table, &addresses[0], macs[i], time ) );
+
+    check( netcode_connect_token_table_find_or_add( &table, &addresses[1], macs[0], time ) );
+
+    netcode_connect_token_table_destroy( &table );
+    netcode_connect_token_table_destroy( &scan_table );
+}
+
+void test_session_ticket_table()
+{
+    #define NUM_SESSION_TICKET_TABLE_ENTRIES 16
+
+    struct netcode_session_ticket_table_t table;
+
+    check( netcode_session_ticket_table_create( &table, NUM_SESSION_TICKET_TABLE_ENTRIES, NULL, NULL, NULL ) == NETCODE_OK );
+
+    // tickets are remembered until they expire, no matter how far apart their sequence numbers are
+
+    double time = 100.0;
+
+    check( !netcode_session_ticket_table_spent( &table, 1000, time ) );
+    check( netcode_session_ticket_table_add( &table, 1000, time, time + 10.0 ) == NETCODE_OK );
+    check( netcode_session_ticket_table_add( &table, 5, time, time + 10.0 ) == NETCODE_OK );
+    check( netcode_session_ticket_table_spent( &table, 1000, time ) );
+    check( netcode_session_ticket_table_spent( &table, 5, time ) );
+    check( !netcode_session_ticket_table_spent( &table, 6, time ) );
+
+    // once full of tickets that haven't expired, nothing more can be added
+
+    uint64_t i;
+    for ( i = 0; i < NUM_SESSION_TICKET_TABLE_ENTRIES - 2; ++i )
+    {
+        time += 0.1;
+        check( netcode_session_ticket_table_add( &table, 2000 + i * 1000, time, time + 10.0 ) == NETCODE_OK );
+    }
+
+    check( netcode_session_ticket_table_full( &table, time ) );
+    check( netcode_session_ticket_table_add( &table, 1, time, time + 10.0 ) == NETCODE_ERROR );
+
+    for ( i = 0; i < NUM_SESSION_TICKET_TABLE_ENTRIES - 2; ++i )
+        check( netcode_session_ticket_table_spent( &table, 2000 + i * 1000, time ) );
+
+    // expired tickets make room, oldest first
+
+    time = 110.05;
+
+    check( !netcode_session_ticket_table_spent( &table, 1000, time ) );
+    check( !netcode_session_ticket_table_full( &table, time ) );
+    check( netcode_session_ticket_table_add( &table, 1, time, time + 10.0 ) == NETCODE_OK );
+    check( netcode_session_ticket_table_add( &table, 2, time, time + 10.0 ) == NETCODE_OK );
+    check( netcode_session_ticket_table_full( &table, time ) );
+    check( netcode_session_ticket_table_spent( &table, 1, time ) );
+    check( netcode_session_ticket_table_spent( &table, 2, time ) );
+    check( netcode_session_ticket_table_spent( &table, 2000, time ) );
+
+    netcode_session_ticket_table_destroy( &table );
+}
+
+void test_replay_protection()
+{
+    struct netcode_replay_protection_t replay_protection;
+
+    int i;
+    for ( i = 0; i < 2; ++i )
+    {
+        netcode_replay_protection_reset( &replay_protection );
+
+        check( replay_protection.most_recent_sequence == 0 );
+
+        // the first time we receive packets, they should not be already received
+
+        #define MAX_SEQUENCE ( NETCODE_REPLAY_PROTECTION_BUFFER_SIZE * 4 )
+
+        uint64_t sequence;
+        for ( sequence = 0; sequence < MAX_SEQUENCE; ++sequence )
+        {
+            check( netcode_replay_protection_already_received( &replay_protection, sequence ) == 0 );
+            netcode_replay_protection_advance_sequence( &replay_protection, sequence );
+        }
+
+        // old packets outside buffer should be considered already received
+
+        check( netcode_replay_protection_already_received( &replay_protection, 0 ) == 1 );
+
+        // packets received a second time should be flagged already received
+
+        for ( sequence = MAX_SEQUENCE - 10; sequence < MAX_SEQUENCE; ++sequence )
+        {
+            check( netcode_replay_protection_already_received( &replay_protection, sequence ) == 1 );
+        }
+
+        // jumping ahead to a much higher sequence should be considered not already received
+
+        check( netcode_replay_protection_already_received( &replay_protection, MAX_SEQUENCE + NETCODE_REPLAY_PROTECTION_BUFFER_SIZE ) == 0 );
+
+        // old packets should be considered already received
+
+        for ( sequence = 0; sequence < MAX_SEQUENCE; ++sequence )
+        {
+            check( netcode_replay_protection_already_received( &replay_protection, sequence ) == 1 );
+        }
+    }
+}
+
+#define TEST_AEAD_BATCH_MESSAGES 11
+
+void test_encrypt_aead_batch()
+{
+    // the batch must produce exactly what the scalar construction does, for every batch size and message length
+
+    static uint8_t batch_buffer[TEST_AEAD_BATCH_MESSAGES][NETCODE_MAX_PAYLOAD_BYTES+NETCODE_MAC_BYTES];
+    static uint8_t scalar_buffer[TEST_AEAD_BATCH_MESSAGES][NETCODE_MAX_PAYLOAD_BYTES+NETCODE_MAC_BYTES];
+    static uint8_t plaintext[TEST_AEAD_BATCH_MESSAGES][NETCODE_MAX_PAYLOAD_BYTES];
+
+    uint8_t key_data[TEST_AEAD_BATCH_MESSAGES][NETCODE_KEY_BYTES];
+    uint8_t nonce_data[TEST_AEAD_BATCH_MESSAGES][12];
+    uint8_t additional_data[TEST_AEAD_BATCH_MESSAGES][NETCODE_VERSION_INFO_BYTES+8+1];
+
+    const uint64_t lengths[TEST_AEAD_BATCH_MESSAGES] = { 1, 63, 64, 65, 127, 200, 511, 512, 1000, NETCODE_MAX_PAYLOAD_BYTES, 17 };
+
+    uint8_t * output[TEST_AEAD_BATCH_MESSAGES];
+    uint8_t * message[TEST_AEAD_BATCH_MESSAGES];
+    uint64_t message_length[TEST_AEAD_BATCH_MESSAGES];
+    uint8_t * additional[TEST_AEAD_BATCH_MESSAGES];
+    uint64_t additional_length[TEST_AEAD_BATCH_MESSAGES];
+    uint8_t * nonce[TEST_AEAD_BATCH_MESSAGES];
+    uint8_t * key[TEST_AEAD_BATCH_MESSAGES];
+    int result[TEST_AEAD_BATCH_MESSAGES];
+
+    int num_messages;
+    for ( num_messages = 1; num_messages <= TEST_AEAD_BATCH_MESSAGES; ++num_messages )
+    {
+        int i;
+        for ( i = 0; i < num_messages; ++i )
+        {
+            netcode_generate_key( key_data[i] );
+            netcode_random_bytes( nonce_data[i], sizeof( nonce_data[i] ) );
+            netcode_random_bytes( additional_data[i], sizeof( additional_data[i] ) );
+            netcode_random_bytes( plaintext[i], NETCODE_MAX_PAYLOAD_BYTES );
+
+            output[i] = batch_buffer[i];
+            message[i] = plaintext[i];
+            message_length[i] = lengths[(i+num_messages) % TEST_AEAD_BATCH_MESSAGES];
+            additional[i] = additional_data[i];
+            additional_length[i] = sizeof( additional_data[i] );
+            nonce[i] = nonce_data[i];
+            key[i] = key_data[i];
+
+            check( netcode_encrypt_aead_to( scalar_buffer[i], plaintext[i], message_length[i], additional[i], additional_length[i], nonce[i], key[i] ) == NETCODE_OK );
+        }
+
+        check( netcode_encrypt_aead_batch( num_messages, output, message, message_length, additional, additional_length, nonce, key ) == NETCODE_OK );
+
+        for ( i = 0; i < num_messages; ++i )
+        {
+            check( memcmp( batch_buffer[i], scalar_buffer[i], message_length[i] + NETCODE_MAC_BYTES ) == 0 );
+            message_length[i] += NETCODE_MAC_BYTES;
+        }
+
+        // tamper with the last message. only that one may fail
+
+        batch_buffer[num_messages-1][0] ^= 1;
+
+        netcode_decrypt_aead_batch( num_messages, output, message_length, additional, additional_length, nonce, key, result );
+
+        for ( i = 0; i < num_messages - 1; ++i )
+        {
+            check( result[i] == NETCODE_OK );
+            check( memcmp( batch_buffer[i], plaintext[i], message_length[i] - NETCODE_MAC_BYTES ) == 0 );
+        }
+
+        check( result[num_messages-1] == NETCODE_ERROR );
+    }
+}
+
+void test_aes256gcm()
+{
+    if ( !netcode_cipher_suite_supported( NETCODE_CIPHER_SUITE_AES256_GCM ) )
+    {
+        // no aes-ni or pclmulqdq here. nothing to test
+
+        return;
+    }
+
+    // test cases 13, 14 and 16 from the gcm spec
+
+    struct netcode_aes256gcm_key_t aes_key;
+    uint8_t buffer[256];
+
+    {
+        uint8_t key[32];
+        uint8_t nonce[12];
+        memset( key, 0, sizeof( key ) );
+        memset( nonce, 0, sizeof( nonce ) );
+
+        const uint8_t tag_13[] = 
+        {
+        0x53, 0x0f, 0x8a, 0xfb, 0xc7, 0x45, 0x36, 0xb9, 0xa9, 0x63, 0xb4, 0xf1, 0xc4, 0xcb, 0x73, 0x8b
+        };
+
+        const uint8_t ciphertext_14[] = 
+        {
+        0xce, 0xa7, 0x40, 0x3d, 0x4d, 0x60, 0x6b, 0x6e, 0x07, 0x4e, 0xc5, 0xd3, 0xba, 0xf3, 0x9d, 0x18,
+        0xd0, 0xd1, 0xc8, 0xa7, 0x99, 0x99, 0x6b, 0xf0, 0x26, 0x5b, 0x98, 0xb5, 0xd4, 0x8a, 0xb9, 0x19
+        };
+
+        netcode_aes256gcm_expand_key( &aes_key, key );
+
+        check( netcode_encrypt_aead_aes256gcm( buffer, NULL, 0, NULL, 0, nonce, &aes_key ) == NETCODE_OK );
+        check( memcmp( buffer, tag_13, sizeof( tag_13 ) ) == 0 );
+
+        memset( buffer, 0, 16 );
+        check( netcode_encrypt_aead_aes256gcm( buffer, buffer, 16, NULL, 0, nonce, &aes_key ) == NETCODE_OK );
+        check( memcmp( buffer, ciphertext_14, sizeof( ciphertext_14 ) ) == 0 );
+
+        check( netcode_decrypt_aead_aes256gcm( buffer, sizeof( ciphertext_14 ), NULL, 0, nonce, &aes_key ) == NETCODE_OK );
+        int i;
+        for ( i = 0; i < 16; ++i )
+        {
+            check( buffer[i] == 0 );
+        }
+    }
+
+    {
+        const uint8_t key[] = 
+        {
+        0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c, 0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08,
+        0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c, 0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08
+        };
+
+        const uint8_t nonce[] = 
+        {
+        0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88
+        };
+
+        const uint8_t additional[] = 
+        {
+        0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef, 0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+        0xab, 0xad, 0xda, 0xd2
+        };
+
+        const uint8_t plaintext[] = 
+        {
+        0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5, 0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+        0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda, 0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+        0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53, 0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+        0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57, 0xba, 0x63, 0x7b, 0x39
+        };
+
+        const uint8_t ciphertext[] = 
+        {
+        0x52, 0x2d, 0xc1, 0xf0, 0x99, 0x56, 0x7d, 0x07, 0xf4, 0x7f, 0x37, 0xa3, 0x2a, 0x84, 0x42, 0x7d,
+        0x64, 0x3a, 0x8c, 0xdc, 0xbf, 0xe5, 0xc0, 0xc9, 0x75, 0x98, 0xa2, 0xbd, 0x25, 0x55, 0xd1, 0xaa,
+        0x8c, 0xb0, 0x8e, 0x48, 0x59, 0x0d, 0xbb, 0x3d, 0xa7, 0xb0, 0x8b, 0x10, 0x56, 0x82, 0x88, 0x38,
+        0xc5, 0xf6, 0x1e, 0x63, 0x93, 0xba, 0x7a, 0x0a, 0xbc, 0xc9, 0xf6, 0x62, 0x76, 0xfc, 0x6e, 0xce,
+        0x0f, 0x4e, 0x17, 0x68, 0xcd, 0xdf, 0x88, 0x53, 0xbb, 0x2d, 0x55, 0x1b
+        };
+
+        netcode_aes256gcm_expand_key( &aes_key, key );
+
+        check( netcode_encrypt_aead_aes256gcm( buffer, plaintext, sizeof( plaintext ), additional, sizeof( additional ), nonce, &aes_key ) == NETCODE_OK );
+        check( memcmp( buffer, ciphertext, sizeof( ciphertext ) ) == 0 );
+
+        check( netcode_decrypt_aead_aes256gcm( buffer, sizeof( ciphertext ), additional, sizeof( additional ), nonce, &aes_key ) == NETCODE_OK );
+        check( memcmp( buffer, plaintext, sizeof( plaintext ) ) == 0 );
+    }
+
+    // round trip every length around the four block stride, and make sure tampering is caught
+
+    static uint8_t plaintext[NETCODE_MAX_PAYLOAD_BYTES];
+    static uint8_t message[NETCODE_MAX_PAYLOAD_BYTES+NETCODE_MAC_BYTES];
+
+    uint8_t packet_key[NETCODE_KEY_BYTES];
+    uint8_t nonce[12];
+    uint8_t additional[NETCODE_VERSION_INFO_BYTES+8+1];
+
+    netcode_generate_key( packet_key );
+    netcode_aes256gcm_init_packet_key( &aes_key, packet_key );
+
+    int length;
+    for ( length = 0; length <= NETCODE_MAX_PAYLOAD_BYTES; length += ( length < 160 ) ? 1 : 97 )
+    {
+        if ( length > 0 )
+        {
+            netcode_random_bytes( plaintext, length );
+        }
+        netcode_random_bytes( nonce, sizeof( nonce ) );
+        netcode_random_bytes( additional, sizeof( additional ) );
+
+        memcpy( message, plaintext, length );
+        check( netcode_encrypt_aead_aes256gcm( message, message, length, additional, sizeof( additional ), nonce, &aes_key ) == NETCODE_OK );
+        check( netcode_decrypt_aead_aes256gcm( message, length + NETCODE_MAC_BYTES, additional, sizeof( additional ), nonce, &aes_key ) == NETCODE_OK );
+        check( memcmp( message, plaintext, length ) == 0 );
+
+        check( netcode_encrypt_aead_aes256gcm( message, message, length, additional, sizeof( additional ), nonce, &aes_key ) == NETCODE_OK );
+        message[length/2] ^= 1;
+        check( netcode_decrypt_aead_aes256gcm( message, length + NETCODE_MAC_BYTES, additional, sizeof( additional ), nonce, &aes_key ) == NETCODE_ERROR );
+
+        check( netcode_encrypt_aead_aes256gcm( message, plaintext, length, additional, sizeof( additional ), nonce, &aes_key ) == NETCODE_OK );
+        additional[0] ^= 1;
+        check( netcode_decrypt_aead_aes256gcm( message, length + NETCODE_MAC_BYTES, additional, sizeof( additional ), nonce, &aes_key ) == NETCODE_ERROR );
+    }
+}
+
+void test_integrity_only()
+{
+    static uint8_t plaintext[NETCODE_MAX_PAYLOAD_BYTES];
+    static uint8_t message[NETCODE_MAX_PAYLOAD_BYTES+NETCODE_MAC_BYTES];
+    static uint8_t ciphertext[NETCODE_MAX_PAYLOAD_BYTES+NETCODE_MAC_BYTES];
+
+    uint8_t key[NETCODE_KEY_BYTES];
+    uint8_t nonce[12];
+    uint8_t additional[NETCODE_VERSION_INFO_BYTES+8+1];
+
+    netcode_generate_key( key );
+
+    int length;
+    for ( length = 1; length <= NETCODE_MAX_PAYLOAD_BYTES; length += ( length < 40 ) ? 1 : 113 )
+    {
+        netcode_random_bytes( plaintext, length );
+        netcode_random_bytes( nonce, sizeof( nonce ) );
+        netcode_random_bytes( additional, sizeof( additional ) );
+
+        // the message goes out as is, followed by the tag
+
+        check( netcode_sign_integrity_only( message, plaintext, length, additional, sizeof( additional ), nonce, key ) == NETCODE_OK );
+        check( memcmp( message, plaintext, length ) == 0 );
+        check( netcode_verify_integrity_only( message, length + NETCODE_MAC_BYTES, additional, sizeof( additional ), nonce, key ) == NETCODE_OK );
+        check( memcmp( message, plaintext, length ) == 0 );
+
+        // the tag is the chacha20-poly1305 tag, computed over the message rather than a ciphertext
+
+        check( netcode_encrypt_aead_to( ciphertext, plaintext, length, additional, sizeof( additional ), nonce, key ) == NETCODE_OK );
+        check( netcode_sign_integrity_only( ciphertext, ciphertext, length, additional, sizeof( additional ), nonce, key ) == NETCODE_OK );
+        check( netcode_encrypt_aead_to( message, plaintext, length, additional, sizeof( additional ), nonce, key ) == NETCODE_OK );
+        check( memcmp( ciphertext, message, length + NETCODE_MAC_BYTES ) == 0 );
+
+        // any change to the message, the additional data or the tag is caught
+
+        check( netcode_sign_integrity_only( message, plaintext, length, additional, sizeof( additional ), nonce, key ) == NETCODE_OK );
+        message[length/2] ^= 1;
+        check( netcode_verify_integrity_only( message, length + NETCODE_MAC_BYTES, additional, sizeof( additional ), nonce, key ) == NETCODE_ERROR );
+        message[length/2] ^= 1;
+
+        additional[0] ^= 1;
+        check( netcode_verify_integrity_only( message, length + NETCODE_MAC_BYTES, additional, sizeof( additional ), nonce, key ) == NETCODE_ERROR );
+        additional[0] ^= 1;
+
+        message[length] ^= 1;
+        check( netcode_verify_integrity_only( message, length + NETCODE_MAC_BYTES, additional, sizeof( additional ), nonce, key ) == NETCODE_ERROR );
+        message[length] ^= 1;
+
+        check( netcode_verify_integrity_only( message, length + NETCODE_MAC_BYTES, additional, sizeof( additional ), nonce, key ) == NETCODE_OK );
+    }
+}
+
+static int test_num_allocations;
+static int test_num_frees;
+
+static void * test_counting_allocate_function( void * context, size_t bytes )
+{
+    (void) context;
+    test_num_allocations++;
+    return malloc( bytes );
+}
+
+static void test_counting_free_function( void * context, void * pointer )
+{
+    (void) context;
+    test_num_frees++;
+    free( pointer );
+}
+
+void test_packet_pool()
+{
+    test_num_allocations = 0;
+    test_num_frees = 0;
+
+    struct netcode_packet_pool_t pool;
+    netcode_packet_pool_init( &pool, NULL, test_counting_allocate_function, test_counting_free_function );
+
+    #define NUM_POOL_BLOCKS ( NETCODE_PACKET_POOL_CHUNK_BLOCKS * 3 )
+
+    // grow past the first chunk, then free everything through pointers into the middle of each block
+
+    uint8_t * blocks[NUM_POOL_BLOCKS];
+    int i;
+    for ( i = 0; i < NUM_POOL_BLOCKS; ++i )
+    {
+        blocks[i] = (uint8_t*) netcode_packet_pool_allocate( &pool, NETCODE_PACKET_POOL_BLOCK_BYTES );
+        check( blocks[i] );
+        check( ( (uintptr_t) blocks[i] & 15 ) == 0 );
+        memset( blocks[i], i & 0xFF, NETCODE_PACKET_POOL_BLOCK_BYTES );
+    }
+
+    check( pool.num_chunks == 2 );
+    check( pool.num_blocks_allocated == NUM_POOL_BLOCKS );
+    check( test_num_allocations == 2 );
+
+    for ( i = 0; i < NUM_POOL_BLOCKS; ++i )
+    {
+        check( blocks[i][NETCODE_PACKET_POOL_BLOCK_BYTES-1] == ( i & 0xFF ) );
+        netcode_packet_pool_free( &pool, blocks[i] + NETCODE_RECEIVE_BUFFER_HEADROOM + i % NETCODE_MAX_PACKET_BYTES );
+    }
+
+    check( pool.num_blocks_allocated == 0 );
+
+    // steady state reuses the blocks already allocated
+
+    for ( i = 0; i < NUM_POOL_BLOCKS; ++i )
+    {
+        blocks[i] = netcode_packet_pool_allocate_receive_buffer( &pool );
+        check( blocks[i] );
+    }
+
+    for ( i = 0; i < NUM_POOL_BLOCKS; ++i )
+    {
+        netcode_packet_pool_free( &pool, blocks[i] );
+    }
+
+    check( test_num_allocations == 2 );
+
+    netcode_packet_pool_destroy( &pool );
+
+    check( test_num_frees == 2 );
+}
+
+void test_client_create()
+{
+    {
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
+
+        struct netcode_client_t * client = netcode_client_create( "127.0.0.1:40000", &client_config, 0.0 );
+
+        struct netcode_address_t test_address;
+        netcode_parse_address( "127.0.0.1:40000", &test_address );
+
+        check( client );
+        check( client->socket_holder.ipv4.handle != 0 );
+        check( client->socket_holder.ipv6.handle == 0 );
+        check( netcode_address_equal( &client->address, &test_address ) );
+
+        netcode_client_destroy( client );
+    }
+
+    {
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
+
+        struct netcode_client_t * client = netcode_client_create( "[::]:50000", &client_config, 0.0 );
+
+        struct netcode_address_t test_address;
+        netcode_parse_address( "[::]:50000", &test_address );
+
+        check( client );
+        check( client->socket_holder.ipv4.handle == 0 );
+        check( client->socket_holder.ipv6.handle != 0 );
+        check( netcode_address_equal( &client->address, &test_address ) );
+
+        netcode_client_destroy( client );
+    }
+
+    {
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
+
+        struct netcode_client_t * client = netcode_client_create_overload( "127.0.0.1:40000", "[::]:50000", &client_config, 0.0 );
+
+        struct netcode_address_t test_address;
+        netcode_parse_address( "127.0.0.1:40000", &test_address );
+
+        check( client );
+        check( client->socket_holder.ipv4.handle != 0 );
+        check( client->socket_holder.ipv6.handle != 0 );
+        check( netcode_address_equal( &client->address, &test_address ) );
+
+        netcode_client_destroy( client );
+    }
+
+    {
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
+
+        struct netcode_client_t * client = netcode_client_create_overload( "[::]:50000", "127.0.0.1:40000", &client_config, 0.0 );
+
+        struct netcode_address_t test_address;
+        netcode_parse_address( "[::]:50000", &test_address );
+
+        check( client );
+        check( client->socket_holder.ipv4.handle != 0 );
+        check( client->socket_holder.ipv6.handle != 0 );
+        check( netcode_address_equal( &client->address, &test_address ) );
+
+        netcode_client_destroy( client );
+    }
+}
+
+void test_server_create()
+{
+    {
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+
+        struct netcode_server_t * server = netcode_server_create( "127.0.0.1:40000", &server_config, 0.0 );
+
+        struct netcode_address_t test_address;
+        netcode_parse_address( "127.0.0.1:40000", &test_address );
+
+        check( server );
+        check( server->socket_holder.ipv4.handle != 0 );
+        check( server->socket_holder.ipv6.handle == 0 );
+        check( netcode_address_equal( &server->address, &test_address ) );
+
+        netcode_server_destroy( server );
+    }
+
+    {
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+
+        struct netcode_server_t * server = netcode_server_create( "[::1]:50000", &server_config, 0.0 );
+
+        struct netcode_address_t test_address;
+        netcode_parse_address( "[::1]:50000", &test_address );
+
+        check( server );
+        check( server->socket_holder.ipv4.handle == 0 );
+        check( server->socket_holder.ipv6.handle != 0 );
+        check( netcode_address_equal( &server->address, &test_address ) );
+
+        netcode_server_destroy( server );
+    }
+
+    {
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+
+        struct netcode_server_t * server = netcode_server_create_overload( "127.0.0.1:40000", "[::1]:50000", &server_config, 0.0 );
+
+        struct netcode_address_t test_address;
+        netcode_parse_address( "127.0.0.1:40000", &test_address );
+
+        check( server );
+        check( server->socket_holder.ipv4.handle != 0 );
+        check( server->socket_holder.ipv6.handle != 0 );
+        check( netcode_address_equal( &server->address, &test_address ) );
+
+        netcode_server_destroy( server );
+    }
+
+    {
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+
+        struct netcode_server_t * server = netcode_server_create_overload( "[::1]:50000", "127.0.0.1:40000", &server_config, 0.0 );
+
+        struct netcode_address_t test_address;
+        netcode_parse_address( "[::1]:50000", &test_address );
+
+        check( server );
+        check( server->socket_holder.ipv4.handle != 0 );
+        check( server->socket_holder.ipv6.handle != 0 );
+        check( netcode_address_equal( &server->address, &test_address ) );
+
+        netcode_server_destroy( server );
+    }
+}
+
+static uint8_t private_key[NETCODE_KEY_BYTES] = { 0x60, 0x6a, 0xbe, 0x6e, 0xc9, 0x19, 0x10, 0xea, 
+                                                  0x9a, 0x65, 0x62, 0xf6, 0x6f, 0x2b, 0x30, 0xe4, 
+                                                  0x43, 0x71, 0xd6, 0x2c, 0xd1, 0x99, 0x27, 0x26,
+                                                  0x6b, 0x3c, 0x60, 0xf4, 0xb7, 0x15, 0xab, 0xa1 };
+
+void test_client_server_connect()
+{
+    struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
+
+    network_simulator->latency_milliseconds = 250;
+    network_simulator->jitter_milliseconds = 250;
+    network_simulator->packet_loss_percent = 5;
+    network_simulator->duplicate_packet_percent = 10;
+
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
+
+    struct netcode_client_config_t client_config;
+    netcode_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
+
+    struct netcode_client_t * client = netcode_client_create( "[::]:50000", &client_config, time );
+
+    check( client );
+
+    struct netcode_server_config_t server_config;
+    netcode_default_server_config( &server_config );
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
+
+    struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
+
+    check( server );
+
+    netcode_server_start( server, 1 );
+
+    NETCODE_CONST char * server_address = "[::1]:40000";
+
+    uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+
+    uint64_t client_id = 0;
+    netcode_random_bytes( (uint8_t*) &client_id, 8 );
+
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
+
+    check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+
+    netcode_client_connect( client, connect_token );
+
+    while ( 1 )
+    {
+        netcode_network_simulator_update( network_simulator, time );
+
+        netcode_client_update( client, time );
+
+        netcode_server_update( server, time );
+
+        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+            break;
+
+        time += delta_time;
+    }
+
+    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+    check( netcode_client_index( client ) == 0 );
+    check( netcode_server_client_connected( server, 0 ) == 1 );
+    check( netcode_server_num_connected_clients( server ) == 1 );
+
+    int server_num_packets_received = 0;
+    int client_num_packets_received = 0;
+
+    uint8_t packet_data[NETCODE_MAX_PACKET_SIZE];
+    int i;
+    for ( i = 0; i < NETCODE_MAX_PACKET_SIZE; ++i )
+        packet_data[i] = (uint8_t) i;
+
+    while ( 1 )
+    {
+        netcode_network_simulator_update( network_simulator, time );
+
+        netcode_client_update( client, time );
+
+        netcode_server_update( server, time );
+
+        netcode_client_send_packet( client, packet_data, NETCODE_MAX_PACKET_SIZE );
+
+        netcode_server_send_packet( server, 0, packet_data, NETCODE_MAX_PACKET_SIZE );
+
+        while ( 1 )             
+        {
+            int packet_bytes;
+            uint64_t packet_sequence;
+            uint8_t * packet = netcode_client_receive_packet( client, &packet_bytes, &packet_sequence );
+            if ( !packet )
+                break;
+            (void) packet_sequence;
+            netcode_assert( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+            netcode_assert( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
+            client_num_packets_received++;
+            netcode_client_free_packet( client, packet );
+        }
+
+        while ( 1 )             
+        {
+            int packet_bytes;
+            uint64_t packet_sequence;
+            void * packet = netcode_server_receive_packet( server, 0, &packet_bytes, &packet_sequence );
+            if ( !packet )
+                break;
+            (void) packet_sequence;
+            netcode_assert( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+            netcode_assert( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
+            server_num_packets_received++;
+            netcode_server_free_packet( server, packet );
+        }
+
+        if ( client_num_packets_received >= 10 && server_num_packets_received >= 10 )
+        {
+            if ( netcode_server_client_connected( server, 0 ) )
+            {
+                netcode_server_disconnect_client( server, 0 );
+            }
+        }
+
+        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        time += delta_time;
+    }
+
+    check( client_num_packets_received >= 10 && server_num_packets_received >= 10 );
+
+    netcode_server_destroy( server );
+
+    netcode_client_destroy( client );
+
+    netcode_network_simulator_destroy( network_simulator );
+}
+
+int test_client_server_cipher_suite_connect( int token_cipher_suite, int server_cipher_suite )
+{
+    // connects one client, exchanges payloads both ways and returns the cipher suite the two ends agreed on
+
+    struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
+
+    network_simulator->latency_milliseconds = 50;
+
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
+
+    struct netcode_client_config_t client_config;
+    netcode_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
+
+    struct netcode_client_t * client = netcode_client_create( "[::]:50000", &client_config, time );
+
+    check( client );
+
+    struct netcode_server_config_t server_config;
+    netcode_default_server_config( &server_config );
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    server_config.cipher_suite = server_cipher_suite;
+    memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
+
+    struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
+
+    check( server );
+
+    netcode_server_start( server, 1 );
+
+    NETCODE_CONST char * server_address = "[::1]:40000";
+
+    uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+
+    uint64_t client_id = 0;
+    netcode_random_bytes( (uint8_t*) &client_id, 8 );
+
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
+
+    check( netcode_generate_connect_token_with_cipher_suite( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, token_cipher_suite, connect_token ) );
+
+    netcode_client_connect( client, connect_token );
+
+    while ( 1 )
+    {
+        netcode_network_simulator_update( network_simulator, time );
+
+        netcode_client_update( client, time );
+
+        netcode_server_update( server, time );
+
+        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+            break;
+
+        time += delta_time;
+    }
+
+    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+    check( netcode_server_client_connected( server, 0 ) == 1 );
+    check( client->context.cipher_suite == server->client_cipher_suite[0] );
+
+    const int cipher_suite = server->client_cipher_suite[0];
+
+    int server_num_packets_received = 0;
+    int client_num_packets_received = 0;
+
+    uint8_t packet_data[NETCODE_MAX_PACKET_SIZE];
+    int i;
+    for ( i = 0; i < NETCODE_MAX_PACKET_SIZE; ++i )
+        packet_data[i] = (uint8_t) i;
+
+    // the server alternates between single sends and the batch path, which has to leave these clients out of its lanes
+
+    int client_index[2] = { 0, 0 };
+    NETCODE_CONST uint8_t * batch_packet_data[2] = { packet_data, packet_data };
+    int batch_packet_bytes[2] = { NETCODE_MAX_PACKET_SIZE, NETCODE_MAX_PACKET_SIZE };
+
+    int iteration;
+    for ( iteration = 0; iteration < 100; ++iteration )
+    {
+        netcode_network_simulator_update( network_simulator, time );
+
+        netcode_client_update( client, time );
+
+        netcode_server_update( server, time );
+
+        netcode_client_send_packet( client, packet_data, NETCODE_MAX_PACKET_SIZE );
+
+        if ( iteration % 2 )
+        {
+            netcode_server_send_packets_batch( server, client_index, batch_packet_data, batch_packet_bytes, 2 );
+        }
+        else
+        {
+            netcode_server_send_packet( server, 0, packet_data, NETCODE_MAX_PACKET_SIZE );
+        }
+
+        while ( 1 )             
+        {
+            int packet_bytes;
+            uint64_t packet_sequence;
+            uint8_t * packet = netcode_client_receive_packet( client, &packet_bytes, &packet_sequence );
+            if ( !packet )
+                break;
+            (void) packet_sequence;
+            check( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+            check( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
+            client_num_packets_received++;
+            netcode_client_free_packet( client, packet );
+        }
+
+        while ( 1 )             
+        {
+            int packet_bytes;
+            uint64_t packet_sequence;
+            void * packet = netcode_server_receive_packet( server, 0, &packet_bytes, &packet_sequence );
+            if ( !packet )
+                break;
+            (void) packet_sequence;
+            check( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+            check( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
+            server_num_packets_received++;
+            netcode_server_free_packet( server, packet );
+        }
+
+        if ( client_num_packets_received >= 20 && server_num_packets_received >= 20 )
+            break;
+
+        time += delta_time;
     }
 
-    return 0;
+    check( client_num_packets_received >= 20 && server_num_packets_received >= 20 );
+    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+
+    netcode_server_destroy( server );
+
+    netcode_client_destroy( client );
+
+    netcode_network_simulator_destroy( network_simulator );
+
+    return cipher_suite;
 }
 
-int netcode_encryption_manager_find_encryption_mapping( struct netcode_encryption_manager_t * encryption_manager, struct netcode_address_t * address, double time )
+void test_client_server_cipher_suite()
 {
-    int i;
-    for ( i = 0; i < encryption_manager->num_encryption_mappings; ++i )
+    const int aes256gcm_supported = netcode_cipher_suite_supported( NETCODE_CIPHER_SUITE_AES256_GCM );
+
+    // aes-256-gcm needs the token, the server config and the cpu to all agree. anything else falls back to chacha20-poly1305
+
+    check( test_client_server_cipher_suite_connect( NETCODE_CIPHER_SUITE_AES256_GCM, NETCODE_CIPHER_SUITE_AES256_GCM ) == 
+        ( aes256gcm_supported ? NETCODE_CIPHER_SUITE_AES256_GCM : NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 ) );
+
+    check( test_client_server_cipher_suite_connect( NETCODE_CIPHER_SUITE_AES256_GCM, NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 ) == NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 );
+
+    check( test_client_server_cipher_suite_connect( NETCODE_CIPHER_SUITE_CHACHA20_POLY1305, NETCODE_CIPHER_SUITE_AES256_GCM ) == NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 );
+
+    check( test_client_server_cipher_suite_connect( NETCODE_CIPHER_SUITE_CHACHA20_POLY1305, NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 ) == NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 );
+
+    // integrity only works the same way, and a server set up for it still encrypts for everybody else
+
+    check( test_client_server_cipher_suite_connect( NETCODE_CIPHER_SUITE_INTEGRITY_ONLY, NETCODE_CIPHER_SUITE_INTEGRITY_ONLY ) == NETCODE_CIPHER_SUITE_INTEGRITY_ONLY );
+
+    check( test_client_server_cipher_suite_connect( NETCODE_CIPHER_SUITE_INTEGRITY_ONLY, NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 ) == NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 );
+
+    check( test_client_server_cipher_suite_connect( NETCODE_CIPHER_SUITE_CHACHA20_POLY1305, NETCODE_CIPHER_SUITE_INTEGRITY_ONLY ) == NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 );
+
+    check( test_client_server_cipher_suite_connect( NETCODE_CIPHER_SUITE_AES256_GCM, NETCODE_CIPHER_SUITE_INTEGRITY_ONLY ) == NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 );
+}
+
+double test_client_server_handshake_connect( int adaptive_handshake, float packet_loss_percent, double * first_payload_time )
+{
+    // connects one client over a 25ms one way link and returns how long it took. the server sends a payload as soon as
+    // the client is connected, the time it reaches the client is returned in first_payload_time
+
+    struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
+
+    network_simulator->latency_milliseconds = 25;
+    network_simulator->packet_loss_percent = packet_loss_percent;
+
+    double time = 0.0;
+    double delta_time = 1.0 / 1000.0;
+
+    struct netcode_client_config_t client_config;
+    netcode_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
+    client_config.adaptive_handshake = adaptive_handshake;
+
+    struct netcode_client_t * client = netcode_client_create( "[::]:50000", &client_config, time );
+
+    check( client );
+
+    struct netcode_server_config_t server_config;
+    netcode_default_server_config( &server_config );
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    server_config.adaptive_handshake = adaptive_handshake;
+    memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
+
+    struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
+
+    check( server );
+
+    netcode_server_start( server, 1 );
+
+    NETCODE_CONST char * server_address = "[::1]:40000";
+
+    uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+
+    uint64_t client_id = 0;
+    netcode_random_bytes( (uint8_t*) &client_id, 8 );
+
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
+
+    check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+
+    netcode_client_connect( client, connect_token );
+
+    uint8_t packet_data[64];
+    memset( packet_data, 0x42, sizeof( packet_data ) );
+
+    double connect_time = -1.0;
+    *first_payload_time = -1.0;
+
+    while ( time < 5.0 )
     {
-        if ( netcode_address_equal( &encryption_manager->address[i], address ) && !netcode_encryption_manager_entry_expired( encryption_manager, i, time ) )
+        netcode_network_simulator_update( network_simulator, time );
+
+        netcode_client_update( client, time );
+
+        netcode_server_update( server, time );
+
+        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        if ( connect_time < 0.0 && netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+            connect_time = time;
+
+        int packet_bytes;
+        uint64_t packet_sequence;
+        uint8_t * packet = netcode_client_receive_packet( client, &packet_bytes, &packet_sequence );
+        if ( packet )
         {
-            encryption_manager->last_access_time[i] = time;
-            return i;
+            check( packet_bytes == (int) sizeof( packet_data ) );
+            check( memcmp( packet, packet_data, sizeof( packet_data ) ) == 0 );
+            netcode_client_free_packet( client, packet );
+            *first_payload_time = time;
+            break;
         }
+
+        if ( netcode_server_client_connected( server, 0 ) )
+            netcode_server_send_packet( server, 0, packet_data, sizeof( packet_data ) );
+
+        time += delta_time;
     }
-    return -1;
+
+    netcode_server_destroy( server );
+
+    netcode_client_destroy( client );
+
+    netcode_network_simulator_destroy( network_simulator );
+
+    return connect_time;
 }
 
-int netcode_encryption_manager_touch( struct netcode_encryption_manager_t * encryption_manager, int index, struct netcode_address_t * address, double time )
+void test_client_server_adaptive_handshake()
 {
-    netcode_assert( index >= 0 );
-    netcode_assert( index < encryption_manager->num_encryption_mappings );
-    if ( !netcode_address_equal( &encryption_manager->address[index], address ) )
-        return 0;
-    encryption_manager->last_access_time[index] = time;
-    return 1;
+    double first_payload_time;
+
+    // on a clean link the classic handshake waits out the 100ms send interval before it answers the challenge.
+    // the adaptive handshake answers straight away and connects in two round trips
+
+    double classic_connect_time = test_client_server_handshake_connect( 0, 0.0f, &first_payload_time );
+    check( classic_connect_time > 0.14 );
+    check( first_payload_time >= classic_connect_time );
+
+    double adaptive_connect_time = test_client_server_handshake_connect( 1, 0.0f, &first_payload_time );
+    check( adaptive_connect_time > 0.0 && adaptive_connect_time < 0.11 );
+    check( first_payload_time >= adaptive_connect_time && first_payload_time < 0.11 );
+
+    // with heavy loss every connect still completes and delivers its first payload
+
+    int i;
+    for ( i = 0; i < 20; ++i )
+    {
+        double connect_time = test_client_server_handshake_connect( 1, 30.0f, &first_payload_time );
+        check( connect_time > 0.0 );
+        check( first_payload_time >= connect_time );
+    }
 }
 
-void netcode_encryption_manager_set_expire_time( struct netcode_encryption_manager_t * encryption_manager, int index, double expire_time )
+static void test_wait_for_handshakes( struct netcode_server_t * server )
 {
-    netcode_assert( index >= 0 );
-    netcode_assert( index < encryption_manager->num_encryption_mappings );
-    encryption_manager->expire_time[index] = expire_time;
+    struct netcode_handshake_queue_t * queue = server->handshake_queue;
+    netcode_mutex_lock( &queue->mutex );
+    while ( queue->processed != queue->tail )
+        netcode_condition_wait( &queue->job_done, &queue->mutex );
+    netcode_mutex_unlock( &queue->mutex );
+}
+
+void test_server_handshake_thread()
+{
+    struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
+
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
+
+    struct netcode_client_config_t client_config;
+    netcode_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
+
+    struct netcode_client_t * client = netcode_client_create( "[::]:50000", &client_config, time );
+
+    check( client );
+
+    struct netcode_server_config_t server_config;
+    netcode_default_server_config( &server_config );
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    server_config.handshake_thread = 1;
+    memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
+
+    struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
+
+    check( server );
+    check( server->handshake_queue );
+
+    netcode_server_start( server, 1 );
+
+    NETCODE_CONST char * server_address = "[::1]:40000";
+
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    netcode_random_bytes( user_data, NETCODE_USER_DATA_BYTES );
+
+    // flood the server with one valid connection request replayed from many addresses. 
+    // every copy costs the handshake thread a token decrypt, but only the first gets a challenge back
+
+    uint8_t flood_connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+
+    check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, TEST_CLIENT_ID, TEST_PROTOCOL_ID, private_key, user_data, flood_connect_token ) );
+
+    struct netcode_connect_token_t connect_token_public;
+    check( netcode_read_connect_token( flood_connect_token, NETCODE_CONNECT_TOKEN_BYTES, &connect_token_public ) == NETCODE_OK );
+
+    struct netcode_connection_request_packet_t request_packet;
+    request_packet.packet_type = NETCODE_CONNECTION_REQUEST_PACKET;
+    memcpy( request_packet.version_info, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
+    request_packet.protocol_id = TEST_PROTOCOL_ID;
+    request_packet.connect_token_expire_timestamp = connect_token_public.expire_timestamp;
+    memcpy( request_packet.connect_token_nonce, connect_token_public.nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+    memcpy( request_packet.connect_token_data, connect_token_public.private_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    request_packet.cipher_suite = NETCODE_CIPHER_SUITE_CHACHA20_POLY1305;
+
+    uint8_t packet_key[NETCODE_KEY_BYTES];
+    netcode_generate_key( packet_key );
+
+    uint8_t request_packet_data[NETCODE_MAX_PACKET_BYTES];
+    int request_packet_bytes = netcode_write_packet( &request_packet, request_packet_data, NETCODE_MAX_PACKET_BYTES, 0, packet_key, TEST_PROTOCOL_ID, NULL );
+    check( request_packet_bytes > 0 );
+
+    int i;
+    for ( i = 0; i < NETCODE_HANDSHAKE_QUEUE_SIZE * 4; ++i )
+    {
+        struct netcode_address_t from;
+        memset( &from, 0, sizeof( from ) );
+        from.type = NETCODE_ADDRESS_IPV4;
+        from.data.ipv4[0] = 10;
+        from.data.ipv4[1] = (uint8_t) ( i >> 8 );
+        from.data.ipv4[2] = (uint8_t) i;
+        from.data.ipv4[3] = 1;
+        from.port = 50000;
+        netcode_server_process_packet( server, &from, request_packet_data, request_packet_bytes );
+    }
+
+    netcode_server_update( server, time );
+
+    test_wait_for_handshakes( server );
+
+    netcode_server_update( server, time );
+
+    check( server->handshake_queue->head == server->handshake_queue->tail );
+    check( netcode_server_num_connected_clients( server ) == 0 );
+
+    // a real client still gets through. waiting for the handshake thread each tick keeps the test deterministic
+
+    uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+
+    check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, TEST_CLIENT_ID + 1, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+
+    netcode_client_connect( client, connect_token );
+
+    while ( 1 )
+    {
+        netcode_network_simulator_update( network_simulator, time );
+
+        netcode_client_update( client, time );
+
+        test_wait_for_handshakes( server );
+
+        netcode_server_update( server, time );
+
+        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+            break;
+
+        time += delta_time;
+    }
+
+    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+    check( netcode_client_index( client ) == 0 );
+    check( netcode_server_client_connected( server, 0 ) == 1 );
+    check( netcode_server_client_id( server, 0 ) == TEST_CLIENT_ID + 1 );
+    check( memcmp( netcode_server_client_user_data( server, 0 ), user_data, NETCODE_USER_DATA_BYTES ) == 0 );
+
+    // restarting waits for the handshake thread, so a flood in flight can't leak into the next run
+
+    for ( i = 0; i < NETCODE_HANDSHAKE_QUEUE_SIZE; ++i )
+    {
+        struct netcode_address_t from;
+        memset( &from, 0, sizeof( from ) );
+        from.type = NETCODE_ADDRESS_IPV4;
+        from.data.ipv4[0] = 10;
+        from.data.ipv4[3] = 2;
+        from.port = (uint16_t) ( 10000 + i );
+        netcode_server_process_packet( server, &from, request_packet_data, request_packet_bytes );
+    }
+
+    netcode_server_start( server, 1 );
+
+    check( server->handshake_queue->head == server->handshake_queue->tail );
+    check( netcode_server_num_connected_clients( server ) == 0 );
+
+    netcode_server_destroy( server );
+
+    netcode_client_destroy( client );
+
+    netcode_network_simulator_destroy( network_simulator );
 }
 
+void test_server_admission_control()
+{
+    struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
+
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
+
+    struct netcode_client_config_t client_config;
+    netcode_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
+
+    struct netcode_client_t * client = netcode_client_create( "[::]:50000", &client_config, time );
+
+    check( client );
+
+    struct netcode_server_config_t server_config;
+    netcode_default_server_config( &server_config );
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    server_config.max_connection_requests_per_second = 100;
+    memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
+
+    struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
+
+    check( server );
+
+    netcode_server_start( server, 1 );
+
+    NETCODE_CONST char * server_address = "[::1]:40000";
 
-uint8_t * netcode_encryption_manager_get_send_key( struct netcode_encryption_manager_t * encryption_manager, int index )
-{
-    netcode_assert( encryption_manager );
-    if ( index == -1 )
-        return NULL;
-    netcode_assert( index >= 0 );
-    netcode_assert( index < encryption_manager->num_encryption_mappings );
-    return encryption_manager->send_key + index * NETCODE_KEY_BYTES;
-}
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    netcode_random_bytes( user_data, NETCODE_USER_DATA_BYTES );
 
-uint8_t * netcode_encryption_manager_get_receive_key( struct netcode_encryption_manager_t * encryption_manager, int index )
-{
-    netcode_assert( encryption_manager );
-    if ( index == -1 )
-        return NULL;
-    netcode_assert( index >= 0 );
-    netcode_assert( index < encryption_manager->num_encryption_mappings );
-    return encryption_manager->receive_key + index * NETCODE_KEY_BYTES;
-}
+    uint8_t flood_connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-int netcode_encryption_manager_get_timeout( struct netcode_encryption_manager_t * encryption_manager, int index )
-{
-    netcode_assert( encryption_manager );
-    if ( index == -1 )
-        return 0;
-    netcode_assert( index >= 0 );
-    netcode_assert( index < encryption_manager->num_encryption_mappings );
-    return encryption_manager->timeout[index];
-}
+    check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, TEST_CLIENT_ID, TEST_PROTOCOL_ID, private_key, user_data, flood_connect_token ) );
 
-// ----------------------------------------------------------------
+    struct netcode_connect_token_t connect_token_public;
+    check( netcode_read_connect_token( flood_connect_token, NETCODE_CONNECT_TOKEN_BYTES, &connect_token_public ) == NETCODE_OK );
 
-#define NETCODE_MAX_CONNECT_TOKEN_ENTRIES ( NETCODE_MAX_CLIENTS * 8 )
+    struct netcode_connection_request_packet_t request_packet;
+    request_packet.packet_type = NETCODE_CONNECTION_REQUEST_PACKET;
+    memcpy( request_packet.version_info, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
+    request_packet.protocol_id = TEST_PROTOCOL_ID;
+    request_packet.connect_token_expire_timestamp = connect_token_public.expire_timestamp;
+    memcpy( request_packet.connect_token_nonce, connect_token_public.nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
+    memcpy( request_packet.connect_token_data, connect_token_public.private_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    request_packet.cipher_suite = NETCODE_CIPHER_SUITE_CHACHA20_POLY1305;
 
-struct netcode_connect_token_entry_t
-{
-    double time;
-    uint8_t mac[NETCODE_MAC_BYTES];
-    struct netcode_address_t address;
-};
+    uint8_t packet_key[NETCODE_KEY_BYTES];
+    netcode_generate_key( packet_key );
 
-void netcode_connect_token_entries_reset( struct netcode_connect_token_entry_t * connect_token_entries )
-{
-    int i;
-    for ( i = 0; i < NETCODE_MAX_CONNECT_TOKEN_ENTRIES; ++i )
-    {
-        connect_token_entries[i].time = -1000.0;
-        memset( connect_token_entries[i].mac, 0, NETCODE_MAC_BYTES );
-        memset( &connect_token_entries[i].address, 0, sizeof( struct netcode_address_t ) );
-    }
-}
+    uint8_t request_packet_data[NETCODE_MAX_PACKET_BYTES];
+    int request_packet_bytes = netcode_write_packet( &request_packet, request_packet_data, NETCODE_MAX_PACKET_BYTES, 0, packet_key, TEST_PROTOCOL_ID, NULL );
+    check( request_packet_bytes > 0 );
 
-int netcode_connect_token_entries_find_or_add( struct netcode_connect_token_entry_t * connect_token_entries, 
-                                               struct netcode_address_t * address, 
-                                               uint8_t * mac, 
-                                               double time )
-{
-    netcode_assert( connect_token_entries );
-    netcode_assert( address );
-    netcode_assert( mac );
+    const uint64_t * counters = netcode_server_counters( server );
 
-    // find the matching entry for the token mac and the oldest token entry. constant time worst case. This is intentional!
+    // one address gets a burst of requests through, and the rest are shed before the token is decrypted
 
-    int matching_token_index = -1;
-    int oldest_token_index = -1;
-    double oldest_token_time = 0.0;
+    struct netcode_address_t from;
+    memset( &from, 0, sizeof( from ) );
+    from.type = NETCODE_ADDRESS_IPV4;
+    from.data.ipv4[0] = 10;
+    from.data.ipv4[3] = 1;
+    from.port = 50000;
 
     int i;
-    for ( i = 0; i < NETCODE_MAX_CONNECT_TOKEN_ENTRIES; ++i )
+    for ( i = 0; i < 100; ++i )
     {
-        if ( memcmp( mac, connect_token_entries[i].mac, NETCODE_MAC_BYTES ) == 0 )
-            matching_token_index = i;
-        
-        if ( oldest_token_index == -1 || connect_token_entries[i].time < oldest_token_time )
-        {
-            oldest_token_time = connect_token_entries[i].time;
-            oldest_token_index = i;
-        }
+        netcode_server_process_packet( server, &from, request_packet_data, request_packet_bytes );
     }
 
-    // if no entry is found with the mac, this is a new connect token. replace the oldest token entry.
+    check( counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_ADDRESS_RATE] == 100 - (int) NETCODE_ADMISSION_PACKET_BURST );
+    check( counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_REQUEST_RATE] == 0 );
 
-    netcode_assert( oldest_token_index != -1 );
+    // requests spread over many addresses are bounded by the global cap instead
 
-    if ( matching_token_index == -1 )
+    for ( i = 0; i < 200; ++i )
     {
-        connect_token_entries[oldest_token_index].time = time;
-        connect_token_entries[oldest_token_index].address = *address;
-        memcpy( connect_token_entries[oldest_token_index].mac, mac, NETCODE_MAC_BYTES );
-        return 1;
+        from.data.ipv4[1] = (uint8_t) ( i >> 8 );
+        from.data.ipv4[2] = (uint8_t) i;
+        from.data.ipv4[3] = 2;
+        netcode_server_process_packet( server, &from, request_packet_data, request_packet_bytes );
     }
 
-    // allow connect tokens we have already seen from the same address
+    check( counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_REQUEST_RATE] == 200 - ( 100 - (int) NETCODE_ADMISSION_PACKET_BURST ) );
 
-    netcode_assert( matching_token_index >= 0 );
-    netcode_assert( matching_token_index < NETCODE_MAX_CONNECT_TOKEN_ENTRIES );
-    if ( netcode_address_equal( &connect_token_entries[matching_token_index].address, address ) )
-        return 1;
+    // malformed packets and packets from addresses without an encryption mapping never reach a decrypt
 
-    return 0;
-}
+    netcode_server_process_packet( server, &from, request_packet_data, request_packet_bytes - 1 );
 
-// ----------------------------------------------------------------
+    check( counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_MALFORMED] == 1 );
 
-#define NETCODE_SERVER_FLAG_IGNORE_CONNECTION_REQUEST_PACKETS       1
-#define NETCODE_SERVER_FLAG_IGNORE_CONNECTION_RESPONSE_PACKETS      (1<<1)
+    struct netcode_connection_keep_alive_packet_t keep_alive_packet;
+    keep_alive_packet.packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
+    keep_alive_packet.client_index = 0;
+    keep_alive_packet.max_clients = 1;
 
-void netcode_default_server_config( struct netcode_server_config_t * config )
-{
-    netcode_assert( config );
-    config->allocator_context = NULL;
-    config->allocate_function = netcode_default_allocate_function;
-    config->free_function = netcode_default_free_function;
-    config->network_simulator = NULL;
-    config->callback_context = NULL;
-    config->connect_disconnect_callback = NULL;
-    config->send_loopback_packet_callback = NULL;
-    config->override_send_and_receive = 0;
-    config->send_packet_override = NULL;
-    config->aux_receive_packet = NULL;
-    config->aux_send_packet = NULL;
-    config->receive_packet_override = NULL;
-};
+    uint8_t keep_alive_packet_data[NETCODE_MAX_PACKET_BYTES];
+    int keep_alive_packet_bytes = netcode_write_packet( &keep_alive_packet, keep_alive_packet_data, NETCODE_MAX_PACKET_BYTES, 1, packet_key, TEST_PROTOCOL_ID, NULL );
+    check( keep_alive_packet_bytes > 0 );
 
-struct netcode_server_t
-{
-    struct netcode_server_config_t config;
-    struct netcode_socket_holder_t socket_holder;
-    struct netcode_address_t address;
-    uint32_t flags;
-    double time;
-    int running;
-    int max_clients;
-    int num_connected_clients;
-    uint64_t global_sequence;
-    uint64_t challenge_sequence;
-    uint8_t challenge_key[NETCODE_KEY_BYTES];
-    int client_connected[NETCODE_MAX_CLIENTS];
-    int client_timeout[NETCODE_MAX_CLIENTS];
-    int client_loopback[NETCODE_MAX_CLIENTS];
-    int client_confirmed[NETCODE_MAX_CLIENTS];
-    int client_encryption_index[NETCODE_MAX_CLIENTS];
-    uint64_t client_id[NETCODE_MAX_CLIENTS];
-    uint64_t client_sequence[NETCODE_MAX_CLIENTS];
-    double client_last_packet_send_time[NETCODE_MAX_CLIENTS];
-    double client_last_packet_receive_time[NETCODE_MAX_CLIENTS];
-    uint8_t client_user_data[NETCODE_MAX_CLIENTS][NETCODE_USER_DATA_BYTES];
-    struct netcode_replay_protection_t client_replay_protection[NETCODE_MAX_CLIENTS];
-    struct netcode_packet_queue_t client_packet_queue[NETCODE_MAX_CLIENTS];
-    struct netcode_address_t client_address[NETCODE_MAX_CLIENTS];
-    struct netcode_connect_token_entry_t connect_token_entries[NETCODE_MAX_CONNECT_TOKEN_ENTRIES];
-    struct netcode_encryption_manager_t encryption_manager;
-    uint8_t * receive_packet_data[NETCODE_SERVER_MAX_RECEIVE_PACKETS];
-    int receive_packet_bytes[NETCODE_SERVER_MAX_RECEIVE_PACKETS];
-    struct netcode_address_t receive_from[NETCODE_SERVER_MAX_RECEIVE_PACKETS];
-};
+    netcode_server_process_packet( server, &from, keep_alive_packet_data, keep_alive_packet_bytes );
 
-int netcode_server_socket_create( struct netcode_socket_t * socket,
-                                  struct netcode_address_t * address,
-                                  int send_buffer_size,
-                                  int receive_buffer_size,
-                                  NETCODE_CONST struct netcode_server_config_t * config )
-{
-    netcode_assert( socket );
-    netcode_assert( address );
-    netcode_assert( config );
+    check( counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_NO_MAPPING] == 1 );
 
-    if ( !config->network_simulator )
+    // a real client still connects once the buckets have refilled
+
+    uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+
+    check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, TEST_CLIENT_ID + 1, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+
+    time += 1.0;
+
+    netcode_client_connect( client, connect_token );
+
+    while ( 1 )
     {
-        if ( !config->override_send_and_receive )
-        {
-            if ( netcode_socket_create( socket, address, send_buffer_size, receive_buffer_size ) != NETCODE_SOCKET_ERROR_NONE )
-            {
-                return 0;
-            }
-        }
+        netcode_network_simulator_update( network_simulator, time );
+
+        netcode_client_update( client, time );
+
+        netcode_server_update( server, time );
+
+        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+            break;
+
+        time += delta_time;
     }
 
-    return 1;
+    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+    check( netcode_server_client_connected( server, 0 ) == 1 );
+
+    // a connection request from a connected client would only be decrypted to be ignored
+
+    netcode_server_process_packet( server, &server->client_address[0], request_packet_data, request_packet_bytes );
+
+    check( counters[NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_UNEXPECTED] == 1 );
+
+    netcode_server_destroy( server );
+
+    netcode_client_destroy( client );
+
+    netcode_network_simulator_destroy( network_simulator );
 }
 
-struct netcode_server_t * netcode_server_create_overload( NETCODE_CONST char * server_address1_string, NETCODE_CONST char * server_address2_string, NETCODE_CONST struct netcode_server_config_t * config, double time )
+void test_client_server_ipv4_socket_connect()
 {
-    netcode_assert( config );
-    netcode_assert( netcode.initialized );
+    {
+        double time = 0.0;
+        double delta_time = 1.0 / 10.0;
 
-    struct netcode_address_t server_address1;
-    struct netcode_address_t server_address2;
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
 
-    memset( &server_address1, 0, sizeof( server_address1 ) );
-    memset( &server_address2, 0, sizeof( server_address2 ) );
+        struct netcode_client_t * client = netcode_client_create( "0.0.0.0:50000", &client_config, time );
 
-    if ( netcode_parse_address( server_address1_string, &server_address1 ) != NETCODE_OK )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: failed to parse server public address\n" );
-        return NULL;
-    }
+        check( client );
 
-    if ( server_address2_string != NULL && netcode_parse_address( server_address2_string, &server_address2 ) != NETCODE_OK )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: failed to parse server public address2\n" );
-        return NULL;
-    }
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-    struct netcode_address_t bind_address_ipv4;
-    struct netcode_address_t bind_address_ipv6;
+        struct netcode_server_t * server = netcode_server_create( "127.0.0.1:40000", &server_config, time );
 
-    memset( &bind_address_ipv4, 0, sizeof( bind_address_ipv4 ) );
-    memset( &bind_address_ipv6, 0, sizeof( bind_address_ipv6 ) );
+        check( server );
 
-    struct netcode_socket_t socket_ipv4;
-    struct netcode_socket_t socket_ipv6;
+        netcode_server_start( server, 1 );
 
-    memset( &socket_ipv4, 0, sizeof( socket_ipv4 ) );
-    memset( &socket_ipv6, 0, sizeof( socket_ipv6 ) );
+        NETCODE_CONST char * server_address = "127.0.0.1:40000";
 
-    if ( server_address1.type == NETCODE_ADDRESS_IPV4 || server_address2.type == NETCODE_ADDRESS_IPV4 )
-    {
-        bind_address_ipv4.type = NETCODE_ADDRESS_IPV4;
-        bind_address_ipv4.port = server_address1.type == NETCODE_ADDRESS_IPV4 ? server_address1.port : server_address2.port;
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-        if ( !netcode_server_socket_create( &socket_ipv4, &bind_address_ipv4, NETCODE_SERVER_SOCKET_SNDBUF_SIZE, NETCODE_SERVER_SOCKET_RCVBUF_SIZE, config ) )
-        {
-            return NULL;
-        }
-    }
+        uint64_t client_id = 0;
+        netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-    if ( server_address1.type == NETCODE_ADDRESS_IPV6 || server_address2.type == NETCODE_ADDRESS_IPV6 )
-    {
-        bind_address_ipv6.type = NETCODE_ADDRESS_IPV6;
-        bind_address_ipv6.port = server_address1.type == NETCODE_ADDRESS_IPV6 ? server_address1.port : server_address2.port;
+        uint8_t user_data[NETCODE_USER_DATA_BYTES];
+        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-        if ( !netcode_server_socket_create( &socket_ipv6, &bind_address_ipv6, NETCODE_SERVER_SOCKET_SNDBUF_SIZE, NETCODE_SERVER_SOCKET_RCVBUF_SIZE, config ) )
+        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+
+        netcode_client_connect( client, connect_token );
+
+        while ( 1 )
         {
-            return NULL;
+            netcode_client_update( client, time );
+
+            netcode_server_update( server, time );
+
+            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+                break;
+
+            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+                break;
+
+            time += delta_time;
         }
-    }
 
-    struct netcode_server_t * server = (struct netcode_server_t*) config->allocate_function( config->allocator_context, sizeof( struct netcode_server_t ) );
-    if ( !server )
-    {
-        netcode_socket_destroy( &socket_ipv4 );
-        netcode_socket_destroy( &socket_ipv6 );
-        return NULL;
-    }
+        netcode_server_destroy( server );
 
-    if ( !config->network_simulator )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_INFO, "server listening on %s\n", server_address1_string );
-    }
-    else
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_INFO, "server listening on %s (network simulator)\n", server_address1_string );
+        netcode_client_destroy( client );
     }
 
-    server->config = *config;
-    server->socket_holder.ipv4 = socket_ipv4;
-    server->socket_holder.ipv6 = socket_ipv6;
-    server->address = server_address1;
-    server->flags = 0;
-    server->time = time;
-    server->running = 0;
-    server->max_clients = 0;
-    server->num_connected_clients = 0;
-    server->global_sequence = 1ULL << 63;
+    {
+        double time = 0.0;
+        double delta_time = 1.0 / 10.0;
 
-    memset( server->client_connected, 0, sizeof( server->client_connected ) );
-    memset( server->client_loopback, 0, sizeof( server->client_loopback ) );
-    memset( server->client_confirmed, 0, sizeof( server->client_confirmed ) );
-    memset( server->client_id, 0, sizeof( server->client_id ) );
-    memset( server->client_sequence, 0, sizeof( server->client_sequence ) );
-    memset( server->client_last_packet_send_time, 0, sizeof( server->client_last_packet_send_time ) );
-    memset( server->client_last_packet_receive_time, 0, sizeof( server->client_last_packet_receive_time ) );
-    memset( server->client_address, 0, sizeof( server->client_address ) );
-    memset( server->client_user_data, 0, sizeof( server->client_user_data ) );
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
 
-    int i;
-    for ( i = 0; i < NETCODE_MAX_CLIENTS; ++i )
-        server->client_encryption_index[i] = -1;
+        struct netcode_client_t * client = netcode_client_create( "0.0.0.0:50000", &client_config, time );
 
-    netcode_connect_token_entries_reset( server->connect_token_entries );
+        check( client );
 
-    netcode_encryption_manager_reset( &server->encryption_manager );
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-    for ( i = 0; i < NETCODE_MAX_CLIENTS; ++i )
-        netcode_replay_protection_reset( &server->client_replay_protection[i] );
+        struct netcode_server_t * server = netcode_server_create_overload( "127.0.0.1:40000", "[::1]:40000", &server_config, time );
 
-    memset( &server->client_packet_queue, 0, sizeof( server->client_packet_queue ) );
+        check( server );
 
-    return server;
-}
+        netcode_server_start( server, 1 );
 
-struct netcode_server_t * netcode_server_create( NETCODE_CONST char * server_address_string, NETCODE_CONST struct netcode_server_config_t * config, double time )
-{
-    return netcode_server_create_overload( server_address_string, NULL, config, time );
-}
+        NETCODE_CONST char * server_address = "127.0.0.1:40000";
 
-void netcode_server_stop( struct netcode_server_t * server );
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-void netcode_server_destroy( struct netcode_server_t * server )
-{
-    netcode_assert( server );
+        uint64_t client_id = 0;
+        netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-    netcode_server_stop( server );
+        uint8_t user_data[NETCODE_USER_DATA_BYTES];
+        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-    netcode_socket_destroy( &server->socket_holder.ipv4 );
-    netcode_socket_destroy( &server->socket_holder.ipv6 );
+        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-    server->config.free_function( server->config.allocator_context, server );
-}
+        netcode_client_connect( client, connect_token );
 
-void netcode_server_start( struct netcode_server_t * server, int max_clients )
-{
-    netcode_assert( server );
-    netcode_assert( max_clients > 0 );
-    netcode_assert( max_clients <= NETCODE_MAX_CLIENTS );
+        while ( 1 )
+        {
+            netcode_client_update( client, time );
 
-    if ( server->running )
-        netcode_server_stop( server );
+            netcode_server_update( server, time );
 
-    netcode_printf( NETCODE_LOG_LEVEL_INFO, "server started with %d client slots\n", max_clients );
+            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+                break;
 
-    server->running = 1;
-    server->max_clients = max_clients;
-    server->num_connected_clients = 0;
-    server->challenge_sequence = 0;    
-    netcode_generate_key( server->challenge_key );
+            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+                break;
 
-    int i;
-    for ( i = 0; i < server->max_clients; ++i )
-    {
-        netcode_packet_queue_init( &server->client_packet_queue[i], server->config.allocator_context, server->config.allocate_function, server->config.free_function );
+            time += delta_time;
+        }
+
+        netcode_server_destroy( server );
+
+        netcode_client_destroy( client );
     }
-}
 
-void netcode_server_send_global_packet( struct netcode_server_t * server, void * packet, struct netcode_address_t * to, uint8_t * packet_key )
-{
-    netcode_assert( server );
-    netcode_assert( packet );
-    netcode_assert( to );
-    netcode_assert( packet_key );
+    {
+        double time = 0.0;
+        double delta_time = 1.0 / 10.0;
 
-    uint8_t packet_data[NETCODE_MAX_PACKET_BYTES];
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
 
-    int packet_bytes = netcode_write_packet( packet, packet_data, NETCODE_MAX_PACKET_BYTES, server->global_sequence, packet_key, server->config.protocol_id );
+        struct netcode_client_t * client = netcode_client_create_overload( "0.0.0.0:50000", "[::]:50000", &client_config, time );
 
-    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_BYTES );
+        check( client );
 
-    if ( server->config.network_simulator )
-    {
-        netcode_network_simulator_send_packet( server->config.network_simulator, &server->address, to, packet_data, packet_bytes );
-    }
-    else
-    {
-        if ( server->config.override_send_and_receive )
-        {
-            server->config.send_packet_override( server->config.callback_context, to, packet_data, packet_bytes );
-        }
-        else if ( to->type == NETCODE_ADDRESS_IPV4 )
-        {
-            bool send_real_packet = true;
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-            if ( server->config.aux_send_packet != NULL )
-            {
-                if ( server->config.aux_send_packet(server->config.callback_context, to, packet_data, packet_bytes ) )
-                {
-                    send_real_packet = false;
-                }
-            }
+        struct netcode_server_t * server = netcode_server_create( "127.0.0.1:40000", &server_config, time );
 
-            if ( send_real_packet )
-            {
-                netcode_socket_send_packet( &server->socket_holder.ipv4, to, packet_data, packet_bytes );
-            }
-        }
-        else if ( to->type == NETCODE_ADDRESS_IPV6 )
-        {
-            netcode_socket_send_packet( &server->socket_holder.ipv6, to, packet_data, packet_bytes );
-        }
-    }
+        check( server );
 
-    server->global_sequence++;
-}
+        netcode_server_start( server, 1 );
 
-void netcode_server_send_client_packet( struct netcode_server_t * server, void * packet, int client_index )
-{
-    netcode_assert( server );
-    netcode_assert( packet );
-    netcode_assert( client_index >= 0 );
-    netcode_assert( client_index < server->max_clients );
-    netcode_assert( server->client_connected[client_index] );
-    netcode_assert( !server->client_loopback[client_index] );
+        NETCODE_CONST char * server_address = "127.0.0.1:40000";
 
-    uint8_t packet_data[NETCODE_MAX_PACKET_BYTES];
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-    if ( !netcode_encryption_manager_touch( &server->encryption_manager, 
-                                            server->client_encryption_index[client_index], 
-                                            &server->client_address[client_index], 
-                                            server->time ) )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_ERROR, "error: encryption mapping is out of date for client %d\n", client_index );
-        return;
-    }
+        uint64_t client_id = 0;
+        netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-    uint8_t * packet_key = netcode_encryption_manager_get_send_key( &server->encryption_manager, server->client_encryption_index[client_index] );
+        uint8_t user_data[NETCODE_USER_DATA_BYTES];
+        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-    int packet_bytes = netcode_write_packet( packet, packet_data, NETCODE_MAX_PACKET_BYTES, server->client_sequence[client_index], packet_key, server->config.protocol_id );
+        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_BYTES );
+        netcode_client_connect( client, connect_token );
 
-    if ( server->config.network_simulator )
-    {
-        netcode_network_simulator_send_packet( server->config.network_simulator, &server->address, &server->client_address[client_index], packet_data, packet_bytes );
-    }
-    else
-    {
-        if ( server->config.override_send_and_receive )
-        {
-            server->config.send_packet_override( server->config.callback_context, &server->client_address[client_index], packet_data, packet_bytes );
-        }
-        else
+        while ( 1 )
         {
-            if ( server->client_address[client_index].type == NETCODE_ADDRESS_IPV4 )
-            {
-                bool send_real_packet = true;
+            netcode_client_update( client, time );
 
-                if ( server->config.aux_send_packet != NULL )
-                {
-                    if ( server->config.aux_send_packet(server->config.callback_context, &server->client_address[client_index], packet_data, packet_bytes ) )
-                    {
-                        send_real_packet = false;
-                    }
-                }
+            netcode_server_update( server, time );
 
-                if ( send_real_packet )
-                {
-                    netcode_socket_send_packet( &server->socket_holder.ipv4, &server->client_address[client_index], packet_data, packet_bytes );
-                }
-            }
-            else if ( server->client_address[client_index].type == NETCODE_ADDRESS_IPV6 )
-            {
-                netcode_socket_send_packet( &server->socket_holder.ipv6, &server->client_address[client_index], packet_data, packet_bytes );
-            }
+            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+                break;
+
+            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+                break;
+
+            time += delta_time;
         }
+
+        netcode_server_destroy( server );
+
+        netcode_client_destroy( client );
     }
 
-    server->client_sequence[client_index]++;
+    {
+        double time = 0.0;
+        double delta_time = 1.0 / 10.0;
 
-    server->client_last_packet_send_time[client_index] = server->time;
-}
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
 
-void netcode_server_disconnect_client_internal( struct netcode_server_t * server, int client_index, int send_disconnect_packets )
-{
-    netcode_assert( server );
-    netcode_assert( server->running );
-    netcode_assert( client_index >= 0 );
-    netcode_assert( client_index < server->max_clients );
-    netcode_assert( server->client_connected[client_index] );
-    netcode_assert( !server->client_loopback[client_index] );
-    netcode_assert( server->encryption_manager.client_index[server->client_encryption_index[client_index]] == client_index );
+        struct netcode_client_t * client = netcode_client_create_overload( "0.0.0.0:50000", "[::]:50000", &client_config, time );
 
-    netcode_printf( NETCODE_LOG_LEVEL_INFO, "server disconnected client %d\n", client_index );
+        check( client );
 
-    if ( server->config.connect_disconnect_callback )
-    {
-        server->config.connect_disconnect_callback( server->config.callback_context, client_index, 0 );
-    }
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-    (void)send_disconnect_packets;
+        struct netcode_server_t * server = netcode_server_create_overload( "127.0.0.1:40000", "[::1]:40000", &server_config, time );
 
-    while ( 1 )
-    {
-        void * packet = netcode_packet_queue_pop( &server->client_packet_queue[client_index], NULL );
-        if ( !packet )
-            break;
-        server->config.free_function( server->config.allocator_context, packet );
-    }
+        check( server );
+
+        netcode_server_start( server, 1 );
+
+        NETCODE_CONST char * server_address = "127.0.0.1:40000";
+
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+
+        uint64_t client_id = 0;
+        netcode_random_bytes( (uint8_t*) &client_id, 8 );
+
+        uint8_t user_data[NETCODE_USER_DATA_BYTES];
+        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
+
+        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+
+        netcode_client_connect( client, connect_token );
 
-    netcode_packet_queue_clear( &server->client_packet_queue[client_index] );
+        while ( 1 )
+        {
+            netcode_client_update( client, time );
 
-    netcode_replay_protection_reset( &server->client_replay_protection[client_index] );
+            netcode_server_update( server, time );
 
-    server->encryption_manager.client_index[server->client_encryption_index[client_index]] = -1;
+            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+                break;
 
-    netcode_encryption_manager_remove_encryption_mapping( &server->encryption_manager, &server->client_address[client_index], server->time );
+            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+                break;
 
-    server->client_connected[client_index] = 0;
-    server->client_confirmed[client_index] = 0;
-    server->client_id[client_index] = 0;
-    server->client_sequence[client_index] = 0;
-    server->client_last_packet_send_time[client_index] = 0.0;
-    server->client_last_packet_receive_time[client_index] = 0.0;
-    memset( &server->client_address[client_index], 0, sizeof( struct netcode_address_t ) );
-    server->client_encryption_index[client_index] = -1;
-    memset( server->client_user_data[client_index], 0, NETCODE_USER_DATA_BYTES );
+            time += delta_time;
+        }
 
-    server->num_connected_clients--;
+        netcode_server_destroy( server );
 
-    netcode_assert( server->num_connected_clients >= 0 );
+        netcode_client_destroy( client );
+    }
 }
 
-void netcode_server_disconnect_client( struct netcode_server_t * server, int client_index )
+void test_client_server_ipv6_socket_connect()
 {
-    netcode_assert( server );
-
-    if ( !server->running )
-        return;
-
-    netcode_assert( client_index >= 0 );
-    netcode_assert( client_index < server->max_clients );
-    netcode_assert( server->client_loopback[client_index] == 0 );
+    {
+        double time = 0.0;
+        double delta_time = 1.0 / 10.0;
 
-    if ( !server->client_connected[client_index] )
-        return;
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
 
-    if ( server->client_loopback[client_index] )
-        return;
+        struct netcode_client_t * client = netcode_client_create( "[::]:50000", &client_config, time );
 
-    netcode_server_disconnect_client_internal( server, client_index, 1 );
-}
+        check( client );
 
-void netcode_server_disconnect_all_clients( struct netcode_server_t * server )
-{
-    netcode_assert( server );
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-    if ( !server->running )
-        return;
+        struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
 
-    int i;
-    for ( i = 0; i < server->max_clients; ++i )
-    {
-        if ( server->client_connected[i] && !server->client_loopback[i] )
-        {
-            netcode_server_disconnect_client_internal( server, i, 1 );
-        }
-    }
-}
+        check( server );
 
-void netcode_server_stop( struct netcode_server_t * server )
-{
-    netcode_assert( server );
+        netcode_server_start( server, 1 );
 
-    if ( !server->running )
-        return;
+        NETCODE_CONST char * server_address = "[::1]:40000";
 
-    netcode_server_disconnect_all_clients( server );
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-    server->running = 0;
-    server->max_clients = 0;
-    server->num_connected_clients = 0;
+        uint64_t client_id = 0;
+        netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-    server->global_sequence = 0;
-    server->challenge_sequence = 0;
-    memset( server->challenge_key, 0, NETCODE_KEY_BYTES );
+        uint8_t user_data[NETCODE_USER_DATA_BYTES];
+        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-    netcode_connect_token_entries_reset( server->connect_token_entries );
+        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-    netcode_encryption_manager_reset( &server->encryption_manager );
+        netcode_client_connect( client, connect_token );
 
-    netcode_printf( NETCODE_LOG_LEVEL_INFO, "server stopped\n" );
-}
+        while ( 1 )
+        {
+            netcode_client_update( client, time );
 
-int netcode_server_find_client_index_by_id( struct netcode_server_t * server, uint64_t client_id )
-{
-    netcode_assert( server );
+            netcode_server_update( server, time );
 
-    int i;
-    for ( i = 0; i < server->max_clients; ++i )
-    {   
-        if ( server->client_connected[i] && server->client_id[i] == client_id )
-            return i;
-    }
+            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+                break;
 
-    return -1;
-}
+            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+                break;
 
-int netcode_server_find_client_index_by_address( struct netcode_server_t * server, struct netcode_address_t * address )
-{
-    netcode_assert( server );
-    netcode_assert( address );
+            time += delta_time;
+        }
 
-    if ( address->type == 0 )
-        return -1;
+        netcode_server_destroy( server );
 
-    int i;
-    for ( i = 0; i < server->max_clients; ++i )
-    {   
-        if ( server->client_connected[i] && netcode_address_equal( &server->client_address[i], address ) )
-            return i;
+        netcode_client_destroy( client );
     }
+    
+    {
+        double time = 0.0;
+        double delta_time = 1.0 / 10.0;
 
-    return -1;
-}
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
 
-void netcode_server_process_connection_request_packet( struct netcode_server_t * server, 
-                                                       struct netcode_address_t * from, 
-                                                       struct netcode_connection_request_packet_t * packet )
-{
-    netcode_assert( server );
+        struct netcode_client_t * client = netcode_client_create( "[::]:50000", &client_config, time );
 
-    (void) from;
+        check( client );
 
-    struct netcode_connect_token_private_t connect_token_private;
-    if ( netcode_read_connect_token_private( packet->connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, &connect_token_private ) != NETCODE_OK )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection request. failed to read connect token\n" );
-        return;
-    }
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-    if ( netcode_server_find_client_index_by_address( server, from ) != -1 )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection request. a client with this address is already connected\n" );
-        return;
-    }
+        struct netcode_server_t * server = netcode_server_create_overload( "127.0.0.1:40000", "[::1]:40000", &server_config, time );
 
-    if ( netcode_server_find_client_index_by_id( server, connect_token_private.client_id ) != -1 )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection request. a client with this id is already connected\n" );
-        return;
-    }
+        check( server );
 
-    if ( !netcode_connect_token_entries_find_or_add( server->connect_token_entries, 
-                                                     from, 
-                                                     packet->connect_token_data + NETCODE_CONNECT_TOKEN_PRIVATE_BYTES - NETCODE_MAC_BYTES, 
-                                                     server->time ) )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection request. connect token has already been used\n" );
-        return;
-    }
+        netcode_server_start( server, 1 );
 
-    if ( server->num_connected_clients == server->max_clients )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server denied connection request. server is full\n" );
+        NETCODE_CONST char * server_address = "[::1]:40000";
 
-        struct netcode_connection_denied_packet_t p;
-        p.packet_type = NETCODE_CONNECTION_DENIED_PACKET;
-        
-        netcode_server_send_global_packet( server, &p, from, connect_token_private.server_to_client_key );
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-        return;
-    }
+        uint64_t client_id = 0;
+        netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-    double expire_time = ( connect_token_private.timeout_seconds >= 0 ) ? server->time + connect_token_private.timeout_seconds : -1.0;
+        uint8_t user_data[NETCODE_USER_DATA_BYTES];
+        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-    if ( !netcode_encryption_manager_add_encryption_mapping( &server->encryption_manager, 
-                                                             from, 
-                                                             connect_token_private.server_to_client_key, 
-                                                             connect_token_private.client_to_server_key, 
-                                                             server->time, 
-                                                             expire_time,
-                                                             connect_token_private.timeout_seconds ) )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection request. failed to add encryption mapping\n" );
-        return;
-    }
+        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-    struct netcode_challenge_token_t challenge_token;
-    challenge_token.client_id = connect_token_private.client_id;
-    memcpy( challenge_token.user_data, connect_token_private.user_data, NETCODE_USER_DATA_BYTES );
+        netcode_client_connect( client, connect_token );
 
-    struct netcode_connection_challenge_packet_t challenge_packet;
-    challenge_packet.packet_type = NETCODE_CONNECTION_CHALLENGE_PACKET;
-    challenge_packet.challenge_token_sequence = server->challenge_sequence;
-    netcode_write_challenge_token( &challenge_token, challenge_packet.challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
-    if ( netcode_encrypt_challenge_token( challenge_packet.challenge_token_data, 
-                                          NETCODE_CHALLENGE_TOKEN_BYTES, 
-                                          server->challenge_sequence, 
-                                          server->challenge_key ) != NETCODE_OK )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection request. failed to encrypt challenge token\n" );
-        return;
-    }
+        while ( 1 )
+        {
+            netcode_client_update( client, time );
 
-    server->challenge_sequence++;
+            netcode_server_update( server, time );
 
-    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server sent connection challenge packet\n" );
+            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+                break;
 
-    netcode_server_send_global_packet( server, &challenge_packet, from, connect_token_private.server_to_client_key );
-}
+            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+                break;
 
-int netcode_server_find_free_client_index( struct netcode_server_t * server )
-{
-    netcode_assert( server );
+            time += delta_time;
+        }
 
-    int i;
-    for ( i = 0; i < server->max_clients; ++i )
-    {
-        if ( !server->client_connected[i] )
-            return i;
+        netcode_server_destroy( server );
+
+        netcode_client_destroy( client );
     }
+    
+    {
+        double time = 0.0;
+        double delta_time = 1.0 / 10.0;
 
-    return -1;
-}
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
 
-void netcode_server_connect_client( struct netcode_server_t * server, 
-                                    int client_index, 
-                                    struct netcode_address_t * address, 
-                                    uint64_t client_id, 
-                                    int encryption_index,
-                                    int timeout_seconds, 
-                                    void * user_data )
-{
-    netcode_assert( server );
-    netcode_assert( server->running );
-    netcode_assert( client_index >= 0 );
-    netcode_assert( client_index < server->max_clients );
-    netcode_assert( address );
-    netcode_assert( encryption_index != -1 );
-    netcode_assert( user_data );
-    netcode_assert( server->encryption_manager.client_index[encryption_index] == -1 );
+        struct netcode_client_t * client = netcode_client_create_overload( "0.0.0.0:50000", "[::]:50000", &client_config, time );
+
+        check( client );
+
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-    server->num_connected_clients++;
+        struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
 
-    netcode_assert( server->num_connected_clients <= server->max_clients );
+        check( server );
 
-    netcode_assert( server->client_connected[client_index] == 0 );
+        netcode_server_start( server, 1 );
 
-    netcode_encryption_manager_set_expire_time( &server->encryption_manager, encryption_index, -1.0 );
-    
-    server->encryption_manager.client_index[encryption_index] = client_index;
+        NETCODE_CONST char * server_address = "[::1]:40000";
 
-    server->client_connected[client_index] = 1;
-    server->client_timeout[client_index] = timeout_seconds;
-    server->client_encryption_index[client_index] = encryption_index;
-    server->client_id[client_index] = client_id;
-    server->client_sequence[client_index] = 0;
-    server->client_address[client_index] = *address;
-    server->client_last_packet_send_time[client_index] = server->time;
-    server->client_last_packet_receive_time[client_index] = server->time;
-    memcpy( server->client_user_data[client_index], user_data, NETCODE_USER_DATA_BYTES );
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-    char address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+        uint64_t client_id = 0;
+        netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-    netcode_printf( NETCODE_LOG_LEVEL_INFO, "server accepted client %s %.16" PRIx64 " in slot %d\n", 
-        netcode_address_to_string( address, address_string ), client_id, client_index );
+        uint8_t user_data[NETCODE_USER_DATA_BYTES];
+        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-    struct netcode_connection_keep_alive_packet_t packet;
-    packet.packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
-    packet.client_index = client_index;
-    packet.max_clients = server->max_clients;
+        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-    netcode_server_send_client_packet( server, &packet, client_index );
+        netcode_client_connect( client, connect_token );
 
-    if ( server->config.connect_disconnect_callback )
-    {
-        server->config.connect_disconnect_callback( server->config.callback_context, client_index, 1 );
-    }
-}
+        while ( 1 )
+        {
+            netcode_client_update( client, time );
 
-void netcode_server_process_connection_response_packet( struct netcode_server_t * server, 
-                                                        struct netcode_address_t * from, 
-                                                        struct netcode_connection_response_packet_t * packet, 
-                                                        int encryption_index )
-{
-    netcode_assert( server );
+            netcode_server_update( server, time );
 
-    if ( netcode_decrypt_challenge_token( packet->challenge_token_data, 
-                                          NETCODE_CHALLENGE_TOKEN_BYTES, 
-                                          packet->challenge_token_sequence, 
-                                          server->challenge_key ) != NETCODE_OK )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection response. failed to decrypt challenge token\n" );
-        return;
-    }
+            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+                break;
 
-    struct netcode_challenge_token_t challenge_token;
-    if ( netcode_read_challenge_token( packet->challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES, &challenge_token ) != NETCODE_OK )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection response. failed to read challenge token\n" );
-        return;
-    }
+            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+                break;
 
-    uint8_t * packet_send_key = netcode_encryption_manager_get_send_key( &server->encryption_manager, encryption_index );
+            time += delta_time;
+        }
 
-    if ( !packet_send_key )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection response. no packet send key\n" );
-        return;
-    }
+        netcode_server_destroy( server );
 
-    if ( netcode_server_find_client_index_by_address( server, from ) != -1 )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection response. a client with this address is already connected\n" );
-        return;
+        netcode_client_destroy( client );
     }
-
-    if ( netcode_server_find_client_index_by_id( server, challenge_token.client_id ) != -1 )
+    
     {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server ignored connection response. a client with this id is already connected\n" );
-        return;
-    }
+        double time = 0.0;
+        double delta_time = 1.0 / 10.0;
 
-    if ( server->num_connected_clients == server->max_clients )
-    {
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server denied connection response. server is full\n" );
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
 
-        struct netcode_connection_denied_packet_t p;
-        p.packet_type = NETCODE_CONNECTION_DENIED_PACKET;
+        struct netcode_client_t * client = netcode_client_create_overload( "0.0.0.0:50000", "[::]:50000", &client_config, time );
 
-        netcode_server_send_global_packet( server, &p, from, packet_send_key );
+        check( client );
 
-        return;
-    }
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-    int client_index = netcode_server_find_free_client_index( server );
+        struct netcode_server_t * server = netcode_server_create_overload( "127.0.0.1:40000", "[::1]:40000", &server_config, time );
 
-    netcode_assert( client_index != -1 );
+        check( server );
 
-    int timeout_seconds = netcode_encryption_manager_get_timeout( &server->encryption_manager, encryption_index );
+        netcode_server_start( server, 1 );
 
-    netcode_server_connect_client( server, client_index, from, challenge_token.client_id, encryption_index, timeout_seconds, challenge_token.user_data );
-}
+        NETCODE_CONST char * server_address = "[::1]:40000";
 
-void netcode_server_process_packet_internal( struct netcode_server_t * server, 
-                                             struct netcode_address_t * from, 
-                                             void * packet, 
-                                             uint64_t sequence, 
-                                             int encryption_index, 
-                                             int client_index )
-{
-    netcode_assert( server );
-    netcode_assert( packet );
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-    (void) from;
-    (void) sequence;
+        uint64_t client_id = 0;
+        netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-    uint8_t packet_type = ( (uint8_t*) packet ) [0];
+        uint8_t user_data[NETCODE_USER_DATA_BYTES];
+        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-    switch ( packet_type )
-    {
-        case NETCODE_CONNECTION_REQUEST_PACKET:
-        {    
-            if ( ( server->flags & NETCODE_SERVER_FLAG_IGNORE_CONNECTION_REQUEST_PACKETS ) == 0 )
-            {
-                char from_address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
-                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server received connection request from %s\n", netcode_address_to_string( from, from_address_string ) );
-                netcode_server_process_connection_request_packet( server, from, (struct netcode_connection_request_packet_t*) packet );
-            }
-        }
-        break;
+        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-        case NETCODE_CONNECTION_RESPONSE_PACKET:
-        {    
-            if ( ( server->flags & NETCODE_SERVER_FLAG_IGNORE_CONNECTION_RESPONSE_PACKETS ) == 0 )
-            {
-                char from_address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
-                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server received connection response from %s\n", netcode_address_to_string( from, from_address_string ) );
-                netcode_server_process_connection_response_packet( server, from, (struct netcode_connection_response_packet_t*) packet, encryption_index );
-            }
-        }
-        break;
+        netcode_client_connect( client, connect_token );
 
-        case NETCODE_CONNECTION_KEEP_ALIVE_PACKET:
+        while ( 1 )
         {
-            if ( client_index != -1 )
-            {
-                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server received connection keep alive packet from client %d\n", client_index );
-                server->client_last_packet_receive_time[client_index] = server->time;
-                if ( !server->client_confirmed[client_index] )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server confirmed connection with client %d\n", client_index );
-                    server->client_confirmed[client_index] = 1;
-                }
-            }
-        }
-        break;
+            netcode_client_update( client, time );
 
-        case NETCODE_CONNECTION_PAYLOAD_PACKET:
-        {
-            if ( client_index != -1 )
-            {
-                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server received connection payload packet from client %d\n", client_index );
-                server->client_last_packet_receive_time[client_index] = server->time;
-                if ( !server->client_confirmed[client_index] )
-                {
-                    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server confirmed connection with client %d\n", client_index );
-                    server->client_confirmed[client_index] = 1;
-                }
-                netcode_packet_queue_push( &server->client_packet_queue[client_index], packet, sequence );
-                return;
-            }
-        }
-        break;
+            netcode_server_update( server, time );
 
-        case NETCODE_CONNECTION_DISCONNECT_PACKET:
-        {
-            if ( client_index != -1 )
-            {
-                netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server received disconnect packet from client %d\n", client_index );
-                netcode_server_disconnect_client_internal( server, client_index, 0 );
-           }
+            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+                break;
+
+            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+                break;
+
+            time += delta_time;
         }
-        break;
 
-        default:
-            break;
-    }
+        netcode_server_destroy( server );
 
-    server->config.free_function( server->config.allocator_context, packet );
+        netcode_client_destroy( client );
+    }
 }
 
-void netcode_server_process_packet( struct netcode_server_t * server, struct netcode_address_t * from, uint8_t * packet_data, int packet_bytes )
+void test_server_socket_batching()
 {
-    uint8_t allowed_packets[NETCODE_CONNECTION_NUM_PACKETS];
-    memset( allowed_packets, 0, sizeof( allowed_packets ) );
-    allowed_packets[NETCODE_CONNECTION_REQUEST_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_RESPONSE_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_KEEP_ALIVE_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_PAYLOAD_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_DISCONNECT_PACKET] = 1;
-
-    uint64_t current_timestamp = (uint64_t) time( NULL );
+    #define NUM_BATCHING_CLIENTS 16
+    #define NUM_BATCHING_TICKS 10
 
-    uint64_t sequence;
+    // modes: plain sockets, recvmmsg/sendmmsg batches, io_uring (falls back to batches if unavailable)
 
-    int encryption_index = -1;
-    int client_index = netcode_server_find_client_index_by_address( server, from );
-    if ( client_index != -1 )
-    {
-        netcode_assert( client_index >= 0 );
-        netcode_assert( client_index < server->max_clients );
-        encryption_index = server->client_encryption_index[client_index];
-    }
-    else
+    int mode;
+    for ( mode = 0; mode <= 2; ++mode )
     {
-        encryption_index = netcode_encryption_manager_find_encryption_mapping( &server->encryption_manager, from, server->time );
-    }
-    
-    uint8_t * read_packet_key = netcode_encryption_manager_get_receive_key( &server->encryption_manager, encryption_index );
+        const int batch_socket_io = mode >= 1;
 
-    if ( !read_packet_key && packet_data[0] != 0 )
-    {
-        char address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server could not process packet because no encryption mapping exists for %s\n", netcode_address_to_string( from, address_string ) );
-        return;
-    }
+        double time = 0.0;
+        double delta_time = 1.0 / 10.0;
 
-    void * packet = netcode_read_packet( packet_data, 
-                                         packet_bytes, 
-                                         &sequence, 
-                                         read_packet_key, 
-                                         server->config.protocol_id, 
-                                         current_timestamp, 
-                                         server->config.private_key, 
-                                         allowed_packets, 
-                                         ( client_index != -1 ) ? &server->client_replay_protection[client_index] : NULL, 
-                                         server->config.allocator_context, 
-                                         server->config.allocate_function );
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        server_config.batch_socket_io = batch_socket_io;
+        server_config.io_uring_socket_io = mode == 2;
+        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-    if ( !packet )
-        return;
+        struct netcode_server_t * server = netcode_server_create( "127.0.0.1:40000", &server_config, time );
 
-    netcode_server_process_packet_internal( server, from, packet, sequence, encryption_index, client_index );
-}
+        check( server );
 
-void netcode_server_read_and_process_packet( struct netcode_server_t * server, 
-                                             struct netcode_address_t * from, 
-                                             uint8_t * packet_data, 
-                                             int packet_bytes, 
-                                             uint64_t current_timestamp, 
-                                             uint8_t * allowed_packets )
-{
-    if ( !server->running )
-        return;
+        check( netcode_server_io_uring_active( server ) == 0 || mode == 2 );
 
-    if ( packet_bytes <= 1 )
-        return;
+        netcode_server_start( server, NUM_BATCHING_CLIENTS );
 
-    if ( server->config.auxiliary_command_function != NULL ) {
-		if (server->config.auxiliary_command_function(
-			server->config.auxiliary_command_context, 
-			from, 
-			packet_data, 
-			packet_bytes
-		)) {
-			return;
-		}
-	}
+        struct netcode_client_t * client[NUM_BATCHING_CLIENTS];
 
-    uint64_t sequence;
+        int j;
+        for ( j = 0; j < NUM_BATCHING_CLIENTS; ++j )
+        {
+            char client_address[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+            snprintf( client_address, sizeof(client_address), "0.0.0.0:%d", 50000 + j );
 
-    int encryption_index = -1;
-    int client_index = netcode_server_find_client_index_by_address( server, from );
-    if ( client_index != -1 )
-    {
-        netcode_assert( client_index >= 0 );
-        netcode_assert( client_index < server->max_clients );
-        encryption_index = server->client_encryption_index[client_index];
-    }
-    else
-    {
-        encryption_index = netcode_encryption_manager_find_encryption_mapping( &server->encryption_manager, from, server->time );
-    }
-    
-    uint8_t * read_packet_key = netcode_encryption_manager_get_receive_key( &server->encryption_manager, encryption_index );
+            struct netcode_client_config_t client_config;
+            netcode_default_client_config( &client_config );
 
-    if ( !read_packet_key && packet_data[0] != 0 )
-    {
-        char address_string[NETCODE_MAX_ADDRESS_STRING_LENGTH];
-        netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server could not process packet because no encryption mapping exists for %s\n", netcode_address_to_string( from, address_string ) );
-        return;
-    }
+            client[j] = netcode_client_create( client_address, &client_config, time );
 
-    void * packet = netcode_read_packet( packet_data, 
-                                         packet_bytes, 
-                                         &sequence, 
-                                         read_packet_key, 
-                                         server->config.protocol_id, 
-                                         current_timestamp, 
-                                         server->config.private_key, 
-                                         allowed_packets, 
-                                         ( client_index != -1 ) ? &server->client_replay_protection[client_index] : NULL, 
-                                         server->config.allocator_context, 
-                                         server->config.allocate_function );
+            check( client[j] );
 
-    if ( !packet )
-        return;
+            uint64_t client_id = 0;
+            netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-    netcode_server_process_packet_internal( server, from, packet, sequence, encryption_index, client_index );
-}
+            NETCODE_CONST char * server_address = "127.0.0.1:40000";
 
-void netcode_server_receive_packets( struct netcode_server_t * server )
-{
-    netcode_assert( server );
+            uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-    uint8_t allowed_packets[NETCODE_CONNECTION_NUM_PACKETS];
-    memset( allowed_packets, 0, sizeof( allowed_packets ) );
-    allowed_packets[NETCODE_CONNECTION_REQUEST_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_RESPONSE_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_KEEP_ALIVE_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_PAYLOAD_PACKET] = 1;
-    allowed_packets[NETCODE_CONNECTION_DISCONNECT_PACKET] = 1;
+            uint8_t user_data[NETCODE_USER_DATA_BYTES];
+            netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-    uint64_t current_timestamp = (uint64_t) time( NULL );
+            check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-    if ( !server->config.network_simulator )
-    {
-        // process packets received from socket
+            netcode_client_connect( client[j], connect_token );
+        }
 
-        while ( 1 )
+        int iteration;
+        for ( iteration = 0; iteration < 100; ++iteration )
         {
-            struct netcode_address_t from;
-            
-            uint8_t packet_data[NETCODE_MAX_PACKET_BYTES];
-            
-            int packet_bytes = 0;
-            
-            if ( server->config.override_send_and_receive )
+            for ( j = 0; j < NUM_BATCHING_CLIENTS; ++j )
             {
-                packet_bytes = server->config.receive_packet_override( server->config.callback_context, &from, packet_data, NETCODE_MAX_PACKET_BYTES );
+                netcode_client_update( client[j], time );
             }
-            else
-            {
-                if (server->socket_holder.ipv4.handle != 0)
-                    packet_bytes = netcode_socket_receive_packet( &server->socket_holder.ipv4, &from, packet_data, NETCODE_MAX_PACKET_BYTES );
 
-                if ( packet_bytes == 0 && server->socket_holder.ipv6.handle != 0)
-                    packet_bytes = netcode_socket_receive_packet( &server->socket_holder.ipv6, &from, packet_data, NETCODE_MAX_PACKET_BYTES );
+            netcode_server_update( server, time );
 
-                if ( packet_bytes == 0 && server->config.aux_receive_packet != NULL )
-                    packet_bytes = server->config.aux_receive_packet( server->config.callback_context, &from, packet_data, NETCODE_MAX_PACKET_BYTES );
+            int num_connected_clients = 0;
+
+            for ( j = 0; j < NUM_BATCHING_CLIENTS; ++j )
+            {
+                if ( netcode_client_state( client[j] ) == NETCODE_CLIENT_STATE_CONNECTED )
+                    num_connected_clients++;
             }
 
-            if ( packet_bytes == 0 )
+            if ( num_connected_clients == NUM_BATCHING_CLIENTS )
                 break;
 
-            netcode_server_read_and_process_packet( server, &from, packet_data, packet_bytes, current_timestamp, allowed_packets );
+            time += delta_time;
         }
-    }
-    else
-    {
-        // process packets received from network simulator
 
-        int num_packets_received = netcode_network_simulator_receive_packets( server->config.network_simulator, 
-                                                                              &server->address, 
-                                                                              NETCODE_SERVER_MAX_RECEIVE_PACKETS, 
-                                                                              server->receive_packet_data, 
-                                                                              server->receive_packet_bytes, 
-                                                                              server->receive_from );
+        check( netcode_server_num_connected_clients( server ) == NUM_BATCHING_CLIENTS );
 
-        int i;
-        for ( i = 0; i < num_packets_received; ++i )
+        for ( j = 0; j < NUM_BATCHING_CLIENTS; ++j )
         {
-            netcode_server_read_and_process_packet( server, 
-                                                    &server->receive_from[i], 
-                                                    server->receive_packet_data[i], 
-                                                    server->receive_packet_bytes[i], 
-                                                    current_timestamp, 
-                                                    allowed_packets );
-
-            server->config.free_function( server->config.allocator_context, server->receive_packet_data[i] );
+            check( netcode_client_state( client[j] ) == NETCODE_CLIENT_STATE_CONNECTED );
         }
-    }
-}
-
-void netcode_server_send_packets( struct netcode_server_t * server )
-{
-    netcode_assert( server );
 
-    if ( !server->running )
-        return;
+        // exchange payload packets with every client each tick
 
-    int i;
-    for ( i = 0; i < server->max_clients; ++i )
-    {
-        if ( server->client_connected[i] && !server->client_loopback[i] &&
-             ( server->client_last_packet_send_time[i] + ( 1.0 / NETCODE_PACKET_SEND_RATE ) <= server->time ) )
-        {
-            netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server sent connection keep alive packet to client %d\n", i );
-            struct netcode_connection_keep_alive_packet_t packet;
-            packet.packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
-            packet.client_index = i;
-            packet.max_clients = server->max_clients;
-            netcode_server_send_client_packet( server, &packet, i );
-        }
-    }
-}
+        uint8_t packet_data[NETCODE_MAX_PACKET_SIZE];
+        for ( j = 0; j < NETCODE_MAX_PACKET_SIZE; ++j )
+            packet_data[j] = (uint8_t) j;
 
-void netcode_server_check_for_timeouts( struct netcode_server_t * server )
-{
-    netcode_assert( server );
+        uint64_t receive_calls = netcode_server_counters( server )[NETCODE_SERVER_COUNTER_NUM_SOCKET_RECEIVE_CALLS];
+        uint64_t send_calls = netcode_server_counters( server )[NETCODE_SERVER_COUNTER_NUM_SOCKET_SEND_CALLS];
+        uint64_t packets_received = netcode_server_counters( server )[NETCODE_SERVER_COUNTER_NUM_PACKETS_RECEIVED];
+        uint64_t packets_sent = netcode_server_counters( server )[NETCODE_SERVER_COUNTER_NUM_PACKETS_SENT];
 
-    if ( !server->running )
-        return;
+        int server_num_packets_received = 0;
+        int client_num_packets_received = 0;
 
-    int i;
-    for ( i = 0; i < server->max_clients; ++i )
-    {
-        if ( server->client_connected[i] && server->client_timeout[i] > 0 && !server->client_loopback[i] &&
-             ( server->client_last_packet_receive_time[i] + server->client_timeout[i] <= server->time ) )
+        int tick;
+        for ( tick = 0; tick < NUM_BATCHING_TICKS; ++tick )
         {
-            netcode_printf( NETCODE_LOG_LEVEL_INFO, "server timed out client %d\n", i );
-            netcode_server_disconnect_client_internal( server, i, 0 );
-        }
-    }
-}
+            for ( j = 0; j < NUM_BATCHING_CLIENTS; ++j )
+            {
+                netcode_client_send_packet( client[j], packet_data, NETCODE_MAX_PACKET_SIZE );
+            }
 
-int netcode_server_client_connected( struct netcode_server_t * server, int client_index )
-{
-    netcode_assert( server );
+            netcode_server_update( server, time );
 
-    if ( !server->running )
-        return 0;
+            for ( j = 0; j < NUM_BATCHING_CLIENTS; ++j )
+            {
+                netcode_server_send_packet( server, j, packet_data, NETCODE_MAX_PACKET_SIZE );
+            }
 
-    if ( client_index < 0 || client_index >= server->max_clients )
-        return 0;
+            netcode_server_flush_packets( server );
 
-    return server->client_connected[client_index];
-}
+            for ( j = 0; j < NUM_BATCHING_CLIENTS; ++j )
+            {
+                netcode_client_update( client[j], time );
 
-uint64_t netcode_server_client_id( struct netcode_server_t * server, int client_index )
-{
-    netcode_assert( server );
+                while ( 1 )             
+                {
+                    int packet_bytes;
+                    uint64_t packet_sequence;
+                    uint8_t * packet = netcode_client_receive_packet( client[j], &packet_bytes, &packet_sequence );
+                    if ( !packet )
+                        break;
+                    check( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+                    check( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
+                    client_num_packets_received++;
+                    netcode_client_free_packet( client[j], packet );
+                }
 
-    if ( !server->running )
-        return 0;
+                while ( 1 )             
+                {
+                    int packet_bytes;
+                    uint64_t packet_sequence;
+                    void * packet = netcode_server_receive_packet( server, j, &packet_bytes, &packet_sequence );
+                    if ( !packet )
+                        break;
+                    check( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+                    check( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
+                    server_num_packets_received++;
+                    netcode_server_free_packet( server, packet );
+                }
+            }
 
-    if ( client_index < 0 || client_index >= server->max_clients )
-        return 0;
+            time += delta_time;
+        }
 
-    return server->client_id[client_index];
-}
+        check( server_num_packets_received == NUM_BATCHING_CLIENTS * NUM_BATCHING_TICKS );
+        check( client_num_packets_received == NUM_BATCHING_CLIENTS * NUM_BATCHING_TICKS );
 
-struct netcode_address_t * netcode_server_client_address( struct netcode_server_t * server, int client_index )
-{
-    netcode_assert( server );
+        receive_calls = netcode_server_counters( server )[NETCODE_SERVER_COUNTER_NUM_SOCKET_RECEIVE_CALLS] - receive_calls;
+        send_calls = netcode_server_counters( server )[NETCODE_SERVER_COUNTER_NUM_SOCKET_SEND_CALLS] - send_calls;
+        packets_received = netcode_server_counters( server )[NETCODE_SERVER_COUNTER_NUM_PACKETS_RECEIVED] - packets_received;
+        packets_sent = netcode_server_counters( server )[NETCODE_SERVER_COUNTER_NUM_PACKETS_SENT] - packets_sent;
 
-    if (!server->running)
-        return NULL;
+        check( packets_received >= NUM_BATCHING_CLIENTS * NUM_BATCHING_TICKS );
+        check( packets_sent >= NUM_BATCHING_CLIENTS * NUM_BATCHING_TICKS );
 
-    if (client_index < 0 || client_index >= server->max_clients)
-        return NULL;
+        if ( NETCODE_SOCKET_BATCHING && batch_socket_io )
+        {
+            check( receive_calls < packets_received );
+            check( send_calls < packets_sent );
+        }
+        else
+        {
+            check( receive_calls > packets_received );
+            check( send_calls == packets_sent );
+        }
 
-    return &server->client_address[client_index];
-}
+        for ( j = 0; j < NUM_BATCHING_CLIENTS; ++j )
+        {
+            netcode_client_destroy( client[j] );
+        }
 
-uint64_t netcode_server_next_packet_sequence( struct netcode_server_t * server, int client_index )
-{
-    netcode_assert( client_index >= 0 );
-    netcode_assert( client_index < server->max_clients );
-    if ( !server->client_connected[client_index] )
-        return 0;
-    return server->client_sequence[client_index];    
+        netcode_server_destroy( server );
+    }
 }
 
-void netcode_server_send_packet( struct netcode_server_t * server, int client_index, NETCODE_CONST uint8_t * packet_data, int packet_bytes )
+void test_server_decrypted_payload_changed_client()
 {
-    netcode_assert( server );
-    netcode_assert( packet_data );
-    netcode_assert( packet_bytes >= 0 );
-    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_SIZE );
+    // a payload packet decrypted by a batch must only be read as authenticated if it still resolves to the client whose key
+    // decrypted it. packets earlier in the same batch can disconnect that client, or move another one onto its address
 
-    if ( !server->running )
-        return;
+    const uint64_t current_timestamp = (uint64_t) time( NULL );
+
+    struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
+
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
+
+    struct netcode_server_config_t server_config;
+    netcode_default_server_config( &server_config );
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-    netcode_assert( client_index >= 0 );
-    netcode_assert( client_index < server->max_clients );
-    if ( !server->client_connected[client_index] )
-        return;
+    struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
 
-    if ( !server->client_loopback[client_index] )
-    {
-        uint8_t buffer[NETCODE_MAX_PAYLOAD_BYTES*2];
+    check( server );
 
-        struct netcode_connection_payload_packet_t * packet = (struct netcode_connection_payload_packet_t*) buffer;
+    netcode_server_start( server, 2 );
 
-        packet->packet_type = NETCODE_CONNECTION_PAYLOAD_PACKET;
-        packet->payload_bytes = packet_bytes;
-        memcpy( packet->payload_data, packet_data, packet_bytes );
+    NETCODE_CONST char * server_address = "[::1]:40000";
 
-        if ( !server->client_confirmed[client_index] )
-        {
-            struct netcode_connection_keep_alive_packet_t keep_alive_packet;
-            keep_alive_packet.packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
-            keep_alive_packet.client_index = client_index;
-            keep_alive_packet.max_clients = server->max_clients;
-            netcode_server_send_client_packet( server, &keep_alive_packet, client_index );
-        }
+    struct netcode_client_t * client[2];
 
-        netcode_server_send_client_packet( server, packet, client_index );
-    }
-    else
+    int i;
+    for ( i = 0; i < 2; ++i )
     {
-        netcode_assert( server->config.send_loopback_packet_callback );
+        char client_address[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+        snprintf( client_address, sizeof(client_address), "[::]:%d", 50000 + i );
 
-        server->config.send_loopback_packet_callback( server->config.callback_context,
-                                                      client_index, 
-                                                      packet_data, 
-                                                      packet_bytes, 
-                                                      server->client_sequence[client_index]++ );
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
+        client_config.network_simulator = network_simulator;
 
-        server->client_last_packet_send_time[client_index] = server->time;
-    }
-}
+        client[i] = netcode_client_create( client_address, &client_config, time );
 
-uint8_t * netcode_server_receive_packet( struct netcode_server_t * server, int client_index, int * packet_bytes, uint64_t * packet_sequence )
-{
-    netcode_assert( server );
-    netcode_assert( packet_bytes );
+        check( client[i] );
 
-    if ( !server->running )
-        return NULL;
+        uint64_t client_id = 0;
+        netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-    if ( !server->client_connected[client_index] )
-        return NULL;
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-    netcode_assert( client_index >= 0 );
-    netcode_assert( client_index < server->max_clients );
+        uint8_t user_data[NETCODE_USER_DATA_BYTES];
+        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-    struct netcode_connection_payload_packet_t * packet = (struct netcode_connection_payload_packet_t*) 
-        netcode_packet_queue_pop( &server->client_packet_queue[client_index], packet_sequence );
-    
-    if ( packet )
-    {
-        netcode_assert( packet->packet_type == NETCODE_CONNECTION_PAYLOAD_PACKET );
-        *packet_bytes = packet->payload_bytes;
-        netcode_assert( *packet_bytes >= 0 );
-        netcode_assert( *packet_bytes <= NETCODE_MAX_PAYLOAD_BYTES );
-        return (uint8_t*) &packet->payload_data;
+        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+
+        netcode_client_connect( client[i], connect_token );
     }
-    else
+
+    int iteration;
+    for ( iteration = 0; iteration < 100; ++iteration )
     {
-        return NULL;
-    }
-}
+        netcode_network_simulator_update( network_simulator, time );
 
-void netcode_server_free_packet( struct netcode_server_t * server, void * packet )
-{
-    netcode_assert( server );
-    netcode_assert( packet );
-    (void) server;
-    int offset = offsetof( struct netcode_connection_payload_packet_t, payload_data );
-    server->config.free_function( server->config.allocator_context, ( (uint8_t*) packet ) - offset );
-}
+        netcode_client_update( client[0], time );
+        netcode_client_update( client[1], time );
 
-int netcode_server_num_connected_clients( struct netcode_server_t * server )
-{
-    netcode_assert( server );
-    return server->num_connected_clients;
-}
+        netcode_server_update( server, time );
 
-void * netcode_server_client_user_data( struct netcode_server_t * server, int client_index )
-{
-    netcode_assert( server );
-    netcode_assert( client_index >= 0 );
-    netcode_assert( client_index < server->max_clients );
-    return server->client_user_data[client_index];
-}
+        if ( netcode_client_state( client[0] ) == NETCODE_CLIENT_STATE_CONNECTED && netcode_client_state( client[1] ) == NETCODE_CLIENT_STATE_CONNECTED )
+            break;
 
-int netcode_server_running( struct netcode_server_t * server )
-{
-    netcode_assert( server );
-    return server->running;
-}
+        time += delta_time;
+    }
 
-int netcode_server_max_clients( struct netcode_server_t * server )
-{
-    return server->max_clients;
-}
+    check( netcode_server_num_connected_clients( server ) == 2 );
 
-void netcode_server_update( struct netcode_server_t * server, double time )
-{
-    netcode_assert( server );
-    server->time = time;
-    netcode_server_receive_packets( server );
-    netcode_server_send_packets( server );
-    netcode_server_check_for_timeouts( server );
-}
+    // capture a payload packet from the first client before the server reads it
 
-void netcode_server_connect_loopback_client( struct netcode_server_t * server, int client_index, uint64_t client_id, NETCODE_CONST uint8_t * user_data )
-{
-    netcode_assert( server );
-    netcode_assert( client_index >= 0 );
-    netcode_assert( client_index < server->max_clients );
-    netcode_assert( server->running );
-    netcode_assert( !server->client_connected[client_index] );
+    uint8_t packet_data[NETCODE_MAX_PACKET_SIZE];
+    for ( i = 0; i < NETCODE_MAX_PACKET_SIZE; ++i )
+        packet_data[i] = (uint8_t) i;
 
-    server->num_connected_clients++;
+    const int client_index = netcode_client_index( client[0] );
+    const int other_client_index = netcode_client_index( client[1] );
 
-    netcode_assert( server->num_connected_clients <= server->max_clients );
+    netcode_client_send_packet( client[0], packet_data, NETCODE_MAX_PACKET_SIZE );
 
-    server->client_loopback[client_index] = 1;
-    server->client_connected[client_index] = 1;
-    server->client_confirmed[client_index] = 1;
-    server->client_encryption_index[client_index] = -1;
-    server->client_id[client_index] = client_id;
-    server->client_sequence[client_index] = 0;
-    memset( &server->client_address[client_index], 0, sizeof( struct netcode_address_t ) );
-    server->client_last_packet_send_time[client_index] = server->time;
-    server->client_last_packet_receive_time[client_index] = server->time;
+    uint8_t payload_packet_data[NETCODE_MAX_PACKET_BYTES];
+    int payload_packet_bytes = 0;
 
-    if ( user_data )
-    {
-        memcpy( server->client_user_data[client_index], user_data, NETCODE_USER_DATA_BYTES );
-    }
-    else
+    for ( i = 0; i < NETCODE_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES; ++i )
     {
-        memset( server->client_user_data[client_index], 0, NETCODE_USER_DATA_BYTES );
+        struct netcode_network_simulator_packet_entry_t * entry = &network_simulator->packet_entries[i];
+        if ( entry->packet_data && ( entry->packet_data[0] & 0xF ) == NETCODE_CONNECTION_PAYLOAD_PACKET && netcode_address_equal( &entry->from, &server->client_address[client_index] ) )
+        {
+            memcpy( payload_packet_data, entry->packet_data, entry->packet_bytes );
+            payload_packet_bytes = entry->packet_bytes;
+        }
     }
 
-    netcode_printf( NETCODE_LOG_LEVEL_INFO, "server connected loopback client %.16" PRIx64 " in slot %d\n", client_id, client_index );
+    check( payload_packet_bytes > 0 );
 
-    if ( server->config.connect_disconnect_callback )
-    {
-        server->config.connect_disconnect_callback( server->config.callback_context, client_index, 1 );
-    }
-}
+    uint8_t allowed_packets[NETCODE_CONNECTION_NUM_PACKETS];
+    memset( allowed_packets, 0, sizeof( allowed_packets ) );
+    allowed_packets[NETCODE_CONNECTION_KEEP_ALIVE_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_PAYLOAD_PACKET] = 1;
+    allowed_packets[NETCODE_CONNECTION_DISCONNECT_PACKET] = 1;
 
-void netcode_server_disconnect_loopback_client( struct netcode_server_t * server, int client_index )
-{
-    netcode_assert( server );
-    netcode_assert( client_index >= 0 );
-    netcode_assert( client_index < server->max_clients );
-    netcode_assert( server->running );
-    netcode_assert( server->client_connected[client_index] );
-    netcode_assert( server->client_loopback[client_index] );
+    // pretend a batch decrypted it under the first client's key, but it now resolves to the other client. it must be dropped
 
-    netcode_printf( NETCODE_LOG_LEVEL_INFO, "server disconnected loopback client %d\n", client_index );
+    uint8_t packet_copy[NETCODE_MAX_PACKET_BYTES];
+    memcpy( packet_copy, payload_packet_data, payload_packet_bytes );
 
-    if ( server->config.connect_disconnect_callback )
-    {
-        server->config.connect_disconnect_callback( server->config.callback_context, client_index, 0 );
-    }
+    netcode_server_read_and_process_packet( server, 
+                                            &server->client_address[other_client_index], 
+                                            packet_copy, 
+                                            payload_packet_bytes, 
+                                            current_timestamp, 
+                                            allowed_packets, 
+                                            NULL, 
+                                            server->client_encryption_index[client_index] );
 
-    while ( 1 )
-    {
-        void * packet = netcode_packet_queue_pop( &server->client_packet_queue[client_index], NULL );
-        if ( !packet )
-            break;
-        server->config.free_function( server->config.allocator_context, packet );
-    }
+    int packet_bytes;
+    uint64_t packet_sequence;
+    check( netcode_server_receive_packet( server, other_client_index, &packet_bytes, &packet_sequence ) == NULL );
+    check( netcode_server_receive_packet( server, client_index, &packet_bytes, &packet_sequence ) == NULL );
 
-    netcode_packet_queue_clear( &server->client_packet_queue[client_index] );
+    // the same packet still reads normally from the client that sent it
 
-    server->client_connected[client_index] = 0;
-    server->client_loopback[client_index] = 0;
-    server->client_confirmed[client_index] = 0;
-    server->client_id[client_index] = 0;
-    server->client_sequence[client_index] = 0;
-    server->client_last_packet_send_time[client_index] = 0.0;
-    server->client_last_packet_receive_time[client_index] = 0.0;
-    memset( &server->client_address[client_index], 0, sizeof( struct netcode_address_t ) );
-    server->client_encryption_index[client_index] = -1;
-    memset( server->client_user_data[client_index], 0, NETCODE_USER_DATA_BYTES );
+    netcode_network_simulator_update( network_simulator, time );
 
-    server->num_connected_clients--;
+    netcode_server_update( server, time );
 
-    netcode_assert( server->num_connected_clients >= 0 );
-}
+    void * packet = netcode_server_receive_packet( server, client_index, &packet_bytes, &packet_sequence );
+    check( packet );
+    check( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+    check( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );
+    netcode_server_free_packet( server, packet );
 
-int netcode_server_client_loopback( struct netcode_server_t * server, int client_index )
-{
-    netcode_assert( server );
-    netcode_assert( server->running );
-    netcode_assert( client_index >= 0 );
-    netcode_assert( client_index < server->max_clients );
-    return server->client_loopback[client_index];
+    check( netcode_server_receive_packet( server, other_client_index, &packet_bytes, &packet_sequence ) == NULL );
+
+    netcode_server_destroy( server );
+
+    netcode_client_destroy( client[0] );
+    netcode_client_destroy( client[1] );
+
+    netcode_network_simulator_destroy( network_simulator );
 }
 
-void netcode_server_process_loopback_packet( struct netcode_server_t * server, int client_index, NETCODE_CONST uint8_t * packet_data, int packet_bytes, uint64_t packet_sequence )
+void test_server_wait()
 {
-    netcode_assert( server );
-    netcode_assert( client_index >= 0 );
-    netcode_assert( client_index < server->max_clients );
-    netcode_assert( packet_data );
-    netcode_assert( packet_bytes >= 0 );
-    netcode_assert( packet_bytes <= NETCODE_MAX_PACKET_SIZE );
-    netcode_assert( server->client_connected[client_index] );
-    netcode_assert( server->client_loopback[client_index] );
-    netcode_assert( server->running );
+    // modes: plain sockets, io_uring (falls back to batches if unavailable)
 
-    struct netcode_connection_payload_packet_t * packet = netcode_create_payload_packet( packet_bytes, server->config.allocator_context, server->config.allocate_function );
-    if ( !packet )
-        return;
+    int mode;
+    for ( mode = 0; mode <= 1; ++mode )
+    {
+        double time = 0.0;
+        double delta_time = 1.0 / 10.0;
 
-    memcpy( packet->payload_data, packet_data, packet_bytes );
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        server_config.io_uring_socket_io = mode == 1;
+        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-    netcode_printf( NETCODE_LOG_LEVEL_DEBUG, "server processing loopback packet from client %d\n", client_index );
+        struct netcode_server_t * server = netcode_server_create( "127.0.0.1:40000", &server_config, time );
 
-    server->client_last_packet_receive_time[client_index] = server->time;
+        check( server );
 
-    netcode_packet_queue_push( &server->client_packet_queue[client_index], packet, packet_sequence );
-}
+        netcode_server_start( server, 1 );
 
-uint16_t netcode_server_get_port( struct netcode_server_t * server )
-{
-    netcode_assert( server );
-    return server->address.type == NETCODE_ADDRESS_IPV4 ? server->socket_holder.ipv4.address.port : server->socket_holder.ipv6.address.port;
-}
+        check( netcode_server_socket_handle( server, NETCODE_ADDRESS_IPV4 ) != 0 );
+        check( netcode_server_socket_handle( server, NETCODE_ADDRESS_IPV6 ) == 0 );
 
-// ----------------------------------------------------------------
+        // nothing has been sent yet, so the wait must time out
 
-int netcode_generate_connect_token( int num_server_addresses, 
-                                    NETCODE_CONST char ** public_server_addresses, 
-                                    NETCODE_CONST char ** internal_server_addresses, 
-                                    int expire_seconds, 
-                                    int timeout_seconds,
-                                    uint64_t client_id, 
-                                    uint64_t protocol_id, 
-                                    NETCODE_CONST uint8_t * private_key, 
-                                    uint8_t * user_data, 
-                                    uint8_t * output_buffer )
-{
-    netcode_assert( num_server_addresses > 0 );
-    netcode_assert( num_server_addresses <= NETCODE_MAX_SERVERS_PER_CONNECT );
-    netcode_assert( public_server_addresses );
-    netcode_assert( internal_server_addresses );
-    netcode_assert( private_key );
-    netcode_assert( user_data );
-    netcode_assert( output_buffer );
+        check( netcode_server_wait( server, 0.0 ) == 0 );
+        check( netcode_server_wait( server, 0.01 ) == 0 );
+
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
+
+        struct netcode_client_t * client = netcode_client_create( "0.0.0.0:50000", &client_config, time );
+
+        check( client );
+
+        uint64_t client_id = 0;
+        netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-    // parse public server addresses
+        NETCODE_CONST char * server_address = "127.0.0.1:40000";
 
-    struct netcode_address_t parsed_public_server_addresses[NETCODE_MAX_SERVERS_PER_CONNECT];
-    int i;
-    for ( i = 0; i < num_server_addresses; ++i )
-    {
-        if ( netcode_parse_address( public_server_addresses[i], &parsed_public_server_addresses[i] ) != NETCODE_OK )
-        {
-            return NETCODE_ERROR;
-        }
-    }
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-    // parse internal server addresses
+        uint8_t user_data[NETCODE_USER_DATA_BYTES];
+        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-     struct netcode_address_t parsed_internal_server_addresses[NETCODE_MAX_SERVERS_PER_CONNECT];
-    for ( i = 0; i < num_server_addresses; ++i )
-    {
-        if ( netcode_parse_address( internal_server_addresses[i], &parsed_internal_server_addresses[i] ) != NETCODE_OK )
-        {
-            return NETCODE_ERROR;
-        }
-    }
+        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-    // generate a connect token
+        netcode_client_connect( client, connect_token );
 
-    uint8_t nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
-    netcode_generate_nonce(nonce);
+        check( netcode_client_socket_handle( client ) != 0 );
 
-    struct netcode_connect_token_private_t connect_token_private;
-    netcode_generate_connect_token_private( &connect_token_private, client_id, timeout_seconds, num_server_addresses, parsed_internal_server_addresses, user_data );
+        // the connection request wakes the server, the challenge wakes the client
 
-    // write it to a buffer
+        netcode_client_update( client, time );
 
-    uint8_t connect_token_data[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
-    netcode_write_connect_token_private( &connect_token_private, connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+        check( netcode_server_wait( server, 1.0 ) == 1 );
 
-    // encrypt the buffer
+        netcode_server_update( server, time );
 
-    uint64_t create_timestamp = time( NULL );
-    uint64_t expire_timestamp = ( expire_seconds >= 0 ) ? ( create_timestamp + expire_seconds ) : 0xFFFFFFFFFFFFFFFFULL;
-    if ( netcode_encrypt_connect_token_private( connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, NETCODE_VERSION_INFO, protocol_id, expire_timestamp, nonce, private_key ) != NETCODE_OK )
-        return NETCODE_ERROR;
+        check( netcode_client_wait( client, 1.0 ) == 1 );
 
-    // wrap a connect token around the private connect token data
+        int iteration;
+        for ( iteration = 0; iteration < 100; ++iteration )
+        {
+            netcode_client_update( client, time );
 
-    struct netcode_connect_token_t connect_token;
-    memcpy( connect_token.version_info, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
-    connect_token.protocol_id = protocol_id;
-    connect_token.create_timestamp = create_timestamp;
-    connect_token.expire_timestamp = expire_timestamp;
-    memcpy( connect_token.nonce, nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
-    memcpy( connect_token.private_data, connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
-    connect_token.num_server_addresses = num_server_addresses;
-    for ( i = 0; i < num_server_addresses; ++i )
-        connect_token.server_addresses[i] = parsed_public_server_addresses[i];
-    memcpy( connect_token.client_to_server_key, connect_token_private.client_to_server_key, NETCODE_KEY_BYTES );
-    memcpy( connect_token.server_to_client_key, connect_token_private.server_to_client_key, NETCODE_KEY_BYTES );
-    connect_token.timeout_seconds = timeout_seconds;
+            netcode_server_wait( server, 0.1 );
 
-    // write the connect token to the output buffer
+            netcode_server_update( server, time );
 
-    netcode_write_connect_token( &connect_token, output_buffer, NETCODE_CONNECT_TOKEN_BYTES );
+            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+                break;
 
-    return NETCODE_OK;
-}
+            time += delta_time;
+        }
 
-// ---------------------------------------------------------------
+        check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
 
-#if __APPLE__
+        // a payload packet wakes the server again once everything has been drained
 
-// MacOS
+        netcode_server_update( server, time );
 
-#include <unistd.h>
-#include <mach/mach.h>
-#include <mach/mach_time.h>
+        uint8_t packet_data[NETCODE_MAX_PACKET_SIZE];
+        memset( packet_data, 0, sizeof( packet_data ) );
 
-void netcode_sleep( double time )
-{
-    struct timespec ts;
-    ts.tv_sec = (time_t) time;
-    ts.tv_nsec = (long) ((time - (double) ( ts.tv_sec )) * 1000000000.0);
-    nanosleep( &ts, NULL );
-}
+        netcode_client_send_packet( client, packet_data, NETCODE_MAX_PACKET_SIZE );
 
-static uint64_t start = 0;
-static mach_timebase_info_data_t timebase_info;
+        check( netcode_server_wait( server, 1.0 ) == 1 );
 
-double netcode_time()
-{
-    if ( start == 0 )
-    {
-        mach_timebase_info( &timebase_info );
-        start = mach_absolute_time();
-        return 0.0;
-    }
-    uint64_t current = mach_absolute_time();
-    return ( (double) ( current - start ) ) * ( (double) timebase_info.numer ) / ( (double) timebase_info.denom ) / 1000000000.0;
-}
+        // an external reactor polls the handle instead. with io_uring it is the ring, which must wake up just the same
 
-#elif __linux
+        netcode_socket_handle_t handle = (netcode_socket_handle_t) netcode_server_socket_handle( server, NETCODE_ADDRESS_IPV4 );
 
-// linux
+        check( handle != 0 );
+        check( netcode_socket_wait( &handle, 1, 1.0 ) == 1 );
 
-#include <unistd.h>
+        netcode_server_update( server, time );
 
-void netcode_sleep( double time )
-{
-    struct timespec ts;
-    ts.tv_sec = (time_t) time;
-    ts.tv_nsec = (long) ((time - (double) ( ts.tv_sec )) * 1000000000.0);
-    nanosleep( &ts, NULL );
+        check( netcode_socket_wait( &handle, 1, 0.0 ) == 0 );
+
+        int packet_bytes;
+        uint64_t packet_sequence;
+        void * packet = netcode_server_receive_packet( server, 0, &packet_bytes, &packet_sequence );
+        check( packet );
+        check( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+        netcode_server_free_packet( server, packet );
+
+        netcode_client_destroy( client );
+
+        netcode_server_destroy( server );
+    }
 }
 
-double netcode_time()
+void test_server_receive_no_allocations()
 {
-    static double start = -1;
-    if ( start == -1 )
+    // modes: plain sockets, recvmmsg batches. once warmed up, receiving payloads must not touch the allocator
+
+    int mode;
+    for ( mode = 0; mode <= 1; ++mode )
     {
-        struct timespec ts;
-        clock_gettime( CLOCK_MONOTONIC_RAW, &ts );
-        start = ts.tv_sec + ( (double) ( ts.tv_nsec ) ) / 1000000000.0;
-        return 0.0;
-    }
-    struct timespec ts;
-    clock_gettime( CLOCK_MONOTONIC_RAW, &ts );
-    double current = ts.tv_sec + ( (double) ( ts.tv_nsec ) ) / 1000000000.0;
-    return current - start;
-}
+        double time = 0.0;
+        double delta_time = 1.0 / 10.0;
 
-#elif defined(__EMSCRIPTEN__)
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        server_config.batch_socket_io = mode;
+        server_config.io_uring_socket_io = 0;
+        server_config.allocate_function = test_counting_allocate_function;
+        server_config.free_function = test_counting_free_function;
+        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-#elif defined( _WIN32 )
+        struct netcode_server_t * server = netcode_server_create( "127.0.0.1:40000", &server_config, time );
 
-// windows
+        check( server );
 
-#define NOMINMAX
-#include <windows.h>
+        netcode_server_start( server, 1 );
 
-void netcode_sleep( double time )
-{
-    int milliseconds = (int) ( time * 1000 );
-    Sleep( milliseconds );
-}
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
 
-static int timer_initialized = 0;
-static LARGE_INTEGER timer_frequency;
-static LARGE_INTEGER timer_start;
+        struct netcode_client_t * client = netcode_client_create( "0.0.0.0:50000", &client_config, time );
 
-double netcode_time()
-{
-    if ( !timer_initialized )
-    {
-        QueryPerformanceFrequency( &timer_frequency );
-        QueryPerformanceCounter( &timer_start );
-        timer_initialized = 1;
-    }
-    LARGE_INTEGER now;
-    QueryPerformanceCounter( &now );
-    return ( (double) ( now.QuadPart - timer_start.QuadPart ) ) / ( (double) ( timer_frequency.QuadPart ) );
-}
+        check( client );
 
-#elif defined(__EMSCRIPTEN__)
+        uint64_t client_id = 0;
+        netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-#else
+        NETCODE_CONST char * server_address = "127.0.0.1:40000";
 
-#error unsupported platform!
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-#endif
+        uint8_t user_data[NETCODE_USER_DATA_BYTES];
+        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-// ---------------------------------------------------------------
+        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-#if NETCODE_ENABLE_TESTS
+        netcode_client_connect( client, connect_token );
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <memory.h>
-#include <time.h>
+        int iteration;
+        for ( iteration = 0; iteration < 100; ++iteration )
+        {
+            netcode_client_update( client, time );
 
-static void check_handler( NETCODE_CONST char * condition, 
-                           NETCODE_CONST char * function,
-                           NETCODE_CONST char * file,
-                           int line )
-{
-    printf( "check failed: ( %s ), function %s, file %s, line %d\n", condition, function, file, line );
-#ifdef NETCODE_DEBUG
-    #if defined( __GNUC__ )
-        __builtin_trap();
-    #elif defined( _MSC_VER )
-        __debugbreak();
-    #endif
-#endif
-    exit( 1 );
-}
+            netcode_server_update( server, time );
 
-#define check( condition )                                                                                      \
-do                                                                                                              \
-{                                                                                                               \
-    if ( !(condition) )                                                                                         \
-    {                                                                                                           \
-        check_handler( #condition, (NETCODE_CONST char*) __FUNCTION__, (char*) __FILE__, __LINE__ );            \
-    }                                                                                                           \
-} while(0)
+            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+                break;
 
-static void test_queue()
-{
-    struct netcode_packet_queue_t queue;
+            time += delta_time;
+        }
 
-    netcode_packet_queue_init( &queue, NULL, NULL, NULL );
+        check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
 
-    check( queue.num_packets == 0 );
-    check( queue.start_index == 0 );
+        uint8_t packet_data[NETCODE_MAX_PACKET_SIZE];
+        int j;
+        for ( j = 0; j < NETCODE_MAX_PACKET_SIZE; ++j )
+            packet_data[j] = (uint8_t) j;
 
-    // attempting to pop a packet off an empty queue should return NULL
+        int num_allocations = 0;
+        int num_packets_received = 0;
 
-    check( netcode_packet_queue_pop( &queue, NULL ) == NULL );
+        int tick;
+        for ( tick = 0; tick < 20; ++tick )
+        {
+            // the first ticks warm up the pool
 
-    // add some packets to the queue and make sure they pop off in the correct order
-    {
-        #define NUM_PACKETS 100
+            if ( tick == 10 )
+                num_allocations = test_num_allocations;
 
-        void * packets[NUM_PACKETS];
+            for ( j = 0; j < 8; ++j )
+            {
+                netcode_client_send_packet( client, packet_data, NETCODE_MAX_PACKET_SIZE );
+            }
 
-        int i;
-        for ( i = 0; i < NUM_PACKETS; ++i )
-        {
-            packets[i] = malloc( (i+1) * 256 );
-            check( netcode_packet_queue_push( &queue, packets[i], (uint64_t) i ) == 1 );
+            netcode_client_update( client, time );
+
+            netcode_server_update( server, time );
+
+            while ( 1 )
+            {
+                int packet_bytes;
+                uint64_t packet_sequence;
+                uint8_t * packet = netcode_server_receive_packet( server, 0, &packet_bytes, &packet_sequence );
+                if ( !packet )
+                    break;
+                check( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+                check( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );
+                netcode_server_free_packet( server, packet );
+                num_packets_received++;
+            }
+
+            time += delta_time;
         }
 
-        check( queue.num_packets == NUM_PACKETS );
+        check( num_packets_received > 0 );
+        check( test_num_allocations == num_allocations );
+
+        netcode_client_destroy( client );
+
+        netcode_server_destroy( server );
+    }
+}
+
+void test_send_packet_in_place()
+{
+    // modes: plain sockets, sendmmsg batches. packets written into headroom and tailroom must arrive intact,
+    // and nothing outside of the reserved room may be touched
+
+    int mode;
+    for ( mode = 0; mode <= 1; ++mode )
+    {
+        double time = 0.0;
+        double delta_time = 1.0 / 10.0;
+
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        server_config.batch_socket_io = mode;
+        server_config.io_uring_socket_io = 0;
+        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-        for ( i = 0; i < NUM_PACKETS; ++i )
-        {
-            uint64_t sequence = 0;
-            void * packet = netcode_packet_queue_pop( &queue, &sequence );
-            check( sequence == (uint64_t) i ) ;
-            check( packet == packets[i] );
-            free( packet );
-        }
-    }
+        struct netcode_server_t * server = netcode_server_create( "127.0.0.1:40000", &server_config, time );
 
-    // after all entries are popped off, the queue is empty, so calls to pop should return NULL
+        check( server );
 
-    check( queue.num_packets == 0 );
+        netcode_server_start( server, 1 );
 
-    check( netcode_packet_queue_pop( &queue, NULL ) == NULL );
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
 
-    // test that the packet queue can be filled to max capacity
+        struct netcode_client_t * client = netcode_client_create( "0.0.0.0:50000", &client_config, time );
 
-    void * packets[NETCODE_PACKET_QUEUE_SIZE];
+        check( client );
 
-    int i;
-    for ( i = 0; i < NETCODE_PACKET_QUEUE_SIZE; ++i )
-    {
-        packets[i] = malloc( i * 256 );
-        check( netcode_packet_queue_push( &queue, packets[i], (uint64_t) i ) == 1 );
-    }
+        uint64_t client_id = 0;
+        netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-    check( queue.num_packets == NETCODE_PACKET_QUEUE_SIZE );
+        NETCODE_CONST char * server_address = "127.0.0.1:40000";
 
-    // when the queue is full, attempting to push a packet should fail and return 0
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-    check( netcode_packet_queue_push( &queue, malloc( 100 ), 0 ) == 0 );
+        uint8_t user_data[NETCODE_USER_DATA_BYTES];
+        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-    // make sure all packets pop off in the correct order
+        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-    for ( i = 0; i < NETCODE_PACKET_QUEUE_SIZE; ++i )
-    {
-        uint64_t sequence = 0;
-        void * packet = netcode_packet_queue_pop( &queue, &sequence );
-        check( sequence == (uint64_t) i );
-        check( packet == packets[i] );
-        free( packet );
-    }
+        netcode_client_connect( client, connect_token );
 
-    // add some packets again
+        int iteration;
+        for ( iteration = 0; iteration < 100; ++iteration )
+        {
+            netcode_client_update( client, time );
 
-    for ( i = 0; i < NETCODE_PACKET_QUEUE_SIZE; ++i )
-    {
-        packets[i] = malloc( i * 256 );
-        check( netcode_packet_queue_push( &queue, packets[i], (uint64_t) i ) == 1 );
-    }
+            netcode_server_update( server, time );
 
-    // clear the queue and make sure that all packets are freed
+            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+                break;
 
-    netcode_packet_queue_clear( &queue );
+            time += delta_time;
+        }
 
-    check( queue.start_index == 0 );
-    check( queue.num_packets == 0 );
-    for ( i = 0; i < NETCODE_PACKET_QUEUE_SIZE; ++i )
-        check( queue.packet_data[i] == NULL );
-}
+        check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
 
-static void test_endian()
-{
-    uint32_t value = 0x11223344;
+        #define IN_PLACE_GUARD_BYTES 8
 
-    char * bytes = (char*) &value;
+        uint8_t expected_packet_data[NETCODE_MAX_PACKET_SIZE];
+        int j;
+        for ( j = 0; j < NETCODE_MAX_PACKET_SIZE; ++j )
+            expected_packet_data[j] = (uint8_t) j;
 
-#if NETCODE_LITTLE_ENDIAN
+        uint8_t buffer[IN_PLACE_GUARD_BYTES + NETCODE_PACKET_HEADROOM_BYTES + NETCODE_MAX_PACKET_SIZE + NETCODE_PACKET_TAILROOM_BYTES + IN_PLACE_GUARD_BYTES];
+        uint8_t * packet_data = buffer + IN_PLACE_GUARD_BYTES + NETCODE_PACKET_HEADROOM_BYTES;
 
-    check( bytes[0] == 0x44 );
-    check( bytes[1] == 0x33 );
-    check( bytes[2] == 0x22 );
-    check( bytes[3] == 0x11 );
+        int server_num_packets_received = 0;
+        int client_num_packets_received = 0;
 
-#else // #if NETCODE_LITTLE_ENDIAN
+        int tick;
+        for ( tick = 0; tick < 10; ++tick )
+        {
+            int packet_bytes = 1 + ( tick * 131 ) % NETCODE_MAX_PACKET_SIZE;
 
-    check( bytes[3] == 0x44 );
-    check( bytes[2] == 0x33 );
-    check( bytes[1] == 0x22 );
-    check( bytes[0] == 0x11 );
+            memset( buffer, 0xFF, sizeof( buffer ) );
+            memcpy( packet_data, expected_packet_data, packet_bytes );
+            netcode_client_send_packet_in_place( client, packet_data, packet_bytes );
 
-#endif // #if NETCODE_LITTLE_ENDIAN
-}
+            for ( j = 0; j < IN_PLACE_GUARD_BYTES; ++j )
+            {
+                check( buffer[j] == 0xFF );
+                check( packet_data[packet_bytes + NETCODE_PACKET_TAILROOM_BYTES + j] == 0xFF );
+            }
 
-static void test_sequence()
-{
-    check( netcode_sequence_number_bytes_required( 0 ) == 1 );
-    check( netcode_sequence_number_bytes_required( 0x11 ) == 1 );
-    check( netcode_sequence_number_bytes_required( 0x1122 ) == 2 );
-    check( netcode_sequence_number_bytes_required( 0x112233 ) == 3 );
-    check( netcode_sequence_number_bytes_required( 0x11223344 ) == 4 );
-    check( netcode_sequence_number_bytes_required( 0x1122334455 ) == 5 );
-    check( netcode_sequence_number_bytes_required( 0x112233445566 ) == 6 );
-    check( netcode_sequence_number_bytes_required( 0x11223344556677 ) == 7 );
-    check( netcode_sequence_number_bytes_required( 0x1122334455667788 ) == 8 );
-}
+            memset( buffer, 0xFF, sizeof( buffer ) );
+            memcpy( packet_data, expected_packet_data, packet_bytes );
+            netcode_server_send_packet_in_place( server, 0, packet_data, packet_bytes );
 
-static void test_address()
-{
-    {
-        struct netcode_address_t address;
-        check( netcode_parse_address( "", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( "[", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( "[]", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( "[]:", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( ":", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( "1", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( "12", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( "123", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( "1234", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( "1234.0.12313.0000", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( "1234.0.12313.0000.0.0.0.0.0", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( "1312313:123131:1312313:123131:1312313:123131:1312313:123131:1312313:123131:1312313:123131", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( ".", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( "..", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( "...", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( "....", &address ) == NETCODE_ERROR );
-        check( netcode_parse_address( ".....", &address ) == NETCODE_ERROR );
-    }
+            for ( j = 0; j < IN_PLACE_GUARD_BYTES; ++j )
+            {
+                check( buffer[j] == 0xFF );
+                check( packet_data[packet_bytes + NETCODE_PACKET_TAILROOM_BYTES + j] == 0xFF );
+            }
 
-    {
-        struct netcode_address_t address;
-        check( netcode_parse_address( "107.77.207.77", &address ) == NETCODE_OK );
-        check( address.type == NETCODE_ADDRESS_IPV4 );
-        check( address.port == 0 );
-        check( address.data.ipv4[0] == 107 );
-        check( address.data.ipv4[1] == 77 );
-        check( address.data.ipv4[2] == 207 );
-        check( address.data.ipv4[3] == 77 );
-    }
+            netcode_server_flush_packets( server );
 
-    {
-        struct netcode_address_t address;
-        check( netcode_parse_address( "127.0.0.1", &address ) == NETCODE_OK );
-        check( address.type == NETCODE_ADDRESS_IPV4 );
-        check( address.port == 0 );
-        check( address.data.ipv4[0] == 127 );
-        check( address.data.ipv4[1] == 0 );
-        check( address.data.ipv4[2] == 0 );
-        check( address.data.ipv4[3] == 1 );
-    }
+            time += delta_time;
 
-    {
-        struct netcode_address_t address;
-        check( netcode_parse_address( "107.77.207.77:40000", &address ) == NETCODE_OK );
-        check( address.type == NETCODE_ADDRESS_IPV4 );
-        check( address.port == 40000 );
-        check( address.data.ipv4[0] == 107 );
-        check( address.data.ipv4[1] == 77 );
-        check( address.data.ipv4[2] == 207 );
-        check( address.data.ipv4[3] == 77 );
-    }
+            netcode_client_update( client, time );
 
-    {
-        struct netcode_address_t address;
-        check( netcode_parse_address( "127.0.0.1:40000", &address ) == NETCODE_OK );
-        check( address.type == NETCODE_ADDRESS_IPV4 );
-        check( address.port == 40000 );
-        check( address.data.ipv4[0] == 127 );
-        check( address.data.ipv4[1] == 0 );
-        check( address.data.ipv4[2] == 0 );
-        check( address.data.ipv4[3] == 1 );
-    }
+            netcode_server_update( server, time );
 
-    {
-        struct netcode_address_t address;
-        check( netcode_parse_address( "fe80::202:b3ff:fe1e:8329", &address ) == NETCODE_OK );
-        check( address.type == NETCODE_ADDRESS_IPV6 );
-        check( address.port == 0 );
-        check( address.data.ipv6[0] == 0xfe80 );
-        check( address.data.ipv6[1] == 0x0000 );
-        check( address.data.ipv6[2] == 0x0000 );
-        check( address.data.ipv6[3] == 0x0000 );
-        check( address.data.ipv6[4] == 0x0202 );
-        check( address.data.ipv6[5] == 0xb3ff );
-        check( address.data.ipv6[6] == 0xfe1e );
-        check( address.data.ipv6[7] == 0x8329 );
-    }
+            while ( 1 )
+            {
+                int received_bytes;
+                uint64_t packet_sequence;
+                uint8_t * packet = netcode_server_receive_packet( server, 0, &received_bytes, &packet_sequence );
+                if ( !packet )
+                    break;
+                check( received_bytes == packet_bytes );
+                check( memcmp( packet, expected_packet_data, packet_bytes ) == 0 );
+                netcode_server_free_packet( server, packet );
+                server_num_packets_received++;
+            }
 
-    {
-        struct netcode_address_t address;
-        check( netcode_parse_address( "::", &address ) == NETCODE_OK );
-        check( address.type == NETCODE_ADDRESS_IPV6 );
-        check( address.port == 0 );
-        check( address.data.ipv6[0] == 0x0000 );
-        check( address.data.ipv6[1] == 0x0000 );
-        check( address.data.ipv6[2] == 0x0000 );
-        check( address.data.ipv6[3] == 0x0000 );
-        check( address.data.ipv6[4] == 0x0000 );
-        check( address.data.ipv6[5] == 0x0000 );
-        check( address.data.ipv6[6] == 0x0000 );
-        check( address.data.ipv6[7] == 0x0000 );
-    }
+            while ( 1 )
+            {
+                int received_bytes;
+                uint64_t packet_sequence;
+                uint8_t * packet = netcode_client_receive_packet( client, &received_bytes, &packet_sequence );
+                if ( !packet )
+                    break;
+                check( received_bytes == packet_bytes );
+                check( memcmp( packet, expected_packet_data, packet_bytes ) == 0 );
+                netcode_client_free_packet( client, packet );
+                client_num_packets_received++;
+            }
+        }
 
-    {
-        struct netcode_address_t address;
-        check( netcode_parse_address( "::1", &address ) == NETCODE_OK );
-        check( address.type == NETCODE_ADDRESS_IPV6 );
-        check( address.port == 0 );
-        check( address.data.ipv6[0] == 0x0000 );
-        check( address.data.ipv6[1] == 0x0000 );
-        check( address.data.ipv6[2] == 0x0000 );
-        check( address.data.ipv6[3] == 0x0000 );
-        check( address.data.ipv6[4] == 0x0000 );
-        check( address.data.ipv6[5] == 0x0000 );
-        check( address.data.ipv6[6] == 0x0000 );
-        check( address.data.ipv6[7] == 0x0001 );
-    }
+        check( server_num_packets_received > 0 );
+        check( client_num_packets_received > 0 );
 
-    {
-        struct netcode_address_t address;
-        check( netcode_parse_address( "[fe80::202:b3ff:fe1e:8329]:40000", &address ) == NETCODE_OK );
-        check( address.type == NETCODE_ADDRESS_IPV6 );
-        check( address.port == 40000 );
-        check( address.data.ipv6[0] == 0xfe80 );
-        check( address.data.ipv6[1] == 0x0000 );
-        check( address.data.ipv6[2] == 0x0000 );
-        check( address.data.ipv6[3] == 0x0000 );
-        check( address.data.ipv6[4] == 0x0202 );
-        check( address.data.ipv6[5] == 0xb3ff );
-        check( address.data.ipv6[6] == 0xfe1e );
-        check( address.data.ipv6[7] == 0x8329 );
-    }
+        netcode_client_destroy( client );
 
-    {
-        struct netcode_address_t address;
-        check( netcode_parse_address( "[::]:40000", &address ) == NETCODE_OK );
-        check( address.type == NETCODE_ADDRESS_IPV6 );
-        check( address.port == 40000 );
-        check( address.data.ipv6[0] == 0x0000 );
-        check( address.data.ipv6[1] == 0x0000 );
-        check( address.data.ipv6[2] == 0x0000 );
-        check( address.data.ipv6[3] == 0x0000 );
-        check( address.data.ipv6[4] == 0x0000 );
-        check( address.data.ipv6[5] == 0x0000 );
-        check( address.data.ipv6[6] == 0x0000 );
-        check( address.data.ipv6[7] == 0x0000 );
+        netcode_server_destroy( server );
     }
+}
 
+#define TEST_SEND_BATCH_NUM_CLIENTS 3
+#define TEST_SEND_BATCH_NUM_PACKETS 20
+
+static int test_server_client_index( struct netcode_server_t * server, uint64_t client_id )
+{
+    int i;
+    for ( i = 0; i < netcode_server_max_clients( server ); ++i )
     {
-        struct netcode_address_t address;
-        check( netcode_parse_address( "[::1]:40000", &address ) == NETCODE_OK );
-        check( address.type == NETCODE_ADDRESS_IPV6 );
-        check( address.port == 40000 );
-        check( address.data.ipv6[0] == 0x0000 );
-        check( address.data.ipv6[1] == 0x0000 );
-        check( address.data.ipv6[2] == 0x0000 );
-        check( address.data.ipv6[3] == 0x0000 );
-        check( address.data.ipv6[4] == 0x0000 );
-        check( address.data.ipv6[5] == 0x0000 );
-        check( address.data.ipv6[6] == 0x0000 );
-        check( address.data.ipv6[7] == 0x0001 );
+        if ( netcode_server_client_connected( server, i ) && netcode_server_client_id( server, i ) == client_id )
+            return i;
     }
+    return -1;
 }
 
-#define TEST_PROTOCOL_ID            0x1122334455667788ULL
-#define TEST_CLIENT_ID              0x1ULL
-#define TEST_SERVER_PORT            40000
-#define TEST_CONNECT_TOKEN_EXPIRY   30
-#define TEST_TIMEOUT_SECONDS        15
-
-static void test_connect_token()
+void test_server_send_packets_batch()
 {
-    // generate a connect token
+    // modes: plain sockets, sendmmsg/recvmmsg batches. one batch with several packets per client, larger than
+    // a set of lanes, must arrive intact and in order. the batched mode also runs client packets through batch decryption
 
-    struct netcode_address_t server_address;
-    server_address.type = NETCODE_ADDRESS_IPV4;
-    server_address.data.ipv4[0] = 127;
-    server_address.data.ipv4[1] = 0;
-    server_address.data.ipv4[2] = 0;
-    server_address.data.ipv4[3] = 1;
-    server_address.port = TEST_SERVER_PORT;
+    int mode;
+    for ( mode = 0; mode <= 1; ++mode )
+    {
+        double time = 0.0;
+        double delta_time = 1.0 / 10.0;
 
-    uint8_t user_data[NETCODE_USER_DATA_BYTES];
-    netcode_random_bytes( user_data, NETCODE_USER_DATA_BYTES );
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        server_config.batch_socket_io = mode;
+        server_config.io_uring_socket_io = 0;
+        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-    struct netcode_connect_token_private_t input_token;
+        struct netcode_server_t * server = netcode_server_create( "127.0.0.1:40000", &server_config, time );
 
-    netcode_generate_connect_token_private( &input_token, TEST_CLIENT_ID, TEST_TIMEOUT_SECONDS, 1, &server_address, user_data );
+        check( server );
 
-    check( input_token.client_id == TEST_CLIENT_ID );
-    check( input_token.num_server_addresses == 1 );
-    check( memcmp( input_token.user_data, user_data, NETCODE_USER_DATA_BYTES ) == 0 );
-    check( netcode_address_equal( &input_token.server_addresses[0], &server_address ) );
+        netcode_server_start( server, TEST_SEND_BATCH_NUM_CLIENTS );
 
-    // write it to a buffer
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
 
-    uint8_t buffer[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
+        struct netcode_client_t * client[TEST_SEND_BATCH_NUM_CLIENTS];
 
-    netcode_write_connect_token_private( &input_token, buffer, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+        NETCODE_CONST char * server_address = "127.0.0.1:40000";
 
-    // encrypt the buffer
+        uint8_t user_data[NETCODE_USER_DATA_BYTES];
+        netcode_random_bytes( user_data, NETCODE_USER_DATA_BYTES );
 
-    uint64_t expire_timestamp = time( NULL ) + 30;
-    uint8_t nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
-    netcode_generate_nonce(nonce);
-    uint8_t key[NETCODE_KEY_BYTES];
-    netcode_generate_key( key );    
+        int i;
+        for ( i = 0; i < TEST_SEND_BATCH_NUM_CLIENTS; ++i )
+        {
+            char client_address[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+            sprintf( client_address, "127.0.0.1:%d", 50000 + i );
 
-    check( netcode_encrypt_connect_token_private( buffer, 
-                                                  NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, 
-                                                  NETCODE_VERSION_INFO, 
-                                                  TEST_PROTOCOL_ID, 
-                                                  expire_timestamp, 
-                                                  nonce, 
-                                                  key ) == NETCODE_OK );
+            client[i] = netcode_client_create( client_address, &client_config, time );
+            check( client[i] );
 
-    // decrypt the buffer
+            uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+            check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, (uint64_t) i + 1, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-    check( netcode_decrypt_connect_token_private( buffer, 
-                                                  NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, 
-                                                  NETCODE_VERSION_INFO, 
-                                                  TEST_PROTOCOL_ID, 
-                                                  expire_timestamp, 
-                                                  nonce, 
-                                                  key ) == NETCODE_OK );
+            netcode_client_connect( client[i], connect_token );
+        }
 
-    // read the connect token back in
+        int iteration;
+        for ( iteration = 0; iteration < 100; ++iteration )
+        {
+            for ( i = 0; i < TEST_SEND_BATCH_NUM_CLIENTS; ++i )
+                netcode_client_update( client[i], time );
 
-    struct netcode_connect_token_private_t output_token;
+            netcode_server_update( server, time );
 
-    check( netcode_read_connect_token_private( buffer, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, &output_token ) == NETCODE_OK );
+            if ( netcode_server_num_connected_clients( server ) == TEST_SEND_BATCH_NUM_CLIENTS )
+                break;
 
-    // make sure that everything matches the original connect token
+            time += delta_time;
+        }
 
-    check( output_token.client_id == input_token.client_id );
-    check( output_token.timeout_seconds == input_token.timeout_seconds );
-    check( output_token.num_server_addresses == input_token.num_server_addresses );
-    check( netcode_address_equal( &output_token.server_addresses[0], &input_token.server_addresses[0] ) );
-    check( memcmp( output_token.client_to_server_key, input_token.client_to_server_key, NETCODE_KEY_BYTES ) == 0 );
-    check( memcmp( output_token.server_to_client_key, input_token.server_to_client_key, NETCODE_KEY_BYTES ) == 0 );
-    check( memcmp( output_token.user_data, input_token.user_data, NETCODE_USER_DATA_BYTES ) == 0 );
-}
+        check( netcode_server_num_connected_clients( server ) == TEST_SEND_BATCH_NUM_CLIENTS );
 
-static void test_challenge_token()
-{
-    // generate a challenge token
+        for ( i = 0; i < TEST_SEND_BATCH_NUM_CLIENTS; ++i )
+            netcode_client_update( client[i], time );
 
-    struct netcode_challenge_token_t input_token;
+        // packet i goes to client i % num clients and carries its own index, so order can be checked on arrival
 
-    input_token.client_id = TEST_CLIENT_ID;
-    netcode_random_bytes( input_token.user_data, NETCODE_USER_DATA_BYTES );
+        static uint8_t packet_buffer[TEST_SEND_BATCH_NUM_PACKETS][NETCODE_MAX_PACKET_SIZE];
+        NETCODE_CONST uint8_t * packet_data[TEST_SEND_BATCH_NUM_PACKETS];
+        int packet_bytes[TEST_SEND_BATCH_NUM_PACKETS];
+        int client_index[TEST_SEND_BATCH_NUM_PACKETS];
 
-    // write it to a buffer
+        for ( i = 0; i < TEST_SEND_BATCH_NUM_PACKETS; ++i )
+        {
+            packet_bytes[i] = 2 + ( i * 97 ) % ( NETCODE_MAX_PACKET_SIZE - 2 );
+            int j;
+            for ( j = 0; j < packet_bytes[i]; ++j )
+                packet_buffer[i][j] = (uint8_t) ( i + j );
+            packet_data[i] = packet_buffer[i];
+            client_index[i] = test_server_client_index( server, (uint64_t) ( i % TEST_SEND_BATCH_NUM_CLIENTS ) + 1 );
+            check( client_index[i] != -1 );
+        }
 
-    uint8_t buffer[NETCODE_CHALLENGE_TOKEN_BYTES];
+        netcode_server_send_packets_batch( server, client_index, packet_data, packet_bytes, TEST_SEND_BATCH_NUM_PACKETS );
+        netcode_server_flush_packets( server );
 
-    netcode_write_challenge_token( &input_token, buffer, NETCODE_CHALLENGE_TOKEN_BYTES );
+        for ( i = 0; i < TEST_SEND_BATCH_NUM_CLIENTS; ++i )
+        {
+            int j;
+            for ( j = i; j < TEST_SEND_BATCH_NUM_PACKETS; j += TEST_SEND_BATCH_NUM_CLIENTS )
+                netcode_client_send_packet( client[i], packet_buffer[j], packet_bytes[j] );
+        }
 
-    // encrypt the buffer
+        time += delta_time;
 
-    uint64_t sequence = 1000;
-    uint8_t key[NETCODE_KEY_BYTES]; 
-    netcode_generate_key( key );    
+        for ( i = 0; i < TEST_SEND_BATCH_NUM_CLIENTS; ++i )
+            netcode_client_update( client[i], time );
 
-    check( netcode_encrypt_challenge_token( buffer, NETCODE_CHALLENGE_TOKEN_BYTES, sequence, key ) == NETCODE_OK );
+        netcode_server_update( server, time );
 
-    // decrypt the buffer
+        for ( i = 0; i < TEST_SEND_BATCH_NUM_CLIENTS; ++i )
+        {
+            int expected = i;
+            while ( 1 )
+            {
+                int received_bytes;
+                uint64_t packet_sequence;
+                uint8_t * packet = netcode_client_receive_packet( client[i], &received_bytes, &packet_sequence );
+                if ( !packet )
+                    break;
+                check( expected < TEST_SEND_BATCH_NUM_PACKETS );
+                check( received_bytes == packet_bytes[expected] );
+                check( memcmp( packet, packet_buffer[expected], received_bytes ) == 0 );
+                netcode_client_free_packet( client[i], packet );
+                expected += TEST_SEND_BATCH_NUM_CLIENTS;
+            }
+            check( expected >= TEST_SEND_BATCH_NUM_PACKETS );
 
-    check( netcode_decrypt_challenge_token( buffer, NETCODE_CHALLENGE_TOKEN_BYTES, sequence, key ) == NETCODE_OK );
+            expected = i;
+            const int server_client_index = test_server_client_index( server, (uint64_t) i + 1 );
+            while ( 1 )
+            {
+                int received_bytes;
+                uint64_t packet_sequence;
+                uint8_t * packet = netcode_server_receive_packet( server, server_client_index, &received_bytes, &packet_sequence );
+                if ( !packet )
+                    break;
+                check( expected < TEST_SEND_BATCH_NUM_PACKETS );
+                check( received_bytes == packet_bytes[expected] );
+                check( memcmp( packet, packet_buffer[expected], received_bytes ) == 0 );
+                netcode_server_free_packet( server, packet );
+                expected += TEST_SEND_BATCH_NUM_CLIENTS;
+            }
+            check( expected >= TEST_SEND_BATCH_NUM_PACKETS );
+        }
 
-    // read the challenge token back in
+        for ( i = 0; i < TEST_SEND_BATCH_NUM_CLIENTS; ++i )
+            netcode_client_destroy( client[i] );
 
-    struct netcode_challenge_token_t output_token;
+        netcode_server_destroy( server );
+    }
+}
 
-    check( netcode_read_challenge_token( buffer, NETCODE_CHALLENGE_TOKEN_BYTES, &output_token ) == NETCODE_OK );
+#if NETCODE_UDP_OFFLOAD
 
-    // make sure that everything matches the original challenge token
+void test_socket_udp_offload()
+{
+    struct netcode_address_t sender_address;
+    struct netcode_address_t receiver_address;
+    check( netcode_parse_address( "127.0.0.1:50000", &sender_address ) == NETCODE_OK );
+    check( netcode_parse_address( "127.0.0.1:40000", &receiver_address ) == NETCODE_OK );
 
-    check( output_token.client_id == input_token.client_id );
-    check( memcmp( output_token.user_data, input_token.user_data, NETCODE_USER_DATA_BYTES ) == 0 );
-}
+    struct netcode_socket_t sender;
+    struct netcode_socket_t receiver;
+    check( netcode_socket_create( &sender, &sender_address, NETCODE_SERVER_SOCKET_SNDBUF_SIZE, NETCODE_SERVER_SOCKET_RCVBUF_SIZE, 0 ) == NETCODE_SOCKET_ERROR_NONE );
+    check( netcode_socket_create( &receiver, &receiver_address, NETCODE_SERVER_SOCKET_SNDBUF_SIZE, NETCODE_SERVER_SOCKET_RCVBUF_SIZE, 0 ) == NETCODE_SOCKET_ERROR_NONE );
 
-static void test_connection_request_packet()
-{
-    // generate a connect token
+    if ( !netcode_socket_udp_offload_supported( &sender ) || netcode_socket_set_udp_gro( &receiver, 1 ) != NETCODE_OK )
+    {
+        // kernel too old for udp offload. nothing to test
 
-    struct netcode_address_t server_address;
-    server_address.type = NETCODE_ADDRESS_IPV4;
-    server_address.data.ipv4[0] = 127;
-    server_address.data.ipv4[1] = 0;
-    server_address.data.ipv4[2] = 0;
-    server_address.data.ipv4[3] = 1;
-    server_address.port = TEST_SERVER_PORT;
+        netcode_socket_destroy( &sender );
+        netcode_socket_destroy( &receiver );
+        return;
+    }
 
-    uint8_t user_data[NETCODE_USER_DATA_BYTES];
-    netcode_random_bytes( user_data, NETCODE_USER_DATA_BYTES );
+    // a train of equal sized datagrams with a shorter tail leaves as one segmented send
 
-    struct netcode_connect_token_private_t input_token;
+    #define NUM_OFFLOAD_PACKETS 7
 
-    netcode_generate_connect_token_private( &input_token, TEST_CLIENT_ID, TEST_TIMEOUT_SECONDS, 1, &server_address, user_data );
+    static struct netcode_socket_batch_t send_batch;
+    send_batch.num_packets = NUM_OFFLOAD_PACKETS;
 
-    check( input_token.client_id == TEST_CLIENT_ID );
-    check( input_token.num_server_addresses == 1 );
-    check( memcmp( input_token.user_data, user_data, NETCODE_USER_DATA_BYTES ) == 0 );
-    check( netcode_address_equal( &input_token.server_addresses[0], &server_address ) );
+    int i;
+    for ( i = 0; i < NUM_OFFLOAD_PACKETS; ++i )
+    {
+        send_batch.address[i] = receiver.address;
+        send_batch.packet_bytes[i] = ( i == NUM_OFFLOAD_PACKETS - 1 ) ? 200 : 500;
+        memset( send_batch.packet_data[i], i, send_batch.packet_bytes[i] );
+    }
 
-    // write the conect token to a buffer (non-encrypted)
+    check( netcode_socket_send_packets_segmented( &sender, &send_batch, 0 ) == NUM_OFFLOAD_PACKETS );
 
-    uint8_t connect_token_data[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
+    // the receiver splits whatever the kernel coalesced back into the original datagrams
 
-    netcode_write_connect_token_private( &input_token, connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    struct netcode_socket_coalesced_batch_t * receive_batch = (struct netcode_socket_coalesced_batch_t*) malloc( sizeof( struct netcode_socket_coalesced_batch_t ) );
 
-    // copy to a second buffer then encrypt it in place (we need the unencrypted token for verification later on)
+    check( receive_batch );
 
-    uint8_t encrypted_connect_token_data[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
+    int num_packets_received = 0;
 
-    memcpy( encrypted_connect_token_data, connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    int iteration;
+    for ( iteration = 0; iteration < 100 && num_packets_received < NUM_OFFLOAD_PACKETS; ++iteration )
+    {
+        netcode_socket_receive_packets_coalesced( &receiver, receive_batch );
 
-    uint64_t connect_token_expire_timestamp = time( NULL ) + 30;
-    uint8_t connect_token_nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
-    netcode_generate_nonce(connect_token_nonce);
-    uint8_t connect_token_key[NETCODE_KEY_BYTES];
-    netcode_generate_key( connect_token_key );
+        for ( i = 0; i < receive_batch->num_packets; ++i )
+        {
+            check( netcode_address_equal( &receive_batch->address[i], &sender.address ) );
 
-    check( netcode_encrypt_connect_token_private( encrypted_connect_token_data, 
-                                                  NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, 
-                                                  NETCODE_VERSION_INFO, 
-                                                  TEST_PROTOCOL_ID, 
-                                                  connect_token_expire_timestamp, 
-                                                  connect_token_nonce, 
-                                                  connect_token_key ) == NETCODE_OK );
+            int offset = 0;
+            while ( offset < receive_batch->packet_bytes[i] )
+            {
+                int bytes_remaining = receive_batch->packet_bytes[i] - offset;
+                int packet_bytes = bytes_remaining < receive_batch->segment_bytes[i] ? bytes_remaining : receive_batch->segment_bytes[i];
+                check( num_packets_received < NUM_OFFLOAD_PACKETS );
+                check( packet_bytes == send_batch.packet_bytes[num_packets_received] );
+                check( receive_batch->packet_data[i][offset] == (uint8_t) num_packets_received );
+                check( receive_batch->packet_data[i][offset + packet_bytes - 1] == (uint8_t) num_packets_received );
+                offset += packet_bytes;
+                num_packets_received++;
+            }
+        }
 
-    // setup a connection request packet wrapping the encrypted connect token
+        netcode_sleep( 0.001 );
+    }
 
-    struct netcode_connection_request_packet_t input_packet;
+    check( num_packets_received == NUM_OFFLOAD_PACKETS );
 
-    input_packet.packet_type = NETCODE_CONNECTION_REQUEST_PACKET;
-    memcpy( input_packet.version_info, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
-    input_packet.protocol_id = TEST_PROTOCOL_ID;
-    input_packet.connect_token_expire_timestamp = connect_token_expire_timestamp;
-    memcpy( input_packet.connect_token_nonce, connect_token_nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
-    memcpy( input_packet.connect_token_data, encrypted_connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+    // datagrams that don't coalesce still come in a full batch at a time, one per buffer
 
-    // write the connection request packet to a buffer
+    for ( i = 0; i < NETCODE_SOCKET_BATCH_SIZE; ++i )
+    {
+        uint8_t packet_data[100];
+        memset( packet_data, i, sizeof( packet_data ) );
+        netcode_socket_send_packet( &sender, &receiver.address, packet_data, 10 + i );
+    }
 
-    uint8_t buffer[2048];
+    netcode_sleep( 0.01 );
 
-    uint8_t packet_key[NETCODE_KEY_BYTES];
+    check( netcode_socket_receive_packets_coalesced( &receiver, receive_batch ) == NETCODE_SOCKET_BATCH_SIZE );
+    check( receive_batch->num_packets == NETCODE_SOCKET_BATCH_SIZE );
 
-    netcode_generate_key( packet_key );
+    for ( i = 0; i < NETCODE_SOCKET_BATCH_SIZE; ++i )
+    {
+        check( receive_batch->packet_bytes[i] == 10 + i );
+        check( receive_batch->packet_data[i][0] == (uint8_t) i );
+    }
 
-    int bytes_written = netcode_write_packet( &input_packet, buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID );
+    free( receive_batch );
 
-    check( bytes_written > 0 );
+    netcode_socket_destroy( &sender );
+    netcode_socket_destroy( &receiver );
+}
 
-    // read the connection request packet back in from the buffer (the connect token data is decrypted as part of the read packet validation)
+void test_server_udp_offload()
+{
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
 
-    uint64_t sequence = 1000;
+    struct netcode_server_config_t server_config;
+    netcode_default_server_config( &server_config );
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.udp_offload = 1;
+    memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-    uint8_t allowed_packets[NETCODE_CONNECTION_NUM_PACKETS];
-    memset( allowed_packets, 1, sizeof( allowed_packets ) );
+    struct netcode_server_t * server = netcode_server_create( "127.0.0.1:40000", &server_config, time );
 
-    struct netcode_connection_request_packet_t * output_packet = (struct netcode_connection_request_packet_t*) 
-        netcode_read_packet( buffer, bytes_written, &sequence, packet_key, TEST_PROTOCOL_ID, time( NULL ), connect_token_key, allowed_packets, NULL, NULL, NULL );
+    check( server );
 
-    check( output_packet );
+    netcode_server_start( server, 1 );
 
-    // make sure the read packet matches what was written
-    
-    check( output_packet->packet_type == NETCODE_CONNECTION_REQUEST_PACKET );
-    check( memcmp( output_packet->version_info, input_packet.version_info, NETCODE_VERSION_INFO_BYTES ) == 0 );
-    check( output_packet->protocol_id == input_packet.protocol_id );
-    check( output_packet->connect_token_expire_timestamp == input_packet.connect_token_expire_timestamp );
-    check( memcmp( output_packet->connect_token_nonce, input_packet.connect_token_nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES ) == 0 );
-    check( memcmp( output_packet->connect_token_data, connect_token_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES - NETCODE_MAC_BYTES ) == 0 );
+    struct netcode_client_config_t client_config;
+    netcode_default_client_config( &client_config );
+
+    struct netcode_client_t * client = netcode_client_create( "0.0.0.0:50000", &client_config, time );
+
+    check( client );
+
+    uint64_t client_id = 0;
+    netcode_random_bytes( (uint8_t*) &client_id, 8 );
+
+    NETCODE_CONST char * server_address = "127.0.0.1:40000";
+
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    netcode_random_bytes( user_data, NETCODE_USER_DATA_BYTES );
+
+    uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+    check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+
+    netcode_client_connect( client, connect_token );
+
+    int iteration;
+    for ( iteration = 0; iteration < 100; ++iteration )
+    {
+        netcode_client_update( client, time );
+        netcode_server_update( server, time );
+
+        // the server only trusts the client address once it has heard back, and payload packets confirm it
+
+        if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+        {
+            uint8_t ping[8] = { 0 };
+            netcode_client_send_packet( client, ping, sizeof( ping ) );
+            if ( netcode_server_client_connected( server, 0 ) && server->client_confirmed[0] )
+                break;
+        }
 
-    free( output_packet );
-}
+        time += delta_time;
+    }
 
-void test_connection_denied_packet()
-{
-    // setup a connection denied packet
+    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
 
-    struct netcode_connection_denied_packet_t input_packet;
+    // a train of packets to one client, like the fragments of one large reliable packet
 
-    input_packet.packet_type = NETCODE_CONNECTION_DENIED_PACKET;
+    #define NUM_TRAIN_PACKETS 6
 
-    // write the packet to a buffer
+    uint8_t train_data[NUM_TRAIN_PACKETS][NETCODE_MAX_PACKET_SIZE];
+    NETCODE_CONST uint8_t * train_packets[NUM_TRAIN_PACKETS];
+    int train_bytes[NUM_TRAIN_PACKETS];
 
-    uint8_t buffer[NETCODE_MAX_PACKET_BYTES];
+    int i;
+    for ( i = 0; i < NUM_TRAIN_PACKETS; ++i )
+    {
+        train_bytes[i] = ( i == NUM_TRAIN_PACKETS - 1 ) ? 100 : 1000;
+        memset( train_data[i], i, train_bytes[i] );
+        train_packets[i] = train_data[i];
+    }
 
-    uint8_t packet_key[NETCODE_KEY_BYTES];
+    netcode_server_flush_packets( server );
 
-    netcode_generate_key( packet_key );
+    uint64_t send_calls = netcode_server_counters( server )[NETCODE_SERVER_COUNTER_NUM_SOCKET_SEND_CALLS];
 
-    int bytes_written = netcode_write_packet( &input_packet, buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID );
+    netcode_server_send_packets_together( server, 0, train_packets, train_bytes, NUM_TRAIN_PACKETS );
 
-    check( bytes_written > 0 );
+    netcode_server_flush_packets( server );
 
-    // read the packet back in from the buffer
+    send_calls = netcode_server_counters( server )[NETCODE_SERVER_COUNTER_NUM_SOCKET_SEND_CALLS] - send_calls;
 
-    uint64_t sequence;
+    check( send_calls == 1 );
 
-    uint8_t allowed_packet_types[NETCODE_CONNECTION_NUM_PACKETS];
-    memset( allowed_packet_types, 1, sizeof( allowed_packet_types ) );
+    int num_packets_received = 0;
 
-    struct netcode_connection_denied_packet_t * output_packet = (struct netcode_connection_denied_packet_t*) 
-        netcode_read_packet( buffer, bytes_written, &sequence, packet_key, TEST_PROTOCOL_ID, time( NULL ), NULL, allowed_packet_types, NULL, NULL, NULL );
+    for ( iteration = 0; iteration < 100 && num_packets_received < NUM_TRAIN_PACKETS; ++iteration )
+    {
+        netcode_client_update( client, time );
 
-    check( output_packet );
+        while ( 1 )
+        {
+            int packet_bytes;
+            uint64_t packet_sequence;
+            uint8_t * packet = netcode_client_receive_packet( client, &packet_bytes, &packet_sequence );
+            if ( !packet )
+                break;
+            check( num_packets_received < NUM_TRAIN_PACKETS );
+            check( packet_bytes == train_bytes[num_packets_received] );
+            check( memcmp( packet, train_data[num_packets_received], packet_bytes ) == 0 );
+            num_packets_received++;
+            netcode_client_free_packet( client, packet );
+        }
 
-    // make sure the read packet matches what was written
-    
-    check( output_packet->packet_type == NETCODE_CONNECTION_DENIED_PACKET );
+        netcode_sleep( 0.001 );
+    }
 
-    free( output_packet );
+    check( num_packets_received == NUM_TRAIN_PACKETS );
+
+    netcode_client_destroy( client );
+
+    netcode_server_destroy( server );
 }
 
-void test_connection_challenge_packet()
-{
-    // setup a connection challenge packet
+#endif // #if NETCODE_UDP_OFFLOAD
 
-    struct netcode_connection_challenge_packet_t input_packet;
+void test_server_max_clients_config()
+{
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
 
-    input_packet.packet_type = NETCODE_CONNECTION_CHALLENGE_PACKET;
-    input_packet.challenge_token_sequence = 0;
-    netcode_random_bytes( input_packet.challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
+    struct netcode_server_config_t server_config;
+    netcode_default_server_config( &server_config );
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-    // write the packet to a buffer
+    // a server config with no client slots is rejected
 
-    uint8_t buffer[NETCODE_MAX_PACKET_BYTES];
+    server_config.max_clients = 0;
 
-    uint8_t packet_key[NETCODE_KEY_BYTES];
+    check( netcode_server_create( "127.0.0.1:40000", &server_config, time ) == NULL );
 
-    netcode_generate_key( packet_key );
+    // a server can be configured with more slots than the default capacity
 
-    int bytes_written = netcode_write_packet( &input_packet, buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID );
+    const int max_clients = NETCODE_MAX_CLIENTS * 2;
 
-    check( bytes_written > 0 );
+    server_config.max_clients = max_clients;
 
-    // read the packet back in from the buffer
+    struct netcode_server_t * server = netcode_server_create( "127.0.0.1:40000", &server_config, time );
 
-    uint64_t sequence;
+    check( server );
 
-    uint8_t allowed_packet_types[NETCODE_CONNECTION_NUM_PACKETS];
-    memset( allowed_packet_types, 1, sizeof( allowed_packet_types ) );
+    netcode_server_start( server, max_clients );
 
-    struct netcode_connection_challenge_packet_t * output_packet = (struct netcode_connection_challenge_packet_t*) 
-        netcode_read_packet( buffer, bytes_written, &sequence, packet_key, TEST_PROTOCOL_ID, time( NULL ), NULL, allowed_packet_types, NULL, NULL, NULL );
+    check( netcode_server_max_clients( server ) == max_clients );
 
-    check( output_packet );
+    // fill every slot except the last one with loopback clients
 
-    // make sure the read packet packet matches what was written
-    
-    check( output_packet->packet_type == NETCODE_CONNECTION_CHALLENGE_PACKET );
-    check( output_packet->challenge_token_sequence == input_packet.challenge_token_sequence );
-    check( memcmp( output_packet->challenge_token_data, input_packet.challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES ) == 0 );
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    netcode_random_bytes( user_data, NETCODE_USER_DATA_BYTES );
 
-    free( output_packet );
-}
+    int i;
+    for ( i = 0; i < max_clients - 1; ++i )
+    {
+        netcode_server_connect_loopback_client( server, i, (uint64_t) i, user_data );
+    }
 
-void test_connection_response_packet()
-{
-    // setup a connection response packet
+    check( netcode_server_num_connected_clients( server ) == max_clients - 1 );
 
-    struct netcode_connection_response_packet_t input_packet;
+    // connect a real client, which must land in the last slot, past NETCODE_MAX_CLIENTS
 
-    input_packet.packet_type = NETCODE_CONNECTION_RESPONSE_PACKET;
-    input_packet.challenge_token_sequence = 0;
-    netcode_random_bytes( input_packet.challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES );
+    struct netcode_client_config_t client_config;
+    netcode_default_client_config( &client_config );
 
-    // write the packet to a buffer
+    struct netcode_client_t * client = netcode_client_create( "0.0.0.0:50000", &client_config, time );
 
-    uint8_t buffer[NETCODE_MAX_PACKET_BYTES];
+    check( client );
 
-    uint8_t packet_key[NETCODE_KEY_BYTES];
+    uint64_t client_id = 0;
+    netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-    netcode_generate_key( packet_key );
-    
-    int bytes_written = netcode_write_packet( &input_packet, buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID );
+    NETCODE_CONST char * server_address = "127.0.0.1:40000";
 
-    check( bytes_written > 0 );
+    uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-    // read the packet back in from the buffer
+    check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-    uint64_t sequence;
+    netcode_client_connect( client, connect_token );
 
-    uint8_t allowed_packet_types[NETCODE_CONNECTION_NUM_PACKETS];
-    memset( allowed_packet_types, 1, sizeof( allowed_packet_types ) );
+    int iteration;
+    for ( iteration = 0; iteration < 100; ++iteration )
+    {
+        netcode_client_update( client, time );
 
-    struct netcode_connection_response_packet_t * output_packet = (struct netcode_connection_response_packet_t*) 
-        netcode_read_packet( buffer, bytes_written, &sequence, packet_key, TEST_PROTOCOL_ID, time( NULL ), NULL, allowed_packet_types, NULL, NULL, NULL );
+        netcode_server_update( server, time );
 
-    check( output_packet );
+        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+            break;
 
-    // make sure the read packet matches what was written
-    
-    check( output_packet->packet_type == NETCODE_CONNECTION_RESPONSE_PACKET );
-    check( output_packet->challenge_token_sequence == input_packet.challenge_token_sequence );
-    check( memcmp( output_packet->challenge_token_data, input_packet.challenge_token_data, NETCODE_CHALLENGE_TOKEN_BYTES ) == 0 );
+        if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+            break;
 
-    free( output_packet );
-}
+        time += delta_time;
+    }
 
-void test_connection_keep_alive_packet()
-{
-    // setup a connection keep alive packet
+    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+    check( netcode_client_index( client ) == max_clients - 1 );
+    check( netcode_client_max_clients( client ) == max_clients );
+    check( netcode_server_client_connected( server, max_clients - 1 ) );
+    check( netcode_server_client_id( server, max_clients - 1 ) == client_id );
+    check( netcode_server_num_connected_clients( server ) == max_clients );
 
-    struct netcode_connection_keep_alive_packet_t input_packet;
+    // exchange a payload packet across the high slot
 
-    input_packet.packet_type = NETCODE_CONNECTION_KEEP_ALIVE_PACKET;
-    input_packet.client_index = 10;
-    input_packet.max_clients = 16;
+    uint8_t packet_data[NETCODE_MAX_PACKET_SIZE];
+    for ( i = 0; i < NETCODE_MAX_PACKET_SIZE; ++i )
+        packet_data[i] = (uint8_t) i;
 
-    // write the packet to a buffer
+    int server_num_packets_received = 0;
+    int client_num_packets_received = 0;
 
-    uint8_t buffer[NETCODE_MAX_PACKET_BYTES];
+    for ( iteration = 0; iteration < 10; ++iteration )
+    {
+        netcode_client_send_packet( client, packet_data, NETCODE_MAX_PACKET_SIZE );
 
-    uint8_t packet_key[NETCODE_KEY_BYTES];
+        netcode_server_send_packet( server, max_clients - 1, packet_data, NETCODE_MAX_PACKET_SIZE );
 
-    netcode_generate_key( packet_key );
+        netcode_client_update( client, time );
 
-    int bytes_written = netcode_write_packet( &input_packet, buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID );
+        netcode_server_update( server, time );
 
-    check( bytes_written > 0 );
+        while ( 1 )             
+        {
+            int packet_bytes;
+            uint64_t packet_sequence;
+            uint8_t * packet = netcode_client_receive_packet( client, &packet_bytes, &packet_sequence );
+            if ( !packet )
+                break;
+            check( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+            check( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
+            client_num_packets_received++;
+            netcode_client_free_packet( client, packet );
+        }
 
-    // read the packet back in from the buffer
+        while ( 1 )             
+        {
+            int packet_bytes;
+            uint64_t packet_sequence;
+            void * packet = netcode_server_receive_packet( server, max_clients - 1, &packet_bytes, &packet_sequence );
+            if ( !packet )
+                break;
+            check( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+            check( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
+            server_num_packets_received++;
+            netcode_server_free_packet( server, packet );
+        }
 
-    uint64_t sequence;
+        if ( client_num_packets_received >= 2 && server_num_packets_received >= 2 )
+            break;
 
-    uint8_t allowed_packet_types[NETCODE_CONNECTION_NUM_PACKETS];
-    memset( allowed_packet_types, 1, sizeof( allowed_packet_types ) );
-    
-    struct netcode_connection_keep_alive_packet_t * output_packet = (struct netcode_connection_keep_alive_packet_t*) 
-        netcode_read_packet( buffer, bytes_written, &sequence, packet_key, TEST_PROTOCOL_ID, time( NULL ), NULL, allowed_packet_types, NULL, NULL, NULL );
+        time += delta_time;
+    }
 
-    check( output_packet );
+    check( client_num_packets_received >= 2 && server_num_packets_received >= 2 );
 
-    // make sure the read packet matches what was written
-    
-    check( output_packet->packet_type == NETCODE_CONNECTION_KEEP_ALIVE_PACKET );
-    check( output_packet->client_index == input_packet.client_index );
-    check( output_packet->max_clients == input_packet.max_clients );
+    netcode_client_destroy( client );
 
-    free( output_packet );
+    netcode_server_destroy( server );
 }
 
-void test_connection_payload_packet()
+void test_server_shard_group()
 {
-    // setup a connection payload packet
-
-    struct netcode_connection_payload_packet_t * input_packet = netcode_create_payload_packet( NETCODE_MAX_PAYLOAD_BYTES, NULL, NULL );
+    struct netcode_server_shard_group_t * group = netcode_server_shard_group_create( 2, NULL, NULL, NULL );
 
-    check( input_packet->packet_type == NETCODE_CONNECTION_PAYLOAD_PACKET );
-    check( input_packet->payload_bytes == NETCODE_MAX_PAYLOAD_BYTES );
+    check( group );
 
-    netcode_random_bytes( input_packet->payload_data, NETCODE_MAX_PAYLOAD_BYTES );
-    
-    // write the packet to a buffer
+    int owner_a = 0;
+    int owner_b = 0;
 
-    uint8_t buffer[NETCODE_MAX_PACKET_BYTES];
+    // a connect token is accepted once across every shard, no matter which address replays it
 
-    uint8_t packet_key[NETCODE_KEY_BYTES];
+    struct netcode_address_t address1;
+    struct netcode_address_t address2;
+    check( netcode_parse_address( "127.0.0.1:50000", &address1 ) == NETCODE_OK );
+    check( netcode_parse_address( "127.0.0.1:50001", &address2 ) == NETCODE_OK );
 
-    netcode_generate_key( packet_key );
+    uint8_t mac[NETCODE_MAC_BYTES];
+    netcode_random_bytes( mac, NETCODE_MAC_BYTES );
 
-    int bytes_written = netcode_write_packet( input_packet, buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID );
+    check( netcode_server_shard_group_connect_token_find_or_add( group, &address1, mac, 0.0 ) );
+    check( netcode_server_shard_group_connect_token_find_or_add( group, &address1, mac, 0.0 ) );
+    check( !netcode_server_shard_group_connect_token_find_or_add( group, &address2, mac, 0.0 ) );
 
-    check( bytes_written > 0 );
+    // a client id can only be claimed by one shard at a time
 
-    // read the packet back in from the buffer
+    check( !netcode_server_shard_group_client_id_connected( group, 1, &owner_a ) );
+    check( netcode_server_shard_group_claim_client_id( group, 1, &owner_a ) );
+    check( !netcode_server_shard_group_client_id_connected( group, 1, &owner_a ) );
+    check( netcode_server_shard_group_client_id_connected( group, 1, &owner_b ) );
+    check( !netcode_server_shard_group_claim_client_id( group, 1, &owner_b ) );
 
-    uint64_t sequence;
+    // only the owner can release its claim
 
-    uint8_t allowed_packet_types[NETCODE_CONNECTION_NUM_PACKETS];
-    memset( allowed_packet_types, 1, sizeof( allowed_packet_types ) );
+    netcode_server_shard_group_release_client_id( group, 1, &owner_b );
+    check( netcode_server_shard_group_client_id_connected( group, 1, &owner_b ) );
 
-    struct netcode_connection_payload_packet_t * output_packet = (struct netcode_connection_payload_packet_t*) 
-        netcode_read_packet( buffer, bytes_written, &sequence, packet_key, TEST_PROTOCOL_ID, time( NULL ), NULL, allowed_packet_types, NULL, NULL, NULL );
+    netcode_server_shard_group_release_client_id( group, 1, &owner_a );
+    check( !netcode_server_shard_group_client_id_connected( group, 1, &owner_b ) );
+    check( netcode_server_shard_group_claim_client_id( group, 1, &owner_b ) );
 
-    check( output_packet );
+    // claims are bounded by the group capacity
 
-    // make sure the read packet matches what was written
-    
-    check( output_packet->packet_type == NETCODE_CONNECTION_PAYLOAD_PACKET );
-    check( output_packet->payload_bytes == input_packet->payload_bytes );
-    check( memcmp( output_packet->payload_data, input_packet->payload_data, NETCODE_MAX_PAYLOAD_BYTES ) == 0 );
+    check( netcode_server_shard_group_claim_client_id( group, 2, &owner_a ) );
+    check( !netcode_server_shard_group_claim_client_id( group, 3, &owner_a ) );
 
-    free( input_packet );
-    free( output_packet );
+    netcode_server_shard_group_destroy( group );
 }
 
-void test_connection_disconnect_packet()
-{
-    // setup a connection disconnect packet
-
-    struct netcode_connection_disconnect_packet_t input_packet;
-
-    input_packet.packet_type = NETCODE_CONNECTION_DISCONNECT_PACKET;
-
-    // write the packet to a buffer
-
-    uint8_t buffer[NETCODE_MAX_PACKET_BYTES];
+#if defined( SO_REUSEPORT )
 
-    uint8_t packet_key[NETCODE_KEY_BYTES];
+#define TEST_SHARD_NUM_SERVERS 2
+#define TEST_SHARD_NUM_CLIENTS 8
 
-    netcode_generate_key( packet_key );
+void test_server_shard_group_connect()
+{
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
 
-    int bytes_written = netcode_write_packet( &input_packet, buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID );
+    struct netcode_server_shard_group_t * group = netcode_server_shard_group_create( TEST_SHARD_NUM_CLIENTS, NULL, NULL, NULL );
 
-    check( bytes_written > 0 );
+    check( group );
 
-    // read the packet back in from the buffer
+    struct netcode_server_config_t server_config;
+    netcode_default_server_config( &server_config );
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
+    server_config.shard_group = group;
 
-    uint64_t sequence;
+    // sharded servers must bind an explicit port
 
-    uint8_t allowed_packet_types[NETCODE_CONNECTION_NUM_PACKETS];
-    memset( allowed_packet_types, 1, sizeof( allowed_packet_types ) );
+    check( netcode_server_create( "127.0.0.1", &server_config, time ) == NULL );
 
-    struct netcode_connection_disconnect_packet_t * output_packet = (struct netcode_connection_disconnect_packet_t*) 
-        netcode_read_packet( buffer, bytes_written, &sequence, packet_key, TEST_PROTOCOL_ID, time( NULL ), NULL, allowed_packet_types, NULL, NULL, NULL );
+    // every shard binds the same port and the kernel spreads clients across them
 
-    check( output_packet );
+    struct netcode_server_t * server[TEST_SHARD_NUM_SERVERS];
 
-    // make sure the read packet matches what was written
-    
-    check( output_packet->packet_type == NETCODE_CONNECTION_DISCONNECT_PACKET );
+    int i;
+    for ( i = 0; i < TEST_SHARD_NUM_SERVERS; ++i )
+    {
+        server[i] = netcode_server_create( "127.0.0.1:40000", &server_config, time );
+        check( server[i] );
+        netcode_server_start( server[i], TEST_SHARD_NUM_CLIENTS );
+    }
 
-    free( output_packet );
-}
+    struct netcode_client_config_t client_config;
+    netcode_default_client_config( &client_config );
 
-void test_connect_token_public()
-{
-    // generate a private connect token
+    struct netcode_client_t * client[TEST_SHARD_NUM_CLIENTS];
 
-    struct netcode_address_t server_address;
-    server_address.type = NETCODE_ADDRESS_IPV4;
-    server_address.data.ipv4[0] = 127;
-    server_address.data.ipv4[1] = 0;
-    server_address.data.ipv4[2] = 0;
-    server_address.data.ipv4[3] = 1;
-    server_address.port = TEST_SERVER_PORT;
+    NETCODE_CONST char * server_address = "127.0.0.1:40000";
 
     uint8_t user_data[NETCODE_USER_DATA_BYTES];
     netcode_random_bytes( user_data, NETCODE_USER_DATA_BYTES );
 
-    struct netcode_connect_token_private_t connect_token_private;
-
-    netcode_generate_connect_token_private( &connect_token_private, TEST_CLIENT_ID, TEST_TIMEOUT_SECONDS, 1, &server_address, user_data );
+    for ( i = 0; i < TEST_SHARD_NUM_CLIENTS; ++i )
+    {
+        char client_address[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+        sprintf( client_address, "127.0.0.1:%d", 50000 + i );
 
-    check( connect_token_private.client_id == TEST_CLIENT_ID );
-    check( connect_token_private.num_server_addresses == 1 );
-    check( memcmp( connect_token_private.user_data, user_data, NETCODE_USER_DATA_BYTES ) == 0 );
-    check( netcode_address_equal( &connect_token_private.server_addresses[0], &server_address ) );
+        client[i] = netcode_client_create( client_address, &client_config, time );
+        check( client[i] );
 
-    // write it to a buffer
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, (uint64_t) i + 1, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-    uint8_t connect_token_private_data[NETCODE_CONNECT_TOKEN_PRIVATE_BYTES];
-    netcode_write_connect_token_private( &connect_token_private, connect_token_private_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
+        netcode_client_connect( client[i], connect_token );
+    }
 
-    // encrypt the buffer
+    int iteration;
+    for ( iteration = 0; iteration < 100; ++iteration )
+    {
+        for ( i = 0; i < TEST_SHARD_NUM_CLIENTS; ++i )
+            netcode_client_update( client[i], time );
 
-    uint64_t create_timestamp = time( NULL );
-    uint64_t expire_timestamp = create_timestamp + 30;
-    uint8_t connect_token_nonce[NETCODE_CONNECT_TOKEN_NONCE_BYTES];
-    netcode_generate_nonce( connect_token_nonce );    
-    uint8_t key[NETCODE_KEY_BYTES];
-    netcode_generate_key( key );    
-    check( netcode_encrypt_connect_token_private( connect_token_private_data, 
-                                                  NETCODE_CONNECT_TOKEN_PRIVATE_BYTES, 
-                                                  NETCODE_VERSION_INFO, 
-                                                  TEST_PROTOCOL_ID, 
-                                                  expire_timestamp, 
-                                                  connect_token_nonce, 
-                                                  key ) == 1 );
+        int j;
+        for ( j = 0; j < TEST_SHARD_NUM_SERVERS; ++j )
+            netcode_server_update( server[j], time );
 
-    // wrap a public connect token around the private connect token data
+        int num_connected = 0;
+        for ( i = 0; i < TEST_SHARD_NUM_CLIENTS; ++i )
+        {
+            if ( netcode_client_state( client[i] ) == NETCODE_CLIENT_STATE_CONNECTED )
+                num_connected++;
+        }
 
-    struct netcode_connect_token_t input_connect_token;
-    memset( &input_connect_token, 0, sizeof( struct netcode_connect_token_t ) );
-    memcpy( input_connect_token.version_info, NETCODE_VERSION_INFO, NETCODE_VERSION_INFO_BYTES );
-    input_connect_token.protocol_id = TEST_PROTOCOL_ID;
-    input_connect_token.create_timestamp = create_timestamp;
-    input_connect_token.expire_timestamp = expire_timestamp;
-    memcpy( input_connect_token.nonce, connect_token_nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES );
-    memcpy( input_connect_token.private_data, connect_token_private_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES );
-    input_connect_token.num_server_addresses = 1;
-    input_connect_token.server_addresses[0] = server_address;
-    memcpy( input_connect_token.client_to_server_key, connect_token_private.client_to_server_key, NETCODE_KEY_BYTES );
-    memcpy( input_connect_token.server_to_client_key, connect_token_private.server_to_client_key, NETCODE_KEY_BYTES );
-    input_connect_token.timeout_seconds = (int) TEST_TIMEOUT_SECONDS;
+        if ( num_connected == TEST_SHARD_NUM_CLIENTS )
+            break;
 
-    // write the connect token to a buffer
+        time += delta_time;
+    }
 
-    uint8_t buffer[NETCODE_CONNECT_TOKEN_BYTES];
-    netcode_write_connect_token( &input_connect_token, buffer, NETCODE_CONNECT_TOKEN_BYTES );
+    int num_server_clients = 0;
+    for ( i = 0; i < TEST_SHARD_NUM_SERVERS; ++i )
+        num_server_clients += netcode_server_num_connected_clients( server[i] );
 
-    // read the buffer back in
+    check( num_server_clients == TEST_SHARD_NUM_CLIENTS );
 
-    struct netcode_connect_token_t output_connect_token;
-    memset( &output_connect_token, 0, sizeof( struct netcode_connect_token_t ) );
-    check( netcode_read_connect_token( buffer, NETCODE_CONNECT_TOKEN_BYTES, &output_connect_token ) == 1 );
+    for ( i = 0; i < TEST_SHARD_NUM_CLIENTS; ++i )
+    {
+        check( netcode_client_state( client[i] ) == NETCODE_CLIENT_STATE_CONNECTED );
+        netcode_client_destroy( client[i] );
+    }
 
-    // make sure the public connect token matches what was written
+    for ( i = 0; i < TEST_SHARD_NUM_SERVERS; ++i )
+        netcode_server_destroy( server[i] );
 
-    check( memcmp( output_connect_token.version_info, input_connect_token.version_info, NETCODE_VERSION_INFO_BYTES ) == 0 );
-    check( output_connect_token.protocol_id == input_connect_token.protocol_id );
-    check( output_connect_token.create_timestamp == input_connect_token.create_timestamp );
-    check( output_connect_token.expire_timestamp == input_connect_token.expire_timestamp );
-    check( memcmp( output_connect_token.nonce, input_connect_token.nonce, NETCODE_CONNECT_TOKEN_NONCE_BYTES ) == 0 );
-    check( memcmp( output_connect_token.private_data, input_connect_token.private_data, NETCODE_CONNECT_TOKEN_PRIVATE_BYTES ) == 0 );
-    check( output_connect_token.num_server_addresses == input_connect_token.num_server_addresses );
-    check( netcode_address_equal( &output_connect_token.server_addresses[0], &input_connect_token.server_addresses[0] ) );
-    check( memcmp( output_connect_token.client_to_server_key, input_connect_token.client_to_server_key, NETCODE_KEY_BYTES ) == 0 );
-    check( memcmp( output_connect_token.server_to_client_key, input_connect_token.server_to_client_key, NETCODE_KEY_BYTES ) == 0 );
-    check( output_connect_token.timeout_seconds == input_connect_token.timeout_seconds );
+    netcode_server_shard_group_destroy( group );
 }
 
-void test_encryption_manager()
-{
-    struct netcode_encryption_manager_t encryption_manager;
+#endif // #if defined( SO_REUSEPORT )
 
-    netcode_encryption_manager_reset( &encryption_manager );
+void test_server_shard_group_duplicate_client_id()
+{
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
 
-    double time = 100.0;
+    struct netcode_server_shard_group_t * group = netcode_server_shard_group_create( NETCODE_MAX_CLIENTS, NULL, NULL, NULL );
 
-    // generate some test encryption mappings
+    check( group );
 
-    struct encryption_mapping_t
-    {
-        struct netcode_address_t address;
-        uint8_t send_key[NETCODE_KEY_BYTES];
-        uint8_t receive_key[NETCODE_KEY_BYTES];
-    };
+    struct netcode_server_config_t server_config;
+    netcode_default_server_config( &server_config );
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
+    server_config.shard_group = group;
 
-    #define NUM_ENCRYPTION_MAPPINGS 5
+    // bind the shards to different ports so each client deterministically reaches a different shard
 
-    struct encryption_mapping_t encryption_mapping[NUM_ENCRYPTION_MAPPINGS];
-    memset( encryption_mapping, 0, sizeof( encryption_mapping ) );
-    int i;
-    for ( i = 0; i < NUM_ENCRYPTION_MAPPINGS; ++i )
-    {
-        encryption_mapping[i].address.type = NETCODE_ADDRESS_IPV6;
-        encryption_mapping[i].address.data.ipv6[7] = 1;
-        encryption_mapping[i].address.port = ( uint16_t) ( 20000 + i );
-        netcode_generate_key( encryption_mapping[i].send_key );
-        netcode_generate_key( encryption_mapping[i].receive_key );
-    }
+    NETCODE_CONST char * server_address[2] = { "127.0.0.1:40000", "127.0.0.1:40001" };
 
-    // add the encryption mappings to the manager and make sure they can be looked up by address
+    struct netcode_server_t * server[2];
+    struct netcode_client_t * client[2];
 
-    for ( i = 0; i < NUM_ENCRYPTION_MAPPINGS; ++i )
-    {
-        int encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+    struct netcode_client_config_t client_config;
+    netcode_default_client_config( &client_config );
 
-        check( encryption_index == -1 );
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    netcode_random_bytes( user_data, NETCODE_USER_DATA_BYTES );
 
-        check( netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index ) == NULL );
-        check( netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index ) == NULL );
+    uint64_t client_id = 0;
+    netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-        check( netcode_encryption_manager_add_encryption_mapping( &encryption_manager, 
-                                                                  &encryption_mapping[i].address, 
-                                                                  encryption_mapping[i].send_key, 
-                                                                  encryption_mapping[i].receive_key, 
-                                                                  time, 
-                                                                  -1.0,
-                                                                  TEST_TIMEOUT_SECONDS ) );
+    int i;
+    for ( i = 0; i < 2; ++i )
+    {
+        server[i] = netcode_server_create( server_address[i], &server_config, time );
+        check( server[i] );
+        netcode_server_start( server[i], NETCODE_MAX_CLIENTS );
 
-        encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+        char client_address[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+        sprintf( client_address, "127.0.0.1:%d", 50000 + i );
 
-        uint8_t * send_key = netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index );
-        uint8_t * receive_key = netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+        client[i] = netcode_client_create( client_address, &client_config, time );
+        check( client[i] );
 
-        check( send_key );
-        check( receive_key );
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+        check( netcode_generate_connect_token( 1, &server_address[i], &server_address[i], TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-        check( memcmp( send_key, encryption_mapping[i].send_key, NETCODE_KEY_BYTES ) == 0 );
-        check( memcmp( receive_key, encryption_mapping[i].receive_key, NETCODE_KEY_BYTES ) == 0 );
+        netcode_client_connect( client[i], connect_token );
     }
 
-    // removing an encryption mapping that doesn't exist should return 0
+    int iteration;
+    for ( iteration = 0; iteration < 50; ++iteration )
     {
-        struct netcode_address_t address;
-        address.type = NETCODE_ADDRESS_IPV6;
-        address.data.ipv6[7] = 1;
-        address.port = 50000;
+        for ( i = 0; i < 2; ++i )
+        {
+            netcode_client_update( client[i], time );
+            netcode_server_update( server[i], time );
+        }
 
-        check( netcode_encryption_manager_remove_encryption_mapping( &encryption_manager, &address, time ) == 0 );
+        time += delta_time;
     }
 
-    // remove the first and last encryption mappings
-
-    check( netcode_encryption_manager_remove_encryption_mapping( &encryption_manager, &encryption_mapping[0].address, time ) == 1 );
+    // exactly one shard accepts the client id
 
-    check( netcode_encryption_manager_remove_encryption_mapping( &encryption_manager, &encryption_mapping[NUM_ENCRYPTION_MAPPINGS-1].address, time ) == 1 );
+    check( netcode_server_num_connected_clients( server[0] ) + netcode_server_num_connected_clients( server[1] ) == 1 );
+    check( ( netcode_client_state( client[0] ) == NETCODE_CLIENT_STATE_CONNECTED ) != ( netcode_client_state( client[1] ) == NETCODE_CLIENT_STATE_CONNECTED ) );
 
-    // make sure the encryption mappings that were removed can no longer be looked up by address
+    // once the winning shard disconnects the client, the other shard may accept the id
 
-    for ( i = 0; i < NUM_ENCRYPTION_MAPPINGS; ++i )
-    {
-        int encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+    int winner = netcode_server_num_connected_clients( server[0] ) == 1 ? 0 : 1;
 
-        uint8_t * send_key = netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index );
-        uint8_t * receive_key = netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+    netcode_server_disconnect_all_clients( server[winner] );
 
-        if ( i != 0 && i != NUM_ENCRYPTION_MAPPINGS - 1 )
-        {
-            check( send_key );
-            check( receive_key );
+    check( !netcode_server_shard_group_client_id_connected( group, client_id, server[1-winner] ) );
 
-            check( memcmp( send_key, encryption_mapping[i].send_key, NETCODE_KEY_BYTES ) == 0 );
-            check( memcmp( receive_key, encryption_mapping[i].receive_key, NETCODE_KEY_BYTES ) == 0 );
-        }
-        else
-        {
-            check( !send_key );
-            check( !receive_key );
-        }
+    for ( i = 0; i < 2; ++i )
+    {
+        netcode_client_destroy( client[i] );
+        netcode_server_destroy( server[i] );
     }
 
-    // add the encryption mappings back in
-    
-    check( netcode_encryption_manager_add_encryption_mapping( &encryption_manager, 
-                                                              &encryption_mapping[0].address, 
-                                                              encryption_mapping[0].send_key, 
-                                                              encryption_mapping[0].receive_key, 
-                                                              time, 
-                                                              -1.0,
-                                                              TEST_TIMEOUT_SECONDS ) );
-    
-    check( netcode_encryption_manager_add_encryption_mapping( &encryption_manager, 
-                                                              &encryption_mapping[NUM_ENCRYPTION_MAPPINGS-1].address, 
-                                                              encryption_mapping[NUM_ENCRYPTION_MAPPINGS-1].send_key, 
-                                                              encryption_mapping[NUM_ENCRYPTION_MAPPINGS-1].receive_key, 
-                                                              time, 
-                                                              -1.0,
-                                                              TEST_TIMEOUT_SECONDS ) );
+    netcode_server_shard_group_destroy( group );
+}
 
-    // all encryption mappings should be able to be looked up by address again
+void test_client_server_keep_alive()
+{
+    struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
 
-    for ( i = 0; i < NUM_ENCRYPTION_MAPPINGS; ++i )
-    {
-        int encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+    network_simulator->latency_milliseconds = 250;
+    network_simulator->jitter_milliseconds = 250;
+    network_simulator->packet_loss_percent = 5;
+    network_simulator->duplicate_packet_percent = 10;
 
-        uint8_t * send_key = netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index );
-        uint8_t * receive_key = netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
 
-        check( send_key );
-        check( receive_key );
+    // connect client to server
 
-        check( memcmp( send_key, encryption_mapping[i].send_key, NETCODE_KEY_BYTES ) == 0 );
-        check( memcmp( receive_key, encryption_mapping[i].receive_key, NETCODE_KEY_BYTES ) == 0 );
-    }
+    struct netcode_client_config_t client_config;
+    netcode_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
 
-    // check that encryption mappings time out properly
+    struct netcode_client_t * client = netcode_client_create( "[::]:50000", &client_config, time );
 
-    time += TEST_TIMEOUT_SECONDS * 2;
+    check( client );
 
-    for ( i = 0; i < NUM_ENCRYPTION_MAPPINGS; ++i )
-    {
-        int encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+    struct netcode_server_config_t server_config;
+    netcode_default_server_config( &server_config );
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-        uint8_t * send_key = netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index );
-        uint8_t * receive_key = netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+    struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
 
-        check( !send_key );
-        check( !receive_key );
-    }
+    check( server );
 
-    // add the same encryption mappings after timeout
+    netcode_server_start( server, 1 );
 
-    for ( i = 0; i < NUM_ENCRYPTION_MAPPINGS; ++i )
-    {
-        int encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+    NETCODE_CONST char * server_address = "[::1]:40000";
 
-        check( encryption_index == -1 );
+    uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-        check( netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index ) == NULL );
-        check( netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index ) == NULL );
+    uint64_t client_id = 0;
+    netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-        check( netcode_encryption_manager_add_encryption_mapping( &encryption_manager, 
-                                                                  &encryption_mapping[i].address, 
-                                                                  encryption_mapping[i].send_key, 
-                                                                  encryption_mapping[i].receive_key, 
-                                                                  time, 
-                                                                  -1.0,
-                                                                  TEST_TIMEOUT_SECONDS ) );
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
+
+    check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+
+    netcode_client_connect( client, connect_token );
 
-        encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+    while ( 1 )
+    {
+        netcode_network_simulator_update( network_simulator, time );
 
-        uint8_t * send_key = netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index );
-        uint8_t * receive_key = netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+        netcode_client_update( client, time );
 
-        check( send_key );
-        check( receive_key );
+        netcode_server_update( server, time );
 
-        check( memcmp( send_key, encryption_mapping[i].send_key, NETCODE_KEY_BYTES ) == 0 );
-        check( memcmp( receive_key, encryption_mapping[i].receive_key, NETCODE_KEY_BYTES ) == 0 );
+        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+            break;
+
+        time += delta_time;
     }
 
-    // reset the encryption mapping and verify that all encryption mappings have been removed
+    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+    check( netcode_client_index( client ) == 0 );
+    check( netcode_server_client_connected( server, 0 ) == 1 );
+    check( netcode_server_num_connected_clients( server ) == 1 );
 
-    netcode_encryption_manager_reset( &encryption_manager );
+    // pump the client and server long enough that they would timeout without keep alive packets
 
-    for ( i = 0; i < NUM_ENCRYPTION_MAPPINGS; ++i )
-    {
-        int encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+    int num_iterations = (int) ( 1.25f * TEST_TIMEOUT_SECONDS / delta_time ) + 1;
 
-        uint8_t * send_key = netcode_encryption_manager_get_send_key( &encryption_manager, encryption_index );
-        uint8_t * receive_key = netcode_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+    int i;
+    for ( i = 0; i < num_iterations; ++i )
+    {
+        netcode_network_simulator_update( network_simulator, time );
 
-        check( !send_key );
-        check( !receive_key );
-    }
+        netcode_client_update( client, time );
 
-    // test the expire time for encryption mapping works as expected
+        netcode_server_update( server, time );
 
-    check( netcode_encryption_manager_add_encryption_mapping( &encryption_manager, 
-                                                              &encryption_mapping[0].address, 
-                                                              encryption_mapping[0].send_key, 
-                                                              encryption_mapping[0].receive_key, 
-                                                              time, 
-                                                              time + 1.0,
-                                                              TEST_TIMEOUT_SECONDS ) );
+        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+            break;
 
-    int encryption_index = netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[0].address, time );
+        time += delta_time;
+    }
 
-    check( encryption_index != -1 );
+    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+    check( netcode_client_index( client ) == 0 );
+    check( netcode_server_client_connected( server, 0 ) == 1 );
+    check( netcode_server_num_connected_clients( server ) == 1 );
 
-    check( netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[0].address, time + 1.1f ) == -1 );
+    netcode_server_destroy( server );
 
-    netcode_encryption_manager_set_expire_time( &encryption_manager, encryption_index, -1.0 );
+    netcode_client_destroy( client );
 
-    check( netcode_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[0].address, time ) == encryption_index );
+    netcode_network_simulator_destroy( network_simulator );
 }
 
-void test_replay_protection()
+void test_client_server_multiple_clients()
 {
-    struct netcode_replay_protection_t replay_protection;
+    #define NUM_START_STOP_ITERATIONS 3
 
-    int i;
-    for ( i = 0; i < 2; ++i )
-    {
-        netcode_replay_protection_reset( &replay_protection );
+    int max_clients[NUM_START_STOP_ITERATIONS] = { 2, 32, 5 };
 
-        check( replay_protection.most_recent_sequence == 0 );
+    struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
 
-        // the first time we receive packets, they should not be already received
+    network_simulator->latency_milliseconds = 250;
+    network_simulator->jitter_milliseconds = 250;
+    network_simulator->packet_loss_percent = 5;
+    network_simulator->duplicate_packet_percent = 10;
 
-        #define MAX_SEQUENCE ( NETCODE_REPLAY_PROTECTION_BUFFER_SIZE * 4 )
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
 
-        uint64_t sequence;
-        for ( sequence = 0; sequence < MAX_SEQUENCE; ++sequence )
-        {
-            check( netcode_replay_protection_already_received( &replay_protection, sequence ) == 0 );
-            netcode_replay_protection_advance_sequence( &replay_protection, sequence );
-        }
+    struct netcode_server_config_t server_config;
+    netcode_default_server_config( &server_config );
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-        // old packets outside buffer should be considered already received
+    struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
 
-        check( netcode_replay_protection_already_received( &replay_protection, 0 ) == 1 );
+    check( server );
 
-        // packets received a second time should be flagged already received
+    int i;
+    for ( i = 0; i < NUM_START_STOP_ITERATIONS; ++i )
+    {
+        // start the server with max # of clients for this iteration
 
-        for ( sequence = MAX_SEQUENCE - 10; sequence < MAX_SEQUENCE; ++sequence )
-        {
-            check( netcode_replay_protection_already_received( &replay_protection, sequence ) == 1 );
-        }
+        netcode_server_start( server, max_clients[i] );
 
-        // jumping ahead to a much higher sequence should be considered not already received
+        // create # of client objects for this iteration and connect to server
 
-        check( netcode_replay_protection_already_received( &replay_protection, MAX_SEQUENCE + NETCODE_REPLAY_PROTECTION_BUFFER_SIZE ) == 0 );
+        struct netcode_client_t ** client = (struct netcode_client_t **) malloc( sizeof( struct netcode_client_t* ) * max_clients[i] );
 
-        // old packets should be considered already received
+        check( client );
 
-        for ( sequence = 0; sequence < MAX_SEQUENCE; ++sequence )
+        int j;
+        for ( j = 0; j < max_clients[i]; ++j )
         {
-            check( netcode_replay_protection_already_received( &replay_protection, sequence ) == 1 );
-        }
-    }
-}
+            char client_address[NETCODE_MAX_ADDRESS_STRING_LENGTH];
+            snprintf( client_address, sizeof(client_address), "[::]:%d", 50000 + j );
 
-void test_client_create()
-{
-    {
-        struct netcode_client_config_t client_config;
-        netcode_default_client_config( &client_config );
+            struct netcode_client_config_t client_config;
+            netcode_default_client_config( &client_config );
+            client_config.network_simulator = network_simulator;
 
-        struct netcode_client_t * client = netcode_client_create( "127.0.0.1:40000", &client_config, 0.0 );
+            client[j] = netcode_client_create( client_address, &client_config, time );
 
-        struct netcode_address_t test_address;
-        netcode_parse_address( "127.0.0.1:40000", &test_address );
+            check( client[j] );
 
-        check( client );
-        check( client->socket_holder.ipv4.handle != 0 );
-        check( client->socket_holder.ipv6.handle == 0 );
-        check( netcode_address_equal( &client->address, &test_address ) );
+            uint64_t client_id = j;
+            netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-        netcode_client_destroy( client );
-    }
+            NETCODE_CONST char * server_address = "[::1]:40000";
 
-    {
-        struct netcode_client_config_t client_config;
-        netcode_default_client_config( &client_config );
+            uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-        struct netcode_client_t * client = netcode_client_create( "[::]:50000", &client_config, 0.0 );
+            uint8_t user_data[NETCODE_USER_DATA_BYTES];
+            netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-        struct netcode_address_t test_address;
-        netcode_parse_address( "[::]:50000", &test_address );
+            check( netcode_generate_connect_token( 1, 
+                                                   &server_address, 
+                                                   &server_address, 
+                                                   TEST_CONNECT_TOKEN_EXPIRY, 
+                                                   TEST_TIMEOUT_SECONDS,
+                                                   client_id, 
+                                                   TEST_PROTOCOL_ID, 
+                                                   private_key, 
+                                                   user_data, 
+                                                   connect_token ) );
 
-        check( client );
-        check( client->socket_holder.ipv4.handle == 0 );
-        check( client->socket_holder.ipv6.handle != 0 );
-        check( netcode_address_equal( &client->address, &test_address ) );
+            netcode_client_connect( client[j], connect_token );
+        }
 
-        netcode_client_destroy( client );
-    }
+        // make sure all clients can connect
 
-    {
-        struct netcode_client_config_t client_config;
-        netcode_default_client_config( &client_config );
+        while ( 1 )
+        {
+            netcode_network_simulator_update( network_simulator, time );
 
-        struct netcode_client_t * client = netcode_client_create_overload( "127.0.0.1:40000", "[::]:50000", &client_config, 0.0 );
+            for ( j = 0; j < max_clients[i]; ++j )
+            {
+                netcode_client_update( client[j], time );
+            }
 
-        struct netcode_address_t test_address;
-        netcode_parse_address( "127.0.0.1:40000", &test_address );
+            netcode_server_update( server, time );
 
-        check( client );
-        check( client->socket_holder.ipv4.handle != 0 );
-        check( client->socket_holder.ipv6.handle != 0 );
-        check( netcode_address_equal( &client->address, &test_address ) );
+            int num_connected_clients = 0;
 
-        netcode_client_destroy( client );
-    }
+            for ( j = 0; j < max_clients[i]; ++j )
+            {
+                if ( netcode_client_state( client[j] ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+                    break;
 
-    {
-        struct netcode_client_config_t client_config;
-        netcode_default_client_config( &client_config );
+                if ( netcode_client_state( client[j] ) == NETCODE_CLIENT_STATE_CONNECTED )
+                    num_connected_clients++;
+            }
 
-        struct netcode_client_t * client = netcode_client_create_overload( "[::]:50000", "127.0.0.1:40000", &client_config, 0.0 );
+            if ( num_connected_clients == max_clients[i] )
+                break;
 
-        struct netcode_address_t test_address;
-        netcode_parse_address( "[::]:50000", &test_address );
+            time += delta_time;
+        }
 
-        check( client );
-        check( client->socket_holder.ipv4.handle != 0 );
-        check( client->socket_holder.ipv6.handle != 0 );
-        check( netcode_address_equal( &client->address, &test_address ) );
+        check( netcode_server_num_connected_clients( server ) == max_clients[i] );
 
-        netcode_client_destroy( client );
-    }
-}
+        for ( j = 0; j < max_clients[i]; ++j )
+        {
+            check( netcode_client_state( client[j] ) == NETCODE_CLIENT_STATE_CONNECTED );
+            check( netcode_server_client_connected( server, j ) == 1 );
+        }
 
-void test_server_create()
-{
-    {
-        struct netcode_server_config_t server_config;
-        netcode_default_server_config( &server_config );
+        // make sure all clients can exchange packets with the server
 
-        struct netcode_server_t * server = netcode_server_create( "127.0.0.1:40000", &server_config, 0.0 );
+        int * server_num_packets_received = (int*) malloc( sizeof(int) * max_clients[i] );
+        int * client_num_packets_received = (int*) malloc( sizeof(int) * max_clients[i] );
 
-        struct netcode_address_t test_address;
-        netcode_parse_address( "127.0.0.1:40000", &test_address );
+        memset( server_num_packets_received, 0, sizeof(int) * max_clients[i] );
+        memset( client_num_packets_received, 0, sizeof(int) * max_clients[i] );
 
-        check( server );
-        check( server->socket_holder.ipv4.handle != 0 );
-        check( server->socket_holder.ipv6.handle == 0 );
-        check( netcode_address_equal( &server->address, &test_address ) );
+        uint8_t packet_data[NETCODE_MAX_PACKET_SIZE];
+        for ( j = 0; j < NETCODE_MAX_PACKET_SIZE; ++j )
+            packet_data[j] = (uint8_t) j;
+
+        while ( 1 )
+        {
+            netcode_network_simulator_update( network_simulator, time );
+
+            for ( j = 0; j < max_clients[i]; ++j )
+            {
+                netcode_client_update( client[j], time );
+            }
+
+            netcode_server_update( server, time );
 
-        netcode_server_destroy( server );
-    }
+            for ( j = 0; j < max_clients[i]; ++j )
+            {
+                netcode_client_send_packet( client[j], packet_data, NETCODE_MAX_PACKET_SIZE );
+            }
 
-    {
-        struct netcode_server_config_t server_config;
-        netcode_default_server_config( &server_config );
+            for ( j = 0; j < max_clients[i]; ++j )
+            {
+                netcode_server_send_packet( server, j, packet_data, NETCODE_MAX_PACKET_SIZE );
+            }
 
-        struct netcode_server_t * server = netcode_server_create( "[::1]:50000", &server_config, 0.0 );
+            for ( j = 0; j < max_clients[i]; ++j )
+            {
+                while ( 1 )             
+                {
+                    int packet_bytes;
+                    uint64_t packet_sequence;
+                    uint8_t * packet = netcode_client_receive_packet( client[j], &packet_bytes, &packet_sequence );
+                    if ( !packet )
+                        break;
+                    (void) packet_sequence;
+                    netcode_assert( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+                    netcode_assert( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
+                    client_num_packets_received[j]++;
+                    netcode_client_free_packet( client[j], packet );
+                }
+            }
 
-        struct netcode_address_t test_address;
-        netcode_parse_address( "[::1]:50000", &test_address );
+            for ( j = 0; j < max_clients[i]; ++j )
+            {
+                while ( 1 )             
+                {
+                    int packet_bytes;
+                    uint64_t packet_sequence;
+                    void * packet = netcode_server_receive_packet( server, j, &packet_bytes, &packet_sequence );
+                    if ( !packet )
+                        break;
+                    (void) packet_sequence;
+                    netcode_assert( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+                    netcode_assert( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
+                    server_num_packets_received[j]++;
+                    netcode_server_free_packet( server, packet );
+                }
+            }
 
-        check( server );
-        check( server->socket_holder.ipv4.handle == 0 );
-        check( server->socket_holder.ipv6.handle != 0 );
-        check( netcode_address_equal( &server->address, &test_address ) );
+            int num_clients_ready = 0;
 
-        netcode_server_destroy( server );
-    }
+            for ( j = 0; j < max_clients[i]; ++j )
+            {
+                if ( client_num_packets_received[j] >= 1 && server_num_packets_received[j] >= 1 )
+                {
+                    num_clients_ready++;
+                }
+            }
 
-    {
-        struct netcode_server_config_t server_config;
-        netcode_default_server_config( &server_config );
+            if ( num_clients_ready == max_clients[i] )
+                break;
 
-        struct netcode_server_t * server = netcode_server_create_overload( "127.0.0.1:40000", "[::1]:50000", &server_config, 0.0 );
+            for ( j = 0; j < max_clients[i]; ++j )
+            {
+                if ( netcode_client_state( client[j] ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+                    break;
+            }
 
-        struct netcode_address_t test_address;
-        netcode_parse_address( "127.0.0.1:40000", &test_address );
+            time += delta_time;
+        }
 
-        check( server );
-        check( server->socket_holder.ipv4.handle != 0 );
-        check( server->socket_holder.ipv6.handle != 0 );
-        check( netcode_address_equal( &server->address, &test_address ) );
+        int num_clients_ready = 0;
 
-        netcode_server_destroy( server );
-    }
+        for ( j = 0; j < max_clients[i]; ++j )
+        {
+            if ( client_num_packets_received[j] >= 1 && server_num_packets_received[j] >= 1 )
+            {
+                num_clients_ready++;
+            }
+        }
 
-    {
-        struct netcode_server_config_t server_config;
-        netcode_default_server_config( &server_config );
+        check( num_clients_ready == max_clients[i] );
 
-        struct netcode_server_t * server = netcode_server_create_overload( "[::1]:50000", "127.0.0.1:40000", &server_config, 0.0 );
+        free( server_num_packets_received );
+        free( client_num_packets_received );
+        
+        netcode_network_simulator_reset( network_simulator );
 
-        struct netcode_address_t test_address;
-        netcode_parse_address( "[::1]:50000", &test_address );
+        for ( j = 0; j < max_clients[i]; ++j )
+        {
+            netcode_client_destroy( client[j] );
+        }
 
-        check( server );
-        check( server->socket_holder.ipv4.handle != 0 );
-        check( server->socket_holder.ipv6.handle != 0 );
-        check( netcode_address_equal( &server->address, &test_address ) );
+        free( client );
 
-        netcode_server_destroy( server );
+        netcode_server_stop( server );
     }
-}
 
-static uint8_t private_key[NETCODE_KEY_BYTES] = { 0x60, 0x6a, 0xbe, 0x6e, 0xc9, 0x19, 0x10, 0xea, 
-                                                  0x9a, 0x65, 0x62, 0xf6, 0x6f, 0x2b, 0x30, 0xe4, 
-                                                  0x43, 0x71, 0xd6, 0x2c, 0xd1, 0x99, 0x27, 0x26,
-                                                  0x6b, 0x3c, 0x60, 0xf4, 0xb7, 0x15, 0xab, 0xa1 };
+    netcode_server_destroy( server );
 
-void test_client_server_connect()
+    netcode_network_simulator_destroy( network_simulator );
+}
+
+void test_client_server_multiple_servers()
 {
     struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
 
@@ -6610,7 +16069,7 @@ void test_client_server_connect()
 
     netcode_server_start( server, 1 );
 
-    NETCODE_CONST char * server_address = "[::1]:40000";
+    NETCODE_CONST char * server_address[] = { "10.10.10.10:1000", "100.100.100.100:50000", "[::1]:40000" };
 
     uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
@@ -6620,7 +16079,7 @@ void test_client_server_connect()
     uint8_t user_data[NETCODE_USER_DATA_BYTES];
     netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-    check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+    check( netcode_generate_connect_token( 3, server_address, server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
     netcode_client_connect( client, connect_token );
 
@@ -6687,7 +16146,6 @@ void test_client_server_connect()
             void * packet = netcode_server_receive_packet( server, 0, &packet_bytes, &packet_sequence );
             if ( !packet )
                 break;
-            (void) packet_sequence;
             netcode_assert( packet_bytes == NETCODE_MAX_PACKET_SIZE );
             netcode_assert( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
             server_num_packets_received++;
@@ -6708,306 +16166,205 @@ void test_client_server_connect()
         time += delta_time;
     }
 
-    check( client_num_packets_received >= 10 && server_num_packets_received >= 10 );
-
-    netcode_server_destroy( server );
-
-    netcode_client_destroy( client );
-
-    netcode_network_simulator_destroy( network_simulator );
-}
-
-void test_client_server_ipv4_socket_connect()
-{
-    {
-        double time = 0.0;
-        double delta_time = 1.0 / 10.0;
-
-        struct netcode_client_config_t client_config;
-        netcode_default_client_config( &client_config );
-
-        struct netcode_client_t * client = netcode_client_create( "0.0.0.0:50000", &client_config, time );
-
-        check( client );
-
-        struct netcode_server_config_t server_config;
-        netcode_default_server_config( &server_config );
-        server_config.protocol_id = TEST_PROTOCOL_ID;
-        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
-
-        struct netcode_server_t * server = netcode_server_create( "127.0.0.1:40000", &server_config, time );
-
-        check( server );
-
-        netcode_server_start( server, 1 );
-
-        NETCODE_CONST char * server_address = "127.0.0.1:40000";
-
-        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
-
-        uint64_t client_id = 0;
-        netcode_random_bytes( (uint8_t*) &client_id, 8 );
-
-        uint8_t user_data[NETCODE_USER_DATA_BYTES];
-        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
-
-        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
-
-        netcode_client_connect( client, connect_token );
-
-        while ( 1 )
-        {
-            netcode_client_update( client, time );
-
-            netcode_server_update( server, time );
-
-            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
-                break;
-
-            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
-                break;
-
-            time += delta_time;
-        }
-
-        netcode_server_destroy( server );
-
-        netcode_client_destroy( client );
-    }
-
-    {
-        double time = 0.0;
-        double delta_time = 1.0 / 10.0;
-
-        struct netcode_client_config_t client_config;
-        netcode_default_client_config( &client_config );
-
-        struct netcode_client_t * client = netcode_client_create( "0.0.0.0:50000", &client_config, time );
-
-        check( client );
-
-        struct netcode_server_config_t server_config;
-        netcode_default_server_config( &server_config );
-        server_config.protocol_id = TEST_PROTOCOL_ID;
-        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
-
-        struct netcode_server_t * server = netcode_server_create_overload( "127.0.0.1:40000", "[::1]:40000", &server_config, time );
-
-        check( server );
-
-        netcode_server_start( server, 1 );
-
-        NETCODE_CONST char * server_address = "127.0.0.1:40000";
-
-        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
-
-        uint64_t client_id = 0;
-        netcode_random_bytes( (uint8_t*) &client_id, 8 );
-
-        uint8_t user_data[NETCODE_USER_DATA_BYTES];
-        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
-
-        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
-
-        netcode_client_connect( client, connect_token );
-
-        while ( 1 )
-        {
-            netcode_client_update( client, time );
-
-            netcode_server_update( server, time );
-
-            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
-                break;
-
-            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
-                break;
-
-            time += delta_time;
-        }
-
-        netcode_server_destroy( server );
-
-        netcode_client_destroy( client );
-    }
-
-    {
-        double time = 0.0;
-        double delta_time = 1.0 / 10.0;
+    check( client_num_packets_received >= 10 && server_num_packets_received >= 10 );
 
-        struct netcode_client_config_t client_config;
-        netcode_default_client_config( &client_config );
+    netcode_server_destroy( server );
 
-        struct netcode_client_t * client = netcode_client_create_overload( "0.0.0.0:50000", "[::]:50000", &client_config, time );
+    netcode_client_destroy( client );
 
-        check( client );
+    netcode_network_simulator_destroy( network_simulator );
+}
 
-        struct netcode_server_config_t server_config;
-        netcode_default_server_config( &server_config );
-        server_config.protocol_id = TEST_PROTOCOL_ID;
-        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
+void test_client_server_race_connect()
+{
+    struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
 
-        struct netcode_server_t * server = netcode_server_create( "127.0.0.1:40000", &server_config, time );
+    network_simulator->latency_milliseconds = 25;
 
-        check( server );
+    double time = 0.0;
+    double delta_time = 1.0 / 100.0;
 
-        netcode_server_start( server, 1 );
+    struct netcode_client_config_t client_config;
+    netcode_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
+    client_config.race_connect_servers = 3;
 
-        NETCODE_CONST char * server_address = "127.0.0.1:40000";
+    struct netcode_client_t * client = netcode_client_create( "[::]:50000", &client_config, time );
 
-        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+    check( client );
 
-        uint64_t client_id = 0;
-        netcode_random_bytes( (uint8_t*) &client_id, 8 );
+    struct netcode_server_config_t server_config;
+    netcode_default_server_config( &server_config );
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-        uint8_t user_data[NETCODE_USER_DATA_BYTES];
-        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
+    struct netcode_server_t * server[2];
+    server[0] = netcode_server_create( "[::1]:40000", &server_config, time );
+    server[1] = netcode_server_create( "[::1]:40001", &server_config, time );
 
-        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+    check( server[0] );
+    check( server[1] );
 
-        netcode_client_connect( client, connect_token );
+    netcode_server_start( server[0], 1 );
+    netcode_server_start( server[1], 1 );
 
-        while ( 1 )
-        {
-            netcode_client_update( client, time );
+    // the first server in the token never answers. connecting in turn would sit through a full timeout on it
 
-            netcode_server_update( server, time );
+    NETCODE_CONST char * server_address[] = { "10.10.10.10:1000", "[::1]:40000", "[::1]:40001" };
 
-            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
-                break;
+    uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
-            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
-                break;
+    uint64_t client_id = 0;
+    netcode_random_bytes( (uint8_t*) &client_id, 8 );
 
-            time += delta_time;
-        }
+    uint8_t user_data[NETCODE_USER_DATA_BYTES];
+    netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-        netcode_server_destroy( server );
+    check( netcode_generate_connect_token( 3, server_address, server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-        netcode_client_destroy( client );
-    }
+    netcode_client_connect( client, connect_token );
 
+    while ( time < 1.0 )
     {
-        double time = 0.0;
-        double delta_time = 1.0 / 10.0;
+        netcode_network_simulator_update( network_simulator, time );
 
-        struct netcode_client_config_t client_config;
-        netcode_default_client_config( &client_config );
+        netcode_client_update( client, time );
 
-        struct netcode_client_t * client = netcode_client_create_overload( "0.0.0.0:50000", "[::]:50000", &client_config, time );
+        netcode_server_update( server[0], time );
+        netcode_server_update( server[1], time );
 
-        check( client );
+        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+            break;
 
-        struct netcode_server_config_t server_config;
-        netcode_default_server_config( &server_config );
-        server_config.protocol_id = TEST_PROTOCOL_ID;
-        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
+        if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+            break;
 
-        struct netcode_server_t * server = netcode_server_create_overload( "127.0.0.1:40000", "[::1]:40000", &server_config, time );
+        time += delta_time;
+    }
 
-        check( server );
+    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+    check( time < 0.5 );
 
-        netcode_server_start( server, 1 );
+    // exactly one server got the client. the other one dropped its pending encryption mapping when the client abandoned it
 
-        NETCODE_CONST char * server_address = "127.0.0.1:40000";
+    const int winner = netcode_server_client_connected( server[0], 0 ) ? 0 : 1;
+    const int loser = 1 - winner;
 
-        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+    check( netcode_address_equal( &client->server_address, &server[winner]->address ) );
 
-        uint64_t client_id = 0;
-        netcode_random_bytes( (uint8_t*) &client_id, 8 );
+    int i;
+    for ( i = 0; i < 10; ++i )
+    {
+        netcode_network_simulator_update( network_simulator, time );
 
-        uint8_t user_data[NETCODE_USER_DATA_BYTES];
-        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
+        netcode_client_update( client, time );
 
-        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+        netcode_server_update( server[0], time );
+        netcode_server_update( server[1], time );
 
-        netcode_client_connect( client, connect_token );
+        time += delta_time;
+    }
 
-        while ( 1 )
-        {
-            netcode_client_update( client, time );
+    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+    check( netcode_server_client_connected( server[winner], 0 ) == 1 );
+    check( netcode_server_num_connected_clients( server[loser] ) == 0 );
+    check( netcode_encryption_manager_find_encryption_mapping( &server[loser]->encryption_manager, &client->address, server[loser]->time ) == -1 );
 
-            netcode_server_update( server, time );
+    netcode_client_disconnect( client );
 
-            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
-                break;
+    // with a race of two, the first pair of servers has to time out before the client moves on to the next pair
 
-            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
-                break;
+    NETCODE_CONST char * unreachable_server_address[] = { "10.10.10.10:1000", "10.10.10.11:1000", "[::1]:40000" };
 
-            time += delta_time;
-        }
+    check( netcode_generate_connect_token( 3, unreachable_server_address, unreachable_server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id + 1, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-        netcode_server_destroy( server );
+    client->config.race_connect_servers = 2;
 
-        netcode_client_destroy( client );
-    }
-}
+    netcode_client_connect( client, connect_token );
 
-void test_client_server_ipv6_socket_connect()
-{
+    const double connect_time = time;
+
+    while ( time < connect_time + TEST_TIMEOUT_SECONDS * 2 )
     {
-        double time = 0.0;
-        double delta_time = 1.0 / 10.0;
+        netcode_network_simulator_update( network_simulator, time );
 
-        struct netcode_client_config_t client_config;
-        netcode_default_client_config( &client_config );
+        netcode_client_update( client, time );
 
-        struct netcode_client_t * client = netcode_client_create( "[::]:50000", &client_config, time );
+        netcode_server_update( server[0], time );
+        netcode_server_update( server[1], time );
 
-        check( client );
+        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+            break;
 
-        struct netcode_server_config_t server_config;
-        netcode_default_server_config( &server_config );
-        server_config.protocol_id = TEST_PROTOCOL_ID;
-        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
+        if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+            break;
 
-        struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
+        time += delta_time;
+    }
 
-        check( server );
+    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+    check( time > connect_time + TEST_TIMEOUT_SECONDS );
+    check( client->server_address_index == 2 );
 
-        netcode_server_start( server, 1 );
+    netcode_server_destroy( server[0] );
+    netcode_server_destroy( server[1] );
 
-        NETCODE_CONST char * server_address = "[::1]:40000";
+    netcode_client_destroy( client );
 
-        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+    netcode_network_simulator_destroy( network_simulator );
+}
 
-        uint64_t client_id = 0;
-        netcode_random_bytes( (uint8_t*) &client_id, 8 );
+int test_client_server_connect_and_wait( struct netcode_network_simulator_t * network_simulator, 
+                                         struct netcode_client_t * client, 
+                                         struct netcode_server_t * server, 
+                                         uint8_t * connect_token, 
+                                         double * time )
+{
+    // connects with a connect token or session ticket and updates until the client is connected or gives up.
+    // returns the number of updates it took, so a resumed session can be told apart from a full handshake
 
-        uint8_t user_data[NETCODE_USER_DATA_BYTES];
-        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
+    const double delta_time = 1.0 / 10.0;
 
-        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+    netcode_client_connect( client, connect_token );
 
-        netcode_client_connect( client, connect_token );
+    int num_updates = 0;
 
-        while ( 1 )
-        {
-            netcode_client_update( client, time );
+    while ( 1 )
+    {
+        netcode_network_simulator_update( network_simulator, *time );
 
-            netcode_server_update( server, time );
+        netcode_client_update( client, *time );
 
-            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
-                break;
+        netcode_server_update( server, *time );
 
-            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
-                break;
+        num_updates++;
 
-            time += delta_time;
-        }
+        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
+            break;
 
-        netcode_server_destroy( server );
+        if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+            break;
 
-        netcode_client_destroy( client );
+        *time += delta_time;
     }
-    
+
+    return num_updates;
+}
+
+void test_client_server_session_ticket()
+{
+    int handshake_thread;
+    for ( handshake_thread = 0; handshake_thread <= 1; ++handshake_thread )
     {
+        struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
+
         double time = 0.0;
         double delta_time = 1.0 / 10.0;
 
         struct netcode_client_config_t client_config;
         netcode_default_client_config( &client_config );
+        client_config.network_simulator = network_simulator;
 
         struct netcode_client_t * client = netcode_client_create( "[::]:50000", &client_config, time );
 
@@ -7016,9 +16373,12 @@ void test_client_server_ipv6_socket_connect()
         struct netcode_server_config_t server_config;
         netcode_default_server_config( &server_config );
         server_config.protocol_id = TEST_PROTOCOL_ID;
+        server_config.network_simulator = network_simulator;
+        server_config.handshake_thread = handshake_thread;
+        server_config.session_ticket_seconds = 30;
         memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
-        struct netcode_server_t * server = netcode_server_create_overload( "127.0.0.1:40000", "[::1]:40000", &server_config, time );
+        struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
 
         check( server );
 
@@ -7036,155 +16396,163 @@ void test_client_server_ipv6_socket_connect()
 
         check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-        netcode_client_connect( client, connect_token );
+        // connect with a connect token from the backend. no session ticket until the server hands one out
 
-        while ( 1 )
+        uint8_t session_ticket[NETCODE_CONNECT_TOKEN_BYTES];
+
+        check( netcode_client_session_ticket( client, session_ticket ) == 0 );
+
+        int full_handshake_updates = test_client_server_connect_and_wait( network_simulator, client, server, connect_token, &time );
+
+        check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+
+        // the server sends a session ticket once the client is confirmed
+
+        int i;
+        for ( i = 0; i < 100; ++i )
         {
+            netcode_network_simulator_update( network_simulator, time );
+
             netcode_client_update( client, time );
 
             netcode_server_update( server, time );
 
-            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
-                break;
-
-            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+            if ( netcode_client_session_ticket( client, session_ticket ) )
                 break;
 
             time += delta_time;
         }
 
-        netcode_server_destroy( server );
-
-        netcode_client_destroy( client );
-    }
-    
-    {
-        double time = 0.0;
-        double delta_time = 1.0 / 10.0;
-
-        struct netcode_client_config_t client_config;
-        netcode_default_client_config( &client_config );
+        check( netcode_client_session_ticket( client, session_ticket ) == 1 );
 
-        struct netcode_client_t * client = netcode_client_create_overload( "0.0.0.0:50000", "[::]:50000", &client_config, time );
+        // the ticket survives a disconnect, and reconnecting with it skips the challenge
 
-        check( client );
+        netcode_client_disconnect( client );
 
-        struct netcode_server_config_t server_config;
-        netcode_default_server_config( &server_config );
-        server_config.protocol_id = TEST_PROTOCOL_ID;
-        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
+        for ( i = 0; i < 10; ++i )
+        {
+            netcode_network_simulator_update( network_simulator, time );
 
-        struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
+            netcode_server_update( server, time );
 
-        check( server );
+            time += delta_time;
+        }
 
-        netcode_server_start( server, 1 );
+        check( netcode_server_num_connected_clients( server ) == 0 );
 
-        NETCODE_CONST char * server_address = "[::1]:40000";
+        check( netcode_client_session_ticket( client, session_ticket ) == 1 );
 
-        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+        int resume_updates = test_client_server_connect_and_wait( network_simulator, client, server, session_ticket, &time );
 
-        uint64_t client_id = 0;
-        netcode_random_bytes( (uint8_t*) &client_id, 8 );
+        check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+        check( resume_updates < full_handshake_updates );
+        check( netcode_server_client_connected( server, 0 ) == 1 );
+        check( netcode_server_client_id( server, 0 ) == client_id );
+        check( memcmp( netcode_server_client_user_data( server, 0 ), user_data, NETCODE_USER_DATA_BYTES ) == 0 );
 
-        uint8_t user_data[NETCODE_USER_DATA_BYTES];
-        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
+        // payloads flow both ways over the resumed session
 
-        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+        uint8_t packet_data[NETCODE_MAX_PACKET_SIZE];
+        for ( i = 0; i < NETCODE_MAX_PACKET_SIZE; ++i )
+            packet_data[i] = (uint8_t) i;
 
-        netcode_client_connect( client, connect_token );
+        int server_num_packets_received = 0;
+        int client_num_packets_received = 0;
 
-        while ( 1 )
+        for ( i = 0; i < 100; ++i )
         {
-            netcode_client_update( client, time );
-
-            netcode_server_update( server, time );
-
-            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
-                break;
-
-            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
-                break;
-
-            time += delta_time;
-        }
-
-        netcode_server_destroy( server );
-
-        netcode_client_destroy( client );
-    }
-    
-    {
-        double time = 0.0;
-        double delta_time = 1.0 / 10.0;
-
-        struct netcode_client_config_t client_config;
-        netcode_default_client_config( &client_config );
-
-        struct netcode_client_t * client = netcode_client_create_overload( "0.0.0.0:50000", "[::]:50000", &client_config, time );
+            netcode_client_send_packet( client, packet_data, NETCODE_MAX_PACKET_SIZE );
 
-        check( client );
+            netcode_server_send_packet( server, 0, packet_data, NETCODE_MAX_PACKET_SIZE );
 
-        struct netcode_server_config_t server_config;
-        netcode_default_server_config( &server_config );
-        server_config.protocol_id = TEST_PROTOCOL_ID;
-        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
+            netcode_network_simulator_update( network_simulator, time );
 
-        struct netcode_server_t * server = netcode_server_create_overload( "127.0.0.1:40000", "[::1]:40000", &server_config, time );
+            netcode_client_update( client, time );
 
-        check( server );
+            netcode_server_update( server, time );
 
-        netcode_server_start( server, 1 );
+            while ( 1 )
+            {
+                int packet_bytes;
+                uint64_t packet_sequence;
+                void * packet = netcode_client_receive_packet( client, &packet_bytes, &packet_sequence );
+                if ( !packet )
+                    break;
+                check( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+                check( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );
+                client_num_packets_received++;
+                netcode_client_free_packet( client, packet );
+            }
 
-        NETCODE_CONST char * server_address = "[::1]:40000";
+            while ( 1 )
+            {
+                int packet_bytes;
+                uint64_t packet_sequence;
+                void * packet = netcode_server_receive_packet( server, 0, &packet_bytes, &packet_sequence );
+                if ( !packet )
+                    break;
+                check( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+                check( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );
+                server_num_packets_received++;
+                netcode_server_free_packet( server, packet );
+            }
 
-        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+            if ( client_num_packets_received >= 10 && server_num_packets_received >= 10 )
+                break;
 
-        uint64_t client_id = 0;
-        netcode_random_bytes( (uint8_t*) &client_id, 8 );
+            time += delta_time;
+        }
 
-        uint8_t user_data[NETCODE_USER_DATA_BYTES];
-        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
+        check( client_num_packets_received >= 10 && server_num_packets_received >= 10 );
 
-        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+        // a session ticket is good for one session only. replaying it gets the client denied
 
-        netcode_client_connect( client, connect_token );
+        netcode_client_disconnect( client );
 
-        while ( 1 )
+        for ( i = 0; i < 10; ++i )
         {
-            netcode_client_update( client, time );
+            netcode_network_simulator_update( network_simulator, time );
 
             netcode_server_update( server, time );
 
-            if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
-                break;
-
-            if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
-                break;
-
             time += delta_time;
         }
 
+        check( netcode_server_num_connected_clients( server ) == 0 );
+
+        test_client_server_connect_and_wait( network_simulator, client, server, session_ticket, &time );
+
+        check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTION_DENIED );
+        check( netcode_server_num_connected_clients( server ) == 0 );
+
         netcode_server_destroy( server );
 
         netcode_client_destroy( client );
+
+        netcode_network_simulator_destroy( network_simulator );
     }
 }
 
-void test_client_server_keep_alive()
+static int test_contains_bytes( NETCODE_CONST uint8_t * data, int data_bytes, NETCODE_CONST uint8_t * bytes, int num_bytes )
+{
+    int i;
+    for ( i = 0; i + num_bytes <= data_bytes; ++i )
+    {
+        if ( memcmp( data + i, bytes, num_bytes ) == 0 )
+            return 1;
+    }
+    return 0;
+}
+
+void test_client_server_session_ticket_integrity_only()
 {
     struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
 
-    network_simulator->latency_milliseconds = 250;
-    network_simulator->jitter_milliseconds = 250;
-    network_simulator->packet_loss_percent = 5;
-    network_simulator->duplicate_packet_percent = 10;
+    network_simulator->latency_milliseconds = 50;
 
     double time = 0.0;
     double delta_time = 1.0 / 10.0;
 
-    // connect client to server
-
     struct netcode_client_config_t client_config;
     netcode_default_client_config( &client_config );
     client_config.network_simulator = network_simulator;
@@ -7197,6 +16565,8 @@ void test_client_server_keep_alive()
     netcode_default_server_config( &server_config );
     server_config.protocol_id = TEST_PROTOCOL_ID;
     server_config.network_simulator = network_simulator;
+    server_config.cipher_suite = NETCODE_CIPHER_SUITE_INTEGRITY_ONLY;
+    server_config.session_ticket_seconds = 30;
     memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
     struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
@@ -7215,38 +16585,22 @@ void test_client_server_keep_alive()
     uint8_t user_data[NETCODE_USER_DATA_BYTES];
     netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-    check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
-
-    netcode_client_connect( client, connect_token );
-
-    while ( 1 )
-    {
-        netcode_network_simulator_update( network_simulator, time );
-
-        netcode_client_update( client, time );
-
-        netcode_server_update( server, time );
-
-        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
-            break;
+    check( netcode_generate_connect_token_with_cipher_suite( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, NETCODE_CIPHER_SUITE_INTEGRITY_ONLY, connect_token ) );
 
-        if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
-            break;
-
-        time += delta_time;
-    }
+    test_client_server_connect_and_wait( network_simulator, client, server, connect_token, &time );
 
     check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
-    check( netcode_client_index( client ) == 0 );
-    check( netcode_server_client_connected( server, 0 ) == 1 );
-    check( netcode_server_num_connected_clients( server ) == 1 );
+    check( server->client_cipher_suite[0] == NETCODE_CIPHER_SUITE_INTEGRITY_ONLY );
 
-    // pump the client and server long enough that they would timeout without keep alive packets
+    // grab the session ticket packet off the wire on its way to the client
 
-    int num_iterations = (int) ( 1.25f * TEST_TIMEOUT_SECONDS / delta_time ) + 1;
+    uint8_t ticket_packet_data[NETCODE_MAX_PACKET_BYTES];
+    int ticket_packet_bytes = 0;
+
+    uint8_t session_ticket[NETCODE_CONNECT_TOKEN_BYTES];
 
     int i;
-    for ( i = 0; i < num_iterations; ++i )
+    for ( i = 0; i < 100; ++i )
     {
         netcode_network_simulator_update( network_simulator, time );
 
@@ -7254,269 +16608,117 @@ void test_client_server_keep_alive()
 
         netcode_server_update( server, time );
 
-        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
-            break;
-
-        time += delta_time;
-    }
-
-    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
-    check( netcode_client_index( client ) == 0 );
-    check( netcode_server_client_connected( server, 0 ) == 1 );
-    check( netcode_server_num_connected_clients( server ) == 1 );
-
-    netcode_server_destroy( server );
-
-    netcode_client_destroy( client );
-
-    netcode_network_simulator_destroy( network_simulator );
-}
-
-void test_client_server_multiple_clients()
-{
-    #define NUM_START_STOP_ITERATIONS 3
-
-    int max_clients[NUM_START_STOP_ITERATIONS] = { 2, 32, 5 };
-
-    struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
-
-    network_simulator->latency_milliseconds = 250;
-    network_simulator->jitter_milliseconds = 250;
-    network_simulator->packet_loss_percent = 5;
-    network_simulator->duplicate_packet_percent = 10;
-
-    double time = 0.0;
-    double delta_time = 1.0 / 10.0;
-
-    struct netcode_server_config_t server_config;
-    netcode_default_server_config( &server_config );
-    server_config.protocol_id = TEST_PROTOCOL_ID;
-    server_config.network_simulator = network_simulator;
-    memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
-
-    struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
-
-    check( server );
-
-    int i;
-    for ( i = 0; i < NUM_START_STOP_ITERATIONS; ++i )
-    {
-        // start the server with max # of clients for this iteration
-
-        netcode_server_start( server, max_clients[i] );
-
-        // create # of client objects for this iteration and connect to server
-
-        struct netcode_client_t ** client = (struct netcode_client_t **) malloc( sizeof( struct netcode_client_t* ) * max_clients[i] );
-
-        check( client );
-
         int j;
-        for ( j = 0; j < max_clients[i]; ++j )
-        {
-            char client_address[NETCODE_MAX_ADDRESS_STRING_LENGTH];
-            snprintf( client_address, sizeof(client_address), "[::]:%d", 50000 + j );
-
-            struct netcode_client_config_t client_config;
-            netcode_default_client_config( &client_config );
-            client_config.network_simulator = network_simulator;
-
-            client[j] = netcode_client_create( client_address, &client_config, time );
-
-            check( client[j] );
-
-            uint64_t client_id = j;
-            netcode_random_bytes( (uint8_t*) &client_id, 8 );
-
-            NETCODE_CONST char * server_address = "[::1]:40000";
-
-            uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
-
-            uint8_t user_data[NETCODE_USER_DATA_BYTES];
-            netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
-
-            check( netcode_generate_connect_token( 1, 
-                                                   &server_address, 
-                                                   &server_address, 
-                                                   TEST_CONNECT_TOKEN_EXPIRY, 
-                                                   TEST_TIMEOUT_SECONDS,
-                                                   client_id, 
-                                                   TEST_PROTOCOL_ID, 
-                                                   private_key, 
-                                                   user_data, 
-                                                   connect_token ) );
-
-            netcode_client_connect( client[j], connect_token );
-        }
-
-        // make sure all clients can connect
-
-        while ( 1 )
+        for ( j = 0; j < NETCODE_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES; ++j )
         {
-            netcode_network_simulator_update( network_simulator, time );
-
-            for ( j = 0; j < max_clients[i]; ++j )
-            {
-                netcode_client_update( client[j], time );
-            }
-
-            netcode_server_update( server, time );
-
-            int num_connected_clients = 0;
-
-            for ( j = 0; j < max_clients[i]; ++j )
+            struct netcode_network_simulator_packet_entry_t * entry = &network_simulator->packet_entries[j];
+            if ( entry->packet_data && ( entry->packet_data[0] & 0xF ) == NETCODE_CONNECTION_SESSION_TICKET_PACKET && ticket_packet_bytes == 0 )
             {
-                if ( netcode_client_state( client[j] ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
-                    break;
-
-                if ( netcode_client_state( client[j] ) == NETCODE_CLIENT_STATE_CONNECTED )
-                    num_connected_clients++;
+                memcpy( ticket_packet_data, entry->packet_data, entry->packet_bytes );
+                ticket_packet_bytes = entry->packet_bytes;
             }
-
-            if ( num_connected_clients == max_clients[i] )
-                break;
-
-            time += delta_time;
         }
 
-        check( netcode_server_num_connected_clients( server ) == max_clients[i] );
-
-        for ( j = 0; j < max_clients[i]; ++j )
-        {
-            check( netcode_client_state( client[j] ) == NETCODE_CLIENT_STATE_CONNECTED );
-            check( netcode_server_client_connected( server, j ) == 1 );
-        }
+        if ( netcode_client_session_ticket( client, session_ticket ) )
+            break;
 
-        // make sure all clients can exchange packets with the server
+        time += delta_time;
+    }
 
-        int * server_num_packets_received = (int*) malloc( sizeof(int) * max_clients[i] );
-        int * client_num_packets_received = (int*) malloc( sizeof(int) * max_clients[i] );
+    check( netcode_client_session_ticket( client, session_ticket ) == 1 );
+    check( ticket_packet_bytes > 0 );
 
-        memset( server_num_packets_received, 0, sizeof(int) * max_clients[i] );
-        memset( client_num_packets_received, 0, sizeof(int) * max_clients[i] );
+    // the connection only authenticates its packets, but the keys for the next session must not be readable
 
-        uint8_t packet_data[NETCODE_MAX_PACKET_SIZE];
-        for ( j = 0; j < NETCODE_MAX_PACKET_SIZE; ++j )
-            packet_data[j] = (uint8_t) j;
+    check( !test_contains_bytes( ticket_packet_data, ticket_packet_bytes, client->session_ticket.client_to_server_key, NETCODE_KEY_BYTES ) );
+    check( !test_contains_bytes( ticket_packet_data, ticket_packet_bytes, client->session_ticket.server_to_client_key, NETCODE_KEY_BYTES ) );
 
-        while ( 1 )
-        {
-            netcode_network_simulator_update( network_simulator, time );
+    // the ticket resumes an integrity only session
 
-            for ( j = 0; j < max_clients[i]; ++j )
-            {
-                netcode_client_update( client[j], time );
-            }
+    netcode_client_disconnect( client );
 
-            netcode_server_update( server, time );
+    for ( i = 0; i < 10; ++i )
+    {
+        netcode_network_simulator_update( network_simulator, time );
 
-            for ( j = 0; j < max_clients[i]; ++j )
-            {
-                netcode_client_send_packet( client[j], packet_data, NETCODE_MAX_PACKET_SIZE );
-            }
+        netcode_server_update( server, time );
 
-            for ( j = 0; j < max_clients[i]; ++j )
-            {
-                netcode_server_send_packet( server, j, packet_data, NETCODE_MAX_PACKET_SIZE );
-            }
+        time += delta_time;
+    }
 
-            for ( j = 0; j < max_clients[i]; ++j )
-            {
-                while ( 1 )             
-                {
-                    int packet_bytes;
-                    uint64_t packet_sequence;
-                    uint8_t * packet = netcode_client_receive_packet( client[j], &packet_bytes, &packet_sequence );
-                    if ( !packet )
-                        break;
-                    (void) packet_sequence;
-                    netcode_assert( packet_bytes == NETCODE_MAX_PACKET_SIZE );
-                    netcode_assert( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
-                    client_num_packets_received[j]++;
-                    netcode_client_free_packet( client[j], packet );
-                }
-            }
+    check( netcode_server_num_connected_clients( server ) == 0 );
 
-            for ( j = 0; j < max_clients[i]; ++j )
-            {
-                while ( 1 )             
-                {
-                    int packet_bytes;
-                    uint64_t packet_sequence;
-                    void * packet = netcode_server_receive_packet( server, j, &packet_bytes, &packet_sequence );
-                    if ( !packet )
-                        break;
-                    (void) packet_sequence;
-                    netcode_assert( packet_bytes == NETCODE_MAX_PACKET_SIZE );
-                    netcode_assert( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
-                    server_num_packets_received[j]++;
-                    netcode_server_free_packet( server, packet );
-                }
-            }
+    test_client_server_connect_and_wait( network_simulator, client, server, session_ticket, &time );
 
-            int num_clients_ready = 0;
+    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+    check( netcode_server_client_id( server, 0 ) == client_id );
+    check( server->client_cipher_suite[0] == NETCODE_CIPHER_SUITE_INTEGRITY_ONLY );
+    check( client->context.cipher_suite == NETCODE_CIPHER_SUITE_INTEGRITY_ONLY );
 
-            for ( j = 0; j < max_clients[i]; ++j )
-            {
-                if ( client_num_packets_received[j] >= 1 && server_num_packets_received[j] >= 1 )
-                {
-                    num_clients_ready++;
-                }
-            }
+    uint8_t packet_data[NETCODE_MAX_PACKET_SIZE];
+    for ( i = 0; i < NETCODE_MAX_PACKET_SIZE; ++i )
+        packet_data[i] = (uint8_t) i;
 
-            if ( num_clients_ready == max_clients[i] )
-                break;
+    int server_num_packets_received = 0;
+    int client_num_packets_received = 0;
 
-            for ( j = 0; j < max_clients[i]; ++j )
-            {
-                if ( netcode_client_state( client[j] ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
-                    break;
-            }
+    for ( i = 0; i < 100; ++i )
+    {
+        netcode_client_send_packet( client, packet_data, NETCODE_MAX_PACKET_SIZE );
 
-            time += delta_time;
-        }
+        netcode_server_send_packet( server, 0, packet_data, NETCODE_MAX_PACKET_SIZE );
 
-        int num_clients_ready = 0;
+        netcode_network_simulator_update( network_simulator, time );
 
-        for ( j = 0; j < max_clients[i]; ++j )
-        {
-            if ( client_num_packets_received[j] >= 1 && server_num_packets_received[j] >= 1 )
-            {
-                num_clients_ready++;
-            }
-        }
+        netcode_client_update( client, time );
 
-        check( num_clients_ready == max_clients[i] );
+        netcode_server_update( server, time );
 
-        free( server_num_packets_received );
-        free( client_num_packets_received );
-        
-        netcode_network_simulator_reset( network_simulator );
+        while ( 1 )
+        {
+            int packet_bytes;
+            uint64_t packet_sequence;
+            void * packet = netcode_client_receive_packet( client, &packet_bytes, &packet_sequence );
+            if ( !packet )
+                break;
+            check( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+            check( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );
+            client_num_packets_received++;
+            netcode_client_free_packet( client, packet );
+        }
 
-        for ( j = 0; j < max_clients[i]; ++j )
+        while ( 1 )
         {
-            netcode_client_destroy( client[j] );
+            int packet_bytes;
+            uint64_t packet_sequence;
+            void * packet = netcode_server_receive_packet( server, 0, &packet_bytes, &packet_sequence );
+            if ( !packet )
+                break;
+            check( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+            check( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );
+            server_num_packets_received++;
+            netcode_server_free_packet( server, packet );
         }
 
-        free( client );
+        if ( client_num_packets_received >= 10 && server_num_packets_received >= 10 )
+            break;
 
-        netcode_server_stop( server );
+        time += delta_time;
     }
 
+    check( client_num_packets_received >= 10 && server_num_packets_received >= 10 );
+
     netcode_server_destroy( server );
 
+    netcode_client_destroy( client );
+
     netcode_network_simulator_destroy( network_simulator );
 }
 
-void test_client_server_multiple_servers()
+void test_client_server_session_ticket_out_of_order()
 {
     struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
 
-    network_simulator->latency_milliseconds = 250;
-    network_simulator->jitter_milliseconds = 250;
-    network_simulator->packet_loss_percent = 5;
-    network_simulator->duplicate_packet_percent = 10;
-
     double time = 0.0;
     double delta_time = 1.0 / 10.0;
 
@@ -7532,6 +16734,7 @@ void test_client_server_multiple_servers()
     netcode_default_server_config( &server_config );
     server_config.protocol_id = TEST_PROTOCOL_ID;
     server_config.network_simulator = network_simulator;
+    server_config.session_ticket_seconds = 30;
     memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
 
     struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
@@ -7540,7 +16743,7 @@ void test_client_server_multiple_servers()
 
     netcode_server_start( server, 1 );
 
-    NETCODE_CONST char * server_address[] = { "10.10.10.10:1000", "100.100.100.100:50000", "[::1]:40000" };
+    NETCODE_CONST char * server_address = "[::1]:40000";
 
     uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
 
@@ -7550,11 +16753,16 @@ void test_client_server_multiple_servers()
     uint8_t user_data[NETCODE_USER_DATA_BYTES];
     netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
 
-    check( netcode_generate_connect_token( 3, server_address, server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+    check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
 
-    netcode_client_connect( client, connect_token );
+    test_client_server_connect_and_wait( network_simulator, client, server, connect_token, &time );
 
-    while ( 1 )
+    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+
+    uint8_t old_session_ticket[NETCODE_CONNECT_TOKEN_BYTES];
+
+    int i;
+    for ( i = 0; i < 100; ++i )
     {
         netcode_network_simulator_update( network_simulator, time );
 
@@ -7562,88 +16770,222 @@ void test_client_server_multiple_servers()
 
         netcode_server_update( server, time );
 
-        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
-            break;
-
-        if ( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED )
+        if ( netcode_client_session_ticket( client, old_session_ticket ) )
             break;
 
         time += delta_time;
     }
 
-    check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
-    check( netcode_client_index( client ) == 0 );
-    check( netcode_server_client_connected( server, 0 ) == 1 );
-    check( netcode_server_num_connected_clients( server ) == 1 );
+    check( netcode_client_session_ticket( client, old_session_ticket ) == 1 );
 
-    int server_num_packets_received = 0;
-    int client_num_packets_received = 0;
+    // a busy server hands out lots of tickets to other clients in the meantime
 
-    uint8_t packet_data[NETCODE_MAX_PACKET_SIZE];
-    int i;
-    for ( i = 0; i < NETCODE_MAX_PACKET_SIZE; ++i )
-        packet_data[i] = (uint8_t) i;
+    const uint64_t old_session_ticket_sequence = server->session_ticket_sequence;
 
-    while ( 1 )
+    for ( i = 0; i < 30; ++i )
     {
+        int j;
+        for ( j = 0; j < 10; ++j )
+        {
+            netcode_server_send_session_ticket( server, 0 );
+        }
+
         netcode_network_simulator_update( network_simulator, time );
 
         netcode_client_update( client, time );
 
         netcode_server_update( server, time );
 
-        netcode_client_send_packet( client, packet_data, NETCODE_MAX_PACKET_SIZE );
+        time += delta_time;
+    }
 
-        netcode_server_send_packet( server, 0, packet_data, NETCODE_MAX_PACKET_SIZE );
+    check( server->session_ticket_sequence - old_session_ticket_sequence > 256 );
 
-        while ( 1 )             
+    uint8_t new_session_ticket[NETCODE_CONNECT_TOKEN_BYTES];
+
+    check( netcode_client_session_ticket( client, new_session_ticket ) == 1 );
+    check( memcmp( new_session_ticket, old_session_ticket, NETCODE_CONNECT_TOKEN_BYTES ) != 0 );
+
+    // redeem the newest ticket first, then the old one. each works once
+
+    uint8_t * session_tickets[3] = { new_session_ticket, old_session_ticket, old_session_ticket };
+
+    for ( i = 0; i < 3; ++i )
+    {
+        netcode_client_disconnect( client );
+
+        int j;
+        for ( j = 0; j < 10; ++j )
         {
-            int packet_bytes;
-            uint64_t packet_sequence;
-            uint8_t * packet = netcode_client_receive_packet( client, &packet_bytes, &packet_sequence );
-            if ( !packet )
-                break;
-            (void) packet_sequence;
-            netcode_assert( packet_bytes == NETCODE_MAX_PACKET_SIZE );
-            netcode_assert( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
-            client_num_packets_received++;
-            netcode_client_free_packet( client, packet );
+            netcode_network_simulator_update( network_simulator, time );
+
+            netcode_server_update( server, time );
+
+            time += delta_time;
         }
 
-        while ( 1 )             
+        check( netcode_server_num_connected_clients( server ) == 0 );
+
+        test_client_server_connect_and_wait( network_simulator, client, server, session_tickets[i], &time );
+
+        if ( i < 2 )
+        {
+            check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+            check( netcode_server_client_id( server, 0 ) == client_id );
+        }
+        else
+        {
+            check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTION_DENIED );
+            check( netcode_server_num_connected_clients( server ) == 0 );
+        }
+    }
+
+    netcode_server_destroy( server );
+
+    netcode_client_destroy( client );
+
+    netcode_network_simulator_destroy( network_simulator );
+}
+
+int test_client_server_connection_id_exchange( struct netcode_network_simulator_t * network_simulator, 
+                                               struct netcode_client_t * client, 
+                                               struct netcode_server_t * server, 
+                                               double * time )
+{
+    uint8_t packet_data[NETCODE_MAX_PACKET_SIZE];
+    int i;
+    for ( i = 0; i < NETCODE_MAX_PACKET_SIZE; ++i )
+        packet_data[i] = (uint8_t) i;
+
+    int server_num_packets_received = 0;
+
+    for ( i = 0; i < 20; ++i )
+    {
+        netcode_client_send_packet( client, packet_data, NETCODE_MAX_PACKET_SIZE );
+
+        netcode_network_simulator_update( network_simulator, *time );
+
+        netcode_client_update( client, *time );
+
+        netcode_server_update( server, *time );
+
+        while ( 1 )
         {
             int packet_bytes;
             uint64_t packet_sequence;
             void * packet = netcode_server_receive_packet( server, 0, &packet_bytes, &packet_sequence );
             if ( !packet )
                 break;
-            netcode_assert( packet_bytes == NETCODE_MAX_PACKET_SIZE );
-            netcode_assert( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );            
+            check( packet_bytes == NETCODE_MAX_PACKET_SIZE );
+            check( memcmp( packet, packet_data, NETCODE_MAX_PACKET_SIZE ) == 0 );
             server_num_packets_received++;
             netcode_server_free_packet( server, packet );
         }
 
-        if ( client_num_packets_received >= 10 && server_num_packets_received >= 10 )
+        while ( 1 )
         {
-            if ( netcode_server_client_connected( server, 0 ) )
-            {
-                netcode_server_disconnect_client( server, 0 );
-            }
+            int packet_bytes;
+            uint64_t packet_sequence;
+            void * packet = netcode_client_receive_packet( client, &packet_bytes, &packet_sequence );
+            if ( !packet )
+                break;
+            netcode_client_free_packet( client, packet );
         }
 
-        if ( netcode_client_state( client ) <= NETCODE_CLIENT_STATE_DISCONNECTED )
-            break;
-
-        time += delta_time;
+        *time += 1.0 / 10.0;
     }
 
-    check( client_num_packets_received >= 10 && server_num_packets_received >= 10 );
+    return server_num_packets_received;
+}
 
-    netcode_server_destroy( server );
+void test_client_server_connection_id()
+{
+    int connection_ids;
+    for ( connection_ids = 0; connection_ids <= 1; ++connection_ids )
+    {
+        struct netcode_network_simulator_t * network_simulator = netcode_network_simulator_create( NULL, NULL, NULL );
 
-    netcode_client_destroy( client );
+        double time = 0.0;
 
-    netcode_network_simulator_destroy( network_simulator );
+        struct netcode_client_config_t client_config;
+        netcode_default_client_config( &client_config );
+        client_config.network_simulator = network_simulator;
+        client_config.connection_id = 1;
+
+        struct netcode_client_t * client = netcode_client_create( "[::]:50000", &client_config, time );
+
+        check( client );
+
+        struct netcode_server_config_t server_config;
+        netcode_default_server_config( &server_config );
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        server_config.network_simulator = network_simulator;
+        server_config.connection_ids = connection_ids;
+        memcpy( &server_config.private_key, private_key, NETCODE_KEY_BYTES );
+
+        struct netcode_server_t * server = netcode_server_create( "[::1]:40000", &server_config, time );
+
+        check( server );
+
+        netcode_server_start( server, 1 );
+
+        NETCODE_CONST char * server_address = "[::1]:40000";
+
+        uint8_t connect_token[NETCODE_CONNECT_TOKEN_BYTES];
+
+        uint64_t client_id = 0;
+        netcode_random_bytes( (uint8_t*) &client_id, 8 );
+
+        uint8_t user_data[NETCODE_USER_DATA_BYTES];
+        netcode_random_bytes(user_data, NETCODE_USER_DATA_BYTES);
+
+        check( netcode_generate_connect_token( 1, &server_address, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) );
+
+        // clients always tag their packets once connected. servers that don't look at the tag just skip over it
+
+        test_client_server_connect_and_wait( network_simulator, client, server, connect_token, &time );
+
+        check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+        check( netcode_server_client_connected( server, 0 ) == 1 );
+        check( client->connection_id != 0 );
+
+        check( test_client_server_connection_id_exchange( network_simulator, client, server, &time ) > 0 );
+
+        // the client's NAT binding changes, so its packets now arrive from another port
+
+        struct netcode_address_t old_address = client->address;
+        struct netcode_address_t new_address;
+        check( netcode_parse_address( "[::]:50001", &new_address ) == NETCODE_OK );
+        client->address = new_address;
+
+        int server_num_packets_received = test_client_server_connection_id_exchange( network_simulator, client, server, &time );
+
+        if ( connection_ids )
+        {
+            // the server follows the client to the new address and keeps it in the same slot
+
+            check( server_num_packets_received > 0 );
+            check( netcode_server_client_connected( server, 0 ) == 1 );
+            check( netcode_server_client_id( server, 0 ) == client_id );
+            check( netcode_address_equal( netcode_server_client_address( server, 0 ), &new_address ) );
+            check( netcode_server_counters( server )[NETCODE_SERVER_COUNTER_NUM_CLIENTS_MIGRATED] == 1 );
+            check( netcode_client_state( client ) == NETCODE_CLIENT_STATE_CONNECTED );
+        }
+        else
+        {
+            // without connection ids the packets from the new address belong to nobody
+
+            check( server_num_packets_received == 0 );
+            check( netcode_address_equal( netcode_server_client_address( server, 0 ), &old_address ) );
+            check( netcode_server_counters( server )[NETCODE_SERVER_COUNTER_NUM_CLIENTS_MIGRATED] == 0 );
+        }
+
+        netcode_server_destroy( server );
+
+        netcode_client_destroy( client );
+
+        netcode_network_simulator_destroy( network_simulator );
+    }
 }
 
 void test_client_error_connect_token_expired()
@@ -8980,15 +18322,47 @@ void netcode_test()
         RUN_TEST( test_connection_disconnect_packet );
         RUN_TEST( test_connect_token_public );
         RUN_TEST( test_encryption_manager );
+        RUN_TEST( test_address_map );
+        RUN_TEST( test_connect_token_table );
+        RUN_TEST( test_session_ticket_table );
         RUN_TEST( test_replay_protection );
+        RUN_TEST( test_encrypt_aead_batch );
+        RUN_TEST( test_aes256gcm );
+        RUN_TEST( test_integrity_only );
+        RUN_TEST( test_packet_pool );
         RUN_TEST( test_client_create );
         RUN_TEST( test_server_create );
         RUN_TEST( test_client_server_connect );
+        RUN_TEST( test_client_server_cipher_suite );
+        RUN_TEST( test_client_server_adaptive_handshake );
+        RUN_TEST( test_server_handshake_thread );
+        RUN_TEST( test_server_admission_control );
         RUN_TEST( test_client_server_ipv4_socket_connect );
         RUN_TEST( test_client_server_ipv6_socket_connect );
+        RUN_TEST( test_server_socket_batching );
+        RUN_TEST( test_server_decrypted_payload_changed_client );
+        RUN_TEST( test_server_wait );
+        RUN_TEST( test_server_receive_no_allocations );
+        RUN_TEST( test_send_packet_in_place );
+        RUN_TEST( test_server_send_packets_batch );
+#if NETCODE_UDP_OFFLOAD
+        RUN_TEST( test_socket_udp_offload );
+        RUN_TEST( test_server_udp_offload );
+#endif // #if NETCODE_UDP_OFFLOAD
+        RUN_TEST( test_server_max_clients_config );
+        RUN_TEST( test_server_shard_group );
+#if defined( SO_REUSEPORT )
+        RUN_TEST( test_server_shard_group_connect );
+#endif // #if defined( SO_REUSEPORT )
+        RUN_TEST( test_server_shard_group_duplicate_client_id );
         RUN_TEST( test_client_server_keep_alive );
         RUN_TEST( test_client_server_multiple_clients );
         RUN_TEST( test_client_server_multiple_servers );
+        RUN_TEST( test_client_server_race_connect );
+        RUN_TEST( test_client_server_session_ticket );
+        RUN_TEST( test_client_server_session_ticket_integrity_only );
+        RUN_TEST( test_client_server_session_ticket_out_of_order );
+        RUN_TEST( test_client_server_connection_id );
         RUN_TEST( test_client_error_connect_token_expired );
         RUN_TEST( test_client_error_invalid_connect_token );
         RUN_TEST( test_client_error_connection_timed_out );
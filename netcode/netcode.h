@@ -71,6 +71,11 @@
 #define NETCODE_USER_DATA_BYTES 256
 #define NETCODE_MAX_SERVERS_PER_CONNECT 32
 
+#define NETCODE_CIPHER_SUITE_CHACHA20_POLY1305                  0
+#define NETCODE_CIPHER_SUITE_AES256_GCM                         1
+#define NETCODE_CIPHER_SUITE_INTEGRITY_ONLY                     2
+#define NETCODE_NUM_CIPHER_SUITES                               3
+
 #define NETCODE_CLIENT_STATE_CONNECT_TOKEN_EXPIRED              -6
 #define NETCODE_CLIENT_STATE_INVALID_CONNECT_TOKEN              -5
 #define NETCODE_CLIENT_STATE_CONNECTION_TIMED_OUT               -4
@@ -85,6 +90,13 @@
 #define NETCODE_MAX_CLIENTS         256
 #define NETCODE_MAX_PACKET_SIZE     1200
 
+// *_send_packet_in_place write the packet header and mac around the payload and encrypt it where it sits,
+// so the caller must leave this much room on either side and treat the payload as clobbered afterwards.
+// the headroom covers the prefix byte, a connection id and the sequence
+
+#define NETCODE_PACKET_HEADROOM_BYTES   17
+#define NETCODE_PACKET_TAILROOM_BYTES   NETCODE_MAC_BYTES
+
 #define NETCODE_LOG_LEVEL_NONE      0
 #define NETCODE_LOG_LEVEL_ERROR     1
 #define NETCODE_LOG_LEVEL_INFO      2
@@ -97,6 +109,19 @@
 #define NETCODE_ADDRESS_IPV4        1
 #define NETCODE_ADDRESS_IPV6        2
 
+#define NETCODE_SERVER_COUNTER_NUM_PACKETS_SENT                     0
+#define NETCODE_SERVER_COUNTER_NUM_PACKETS_RECEIVED                 1
+#define NETCODE_SERVER_COUNTER_NUM_SOCKET_SEND_CALLS                2
+#define NETCODE_SERVER_COUNTER_NUM_SOCKET_RECEIVE_CALLS             3
+#define NETCODE_SERVER_COUNTER_NUM_HANDSHAKES_DROPPED               4
+#define NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_MALFORMED       5
+#define NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_UNEXPECTED      6
+#define NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_NO_MAPPING      7
+#define NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_ADDRESS_RATE    8
+#define NETCODE_SERVER_COUNTER_NUM_PACKETS_REJECTED_REQUEST_RATE    9
+#define NETCODE_SERVER_COUNTER_NUM_CLIENTS_MIGRATED                 10
+#define NETCODE_SERVER_NUM_COUNTERS                                 11
+
 #ifdef __cplusplus
 #define NETCODE_CONST const
 extern "C" {
@@ -140,6 +165,10 @@ struct netcode_client_config_t
 
 	bool (*auxiliary_command_function)(void*,uint8_t*,int);
 	void * auxiliary_command_context;
+
+    int adaptive_handshake;
+    int race_connect_servers;
+    int connection_id;
 };
 
 void netcode_default_client_config( struct netcode_client_config_t * config );
@@ -156,6 +185,8 @@ uint64_t netcode_client_next_packet_sequence( struct netcode_client_t * client )
 
 void netcode_client_send_packet( struct netcode_client_t * client, NETCODE_CONST uint8_t * packet_data, int packet_bytes );
 
+void netcode_client_send_packet_in_place( struct netcode_client_t * client, uint8_t * packet_data, int packet_bytes );
+
 uint8_t * netcode_client_receive_packet( struct netcode_client_t * client, int * packet_bytes, uint64_t * packet_sequence );
 
 void netcode_client_free_packet( struct netcode_client_t * client, void * packet );
@@ -182,6 +213,12 @@ uint16_t netcode_client_get_port( struct netcode_client_t * client );
 
 struct netcode_address_t * netcode_client_server_address( struct netcode_client_t * client );
 
+int netcode_client_session_ticket( struct netcode_client_t * client, uint8_t * session_ticket );
+
+uint64_t netcode_client_socket_handle( struct netcode_client_t * client );
+
+int netcode_client_wait( struct netcode_client_t * client, double timeout );
+
 int netcode_generate_connect_token( int num_server_addresses, 
                                     NETCODE_CONST char ** public_server_addresses, 
                                     NETCODE_CONST char ** internal_server_addresses, 
@@ -193,6 +230,20 @@ int netcode_generate_connect_token( int num_server_addresses,
                                     uint8_t * user_data, 
                                     uint8_t * connect_token );
 
+int netcode_generate_connect_token_with_cipher_suite( int num_server_addresses, 
+                                                      NETCODE_CONST char ** public_server_addresses, 
+                                                      NETCODE_CONST char ** internal_server_addresses, 
+                                                      int expire_seconds,
+                                                      int timeout_seconds, 
+                                                      uint64_t client_id, 
+                                                      uint64_t protocol_id, 
+                                                      NETCODE_CONST uint8_t * private_key, 
+                                                      uint8_t * user_data, 
+                                                      int cipher_suite, 
+                                                      uint8_t * connect_token );
+
+int netcode_cipher_suite_supported( int cipher_suite );
+
 struct netcode_server_config_t
 {
     uint64_t protocol_id;
@@ -213,8 +264,29 @@ struct netcode_server_config_t
 
 	bool (*auxiliary_command_function)(void*,struct netcode_address_t*,uint8_t*,int);
 	void * auxiliary_command_context;
+
+    int batch_socket_io;
+    int max_clients;
+    struct netcode_server_shard_group_t * shard_group;
+    int io_uring_socket_io;
+    int udp_offload;
+    int cipher_suite;
+    int handshake_thread;
+    int admission_control;
+    int max_connection_requests_per_second;
+    int connect_token_scan;
+    int adaptive_handshake;
+    int session_ticket_seconds;
+    int connection_ids;
 };
 
+struct netcode_server_shard_group_t * netcode_server_shard_group_create( int max_clients, 
+                                                                         void * allocator_context, 
+                                                                         void * (*allocate_function)(void*,size_t), 
+                                                                         void (*free_function)(void*,void*) );
+
+void netcode_server_shard_group_destroy( struct netcode_server_shard_group_t * group );
+
 void netcode_default_server_config( struct netcode_server_config_t * config );
 
 struct netcode_server_t * netcode_server_create( NETCODE_CONST char * server_address, NETCODE_CONST struct netcode_server_config_t * config, double time );
@@ -245,6 +317,12 @@ uint64_t netcode_server_next_packet_sequence( struct netcode_server_t * server,
 
 void netcode_server_send_packet( struct netcode_server_t * server, int client_index, NETCODE_CONST uint8_t * packet_data, int packet_bytes );
 
+void netcode_server_send_packet_in_place( struct netcode_server_t * server, int client_index, uint8_t * packet_data, int packet_bytes );
+
+void netcode_server_send_packets_together( struct netcode_server_t * server, int client_index, NETCODE_CONST uint8_t ** packet_data, NETCODE_CONST int * packet_bytes, int num_packets );
+
+void netcode_server_send_packets_batch( struct netcode_server_t * server, NETCODE_CONST int * client_index, NETCODE_CONST uint8_t ** packet_data, NETCODE_CONST int * packet_bytes, int num_packets );
+
 uint8_t * netcode_server_receive_packet( struct netcode_server_t * server, int client_index, int * packet_bytes, uint64_t * packet_sequence );
 
 void netcode_server_free_packet( struct netcode_server_t * server, void * packet );
@@ -265,6 +343,18 @@ void netcode_server_process_loopback_packet( struct netcode_server_t * server, i
 
 uint16_t netcode_server_get_port( struct netcode_server_t * server );
 
+uint64_t netcode_server_socket_handle( struct netcode_server_t * server, int address_type );
+
+int netcode_server_wait( struct netcode_server_t * server, double timeout );
+
+void netcode_server_flush_packets( struct netcode_server_t * server );
+
+NETCODE_CONST uint64_t * netcode_server_counters( struct netcode_server_t * server );
+
+int netcode_server_io_uring_active( struct netcode_server_t * server );
+
+int netcode_server_udp_offload_active( struct netcode_server_t * server );
+
 void netcode_log_level( int level );
 
 void netcode_set_printf_function( int (*function)( NETCODE_CONST char *, ... ) );
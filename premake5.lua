@@ -20,6 +20,8 @@ solution "Yojimbo"
         symbols "Off"
         optimize "Speed"
         defines { "YOJIMBO_RELEASE", "NETCODE_RELEASE", "RELIABLE_RELEASE" }
+    filter "system:linux"
+        links { "pthread" }
 
 project "sodium-builtin"
     kind "StaticLib"
@@ -86,6 +88,13 @@ project "soak"
     filter "system:not windows"
         links { "yojimbo", "sodium", "tlsf", "netcode", "reliable" }
 
+project "bench"
+    files { "bench.cpp", "shared.h" }
+    filter "system:windows"
+        links { "yojimbo", "sodium-builtin", "tlsf", "netcode", "reliable" }
+    filter "system:not windows"
+        links { "yojimbo", "sodium", "tlsf", "netcode", "reliable" }
+
 project "test"
     files { "test.cpp" }
     defines { "SERIALIZE_ENABLE_TESTS=1" }
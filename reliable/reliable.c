@@ -473,11 +473,61 @@ void reliable_read_bytes( uint8_t ** p, uint8_t * byte_array, int num_bytes )
 
 // ---------------------------------------------------------------
 
+// bits 6 and 7 of the packet header prefix byte say how many ack bits follow. readers from before the wider formats ignore
+// these bits, so a 32 bit header can also advertise that its sender reads 64 and 128 bit acks. an endpoint only sends the
+// wider formats once it has seen that advertisement, or a wider header, from the other side
+
+#define RELIABLE_ACK_FORMAT_32_BITS                 0
+#define RELIABLE_ACK_FORMAT_64_BITS                 1
+#define RELIABLE_ACK_FORMAT_128_BITS                2
+#define RELIABLE_ACK_FORMAT_32_BITS_EXTENDED        3
+
+#define RELIABLE_ACK_BITS_WORDS ( RELIABLE_MAX_ACK_BITS / 32 )
+
+int reliable_ack_format_bits( int ack_format )
+{
+    switch ( ack_format )
+    {
+        case RELIABLE_ACK_FORMAT_64_BITS:   return 64;
+        case RELIABLE_ACK_FORMAT_128_BITS:  return 128;
+        default:                            return 32;
+    }
+}
+
+void reliable_ack_bits_shift( uint32_t * ack_bits, int shift )
+{
+    reliable_assert( ack_bits );
+    reliable_assert( shift >= 0 );
+
+    // bit n of the ack bits is bit n % 32 of word n / 32, so shifting towards older packets moves bits into higher words
+
+    const int word_shift = shift >> 5;
+    const int bit_shift = shift & 31;
+
+    int i;
+    for ( i = RELIABLE_ACK_BITS_WORDS - 1; i >= 0; --i )
+    {
+        uint32_t word = 0;
+        if ( i >= word_shift )
+        {
+            word = ack_bits[i-word_shift] << bit_shift;
+            if ( bit_shift != 0 && i > word_shift )
+            {
+                word |= ack_bits[i-word_shift-1] >> ( 32 - bit_shift );
+            }
+        }
+        ack_bits[i] = word;
+    }
+}
+
+// ---------------------------------------------------------------
+
 struct reliable_fragment_reassembly_data_t
 {
     uint16_t sequence;
     uint16_t ack;
-    uint32_t ack_bits;
+    uint32_t ack_bits[RELIABLE_ACK_BITS_WORDS];
+    int ack_format;
     int num_fragments_received;
     int num_fragments_total;
     uint8_t * packet_data;
@@ -500,6 +550,43 @@ void reliable_fragment_reassembly_data_cleanup( void * data, void * allocator_co
 
 // ---------------------------------------------------------------
 
+struct reliable_packet_window_t
+{
+    int num_packets;
+    uint64_t bytes;
+    uint16_t first_sequence;
+    uint16_t last_sequence;
+};
+
+// the smallest rtt over a time window, kept with the three sample windowed min filter from linux lib/win_minmax.c
+
+struct reliable_rtt_min_sample_t
+{
+    double time;
+    float rtt;
+};
+
+struct reliable_rtt_min_filter_t
+{
+    struct reliable_rtt_min_sample_t samples[3];
+};
+
+// rtt percentiles come from a histogram with 1ms buckets below 16ms and 8 buckets per doubling above, so they are within
+// 1/16 of the true value. the counts are halved as samples come in so the histogram follows the recent past
+
+#define RELIABLE_RTT_HISTOGRAM_LINEAR_BUCKETS       16
+#define RELIABLE_RTT_HISTOGRAM_BUCKETS              ( RELIABLE_RTT_HISTOGRAM_LINEAR_BUCKETS + 8 * 10 )
+#define RELIABLE_RTT_HISTOGRAM_MAX_SAMPLES          1024
+
+// the congestion controller works like LEDBAT. it aims for a little queueing delay over the min rtt, backs off further the
+// more it overshoots, and cuts the rate when packets are lost. the rate is adjusted once per round trip
+
+#define RELIABLE_CONGESTION_LOSS_REORDERING         3
+#define RELIABLE_CONGESTION_LOSS_DECREASE           0.7
+#define RELIABLE_CONGESTION_MAX_DELAY_DECREASE      0.25
+#define RELIABLE_CONGESTION_MAX_BURST_SECONDS       0.05
+#define RELIABLE_CONGESTION_PACING_GAIN             1.25
+
 struct reliable_endpoint_t
 {
     void * allocator_context;
@@ -508,10 +595,38 @@ struct reliable_endpoint_t
     struct reliable_config_t config;
     double time;
     float rtt;
+    float rtt_smoothed;
+    float rtt_variance;
+    struct reliable_rtt_min_filter_t rtt_min_filter;
+    uint32_t rtt_histogram[RELIABLE_RTT_HISTOGRAM_BUCKETS];
+    int rtt_histogram_samples;
     float packet_loss;
     float sent_bandwidth_kbps;
     float received_bandwidth_kbps;
     float acked_bandwidth_kbps;
+    struct reliable_packet_window_t sent_window;
+    struct reliable_packet_window_t acked_window;
+    struct reliable_packet_window_t received_window;
+    uint16_t received_ack;
+    uint32_t received_ack_bits[RELIABLE_ACK_BITS_WORDS];
+    int peer_extended_acks;
+    double congestion_rate;
+    double congestion_budget;
+    double congestion_update_time;
+    double congestion_update_interval;
+    double congestion_adjust_time;
+    int congestion_slow_start;
+    uint16_t congestion_loss_sequence;
+    int congestion_num_lost;
+    int congestion_num_rtt_samples;
+    float congestion_queue_delay;
+    uint64_t congestion_acked_bytes;
+    uint8_t * paced_fragment_data;
+    int paced_fragment_bytes[256];
+    int num_paced_fragments;
+    int next_paced_fragment;
+    uint16_t paced_sequence;
+    double paced_fragment_time;
     int num_acks;
     uint16_t * acks;
     uint16_t sequence;
@@ -534,1295 +649,2673 @@ struct reliable_received_packet_data_t
     uint32_t packet_bytes;
 };
 
-void reliable_default_config( struct reliable_config_t * config )
+// packet loss and bandwidth are measured over the older half of the sent and received packet buffers. rather than scan
+// that half on every update, each window keeps running totals as packets slide into and out of it, so the cost of a
+// sample is paid once per packet and reliable_endpoint_update is constant time whatever the buffer sizes
+
+typedef int (*reliable_packet_window_sample_function_t)( struct reliable_sequence_buffer_t * sequence_buffer, uint16_t sequence );
+
+int reliable_sent_packet_sample( struct reliable_sequence_buffer_t * sequence_buffer, uint16_t sequence )
 {
-    reliable_assert( config );
-    memset( config, 0, sizeof( struct reliable_config_t ) );
-    config->name[0] = 'e';
-    config->name[1] = 'n';
-    config->name[2] = 'd';
-    config->name[3] = 'p';
-    config->name[4] = 'o';
-    config->name[5] = 'i';
-    config->name[6] = 'n';
-    config->name[7] = 't';
-    config->name[8] = '\0';
-    config->max_packet_size = 16 * 1024;
-    config->fragment_above = 1024;
-    config->max_fragments = 16;
-    config->fragment_size = 1024;
-    config->ack_buffer_size = 256;
-    config->sent_packets_buffer_size = 256;
-    config->received_packets_buffer_size = 256;
-    config->fragment_reassembly_buffer_size = 64;
-    config->rtt_smoothing_factor = 0.0025f;
-    config->packet_loss_smoothing_factor = 0.1f;
-    config->bandwidth_smoothing_factor = 0.1f;
-    config->packet_header_size = 28;        // note: UDP over IPv4 = 20 + 8 bytes, UDP over IPv6 = 40 + 8 bytes
+    struct reliable_sent_packet_data_t * sent_packet_data = (struct reliable_sent_packet_data_t*) reliable_sequence_buffer_find( sequence_buffer, sequence );
+    return sent_packet_data ? (int) sent_packet_data->packet_bytes : 0;
 }
 
-struct reliable_endpoint_t * reliable_endpoint_create( struct reliable_config_t * config, double time )
+int reliable_acked_packet_sample( struct reliable_sequence_buffer_t * sequence_buffer, uint16_t sequence )
 {
-    reliable_assert( config );
-    reliable_assert( config->max_packet_size > 0 );
-    reliable_assert( config->fragment_above > 0 );
-    reliable_assert( config->max_fragments > 0 );
-    reliable_assert( config->max_fragments <= 256 );
-    reliable_assert( config->fragment_size > 0 );
-    reliable_assert( config->ack_buffer_size > 0 );
-    reliable_assert( config->sent_packets_buffer_size > 0 );
-    reliable_assert( config->received_packets_buffer_size > 0 );
-    reliable_assert( config->transmit_packet_function != NULL );
-    reliable_assert( config->process_packet_function != NULL );
+    struct reliable_sent_packet_data_t * sent_packet_data = (struct reliable_sent_packet_data_t*) reliable_sequence_buffer_find( sequence_buffer, sequence );
+    return ( sent_packet_data && sent_packet_data->acked ) ? (int) sent_packet_data->packet_bytes : 0;
+}
 
-    void * allocator_context = config->allocator_context;
-    void * (*allocate_function)(void*,size_t) = config->allocate_function;
-    void (*free_function)(void*,void*) = config->free_function;
+int reliable_received_packet_sample( struct reliable_sequence_buffer_t * sequence_buffer, uint16_t sequence )
+{
+    struct reliable_received_packet_data_t * received_packet_data = (struct reliable_received_packet_data_t*) reliable_sequence_buffer_find( sequence_buffer, sequence );
+    return received_packet_data ? (int) received_packet_data->packet_bytes : 0;
+}
 
-    if ( allocate_function == NULL )
+void reliable_packet_window_reset( struct reliable_packet_window_t * window )
+{
+    reliable_assert( window );
+    memset( window, 0, sizeof( struct reliable_packet_window_t ) );
+}
+
+int reliable_packet_window_contains( struct reliable_sequence_buffer_t * sequence_buffer, uint16_t sequence )
+{
+    reliable_assert( sequence_buffer );
+    const uint16_t window_start = sequence_buffer->sequence - ( (uint16_t) sequence_buffer->num_entries );
+    return ( (uint16_t) ( sequence - window_start ) ) < sequence_buffer->num_entries / 2;
+}
+
+void reliable_packet_window_add( struct reliable_packet_window_t * window, uint16_t sequence, int packet_bytes )
+{
+    reliable_assert( window );
+    reliable_assert( packet_bytes > 0 );
+    if ( window->num_packets == 0 || reliable_sequence_less_than( sequence, window->first_sequence ) )
     {
-        allocate_function = reliable_default_allocate_function;
+        window->first_sequence = sequence;
     }
-
-    if ( free_function == NULL )
+    if ( window->num_packets == 0 || reliable_sequence_greater_than( sequence, window->last_sequence ) )
     {
-        free_function = reliable_default_free_function;
+        window->last_sequence = sequence;
     }
+    window->num_packets++;
+    window->bytes += packet_bytes;
+}
 
-    struct reliable_endpoint_t * endpoint = (struct reliable_endpoint_t*) allocate_function( allocator_context, sizeof( struct reliable_endpoint_t ) );
+void reliable_packet_window_remove_oldest( struct reliable_packet_window_t * window, 
+                                           struct reliable_sequence_buffer_t * sequence_buffer, 
+                                           reliable_packet_window_sample_function_t sample_function,
+                                           uint16_t sequence, 
+                                           int packet_bytes )
+{
+    reliable_assert( window );
+    reliable_assert( window->num_packets > 0 );
+    reliable_assert( window->first_sequence == sequence );
+    reliable_assert( window->bytes >= (uint64_t) packet_bytes );
 
-    reliable_assert( endpoint );
+    window->num_packets--;
+    window->bytes -= packet_bytes;
 
-    memset( endpoint, 0, sizeof( struct reliable_endpoint_t ) );
+    if ( window->num_packets == 0 )
+        return;
 
-    endpoint->allocator_context = allocator_context;
-    endpoint->allocate_function = allocate_function;
-    endpoint->free_function = free_function;
-    endpoint->config = *config;
-    endpoint->time = time;
+    // the next oldest packet is somewhere before the last one. each sequence is only stepped over once as the window slides
 
-    endpoint->acks = (uint16_t*) allocate_function( allocator_context, config->ack_buffer_size * sizeof( uint16_t ) );
-    
-    endpoint->sent_packets = reliable_sequence_buffer_create( config->sent_packets_buffer_size, 
-                                                              sizeof( struct reliable_sent_packet_data_t ), 
-                                                              allocator_context, 
-                                                              allocate_function, 
-                                                              free_function );
+    uint16_t next_sequence = sequence + 1;
+    while ( next_sequence != window->last_sequence && !sample_function( sequence_buffer, next_sequence ) )
+    {
+        next_sequence++;
+    }
+    window->first_sequence = next_sequence;
+}
 
-    endpoint->received_packets = reliable_sequence_buffer_create( config->received_packets_buffer_size, 
-                                                                  sizeof( struct reliable_received_packet_data_t ), 
-                                                                  allocator_context, 
-                                                                  allocate_function, 
-                                                                  free_function );
-    
-    endpoint->fragment_reassembly = reliable_sequence_buffer_create( config->fragment_reassembly_buffer_size, 
-                                                                     sizeof( struct reliable_fragment_reassembly_data_t ), 
-                                                                     allocator_context, 
-                                                                     allocate_function, 
-                                                                     free_function );
+void reliable_packet_window_advance( struct reliable_packet_window_t * window, 
+                                     struct reliable_sequence_buffer_t * sequence_buffer, 
+                                     reliable_packet_window_sample_function_t sample_function, 
+                                     uint16_t sequence )
+{
+    reliable_assert( window );
+    reliable_assert( sequence_buffer );
 
-    memset( endpoint->acks, 0, config->ack_buffer_size * sizeof( uint16_t ) );
+    // call before sequence is inserted into the buffer. if the buffer moves forward, so does its window, and the packets
+    // leaving the window must be sampled before the buffer forgets them
 
-    return endpoint;
-}
+    if ( !reliable_sequence_greater_than( sequence + 1, sequence_buffer->sequence ) )
+        return;
 
-void reliable_endpoint_destroy( struct reliable_endpoint_t * endpoint )
-{
-    reliable_assert( endpoint );
-    reliable_assert( endpoint->acks );
-    reliable_assert( endpoint->sent_packets );
-    reliable_assert( endpoint->received_packets );
+    const int num_entries = sequence_buffer->num_entries;
+    const int window_size = num_entries / 2;
+    const int advance = (uint16_t) ( sequence + 1 - sequence_buffer->sequence );
+    const uint16_t window_start = sequence_buffer->sequence - ( (uint16_t) num_entries );
 
-    int i;
-    for ( i = 0; i < endpoint->config.fragment_reassembly_buffer_size; ++i )
+    if ( advance < window_size )
     {
-        struct reliable_fragment_reassembly_data_t * reassembly_data = (struct reliable_fragment_reassembly_data_t*) 
-            reliable_sequence_buffer_at_index( endpoint->fragment_reassembly, i );
-
-        if ( reassembly_data && reassembly_data->packet_data )
+        int i;
+        for ( i = 0; i < advance; ++i )
         {
-            endpoint->free_function( endpoint->allocator_context, reassembly_data->packet_data );
-            reassembly_data->packet_data = NULL;
+            const uint16_t leaving_sequence = window_start + ( (uint16_t) i );
+            const int leaving_bytes = sample_function( sequence_buffer, leaving_sequence );
+            if ( leaving_bytes )
+            {
+                reliable_packet_window_remove_oldest( window, sequence_buffer, sample_function, leaving_sequence, leaving_bytes );
+            }
+
+            const uint16_t entering_sequence = window_start + ( (uint16_t) ( window_size + i ) );
+            const int entering_bytes = sample_function( sequence_buffer, entering_sequence );
+            if ( entering_bytes )
+            {
+                reliable_packet_window_add( window, entering_sequence, entering_bytes );
+            }
         }
     }
+    else
+    {
+        // the whole window moves past what it held. only the part of the new window the buffer still covers can have packets
 
-    endpoint->free_function( endpoint->allocator_context, endpoint->acks );
+        reliable_packet_window_reset( window );
 
-    reliable_sequence_buffer_destroy( endpoint->sent_packets );
-    reliable_sequence_buffer_destroy( endpoint->received_packets );
-    reliable_sequence_buffer_destroy( endpoint->fragment_reassembly );
+        const int num_remaining = ( advance < num_entries ) ? num_entries - advance : 0;
+        const int num_entering = ( num_remaining < window_size ) ? num_remaining : window_size;
 
-    endpoint->free_function( endpoint->allocator_context, endpoint );
+        int i;
+        for ( i = 0; i < num_entering; ++i )
+        {
+            const uint16_t entering_sequence = window_start + ( (uint16_t) ( advance + i ) );
+            const int entering_bytes = sample_function( sequence_buffer, entering_sequence );
+            if ( entering_bytes )
+            {
+                reliable_packet_window_add( window, entering_sequence, entering_bytes );
+            }
+        }
+    }
 }
 
-uint16_t reliable_endpoint_next_packet_sequence( struct reliable_endpoint_t * endpoint )
+float reliable_packet_window_kbps( struct reliable_packet_window_t * window, double start_time, double finish_time )
 {
-    reliable_assert( endpoint );
-    return endpoint->sequence;
+    reliable_assert( window );
+    return (float) ( ( (double) window->bytes ) / ( finish_time - start_time ) * 8.0f / 1000.0f );
 }
 
-int reliable_write_packet_header( uint8_t * packet_data, uint16_t sequence, uint16_t ack, uint32_t ack_bits )
+// ---------------------------------------------------------------
+
+void reliable_rtt_min_filter_reset( struct reliable_rtt_min_filter_t * filter, double time, float rtt )
 {
-    uint8_t * p = packet_data;
+    reliable_assert( filter );
+    filter->samples[0].time = time;
+    filter->samples[0].rtt = rtt;
+    filter->samples[1] = filter->samples[0];
+    filter->samples[2] = filter->samples[0];
+}
 
-    uint8_t prefix_byte = 0;
+float reliable_rtt_min_filter_update( struct reliable_rtt_min_filter_t * filter, double window, double time, float rtt )
+{
+    reliable_assert( filter );
 
-    if ( ( ack_bits & 0x000000FF ) != 0x000000FF )
-    {
-        prefix_byte |= (1<<1);
-    }
+    // the best sample, and the best ones to take over from it when it ages out of the window
 
-    if ( ( ack_bits & 0x0000FF00 ) != 0x0000FF00 )
+    struct reliable_rtt_min_sample_t sample;
+    sample.time = time;
+    sample.rtt = rtt;
+
+    if ( rtt <= filter->samples[0].rtt || time - filter->samples[2].time > window )
     {
-        prefix_byte |= (1<<2);
+        reliable_rtt_min_filter_reset( filter, time, rtt );
+        return rtt;
     }
 
-    if ( ( ack_bits & 0x00FF0000 ) != 0x00FF0000 )
+    if ( rtt <= filter->samples[1].rtt )
     {
-        prefix_byte |= (1<<3);
+        filter->samples[1] = sample;
+        filter->samples[2] = sample;
     }
-
-    if ( ( ack_bits & 0xFF000000 ) != 0xFF000000 )
+    else if ( rtt <= filter->samples[2].rtt )
     {
-        prefix_byte |= (1<<4);
+        filter->samples[2] = sample;
     }
 
-    int sequence_difference = sequence - ack;
-    if ( sequence_difference < 0 )
-        sequence_difference += 65536;
-    if ( sequence_difference <= 255 )
-        prefix_byte |= (1<<5);
-
-    reliable_write_uint8( &p, prefix_byte );
-
-    reliable_write_uint16( &p, sequence );
+    const double dt = time - filter->samples[0].time;
 
-    if ( sequence_difference <= 255 )
+    if ( dt > window )
     {
-        reliable_write_uint8( &p, (uint8_t) sequence_difference );
+        filter->samples[0] = filter->samples[1];
+        filter->samples[1] = filter->samples[2];
+        filter->samples[2] = sample;
+        if ( time - filter->samples[0].time > window )
+        {
+            filter->samples[0] = filter->samples[1];
+            filter->samples[1] = filter->samples[2];
+            filter->samples[2] = sample;
+        }
     }
-    else
+    else if ( filter->samples[1].time == filter->samples[0].time && dt > window / 4 )
     {
-        reliable_write_uint16( &p, ack );
+        filter->samples[1] = sample;
+        filter->samples[2] = sample;
     }
-
-    if ( ( ack_bits & 0x000000FF ) != 0x000000FF )
+    else if ( filter->samples[2].time == filter->samples[1].time && dt > window / 2 )
     {
-        reliable_write_uint8( &p, (uint8_t) ( ack_bits & 0x000000FF ) );
+        filter->samples[2] = sample;
     }
 
-    if ( ( ack_bits & 0x0000FF00 ) != 0x0000FF00 )
-    {
-        reliable_write_uint8( &p, (uint8_t) ( ( ack_bits & 0x0000FF00 ) >> 8 ) );
-    }
+    return filter->samples[0].rtt;
+}
 
-    if ( ( ack_bits & 0x00FF0000 ) != 0x00FF0000 )
-    {
-        reliable_write_uint8( &p, (uint8_t) ( ( ack_bits & 0x00FF0000 ) >> 16 ) );
-    }
+int reliable_rtt_histogram_bucket( float rtt )
+{
+    const int rtt_ms = (int) rtt;
 
-    if ( ( ack_bits & 0xFF000000 ) != 0xFF000000 )
+    if ( rtt_ms < RELIABLE_RTT_HISTOGRAM_LINEAR_BUCKETS )
+        return ( rtt_ms > 0 ) ? rtt_ms : 0;
+
+    int exponent = 4;
+    while ( exponent < 31 && ( rtt_ms >> ( exponent + 1 ) ) != 0 )
     {
-        reliable_write_uint8( &p, (uint8_t) ( ( ack_bits & 0xFF000000 ) >> 24 ) );
+        exponent++;
     }
 
-    reliable_assert( p - packet_data <= RELIABLE_MAX_PACKET_HEADER_BYTES );
+    const int bucket = RELIABLE_RTT_HISTOGRAM_LINEAR_BUCKETS + ( exponent - 4 ) * 8 + ( ( rtt_ms >> ( exponent - 3 ) ) & 7 );
 
-    return (int) ( p - packet_data );
+    return ( bucket < RELIABLE_RTT_HISTOGRAM_BUCKETS ) ? bucket : RELIABLE_RTT_HISTOGRAM_BUCKETS - 1;
 }
 
-void reliable_endpoint_send_packet( struct reliable_endpoint_t * endpoint, uint8_t * packet_data, int packet_bytes )
+float reliable_rtt_histogram_bucket_rtt( int bucket )
 {
-    reliable_assert( endpoint );
-    reliable_assert( packet_data );
-    reliable_assert( packet_bytes > 0 );
+    reliable_assert( bucket >= 0 );
+    reliable_assert( bucket < RELIABLE_RTT_HISTOGRAM_BUCKETS );
 
-    if ( packet_bytes > endpoint->config.max_packet_size )
-    {
-        reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] packet too large to send. packet is %d bytes, maximum is %d\n", 
-            endpoint->config.name, packet_bytes, endpoint->config.max_packet_size );
-        endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_TOO_LARGE_TO_SEND]++;
-        return;
-    }
+    // the middle of the range of rtt that lands in the bucket
 
-    uint16_t sequence = endpoint->sequence++;
-    uint16_t ack;
-    uint32_t ack_bits;
+    if ( bucket < RELIABLE_RTT_HISTOGRAM_LINEAR_BUCKETS )
+        return bucket + 0.5f;
 
-    reliable_sequence_buffer_generate_ack_bits( endpoint->received_packets, &ack, &ack_bits );
+    const int exponent = 4 + ( bucket - RELIABLE_RTT_HISTOGRAM_LINEAR_BUCKETS ) / 8;
+    const int mantissa = 8 + ( bucket - RELIABLE_RTT_HISTOGRAM_LINEAR_BUCKETS ) % 8;
+    const int bucket_size = 1 << ( exponent - 3 );
 
-    reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] sending packet %d\n", endpoint->config.name, sequence );
+    return (float) ( mantissa * bucket_size ) + bucket_size * 0.5f;
+}
 
-    struct reliable_sent_packet_data_t * sent_packet_data = (struct reliable_sent_packet_data_t*) reliable_sequence_buffer_insert( endpoint->sent_packets, sequence );
+float reliable_rtt_histogram_percentile( const uint32_t * histogram, int num_samples, float percentile )
+{
+    reliable_assert( histogram );
 
-    reliable_assert( sent_packet_data );
+    if ( num_samples == 0 )
+        return 0.0f;
 
-    sent_packet_data->time = endpoint->time;
-    sent_packet_data->packet_bytes = endpoint->config.packet_header_size + packet_bytes;
-    sent_packet_data->acked = 0;
+    const uint32_t target = (uint32_t) ceil( num_samples * percentile );
 
-    if ( packet_bytes <= endpoint->config.fragment_above )
+    uint32_t count = 0;
+    int i;
+    for ( i = 0; i < RELIABLE_RTT_HISTOGRAM_BUCKETS; ++i )
     {
-        // regular packet
-
-        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] sending packet %d without fragmentation\n", endpoint->config.name, sequence );
-
-        uint8_t * transmit_packet_data = (uint8_t*) endpoint->allocate_function( endpoint->allocator_context, packet_bytes + RELIABLE_MAX_PACKET_HEADER_BYTES );
+        count += histogram[i];
+        if ( count >= target && count > 0 )
+        {
+            return reliable_rtt_histogram_bucket_rtt( i );
+        }
+    }
 
-        int packet_header_bytes = reliable_write_packet_header( transmit_packet_data, sequence, ack, ack_bits );
+    return reliable_rtt_histogram_bucket_rtt( RELIABLE_RTT_HISTOGRAM_BUCKETS - 1 );
+}
 
-        memcpy( transmit_packet_data + packet_header_bytes, packet_data, packet_bytes );
+void reliable_endpoint_rtt_sample( struct reliable_endpoint_t * endpoint, float rtt )
+{
+    reliable_assert( endpoint );
+    reliable_assert( rtt >= 0.0f );
 
-        endpoint->config.transmit_packet_function( endpoint->config.context, endpoint->config.id, sequence, transmit_packet_data, packet_header_bytes + packet_bytes );
+    // smoothed rtt and rtt variation as in RFC 6298, with alpha = 1/8 and beta = 1/4
 
-        endpoint->free_function( endpoint->allocator_context, transmit_packet_data );
+    if ( endpoint->rtt_histogram_samples == 0 )
+    {
+        endpoint->rtt_smoothed = rtt;
+        endpoint->rtt_variance = rtt * 0.5f;
+        reliable_rtt_min_filter_reset( &endpoint->rtt_min_filter, endpoint->time, rtt );
     }
     else
     {
-        // fragmented packet
+        endpoint->rtt_variance += ( (float) fabs( endpoint->rtt_smoothed - rtt ) - endpoint->rtt_variance ) * 0.25f;
+        endpoint->rtt_smoothed += ( rtt - endpoint->rtt_smoothed ) * 0.125f;
+        reliable_rtt_min_filter_update( &endpoint->rtt_min_filter, endpoint->config.rtt_min_window_seconds, endpoint->time, rtt );
+    }
 
-        uint8_t packet_header[RELIABLE_MAX_PACKET_HEADER_BYTES];
+    if ( endpoint->rtt_histogram_samples >= RELIABLE_RTT_HISTOGRAM_MAX_SAMPLES )
+    {
+        endpoint->rtt_histogram_samples = 0;
+        int i;
+        for ( i = 0; i < RELIABLE_RTT_HISTOGRAM_BUCKETS; ++i )
+        {
+            endpoint->rtt_histogram[i] >>= 1;
+            endpoint->rtt_histogram_samples += endpoint->rtt_histogram[i];
+        }
+    }
 
-        memset( packet_header, 0, RELIABLE_MAX_PACKET_HEADER_BYTES );
+    endpoint->rtt_histogram[reliable_rtt_histogram_bucket( rtt )]++;
+    endpoint->rtt_histogram_samples++;
 
-        int packet_header_bytes = reliable_write_packet_header( packet_header, sequence, ack, ack_bits );        
-
-        int num_fragments = ( packet_bytes / endpoint->config.fragment_size ) + ( ( packet_bytes % endpoint->config.fragment_size ) != 0 ? 1 : 0 );
-
-        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] sending packet %d as %d fragments\n", endpoint->config.name, sequence, num_fragments );
-
-        reliable_assert( num_fragments >= 1 );
-        reliable_assert( num_fragments <= endpoint->config.max_fragments );
-
-        int fragment_buffer_size = RELIABLE_FRAGMENT_HEADER_BYTES + RELIABLE_MAX_PACKET_HEADER_BYTES + endpoint->config.fragment_size;
-
-        uint8_t * fragment_packet_data = (uint8_t*) endpoint->allocate_function( endpoint->allocator_context, fragment_buffer_size );
-
-        uint8_t * q = packet_data;
-
-        uint8_t * end = q + packet_bytes;
-
-        int fragment_id;
-        for ( fragment_id = 0; fragment_id < num_fragments; ++fragment_id )
+    if ( endpoint->config.congestion_control )
+    {
+        const float queue_delay = rtt - endpoint->rtt_min_filter.samples[0].rtt;
+        if ( queue_delay < endpoint->congestion_queue_delay )
         {
-            uint8_t * p = fragment_packet_data;
+            endpoint->congestion_queue_delay = queue_delay;
+        }
+        endpoint->congestion_num_rtt_samples++;
+    }
+}
 
-            reliable_write_uint8( &p, 1 );
-            reliable_write_uint16( &p, sequence );
-            reliable_write_uint8( &p, (uint8_t) fragment_id );
-            reliable_write_uint8( &p, (uint8_t) ( num_fragments - 1 ) );
+// ---------------------------------------------------------------
 
-            if ( fragment_id == 0 )
-            {
-                memcpy( p, packet_header, packet_header_bytes );
-                p += packet_header_bytes;
-            }
+void reliable_endpoint_reset_congestion( struct reliable_endpoint_t * endpoint )
+{
+    reliable_assert( endpoint );
+    endpoint->congestion_rate = endpoint->config.congestion_initial_bandwidth_kbps * 1000.0 / 8.0;
+    endpoint->congestion_budget = endpoint->config.max_packet_size + endpoint->config.packet_header_size;
+    endpoint->congestion_update_time = endpoint->time;
+    endpoint->congestion_update_interval = 0.0;
+    endpoint->congestion_adjust_time = endpoint->time;
+    endpoint->congestion_slow_start = 1;
+    endpoint->congestion_loss_sequence = endpoint->sequence - 1;
+    endpoint->congestion_num_lost = 0;
+    endpoint->congestion_num_rtt_samples = 0;
+    endpoint->congestion_queue_delay = FLT_MAX;
+    endpoint->congestion_acked_bytes = 0;
+}
 
-            int bytes_to_copy = endpoint->config.fragment_size;
-            if ( q + bytes_to_copy > end )
-            {
-                bytes_to_copy = (int) ( end - q );
-            }
+void reliable_endpoint_detect_losses( struct reliable_endpoint_t * endpoint, uint16_t ack )
+{
+    reliable_assert( endpoint );
 
-            memcpy( p, q, bytes_to_copy );
+    // by the time a packet is acked, sent packets a few older than it that are still not acked were lost. acks for
+    // them would have come in with the same ack bits, unless they were reordered on the way
 
-            p += bytes_to_copy;
-            q += bytes_to_copy;
+    const uint16_t lost_sequence = ack - RELIABLE_CONGESTION_LOSS_REORDERING;
 
-            int fragment_packet_bytes = (int) ( p - fragment_packet_data );
+    if ( !reliable_sequence_greater_than( lost_sequence, endpoint->congestion_loss_sequence ) )
+        return;
 
-            endpoint->config.transmit_packet_function( endpoint->config.context, endpoint->config.id, sequence, fragment_packet_data, fragment_packet_bytes );
+    int num_sequences = (uint16_t) ( lost_sequence - endpoint->congestion_loss_sequence );
+    if ( num_sequences > endpoint->sent_packets->num_entries )
+    {
+        num_sequences = endpoint->sent_packets->num_entries;
+    }
 
-            endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_SENT]++;
+    int i;
+    for ( i = 0; i < num_sequences; ++i )
+    {
+        const uint16_t sequence = lost_sequence - ( (uint16_t) i );
+        struct reliable_sent_packet_data_t * sent_packet_data = (struct reliable_sent_packet_data_t*) reliable_sequence_buffer_find( endpoint->sent_packets, sequence );
+        if ( sent_packet_data && !sent_packet_data->acked )
+        {
+            endpoint->congestion_num_lost++;
         }
-
-        endpoint->free_function( endpoint->allocator_context, fragment_packet_data );
     }
 
-    endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_SENT]++;
+    endpoint->congestion_loss_sequence = lost_sequence;
 }
 
-int reliable_read_packet_header( RELIABLE_CONST char * name, uint8_t * packet_data, int packet_bytes, uint16_t * sequence, uint16_t * ack, uint32_t * ack_bits )
+void reliable_endpoint_adjust_congestion_rate( struct reliable_endpoint_t * endpoint )
 {
-    if ( packet_bytes < 3 )
-    {
-        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] packet too small for packet header (1)\n", name );
-        return -1;
-    }
-
-    uint8_t * p = packet_data;
+    reliable_assert( endpoint );
 
-    uint8_t prefix_byte = reliable_read_uint8( &p );
+    const double interval = endpoint->time - endpoint->congestion_adjust_time;
+    const double target_delay = endpoint->config.congestion_target_delay;
+    const double queue_delay = endpoint->congestion_queue_delay;
+    const int has_rtt_samples = endpoint->congestion_num_rtt_samples > 0;
 
-    if ( ( prefix_byte & 1 ) != 0 )
+    if ( endpoint->congestion_num_lost > 0 )
     {
-        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] prefix byte does not indicate a regular packet\n", name );
-        return -1;
+        endpoint->congestion_rate *= RELIABLE_CONGESTION_LOSS_DECREASE;
+        endpoint->congestion_slow_start = 0;
     }
-
-    *sequence = reliable_read_uint16( &p );
-
-    if ( prefix_byte & (1<<5) )
+    else if ( has_rtt_samples && queue_delay > target_delay )
     {
-        if ( packet_bytes < 3 + 1 )
+        double overshoot = ( queue_delay - target_delay ) / target_delay;
+        if ( overshoot > 1.0 )
         {
-            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] packet too small for packet header (2)\n", name );
-            return -1;
+            overshoot = 1.0;
         }
-        uint8_t sequence_difference = reliable_read_uint8( &p );
-        *ack = *sequence - sequence_difference;
+        endpoint->congestion_rate *= 1.0 - RELIABLE_CONGESTION_MAX_DELAY_DECREASE * overshoot;
+        endpoint->congestion_slow_start = 0;
     }
-    else
+    else if ( has_rtt_samples && endpoint->congestion_acked_bytes >= endpoint->congestion_rate * interval * 0.5 )
     {
-        if ( packet_bytes < 3 + 2 )
+        // only grow the rate while the sender is using it. otherwise nothing says the link can take more
+
+        if ( endpoint->congestion_slow_start )
         {
-            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] packet too small for packet header (3)\n", name );
-            return -1;
+            endpoint->congestion_rate *= 2.0;
         }
-        *ack = reliable_read_uint16( &p );
-    }
-
-    int expected_bytes = 0;
-    int i;
-    for ( i = 1; i <= 4; ++i )
-    {
-        if ( prefix_byte & (1<<i) )
+        else
         {
-            expected_bytes++;
+            const double off_target = ( target_delay - queue_delay ) / target_delay;
+            const double rtt_seconds = endpoint->rtt_smoothed * 0.001;
+            endpoint->congestion_rate += off_target * endpoint->config.fragment_size / rtt_seconds;
         }
     }
-    if ( packet_bytes < ( p - packet_data ) + expected_bytes )
-    {
-        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] packet too small for packet header (4)\n", name );
-        return -1;
-    }
-
-    *ack_bits = 0xFFFFFFFF;
-
-    if ( prefix_byte & (1<<1) )
-    {
-        *ack_bits &= 0xFFFFFF00;
-        *ack_bits |= (uint32_t) ( reliable_read_uint8( &p ) );
-    }
 
-    if ( prefix_byte & (1<<2) )
-    {
-        *ack_bits &= 0xFFFF00FF;
-        *ack_bits |= (uint32_t) ( reliable_read_uint8( &p ) ) << 8;
-    }
+    const double min_rate = endpoint->config.congestion_min_bandwidth_kbps * 1000.0 / 8.0;
+    const double max_rate = endpoint->config.congestion_max_bandwidth_kbps * 1000.0 / 8.0;
 
-    if ( prefix_byte & (1<<3) )
+    if ( endpoint->congestion_rate < min_rate )
     {
-        *ack_bits &= 0xFF00FFFF;
-        *ack_bits |= (uint32_t) ( reliable_read_uint8( &p ) ) << 16;
+        endpoint->congestion_rate = min_rate;
     }
 
-    if ( prefix_byte & (1<<4) )
+    if ( endpoint->congestion_rate > max_rate )
     {
-        *ack_bits &= 0x00FFFFFF;
-        *ack_bits |= (uint32_t) ( reliable_read_uint8( &p ) ) << 24;
+        endpoint->congestion_rate = max_rate;
     }
 
-    return (int) ( p - packet_data );
+    endpoint->congestion_adjust_time = endpoint->time;
+    endpoint->congestion_num_lost = 0;
+    endpoint->congestion_num_rtt_samples = 0;
+    endpoint->congestion_queue_delay = FLT_MAX;
+    endpoint->congestion_acked_bytes = 0;
 }
 
-int reliable_read_fragment_header( char * name, 
-                                   uint8_t * packet_data, 
-                                   int packet_bytes, 
-                                   int max_fragments, 
-                                   int fragment_size, 
-                                   int * fragment_id, 
-                                   int * num_fragments, 
-                                   int * fragment_bytes, 
-                                   uint16_t * sequence, 
-                                   uint16_t * ack, 
-                                   uint32_t * ack_bits )
+void reliable_endpoint_send_paced_fragments( struct reliable_endpoint_t * endpoint, int flush )
 {
-    if ( packet_bytes < RELIABLE_FRAGMENT_HEADER_BYTES )
-    {
-        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] packet is too small to read fragment header\n", name );
-        return -1;
-    }
+    reliable_assert( endpoint );
 
-    uint8_t * p = packet_data;
+    if ( !endpoint->paced_fragment_data )
+        return;
 
-    uint8_t prefix_byte = reliable_read_uint8( &p );
-    if ( prefix_byte != 1 )
-    {
-        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] prefix byte is not a fragment\n", name );
-        return -1;
-    }
-    
-    *sequence = reliable_read_uint16( &p );
-    *fragment_id = (int) reliable_read_uint8( &p );
-    *num_fragments = ( (int) reliable_read_uint8( &p ) ) + 1;
+    // updates are the only chance to send, so fragments due before the next one go out now
 
-    if ( *num_fragments > max_fragments )
-    {
-        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] num fragments %d outside of range of max fragments %d\n", name, *num_fragments, max_fragments );
-        return -1;
-    }
+    const double send_time = endpoint->time + endpoint->congestion_update_interval;
+    const double pacing_rate = endpoint->congestion_rate * RELIABLE_CONGESTION_PACING_GAIN;
+    const int fragment_buffer_size = RELIABLE_FRAGMENT_HEADER_BYTES + RELIABLE_MAX_PACKET_HEADER_BYTES + endpoint->config.fragment_size;
 
-    if ( *fragment_id >= *num_fragments )
+    if ( endpoint->paced_fragment_time < endpoint->time )
     {
-        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] fragment id %d outside of range of num fragments %d\n", name, *fragment_id, *num_fragments );
-        return -1;
+        endpoint->paced_fragment_time = endpoint->time;
     }
 
-    *fragment_bytes = packet_bytes - RELIABLE_FRAGMENT_HEADER_BYTES;
+    uint8_t * fragment_data[256];
+    int fragment_bytes[256];
+    int num_fragments = 0;
 
-    uint16_t packet_sequence = 0;
-    uint16_t packet_ack = 0;
-    uint32_t packet_ack_bits = 0;
+    while ( endpoint->next_paced_fragment < endpoint->num_paced_fragments && ( flush || endpoint->paced_fragment_time <= send_time ) )
+    {
+        fragment_data[num_fragments] = endpoint->paced_fragment_data + fragment_buffer_size * endpoint->next_paced_fragment;
+        fragment_bytes[num_fragments] = endpoint->paced_fragment_bytes[endpoint->next_paced_fragment];
+        endpoint->paced_fragment_time += ( endpoint->config.packet_header_size + fragment_bytes[num_fragments] ) / pacing_rate;
+        endpoint->next_paced_fragment++;
+        num_fragments++;
+    }
 
-    if ( *fragment_id == 0 )
+    if ( num_fragments > 0 )
     {
-        int packet_header_bytes = reliable_read_packet_header( name, 
-                                                               packet_data + RELIABLE_FRAGMENT_HEADER_BYTES, 
-                                                               packet_bytes, 
-                                                               &packet_sequence, 
-                                                               &packet_ack, 
-                                                               &packet_ack_bits );
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] sending %d paced fragments of packet %d\n", endpoint->config.name, num_fragments, endpoint->paced_sequence );
 
-        if ( packet_header_bytes < 0 )
+        if ( endpoint->config.transmit_packets_function )
         {
-            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] bad packet header in fragment\n", name );
-            return -1;
+            endpoint->config.transmit_packets_function( endpoint->config.context, endpoint->config.id, endpoint->paced_sequence, fragment_data, fragment_bytes, num_fragments );
         }
-
-        if ( packet_sequence != *sequence )
+        else
         {
-            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] bad packet sequence in fragment. expected %d, got %d\n", name, *sequence, packet_sequence );
-            return -1;
+            int i;
+            for ( i = 0; i < num_fragments; ++i )
+            {
+                endpoint->config.transmit_packet_function( endpoint->config.context, endpoint->config.id, endpoint->paced_sequence, fragment_data[i], fragment_bytes[i] );
+            }
         }
+    }
 
-        *fragment_bytes = packet_bytes - packet_header_bytes - RELIABLE_FRAGMENT_HEADER_BYTES;
+    if ( endpoint->next_paced_fragment == endpoint->num_paced_fragments )
+    {
+        endpoint->free_function( endpoint->allocator_context, endpoint->paced_fragment_data );
+        endpoint->paced_fragment_data = NULL;
+        endpoint->num_paced_fragments = 0;
+        endpoint->next_paced_fragment = 0;
     }
+}
 
-    *ack = packet_ack;
-    *ack_bits = packet_ack_bits;
+void reliable_endpoint_update_congestion( struct reliable_endpoint_t * endpoint )
+{
+    reliable_assert( endpoint );
 
-    if ( *fragment_bytes > fragment_size )
+    const double dt = endpoint->time - endpoint->congestion_update_time;
+    endpoint->congestion_update_time = endpoint->time;
+    if ( dt > 0.0 )
     {
-        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] fragment bytes %d > fragment size %d\n", name, *fragment_bytes, fragment_size );
-        return - 1;
+        endpoint->congestion_update_interval = dt;
     }
 
-    if ( *fragment_id != *num_fragments - 1 && *fragment_bytes != fragment_size )
+    const double adjust_interval = ( endpoint->rtt_smoothed > 0.0f ) ? endpoint->rtt_smoothed * 0.001 : 0.1;
+    if ( endpoint->time - endpoint->congestion_adjust_time >= adjust_interval )
     {
-        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] fragment %d is %d bytes, which is not the expected fragment size %d\n", 
-            name, *fragment_id, *fragment_bytes, fragment_size );
-        return -1;
+        reliable_endpoint_adjust_congestion_rate( endpoint );
     }
 
-    return (int) ( p - packet_data );
-}
+    // the budget fills at the congestion controlled rate. it can save up a short burst, or one packet of the largest size
 
-void reliable_store_fragment_data( struct reliable_fragment_reassembly_data_t * reassembly_data, 
-                                   uint16_t sequence, 
-                                   uint16_t ack, 
-                                   uint32_t ack_bits, 
-                                   int fragment_id, 
-                                   int fragment_size, 
-                                   uint8_t * fragment_data, 
-                                   int fragment_bytes )
-{
-    if ( fragment_id == 0 )
+    double max_budget = endpoint->congestion_rate * RELIABLE_CONGESTION_MAX_BURST_SECONDS;
+    if ( max_budget < endpoint->config.max_packet_size + endpoint->config.packet_header_size )
     {
-        uint8_t packet_header[RELIABLE_MAX_PACKET_HEADER_BYTES];
-
-        memset( packet_header, 0, RELIABLE_MAX_PACKET_HEADER_BYTES );
-
-        reassembly_data->packet_header_bytes = reliable_write_packet_header( packet_header, sequence, ack, ack_bits );
+        max_budget = endpoint->config.max_packet_size + endpoint->config.packet_header_size;
+    }
 
-        memcpy( reassembly_data->packet_data + RELIABLE_MAX_PACKET_HEADER_BYTES - reassembly_data->packet_header_bytes, 
-                packet_header, 
-                reassembly_data->packet_header_bytes );
+    endpoint->congestion_budget += endpoint->congestion_rate * dt;
 
-        fragment_data += reassembly_data->packet_header_bytes;
-        fragment_bytes -= reassembly_data->packet_header_bytes;
+    if ( endpoint->congestion_budget > max_budget )
+    {
+        endpoint->congestion_budget = max_budget;
     }
 
-    if ( fragment_id == reassembly_data->num_fragments_total - 1 )
+    if ( endpoint->congestion_budget < -max_budget )
     {
-        reassembly_data->packet_bytes = ( reassembly_data->num_fragments_total - 1 ) * fragment_size + fragment_bytes;
+        endpoint->congestion_budget = -max_budget;
     }
 
-    memcpy( reassembly_data->packet_data + RELIABLE_MAX_PACKET_HEADER_BYTES + fragment_id * fragment_size, fragment_data, fragment_bytes );
+    reliable_endpoint_send_paced_fragments( endpoint, 0 );
 }
 
-void reliable_endpoint_receive_packet( struct reliable_endpoint_t * endpoint, uint8_t * packet_data, int packet_bytes )
+// ---------------------------------------------------------------
+
+void reliable_endpoint_advance_received_ack( struct reliable_endpoint_t * endpoint, uint16_t sequence )
 {
     reliable_assert( endpoint );
-    reliable_assert( packet_data );
-    reliable_assert( packet_bytes > 0 );
 
-    if ( packet_bytes > endpoint->config.max_packet_size + RELIABLE_MAX_PACKET_HEADER_BYTES + RELIABLE_FRAGMENT_HEADER_BYTES )
-    {
-        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] packet too large to receive. packet is at least %d bytes, maximum is %d\n",
-            endpoint->config.name, packet_bytes - ( RELIABLE_MAX_PACKET_HEADER_BYTES + RELIABLE_FRAGMENT_HEADER_BYTES ), endpoint->config.max_packet_size );
-        endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_TOO_LARGE_TO_RECEIVE]++;
+    // the ack and ack bits sent with each packet follow the received packets buffer. moving it forward moves the ack
+    // and shifts the bits along with it, so they never need to be rebuilt from the buffer when a packet is sent
+
+    if ( !reliable_sequence_greater_than( sequence, endpoint->received_ack ) )
         return;
-    }
 
-    uint8_t prefix_byte = packet_data[0];
+    reliable_ack_bits_shift( endpoint->received_ack_bits, (uint16_t) ( sequence - endpoint->received_ack ) );
+    endpoint->received_ack = sequence;
+}
 
-    if ( ( prefix_byte & 1 ) == 0 )
+void reliable_endpoint_mark_received_ack( struct reliable_endpoint_t * endpoint, uint16_t sequence )
+{
+    reliable_assert( endpoint );
+    const int offset = (uint16_t) ( endpoint->received_ack - sequence );
+    if ( offset < RELIABLE_MAX_ACK_BITS )
     {
-        // regular packet
-
-        endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_RECEIVED]++;
-
-        uint16_t sequence;
-        uint16_t ack;
-        uint32_t ack_bits;
-
-        int packet_header_bytes = reliable_read_packet_header( endpoint->config.name, packet_data, packet_bytes, &sequence, &ack, &ack_bits );
-        if ( packet_header_bytes < 0 )
-        {
-            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] ignoring invalid packet. could not read packet header\n", endpoint->config.name );
-            endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_INVALID]++;
-            return;
-        }
-
-        reliable_assert( packet_header_bytes <= packet_bytes );
+        endpoint->received_ack_bits[offset>>5] |= 1U << ( offset & 31 );
+    }
+}
 
-        int packet_payload_bytes = packet_bytes - packet_header_bytes;
+void reliable_default_config( struct reliable_config_t * config )
+{
+    reliable_assert( config );
+    memset( config, 0, sizeof( struct reliable_config_t ) );
+    config->name[0] = 'e';
+    config->name[1] = 'n';
+    config->name[2] = 'd';
+    config->name[3] = 'p';
+    config->name[4] = 'o';
+    config->name[5] = 'i';
+    config->name[6] = 'n';
+    config->name[7] = 't';
+    config->name[8] = '\0';
+    config->max_packet_size = 16 * 1024;
+    config->fragment_above = 1024;
+    config->max_fragments = 16;
+    config->fragment_size = 1024;
+    config->ack_buffer_size = 256;
+    config->sent_packets_buffer_size = 256;
+    config->received_packets_buffer_size = 256;
+    config->fragment_reassembly_buffer_size = 64;
+    config->rtt_smoothing_factor = 0.0025f;
+    config->rtt_min_window_seconds = 10.0f;
+    config->congestion_control = 0;
+    config->congestion_target_delay = 25.0f;
+    config->congestion_min_bandwidth_kbps = 64.0f;
+    config->congestion_initial_bandwidth_kbps = 512.0f;
+    config->congestion_max_bandwidth_kbps = 100000.0f;
+    config->packet_loss_smoothing_factor = 0.1f;
+    config->bandwidth_smoothing_factor = 0.1f;
+    config->packet_header_size = 28;        // note: UDP over IPv4 = 20 + 8 bytes, UDP over IPv6 = 40 + 8 bytes
+    config->num_ack_bits = 32;
+}
 
-        if ( packet_payload_bytes > endpoint->config.max_packet_size )
-        {
-            reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] packet too large to receive. packet is at %d bytes, maximum is %d\n",
-                endpoint->config.name, packet_payload_bytes, endpoint->config.max_packet_size );
-            endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_TOO_LARGE_TO_RECEIVE]++;
-            return;
-        }
+struct reliable_endpoint_t * reliable_endpoint_create( struct reliable_config_t * config, double time )
+{
+    reliable_assert( config );
+    reliable_assert( config->max_packet_size > 0 );
+    reliable_assert( config->fragment_above > 0 );
+    reliable_assert( config->max_fragments > 0 );
+    reliable_assert( config->max_fragments <= 256 );
+    reliable_assert( config->fragment_size > 0 );
+    reliable_assert( config->ack_buffer_size > 0 );
+    reliable_assert( config->sent_packets_buffer_size > 0 );
+    reliable_assert( config->received_packets_buffer_size > 0 );
+    reliable_assert( config->num_ack_bits == 32 || config->num_ack_bits == 64 || config->num_ack_bits == RELIABLE_MAX_ACK_BITS );
+    reliable_assert( !config->congestion_control || config->congestion_target_delay > 0.0f );
+    reliable_assert( !config->congestion_control || config->congestion_min_bandwidth_kbps > 0.0f );
+    reliable_assert( !config->congestion_control || config->congestion_initial_bandwidth_kbps >= config->congestion_min_bandwidth_kbps );
+    reliable_assert( !config->congestion_control || config->congestion_max_bandwidth_kbps >= config->congestion_initial_bandwidth_kbps );
+    reliable_assert( config->transmit_packet_function != NULL );
+    reliable_assert( config->process_packet_function != NULL );
 
-        if ( !reliable_sequence_buffer_test_insert( endpoint->received_packets, sequence ) )
-        {
-            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] ignoring stale packet %d\n", endpoint->config.name, sequence );
-            endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_STALE]++;
-            return;
-        }
+    void * allocator_context = config->allocator_context;
+    void * (*allocate_function)(void*,size_t) = config->allocate_function;
+    void (*free_function)(void*,void*) = config->free_function;
 
-        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] processing packet %d\n", endpoint->config.name, sequence );
+    if ( allocate_function == NULL )
+    {
+        allocate_function = reliable_default_allocate_function;
+    }
 
-        if ( endpoint->config.process_packet_function( endpoint->config.context, 
-                                                       endpoint->config.id, 
-                                                       sequence, 
-                                                       packet_data + packet_header_bytes, 
-                                                       packet_bytes - packet_header_bytes ) )
-        {
-            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] process packet %d successful\n", endpoint->config.name, sequence );
+    if ( free_function == NULL )
+    {
+        free_function = reliable_default_free_function;
+    }
 
-            struct reliable_received_packet_data_t * received_packet_data = (struct reliable_received_packet_data_t*) 
-                reliable_sequence_buffer_insert( endpoint->received_packets, sequence );
+    struct reliable_endpoint_t * endpoint = (struct reliable_endpoint_t*) allocate_function( allocator_context, sizeof( struct reliable_endpoint_t ) );
 
-            reliable_sequence_buffer_advance_with_cleanup( endpoint->fragment_reassembly, sequence, reliable_fragment_reassembly_data_cleanup );
+    reliable_assert( endpoint );
 
-            reliable_assert( received_packet_data );
+    memset( endpoint, 0, sizeof( struct reliable_endpoint_t ) );
 
-            received_packet_data->time = endpoint->time;
-            received_packet_data->packet_bytes = endpoint->config.packet_header_size + packet_bytes;
+    endpoint->allocator_context = allocator_context;
+    endpoint->allocate_function = allocate_function;
+    endpoint->free_function = free_function;
+    endpoint->config = *config;
+    endpoint->time = time;
 
-            int i;
-            for ( i = 0; i < 32; ++i )
-            {
-                if ( ack_bits & 1 )
-                {                    
-                    uint16_t ack_sequence = ack - ((uint16_t)i);
-                    
-                    struct reliable_sent_packet_data_t * sent_packet_data = (struct reliable_sent_packet_data_t*) 
-                        reliable_sequence_buffer_find( endpoint->sent_packets, ack_sequence );
+    endpoint->acks = (uint16_t*) allocate_function( allocator_context, config->ack_buffer_size * sizeof( uint16_t ) );
+    
+    endpoint->sent_packets = reliable_sequence_buffer_create( config->sent_packets_buffer_size, 
+                                                              sizeof( struct reliable_sent_packet_data_t ), 
+                                                              allocator_context, 
+                                                              allocate_function, 
+                                                              free_function );
 
-                    if ( sent_packet_data && !sent_packet_data->acked && endpoint->num_acks < endpoint->config.ack_buffer_size )
-                    {
-                        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] acked packet %d\n", endpoint->config.name, ack_sequence );
-                        endpoint->acks[endpoint->num_acks++] = ack_sequence;
-                        endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_ACKED]++;
-                        sent_packet_data->acked = 1;
+    endpoint->received_packets = reliable_sequence_buffer_create( config->received_packets_buffer_size, 
+                                                                  sizeof( struct reliable_received_packet_data_t ), 
+                                                                  allocator_context, 
+                                                                  allocate_function, 
+                                                                  free_function );
+    
+    endpoint->fragment_reassembly = reliable_sequence_buffer_create( config->fragment_reassembly_buffer_size, 
+                                                                     sizeof( struct reliable_fragment_reassembly_data_t ), 
+                                                                     allocator_context, 
+                                                                     allocate_function, 
+                                                                     free_function );
 
-                        float rtt = (float) ( endpoint->time - sent_packet_data->time ) * 1000.0f;
-                        reliable_assert( rtt >= 0.0 );
-                        if ( ( endpoint->rtt == 0.0f && rtt > 0.0f ) || fabs( endpoint->rtt - rtt ) < 0.00001 )
-                        {
-                            endpoint->rtt = rtt;
-                        }
-                        else
-                        {
-                            endpoint->rtt += ( rtt - endpoint->rtt ) * endpoint->config.rtt_smoothing_factor;
-                        }
-                    }
-                }
-                ack_bits >>= 1;
-            }
-        }
-        else
-        {
-            reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] process packet failed\n", endpoint->config.name );
-        }
-    }
-    else
-    {
-        // fragment packet
+    memset( endpoint->acks, 0, config->ack_buffer_size * sizeof( uint16_t ) );
 
-        int fragment_id;
-        int num_fragments;
-        int fragment_bytes;
+    endpoint->received_ack = 0xFFFF;
 
-        uint16_t sequence;
-        uint16_t ack;
-        uint32_t ack_bits;
+    reliable_endpoint_reset_congestion( endpoint );
 
-        int fragment_header_bytes = reliable_read_fragment_header( endpoint->config.name, 
-                                                                   packet_data, 
-                                                                   packet_bytes, 
-                                                                   endpoint->config.max_fragments, 
-                                                                   endpoint->config.fragment_size,
-                                                                   &fragment_id, 
-                                                                   &num_fragments, 
-                                                                   &fragment_bytes, 
-                                                                   &sequence, 
-                                                                   &ack, 
-                                                                   &ack_bits );
+    return endpoint;
+}
 
-        if ( fragment_header_bytes < 0 )
-        {
-            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] ignoring invalid fragment. could not read fragment header\n", endpoint->config.name );
-            endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID]++;
-            return;
-        }
+void reliable_endpoint_destroy( struct reliable_endpoint_t * endpoint )
+{
+    reliable_assert( endpoint );
+    reliable_assert( endpoint->acks );
+    reliable_assert( endpoint->sent_packets );
+    reliable_assert( endpoint->received_packets );
 
+    int i;
+    for ( i = 0; i < endpoint->config.fragment_reassembly_buffer_size; ++i )
+    {
         struct reliable_fragment_reassembly_data_t * reassembly_data = (struct reliable_fragment_reassembly_data_t*) 
-            reliable_sequence_buffer_find( endpoint->fragment_reassembly, sequence );
-
-        if ( !reassembly_data )
-        {
-            reassembly_data = (struct reliable_fragment_reassembly_data_t*) 
-                reliable_sequence_buffer_insert_with_cleanup( endpoint->fragment_reassembly, sequence, reliable_fragment_reassembly_data_cleanup );
-
-            if ( !reassembly_data )
-            {
-                reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] ignoring invalid fragment. could not insert in reassembly buffer (stale)\n", endpoint->config.name );
-                endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID]++;
-                return;
-            }
-
-            reliable_sequence_buffer_advance( endpoint->received_packets, sequence );
-
-            int packet_buffer_size = RELIABLE_MAX_PACKET_HEADER_BYTES + num_fragments * endpoint->config.fragment_size;
-
-            reassembly_data->sequence = sequence;
-            reassembly_data->ack = 0;
-            reassembly_data->ack_bits = 0;
-            reassembly_data->num_fragments_received = 0;
-            reassembly_data->num_fragments_total = num_fragments;
-            reassembly_data->packet_data = (uint8_t*) endpoint->allocate_function( endpoint->allocator_context, packet_buffer_size );
-            reassembly_data->packet_bytes = 0;
-            memset( reassembly_data->fragment_received, 0, sizeof( reassembly_data->fragment_received ) );
-        }
-
-        if ( num_fragments != (int) reassembly_data->num_fragments_total )
-        {
-            reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] ignoring invalid fragment. fragment count mismatch. expected %d, got %d\n", 
-                endpoint->config.name, (int) reassembly_data->num_fragments_total, num_fragments );
-            endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID]++;
-            return;
-        }
+            reliable_sequence_buffer_at_index( endpoint->fragment_reassembly, i );
 
-        if ( reassembly_data->fragment_received[fragment_id] )
+        if ( reassembly_data && reassembly_data->packet_data )
         {
-            reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] ignoring fragment %d of packet %d. fragment already received\n", 
-                endpoint->config.name, fragment_id, sequence );
-            return;
+            endpoint->free_function( endpoint->allocator_context, reassembly_data->packet_data );
+            reassembly_data->packet_data = NULL;
         }
+    }
 
-        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] received fragment %d of packet %d (%d/%d)\n", 
-            endpoint->config.name, fragment_id, sequence, reassembly_data->num_fragments_received+1, num_fragments );
-
-        reassembly_data->num_fragments_received++;
-        reassembly_data->fragment_received[fragment_id] = 1;
-
-        reliable_store_fragment_data( reassembly_data, 
-                                      sequence, 
-                                      ack, 
-                                      ack_bits, 
-                                      fragment_id, 
-                                      endpoint->config.fragment_size, 
-                                      packet_data + fragment_header_bytes, 
-                                      packet_bytes - fragment_header_bytes );
-
-        if ( reassembly_data->num_fragments_received == reassembly_data->num_fragments_total )
-        {
-            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] completed reassembly of packet %d\n", endpoint->config.name, sequence );
+    endpoint->free_function( endpoint->allocator_context, endpoint->acks );
 
-            reliable_endpoint_receive_packet( endpoint, 
-                                              reassembly_data->packet_data + RELIABLE_MAX_PACKET_HEADER_BYTES - reassembly_data->packet_header_bytes, 
-                                              reassembly_data->packet_header_bytes + reassembly_data->packet_bytes );
+    if ( endpoint->paced_fragment_data )
+    {
+        endpoint->free_function( endpoint->allocator_context, endpoint->paced_fragment_data );
+    }
 
-            reliable_sequence_buffer_remove_with_cleanup( endpoint->fragment_reassembly, sequence, reliable_fragment_reassembly_data_cleanup );
-        }
+    reliable_sequence_buffer_destroy( endpoint->sent_packets );
+    reliable_sequence_buffer_destroy( endpoint->received_packets );
+    reliable_sequence_buffer_destroy( endpoint->fragment_reassembly );
 
-        endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_RECEIVED]++;
-    }
+    endpoint->free_function( endpoint->allocator_context, endpoint );
 }
 
-void reliable_endpoint_free_packet( struct reliable_endpoint_t * endpoint, void * packet )
+uint16_t reliable_endpoint_next_packet_sequence( struct reliable_endpoint_t * endpoint )
 {
     reliable_assert( endpoint );
-    reliable_assert( packet );
-    endpoint->free_function( endpoint->allocator_context, packet );
+    return endpoint->sequence;
 }
 
-uint16_t * reliable_endpoint_get_acks( struct reliable_endpoint_t * endpoint, int * num_acks )
+int reliable_write_packet_header( uint8_t * packet_data, uint16_t sequence, uint16_t ack, const uint32_t * ack_bits, int ack_format )
 {
-    reliable_assert( endpoint );
-    reliable_assert( num_acks );
-    *num_acks = endpoint->num_acks;
-    return endpoint->acks;
-}
+    reliable_assert( ack_bits );
+    reliable_assert( ack_format >= RELIABLE_ACK_FORMAT_32_BITS && ack_format <= RELIABLE_ACK_FORMAT_32_BITS_EXTENDED );
 
-void reliable_endpoint_clear_acks( struct reliable_endpoint_t * endpoint )
-{
-    reliable_assert( endpoint );
-    endpoint->num_acks = 0;
-}
+    uint8_t * p = packet_data;
 
-void reliable_endpoint_reset( struct reliable_endpoint_t * endpoint )
-{
-    reliable_assert( endpoint );
+    // ack bit bytes that are all ones are left out. a flag per byte says which ones are written: the first four flags go
+    // in the prefix byte, the flags for the rest of the wider formats follow the ack
 
-    endpoint->num_acks = 0;
-    endpoint->sequence = 0;
+    const int num_ack_bytes = reliable_ack_format_bits( ack_format ) / 8;
 
-    memset( endpoint->acks, 0, endpoint->config.ack_buffer_size * sizeof( uint16_t ) );
-    memset( endpoint->counters, 0, RELIABLE_ENDPOINT_NUM_COUNTERS * sizeof( uint64_t ) );
+    uint8_t ack_bytes[RELIABLE_MAX_ACK_BITS/8];
+    uint32_t ack_byte_flags = 0;
 
     int i;
-    for ( i = 0; i < endpoint->config.fragment_reassembly_buffer_size; ++i )
+    for ( i = 0; i < num_ack_bytes; ++i )
     {
-        struct reliable_fragment_reassembly_data_t * reassembly_data = (struct reliable_fragment_reassembly_data_t*) 
-            reliable_sequence_buffer_at_index( endpoint->fragment_reassembly, i );
-
-        if ( reassembly_data && reassembly_data->packet_data )
+        ack_bytes[i] = (uint8_t) ( ack_bits[i>>2] >> ( ( i & 3 ) * 8 ) );
+        if ( ack_bytes[i] != 0xFF )
         {
-            endpoint->free_function( endpoint->allocator_context, reassembly_data->packet_data );
-            reassembly_data->packet_data = NULL;
+            ack_byte_flags |= 1U << i;
         }
     }
 
-    reliable_sequence_buffer_reset( endpoint->sent_packets );
-    reliable_sequence_buffer_reset( endpoint->received_packets );
-    reliable_sequence_buffer_reset( endpoint->fragment_reassembly );
-}
+    uint8_t prefix_byte = (uint8_t) ( ( ack_byte_flags & 0xF ) << 1 );
 
-void reliable_endpoint_update( struct reliable_endpoint_t * endpoint, double time )
-{
-    reliable_assert( endpoint );
+    int sequence_difference = sequence - ack;
+    if ( sequence_difference < 0 )
+        sequence_difference += 65536;
+    if ( sequence_difference <= 255 )
+        prefix_byte |= (1<<5);
 
-    endpoint->time = time;
-    
-    // calculate packet loss
+    prefix_byte |= (uint8_t) ( ack_format << 6 );
+
+    reliable_write_uint8( &p, prefix_byte );
+
+    reliable_write_uint16( &p, sequence );
+
+    if ( sequence_difference <= 255 )
     {
-        uint32_t base_sequence = ( endpoint->sent_packets->sequence - endpoint->config.sent_packets_buffer_size + 1 ) + 0xFFFF;
-        int i;
-        int num_dropped = 0;
-        int num_samples = endpoint->config.sent_packets_buffer_size / 2;
-        for ( i = 0; i < num_samples; ++i )
-        {
-            uint16_t sequence = (uint16_t) ( base_sequence + i );
-            struct reliable_sent_packet_data_t * sent_packet_data = (struct reliable_sent_packet_data_t*) 
-                reliable_sequence_buffer_find( endpoint->sent_packets, sequence );
-            if ( sent_packet_data && !sent_packet_data->acked )
-            {
-                num_dropped++;
-            }
-        }
-        float packet_loss = ( (float) num_dropped ) / ( (float) num_samples ) * 100.0f;
-        if ( fabs( endpoint->packet_loss - packet_loss ) > 0.00001 )
-        {
-            endpoint->packet_loss += ( packet_loss - endpoint->packet_loss ) * endpoint->config.packet_loss_smoothing_factor;
-        }
-        else
-        {
-            endpoint->packet_loss = packet_loss;
-        }
+        reliable_write_uint8( &p, (uint8_t) sequence_difference );
+    }
+    else
+    {
+        reliable_write_uint16( &p, ack );
     }
 
-    // calculate sent bandwidth
+    if ( ack_format == RELIABLE_ACK_FORMAT_64_BITS )
     {
-        uint32_t base_sequence = ( endpoint->sent_packets->sequence - endpoint->config.sent_packets_buffer_size + 1 ) + 0xFFFF;
-        int i;
-        int bytes_sent = 0;
-        double start_time = FLT_MAX;
-        double finish_time = 0.0;
-        int num_samples = endpoint->config.sent_packets_buffer_size / 2;
-        for ( i = 0; i < num_samples; ++i )
-        {
-            uint16_t sequence = (uint16_t) ( base_sequence + i );
-            struct reliable_sent_packet_data_t * sent_packet_data = (struct reliable_sent_packet_data_t*) 
-                reliable_sequence_buffer_find( endpoint->sent_packets, sequence );
-            if ( !sent_packet_data )
-            {
-                continue;
-            }
-            bytes_sent += sent_packet_data->packet_bytes;
-            if ( sent_packet_data->time < start_time )
-            {
-                start_time = sent_packet_data->time;
-            }
-            if ( sent_packet_data->time > finish_time )
-            {
-                finish_time = sent_packet_data->time;
-            }
-        }
-        if ( start_time != FLT_MAX && finish_time != 0.0 )
+        reliable_write_uint8( &p, (uint8_t) ( ack_byte_flags >> 4 ) );
+    }
+    else if ( ack_format == RELIABLE_ACK_FORMAT_128_BITS )
+    {
+        reliable_write_uint16( &p, (uint16_t) ( ack_byte_flags >> 4 ) );
+    }
+
+    for ( i = 0; i < num_ack_bytes; ++i )
+    {
+        if ( ack_byte_flags & ( 1U << i ) )
         {
-            float sent_bandwidth_kbps = (float) ( ( (double) bytes_sent ) / ( finish_time - start_time ) * 8.0f / 1000.0f );
-            if ( fabs( endpoint->sent_bandwidth_kbps - sent_bandwidth_kbps ) > 0.00001 )
-            {
-                endpoint->sent_bandwidth_kbps += ( sent_bandwidth_kbps - endpoint->sent_bandwidth_kbps ) * endpoint->config.bandwidth_smoothing_factor;
-            }
-            else
-            {
-                endpoint->sent_bandwidth_kbps = sent_bandwidth_kbps;
-            }
+            reliable_write_uint8( &p, ack_bytes[i] );
         }
     }
 
-    // calculate received bandwidth
+    reliable_assert( p - packet_data <= RELIABLE_MAX_PACKET_HEADER_BYTES );
+
+    return (int) ( p - packet_data );
+}
+
+int reliable_endpoint_ack_format( struct reliable_endpoint_t * endpoint )
+{
+    reliable_assert( endpoint );
+
+    if ( endpoint->config.num_ack_bits == 32 )
+        return RELIABLE_ACK_FORMAT_32_BITS;
+
+    if ( !endpoint->peer_extended_acks )
+        return RELIABLE_ACK_FORMAT_32_BITS_EXTENDED;
+
+    return ( endpoint->config.num_ack_bits == 64 ) ? RELIABLE_ACK_FORMAT_64_BITS : RELIABLE_ACK_FORMAT_128_BITS;
+}
+
+void reliable_endpoint_send_packet( struct reliable_endpoint_t * endpoint, uint8_t * packet_data, int packet_bytes )
+{
+    reliable_assert( endpoint );
+    reliable_assert( packet_data );
+    reliable_assert( packet_bytes > 0 );
+
+    if ( packet_bytes > endpoint->config.max_packet_size )
     {
-        uint32_t base_sequence = ( endpoint->received_packets->sequence - endpoint->config.received_packets_buffer_size + 1 ) + 0xFFFF;
-        int i;
-        int bytes_sent = 0;
-        double start_time = FLT_MAX;
-        double finish_time = 0.0;
-        int num_samples = endpoint->config.received_packets_buffer_size / 2;
-        for ( i = 0; i < num_samples; ++i )
+        reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] packet too large to send. packet is %d bytes, maximum is %d\n", 
+            endpoint->config.name, packet_bytes, endpoint->config.max_packet_size );
+        endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_TOO_LARGE_TO_SEND]++;
+        return;
+    }
+
+    uint16_t sequence = endpoint->sequence++;
+    uint16_t ack = endpoint->received_ack;
+    const uint32_t * ack_bits = endpoint->received_ack_bits;
+    int ack_format = reliable_endpoint_ack_format( endpoint );
+
+    reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] sending packet %d\n", endpoint->config.name, sequence );
+
+    reliable_packet_window_advance( &endpoint->sent_window, endpoint->sent_packets, reliable_sent_packet_sample, sequence );
+    reliable_packet_window_advance( &endpoint->acked_window, endpoint->sent_packets, reliable_acked_packet_sample, sequence );
+
+    struct reliable_sent_packet_data_t * sent_packet_data = (struct reliable_sent_packet_data_t*) reliable_sequence_buffer_insert( endpoint->sent_packets, sequence );
+
+    reliable_assert( sent_packet_data );
+
+    sent_packet_data->time = endpoint->time;
+    sent_packet_data->packet_bytes = endpoint->config.packet_header_size + packet_bytes;
+    sent_packet_data->acked = 0;
+
+    if ( endpoint->config.congestion_control )
+    {
+        endpoint->congestion_budget -= sent_packet_data->packet_bytes;
+    }
+
+    if ( packet_bytes <= endpoint->config.fragment_above )
+    {
+        // regular packet
+
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] sending packet %d without fragmentation\n", endpoint->config.name, sequence );
+
+        uint8_t * transmit_packet_data = (uint8_t*) endpoint->allocate_function( endpoint->allocator_context, packet_bytes + RELIABLE_MAX_PACKET_HEADER_BYTES );
+
+        int packet_header_bytes = reliable_write_packet_header( transmit_packet_data, sequence, ack, ack_bits, ack_format );
+
+        memcpy( transmit_packet_data + packet_header_bytes, packet_data, packet_bytes );
+
+        endpoint->config.transmit_packet_function( endpoint->config.context, endpoint->config.id, sequence, transmit_packet_data, packet_header_bytes + packet_bytes );
+
+        endpoint->free_function( endpoint->allocator_context, transmit_packet_data );
+    }
+    else
+    {
+        // fragmented packet
+
+        uint8_t packet_header[RELIABLE_MAX_PACKET_HEADER_BYTES];
+
+        memset( packet_header, 0, RELIABLE_MAX_PACKET_HEADER_BYTES );
+
+        int packet_header_bytes = reliable_write_packet_header( packet_header, sequence, ack, ack_bits, ack_format );        
+
+        int num_fragments = ( packet_bytes / endpoint->config.fragment_size ) + ( ( packet_bytes % endpoint->config.fragment_size ) != 0 ? 1 : 0 );
+
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] sending packet %d as %d fragments\n", endpoint->config.name, sequence, num_fragments );
+
+        reliable_assert( num_fragments >= 1 );
+        reliable_assert( num_fragments <= endpoint->config.max_fragments );
+
+        int fragment_buffer_size = RELIABLE_FRAGMENT_HEADER_BYTES + RELIABLE_MAX_PACKET_HEADER_BYTES + endpoint->config.fragment_size;
+
+        // when the transmit side takes fragments in bulk, build them all up front and hand them over in one call,
+        // so the fragments of this packet can be submitted to the socket together
+
+        int transmit_together = endpoint->config.transmit_packets_function != NULL;
+
+        // with congestion control the fragments are built up front too, then paced out over the following updates.
+        // only one packet is paced at a time, so anything left over from the previous packet goes out now
+
+        int pace = endpoint->config.congestion_control;
+
+        if ( pace )
         {
-            uint16_t sequence = (uint16_t) ( base_sequence + i );
-            struct reliable_received_packet_data_t * received_packet_data = (struct reliable_received_packet_data_t*) 
-                reliable_sequence_buffer_find( endpoint->received_packets, sequence );
-            if ( !received_packet_data )
+            reliable_endpoint_send_paced_fragments( endpoint, 1 );
+        }
+
+        int build_together = transmit_together || pace;
+
+        uint8_t * fragment_packet_data = (uint8_t*) endpoint->allocate_function( endpoint->allocator_context, build_together ? fragment_buffer_size * num_fragments : fragment_buffer_size );
+
+        uint8_t * fragment_data[256];
+        int fragment_bytes[256];
+
+        uint8_t * q = packet_data;
+
+        uint8_t * end = q + packet_bytes;
+
+        int fragment_id;
+        for ( fragment_id = 0; fragment_id < num_fragments; ++fragment_id )
+        {
+            uint8_t * fragment = build_together ? fragment_packet_data + fragment_buffer_size * fragment_id : fragment_packet_data;
+
+            uint8_t * p = fragment;
+
+            reliable_write_uint8( &p, 1 );
+            reliable_write_uint16( &p, sequence );
+            reliable_write_uint8( &p, (uint8_t) fragment_id );
+            reliable_write_uint8( &p, (uint8_t) ( num_fragments - 1 ) );
+
+            if ( fragment_id == 0 )
             {
-                continue;
+                memcpy( p, packet_header, packet_header_bytes );
+                p += packet_header_bytes;
             }
-            bytes_sent += received_packet_data->packet_bytes;
-            if ( received_packet_data->time < start_time )
+
+            int bytes_to_copy = endpoint->config.fragment_size;
+            if ( q + bytes_to_copy > end )
             {
-                start_time = received_packet_data->time;
+                bytes_to_copy = (int) ( end - q );
             }
-            if ( received_packet_data->time > finish_time )
+
+            memcpy( p, q, bytes_to_copy );
+
+            p += bytes_to_copy;
+            q += bytes_to_copy;
+
+            int fragment_packet_bytes = (int) ( p - fragment );
+
+            if ( pace )
             {
-                finish_time = received_packet_data->time;
+                endpoint->paced_fragment_bytes[fragment_id] = fragment_packet_bytes;
             }
-        }
-        if ( start_time != FLT_MAX && finish_time != 0.0 )
-        {
-            float received_bandwidth_kbps = (float) ( ( (double) bytes_sent ) / ( finish_time - start_time ) * 8.0f / 1000.0f );
-            if ( fabs( endpoint->received_bandwidth_kbps - received_bandwidth_kbps ) > 0.00001 )
+            else if ( transmit_together )
             {
-                endpoint->received_bandwidth_kbps += ( received_bandwidth_kbps - endpoint->received_bandwidth_kbps ) * endpoint->config.bandwidth_smoothing_factor;
+                fragment_data[fragment_id] = fragment;
+                fragment_bytes[fragment_id] = fragment_packet_bytes;
             }
             else
             {
-                endpoint->received_bandwidth_kbps = received_bandwidth_kbps;
+                endpoint->config.transmit_packet_function( endpoint->config.context, endpoint->config.id, sequence, fragment, fragment_packet_bytes );
             }
+
+            endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_SENT]++;
         }
-    }
 
-    // calculate acked bandwidth
-    {
-        uint32_t base_sequence = ( endpoint->sent_packets->sequence - endpoint->config.sent_packets_buffer_size + 1 ) + 0xFFFF;
-        int i;
-        int bytes_sent = 0;
-        double start_time = FLT_MAX;
-        double finish_time = 0.0;
-        int num_samples = endpoint->config.sent_packets_buffer_size / 2;
-        for ( i = 0; i < num_samples; ++i )
+        if ( pace )
         {
-            uint16_t sequence = (uint16_t) ( base_sequence + i );
-            struct reliable_sent_packet_data_t * sent_packet_data = (struct reliable_sent_packet_data_t*) 
-                reliable_sequence_buffer_find( endpoint->sent_packets, sequence );
-            if ( !sent_packet_data || !sent_packet_data->acked )
-            {
-                continue;
-            }
-            bytes_sent += sent_packet_data->packet_bytes;
-            if ( sent_packet_data->time < start_time )
-            {
-                start_time = sent_packet_data->time;
-            }
-            if ( sent_packet_data->time > finish_time )
-            {
-                finish_time = sent_packet_data->time;
-            }
+            endpoint->paced_fragment_data = fragment_packet_data;
+            endpoint->num_paced_fragments = num_fragments;
+            endpoint->next_paced_fragment = 0;
+            endpoint->paced_sequence = sequence;
+            reliable_endpoint_send_paced_fragments( endpoint, 0 );
         }
-        if ( start_time != FLT_MAX && finish_time != 0.0 )
+        else
         {
-            float acked_bandwidth_kbps = (float) ( ( (double) bytes_sent ) / ( finish_time - start_time ) * 8.0f / 1000.0f );
-            if ( fabs( endpoint->acked_bandwidth_kbps - acked_bandwidth_kbps ) > 0.00001 )
-            {
-                endpoint->acked_bandwidth_kbps += ( acked_bandwidth_kbps - endpoint->acked_bandwidth_kbps ) * endpoint->config.bandwidth_smoothing_factor;
-            }
-            else
+            if ( transmit_together )
             {
-                endpoint->acked_bandwidth_kbps = acked_bandwidth_kbps;
+                endpoint->config.transmit_packets_function( endpoint->config.context, endpoint->config.id, sequence, fragment_data, fragment_bytes, num_fragments );
             }
+
+            endpoint->free_function( endpoint->allocator_context, fragment_packet_data );
         }
     }
-}
 
-float reliable_endpoint_rtt( struct reliable_endpoint_t * endpoint )
-{
-    reliable_assert( endpoint );
-    return endpoint->rtt;
+    endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_SENT]++;
 }
 
-float reliable_endpoint_packet_loss( struct reliable_endpoint_t * endpoint )
+void reliable_endpoint_send_packet_in_place( struct reliable_endpoint_t * endpoint, uint8_t * packet_data, int packet_bytes )
 {
     reliable_assert( endpoint );
-    return endpoint->packet_loss;
-}
+    reliable_assert( packet_data );
+    reliable_assert( packet_bytes > 0 );
 
-void reliable_endpoint_bandwidth( struct reliable_endpoint_t * endpoint, float * sent_bandwidth_kbps, float * received_bandwidth_kbps, float * acked_bandwidth_kbps )
-{
-    reliable_assert( endpoint );
-    reliable_assert( sent_bandwidth_kbps );
-    reliable_assert( acked_bandwidth_kbps );
-    reliable_assert( received_bandwidth_kbps );
-    *sent_bandwidth_kbps = endpoint->sent_bandwidth_kbps;
-    *received_bandwidth_kbps = endpoint->received_bandwidth_kbps;
-    *acked_bandwidth_kbps = endpoint->acked_bandwidth_kbps;
-}
+    // packets that must be fragmented, or endpoints without an in-place transmit, take the regular path
 
-RELIABLE_CONST uint64_t * reliable_endpoint_counters( struct reliable_endpoint_t * endpoint )
-{
-    reliable_assert( endpoint );
-    return endpoint->counters;
-}
+    if ( packet_bytes > endpoint->config.fragment_above || endpoint->config.transmit_packet_in_place_function == NULL )
+    {
+        reliable_endpoint_send_packet( endpoint, packet_data, packet_bytes );
+        return;
+    }
 
-void reliable_copy_string( char * dest, RELIABLE_CONST char * source, size_t dest_size )
-{
-    reliable_assert( dest );
-    reliable_assert( source );
-    reliable_assert( dest_size >= 1 );
-    memset( dest, 0, dest_size );
-    for ( size_t i = 0; i < dest_size - 1; i++ )
+    if ( packet_bytes > endpoint->config.max_packet_size )
+    {
+        reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] packet too large to send. packet is %d bytes, maximum is %d\n", 
+            endpoint->config.name, packet_bytes, endpoint->config.max_packet_size );
+        endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_TOO_LARGE_TO_SEND]++;
+        return;
+    }
+
+    uint16_t sequence = endpoint->sequence++;
+    uint16_t ack = endpoint->received_ack;
+    const uint32_t * ack_bits = endpoint->received_ack_bits;
+    int ack_format = reliable_endpoint_ack_format( endpoint );
+
+    reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] sending packet %d in place\n", endpoint->config.name, sequence );
+
+    reliable_packet_window_advance( &endpoint->sent_window, endpoint->sent_packets, reliable_sent_packet_sample, sequence );
+    reliable_packet_window_advance( &endpoint->acked_window, endpoint->sent_packets, reliable_acked_packet_sample, sequence );
+
+    struct reliable_sent_packet_data_t * sent_packet_data = (struct reliable_sent_packet_data_t*) reliable_sequence_buffer_insert( endpoint->sent_packets, sequence );
+
+    reliable_assert( sent_packet_data );
+
+    sent_packet_data->time = endpoint->time;
+    sent_packet_data->packet_bytes = endpoint->config.packet_header_size + packet_bytes;
+    sent_packet_data->acked = 0;
+
+    if ( endpoint->config.congestion_control )
+    {
+        endpoint->congestion_budget -= sent_packet_data->packet_bytes;
+    }
+
+    // the header is variable length, so write it out first, then drop it into the headroom right in front of the payload
+
+    uint8_t packet_header[RELIABLE_MAX_PACKET_HEADER_BYTES];
+
+    int packet_header_bytes = reliable_write_packet_header( packet_header, sequence, ack, ack_bits, ack_format );
+
+    uint8_t * transmit_packet_data = packet_data - packet_header_bytes;
+
+    memcpy( transmit_packet_data, packet_header, packet_header_bytes );
+
+    endpoint->config.transmit_packet_in_place_function( endpoint->config.context, endpoint->config.id, sequence, transmit_packet_data, packet_header_bytes + packet_bytes );
+
+    endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_SENT]++;
+}
+
+int reliable_read_packet_header( RELIABLE_CONST char * name, uint8_t * packet_data, int packet_bytes, uint16_t * sequence, uint16_t * ack, uint32_t * ack_bits, int * ack_format )
+{
+    if ( packet_bytes < 3 )
+    {
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] packet too small for packet header (1)\n", name );
+        return -1;
+    }
+
+    uint8_t * p = packet_data;
+
+    uint8_t prefix_byte = reliable_read_uint8( &p );
+
+    if ( ( prefix_byte & 1 ) != 0 )
+    {
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] prefix byte does not indicate a regular packet\n", name );
+        return -1;
+    }
+
+    *sequence = reliable_read_uint16( &p );
+
+    if ( prefix_byte & (1<<5) )
+    {
+        if ( packet_bytes < 3 + 1 )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] packet too small for packet header (2)\n", name );
+            return -1;
+        }
+        uint8_t sequence_difference = reliable_read_uint8( &p );
+        *ack = *sequence - sequence_difference;
+    }
+    else
+    {
+        if ( packet_bytes < 3 + 2 )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] packet too small for packet header (3)\n", name );
+            return -1;
+        }
+        *ack = reliable_read_uint16( &p );
+    }
+
+    *ack_format = prefix_byte >> 6;
+
+    const int num_ack_bytes = reliable_ack_format_bits( *ack_format ) / 8;
+
+    uint32_t ack_byte_flags = ( prefix_byte >> 1 ) & 0xF;
+
+    if ( *ack_format == RELIABLE_ACK_FORMAT_64_BITS )
+    {
+        if ( packet_bytes < ( p - packet_data ) + 1 )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] packet too small for packet header (4)\n", name );
+            return -1;
+        }
+        ack_byte_flags |= ( (uint32_t) reliable_read_uint8( &p ) ) << 4;
+    }
+    else if ( *ack_format == RELIABLE_ACK_FORMAT_128_BITS )
+    {
+        if ( packet_bytes < ( p - packet_data ) + 2 )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] packet too small for packet header (4)\n", name );
+            return -1;
+        }
+        ack_byte_flags |= ( (uint32_t) reliable_read_uint16( &p ) ) << 4;
+    }
+
+    int expected_bytes = 0;
+    int i;
+    for ( i = 0; i < num_ack_bytes; ++i )
+    {
+        if ( ack_byte_flags & ( 1U << i ) )
+        {
+            expected_bytes++;
+        }
+    }
+    if ( packet_bytes < ( p - packet_data ) + expected_bytes )
+    {
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] packet too small for packet header (5)\n", name );
+        return -1;
+    }
+
+    // bits past the end of the format are not acks
+
+    memset( ack_bits, 0, RELIABLE_ACK_BITS_WORDS * sizeof( uint32_t ) );
+
+    for ( i = 0; i < num_ack_bytes; ++i )
+    {
+        const uint32_t ack_byte = ( ack_byte_flags & ( 1U << i ) ) ? reliable_read_uint8( &p ) : 0xFF;
+        ack_bits[i>>2] |= ack_byte << ( ( i & 3 ) * 8 );
+    }
+
+    return (int) ( p - packet_data );
+}
+
+int reliable_read_fragment_header( char * name, 
+                                   uint8_t * packet_data, 
+                                   int packet_bytes, 
+                                   int max_fragments, 
+                                   int fragment_size, 
+                                   int * fragment_id, 
+                                   int * num_fragments, 
+                                   int * fragment_bytes, 
+                                   uint16_t * sequence, 
+                                   uint16_t * ack, 
+                                   uint32_t * ack_bits,
+                                   int * ack_format )
+{
+    if ( packet_bytes < RELIABLE_FRAGMENT_HEADER_BYTES )
+    {
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] packet is too small to read fragment header\n", name );
+        return -1;
+    }
+
+    uint8_t * p = packet_data;
+
+    uint8_t prefix_byte = reliable_read_uint8( &p );
+    if ( prefix_byte != 1 )
+    {
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] prefix byte is not a fragment\n", name );
+        return -1;
+    }
+    
+    *sequence = reliable_read_uint16( &p );
+    *fragment_id = (int) reliable_read_uint8( &p );
+    *num_fragments = ( (int) reliable_read_uint8( &p ) ) + 1;
+
+    if ( *num_fragments > max_fragments )
+    {
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] num fragments %d outside of range of max fragments %d\n", name, *num_fragments, max_fragments );
+        return -1;
+    }
+
+    if ( *fragment_id >= *num_fragments )
+    {
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] fragment id %d outside of range of num fragments %d\n", name, *fragment_id, *num_fragments );
+        return -1;
+    }
+
+    *fragment_bytes = packet_bytes - RELIABLE_FRAGMENT_HEADER_BYTES;
+
+    uint16_t packet_sequence = 0;
+    uint16_t packet_ack = 0;
+    uint32_t packet_ack_bits[RELIABLE_ACK_BITS_WORDS];
+    int packet_ack_format = RELIABLE_ACK_FORMAT_32_BITS;
+
+    memset( packet_ack_bits, 0, sizeof( packet_ack_bits ) );
+
+    if ( *fragment_id == 0 )
+    {
+        int packet_header_bytes = reliable_read_packet_header( name, 
+                                                               packet_data + RELIABLE_FRAGMENT_HEADER_BYTES, 
+                                                               packet_bytes, 
+                                                               &packet_sequence, 
+                                                               &packet_ack, 
+                                                               packet_ack_bits,
+                                                               &packet_ack_format );
+
+        if ( packet_header_bytes < 0 )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] bad packet header in fragment\n", name );
+            return -1;
+        }
+
+        if ( packet_sequence != *sequence )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] bad packet sequence in fragment. expected %d, got %d\n", name, *sequence, packet_sequence );
+            return -1;
+        }
+
+        *fragment_bytes = packet_bytes - packet_header_bytes - RELIABLE_FRAGMENT_HEADER_BYTES;
+    }
+
+    *ack = packet_ack;
+    memcpy( ack_bits, packet_ack_bits, sizeof( packet_ack_bits ) );
+    *ack_format = packet_ack_format;
+
+    if ( *fragment_bytes > fragment_size )
+    {
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] fragment bytes %d > fragment size %d\n", name, *fragment_bytes, fragment_size );
+        return - 1;
+    }
+
+    if ( *fragment_id != *num_fragments - 1 && *fragment_bytes != fragment_size )
+    {
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] fragment %d is %d bytes, which is not the expected fragment size %d\n", 
+            name, *fragment_id, *fragment_bytes, fragment_size );
+        return -1;
+    }
+
+    return (int) ( p - packet_data );
+}
+
+void reliable_store_fragment_data( struct reliable_fragment_reassembly_data_t * reassembly_data, 
+                                   uint16_t sequence, 
+                                   uint16_t ack, 
+                                   const uint32_t * ack_bits, 
+                                   int ack_format, 
+                                   int fragment_id, 
+                                   int fragment_size, 
+                                   uint8_t * fragment_data, 
+                                   int fragment_bytes )
+{
+    if ( fragment_id == 0 )
+    {
+        uint8_t packet_header[RELIABLE_MAX_PACKET_HEADER_BYTES];
+
+        memset( packet_header, 0, RELIABLE_MAX_PACKET_HEADER_BYTES );
+
+        reassembly_data->packet_header_bytes = reliable_write_packet_header( packet_header, sequence, ack, ack_bits, ack_format );
+
+        memcpy( reassembly_data->packet_data + RELIABLE_MAX_PACKET_HEADER_BYTES - reassembly_data->packet_header_bytes, 
+                packet_header, 
+                reassembly_data->packet_header_bytes );
+
+        fragment_data += reassembly_data->packet_header_bytes;
+        fragment_bytes -= reassembly_data->packet_header_bytes;
+    }
+
+    if ( fragment_id == reassembly_data->num_fragments_total - 1 )
+    {
+        reassembly_data->packet_bytes = ( reassembly_data->num_fragments_total - 1 ) * fragment_size + fragment_bytes;
+    }
+
+    memcpy( reassembly_data->packet_data + RELIABLE_MAX_PACKET_HEADER_BYTES + fragment_id * fragment_size, fragment_data, fragment_bytes );
+}
+
+void reliable_endpoint_receive_packet( struct reliable_endpoint_t * endpoint, uint8_t * packet_data, int packet_bytes )
+{
+    reliable_assert( endpoint );
+    reliable_assert( packet_data );
+    reliable_assert( packet_bytes > 0 );
+
+    if ( packet_bytes > endpoint->config.max_packet_size + RELIABLE_MAX_PACKET_HEADER_BYTES + RELIABLE_FRAGMENT_HEADER_BYTES )
+    {
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] packet too large to receive. packet is at least %d bytes, maximum is %d\n",
+            endpoint->config.name, packet_bytes - ( RELIABLE_MAX_PACKET_HEADER_BYTES + RELIABLE_FRAGMENT_HEADER_BYTES ), endpoint->config.max_packet_size );
+        endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_TOO_LARGE_TO_RECEIVE]++;
+        return;
+    }
+
+    uint8_t prefix_byte = packet_data[0];
+
+    if ( ( prefix_byte & 1 ) == 0 )
+    {
+        // regular packet
+
+        endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_RECEIVED]++;
+
+        uint16_t sequence;
+        uint16_t ack;
+        uint32_t ack_bits[RELIABLE_ACK_BITS_WORDS];
+        int ack_format;
+
+        int packet_header_bytes = reliable_read_packet_header( endpoint->config.name, packet_data, packet_bytes, &sequence, &ack, ack_bits, &ack_format );
+        if ( packet_header_bytes < 0 )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] ignoring invalid packet. could not read packet header\n", endpoint->config.name );
+            endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_INVALID]++;
+            return;
+        }
+
+        reliable_assert( packet_header_bytes <= packet_bytes );
+
+        int packet_payload_bytes = packet_bytes - packet_header_bytes;
+
+        if ( packet_payload_bytes > endpoint->config.max_packet_size )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] packet too large to receive. packet is at %d bytes, maximum is %d\n",
+                endpoint->config.name, packet_payload_bytes, endpoint->config.max_packet_size );
+            endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_TOO_LARGE_TO_RECEIVE]++;
+            return;
+        }
+
+        if ( !reliable_sequence_buffer_test_insert( endpoint->received_packets, sequence ) )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] ignoring stale packet %d\n", endpoint->config.name, sequence );
+            endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_STALE]++;
+            return;
+        }
+
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] processing packet %d\n", endpoint->config.name, sequence );
+
+        if ( endpoint->config.process_packet_function( endpoint->config.context, 
+                                                       endpoint->config.id, 
+                                                       sequence, 
+                                                       packet_data + packet_header_bytes, 
+                                                       packet_bytes - packet_header_bytes ) )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] process packet %d successful\n", endpoint->config.name, sequence );
+
+            if ( ack_format != RELIABLE_ACK_FORMAT_32_BITS )
+            {
+                endpoint->peer_extended_acks = 1;
+            }
+
+            reliable_packet_window_advance( &endpoint->received_window, endpoint->received_packets, reliable_received_packet_sample, sequence );
+            reliable_endpoint_advance_received_ack( endpoint, sequence );
+            reliable_endpoint_mark_received_ack( endpoint, sequence );
+
+            const int in_received_window = reliable_packet_window_contains( endpoint->received_packets, sequence );
+            const int previous_packet_bytes = in_received_window ? reliable_received_packet_sample( endpoint->received_packets, sequence ) : 0;
+
+            struct reliable_received_packet_data_t * received_packet_data = (struct reliable_received_packet_data_t*) 
+                reliable_sequence_buffer_insert( endpoint->received_packets, sequence );
+
+            reliable_sequence_buffer_advance_with_cleanup( endpoint->fragment_reassembly, sequence, reliable_fragment_reassembly_data_cleanup );
+
+            reliable_assert( received_packet_data );
+
+            received_packet_data->time = endpoint->time;
+            received_packet_data->packet_bytes = endpoint->config.packet_header_size + packet_bytes;
+
+            if ( previous_packet_bytes )
+            {
+                endpoint->received_window.bytes += received_packet_data->packet_bytes;
+                endpoint->received_window.bytes -= previous_packet_bytes;
+            }
+            else if ( in_received_window )
+            {
+                reliable_packet_window_add( &endpoint->received_window, sequence, received_packet_data->packet_bytes );
+            }
+
+            const int num_ack_bits = reliable_ack_format_bits( ack_format );
+
+            int i;
+            for ( i = 0; i < num_ack_bits; ++i )
+            {
+                if ( ack_bits[i>>5] & ( 1U << ( i & 31 ) ) )
+                {                    
+                    uint16_t ack_sequence = ack - ((uint16_t)i);
+                    
+                    struct reliable_sent_packet_data_t * sent_packet_data = (struct reliable_sent_packet_data_t*) 
+                        reliable_sequence_buffer_find( endpoint->sent_packets, ack_sequence );
+
+                    if ( sent_packet_data && !sent_packet_data->acked && endpoint->num_acks < endpoint->config.ack_buffer_size )
+                    {
+                        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] acked packet %d\n", endpoint->config.name, ack_sequence );
+                        endpoint->acks[endpoint->num_acks++] = ack_sequence;
+                        endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_ACKED]++;
+                        sent_packet_data->acked = 1;
+
+                        if ( reliable_packet_window_contains( endpoint->sent_packets, ack_sequence ) )
+                        {
+                            reliable_packet_window_add( &endpoint->acked_window, ack_sequence, sent_packet_data->packet_bytes );
+                        }
+
+                        float rtt = (float) ( endpoint->time - sent_packet_data->time ) * 1000.0f;
+                        reliable_assert( rtt >= 0.0 );
+                        if ( ( endpoint->rtt == 0.0f && rtt > 0.0f ) || fabs( endpoint->rtt - rtt ) < 0.00001 )
+                        {
+                            endpoint->rtt = rtt;
+                        }
+                        else
+                        {
+                            endpoint->rtt += ( rtt - endpoint->rtt ) * endpoint->config.rtt_smoothing_factor;
+                        }
+
+                        reliable_endpoint_rtt_sample( endpoint, rtt );
+
+                        endpoint->congestion_acked_bytes += sent_packet_data->packet_bytes;
+                    }
+                }
+            }
+
+            if ( endpoint->config.congestion_control )
+            {
+                reliable_endpoint_detect_losses( endpoint, ack );
+            }
+        }
+        else
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] process packet failed\n", endpoint->config.name );
+        }
+    }
+    else
+    {
+        // fragment packet
+
+        int fragment_id;
+        int num_fragments;
+        int fragment_bytes;
+
+        uint16_t sequence;
+        uint16_t ack;
+        uint32_t ack_bits[RELIABLE_ACK_BITS_WORDS];
+        int ack_format;
+
+        int fragment_header_bytes = reliable_read_fragment_header( endpoint->config.name, 
+                                                                   packet_data, 
+                                                                   packet_bytes, 
+                                                                   endpoint->config.max_fragments, 
+                                                                   endpoint->config.fragment_size,
+                                                                   &fragment_id, 
+                                                                   &num_fragments, 
+                                                                   &fragment_bytes, 
+                                                                   &sequence, 
+                                                                   &ack, 
+                                                                   ack_bits,
+                                                                   &ack_format );
+
+        if ( fragment_header_bytes < 0 )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] ignoring invalid fragment. could not read fragment header\n", endpoint->config.name );
+            endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID]++;
+            return;
+        }
+
+        struct reliable_fragment_reassembly_data_t * reassembly_data = (struct reliable_fragment_reassembly_data_t*) 
+            reliable_sequence_buffer_find( endpoint->fragment_reassembly, sequence );
+
+        if ( !reassembly_data )
+        {
+            reassembly_data = (struct reliable_fragment_reassembly_data_t*) 
+                reliable_sequence_buffer_insert_with_cleanup( endpoint->fragment_reassembly, sequence, reliable_fragment_reassembly_data_cleanup );
+
+            if ( !reassembly_data )
+            {
+                reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] ignoring invalid fragment. could not insert in reassembly buffer (stale)\n", endpoint->config.name );
+                endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID]++;
+                return;
+            }
+
+            reliable_packet_window_advance( &endpoint->received_window, endpoint->received_packets, reliable_received_packet_sample, sequence );
+            reliable_endpoint_advance_received_ack( endpoint, sequence );
+
+            reliable_sequence_buffer_advance( endpoint->received_packets, sequence );
+
+            int packet_buffer_size = RELIABLE_MAX_PACKET_HEADER_BYTES + num_fragments * endpoint->config.fragment_size;
+
+            reassembly_data->sequence = sequence;
+            reassembly_data->ack = 0;
+            memset( reassembly_data->ack_bits, 0, sizeof( reassembly_data->ack_bits ) );
+            reassembly_data->ack_format = RELIABLE_ACK_FORMAT_32_BITS;
+            reassembly_data->num_fragments_received = 0;
+            reassembly_data->num_fragments_total = num_fragments;
+            reassembly_data->packet_data = (uint8_t*) endpoint->allocate_function( endpoint->allocator_context, packet_buffer_size );
+            reassembly_data->packet_bytes = 0;
+            memset( reassembly_data->fragment_received, 0, sizeof( reassembly_data->fragment_received ) );
+        }
+
+        if ( num_fragments != (int) reassembly_data->num_fragments_total )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] ignoring invalid fragment. fragment count mismatch. expected %d, got %d\n", 
+                endpoint->config.name, (int) reassembly_data->num_fragments_total, num_fragments );
+            endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID]++;
+            return;
+        }
+
+        if ( reassembly_data->fragment_received[fragment_id] )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] ignoring fragment %d of packet %d. fragment already received\n", 
+                endpoint->config.name, fragment_id, sequence );
+            return;
+        }
+
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] received fragment %d of packet %d (%d/%d)\n", 
+            endpoint->config.name, fragment_id, sequence, reassembly_data->num_fragments_received+1, num_fragments );
+
+        reassembly_data->num_fragments_received++;
+        reassembly_data->fragment_received[fragment_id] = 1;
+
+        reliable_store_fragment_data( reassembly_data, 
+                                      sequence, 
+                                      ack, 
+                                      ack_bits, 
+                                      ack_format, 
+                                      fragment_id, 
+                                      endpoint->config.fragment_size, 
+                                      packet_data + fragment_header_bytes, 
+                                      packet_bytes - fragment_header_bytes );
+
+        if ( reassembly_data->num_fragments_received == reassembly_data->num_fragments_total )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] completed reassembly of packet %d\n", endpoint->config.name, sequence );
+
+            reliable_endpoint_receive_packet( endpoint, 
+                                              reassembly_data->packet_data + RELIABLE_MAX_PACKET_HEADER_BYTES - reassembly_data->packet_header_bytes, 
+                                              reassembly_data->packet_header_bytes + reassembly_data->packet_bytes );
+
+            reliable_sequence_buffer_remove_with_cleanup( endpoint->fragment_reassembly, sequence, reliable_fragment_reassembly_data_cleanup );
+        }
+
+        endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_RECEIVED]++;
+    }
+}
+
+void reliable_endpoint_free_packet( struct reliable_endpoint_t * endpoint, void * packet )
+{
+    reliable_assert( endpoint );
+    reliable_assert( packet );
+    endpoint->free_function( endpoint->allocator_context, packet );
+}
+
+uint16_t * reliable_endpoint_get_acks( struct reliable_endpoint_t * endpoint, int * num_acks )
+{
+    reliable_assert( endpoint );
+    reliable_assert( num_acks );
+    *num_acks = endpoint->num_acks;
+    return endpoint->acks;
+}
+
+void reliable_endpoint_clear_acks( struct reliable_endpoint_t * endpoint )
+{
+    reliable_assert( endpoint );
+    endpoint->num_acks = 0;
+}
+
+void reliable_endpoint_reset( struct reliable_endpoint_t * endpoint )
+{
+    reliable_assert( endpoint );
+
+    endpoint->num_acks = 0;
+    endpoint->sequence = 0;
+
+    memset( endpoint->acks, 0, endpoint->config.ack_buffer_size * sizeof( uint16_t ) );
+    memset( endpoint->counters, 0, RELIABLE_ENDPOINT_NUM_COUNTERS * sizeof( uint64_t ) );
+
+    int i;
+    for ( i = 0; i < endpoint->config.fragment_reassembly_buffer_size; ++i )
+    {
+        struct reliable_fragment_reassembly_data_t * reassembly_data = (struct reliable_fragment_reassembly_data_t*) 
+            reliable_sequence_buffer_at_index( endpoint->fragment_reassembly, i );
+
+        if ( reassembly_data && reassembly_data->packet_data )
+        {
+            endpoint->free_function( endpoint->allocator_context, reassembly_data->packet_data );
+            reassembly_data->packet_data = NULL;
+        }
+    }
+
+    reliable_sequence_buffer_reset( endpoint->sent_packets );
+    reliable_sequence_buffer_reset( endpoint->received_packets );
+    reliable_sequence_buffer_reset( endpoint->fragment_reassembly );
+
+    reliable_packet_window_reset( &endpoint->sent_window );
+    reliable_packet_window_reset( &endpoint->acked_window );
+    reliable_packet_window_reset( &endpoint->received_window );
+
+    endpoint->received_ack = 0xFFFF;
+    memset( endpoint->received_ack_bits, 0, sizeof( endpoint->received_ack_bits ) );
+    endpoint->peer_extended_acks = 0;
+
+    if ( endpoint->paced_fragment_data )
+    {
+        endpoint->free_function( endpoint->allocator_context, endpoint->paced_fragment_data );
+        endpoint->paced_fragment_data = NULL;
+        endpoint->num_paced_fragments = 0;
+        endpoint->next_paced_fragment = 0;
+    }
+
+    reliable_endpoint_reset_congestion( endpoint );
+}
+
+void reliable_endpoint_update( struct reliable_endpoint_t * endpoint, double time )
+{
+    reliable_assert( endpoint );
+
+    endpoint->time = time;
+    
+    // calculate packet loss
+    {
+        int num_dropped = endpoint->sent_window.num_packets - endpoint->acked_window.num_packets;
+        int num_samples = endpoint->config.sent_packets_buffer_size / 2;
+        float packet_loss = ( (float) num_dropped ) / ( (float) num_samples ) * 100.0f;
+        if ( fabs( endpoint->packet_loss - packet_loss ) > 0.00001 )
+        {
+            endpoint->packet_loss += ( packet_loss - endpoint->packet_loss ) * endpoint->config.packet_loss_smoothing_factor;
+        }
+        else
+        {
+            endpoint->packet_loss = packet_loss;
+        }
+    }
+
+    // calculate sent bandwidth
+    if ( endpoint->sent_window.num_packets > 0 )
+    {
+        struct reliable_sent_packet_data_t * first_packet_data = (struct reliable_sent_packet_data_t*) 
+            reliable_sequence_buffer_find( endpoint->sent_packets, endpoint->sent_window.first_sequence );
+        struct reliable_sent_packet_data_t * last_packet_data = (struct reliable_sent_packet_data_t*) 
+            reliable_sequence_buffer_find( endpoint->sent_packets, endpoint->sent_window.last_sequence );
+        reliable_assert( first_packet_data );
+        reliable_assert( last_packet_data );
+        if ( last_packet_data->time != 0.0 )
+        {
+            float sent_bandwidth_kbps = reliable_packet_window_kbps( &endpoint->sent_window, first_packet_data->time, last_packet_data->time );
+            if ( fabs( endpoint->sent_bandwidth_kbps - sent_bandwidth_kbps ) > 0.00001 )
+            {
+                endpoint->sent_bandwidth_kbps += ( sent_bandwidth_kbps - endpoint->sent_bandwidth_kbps ) * endpoint->config.bandwidth_smoothing_factor;
+            }
+            else
+            {
+                endpoint->sent_bandwidth_kbps = sent_bandwidth_kbps;
+            }
+        }
+    }
+
+    // calculate received bandwidth
+    if ( endpoint->received_window.num_packets > 0 )
+    {
+        struct reliable_received_packet_data_t * first_packet_data = (struct reliable_received_packet_data_t*) 
+            reliable_sequence_buffer_find( endpoint->received_packets, endpoint->received_window.first_sequence );
+        struct reliable_received_packet_data_t * last_packet_data = (struct reliable_received_packet_data_t*) 
+            reliable_sequence_buffer_find( endpoint->received_packets, endpoint->received_window.last_sequence );
+        reliable_assert( first_packet_data );
+        reliable_assert( last_packet_data );
+        if ( last_packet_data->time != 0.0 )
+        {
+            float received_bandwidth_kbps = reliable_packet_window_kbps( &endpoint->received_window, first_packet_data->time, last_packet_data->time );
+            if ( fabs( endpoint->received_bandwidth_kbps - received_bandwidth_kbps ) > 0.00001 )
+            {
+                endpoint->received_bandwidth_kbps += ( received_bandwidth_kbps - endpoint->received_bandwidth_kbps ) * endpoint->config.bandwidth_smoothing_factor;
+            }
+            else
+            {
+                endpoint->received_bandwidth_kbps = received_bandwidth_kbps;
+            }
+        }
+    }
+
+    // calculate acked bandwidth
+    if ( endpoint->acked_window.num_packets > 0 )
+    {
+        struct reliable_sent_packet_data_t * first_packet_data = (struct reliable_sent_packet_data_t*) 
+            reliable_sequence_buffer_find( endpoint->sent_packets, endpoint->acked_window.first_sequence );
+        struct reliable_sent_packet_data_t * last_packet_data = (struct reliable_sent_packet_data_t*) 
+            reliable_sequence_buffer_find( endpoint->sent_packets, endpoint->acked_window.last_sequence );
+        reliable_assert( first_packet_data );
+        reliable_assert( last_packet_data );
+        if ( last_packet_data->time != 0.0 )
+        {
+            float acked_bandwidth_kbps = reliable_packet_window_kbps( &endpoint->acked_window, first_packet_data->time, last_packet_data->time );
+            if ( fabs( endpoint->acked_bandwidth_kbps - acked_bandwidth_kbps ) > 0.00001 )
+            {
+                endpoint->acked_bandwidth_kbps += ( acked_bandwidth_kbps - endpoint->acked_bandwidth_kbps ) * endpoint->config.bandwidth_smoothing_factor;
+            }
+            else
+            {
+                endpoint->acked_bandwidth_kbps = acked_bandwidth_kbps;
+            }
+        }
+    }
+
+    if ( endpoint->config.congestion_control )
+    {
+        reliable_endpoint_update_congestion( endpoint );
+    }
+}
+
+float reliable_endpoint_rtt( struct reliable_endpoint_t * endpoint )
+{
+    reliable_assert( endpoint );
+    return endpoint->rtt;
+}
+
+float reliable_endpoint_rtt_smoothed( struct reliable_endpoint_t * endpoint )
+{
+    reliable_assert( endpoint );
+    return endpoint->rtt_smoothed;
+}
+
+float reliable_endpoint_rtt_variance( struct reliable_endpoint_t * endpoint )
+{
+    reliable_assert( endpoint );
+    return endpoint->rtt_variance;
+}
+
+float reliable_endpoint_rtt_min( struct reliable_endpoint_t * endpoint )
+{
+    reliable_assert( endpoint );
+    return endpoint->rtt_min_filter.samples[0].rtt;
+}
+
+void reliable_endpoint_rtt_percentiles( struct reliable_endpoint_t * endpoint, float * rtt_p50, float * rtt_p95, float * rtt_p99 )
+{
+    reliable_assert( endpoint );
+    reliable_assert( rtt_p50 );
+    reliable_assert( rtt_p95 );
+    reliable_assert( rtt_p99 );
+    *rtt_p50 = reliable_rtt_histogram_percentile( endpoint->rtt_histogram, endpoint->rtt_histogram_samples, 0.50f );
+    *rtt_p95 = reliable_rtt_histogram_percentile( endpoint->rtt_histogram, endpoint->rtt_histogram_samples, 0.95f );
+    *rtt_p99 = reliable_rtt_histogram_percentile( endpoint->rtt_histogram, endpoint->rtt_histogram_samples, 0.99f );
+}
+
+float reliable_endpoint_packet_loss( struct reliable_endpoint_t * endpoint )
+{
+    reliable_assert( endpoint );
+    return endpoint->packet_loss;
+}
+
+void reliable_endpoint_bandwidth( struct reliable_endpoint_t * endpoint, float * sent_bandwidth_kbps, float * received_bandwidth_kbps, float * acked_bandwidth_kbps )
+{
+    reliable_assert( endpoint );
+    reliable_assert( sent_bandwidth_kbps );
+    reliable_assert( acked_bandwidth_kbps );
+    reliable_assert( received_bandwidth_kbps );
+    *sent_bandwidth_kbps = endpoint->sent_bandwidth_kbps;
+    *received_bandwidth_kbps = endpoint->received_bandwidth_kbps;
+    *acked_bandwidth_kbps = endpoint->acked_bandwidth_kbps;
+}
+
+int reliable_endpoint_send_budget( struct reliable_endpoint_t * endpoint )
+{
+    reliable_assert( endpoint );
+
+    if ( !endpoint->config.congestion_control )
+        return endpoint->config.max_packet_size;
+
+    double budget = endpoint->congestion_budget - endpoint->config.packet_header_size;
+
+    if ( budget <= 0.0 )
+        return 0;
+
+    if ( budget >= endpoint->config.max_packet_size )
+        return endpoint->config.max_packet_size;
+
+    return (int) budget;
+}
+
+float reliable_endpoint_congestion_bandwidth_kbps( struct reliable_endpoint_t * endpoint )
+{
+    reliable_assert( endpoint );
+    return (float) ( endpoint->congestion_rate * 8.0 / 1000.0 );
+}
+
+RELIABLE_CONST uint64_t * reliable_endpoint_counters( struct reliable_endpoint_t * endpoint )
+{
+    reliable_assert( endpoint );
+    return endpoint->counters;
+}
+
+void reliable_copy_string( char * dest, RELIABLE_CONST char * source, size_t dest_size )
+{
+    reliable_assert( dest );
+    reliable_assert( source );
+    reliable_assert( dest_size >= 1 );
+    memset( dest, 0, dest_size );
+    for ( size_t i = 0; i < dest_size - 1; i++ )
+    {
+        if ( source[i] == '\0' )
+            break;
+        dest[i] = source[i];
+    }
+}
+
+// ---------------------------------------------------------------
+
+#if RELIABLE_ENABLE_TESTS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+
+static void check_handler( RELIABLE_CONST char * condition, 
+                           RELIABLE_CONST char * function,
+                           RELIABLE_CONST char * file,
+                           int line )
+{
+    printf( "check failed: ( %s ), function %s, file %s, line %d\n", condition, function, file, line );
+#ifdef RELIABLE_DEBUG
+    #if defined( __GNUC__ )
+        __builtin_trap();
+    #elif defined( _MSC_VER )
+        __debugbreak();
+    #endif
+#endif
+    exit( 1 );
+}
+
+#define check( condition )                                                                                      \
+do                                                                                                              \
+{                                                                                                               \
+    if ( !(condition) )                                                                                         \
+    {                                                                                                           \
+        check_handler( #condition, (RELIABLE_CONST char*) __FUNCTION__, __FILE__, __LINE__ );                   \
+    }                                                                                                           \
+} while(0)
+
+static void test_endian()
+{
+    uint32_t value = 0x11223344;
+
+    char * bytes = (char*) &value;
+
+#if RELIABLE_LITTLE_ENDIAN
+
+    check( bytes[0] == 0x44 );
+    check( bytes[1] == 0x33 );
+    check( bytes[2] == 0x22 );
+    check( bytes[3] == 0x11 );
+
+#else // #if RELIABLE_LITTLE_ENDIAN
+
+    check( bytes[3] == 0x44 );
+    check( bytes[2] == 0x33 );
+    check( bytes[1] == 0x22 );
+    check( bytes[0] == 0x11 );
+
+#endif // #if RELIABLE_LITTLE_ENDIAN
+}
+
+struct test_sequence_data_t
+{
+    uint16_t sequence;
+};
+
+#define TEST_SEQUENCE_BUFFER_SIZE 256
+
+static void test_sequence_buffer()
+{
+    struct reliable_sequence_buffer_t * sequence_buffer = reliable_sequence_buffer_create( TEST_SEQUENCE_BUFFER_SIZE, 
+                                                                                           sizeof( struct test_sequence_data_t ), 
+                                                                                           NULL, 
+                                                                                           NULL, 
+                                                                                           NULL );
+
+    check( sequence_buffer );
+    check( sequence_buffer->sequence == 0 );
+    check( sequence_buffer->num_entries == TEST_SEQUENCE_BUFFER_SIZE );
+    check( sequence_buffer->entry_stride == sizeof( struct test_sequence_data_t ) );
+
+    int i;
+    for ( i = 0; i < TEST_SEQUENCE_BUFFER_SIZE; ++i )
+    {
+        check( reliable_sequence_buffer_find( sequence_buffer, ((uint16_t)i) ) == NULL );
+    }                                                                      
+
+    for ( i = 0; i <= TEST_SEQUENCE_BUFFER_SIZE*4; ++i )
+    {
+        struct test_sequence_data_t * entry = (struct test_sequence_data_t*) reliable_sequence_buffer_insert( sequence_buffer, ((uint16_t)i) );
+        check( entry );
+        entry->sequence = (uint16_t) i;
+        check( sequence_buffer->sequence == i + 1 );
+    }
+
+    for ( i = 0; i <= TEST_SEQUENCE_BUFFER_SIZE; ++i )
+    {
+        struct test_sequence_data_t * entry = (struct test_sequence_data_t*) reliable_sequence_buffer_insert( sequence_buffer, ((uint16_t)i) );
+        check( entry == NULL );
+    }    
+
+    int index = TEST_SEQUENCE_BUFFER_SIZE * 4;
+    for ( i = 0; i < TEST_SEQUENCE_BUFFER_SIZE; ++i )
+    {
+        struct test_sequence_data_t * entry = (struct test_sequence_data_t*) reliable_sequence_buffer_find( sequence_buffer, (uint16_t) index );
+        check( entry );
+        check( entry->sequence == (uint32_t) index );
+        index--;
+    }
+
+    reliable_sequence_buffer_reset( sequence_buffer );
+
+    check( sequence_buffer );
+    check( sequence_buffer->sequence == 0 );
+    check( sequence_buffer->num_entries == TEST_SEQUENCE_BUFFER_SIZE );
+    check( sequence_buffer->entry_stride == sizeof( struct test_sequence_data_t ) );
+
+    for ( i = 0; i < TEST_SEQUENCE_BUFFER_SIZE; ++i )
+    {
+        check( reliable_sequence_buffer_find( sequence_buffer, (uint16_t) i ) == NULL );
+    }
+
+    reliable_sequence_buffer_destroy( sequence_buffer );
+}
+
+static void test_generate_ack_bits()
+{
+    struct reliable_sequence_buffer_t * sequence_buffer = reliable_sequence_buffer_create( TEST_SEQUENCE_BUFFER_SIZE, 
+                                                                                           sizeof( struct test_sequence_data_t ), 
+                                                                                           NULL, 
+                                                                                           NULL, 
+                                                                                           NULL );
+
+    uint16_t ack = 0;
+    uint32_t ack_bits = 0xFFFFFFFF;
+
+    reliable_sequence_buffer_generate_ack_bits( sequence_buffer, &ack, &ack_bits );
+    check( ack == 0xFFFF );
+    check( ack_bits == 0 );
+
+    int i;
+    for ( i = 0; i <= TEST_SEQUENCE_BUFFER_SIZE; ++i )
+    {
+        reliable_sequence_buffer_insert( sequence_buffer, (uint16_t) i );
+    }
+
+    reliable_sequence_buffer_generate_ack_bits( sequence_buffer, &ack, &ack_bits );
+    check( ack == TEST_SEQUENCE_BUFFER_SIZE );
+    check( ack_bits == 0xFFFFFFFF );
+
+    reliable_sequence_buffer_reset( sequence_buffer );
+
+    uint16_t input_acks[] = { 1, 5, 9, 11 };
+    int input_num_acks = sizeof( input_acks ) / sizeof( uint16_t );
+    for ( i = 0; i < input_num_acks; ++i )
+    {
+        reliable_sequence_buffer_insert( sequence_buffer, input_acks[i] );
+    }
+
+    reliable_sequence_buffer_generate_ack_bits( sequence_buffer, &ack, &ack_bits );
+
+    check( ack == 11 );
+    check( ack_bits == ( 1 | (1<<(11-9)) | (1<<(11-5)) | (1<<(11-1)) ) );
+
+    reliable_sequence_buffer_destroy( sequence_buffer );
+}
+
+static void test_packet_header()
+{
+    uint16_t write_sequence;
+    uint16_t write_ack;
+    uint32_t write_ack_bits[RELIABLE_ACK_BITS_WORDS];
+
+    uint16_t read_sequence;
+    uint16_t read_ack;
+    uint32_t read_ack_bits[RELIABLE_ACK_BITS_WORDS];
+    int read_ack_format;
+
+    uint8_t packet_data[RELIABLE_MAX_PACKET_HEADER_BYTES];
+
+    memset( write_ack_bits, 0, sizeof( write_ack_bits ) );
+
+    // worst case, sequence and ack are far apart, no packets acked.
+
+    write_sequence = 10000;
+    write_ack = 100;
+    write_ack_bits[0] = 0;
+
+    int bytes_written = reliable_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits, RELIABLE_ACK_FORMAT_32_BITS );
+
+    check( bytes_written == 1 + 2 + 2 + 4 );
+
+    int bytes_read = reliable_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, read_ack_bits, &read_ack_format );
+
+    check( bytes_read == bytes_written );
+
+    check( read_sequence == write_sequence );
+    check( read_ack == write_ack );
+    check( memcmp( read_ack_bits, write_ack_bits, sizeof( write_ack_bits ) ) == 0 );
+    check( read_ack_format == RELIABLE_ACK_FORMAT_32_BITS );
+
+    // rare case. sequence and ack are far apart, significant # of acks are missing
+
+    write_sequence = 10000;
+    write_ack = 100;
+    write_ack_bits[0] = 0xFEFEFFFE;
+
+    bytes_written = reliable_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits, RELIABLE_ACK_FORMAT_32_BITS );
+
+    check( bytes_written == 1 + 2 + 2 + 3 );
+
+    bytes_read = reliable_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, read_ack_bits, &read_ack_format );
+
+    check( bytes_read == bytes_written );
+
+    check( read_sequence == write_sequence );
+    check( read_ack == write_ack );
+    check( memcmp( read_ack_bits, write_ack_bits, sizeof( write_ack_bits ) ) == 0 );
+
+    // common case under packet loss. sequence and ack are close together, some acks are missing
+
+    write_sequence = 200;
+    write_ack = 100;
+    write_ack_bits[0] = 0xFFFEFFFF;
+
+    bytes_written = reliable_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits, RELIABLE_ACK_FORMAT_32_BITS );
+
+    check( bytes_written == 1 + 2 + 1 + 1 );
+
+    bytes_read = reliable_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, read_ack_bits, &read_ack_format );
+
+    check( bytes_read == bytes_written );
+
+    check( read_sequence == write_sequence );
+    check( read_ack == write_ack );
+    check( memcmp( read_ack_bits, write_ack_bits, sizeof( write_ack_bits ) ) == 0 );
+
+    // ideal case. no packet loss.
+
+    write_sequence = 200;
+    write_ack = 100;
+    write_ack_bits[0] = 0xFFFFFFFF;
+
+    bytes_written = reliable_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits, RELIABLE_ACK_FORMAT_32_BITS );
+
+    check( bytes_written == 1 + 2 + 1 );
+
+    bytes_read = reliable_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, read_ack_bits, &read_ack_format );
+
+    check( bytes_read == bytes_written );
+
+    check( read_sequence == write_sequence );
+    check( read_ack == write_ack );
+    check( memcmp( read_ack_bits, write_ack_bits, sizeof( write_ack_bits ) ) == 0 );
+
+    // advertising the wider formats costs nothing on the wire
+
+    bytes_written = reliable_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits, RELIABLE_ACK_FORMAT_32_BITS_EXTENDED );
+
+    check( bytes_written == 1 + 2 + 1 );
+
+    bytes_read = reliable_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, read_ack_bits, &read_ack_format );
+
+    check( bytes_read == bytes_written );
+
+    check( memcmp( read_ack_bits, write_ack_bits, sizeof( write_ack_bits ) ) == 0 );
+    check( read_ack_format == RELIABLE_ACK_FORMAT_32_BITS_EXTENDED );
+
+    // 64 bit acks. only the bytes with missing acks are written, after one more byte of flags
+
+    write_ack_bits[0] = 0xFFFEFFFF;
+    write_ack_bits[1] = 0x7FFFFFFF;
+
+    bytes_written = reliable_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits, RELIABLE_ACK_FORMAT_64_BITS );
+
+    check( bytes_written == 1 + 2 + 1 + 1 + 2 );
+
+    bytes_read = reliable_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, read_ack_bits, &read_ack_format );
+
+    check( bytes_read == bytes_written );
+
+    check( read_sequence == write_sequence );
+    check( read_ack == write_ack );
+    check( memcmp( read_ack_bits, write_ack_bits, sizeof( write_ack_bits ) ) == 0 );
+    check( read_ack_format == RELIABLE_ACK_FORMAT_64_BITS );
+
+    // 128 bit acks with every packet acked are as small as 32 bit acks, plus the flags
+
+    write_ack_bits[0] = 0xFFFFFFFF;
+    write_ack_bits[1] = 0xFFFFFFFF;
+    write_ack_bits[2] = 0xFFFFFFFF;
+    write_ack_bits[3] = 0xFFFFFFFF;
+
+    bytes_written = reliable_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits, RELIABLE_ACK_FORMAT_128_BITS );
+
+    check( bytes_written == 1 + 2 + 1 + 2 );
+
+    bytes_read = reliable_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, read_ack_bits, &read_ack_format );
+
+    check( bytes_read == bytes_written );
+
+    check( memcmp( read_ack_bits, write_ack_bits, sizeof( write_ack_bits ) ) == 0 );
+    check( read_ack_format == RELIABLE_ACK_FORMAT_128_BITS );
+
+    // worst case for 128 bit acks is the largest header there is
+
+    write_sequence = 10000;
+    write_ack = 100;
+    write_ack_bits[0] = 0x12345678;
+    write_ack_bits[1] = 0;
+    write_ack_bits[2] = 0xFEFEFEFE;
+    write_ack_bits[3] = 0x80000001;
+
+    bytes_written = reliable_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits, RELIABLE_ACK_FORMAT_128_BITS );
+
+    check( bytes_written == RELIABLE_MAX_PACKET_HEADER_BYTES );
+
+    bytes_read = reliable_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, read_ack_bits, &read_ack_format );
+
+    check( bytes_read == bytes_written );
+
+    check( read_sequence == write_sequence );
+    check( read_ack == write_ack );
+    check( memcmp( read_ack_bits, write_ack_bits, sizeof( write_ack_bits ) ) == 0 );
+
+    // truncated headers are rejected
+
+    int i;
+    for ( i = 0; i < bytes_written; ++i )
+    {
+        check( reliable_read_packet_header( "test_packet_header", packet_data, i, &read_sequence, &read_ack, read_ack_bits, &read_ack_format ) < 0 );
+    }
+
+    // a 32 bit header only acks 32 packets, whatever the other bits were on the sending side
+
+    bytes_written = reliable_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits, RELIABLE_ACK_FORMAT_32_BITS );
+
+    bytes_read = reliable_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, read_ack_bits, &read_ack_format );
+
+    check( bytes_read == bytes_written );
+
+    check( read_ack_bits[0] == write_ack_bits[0] );
+    check( read_ack_bits[1] == 0 );
+    check( read_ack_bits[2] == 0 );
+    check( read_ack_bits[3] == 0 );
+}
+
+struct test_context_t
+{
+    int drop;
+    int allow_packets;
+    int num_transmit_packets_calls;
+    int num_transmit_packet_in_place_calls;
+    struct reliable_endpoint_t * sender;
+    struct reliable_endpoint_t * receiver;
+};
+
+void test_default_context( struct test_context_t * context )
+{
+    memset( context, 0, sizeof( *context ) );
+    context->allow_packets = -1;
+}
+
+static void test_transmit_packet_function( void * _context, uint64_t id, uint16_t sequence, uint8_t * packet_data, int packet_bytes )
+{
+    (void) sequence;
+
+    struct test_context_t * context = (struct test_context_t*) _context;
+
+    if ( context->drop )
+    {
+        return;
+    }
+
+    if ( context->allow_packets >= 0 )
+    {
+        if ( context->allow_packets == 0 )
+        {
+            return;
+        }
+
+        context->allow_packets--;
+    }
+
+    if ( id == 0 )
+    {
+        reliable_endpoint_receive_packet( context->receiver, packet_data, packet_bytes );
+    }
+    else if ( id == 1 )
+    {
+        reliable_endpoint_receive_packet( context->sender, packet_data, packet_bytes );
+    }
+}
+
+static void test_transmit_packets_function( void * _context, uint64_t id, uint16_t sequence, uint8_t ** packet_data, int * packet_bytes, int num_packets )
+{
+    struct test_context_t * context = (struct test_context_t*) _context;
+
+    context->num_transmit_packets_calls++;
+
+    int i;
+    for ( i = 0; i < num_packets; ++i )
+    {
+        test_transmit_packet_function( _context, id, sequence, packet_data[i], packet_bytes[i] );
+    }
+}
+
+static void test_transmit_packet_in_place_function( void * _context, uint64_t id, uint16_t sequence, uint8_t * packet_data, int packet_bytes )
+{
+    struct test_context_t * context = (struct test_context_t*) _context;
+
+    context->num_transmit_packet_in_place_calls++;
+
+    test_transmit_packet_function( _context, id, sequence, packet_data, packet_bytes );
+}
+
+static int test_process_packet_function( void * _context, uint64_t id, uint16_t sequence, uint8_t * packet_data, int packet_bytes )
+{
+    struct test_context_t * context = (struct test_context_t*) _context;
+
+    (void) context;
+    (void) id;
+    (void) sequence;
+    (void) packet_data;
+    (void) packet_bytes;
+
+    return 1;
+}
+
+#define TEST_ACKS_NUM_ITERATIONS 256
+
+static void test_acks()
+{
+    double time = 100.0;
+
+    struct test_context_t context;
+    test_default_context( &context );
+    
+    struct reliable_config_t sender_config;
+    struct reliable_config_t receiver_config;
+
+    reliable_default_config( &sender_config );
+    reliable_default_config( &receiver_config );
+
+    sender_config.context = &context;
+    sender_config.id = 0;
+    sender_config.transmit_packet_function = &test_transmit_packet_function;
+    sender_config.process_packet_function = &test_process_packet_function;
+
+    receiver_config.context = &context;
+    receiver_config.id = 1;
+    receiver_config.transmit_packet_function = &test_transmit_packet_function;
+    receiver_config.process_packet_function = &test_process_packet_function;
+
+    context.sender = reliable_endpoint_create( &sender_config, time );
+    context.receiver = reliable_endpoint_create( &receiver_config, time );
+
+    double delta_time = 0.01;
+
+    int i;
+    for ( i = 0; i < TEST_ACKS_NUM_ITERATIONS; ++i )
+    {
+        uint8_t dummy_packet[8];
+        memset( dummy_packet, 0, sizeof( dummy_packet ) );
+
+        reliable_endpoint_send_packet( context.sender, dummy_packet, sizeof( dummy_packet ) );
+        reliable_endpoint_send_packet( context.receiver, dummy_packet, sizeof( dummy_packet ) );
+
+        reliable_endpoint_update( context.sender, time );
+        reliable_endpoint_update( context.receiver, time );
+
+        time += delta_time;
+    }
+
+    uint8_t sender_acked_packet[TEST_ACKS_NUM_ITERATIONS];
+    memset( sender_acked_packet, 0, sizeof( sender_acked_packet ) );
+    int sender_num_acks;
+    uint16_t * sender_acks = reliable_endpoint_get_acks( context.sender, &sender_num_acks );
+    for ( i = 0; i < sender_num_acks; ++i )
+    {
+        if ( sender_acks[i] < TEST_ACKS_NUM_ITERATIONS )
+        {
+            sender_acked_packet[sender_acks[i]] = 1;
+        }
+    }
+    for ( i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; ++i )
+    {
+        check( sender_acked_packet[i] == 1 );
+    }
+
+    uint8_t receiver_acked_packet[TEST_ACKS_NUM_ITERATIONS];
+    memset( receiver_acked_packet, 0, sizeof( receiver_acked_packet ) );
+    int receiver_num_acks;
+    uint16_t * receiver_acks = reliable_endpoint_get_acks( context.receiver, &receiver_num_acks );
+    for ( i = 0; i < receiver_num_acks; ++i )
+    {
+        if ( receiver_acks[i] < TEST_ACKS_NUM_ITERATIONS )
+            receiver_acked_packet[receiver_acks[i]] = 1;
+    }
+    for ( i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; ++i )
+    {
+        check( receiver_acked_packet[i] == 1 );
+    }
+
+    reliable_endpoint_destroy( context.sender );
+    reliable_endpoint_destroy( context.receiver );
+}
+
+static void test_acks_packet_loss()
+{
+    double time = 100.0;
+
+    struct test_context_t context;
+    test_default_context( &context );
+    
+    struct reliable_config_t sender_config;
+    struct reliable_config_t receiver_config;
+
+    reliable_default_config( &sender_config );
+    reliable_default_config( &receiver_config );
+
+    sender_config.context = &context;
+    sender_config.id = 0;
+    sender_config.transmit_packet_function = &test_transmit_packet_function;
+    sender_config.process_packet_function = &test_process_packet_function;
+
+    receiver_config.context = &context;
+    receiver_config.id = 1;
+    receiver_config.transmit_packet_function = &test_transmit_packet_function;
+    receiver_config.process_packet_function = &test_process_packet_function;
+
+    context.sender = reliable_endpoint_create( &sender_config, time );
+    context.receiver = reliable_endpoint_create( &receiver_config, time );
+
+    const double delta_time = 0.1f;
+
+    int i;
+    for ( i = 0; i < TEST_ACKS_NUM_ITERATIONS; ++i )
+    {
+        uint8_t dummy_packet[8];
+        memset( dummy_packet, 0, sizeof( dummy_packet ) );
+
+        context.drop = ( i % 2 );
+
+        reliable_endpoint_send_packet( context.sender, dummy_packet, sizeof( dummy_packet ) );
+        reliable_endpoint_send_packet( context.receiver, dummy_packet, sizeof( dummy_packet ) );
+
+        reliable_endpoint_update( context.sender, time );
+        reliable_endpoint_update( context.receiver, time );
+
+        time += delta_time;
+    }
+
+    uint8_t sender_acked_packet[TEST_ACKS_NUM_ITERATIONS];
+    memset( sender_acked_packet, 0, sizeof( sender_acked_packet ) );
+    int sender_num_acks;
+    uint16_t * sender_acks = reliable_endpoint_get_acks( context.sender, &sender_num_acks );
+    for ( i = 0; i < sender_num_acks; ++i )
+    {
+        if ( sender_acks[i] < TEST_ACKS_NUM_ITERATIONS )
+        {
+            sender_acked_packet[sender_acks[i]] = 1;
+        }
+    }
+    for ( i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; ++i )
+    {
+        check( sender_acked_packet[i] == (i+1) % 2 );
+    }
+
+    uint8_t receiver_acked_packet[TEST_ACKS_NUM_ITERATIONS];
+    memset( receiver_acked_packet, 0, sizeof( receiver_acked_packet ) );
+    int receiver_num_acks;
+    uint16_t * receiver_acks = reliable_endpoint_get_acks( context.sender, &receiver_num_acks );
+    for ( i = 0; i < receiver_num_acks; ++i )
+    {
+        if ( receiver_acks[i] < TEST_ACKS_NUM_ITERATIONS )
+        {
+            receiver_acked_packet[receiver_acks[i]] = 1;
+        }
+    }
+    for ( i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; ++i )
     {
-        if ( source[i] == '\0' )
-            break;
-        dest[i] = source[i];
+        check( receiver_acked_packet[i] == (i+1) % 2 );
     }
+
+    reliable_endpoint_destroy( context.sender );
+    reliable_endpoint_destroy( context.receiver );
 }
 
-// ---------------------------------------------------------------
+#define TEST_MAX_PACKET_BYTES (4*1024)
 
-#if RELIABLE_ENABLE_TESTS
+static void generate_packet_data_with_size( uint16_t sequence, uint8_t * packet_data, int packet_bytes )
+{
+    reliable_assert( packet_bytes >= 2 );
+    reliable_assert( packet_bytes <= TEST_MAX_PACKET_BYTES );
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <memory.h>
+    packet_data[0] = (uint8_t) ( sequence & 0xFF );
+    packet_data[1] = (uint8_t) ( (sequence>>8) & 0xFF );
+    int i;
+    for ( i = 2; i < packet_bytes; ++i )
+    {
+        packet_data[i] = (uint8_t) ( ( (int)i + sequence ) % 256 );
+    }
+}
 
-static void check_handler( RELIABLE_CONST char * condition, 
-                           RELIABLE_CONST char * function,
-                           RELIABLE_CONST char * file,
-                           int line )
+static int generate_packet_data( uint16_t sequence, uint8_t * packet_data )
 {
-    printf( "check failed: ( %s ), function %s, file %s, line %d\n", condition, function, file, line );
-#ifdef RELIABLE_DEBUG
-    #if defined( __GNUC__ )
-        __builtin_trap();
-    #elif defined( _MSC_VER )
-        __debugbreak();
-    #endif
-#endif
-    exit( 1 );
+    int packet_bytes = ( ( (int)sequence * 1023 ) % ( TEST_MAX_PACKET_BYTES - 2 ) ) + 2;
+    generate_packet_data_with_size( sequence, packet_data, packet_bytes );
+    return packet_bytes;
 }
 
-#define check( condition )                                                                                      \
-do                                                                                                              \
-{                                                                                                               \
-    if ( !(condition) )                                                                                         \
-    {                                                                                                           \
-        check_handler( #condition, (RELIABLE_CONST char*) __FUNCTION__, __FILE__, __LINE__ );                   \
-    }                                                                                                           \
-} while(0)
-
-static void test_endian()
+static void validate_packet_data( uint8_t * packet_data, int packet_bytes )
 {
-    uint32_t value = 0x11223344;
-
-    char * bytes = (char*) &value;
-
-#if RELIABLE_LITTLE_ENDIAN
+    reliable_assert( packet_bytes >= 2 );
+    reliable_assert( packet_bytes <= TEST_MAX_PACKET_BYTES );
+    uint16_t sequence = 0;
+    sequence |= (uint16_t) packet_data[0];
+    sequence |= ( (uint16_t) packet_data[1] ) << 8;
+    check( packet_bytes == ( ( (int)sequence * 1023 ) % ( TEST_MAX_PACKET_BYTES - 2 ) ) + 2 );
+    int i;
+    for ( i = 2; i < packet_bytes; ++i )
+    {
+        check( packet_data[i] == (uint8_t) ( ( (int)i + sequence ) % 256 ) );
+    }
+}
 
-    check( bytes[0] == 0x44 );
-    check( bytes[1] == 0x33 );
-    check( bytes[2] == 0x22 );
-    check( bytes[3] == 0x11 );
+static int test_process_packet_function_validate( void * context, uint64_t id, uint16_t sequence, uint8_t * packet_data, int packet_bytes )
+{
+    reliable_assert( packet_data );
+    reliable_assert( packet_bytes > 0 );
+    reliable_assert( packet_bytes <= TEST_MAX_PACKET_BYTES );
 
-#else // #if RELIABLE_LITTLE_ENDIAN
+    (void) context;
+    (void) id;
+    (void) sequence;
 
-    check( bytes[3] == 0x44 );
-    check( bytes[2] == 0x33 );
-    check( bytes[1] == 0x22 );
-    check( bytes[0] == 0x11 );
+    validate_packet_data( packet_data, packet_bytes );
 
-#endif // #if RELIABLE_LITTLE_ENDIAN
+    return 1;
 }
 
-struct test_sequence_data_t
+static int generate_packet_data_large( uint8_t* packet_data )
 {
-    uint16_t sequence;
-};
+    int data_bytes = TEST_MAX_PACKET_BYTES - 2;
+    reliable_assert( data_bytes >= 2) ;
+    reliable_assert( data_bytes <= (1 << 16) );
 
-#define TEST_SEQUENCE_BUFFER_SIZE 256
+    packet_data[0] = (uint8_t) (data_bytes & 0xFF);
+    packet_data[1] = (uint8_t) ( (data_bytes >> 8) & 0xFF );
+    int i;
+    for ( i = 2; i < data_bytes; ++i )
+    {
+        packet_data[i] = (uint8_t) ( i % 256 );
+    }
+    return data_bytes + 2;
+}
 
-static void test_sequence_buffer()
+static int test_process_packet_function_validate_large( void * context, uint64_t id, uint16_t sequence, uint8_t * packet_data, int packet_bytes )
 {
-    struct reliable_sequence_buffer_t * sequence_buffer = reliable_sequence_buffer_create( TEST_SEQUENCE_BUFFER_SIZE, 
-                                                                                           sizeof( struct test_sequence_data_t ), 
-                                                                                           NULL, 
-                                                                                           NULL, 
-                                                                                           NULL );
+    reliable_assert( packet_data );
+    reliable_assert( packet_bytes >= 2 );
+    reliable_assert( packet_bytes <= TEST_MAX_PACKET_BYTES );
 
-    check( sequence_buffer );
-    check( sequence_buffer->sequence == 0 );
-    check( sequence_buffer->num_entries == TEST_SEQUENCE_BUFFER_SIZE );
-    check( sequence_buffer->entry_stride == sizeof( struct test_sequence_data_t ) );
+    (void) context;
+    (void) id;
+    (void) sequence;
 
+    uint16_t data_bytes = 0;
+    data_bytes |= (uint16_t) packet_data[0];
+    data_bytes |= ( (uint16_t) packet_data[1] ) << 8;
+    check( packet_bytes == data_bytes + 2 );
     int i;
-    for ( i = 0; i < TEST_SEQUENCE_BUFFER_SIZE; ++i )
-    {
-        check( reliable_sequence_buffer_find( sequence_buffer, ((uint16_t)i) ) == NULL );
-    }                                                                      
-
-    for ( i = 0; i <= TEST_SEQUENCE_BUFFER_SIZE*4; ++i )
+    for ( i = 2; i < data_bytes; ++i )
     {
-        struct test_sequence_data_t * entry = (struct test_sequence_data_t*) reliable_sequence_buffer_insert( sequence_buffer, ((uint16_t)i) );
-        check( entry );
-        entry->sequence = (uint16_t) i;
-        check( sequence_buffer->sequence == i + 1 );
+        check( packet_data[i] == (uint8_t) ( i  % 256 ) );
     }
 
-    for ( i = 0; i <= TEST_SEQUENCE_BUFFER_SIZE; ++i )
-    {
-        struct test_sequence_data_t * entry = (struct test_sequence_data_t*) reliable_sequence_buffer_insert( sequence_buffer, ((uint16_t)i) );
-        check( entry == NULL );
-    }    
+    return 1;
+}
 
-    int index = TEST_SEQUENCE_BUFFER_SIZE * 4;
-    for ( i = 0; i < TEST_SEQUENCE_BUFFER_SIZE; ++i )
-    {
-        struct test_sequence_data_t * entry = (struct test_sequence_data_t*) reliable_sequence_buffer_find( sequence_buffer, (uint16_t) index );
-        check( entry );
-        check( entry->sequence == (uint32_t) index );
-        index--;
-    }
+void test_packets()
+{
+    double time = 100.0;
 
-    reliable_sequence_buffer_reset( sequence_buffer );
+    struct test_context_t context;
+    test_default_context( &context );
+    
+    struct reliable_config_t sender_config;
+    struct reliable_config_t receiver_config;
 
-    check( sequence_buffer );
-    check( sequence_buffer->sequence == 0 );
-    check( sequence_buffer->num_entries == TEST_SEQUENCE_BUFFER_SIZE );
-    check( sequence_buffer->entry_stride == sizeof( struct test_sequence_data_t ) );
+    reliable_default_config( &sender_config );
+    reliable_default_config( &receiver_config );
 
-    for ( i = 0; i < TEST_SEQUENCE_BUFFER_SIZE; ++i )
-    {
-        check( reliable_sequence_buffer_find( sequence_buffer, (uint16_t) i ) == NULL );
-    }
+    sender_config.fragment_above = 500;
+    receiver_config.fragment_above = 500;
 
-    reliable_sequence_buffer_destroy( sequence_buffer );
-}
+    reliable_copy_string( sender_config.name, "sender", sizeof( sender_config.name ) );
+    sender_config.context = &context;
+    sender_config.id = 0;
+    sender_config.transmit_packet_function = &test_transmit_packet_function;
+    sender_config.process_packet_function = &test_process_packet_function_validate;
 
-static void test_generate_ack_bits()
-{
-    struct reliable_sequence_buffer_t * sequence_buffer = reliable_sequence_buffer_create( TEST_SEQUENCE_BUFFER_SIZE, 
-                                                                                           sizeof( struct test_sequence_data_t ), 
-                                                                                           NULL, 
-                                                                                           NULL, 
-                                                                                           NULL );
+    reliable_copy_string( receiver_config.name, "receiver", sizeof( receiver_config.name ) );
+    receiver_config.context = &context;
+    receiver_config.id = 1;
+    receiver_config.transmit_packet_function = &test_transmit_packet_function;
+    receiver_config.process_packet_function = &test_process_packet_function_validate;
 
-    uint16_t ack = 0;
-    uint32_t ack_bits = 0xFFFFFFFF;
+    context.sender = reliable_endpoint_create( &sender_config, time );
+    context.receiver = reliable_endpoint_create( &receiver_config, time );
 
-    reliable_sequence_buffer_generate_ack_bits( sequence_buffer, &ack, &ack_bits );
-    check( ack == 0xFFFF );
-    check( ack_bits == 0 );
+    double delta_time = 0.1;
 
     int i;
-    for ( i = 0; i <= TEST_SEQUENCE_BUFFER_SIZE; ++i )
+    for ( i = 0; i < 16; ++i )
     {
-        reliable_sequence_buffer_insert( sequence_buffer, (uint16_t) i );
-    }
-
-    reliable_sequence_buffer_generate_ack_bits( sequence_buffer, &ack, &ack_bits );
-    check( ack == TEST_SEQUENCE_BUFFER_SIZE );
-    check( ack_bits == 0xFFFFFFFF );
+        {
+            uint8_t packet_data[TEST_MAX_PACKET_BYTES];
+            uint16_t sequence = reliable_endpoint_next_packet_sequence( context.sender );
+            int packet_bytes = generate_packet_data( sequence, packet_data );
+            reliable_endpoint_send_packet( context.sender, packet_data, packet_bytes );
+        }
 
-    reliable_sequence_buffer_reset( sequence_buffer );
+        {
+            uint8_t packet_data[TEST_MAX_PACKET_BYTES];
+            uint16_t sequence = reliable_endpoint_next_packet_sequence( context.sender );
+            int packet_bytes = generate_packet_data( sequence, packet_data );
+            reliable_endpoint_send_packet( context.sender, packet_data, packet_bytes );
+        }
 
-    uint16_t input_acks[] = { 1, 5, 9, 11 };
-    int input_num_acks = sizeof( input_acks ) / sizeof( uint16_t );
-    for ( i = 0; i < input_num_acks; ++i )
-    {
-        reliable_sequence_buffer_insert( sequence_buffer, input_acks[i] );
-    }
+        reliable_endpoint_update( context.sender, time );
+        reliable_endpoint_update( context.receiver, time );
 
-    reliable_sequence_buffer_generate_ack_bits( sequence_buffer, &ack, &ack_bits );
+        reliable_endpoint_clear_acks( context.sender );
+        reliable_endpoint_clear_acks( context.receiver );
 
-    check( ack == 11 );
-    check( ack_bits == ( 1 | (1<<(11-9)) | (1<<(11-5)) | (1<<(11-1)) ) );
+        time += delta_time;
+    }
 
-    reliable_sequence_buffer_destroy( sequence_buffer );
+    reliable_endpoint_destroy( context.sender );
+    reliable_endpoint_destroy( context.receiver );
 }
 
-static void test_packet_header()
+void test_large_packets()
 {
-    uint16_t write_sequence;
-    uint16_t write_ack;
-    uint32_t write_ack_bits;
+    double time = 100.0;
+
+    struct test_context_t context;
+    test_default_context( &context );
 
-    uint16_t read_sequence;
-    uint16_t read_ack;
-    uint32_t read_ack_bits;
+    struct reliable_config_t sender_config;
+    struct reliable_config_t receiver_config;
 
-    uint8_t packet_data[RELIABLE_MAX_PACKET_HEADER_BYTES];
+    reliable_default_config( &sender_config );
+    reliable_default_config( &receiver_config );
 
-    // worst case, sequence and ack are far apart, no packets acked.
+    sender_config.max_packet_size = TEST_MAX_PACKET_BYTES;
+    receiver_config.max_packet_size = TEST_MAX_PACKET_BYTES;
 
-    write_sequence = 10000;
-    write_ack = 100;
-    write_ack_bits = 0;
+    sender_config.fragment_above = TEST_MAX_PACKET_BYTES;
+    receiver_config.fragment_above = TEST_MAX_PACKET_BYTES;
 
-    int bytes_written = reliable_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits );
+    reliable_copy_string( sender_config.name, "sender", sizeof( sender_config.name ) );
+    sender_config.context = &context;
+    sender_config.id = 0;
+    sender_config.transmit_packet_function = &test_transmit_packet_function;
+    sender_config.process_packet_function = &test_process_packet_function_validate_large;
 
-    check( bytes_written == RELIABLE_MAX_PACKET_HEADER_BYTES );
+    reliable_copy_string( receiver_config.name, "receiver", sizeof( receiver_config.name ) );
+    receiver_config.context = &context;
+    receiver_config.id = 1;
+    receiver_config.transmit_packet_function = &test_transmit_packet_function;
+    receiver_config.process_packet_function = &test_process_packet_function_validate_large;
 
-    int bytes_read = reliable_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, &read_ack_bits );
+    context.sender = reliable_endpoint_create( &sender_config, time );
+    context.receiver = reliable_endpoint_create( &receiver_config, time );
 
-    check( bytes_read == bytes_written );
+    {
+        uint8_t packet_data[TEST_MAX_PACKET_BYTES];
+        int packet_bytes = generate_packet_data_large( packet_data );
+        check( packet_bytes == TEST_MAX_PACKET_BYTES );
+        reliable_endpoint_send_packet( context.sender, packet_data, packet_bytes );
+    }
 
-    check( read_sequence == write_sequence );
-    check( read_ack == write_ack );
-    check( read_ack_bits == write_ack_bits );
+    reliable_endpoint_update( context.sender, time );
+    reliable_endpoint_update( context.receiver, time );
 
-    // rare case. sequence and ack are far apart, significant # of acks are missing
+    reliable_endpoint_clear_acks( context.sender );
+    reliable_endpoint_clear_acks( context.receiver );
 
-    write_sequence = 10000;
-    write_ack = 100;
-    write_ack_bits = 0xFEFEFFFE;
+    RELIABLE_CONST uint64_t * receiver_counters = reliable_endpoint_counters( context.receiver );
+    check( receiver_counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_TOO_LARGE_TO_RECEIVE] == 0 );
+    check( receiver_counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_RECEIVED] == 1 );
 
-    bytes_written = reliable_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits );
+    reliable_endpoint_destroy( context.sender );
+    reliable_endpoint_destroy( context.receiver );
+}
 
-    check( bytes_written == 1 + 2 + 2 + 3 );
+void test_large_packets_transmitted_together()
+{
+    double time = 100.0;
 
-    bytes_read = reliable_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, &read_ack_bits );
+    struct test_context_t context;
+    test_default_context( &context );
 
-    check( bytes_read == bytes_written );
+    struct reliable_config_t sender_config;
+    struct reliable_config_t receiver_config;
 
-    check( read_sequence == write_sequence );
-    check( read_ack == write_ack );
-    check( read_ack_bits == write_ack_bits );
+    reliable_default_config( &sender_config );
+    reliable_default_config( &receiver_config );
 
-    // common case under packet loss. sequence and ack are close together, some acks are missing
+    sender_config.max_packet_size = TEST_MAX_PACKET_BYTES;
+    receiver_config.max_packet_size = TEST_MAX_PACKET_BYTES;
 
-    write_sequence = 200;
-    write_ack = 100;
-    write_ack_bits = 0xFFFEFFFF;
+    reliable_copy_string( sender_config.name, "sender", sizeof( sender_config.name ) );
+    sender_config.context = &context;
+    sender_config.id = 0;
+    sender_config.transmit_packet_function = &test_transmit_packet_function;
+    sender_config.transmit_packets_function = &test_transmit_packets_function;
+    sender_config.process_packet_function = &test_process_packet_function_validate_large;
 
-    bytes_written = reliable_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits );
+    reliable_copy_string( receiver_config.name, "receiver", sizeof( receiver_config.name ) );
+    receiver_config.context = &context;
+    receiver_config.id = 1;
+    receiver_config.transmit_packet_function = &test_transmit_packet_function;
+    receiver_config.process_packet_function = &test_process_packet_function_validate_large;
 
-    check( bytes_written == 1 + 2 + 1 + 1 );
+    context.sender = reliable_endpoint_create( &sender_config, time );
+    context.receiver = reliable_endpoint_create( &receiver_config, time );
 
-    bytes_read = reliable_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, &read_ack_bits );
+    {
+        uint8_t packet_data[TEST_MAX_PACKET_BYTES];
+        int packet_bytes = generate_packet_data_large( packet_data );
+        check( packet_bytes == TEST_MAX_PACKET_BYTES );
+        reliable_endpoint_send_packet( context.sender, packet_data, packet_bytes );
+    }
 
-    check( bytes_read == bytes_written );
+    // every fragment of the packet went out through a single call
 
-    check( read_sequence == write_sequence );
-    check( read_ack == write_ack );
-    check( read_ack_bits == write_ack_bits );
+    check( context.num_transmit_packets_calls == 1 );
 
-    // ideal case. no packet loss.
+    RELIABLE_CONST uint64_t * sender_counters = reliable_endpoint_counters( context.sender );
+    check( sender_counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_SENT] > 1 );
 
-    write_sequence = 200;
-    write_ack = 100;
-    write_ack_bits = 0xFFFFFFFF;
+    RELIABLE_CONST uint64_t * receiver_counters = reliable_endpoint_counters( context.receiver );
+    check( receiver_counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_RECEIVED] == sender_counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_SENT] );
+    check( receiver_counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_RECEIVED] == 1 );
 
-    bytes_written = reliable_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits );
+    reliable_endpoint_destroy( context.sender );
+    reliable_endpoint_destroy( context.receiver );
+}
 
-    check( bytes_written == 1 + 2 + 1 );
+void test_packets_sent_in_place()
+{
+    double time = 100.0;
 
-    bytes_read = reliable_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, &read_ack_bits );
+    struct test_context_t context;
+    test_default_context( &context );
 
-    check( bytes_read == bytes_written );
+    struct reliable_config_t sender_config;
+    struct reliable_config_t receiver_config;
 
-    check( read_sequence == write_sequence );
-    check( read_ack == write_ack );
-    check( read_ack_bits == write_ack_bits );
-}
+    reliable_default_config( &sender_config );
+    reliable_default_config( &receiver_config );
 
-struct test_context_t
-{
-    int drop;
-    int allow_packets;
-    struct reliable_endpoint_t * sender;
-    struct reliable_endpoint_t * receiver;
-};
+    sender_config.fragment_above = 500;
+    receiver_config.fragment_above = 500;
 
-void test_default_context( struct test_context_t * context )
-{
-    memset( context, 0, sizeof( *context ) );
-    context->allow_packets = -1;
-}
+    reliable_copy_string( sender_config.name, "sender", sizeof( sender_config.name ) );
+    sender_config.context = &context;
+    sender_config.id = 0;
+    sender_config.transmit_packet_function = &test_transmit_packet_function;
+    sender_config.transmit_packet_in_place_function = &test_transmit_packet_in_place_function;
+    sender_config.process_packet_function = &test_process_packet_function_validate;
 
-static void test_transmit_packet_function( void * _context, uint64_t id, uint16_t sequence, uint8_t * packet_data, int packet_bytes )
-{
-    (void) sequence;
+    reliable_copy_string( receiver_config.name, "receiver", sizeof( receiver_config.name ) );
+    receiver_config.context = &context;
+    receiver_config.id = 1;
+    receiver_config.transmit_packet_function = &test_transmit_packet_function;
+    receiver_config.process_packet_function = &test_process_packet_function_validate;
 
-    struct test_context_t * context = (struct test_context_t*) _context;
+    context.sender = reliable_endpoint_create( &sender_config, time );
+    context.receiver = reliable_endpoint_create( &receiver_config, time );
 
-    if ( context->drop )
-    {
-        return;
-    }
+    int num_packets = 0;
+    int num_small_packets = 0;
 
-    if ( context->allow_packets >= 0 )
+    int i;
+    for ( i = 0; i < 32; ++i )
     {
-        if ( context->allow_packets == 0 )
-        {
-            return;
-        }
+        uint8_t buffer[RELIABLE_MAX_PACKET_HEADER_BYTES + TEST_MAX_PACKET_BYTES];
+        uint8_t * packet_data = buffer + RELIABLE_MAX_PACKET_HEADER_BYTES;
+        uint16_t sequence = reliable_endpoint_next_packet_sequence( context.sender );
+        int packet_bytes = generate_packet_data( sequence, packet_data );
+        reliable_endpoint_send_packet_in_place( context.sender, packet_data, packet_bytes );
 
-        context->allow_packets--;
-    }
+        num_packets++;
+        if ( packet_bytes <= sender_config.fragment_above )
+            num_small_packets++;
 
-    if ( id == 0 )
-    {
-        reliable_endpoint_receive_packet( context->receiver, packet_data, packet_bytes );
-    }
-    else if ( id == 1 )
-    {
-        reliable_endpoint_receive_packet( context->sender, packet_data, packet_bytes );
+        reliable_endpoint_update( context.sender, time );
+        reliable_endpoint_update( context.receiver, time );
+
+        time += 0.1;
     }
-}
 
-static int test_process_packet_function( void * _context, uint64_t id, uint16_t sequence, uint8_t * packet_data, int packet_bytes )
-{
-    struct test_context_t * context = (struct test_context_t*) _context;
+    // small packets went out in place, large packets fell back to fragmentation, and all of them arrived intact
 
-    (void) context;
-    (void) id;
-    (void) sequence;
-    (void) packet_data;
-    (void) packet_bytes;
+    check( num_small_packets > 0 );
+    check( num_small_packets < num_packets );
+    check( context.num_transmit_packet_in_place_calls == num_small_packets );
 
-    return 1;
-}
+    RELIABLE_CONST uint64_t * receiver_counters = reliable_endpoint_counters( context.receiver );
+    check( receiver_counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_RECEIVED] == (uint64_t) num_packets );
 
-#define TEST_ACKS_NUM_ITERATIONS 256
+    reliable_endpoint_destroy( context.sender );
+    reliable_endpoint_destroy( context.receiver );
+}
 
-static void test_acks()
+void test_sequence_buffer_rollover()
 {
     double time = 100.0;
 
@@ -1835,11 +3328,16 @@ static void test_acks()
     reliable_default_config( &sender_config );
     reliable_default_config( &receiver_config );
 
+    sender_config.fragment_above = 500;
+    receiver_config.fragment_above = 500;
+
+    reliable_copy_string( sender_config.name, "sender", sizeof( sender_config.name ) );
     sender_config.context = &context;
     sender_config.id = 0;
     sender_config.transmit_packet_function = &test_transmit_packet_function;
     sender_config.process_packet_function = &test_process_packet_function;
 
+    reliable_copy_string( receiver_config.name, "receiver", sizeof( receiver_config.name ) );
     receiver_config.context = &context;
     receiver_config.id = 1;
     receiver_config.transmit_packet_function = &test_transmit_packet_function;
@@ -1848,63 +3346,84 @@ static void test_acks()
     context.sender = reliable_endpoint_create( &sender_config, time );
     context.receiver = reliable_endpoint_create( &receiver_config, time );
 
-    double delta_time = 0.01;
-
+    int num_packets_sent = 0;
     int i;
-    for ( i = 0; i < TEST_ACKS_NUM_ITERATIONS; ++i )
+    for (i = 0; i <= 32767; ++i)
     {
-        uint8_t dummy_packet[8];
-        memset( dummy_packet, 0, sizeof( dummy_packet ) );
+        uint8_t packet_data[16];
+        int packet_bytes = sizeof( packet_data ) / sizeof( uint8_t );
+        reliable_endpoint_next_packet_sequence( context.sender );
+        reliable_endpoint_send_packet( context.sender, packet_data, packet_bytes );
 
-        reliable_endpoint_send_packet( context.sender, dummy_packet, sizeof( dummy_packet ) );
-        reliable_endpoint_send_packet( context.receiver, dummy_packet, sizeof( dummy_packet ) );
+        ++num_packets_sent;
+    }
 
-        reliable_endpoint_update( context.sender, time );
-        reliable_endpoint_update( context.receiver, time );
+    uint8_t packet_data[TEST_MAX_PACKET_BYTES];
+    int packet_bytes = sizeof( packet_data ) / sizeof( uint8_t );
+    reliable_endpoint_next_packet_sequence( context.sender );
+    reliable_endpoint_send_packet( context.sender, packet_data, packet_bytes );
+    ++num_packets_sent;
 
-        time += delta_time;
-    }
+    RELIABLE_CONST uint64_t * receiver_counters = reliable_endpoint_counters( context.receiver );
 
-    uint8_t sender_acked_packet[TEST_ACKS_NUM_ITERATIONS];
-    memset( sender_acked_packet, 0, sizeof( sender_acked_packet ) );
-    int sender_num_acks;
-    uint16_t * sender_acks = reliable_endpoint_get_acks( context.sender, &sender_num_acks );
-    for ( i = 0; i < sender_num_acks; ++i )
+    check( receiver_counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_RECEIVED] == (uint16_t) num_packets_sent );
+    check( receiver_counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID] == 0 );
+
+    reliable_endpoint_destroy( context.sender );
+    reliable_endpoint_destroy( context.receiver );
+}
+
+#define ARRAY_LENGTH(x) (sizeof(x) / sizeof((x)[0]))
+
+struct test_tracking_allocate_context_t
+{
+    void* active_allocations[1024];
+};
+
+void * test_tracking_allocate_function( void * context, size_t bytes )
+{
+    struct test_tracking_allocate_context_t* tracking_context = (struct test_tracking_allocate_context_t*)context;
+    void * allocation = malloc( bytes );
+    int tracking_index;
+    for ( tracking_index = 0; tracking_index < (int) ARRAY_LENGTH(tracking_context->active_allocations); ++tracking_index )
     {
-        if ( sender_acks[i] < TEST_ACKS_NUM_ITERATIONS )
+        if ( tracking_context->active_allocations[tracking_index] == NULL )
         {
-            sender_acked_packet[sender_acks[i]] = 1;
+            break;
         }
     }
-    for ( i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; ++i )
-    {
-        check( sender_acked_packet[i] == 1 );
-    }
 
-    uint8_t receiver_acked_packet[TEST_ACKS_NUM_ITERATIONS];
-    memset( receiver_acked_packet, 0, sizeof( receiver_acked_packet ) );
-    int receiver_num_acks;
-    uint16_t * receiver_acks = reliable_endpoint_get_acks( context.receiver, &receiver_num_acks );
-    for ( i = 0; i < receiver_num_acks; ++i )
-    {
-        if ( receiver_acks[i] < TEST_ACKS_NUM_ITERATIONS )
-            receiver_acked_packet[receiver_acks[i]] = 1;
-    }
-    for ( i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; ++i )
+    reliable_assert(tracking_index < (int) ARRAY_LENGTH(tracking_context->active_allocations));
+    tracking_context->active_allocations[tracking_index] = allocation;
+    return allocation;
+}
+
+void test_tracking_free_function( void * context, void * pointer )
+{
+    struct test_tracking_allocate_context_t* tracking_context = (struct test_tracking_allocate_context_t*)context;
+    int tracking_index;
+    for ( tracking_index = 0; tracking_index < (int) ARRAY_LENGTH(tracking_context->active_allocations); ++tracking_index )
     {
-        check( receiver_acked_packet[i] == 1 );
+        if ( tracking_context->active_allocations[tracking_index] == pointer )
+        {
+            break;
+        }
     }
 
-    reliable_endpoint_destroy( context.sender );
-    reliable_endpoint_destroy( context.receiver );
+    reliable_assert( tracking_index < (int) ARRAY_LENGTH(tracking_context->active_allocations) );
+    tracking_context->active_allocations[tracking_index] = NULL;
+    free( pointer );
 }
 
-static void test_acks_packet_loss()
+void test_fragment_cleanup()
 {
     double time = 100.0;
 
     struct test_context_t context;
     test_default_context( &context );
+
+    struct test_tracking_allocate_context_t tracking_alloc_context;
+    memset( &tracking_alloc_context, 0, sizeof( tracking_alloc_context ) );
     
     struct reliable_config_t sender_config;
     struct reliable_config_t receiver_config;
@@ -1912,11 +3431,18 @@ static void test_acks_packet_loss()
     reliable_default_config( &sender_config );
     reliable_default_config( &receiver_config );
 
+    receiver_config.allocator_context = &tracking_alloc_context;
+    receiver_config.allocate_function = &test_tracking_allocate_function;
+    receiver_config.free_function = &test_tracking_free_function;
+    receiver_config.fragment_reassembly_buffer_size = 4;
+
+    reliable_copy_string( sender_config.name, "sender", sizeof( sender_config.name ) );
     sender_config.context = &context;
     sender_config.id = 0;
     sender_config.transmit_packet_function = &test_transmit_packet_function;
     sender_config.process_packet_function = &test_process_packet_function;
 
+    reliable_copy_string( receiver_config.name, "receiver", sizeof( receiver_config.name ) );
     receiver_config.context = &context;
     receiver_config.id = 1;
     receiver_config.transmit_packet_function = &test_transmit_packet_function;
@@ -1925,294 +3451,502 @@ static void test_acks_packet_loss()
     context.sender = reliable_endpoint_create( &sender_config, time );
     context.receiver = reliable_endpoint_create( &receiver_config, time );
 
-    const double delta_time = 0.1f;
+    double delta_time = 0.1;
 
-    int i;
-    for ( i = 0; i < TEST_ACKS_NUM_ITERATIONS; ++i )
-    {
-        uint8_t dummy_packet[8];
-        memset( dummy_packet, 0, sizeof( dummy_packet ) );
+    int packet_sizes[] = {
+        sender_config.fragment_size + sender_config.fragment_size/2,
+        10,
+        10,
+        10,
+        10,
+    };
 
-        context.drop = ( i % 2 );
+    // Make sure we're sending more than receiver_config.fragment_reassembly_buffer_size packets, so the buffer wraps around.
+    reliable_assert( (int) ARRAY_LENGTH( packet_sizes ) > receiver_config.fragment_reassembly_buffer_size );
 
-        reliable_endpoint_send_packet( context.sender, dummy_packet, sizeof( dummy_packet ) );
-        reliable_endpoint_send_packet( context.receiver, dummy_packet, sizeof( dummy_packet ) );
+    int i;
+    for ( i = 0; i < (int) ARRAY_LENGTH( packet_sizes ); ++i )
+    {
+        // Only allow one packet per transmit, so that our fragmented packets are only partially
+        // delivered.
+        context.allow_packets = 1;
+        {
+            uint8_t packet_data[TEST_MAX_PACKET_BYTES];
+            uint16_t sequence = reliable_endpoint_next_packet_sequence( context.sender );
+            generate_packet_data_with_size( sequence, packet_data, packet_sizes[i] );
+            reliable_endpoint_send_packet( context.sender, packet_data, packet_sizes[i]);
+        }
 
         reliable_endpoint_update( context.sender, time );
         reliable_endpoint_update( context.receiver, time );
 
+        reliable_endpoint_clear_acks( context.sender );
+        reliable_endpoint_clear_acks( context.receiver );
+
         time += delta_time;
     }
 
-    uint8_t sender_acked_packet[TEST_ACKS_NUM_ITERATIONS];
-    memset( sender_acked_packet, 0, sizeof( sender_acked_packet ) );
-    int sender_num_acks;
-    uint16_t * sender_acks = reliable_endpoint_get_acks( context.sender, &sender_num_acks );
-    for ( i = 0; i < sender_num_acks; ++i )
-    {
-        if ( sender_acks[i] < TEST_ACKS_NUM_ITERATIONS )
-        {
-            sender_acked_packet[sender_acks[i]] = 1;
-        }
-    }
-    for ( i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; ++i )
+    reliable_endpoint_destroy( context.sender );
+    reliable_endpoint_destroy( context.receiver );
+    
+    // Make sure that there is no memory that hasn't been freed.
+    int tracking_index;
+    for ( tracking_index = 0; tracking_index < (int) ARRAY_LENGTH(tracking_alloc_context.active_allocations); ++tracking_index )
     {
-        check( sender_acked_packet[i] == (i+1) % 2 );
+        check( tracking_alloc_context.active_allocations[tracking_index] == NULL );
     }
+}
 
-    uint8_t receiver_acked_packet[TEST_ACKS_NUM_ITERATIONS];
-    memset( receiver_acked_packet, 0, sizeof( receiver_acked_packet ) );
-    int receiver_num_acks;
-    uint16_t * receiver_acks = reliable_endpoint_get_acks( context.sender, &receiver_num_acks );
-    for ( i = 0; i < receiver_num_acks; ++i )
+#define TEST_WINDOW_MAX_PENDING_PACKETS 16
+#define TEST_WINDOW_PACKET_BYTES 2048
+
+struct test_window_context_t
+{
+    uint32_t random_state;
+    int burst_loss;
+    int num_pending_packets;
+    uint64_t pending_id[TEST_WINDOW_MAX_PENDING_PACKETS];
+    int pending_bytes[TEST_WINDOW_MAX_PENDING_PACKETS];
+    uint8_t pending_data[TEST_WINDOW_MAX_PENDING_PACKETS][TEST_WINDOW_PACKET_BYTES];
+    struct reliable_endpoint_t * endpoint[2];
+};
+
+static int test_window_random( struct test_window_context_t * context, int n )
+{
+    context->random_state = context->random_state * 1664525 + 1013904223;
+    return (int) ( ( context->random_state >> 8 ) % (uint32_t) n );
+}
+
+static void test_window_transmit_packet_function( void * _context, uint64_t id, uint16_t sequence, uint8_t * packet_data, int packet_bytes )
+{
+    (void) sequence;
+
+    struct test_window_context_t * context = (struct test_window_context_t*) _context;
+
+    if ( context->burst_loss || test_window_random( context, 5 ) == 0 || context->num_pending_packets == TEST_WINDOW_MAX_PENDING_PACKETS )
+        return;
+
+    reliable_assert( packet_bytes <= TEST_WINDOW_PACKET_BYTES );
+
+    const int index = context->num_pending_packets++;
+    context->pending_id[index] = id;
+    context->pending_bytes[index] = packet_bytes;
+    memcpy( context->pending_data[index], packet_data, packet_bytes );
+}
+
+static void test_window_deliver_packets( struct test_window_context_t * context )
+{
+    // deliver pending packets in random order. some are held back for later, some are delivered twice
+
+    int i = 0;
+    while ( i < context->num_pending_packets )
     {
-        if ( receiver_acks[i] < TEST_ACKS_NUM_ITERATIONS )
+        if ( test_window_random( context, 3 ) == 0 )
         {
-            receiver_acked_packet[receiver_acks[i]] = 1;
+            i++;
+            continue;
         }
-    }
-    for ( i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; ++i )
-    {
-        check( receiver_acked_packet[i] == (i+1) % 2 );
-    }
 
-    reliable_endpoint_destroy( context.sender );
-    reliable_endpoint_destroy( context.receiver );
-}
+        uint8_t packet_data[TEST_WINDOW_PACKET_BYTES];
+        const uint64_t id = context->pending_id[i];
+        const int packet_bytes = context->pending_bytes[i];
+        memcpy( packet_data, context->pending_data[i], packet_bytes );
 
-#define TEST_MAX_PACKET_BYTES (4*1024)
+        if ( test_window_random( context, 20 ) != 0 )
+        {
+            context->num_pending_packets--;
+            context->pending_id[i] = context->pending_id[context->num_pending_packets];
+            context->pending_bytes[i] = context->pending_bytes[context->num_pending_packets];
+            memcpy( context->pending_data[i], context->pending_data[context->num_pending_packets], context->pending_bytes[i] );
+        }
+        else
+        {
+            i++;
+        }
 
-static void generate_packet_data_with_size( uint16_t sequence, uint8_t * packet_data, int packet_bytes )
+        reliable_endpoint_receive_packet( context->endpoint[id == 0 ? 1 : 0], packet_data, packet_bytes );
+    }
+}
+
+static void test_check_packet_window( struct reliable_packet_window_t * window, 
+                                      struct reliable_sequence_buffer_t * sequence_buffer, 
+                                      reliable_packet_window_sample_function_t sample_function )
 {
-    reliable_assert( packet_bytes >= 2 );
-    reliable_assert( packet_bytes <= TEST_MAX_PACKET_BYTES );
+    // the window must hold exactly what a scan over the older half of the buffer finds
+
+    const uint16_t window_start = sequence_buffer->sequence - ( (uint16_t) sequence_buffer->num_entries );
+    const int window_size = sequence_buffer->num_entries / 2;
+
+    int num_packets = 0;
+    uint64_t bytes = 0;
+    uint16_t first_sequence = 0;
+    uint16_t last_sequence = 0;
 
-    packet_data[0] = (uint8_t) ( sequence & 0xFF );
-    packet_data[1] = (uint8_t) ( (sequence>>8) & 0xFF );
     int i;
-    for ( i = 2; i < packet_bytes; ++i )
+    for ( i = 0; i < window_size; ++i )
     {
-        packet_data[i] = (uint8_t) ( ( (int)i + sequence ) % 256 );
+        const uint16_t sequence = window_start + ( (uint16_t) i );
+        const int packet_bytes = sample_function( sequence_buffer, sequence );
+        if ( !packet_bytes )
+            continue;
+        if ( num_packets == 0 )
+            first_sequence = sequence;
+        last_sequence = sequence;
+        num_packets++;
+        bytes += packet_bytes;
     }
-}
 
-static int generate_packet_data( uint16_t sequence, uint8_t * packet_data )
-{
-    int packet_bytes = ( ( (int)sequence * 1023 ) % ( TEST_MAX_PACKET_BYTES - 2 ) ) + 2;
-    generate_packet_data_with_size( sequence, packet_data, packet_bytes );
-    return packet_bytes;
+    check( window->num_packets == num_packets );
+    check( window->bytes == bytes );
+    if ( num_packets > 0 )
+    {
+        check( window->first_sequence == first_sequence );
+        check( window->last_sequence == last_sequence );
+    }
 }
 
-static void validate_packet_data( uint8_t * packet_data, int packet_bytes )
+void test_packet_window()
 {
-    reliable_assert( packet_bytes >= 2 );
-    reliable_assert( packet_bytes <= TEST_MAX_PACKET_BYTES );
-    uint16_t sequence = 0;
-    sequence |= (uint16_t) packet_data[0];
-    sequence |= ( (uint16_t) packet_data[1] ) << 8;
-    check( packet_bytes == ( ( (int)sequence * 1023 ) % ( TEST_MAX_PACKET_BYTES - 2 ) ) + 2 );
+    double time = 100.0;
+
+    struct test_window_context_t context;
+    memset( &context, 0, sizeof( context ) );
+    context.random_state = 12345;
+
     int i;
-    for ( i = 2; i < packet_bytes; ++i )
+    for ( i = 0; i < 2; ++i )
     {
-        check( packet_data[i] == (uint8_t) ( ( (int)i + sequence ) % 256 ) );
+        struct reliable_config_t config;
+        reliable_default_config( &config );
+        config.context = &context;
+        config.id = i;
+        config.sent_packets_buffer_size = ( i == 0 ) ? 64 : 128;
+        config.received_packets_buffer_size = ( i == 0 ) ? 128 : 64;
+        config.transmit_packet_function = &test_window_transmit_packet_function;
+        config.process_packet_function = &test_process_packet_function;
+        context.endpoint[i] = reliable_endpoint_create( &config, time );
     }
-}
 
-static int test_process_packet_function_validate( void * context, uint64_t id, uint16_t sequence, uint8_t * packet_data, int packet_bytes )
-{
-    reliable_assert( packet_data );
-    reliable_assert( packet_bytes > 0 );
-    reliable_assert( packet_bytes <= TEST_MAX_PACKET_BYTES );
+    // long enough for the sequence numbers to wrap, with random loss, reordering and duplicates, fragmented packets,
+    // and now and then a burst of loss that moves the received window past everything it held
 
-    (void) context;
-    (void) id;
-    (void) sequence;
+    const int num_iterations = 70000;
 
-    validate_packet_data( packet_data, packet_bytes );
+    for ( i = 0; i < num_iterations; ++i )
+    {
+        context.burst_loss = ( i % 5000 ) >= 4900;
 
-    return 1;
+        int j;
+        for ( j = 0; j < 2; ++j )
+        {
+            uint8_t packet_data[TEST_MAX_PACKET_BYTES];
+            const int packet_bytes = ( test_window_random( &context, 10 ) == 0 ) ? 1 + test_window_random( &context, 3000 ) : 1 + test_window_random( &context, 200 );
+            memset( packet_data, 0, packet_bytes );
+            reliable_endpoint_send_packet( context.endpoint[j], packet_data, packet_bytes );
+        }
+
+        test_window_deliver_packets( &context );
+
+        for ( j = 0; j < 2; ++j )
+        {
+            struct reliable_endpoint_t * endpoint = context.endpoint[j];
+
+            reliable_endpoint_update( endpoint, time );
+            reliable_endpoint_clear_acks( endpoint );
+
+            test_check_packet_window( &endpoint->sent_window, endpoint->sent_packets, reliable_sent_packet_sample );
+            test_check_packet_window( &endpoint->acked_window, endpoint->sent_packets, reliable_acked_packet_sample );
+            test_check_packet_window( &endpoint->received_window, endpoint->received_packets, reliable_received_packet_sample );
+        }
+
+        time += 0.01;
+    }
+
+    for ( i = 0; i < 2; ++i )
+    {
+        float sent_bandwidth_kbps, received_bandwidth_kbps, acked_bandwidth_kbps;
+        reliable_endpoint_bandwidth( context.endpoint[i], &sent_bandwidth_kbps, &received_bandwidth_kbps, &acked_bandwidth_kbps );
+        check( sent_bandwidth_kbps > 0.0f );
+        check( received_bandwidth_kbps > 0.0f );
+        check( acked_bandwidth_kbps > 0.0f );
+        check( reliable_endpoint_packet_loss( context.endpoint[i] ) > 0.0f );
+
+        reliable_endpoint_reset( context.endpoint[i] );
+
+        test_check_packet_window( &context.endpoint[i]->sent_window, context.endpoint[i]->sent_packets, reliable_sent_packet_sample );
+        test_check_packet_window( &context.endpoint[i]->received_window, context.endpoint[i]->received_packets, reliable_received_packet_sample );
+
+        reliable_endpoint_destroy( context.endpoint[i] );
+    }
 }
 
-static int generate_packet_data_large( uint8_t* packet_data )
+static void test_check_received_ack_bits( struct reliable_endpoint_t * endpoint )
 {
-    int data_bytes = TEST_MAX_PACKET_BYTES - 2;
-    reliable_assert( data_bytes >= 2) ;
-    reliable_assert( data_bytes <= (1 << 16) );
+    uint16_t ack;
+    uint32_t ack_bits;
+    reliable_sequence_buffer_generate_ack_bits( endpoint->received_packets, &ack, &ack_bits );
+    check( endpoint->received_ack == ack );
+    check( endpoint->received_ack_bits[0] == ack_bits );
+
+    // the wider ack bits can only be checked as far back as the received packets buffer goes
+
+    const int num_ack_bits = ( endpoint->received_packets->num_entries < RELIABLE_MAX_ACK_BITS ) ? endpoint->received_packets->num_entries : RELIABLE_MAX_ACK_BITS;
 
-    packet_data[0] = (uint8_t) (data_bytes & 0xFF);
-    packet_data[1] = (uint8_t) ( (data_bytes >> 8) & 0xFF );
     int i;
-    for ( i = 2; i < data_bytes; ++i )
+    for ( i = 32; i < num_ack_bits; ++i )
     {
-        packet_data[i] = (uint8_t) ( i % 256 );
+        const uint32_t received = reliable_sequence_buffer_exists( endpoint->received_packets, ack - ( (uint16_t) i ) ) ? 1 : 0;
+        check( ( ( endpoint->received_ack_bits[i>>5] >> ( i & 31 ) ) & 1 ) == received );
     }
-    return data_bytes + 2;
 }
 
-static int test_process_packet_function_validate_large( void * context, uint64_t id, uint16_t sequence, uint8_t * packet_data, int packet_bytes )
+void test_received_ack_bits()
 {
-    reliable_assert( packet_data );
-    reliable_assert( packet_bytes >= 2 );
-    reliable_assert( packet_bytes <= TEST_MAX_PACKET_BYTES );
+    double time = 100.0;
 
-    (void) context;
-    (void) id;
-    (void) sequence;
+    struct test_window_context_t context;
+    memset( &context, 0, sizeof( context ) );
+    context.random_state = 54321;
 
-    uint16_t data_bytes = 0;
-    data_bytes |= (uint16_t) packet_data[0];
-    data_bytes |= ( (uint16_t) packet_data[1] ) << 8;
-    check( packet_bytes == data_bytes + 2 );
     int i;
-    for ( i = 2; i < data_bytes; ++i )
+    for ( i = 0; i < 2; ++i )
     {
-        check( packet_data[i] == (uint8_t) ( i  % 256 ) );
+        struct reliable_config_t config;
+        reliable_default_config( &config );
+        config.context = &context;
+        config.id = i;
+        config.received_packets_buffer_size = ( i == 0 ) ? 64 : 256;
+        config.num_ack_bits = RELIABLE_MAX_ACK_BITS;
+        config.transmit_packet_function = &test_window_transmit_packet_function;
+        config.process_packet_function = &test_process_packet_function;
+        context.endpoint[i] = reliable_endpoint_create( &config, time );
     }
 
-    return 1;
+    // the ack bits kept up to date as packets arrive must match the ones generated from the received packets buffer
+
+    const int num_iterations = 70000;
+
+    for ( i = 0; i < num_iterations; ++i )
+    {
+        context.burst_loss = ( i % 5000 ) >= 4960;
+
+        int j;
+        for ( j = 0; j < 2; ++j )
+        {
+            uint8_t packet_data[TEST_MAX_PACKET_BYTES];
+            const int packet_bytes = ( test_window_random( &context, 10 ) == 0 ) ? 1 + test_window_random( &context, 3000 ) : 1 + test_window_random( &context, 200 );
+            memset( packet_data, 0, packet_bytes );
+            reliable_endpoint_send_packet( context.endpoint[j], packet_data, packet_bytes );
+        }
+
+        test_window_deliver_packets( &context );
+
+        for ( j = 0; j < 2; ++j )
+        {
+            struct reliable_endpoint_t * endpoint = context.endpoint[j];
+
+            reliable_endpoint_update( endpoint, time );
+            reliable_endpoint_clear_acks( endpoint );
+
+            test_check_received_ack_bits( endpoint );
+        }
+
+        time += 0.01;
+    }
+
+    for ( i = 0; i < 2; ++i )
+    {
+        reliable_endpoint_reset( context.endpoint[i] );
+
+        test_check_received_ack_bits( context.endpoint[i] );
+
+        reliable_endpoint_destroy( context.endpoint[i] );
+    }
 }
 
-void test_packets()
+void test_extended_acks()
 {
-    double time = 100.0;
+    // wider acks are only sent once the other side has shown it can read them. each side acks with its own width
 
-    struct test_context_t context;
-    test_default_context( &context );
-    
-    struct reliable_config_t sender_config;
-    struct reliable_config_t receiver_config;
+    const int num_ack_bits[][2] = { { 32, 32 }, { 128, 32 }, { 64, 128 }, { 128, 128 } };
+    const int expected_ack_format[][2] = { { RELIABLE_ACK_FORMAT_32_BITS, RELIABLE_ACK_FORMAT_32_BITS },
+                                           { RELIABLE_ACK_FORMAT_32_BITS_EXTENDED, RELIABLE_ACK_FORMAT_32_BITS },
+                                           { RELIABLE_ACK_FORMAT_64_BITS, RELIABLE_ACK_FORMAT_128_BITS },
+                                           { RELIABLE_ACK_FORMAT_128_BITS, RELIABLE_ACK_FORMAT_128_BITS } };
 
-    reliable_default_config( &sender_config );
-    reliable_default_config( &receiver_config );
+    const int num_packets = 100;
 
-    sender_config.fragment_above = 500;
-    receiver_config.fragment_above = 500;
+    int i;
+    for ( i = 0; i < (int) ( sizeof( num_ack_bits ) / sizeof( num_ack_bits[0] ) ); ++i )
+    {
+        double time = 100.0;
 
-    reliable_copy_string( sender_config.name, "sender", sizeof( sender_config.name ) );
-    sender_config.context = &context;
-    sender_config.id = 0;
-    sender_config.transmit_packet_function = &test_transmit_packet_function;
-    sender_config.process_packet_function = &test_process_packet_function_validate;
+        struct test_context_t context;
+        test_default_context( &context );
+
+        struct reliable_config_t sender_config;
+        struct reliable_config_t receiver_config;
+
+        reliable_default_config( &sender_config );
+        reliable_default_config( &receiver_config );
+
+        sender_config.context = &context;
+        sender_config.id = 0;
+        sender_config.num_ack_bits = num_ack_bits[i][0];
+        sender_config.transmit_packet_function = &test_transmit_packet_function;
+        sender_config.process_packet_function = &test_process_packet_function;
+
+        receiver_config.context = &context;
+        receiver_config.id = 1;
+        receiver_config.num_ack_bits = num_ack_bits[i][1];
+        receiver_config.transmit_packet_function = &test_transmit_packet_function;
+        receiver_config.process_packet_function = &test_process_packet_function;
+
+        context.sender = reliable_endpoint_create( &sender_config, time );
+        context.receiver = reliable_endpoint_create( &receiver_config, time );
 
-    reliable_copy_string( receiver_config.name, "receiver", sizeof( receiver_config.name ) );
-    receiver_config.context = &context;
-    receiver_config.id = 1;
-    receiver_config.transmit_packet_function = &test_transmit_packet_function;
-    receiver_config.process_packet_function = &test_process_packet_function_validate;
+        uint8_t packet_data[8];
+        memset( packet_data, 0, sizeof( packet_data ) );
 
-    context.sender = reliable_endpoint_create( &sender_config, time );
-    context.receiver = reliable_endpoint_create( &receiver_config, time );
+        reliable_endpoint_send_packet( context.sender, packet_data, sizeof( packet_data ) );
+        reliable_endpoint_send_packet( context.receiver, packet_data, sizeof( packet_data ) );
+        reliable_endpoint_send_packet( context.sender, packet_data, sizeof( packet_data ) );
+        reliable_endpoint_send_packet( context.receiver, packet_data, sizeof( packet_data ) );
 
-    double delta_time = 0.1;
+        check( reliable_endpoint_ack_format( context.sender ) == expected_ack_format[i][0] );
+        check( reliable_endpoint_ack_format( context.receiver ) == expected_ack_format[i][1] );
 
-    int i;
-    for ( i = 0; i < 16; ++i )
-    {
-        {
-            uint8_t packet_data[TEST_MAX_PACKET_BYTES];
-            uint16_t sequence = reliable_endpoint_next_packet_sequence( context.sender );
-            int packet_bytes = generate_packet_data( sequence, packet_data );
-            reliable_endpoint_send_packet( context.sender, packet_data, packet_bytes );
-        }
+        reliable_endpoint_clear_acks( context.sender );
 
+        // the receiver hears every packet but stays quiet until the end, so only its ack width decides how many get acked
+
+        int j;
+        for ( j = 0; j < num_packets; ++j )
         {
-            uint8_t packet_data[TEST_MAX_PACKET_BYTES];
-            uint16_t sequence = reliable_endpoint_next_packet_sequence( context.sender );
-            int packet_bytes = generate_packet_data( sequence, packet_data );
-            reliable_endpoint_send_packet( context.sender, packet_data, packet_bytes );
+            reliable_endpoint_send_packet( context.sender, packet_data, sizeof( packet_data ) );
         }
 
-        reliable_endpoint_update( context.sender, time );
-        reliable_endpoint_update( context.receiver, time );
+        reliable_endpoint_send_packet( context.receiver, packet_data, sizeof( packet_data ) );
 
-        reliable_endpoint_clear_acks( context.sender );
-        reliable_endpoint_clear_acks( context.receiver );
+        int num_acks;
+        reliable_endpoint_get_acks( context.sender, &num_acks );
+        const int receiver_ack_bits = reliable_ack_format_bits( expected_ack_format[i][1] );
+        check( num_acks == ( ( receiver_ack_bits < num_packets ) ? receiver_ack_bits : num_packets ) );
 
-        time += delta_time;
+        reliable_endpoint_destroy( context.sender );
+        reliable_endpoint_destroy( context.receiver );
     }
+}
 
-    reliable_endpoint_destroy( context.sender );
-    reliable_endpoint_destroy( context.receiver );
+static void test_check_rtt( float rtt, float expected_rtt )
+{
+    // histogram buckets are 1ms wide below 16ms and 1/8 of their start above, so the middle is never further off than this
+
+    check( fabs( rtt - expected_rtt ) <= expected_rtt / 16.0f + 0.5f );
 }
 
-void test_large_packets()
+void test_rtt_stats()
 {
     double time = 100.0;
 
+    int rtt_ms;
+    for ( rtt_ms = 0; rtt_ms < 16384; ++rtt_ms )
+    {
+        test_check_rtt( reliable_rtt_histogram_bucket_rtt( reliable_rtt_histogram_bucket( (float) rtt_ms ) ), (float) rtt_ms );
+    }
+
     struct test_context_t context;
     test_default_context( &context );
 
-    struct reliable_config_t sender_config;
-    struct reliable_config_t receiver_config;
+    struct reliable_config_t config;
+    reliable_default_config( &config );
+    config.context = &context;
+    config.transmit_packet_function = &test_transmit_packet_function;
+    config.process_packet_function = &test_process_packet_function;
 
-    reliable_default_config( &sender_config );
-    reliable_default_config( &receiver_config );
+    struct reliable_endpoint_t * endpoint = reliable_endpoint_create( &config, time );
 
-    sender_config.max_packet_size = TEST_MAX_PACKET_BYTES;
-    receiver_config.max_packet_size = TEST_MAX_PACKET_BYTES;
+    // smoothed rtt and variation follow RFC 6298
 
-    sender_config.fragment_above = TEST_MAX_PACKET_BYTES;
-    receiver_config.fragment_above = TEST_MAX_PACKET_BYTES;
+    reliable_endpoint_rtt_sample( endpoint, 100.0f );
 
-    reliable_copy_string( sender_config.name, "sender", sizeof( sender_config.name ) );
-    sender_config.context = &context;
-    sender_config.id = 0;
-    sender_config.transmit_packet_function = &test_transmit_packet_function;
-    sender_config.process_packet_function = &test_process_packet_function_validate_large;
+    check( reliable_endpoint_rtt_smoothed( endpoint ) == 100.0f );
+    check( reliable_endpoint_rtt_variance( endpoint ) == 50.0f );
+    check( reliable_endpoint_rtt_min( endpoint ) == 100.0f );
 
-    reliable_copy_string( receiver_config.name, "receiver", sizeof( receiver_config.name ) );
-    receiver_config.context = &context;
-    receiver_config.id = 1;
-    receiver_config.transmit_packet_function = &test_transmit_packet_function;
-    receiver_config.process_packet_function = &test_process_packet_function_validate_large;
+    reliable_endpoint_rtt_sample( endpoint, 60.0f );
 
-    context.sender = reliable_endpoint_create( &sender_config, time );
-    context.receiver = reliable_endpoint_create( &receiver_config, time );
+    check( fabs( reliable_endpoint_rtt_smoothed( endpoint ) - 95.0f ) < 0.001f );
+    check( fabs( reliable_endpoint_rtt_variance( endpoint ) - 47.5f ) < 0.001f );
+    check( reliable_endpoint_rtt_min( endpoint ) == 60.0f );
+
+    // min rtt holds for the window, then gives way to the best of what came after
+
+    reliable_endpoint_update( endpoint, time );
+    reliable_endpoint_rtt_sample( endpoint, 20.0f );
 
+    int i;
+    for ( i = 0; i < 15; ++i )
     {
-        uint8_t packet_data[TEST_MAX_PACKET_BYTES];
-        int packet_bytes = generate_packet_data_large( packet_data );
-        check( packet_bytes == TEST_MAX_PACKET_BYTES );
-        reliable_endpoint_send_packet( context.sender, packet_data, packet_bytes );
+        time += 1.0;
+        reliable_endpoint_update( endpoint, time );
+        reliable_endpoint_rtt_sample( endpoint, 50.0f + ( i % 3 ) );
+        if ( i < 10 )
+        {
+            check( reliable_endpoint_rtt_min( endpoint ) == 20.0f );
+        }
+        else
+        {
+            check( reliable_endpoint_rtt_min( endpoint ) >= 50.0f );
+            check( reliable_endpoint_rtt_min( endpoint ) <= 52.0f );
+        }
     }
 
-    reliable_endpoint_update( context.sender, time );
-    reliable_endpoint_update( context.receiver, time );
+    reliable_endpoint_destroy( endpoint );
 
-    reliable_endpoint_clear_acks( context.sender );
-    reliable_endpoint_clear_acks( context.receiver );
+    // percentiles
 
-    RELIABLE_CONST uint64_t * receiver_counters = reliable_endpoint_counters( context.receiver );
-    check( receiver_counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_TOO_LARGE_TO_RECEIVE] == 0 );
-    check( receiver_counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_RECEIVED] == 1 );
+    endpoint = reliable_endpoint_create( &config, time );
 
-    reliable_endpoint_destroy( context.sender );
-    reliable_endpoint_destroy( context.receiver );
-}
+    for ( i = 0; i < 1000; ++i )
+    {
+        reliable_endpoint_rtt_sample( endpoint, ( i % 100 < 90 ) ? 30.0f : ( ( i % 100 < 96 ) ? 100.0f : 400.0f ) );
+    }
 
-void test_sequence_buffer_rollover()
-{
-    double time = 100.0;
+    float rtt_p50, rtt_p95, rtt_p99;
+    reliable_endpoint_rtt_percentiles( endpoint, &rtt_p50, &rtt_p95, &rtt_p99 );
+
+    test_check_rtt( rtt_p50, 30.0f );
+    test_check_rtt( rtt_p95, 100.0f );
+    test_check_rtt( rtt_p99, 400.0f );
+
+    // old samples fade out of the histogram
+
+    for ( i = 0; i < 5000; ++i )
+    {
+        reliable_endpoint_rtt_sample( endpoint, 200.0f );
+    }
+
+    reliable_endpoint_rtt_percentiles( endpoint, &rtt_p50, &rtt_p95, &rtt_p99 );
+
+    test_check_rtt( rtt_p50, 200.0f );
+    test_check_rtt( rtt_p95, 200.0f );
+
+    reliable_endpoint_destroy( endpoint );
+
+    // rtt samples come from acks
 
-    struct test_context_t context;
-    test_default_context( &context );
-    
     struct reliable_config_t sender_config;
     struct reliable_config_t receiver_config;
 
     reliable_default_config( &sender_config );
     reliable_default_config( &receiver_config );
 
-    sender_config.fragment_above = 500;
-    receiver_config.fragment_above = 500;
-
-    reliable_copy_string( sender_config.name, "sender", sizeof( sender_config.name ) );
     sender_config.context = &context;
     sender_config.id = 0;
     sender_config.transmit_packet_function = &test_transmit_packet_function;
     sender_config.process_packet_function = &test_process_packet_function;
 
-    reliable_copy_string( receiver_config.name, "receiver", sizeof( receiver_config.name ) );
     receiver_config.context = &context;
     receiver_config.id = 1;
     receiver_config.transmit_packet_function = &test_transmit_packet_function;
@@ -2221,155 +3955,221 @@ void test_sequence_buffer_rollover()
     context.sender = reliable_endpoint_create( &sender_config, time );
     context.receiver = reliable_endpoint_create( &receiver_config, time );
 
-    int num_packets_sent = 0;
-    int i;
-    for (i = 0; i <= 32767; ++i)
+    for ( i = 0; i < 100; ++i )
     {
-        uint8_t packet_data[16];
-        int packet_bytes = sizeof( packet_data ) / sizeof( uint8_t );
-        reliable_endpoint_next_packet_sequence( context.sender );
-        reliable_endpoint_send_packet( context.sender, packet_data, packet_bytes );
+        uint8_t packet_data[8];
+        memset( packet_data, 0, sizeof( packet_data ) );
 
-        ++num_packets_sent;
+        reliable_endpoint_update( context.sender, time );
+        reliable_endpoint_send_packet( context.sender, packet_data, sizeof( packet_data ) );
+
+        time += 0.05;
+
+        reliable_endpoint_update( context.sender, time );
+        reliable_endpoint_update( context.receiver, time );
+        reliable_endpoint_send_packet( context.receiver, packet_data, sizeof( packet_data ) );
+
+        reliable_endpoint_clear_acks( context.sender );
+        reliable_endpoint_clear_acks( context.receiver );
     }
 
-    uint8_t packet_data[TEST_MAX_PACKET_BYTES];
-    int packet_bytes = sizeof( packet_data ) / sizeof( uint8_t );
-    reliable_endpoint_next_packet_sequence( context.sender );
-    reliable_endpoint_send_packet( context.sender, packet_data, packet_bytes );
-    ++num_packets_sent;
+    test_check_rtt( reliable_endpoint_rtt_smoothed( context.sender ), 50.0f );
+    test_check_rtt( reliable_endpoint_rtt_min( context.sender ), 50.0f );
+    check( reliable_endpoint_rtt_variance( context.sender ) < 1.0f );
 
-    RELIABLE_CONST uint64_t * receiver_counters = reliable_endpoint_counters( context.receiver );
+    reliable_endpoint_rtt_percentiles( context.sender, &rtt_p50, &rtt_p95, &rtt_p99 );
 
-    check( receiver_counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_RECEIVED] == (uint16_t) num_packets_sent );
-    check( receiver_counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID] == 0 );
+    test_check_rtt( rtt_p50, 50.0f );
+    test_check_rtt( rtt_p99, 50.0f );
 
     reliable_endpoint_destroy( context.sender );
     reliable_endpoint_destroy( context.receiver );
 }
 
-#define ARRAY_LENGTH(x) (sizeof(x) / sizeof((x)[0]))
+#define TEST_LINK_MAX_PACKETS 256
+#define TEST_LINK_PACKET_BYTES 1200
+#define TEST_LINK_BYTES_PER_SECOND 100000.0
+#define TEST_LINK_LATENCY 0.02
+#define TEST_LINK_MAX_QUEUE_DELAY 0.25
 
-struct test_tracking_allocate_context_t
+struct test_link_context_t
 {
-    void* active_allocations[1024];
+    double time;
+    double link_free_time;
+    double measure_time;
+    double max_queue_delay;
+    uint64_t delivered_bytes;
+    int num_packets;
+    int num_dropped_packets;
+    double delivery_time[TEST_LINK_MAX_PACKETS];
+    uint64_t packet_id[TEST_LINK_MAX_PACKETS];
+    int packet_bytes[TEST_LINK_MAX_PACKETS];
+    uint8_t packet_data[TEST_LINK_MAX_PACKETS][TEST_LINK_PACKET_BYTES];
+    struct reliable_endpoint_t * endpoint[2];
 };
 
-void * test_tracking_allocate_function( void * context, size_t bytes )
+static void test_link_transmit_packet_function( void * _context, uint64_t id, uint16_t sequence, uint8_t * packet_data, int packet_bytes )
 {
-    struct test_tracking_allocate_context_t* tracking_context = (struct test_tracking_allocate_context_t*)context;
-    void * allocation = malloc( bytes );
-    int tracking_index;
-    for ( tracking_index = 0; tracking_index < (int) ARRAY_LENGTH(tracking_context->active_allocations); ++tracking_index )
+    (void) sequence;
+
+    struct test_link_context_t * context = (struct test_link_context_t*) _context;
+
+    // packets from endpoint 0 go through a bottleneck with a drop tail queue. packets back the other way only see latency
+
+    double delivery_time = context->time + TEST_LINK_LATENCY;
+
+    if ( id == 0 )
     {
-        if ( tracking_context->active_allocations[tracking_index] == NULL )
+        const double queue_delay = ( context->link_free_time > context->time ) ? context->link_free_time - context->time : 0.0;
+
+        if ( queue_delay > TEST_LINK_MAX_QUEUE_DELAY )
         {
-            break;
+            context->num_dropped_packets++;
+            return;
+        }
+
+        if ( context->time >= context->measure_time && queue_delay > context->max_queue_delay )
+        {
+            context->max_queue_delay = queue_delay;
         }
+
+        context->link_free_time = context->time + queue_delay + ( packet_bytes + 28 ) / TEST_LINK_BYTES_PER_SECOND;
+
+        delivery_time = context->link_free_time + TEST_LINK_LATENCY;
     }
 
-    reliable_assert(tracking_index < (int) ARRAY_LENGTH(tracking_context->active_allocations));
-    tracking_context->active_allocations[tracking_index] = allocation;
-    return allocation;
+    reliable_assert( context->num_packets < TEST_LINK_MAX_PACKETS );
+    reliable_assert( packet_bytes <= TEST_LINK_PACKET_BYTES );
+
+    const int index = context->num_packets++;
+    context->delivery_time[index] = delivery_time;
+    context->packet_id[index] = id;
+    context->packet_bytes[index] = packet_bytes;
+    memcpy( context->packet_data[index], packet_data, packet_bytes );
 }
 
-void test_tracking_free_function( void * context, void * pointer )
+static void test_link_deliver_packets( struct test_link_context_t * context )
 {
-    struct test_tracking_allocate_context_t* tracking_context = (struct test_tracking_allocate_context_t*)context;
-    int tracking_index;
-    for ( tracking_index = 0; tracking_index < (int) ARRAY_LENGTH(tracking_context->active_allocations); ++tracking_index )
+    int num_packets = 0;
+
+    int i;
+    for ( i = 0; i < context->num_packets; ++i )
     {
-        if ( tracking_context->active_allocations[tracking_index] == pointer )
+        if ( context->delivery_time[i] > context->time )
         {
-            break;
+            if ( i != num_packets )
+            {
+                context->delivery_time[num_packets] = context->delivery_time[i];
+                context->packet_id[num_packets] = context->packet_id[i];
+                context->packet_bytes[num_packets] = context->packet_bytes[i];
+                memcpy( context->packet_data[num_packets], context->packet_data[i], context->packet_bytes[i] );
+            }
+            num_packets++;
+            continue;
         }
+
+        if ( context->packet_id[i] == 0 && context->time >= context->measure_time )
+        {
+            context->delivered_bytes += context->packet_bytes[i] + 28;
+        }
+
+        reliable_endpoint_receive_packet( context->endpoint[context->packet_id[i] == 0 ? 1 : 0], context->packet_data[i], context->packet_bytes[i] );
     }
 
-    reliable_assert( tracking_index < (int) ARRAY_LENGTH(tracking_context->active_allocations) );
-    tracking_context->active_allocations[tracking_index] = NULL;
-    free( pointer );
+    context->num_packets = num_packets;
 }
 
-void test_fragment_cleanup()
+static void test_congestion_control_run( struct test_link_context_t * context, int congestion_control )
 {
-    double time = 100.0;
+    memset( context, 0, sizeof( *context ) );
 
-    struct test_context_t context;
-    test_default_context( &context );
+    context->time = 100.0;
+    context->measure_time = context->time + 10.0;
 
-    struct test_tracking_allocate_context_t tracking_alloc_context;
-    memset( &tracking_alloc_context, 0, sizeof( tracking_alloc_context ) );
-    
-    struct reliable_config_t sender_config;
-    struct reliable_config_t receiver_config;
+    struct reliable_config_t config;
+    reliable_default_config( &config );
+    config.context = context;
+    config.transmit_packet_function = &test_link_transmit_packet_function;
+    config.process_packet_function = &test_process_packet_function;
 
-    reliable_default_config( &sender_config );
-    reliable_default_config( &receiver_config );
+    config.id = 0;
+    config.congestion_control = congestion_control;
+    context->endpoint[0] = reliable_endpoint_create( &config, context->time );
 
-    receiver_config.allocator_context = &tracking_alloc_context;
-    receiver_config.allocate_function = &test_tracking_allocate_function;
-    receiver_config.free_function = &test_tracking_free_function;
-    receiver_config.fragment_reassembly_buffer_size = 4;
+    config.id = 1;
+    config.congestion_control = 0;
+    context->endpoint[1] = reliable_endpoint_create( &config, context->time );
 
-    reliable_copy_string( sender_config.name, "sender", sizeof( sender_config.name ) );
-    sender_config.context = &context;
-    sender_config.id = 0;
-    sender_config.transmit_packet_function = &test_transmit_packet_function;
-    sender_config.process_packet_function = &test_process_packet_function;
+    uint8_t packet_data[4000];
+    memset( packet_data, 0, sizeof( packet_data ) );
 
-    reliable_copy_string( receiver_config.name, "receiver", sizeof( receiver_config.name ) );
-    receiver_config.context = &context;
-    receiver_config.id = 1;
-    receiver_config.transmit_packet_function = &test_transmit_packet_function;
-    receiver_config.process_packet_function = &test_process_packet_function;
+    // the sender wants 250KB/sec but the link only carries 100KB/sec. without congestion control the queue sits full
 
-    context.sender = reliable_endpoint_create( &sender_config, time );
-    context.receiver = reliable_endpoint_create( &receiver_config, time );
+    int i;
+    for ( i = 0; i < 30000; ++i )
+    {
+        context->time += 0.001;
 
-    double delta_time = 0.1;
+        test_link_deliver_packets( context );
 
-    int packet_sizes[] = {
-        sender_config.fragment_size + sender_config.fragment_size/2,
-        10,
-        10,
-        10,
-        10,
-    };
+        if ( ( i % 16 ) == 0 )
+        {
+            int packet_bytes = reliable_endpoint_send_budget( context->endpoint[0] );
+            if ( packet_bytes > (int) sizeof( packet_data ) )
+            {
+                packet_bytes = (int) sizeof( packet_data );
+            }
 
-    // Make sure we're sending more than receiver_config.fragment_reassembly_buffer_size packets, so the buffer wraps around.
-    reliable_assert( (int) ARRAY_LENGTH( packet_sizes ) > receiver_config.fragment_reassembly_buffer_size );
+            if ( packet_bytes >= 64 )
+            {
+                reliable_endpoint_send_packet( context->endpoint[0], packet_data, packet_bytes );
+            }
 
-    int i;
-    for ( i = 0; i < (int) ARRAY_LENGTH( packet_sizes ); ++i )
-    {
-        // Only allow one packet per transmit, so that our fragmented packets are only partially
-        // delivered.
-        context.allow_packets = 1;
-        {
-            uint8_t packet_data[TEST_MAX_PACKET_BYTES];
-            uint16_t sequence = reliable_endpoint_next_packet_sequence( context.sender );
-            generate_packet_data_with_size( sequence, packet_data, packet_sizes[i] );
-            reliable_endpoint_send_packet( context.sender, packet_data, packet_sizes[i]);
+            reliable_endpoint_send_packet( context->endpoint[1], packet_data, 8 );
         }
 
-        reliable_endpoint_update( context.sender, time );
-        reliable_endpoint_update( context.receiver, time );
-
-        reliable_endpoint_clear_acks( context.sender );
-        reliable_endpoint_clear_acks( context.receiver );
+        reliable_endpoint_update( context->endpoint[0], context->time );
+        reliable_endpoint_update( context->endpoint[1], context->time );
 
-        time += delta_time;
+        reliable_endpoint_clear_acks( context->endpoint[0] );
+        reliable_endpoint_clear_acks( context->endpoint[1] );
     }
+}
 
-    reliable_endpoint_destroy( context.sender );
-    reliable_endpoint_destroy( context.receiver );
-    
-    // Make sure that there is no memory that hasn't been freed.
-    int tracking_index;
-    for ( tracking_index = 0; tracking_index < (int) ARRAY_LENGTH(tracking_alloc_context.active_allocations); ++tracking_index )
-    {
-        check( tracking_alloc_context.active_allocations[tracking_index] == NULL );
-    }
+void test_congestion_control()
+{
+    struct test_link_context_t * context = (struct test_link_context_t*) malloc( sizeof( struct test_link_context_t ) );
+
+    test_congestion_control_run( context, 0 );
+
+    const double uncontrolled_max_queue_delay = context->max_queue_delay;
+    float uncontrolled_rtt_p50, uncontrolled_rtt_p95, uncontrolled_rtt_p99;
+    reliable_endpoint_rtt_percentiles( context->endpoint[0], &uncontrolled_rtt_p50, &uncontrolled_rtt_p95, &uncontrolled_rtt_p99 );
+
+    check( uncontrolled_max_queue_delay > TEST_LINK_MAX_QUEUE_DELAY * 0.9 );
+    check( context->num_dropped_packets > 0 );
+    check( reliable_endpoint_send_budget( context->endpoint[0] ) == 16 * 1024 );
+
+    reliable_endpoint_destroy( context->endpoint[0] );
+    reliable_endpoint_destroy( context->endpoint[1] );
+
+    // with congestion control the queue stays short, while the link is still kept mostly busy
+
+    test_congestion_control_run( context, 1 );
+
+    float rtt_p50, rtt_p95, rtt_p99;
+    reliable_endpoint_rtt_percentiles( context->endpoint[0], &rtt_p50, &rtt_p95, &rtt_p99 );
+
+    const double throughput = context->delivered_bytes / ( context->time - context->measure_time );
+
+    check( context->max_queue_delay < uncontrolled_max_queue_delay * 0.5 );
+    check( rtt_p95 < uncontrolled_rtt_p95 * 0.5f );
+    check( throughput > TEST_LINK_BYTES_PER_SECOND * 0.6 );
+
+    reliable_endpoint_destroy( context->endpoint[0] );
+    reliable_endpoint_destroy( context->endpoint[1] );
+
+    free( context );
 }
 
 #define RUN_TEST( test_function )                                           \
@@ -2392,8 +4192,15 @@ void reliable_test()
         RUN_TEST( test_acks_packet_loss );
         RUN_TEST( test_packets );
         RUN_TEST( test_large_packets );
+        RUN_TEST( test_large_packets_transmitted_together );
+        RUN_TEST( test_packets_sent_in_place );
         RUN_TEST( test_sequence_buffer_rollover );
         RUN_TEST( test_fragment_cleanup );
+        RUN_TEST( test_packet_window );
+        RUN_TEST( test_received_ack_bits );
+        RUN_TEST( test_extended_acks );
+        RUN_TEST( test_rtt_stats );
+        RUN_TEST( test_congestion_control );
     }
 }
 
@@ -67,8 +67,9 @@
 #define RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID                     9
 #define RELIABLE_ENDPOINT_NUM_COUNTERS                                      10
 
-#define RELIABLE_MAX_PACKET_HEADER_BYTES 9
+#define RELIABLE_MAX_PACKET_HEADER_BYTES 23
 #define RELIABLE_FRAGMENT_HEADER_BYTES 5
+#define RELIABLE_MAX_ACK_BITS 128
 
 #define RELIABLE_LOG_LEVEL_NONE     0
 #define RELIABLE_LOG_LEVEL_ERROR    1
@@ -107,10 +108,19 @@ struct reliable_config_t
     int received_packets_buffer_size;
     int fragment_reassembly_buffer_size;
     float rtt_smoothing_factor;
+    float rtt_min_window_seconds;
+    int congestion_control;
+    float congestion_target_delay;
+    float congestion_min_bandwidth_kbps;
+    float congestion_initial_bandwidth_kbps;
+    float congestion_max_bandwidth_kbps;
     float packet_loss_smoothing_factor;
     float bandwidth_smoothing_factor;
     int packet_header_size;
+    int num_ack_bits;
     void (*transmit_packet_function)(void*,uint64_t,uint16_t,uint8_t*,int);
+    void (*transmit_packets_function)(void*,uint64_t,uint16_t,uint8_t**,int*,int);
+    void (*transmit_packet_in_place_function)(void*,uint64_t,uint16_t,uint8_t*,int);
     int (*process_packet_function)(void*,uint64_t,uint16_t,uint8_t*,int);
     void * allocator_context;
     void * (*allocate_function)(void*,size_t);
@@ -125,6 +135,10 @@ uint16_t reliable_endpoint_next_packet_sequence( struct reliable_endpoint_t * en
 
 void reliable_endpoint_send_packet( struct reliable_endpoint_t * endpoint, uint8_t * packet_data, int packet_bytes );
 
+// packet_data must be preceded by RELIABLE_MAX_PACKET_HEADER_BYTES of writable headroom (plus whatever the in-place transmit function needs)
+
+void reliable_endpoint_send_packet_in_place( struct reliable_endpoint_t * endpoint, uint8_t * packet_data, int packet_bytes );
+
 void reliable_endpoint_receive_packet( struct reliable_endpoint_t * endpoint, uint8_t * packet_data, int packet_bytes );
 
 void reliable_endpoint_free_packet( struct reliable_endpoint_t * endpoint, void * packet );
@@ -139,10 +153,25 @@ void reliable_endpoint_update( struct reliable_endpoint_t * endpoint, double tim
 
 float reliable_endpoint_rtt( struct reliable_endpoint_t * endpoint );
 
+float reliable_endpoint_rtt_smoothed( struct reliable_endpoint_t * endpoint );
+
+float reliable_endpoint_rtt_variance( struct reliable_endpoint_t * endpoint );
+
+float reliable_endpoint_rtt_min( struct reliable_endpoint_t * endpoint );
+
+void reliable_endpoint_rtt_percentiles( struct reliable_endpoint_t * endpoint, float * rtt_p50, float * rtt_p95, float * rtt_p99 );
+
 float reliable_endpoint_packet_loss( struct reliable_endpoint_t * endpoint );
 
 void reliable_endpoint_bandwidth( struct reliable_endpoint_t * endpoint, float * sent_bandwidth_kbps, float * received_bandwidth_kbps, float * acked_bandwidth_kpbs );
 
+// with congestion control on, the bytes of packet data that can be sent right now without going over the congestion controlled
+// rate. otherwise max_packet_size. fragments of large packets are paced out at that rate by reliable_endpoint_update
+
+int reliable_endpoint_send_budget( struct reliable_endpoint_t * endpoint );
+
+float reliable_endpoint_congestion_bandwidth_kbps( struct reliable_endpoint_t * endpoint );
+
 RELIABLE_CONST uint64_t * reliable_endpoint_counters( struct reliable_endpoint_t * endpoint );
 
 void reliable_endpoint_destroy( struct reliable_endpoint_t * endpoint );
@@ -62,7 +62,7 @@ int SoakMain()
 
     Address serverAddress( "127.0.0.1", ServerPort );
 
-    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time );
+    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time, nullptr );
 
     server.SetLatency( 1000.0f );
     server.SetJitter( 100.0f );
@@ -74,7 +74,7 @@ int SoakMain()
     uint64_t clientId = 0;
     yojimbo_random_bytes( (uint8_t*) &clientId, 8 );
 
-    Client client( GetDefaultAllocator(), Address("0.0.0.0"), config, adapter, time );
+    Client client( GetDefaultAllocator(), Address("0.0.0.0"), config, adapter, time, nullptr );
 
     client.SetLatency( 1000.0f );
     client.SetJitter( 100.0f );
@@ -46,7 +46,7 @@ namespace yojimbo
         m_networkSimulator = NULL;
         m_clientState = CLIENT_STATE_DISCONNECTED;
         m_clientIndex = -1;
-        m_packetBuffer = (uint8_t*) YOJIMBO_ALLOCATE( allocator, config.maxPacketSize );
+        m_packetBuffer = (uint8_t*) YOJIMBO_ALLOCATE( allocator, PacketHeadroomBytes + config.maxPacketSize + PacketTailroomBytes );
     }
 
     BaseClient::~BaseClient()
@@ -153,7 +153,15 @@ namespace yojimbo
         reliable_config.received_packets_buffer_size = m_config.receivedPacketsBufferSize;
         reliable_config.fragment_reassembly_buffer_size = m_config.packetReassemblyBufferSize;
         reliable_config.rtt_smoothing_factor = m_config.rttSmoothingFactor;
+        reliable_config.rtt_min_window_seconds = m_config.rttMinWindowSeconds;
+        reliable_config.num_ack_bits = m_config.packetAckBits;
+        reliable_config.congestion_control = m_config.congestionControl ? 1 : 0;
+        reliable_config.congestion_target_delay = m_config.congestionTargetDelay;
+        reliable_config.congestion_min_bandwidth_kbps = m_config.congestionMinBandwidth;
+        reliable_config.congestion_initial_bandwidth_kbps = m_config.congestionInitialBandwidth;
+        reliable_config.congestion_max_bandwidth_kbps = m_config.congestionMaxBandwidth;
         reliable_config.transmit_packet_function = BaseClient::StaticTransmitPacketFunction;
+        reliable_config.transmit_packet_in_place_function = BaseClient::StaticTransmitPacketInPlaceFunction;
         reliable_config.process_packet_function = BaseClient::StaticProcessPacketFunction;
         reliable_config.allocator_context = nullptr;
         reliable_config.allocate_function = nullptr;
@@ -183,6 +191,18 @@ namespace yojimbo
         BaseClient * client = (BaseClient*) context;
         client->TransmitPacketFunction( packetSequence, packetData, packetBytes );
     }
+
+    void BaseClient::StaticTransmitPacketInPlaceFunction( void * context, uint64_t index, uint16_t packetSequence, uint8_t * packetData, int packetBytes )
+    {
+        (void) index;
+        BaseClient * client = (BaseClient*) context;
+        client->TransmitPacketInPlaceFunction( packetSequence, packetData, packetBytes );
+    }
+
+    void BaseClient::TransmitPacketInPlaceFunction( uint16_t packetSequence, uint8_t * packetData, int packetBytes )
+    {
+        TransmitPacketFunction( packetSequence, packetData, packetBytes );
+    }
     
     int BaseClient::StaticProcessPacketFunction( void * context, uint64_t index, uint16_t packetSequence, uint8_t * packetData, int packetBytes )
     {
@@ -273,6 +293,10 @@ namespace yojimbo
             info.numPacketsReceived = counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_RECEIVED];
             info.numPacketsAcked = counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_ACKED];
             info.RTT = reliable_endpoint_rtt( m_endpoint );
+            info.smoothedRTT = reliable_endpoint_rtt_smoothed( m_endpoint );
+            info.RTTVariance = reliable_endpoint_rtt_variance( m_endpoint );
+            info.minRTT = reliable_endpoint_rtt_min( m_endpoint );
+            reliable_endpoint_rtt_percentiles( m_endpoint, &info.RTTp50, &info.RTTp95, &info.RTTp99 );
             info.packetLoss = reliable_endpoint_packet_loss( m_endpoint );
             reliable_endpoint_bandwidth( m_endpoint, &info.sentBandwidth, &info.receivedBandwidth, &info.ackedBandwidth );
         }
@@ -4,10 +4,30 @@
 #include "yojimbo_connection.h"
 #include "yojimbo_network_info.h"
 #include "yojimbo_utils.h"
+#include "yojimbo_worker_pool.h"
 #include "reliable.h"
 
 namespace yojimbo
 {
+    struct StagedTransmit
+    {
+        int clientIndex;
+        uint16_t packetSequence;
+        int packetBytes;
+        int offset;
+    };
+
+    struct ServerShard
+    {
+        uint8_t * packetBuffer;                                     ///< Buffer used when writing packets for clients in this shard.
+        uint8_t * transmitData;                                     ///< Packet data staged while generating packets in parallel.
+        StagedTransmit * transmits;                                 ///< Transmits staged while generating packets in parallel, in the order they were made.
+        int transmitDataSize;
+        int transmitDataBytes;
+        int maxTransmits;
+        int numTransmits;
+    };
+
     BaseServer::BaseServer( Allocator & allocator, const ClientServerConfig & config, Adapter & adapter, double time ) : m_config( config )
     {
         m_allocator = &allocator;
@@ -18,16 +38,18 @@ namespace yojimbo
         m_maxClients = 0;
         m_globalMemory = NULL;
         m_globalAllocator = NULL;
-        for ( int i = 0; i < MaxClients; ++i )
-        {
-            m_clientMemory[i] = NULL;
-            m_clientAllocator[i] = NULL;
-            m_clientMessageFactory[i] = NULL;
-            m_clientConnection[i] = NULL;
-            m_clientEndpoint[i] = NULL;
-        }
+        m_clientMemory = NULL;
+        m_clientAllocator = NULL;
+        m_clientMessageFactory = NULL;
+        m_clientConnection = NULL;
+        m_clientEndpoint = NULL;
         m_networkSimulator = NULL;
         m_packetBuffer = NULL;
+        m_workerPool = NULL;
+        m_numShards = 0;
+        m_clientsPerShard = 0;
+        m_shards = NULL;
+        m_stagingTransmits = false;
     }
 
     BaseServer::~BaseServer()
@@ -45,6 +67,7 @@ namespace yojimbo
 
     void BaseServer::Start( int maxClients )
     {
+        yojimbo_assert( maxClients > 0 );
         Stop();
         m_running = true;
         m_maxClients = maxClients;
@@ -57,6 +80,19 @@ namespace yojimbo
         {
             m_networkSimulator = YOJIMBO_NEW( *m_globalAllocator, NetworkSimulator, *m_globalAllocator, m_config.maxSimulatorPackets, m_time );
         }
+        m_clientMemory = (uint8_t**) YOJIMBO_ALLOCATE( *m_allocator, sizeof( uint8_t* ) * m_maxClients );
+        m_clientAllocator = (Allocator**) YOJIMBO_ALLOCATE( *m_allocator, sizeof( Allocator* ) * m_maxClients );
+        m_clientMessageFactory = (MessageFactory**) YOJIMBO_ALLOCATE( *m_allocator, sizeof( MessageFactory* ) * m_maxClients );
+        m_clientConnection = (Connection**) YOJIMBO_ALLOCATE( *m_allocator, sizeof( Connection* ) * m_maxClients );
+        m_clientEndpoint = (reliable_endpoint_t**) YOJIMBO_ALLOCATE( *m_allocator, sizeof( reliable_endpoint_t* ) * m_maxClients );
+        for ( int i = 0; i < m_maxClients; ++i )
+        {
+            m_clientMemory[i] = NULL;
+            m_clientAllocator[i] = NULL;
+            m_clientMessageFactory[i] = NULL;
+            m_clientConnection[i] = NULL;
+            m_clientEndpoint[i] = NULL;
+        }
         for ( int i = 0; i < m_maxClients; ++i )
         {
             yojimbo_assert( !m_clientMemory[i] );
@@ -86,7 +122,16 @@ namespace yojimbo
             reliable_config.received_packets_buffer_size = m_config.receivedPacketsBufferSize;
             reliable_config.fragment_reassembly_buffer_size = m_config.packetReassemblyBufferSize;
             reliable_config.rtt_smoothing_factor = m_config.rttSmoothingFactor;
+            reliable_config.rtt_min_window_seconds = m_config.rttMinWindowSeconds;
+            reliable_config.num_ack_bits = m_config.packetAckBits;
+            reliable_config.congestion_control = m_config.congestionControl ? 1 : 0;
+            reliable_config.congestion_target_delay = m_config.congestionTargetDelay;
+            reliable_config.congestion_min_bandwidth_kbps = m_config.congestionMinBandwidth;
+            reliable_config.congestion_initial_bandwidth_kbps = m_config.congestionInitialBandwidth;
+            reliable_config.congestion_max_bandwidth_kbps = m_config.congestionMaxBandwidth;
             reliable_config.transmit_packet_function = BaseServer::StaticTransmitPacketFunction;
+            reliable_config.transmit_packets_function = BaseServer::StaticTransmitPacketsFunction;
+            reliable_config.transmit_packet_in_place_function = BaseServer::StaticTransmitPacketInPlaceFunction;
             reliable_config.process_packet_function = BaseServer::StaticProcessPacketFunction;
             reliable_config.allocator_context = nullptr;
             reliable_config.allocate_function = nullptr;
@@ -94,7 +139,43 @@ namespace yojimbo
             m_clientEndpoint[i] = reliable_endpoint_create( &reliable_config, m_time );
             reliable_endpoint_reset( m_clientEndpoint[i] );
         }
-        m_packetBuffer = (uint8_t*) YOJIMBO_ALLOCATE( *m_globalAllocator, m_config.maxPacketSize );
+        m_packetBuffer = (uint8_t*) YOJIMBO_ALLOCATE( *m_globalAllocator, PacketHeadroomBytes + m_config.maxPacketSize + PacketTailroomBytes );
+
+        // split clients into contiguous shards. each shard only touches its own clients and its own buffers,
+        // so shards can run in parallel. anything shared (netcode, sockets, the global allocator) stays on this thread.
+
+        const int numThreads = m_config.serverWorkerThreads < m_maxClients ? m_config.serverWorkerThreads : m_maxClients;
+        if ( numThreads > 1 )
+        {
+            m_clientsPerShard = ( m_maxClients + numThreads - 1 ) / numThreads;
+            m_numShards = ( m_maxClients + m_clientsPerShard - 1 ) / m_clientsPerShard;
+            m_workerPool = YOJIMBO_NEW( *m_allocator, WorkerPool, *m_allocator, m_numShards );
+        }
+        else
+        {
+            m_clientsPerShard = m_maxClients;
+            m_numShards = 1;
+        }
+
+        const int maxFragments = m_config.maxPacketFragments > 1 ? m_config.maxPacketFragments : 1;
+        const int transmitBytesPerClient = m_config.maxPacketSize + maxFragments * ( RELIABLE_MAX_PACKET_HEADER_BYTES + RELIABLE_FRAGMENT_HEADER_BYTES );
+
+        // transmits are staged even when processing clients serially, so sending packets can encrypt them in groups
+
+        m_shards = (ServerShard*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( ServerShard ) * m_numShards );
+        memset( m_shards, 0, sizeof( ServerShard ) * m_numShards );
+        for ( int i = 0; i < m_numShards; ++i )
+        {
+            ServerShard & shard = m_shards[i];
+            if ( m_workerPool )
+            {
+                shard.packetBuffer = (uint8_t*) YOJIMBO_ALLOCATE( *m_allocator, PacketHeadroomBytes + m_config.maxPacketSize + PacketTailroomBytes );
+            }
+            shard.transmitDataSize = m_clientsPerShard * transmitBytesPerClient;
+            shard.transmitData = (uint8_t*) YOJIMBO_ALLOCATE( *m_allocator, shard.transmitDataSize );
+            shard.maxTransmits = m_clientsPerShard * maxFragments;
+            shard.transmits = (StagedTransmit*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( StagedTransmit ) * shard.maxTransmits );
+        }
     }
 
     void BaseServer::Stop()
@@ -102,6 +183,14 @@ namespace yojimbo
         if ( IsRunning() )
         {
             YOJIMBO_FREE( *m_globalAllocator, m_packetBuffer );
+            YOJIMBO_DELETE( *m_allocator, WorkerPool, m_workerPool );
+            for ( int i = 0; i < m_numShards; ++i )
+            {
+                YOJIMBO_FREE( *m_allocator, m_shards[i].packetBuffer );
+                YOJIMBO_FREE( *m_allocator, m_shards[i].transmitData );
+                YOJIMBO_FREE( *m_allocator, m_shards[i].transmits );
+            }
+            YOJIMBO_FREE( *m_allocator, m_shards );
             yojimbo_assert( m_globalMemory );
             yojimbo_assert( m_globalAllocator );
             YOJIMBO_DELETE( *m_globalAllocator, NetworkSimulator, m_networkSimulator );
@@ -117,18 +206,46 @@ namespace yojimbo
                 YOJIMBO_DELETE( *m_allocator, Allocator, m_clientAllocator[i] );
                 YOJIMBO_FREE( *m_allocator, m_clientMemory[i] );
             }
+            YOJIMBO_FREE( *m_allocator, m_clientMemory );
+            YOJIMBO_FREE( *m_allocator, m_clientAllocator );
+            YOJIMBO_FREE( *m_allocator, m_clientMessageFactory );
+            YOJIMBO_FREE( *m_allocator, m_clientConnection );
+            YOJIMBO_FREE( *m_allocator, m_clientEndpoint );
             YOJIMBO_DELETE( *m_allocator, Allocator, m_globalAllocator );
             YOJIMBO_FREE( *m_allocator, m_globalMemory );
         }
         m_running = false;
         m_maxClients = 0;
         m_packetBuffer = NULL;
+        m_numShards = 0;
+        m_clientsPerShard = 0;
+        m_stagingTransmits = false;
     }
 
     void BaseServer::AdvanceTime( double time )
     {
         m_time = time;
-        if ( IsRunning() )
+        if ( IsRunning() && m_workerPool )
+        {
+            // updating the endpoints can send paced fragments, so transmits are staged here just like in SendPackets
+            BeginStagingTransmits();
+            RunShards( StaticAdvanceTimeShard, this );
+            EndStagingTransmits();
+            for ( int i = 0; i < m_maxClients; ++i )
+            {
+                if ( m_clientConnection[i]->GetErrorLevel() != CONNECTION_ERROR_NONE )
+                {
+                    yojimbo_printf( YOJIMBO_LOG_LEVEL_ERROR, "client %d connection is in error state. disconnecting client\n", i );
+                    DisconnectClient( i );
+                }
+            }
+            NetworkSimulator * networkSimulator = GetNetworkSimulator();
+            if ( networkSimulator )
+            {
+                networkSimulator->AdvanceTime( time );
+            }        
+        }
+        else if ( IsRunning() )
         {
             for ( int i = 0; i < m_maxClients; ++i )
             {
@@ -153,6 +270,142 @@ namespace yojimbo
         }
     }
 
+    void BaseServer::AdvanceTimeShard( int shardIndex )
+    {
+        // clients that go into error state here are disconnected by AdvanceTime once every shard is done,
+        // since disconnecting goes through netcode
+
+        int firstClientIndex, endClientIndex;
+        GetShardClients( shardIndex, firstClientIndex, endClientIndex );
+        for ( int i = firstClientIndex; i < endClientIndex; ++i )
+        {
+            m_clientConnection[i]->AdvanceTime( m_time );
+            if ( m_clientConnection[i]->GetErrorLevel() != CONNECTION_ERROR_NONE )
+                continue;
+            reliable_endpoint_update( m_clientEndpoint[i], m_time );
+            int numAcks;
+            const uint16_t * acks = reliable_endpoint_get_acks( m_clientEndpoint[i], &numAcks );
+            m_clientConnection[i]->ProcessAcks( acks, numAcks );
+            reliable_endpoint_clear_acks( m_clientEndpoint[i] );
+        }
+    }
+
+    void BaseServer::GetShardClients( int shardIndex, int & firstClientIndex, int & endClientIndex ) const
+    {
+        yojimbo_assert( shardIndex >= 0 );
+        yojimbo_assert( shardIndex < m_numShards );
+        firstClientIndex = shardIndex * m_clientsPerShard;
+        endClientIndex = firstClientIndex + m_clientsPerShard;
+        if ( endClientIndex > m_maxClients )
+            endClientIndex = m_maxClients;
+    }
+
+    uint8_t * BaseServer::GetShardPacketBuffer( int shardIndex )
+    {
+        yojimbo_assert( shardIndex >= 0 );
+        yojimbo_assert( shardIndex < m_numShards );
+        return ( m_workerPool ? m_shards[shardIndex].packetBuffer : m_packetBuffer ) + PacketHeadroomBytes;
+    }
+
+    void BaseServer::RunShards( void (*function)( void * context, int shardIndex ), void * context )
+    {
+        yojimbo_assert( IsRunning() );
+        if ( m_workerPool )
+        {
+            m_workerPool->Run( m_numShards, function, context );
+        }
+        else
+        {
+            for ( int i = 0; i < m_numShards; ++i )
+            {
+                function( context, i );
+            }
+        }
+    }
+
+    void BaseServer::BeginStagingTransmits()
+    {
+        yojimbo_assert( !m_stagingTransmits );
+        for ( int i = 0; i < m_numShards; ++i )
+        {
+            m_shards[i].numTransmits = 0;
+            m_shards[i].transmitDataBytes = 0;
+        }
+        m_stagingTransmits = true;
+    }
+
+    void BaseServer::EndStagingTransmits()
+    {
+        // shards are contiguous client ranges, so walking them in order transmits in client order, however many threads made them.
+        // staged transmits are handed over in groups so the server can encrypt many packets at once
+
+        if ( !m_stagingTransmits )
+            return;
+        m_stagingTransmits = false;
+
+        const int MaxGroupPackets = 64;
+        int clientIndex[MaxGroupPackets];
+        uint16_t packetSequence[MaxGroupPackets];
+        uint8_t * packetData[MaxGroupPackets];
+        int packetBytes[MaxGroupPackets];
+        int numPackets = 0;
+
+        for ( int i = 0; i < m_numShards; ++i )
+        {
+            ServerShard & shard = m_shards[i];
+            for ( int j = 0; j < shard.numTransmits; ++j )
+            {
+                const StagedTransmit & transmit = shard.transmits[j];
+                clientIndex[numPackets] = transmit.clientIndex;
+                packetSequence[numPackets] = transmit.packetSequence;
+                packetData[numPackets] = shard.transmitData + transmit.offset;
+                packetBytes[numPackets] = transmit.packetBytes;
+                if ( ++numPackets == MaxGroupPackets )
+                {
+                    TransmitStagedPacketsFunction( clientIndex, packetSequence, packetData, packetBytes, numPackets );
+                    numPackets = 0;
+                }
+            }
+        }
+
+        if ( numPackets > 0 )
+        {
+            TransmitStagedPacketsFunction( clientIndex, packetSequence, packetData, packetBytes, numPackets );
+        }
+
+        for ( int i = 0; i < m_numShards; ++i )
+        {
+            m_shards[i].numTransmits = 0;
+            m_shards[i].transmitDataBytes = 0;
+        }
+    }
+
+    void BaseServer::StageTransmit( int clientIndex, uint16_t packetSequence, const uint8_t * packetData, int packetBytes )
+    {
+        yojimbo_assert( m_stagingTransmits );
+        yojimbo_assert( clientIndex >= 0 );
+        yojimbo_assert( clientIndex < m_maxClients );
+        ServerShard & shard = m_shards[clientIndex / m_clientsPerShard];
+        if ( shard.numTransmits == shard.maxTransmits || shard.transmitDataBytes + packetBytes > shard.transmitDataSize )
+        {
+            yojimbo_printf( YOJIMBO_LOG_LEVEL_ERROR, "server shard transmit buffer is full. dropping packet for client %d\n", clientIndex );
+            return;
+        }
+        StagedTransmit & transmit = shard.transmits[shard.numTransmits++];
+        transmit.clientIndex = clientIndex;
+        transmit.packetSequence = packetSequence;
+        transmit.packetBytes = packetBytes;
+        transmit.offset = shard.transmitDataBytes;
+        memcpy( shard.transmitData + shard.transmitDataBytes, packetData, packetBytes );
+        shard.transmitDataBytes += packetBytes;
+    }
+
+    void BaseServer::StaticAdvanceTimeShard( void * context, int shardIndex )
+    {
+        BaseServer * server = (BaseServer*) context;
+        server->AdvanceTimeShard( shardIndex );
+    }
+
     void BaseServer::SetLatency( float milliseconds )
     {
         if ( m_networkSimulator )
@@ -274,6 +527,10 @@ namespace yojimbo
             info.numPacketsReceived = counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_RECEIVED];
             info.numPacketsAcked = counters[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_ACKED];
             info.RTT = reliable_endpoint_rtt( m_clientEndpoint[clientIndex] );
+            info.smoothedRTT = reliable_endpoint_rtt_smoothed( m_clientEndpoint[clientIndex] );
+            info.RTTVariance = reliable_endpoint_rtt_variance( m_clientEndpoint[clientIndex] );
+            info.minRTT = reliable_endpoint_rtt_min( m_clientEndpoint[clientIndex] );
+            reliable_endpoint_rtt_percentiles( m_clientEndpoint[clientIndex], &info.RTTp50, &info.RTTp95, &info.RTTp99 );
             info.packetLoss = reliable_endpoint_packet_loss( m_clientEndpoint[clientIndex] );
             reliable_endpoint_bandwidth( m_clientEndpoint[clientIndex], &info.sentBandwidth, &info.receivedBandwidth, &info.ackedBandwidth );
         }
@@ -307,9 +564,62 @@ namespace yojimbo
     void BaseServer::StaticTransmitPacketFunction( void * context, uint64_t index, uint16_t packetSequence, uint8_t * packetData, int packetBytes )
     {
         BaseServer * server = (BaseServer*) context;
+        if ( server->m_stagingTransmits )
+        {
+            server->StageTransmit( (int) index, packetSequence, packetData, packetBytes );
+            return;
+        }
         server->TransmitPacketFunction( index, packetSequence, packetData, packetBytes );
     }
     
+    void BaseServer::StaticTransmitPacketsFunction( void * context, uint64_t index, uint16_t packetSequence, uint8_t ** packetData, int * packetBytes, int numPackets )
+    {
+        BaseServer * server = (BaseServer*) context;
+        if ( server->m_stagingTransmits )
+        {
+            for ( int i = 0; i < numPackets; ++i )
+            {
+                server->StageTransmit( (int) index, packetSequence, packetData[i], packetBytes[i] );
+            }
+            return;
+        }
+        server->TransmitPacketsFunction( (int) index, packetSequence, packetData, packetBytes, numPackets );
+    }
+
+    void BaseServer::TransmitPacketsFunction( int clientIndex, uint16_t packetSequence, uint8_t ** packetData, int * packetBytes, int numPackets )
+    {
+        for ( int i = 0; i < numPackets; ++i )
+        {
+            TransmitPacketFunction( clientIndex, packetSequence, packetData[i], packetBytes[i] );
+        }
+    }
+
+    void BaseServer::StaticTransmitPacketInPlaceFunction( void * context, uint64_t index, uint16_t packetSequence, uint8_t * packetData, int packetBytes )
+    {
+        // staged transmits are copied out of the shard packet buffer anyway, so they take the regular path
+
+        BaseServer * server = (BaseServer*) context;
+        if ( server->m_stagingTransmits )
+        {
+            server->StageTransmit( (int) index, packetSequence, packetData, packetBytes );
+            return;
+        }
+        server->TransmitPacketInPlaceFunction( (int) index, packetSequence, packetData, packetBytes );
+    }
+
+    void BaseServer::TransmitPacketInPlaceFunction( int clientIndex, uint16_t packetSequence, uint8_t * packetData, int packetBytes )
+    {
+        TransmitPacketFunction( clientIndex, packetSequence, packetData, packetBytes );
+    }
+
+    void BaseServer::TransmitStagedPacketsFunction( const int * clientIndex, const uint16_t * packetSequence, uint8_t ** packetData, const int * packetBytes, int numPackets )
+    {
+        for ( int i = 0; i < numPackets; ++i )
+        {
+            TransmitPacketFunction( clientIndex[i], packetSequence[i], packetData[i], packetBytes[i] );
+        }
+    }
+
     int BaseServer::StaticProcessPacketFunction( void * context, uint64_t index, uint16_t packetSequence, uint8_t * packetData, int packetBytes )
     {
         BaseServer * server = (BaseServer*) context;
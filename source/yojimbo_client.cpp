@@ -1,6 +1,7 @@
 #include "yojimbo_client.h"
 #include "yojimbo_connection.h"
 #include "yojimbo_network_simulator.h"
+#include "yojimbo_utils.h"
 #include "yojimbo_adapter.h"
 #include "netcode.h"
 #include "reliable.h"
@@ -13,6 +14,8 @@ namespace yojimbo
         m_clientId = 0;
         m_client = NULL;
 		m_parent = parent;
+        m_hasSessionTicket = false;
+        memset( m_sessionTicket, 0, sizeof( m_sessionTicket ) );
         m_boundAddress = m_address;
     }
 
@@ -69,16 +72,17 @@ namespace yojimbo
         uint8_t userData[256];
         memset( &userData, 0, sizeof(userData) );
 
-        return netcode_generate_connect_token( numServerAddresses, 
-                                               serverAddressStringPointers, 
-                                               serverAddressStringPointers, 
-                                               -1,
-                                               m_config.timeout, 
-                                               clientId, 
-                                               m_config.protocolId, 
-                                               (uint8_t*)privateKey,
-                                               &userData[0], 
-                                               connectToken ) == NETCODE_OK;
+        return netcode_generate_connect_token_with_cipher_suite( numServerAddresses, 
+                                                                 serverAddressStringPointers, 
+                                                                 serverAddressStringPointers, 
+                                                                 -1,
+                                                                 m_config.timeout, 
+                                                                 clientId, 
+                                                                 m_config.protocolId, 
+                                                                 (uint8_t*)privateKey,
+                                                                 &userData[0], 
+                                                                 m_config.integrityOnly ? NETCODE_CIPHER_SUITE_INTEGRITY_ONLY : ( m_config.aesGcm ? NETCODE_CIPHER_SUITE_AES256_GCM : NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 ), 
+                                                                 connectToken ) == NETCODE_OK;
     }
 
     void Client::Connect( uint64_t clientId, uint8_t * connectToken )
@@ -115,9 +119,11 @@ namespace yojimbo
         uint8_t * packetData = GetPacketBuffer();
         int packetBytes;
         uint16_t packetSequence = reliable_endpoint_next_packet_sequence( GetEndpoint() );
-        if ( GetConnection().GeneratePacket( GetContext(), packetSequence, packetData, m_config.maxPacketSize, packetBytes ) )
+        // with congestion control the packet shrinks to what the send budget allows, but still goes out to carry acks
+        const int maxPacketBytes = yojimbo_max( yojimbo_min( reliable_endpoint_send_budget( GetEndpoint() ), m_config.maxPacketSize ) & ~3, 4 );
+        if ( GetConnection().GeneratePacket( GetContext(), packetSequence, packetData, maxPacketBytes, packetBytes ) )
         {
-            reliable_endpoint_send_packet( GetEndpoint(), packetData, packetBytes );
+            reliable_endpoint_send_packet_in_place( GetEndpoint(), packetData, packetBytes );
         }
     }
 
@@ -138,6 +144,13 @@ namespace yojimbo
         }
     }
 
+    bool Client::WaitForPackets( double timeout )
+    {
+        if ( !m_client )
+            return true;
+        return netcode_client_wait( m_client, timeout ) != 0;
+    }
+
     void Client::AdvanceTime( double time )
     {
         BaseClient::AdvanceTime( time );
@@ -226,6 +239,9 @@ namespace yojimbo
         netcodeConfig.callback_context              = this;
         netcodeConfig.state_change_callback         = StaticStateChangeCallbackFunction;
         netcodeConfig.send_loopback_packet_callback = StaticSendLoopbackPacketCallbackFunction;
+        netcodeConfig.adaptive_handshake            = m_config.adaptiveHandshake ? 1 : 0;
+        netcodeConfig.race_connect_servers          = m_config.raceConnectServers;
+        netcodeConfig.connection_id                 = m_config.connectionIds ? 1 : 0;
 
 #if PLATFORM_WEB
 		/* Have to set it early to prevent socket creation */
@@ -239,10 +255,25 @@ namespace yojimbo
         }
     }
 
+    bool Client::GetSessionTicket( uint8_t * sessionTicket ) const
+    {
+        yojimbo_assert( sessionTicket );
+        if ( m_client && netcode_client_session_ticket( m_client, sessionTicket ) )
+            return true;
+        if ( !m_hasSessionTicket )
+            return false;
+        memcpy( sessionTicket, m_sessionTicket, ConnectTokenBytes );
+        return true;
+    }
+
     void Client::DestroyClient()
     {
         if ( m_client )
         {
+            // the session ticket is what gets the client back in after it disconnects, so it outlives the netcode client
+
+            if ( netcode_client_session_ticket( m_client, m_sessionTicket ) )
+                m_hasSessionTicket = true;
             m_boundAddress = m_address;
             netcode_client_destroy( m_client );
             m_client = NULL;
@@ -275,6 +306,20 @@ namespace yojimbo
         }
     }
 
+    void Client::TransmitPacketInPlaceFunction( uint16_t packetSequence, uint8_t * packetData, int packetBytes )
+    {
+        (void) packetSequence;
+        NetworkSimulator * networkSimulator = GetNetworkSimulator();
+        if ( networkSimulator && networkSimulator->IsActive() )
+        {
+            networkSimulator->SendPacket( 0, packetData, packetBytes );
+        }
+        else
+        {
+            netcode_client_send_packet_in_place( m_client, packetData, packetBytes );
+        }
+    }
+
     int Client::ProcessPacketFunction( uint16_t packetSequence, uint8_t * packetData, int packetBytes )
     {
         return (int) GetConnection().ProcessPacket( GetContext(), packetSequence, packetData, packetBytes );
@@ -14,6 +14,9 @@ namespace yojimbo
         m_jitter = 0.0f;
         m_packetLoss = 0.0f;
         m_duplicates = 0.0f;
+        m_bandwidth = 0.0f;
+        m_maxQueueDelay = 250.0f;
+        m_linkFreeTime = time;
         m_active = false;
         m_numPacketEntries = numPackets;
         m_packetEntries = (PacketEntry*) YOJIMBO_ALLOCATE( allocator, sizeof( PacketEntry ) * numPackets );
@@ -56,6 +59,17 @@ namespace yojimbo
         UpdateActive();
     }
 
+    void NetworkSimulator::SetBandwidth( float kbps )
+    {
+        m_bandwidth = kbps;
+        UpdateActive();
+    }
+
+    void NetworkSimulator::SetMaxQueueDelay( float milliseconds )
+    {
+        m_maxQueueDelay = milliseconds;
+    }
+
     bool NetworkSimulator::IsActive() const
     {
         return m_active;
@@ -64,7 +78,7 @@ namespace yojimbo
     void NetworkSimulator::UpdateActive()
     {
         bool previous = m_active;
-        m_active = m_latency != 0.0f || m_jitter != 0.0f || m_packetLoss != 0.0f || m_duplicates != 0.0f;
+        m_active = m_latency != 0.0f || m_jitter != 0.0f || m_packetLoss != 0.0f || m_duplicates != 0.0f || m_bandwidth != 0.0f;
         if ( previous && !m_active )
         {
             DiscardPackets();
@@ -82,6 +96,24 @@ namespace yojimbo
             return;
         }
 
+        double delay = m_latency / 1000.0;
+
+        if ( m_bandwidth > 0.0f )
+        {
+            // the packet waits for everything queued ahead of it, then takes its own time on the link
+
+            const double queueDelay = yojimbo_max( m_linkFreeTime - m_time, 0.0 );
+
+            if ( m_maxQueueDelay > 0.0f && queueDelay * 1000.0 > m_maxQueueDelay )
+            {
+                return;
+            }
+
+            m_linkFreeTime = m_time + queueDelay + packetBytes * 8.0 / ( m_bandwidth * 1000.0 );
+
+            delay += m_linkFreeTime - m_time;
+        }
+
         PacketEntry & packetEntry = m_packetEntries[m_currentIndex];
 
         if ( packetEntry.packetData )
@@ -90,8 +122,6 @@ namespace yojimbo
             packetEntry = PacketEntry();
         }
 
-        double delay = m_latency / 1000.0;
-
         if ( m_jitter > 0 )
             delay += yojimbo_random_float( -m_jitter, +m_jitter ) / 1000.0;
 
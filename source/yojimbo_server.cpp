@@ -26,6 +26,7 @@
 #include "yojimbo_connection.h"
 #include "yojimbo_adapter.h"
 #include "yojimbo_network_simulator.h"
+#include "yojimbo_utils.h"
 #include "reliable.h"
 #include "netcode.h"
 
@@ -40,6 +41,10 @@ namespace yojimbo
         m_boundAddress = address;
         m_config = config;
         m_server = NULL;
+        m_receivedPackets = NULL;
+        m_numReceivedPackets = 0;
+        m_maxReceivedPackets = 0;
+        m_shardReceivedPacketsStart = NULL;
 		m_parent = parent;
     }
 
@@ -69,6 +74,16 @@ namespace yojimbo
         netcodeConfig.callback_context = this;
         netcodeConfig.connect_disconnect_callback = StaticConnectDisconnectCallbackFunction;
         netcodeConfig.send_loopback_packet_callback = StaticSendLoopbackPacketCallbackFunction;
+        netcodeConfig.max_clients = maxClients;
+        netcodeConfig.udp_offload = m_config.serverUdpOffload ? 1 : 0;
+        netcodeConfig.cipher_suite = m_config.integrityOnly ? NETCODE_CIPHER_SUITE_INTEGRITY_ONLY : ( m_config.aesGcm ? NETCODE_CIPHER_SUITE_AES256_GCM : NETCODE_CIPHER_SUITE_CHACHA20_POLY1305 );
+        netcodeConfig.handshake_thread = m_config.serverHandshakeThread ? 1 : 0;
+        netcodeConfig.admission_control = m_config.serverAdmissionControl ? 1 : 0;
+        netcodeConfig.max_connection_requests_per_second = m_config.serverMaxConnectionRequestsPerSecond;
+        netcodeConfig.connect_token_scan = m_config.serverConnectTokenScan ? 1 : 0;
+        netcodeConfig.adaptive_handshake = m_config.adaptiveHandshake ? 1 : 0;
+        netcodeConfig.session_ticket_seconds = m_config.serverSessionTicketSeconds;
+        netcodeConfig.connection_ids = m_config.connectionIds ? 1 : 0;
 #if PLATFORM_WEB
 		/* Have to set it early to prevent socket creation */
         netcodeConfig.override_send_and_receive = 1;
@@ -84,6 +99,13 @@ namespace yojimbo
         
         netcode_server_start( m_server, maxClients );
 
+        if ( IsProcessingClientsInParallel() )
+        {
+            m_maxReceivedPackets = maxClients;
+            m_receivedPackets = (ReceivedPacket*) YOJIMBO_ALLOCATE( GetGlobalAllocator(), sizeof( ReceivedPacket ) * m_maxReceivedPackets );
+            m_shardReceivedPacketsStart = (int*) YOJIMBO_ALLOCATE( GetGlobalAllocator(), sizeof( int ) * ( GetNumShards() + 1 ) );
+        }
+
         m_boundAddress.SetPort( netcode_server_get_port( m_server ) );
     }
 
@@ -96,6 +118,13 @@ namespace yojimbo
             netcode_server_destroy( m_server );
             m_server = NULL;
         }
+        if ( IsRunning() )
+        {
+            YOJIMBO_FREE( GetGlobalAllocator(), m_receivedPackets );
+            YOJIMBO_FREE( GetGlobalAllocator(), m_shardReceivedPacketsStart );
+        }
+        m_numReceivedPackets = 0;
+        m_maxReceivedPackets = 0;
         BaseServer::Stop();
     }
 
@@ -121,26 +150,91 @@ namespace yojimbo
     {
         if ( m_server )
         {
-            const int maxClients = GetMaxClients();
-            for ( int i = 0; i < maxClients; ++i )
+            // packets are staged while they are generated, serially or not, then handed to netcode in groups to encrypt together
+            BeginStagingTransmits();
+            RunShards( StaticSendPacketsShard, this );
+            EndStagingTransmits();
+            netcode_server_flush_packets( m_server );
+        }
+    }
+
+    void Server::SendClientPacket( int clientIndex, uint8_t * packetData )
+    {
+        if ( IsClientConnected( clientIndex ) )
+        {
+            int packetBytes;
+            uint16_t packetSequence = reliable_endpoint_next_packet_sequence( GetClientEndpoint( clientIndex ) );
+            // with congestion control the packet shrinks to what the send budget allows, but still goes out to carry acks
+            const int maxPacketBytes = yojimbo_max( yojimbo_min( reliable_endpoint_send_budget( GetClientEndpoint( clientIndex ) ), m_config.maxPacketSize ) & ~3, 4 );
+            if ( GetClientConnection( clientIndex ).GeneratePacket( GetContext(), packetSequence, packetData, maxPacketBytes, packetBytes ) )
             {
-                if ( IsClientConnected( i ) )
-                {
-                    uint8_t * packetData = GetPacketBuffer();
-                    int packetBytes;
-                    uint16_t packetSequence = reliable_endpoint_next_packet_sequence( GetClientEndpoint(i) );
-                    if ( GetClientConnection(i).GeneratePacket( GetContext(), packetSequence, packetData, m_config.maxPacketSize, packetBytes ) )
-                    {
-                        reliable_endpoint_send_packet( GetClientEndpoint(i), packetData, packetBytes );
-                    }
-                }
+                reliable_endpoint_send_packet_in_place( GetClientEndpoint( clientIndex ), packetData, packetBytes );
             }
         }
     }
 
+    void Server::SendPacketsShard( int shardIndex )
+    {
+        int firstClientIndex, endClientIndex;
+        GetShardClients( shardIndex, firstClientIndex, endClientIndex );
+        uint8_t * packetData = GetShardPacketBuffer( shardIndex );
+        for ( int i = firstClientIndex; i < endClientIndex; ++i )
+        {
+            SendClientPacket( i, packetData );
+        }
+    }
+
     void Server::ReceivePackets()
     {
-        if ( m_server )
+        if ( m_server && IsProcessingClientsInParallel() )
+        {
+            // netcode packet queues and the global allocator aren't thread safe, so pull every packet out here,
+            // let the shards run them through their reliable endpoints, then free them all back on this thread
+
+            m_numReceivedPackets = 0;
+            const int numShards = GetNumShards();
+            for ( int shardIndex = 0; shardIndex < numShards; ++shardIndex )
+            {
+                m_shardReceivedPacketsStart[shardIndex] = m_numReceivedPackets;
+                int firstClientIndex, endClientIndex;
+                GetShardClients( shardIndex, firstClientIndex, endClientIndex );
+                for ( int clientIndex = firstClientIndex; clientIndex < endClientIndex; ++clientIndex )
+                {
+                    while ( true )
+                    {
+                        int packetBytes;
+                        uint64_t packetSequence;
+                        uint8_t * packetData = netcode_server_receive_packet( m_server, clientIndex, &packetBytes, &packetSequence );
+                        if ( !packetData )
+                            break;
+                        if ( m_numReceivedPackets == m_maxReceivedPackets )
+                        {
+                            const int maxReceivedPackets = m_maxReceivedPackets * 2;
+                            ReceivedPacket * receivedPackets = (ReceivedPacket*) YOJIMBO_ALLOCATE( GetGlobalAllocator(), sizeof( ReceivedPacket ) * maxReceivedPackets );
+                            yojimbo_assert( receivedPackets );
+                            memcpy( receivedPackets, m_receivedPackets, sizeof( ReceivedPacket ) * m_numReceivedPackets );
+                            YOJIMBO_FREE( GetGlobalAllocator(), m_receivedPackets );
+                            m_receivedPackets = receivedPackets;
+                            m_maxReceivedPackets = maxReceivedPackets;
+                        }
+                        ReceivedPacket & receivedPacket = m_receivedPackets[m_numReceivedPackets++];
+                        receivedPacket.clientIndex = clientIndex;
+                        receivedPacket.packetBytes = packetBytes;
+                        receivedPacket.packetData = packetData;
+                    }
+                }
+            }
+            m_shardReceivedPacketsStart[numShards] = m_numReceivedPackets;
+
+            RunShards( StaticReceivePacketsShard, this );
+
+            for ( int i = 0; i < m_numReceivedPackets; ++i )
+            {
+                netcode_server_free_packet( m_server, m_receivedPackets[i].packetData );
+            }
+            m_numReceivedPackets = 0;
+        }
+        else if ( m_server )
         {
             const int maxClients = GetMaxClients();
             for ( int clientIndex = 0; clientIndex < maxClients; ++clientIndex )
@@ -159,6 +253,36 @@ namespace yojimbo
         }
     }
 
+    bool Server::WaitForPackets( double timeout )
+    {
+        if ( !m_server )
+            return true;
+        return netcode_server_wait( m_server, timeout ) != 0;
+    }
+
+    void Server::ReceivePacketsShard( int shardIndex )
+    {
+        const int start = m_shardReceivedPacketsStart[shardIndex];
+        const int end = m_shardReceivedPacketsStart[shardIndex+1];
+        for ( int i = start; i < end; ++i )
+        {
+            const ReceivedPacket & receivedPacket = m_receivedPackets[i];
+            reliable_endpoint_receive_packet( GetClientEndpoint( receivedPacket.clientIndex ), receivedPacket.packetData, receivedPacket.packetBytes );
+        }
+    }
+
+    void Server::StaticSendPacketsShard( void * context, int shardIndex )
+    {
+        Server * server = (Server*) context;
+        server->SendPacketsShard( shardIndex );
+    }
+
+    void Server::StaticReceivePacketsShard( void * context, int shardIndex )
+    {
+        Server * server = (Server*) context;
+        server->ReceivePacketsShard( shardIndex );
+    }
+
     void Server::AdvanceTime( double time )
     {
         if ( m_server )
@@ -179,6 +303,11 @@ namespace yojimbo
                 YOJIMBO_FREE( networkSimulator->GetAllocator(), packetData[i] );
             }
         }
+        if ( m_server )
+        {
+            // paced fragments sent while updating the client endpoints
+            netcode_server_flush_packets( m_server );
+        }
     }
 
     bool Server::IsClientConnected( int clientIndex ) const
@@ -235,6 +364,46 @@ namespace yojimbo
         }
     }
 
+    void Server::TransmitPacketsFunction( int clientIndex, uint16_t packetSequence, uint8_t ** packetData, int * packetBytes, int numPackets )
+    {
+        NetworkSimulator * networkSimulator = GetNetworkSimulator();
+        if ( networkSimulator && networkSimulator->IsActive() )
+        {
+            BaseServer::TransmitPacketsFunction( clientIndex, packetSequence, packetData, packetBytes, numPackets );
+        }
+        else
+        {
+            netcode_server_send_packets_together( m_server, clientIndex, (const uint8_t**) packetData, packetBytes, numPackets );
+        }
+    }
+
+    void Server::TransmitPacketInPlaceFunction( int clientIndex, uint16_t packetSequence, uint8_t * packetData, int packetBytes )
+    {
+        (void) packetSequence;
+        NetworkSimulator * networkSimulator = GetNetworkSimulator();
+        if ( networkSimulator && networkSimulator->IsActive() )
+        {
+            networkSimulator->SendPacket( clientIndex, packetData, packetBytes );
+        }
+        else
+        {
+            netcode_server_send_packet_in_place( m_server, clientIndex, packetData, packetBytes );
+        }
+    }
+
+    void Server::TransmitStagedPacketsFunction( const int * clientIndex, const uint16_t * packetSequence, uint8_t ** packetData, const int * packetBytes, int numPackets )
+    {
+        NetworkSimulator * networkSimulator = GetNetworkSimulator();
+        if ( networkSimulator && networkSimulator->IsActive() )
+        {
+            BaseServer::TransmitStagedPacketsFunction( clientIndex, packetSequence, packetData, packetBytes, numPackets );
+        }
+        else
+        {
+            netcode_server_send_packets_batch( m_server, clientIndex, (const uint8_t**) packetData, packetBytes, numPackets );
+        }
+    }
+
     int Server::ProcessPacketFunction( int clientIndex, uint16_t packetSequence, uint8_t * packetData, int packetBytes )
     {
         return (int) GetClientConnection(clientIndex).ProcessPacket( GetContext(), packetSequence, packetData, packetBytes );
@@ -0,0 +1,105 @@
+#include "yojimbo_worker_pool.h"
+#include <new>
+
+namespace yojimbo
+{
+    WorkerPool::WorkerPool( Allocator & allocator, int numThreads )
+    {
+        yojimbo_assert( numThreads >= 1 );
+        m_allocator = &allocator;
+        m_numThreads = numThreads;
+        m_threads = NULL;
+        m_function = NULL;
+        m_context = NULL;
+        m_numTasks = 0;
+        m_nextTask = 0;
+        m_numTasksRemaining = 0;
+        m_quit = false;
+        if ( numThreads > 1 )
+        {
+            m_threads = (std::thread*) YOJIMBO_ALLOCATE( allocator, sizeof( std::thread ) * ( numThreads - 1 ) );
+            yojimbo_assert( m_threads );
+            for ( int i = 0; i < numThreads - 1; ++i )
+            {
+                new ( &m_threads[i] ) std::thread( &WorkerPool::WorkerThread, this );
+            }
+        }
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        yojimbo_assert( m_allocator );
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_quit = true;
+        }
+        m_taskReady.notify_all();
+        if ( m_threads )
+        {
+            for ( int i = 0; i < m_numThreads - 1; ++i )
+            {
+                m_threads[i].join();
+                m_threads[i].~thread();
+            }
+            YOJIMBO_FREE( *m_allocator, m_threads );
+        }
+        m_allocator = NULL;
+    }
+
+    void WorkerPool::Run( int numTasks, void (*function)( void * context, int taskIndex ), void * context )
+    {
+        yojimbo_assert( function );
+        if ( numTasks <= 0 )
+            return;
+        std::unique_lock<std::mutex> lock( m_mutex );
+        yojimbo_assert( m_numTasksRemaining == 0 );
+        m_function = function;
+        m_context = context;
+        m_numTasks = numTasks;
+        m_nextTask = 0;
+        m_numTasksRemaining = numTasks;
+        if ( m_threads )
+        {
+            m_taskReady.notify_all();
+        }
+        while ( RunNextTask( lock ) ) {}
+        m_tasksDone.wait( lock, [this] { return m_numTasksRemaining == 0; } );
+        m_function = NULL;
+        m_context = NULL;
+        m_numTasks = 0;
+        m_nextTask = 0;
+    }
+
+    void WorkerPool::WorkerThread()
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        while ( true )
+        {
+            m_taskReady.wait( lock, [this] { return m_quit || m_nextTask < m_numTasks; } );
+            if ( m_quit )
+                break;
+            while ( RunNextTask( lock ) ) {}
+        }
+    }
+
+    bool WorkerPool::RunNextTask( std::unique_lock<std::mutex> & lock )
+    {
+        // IMPORTANT: the function and context are read under the lock together with the task index,
+        // so a thread can never pair a task index from one batch with the function from another.
+
+        if ( m_nextTask >= m_numTasks )
+            return false;
+        const int taskIndex = m_nextTask++;
+        void (*function)( void * context, int taskIndex ) = m_function;
+        void * context = m_context;
+        lock.unlock();
+        function( context, taskIndex );
+        lock.lock();
+        yojimbo_assert( m_numTasksRemaining > 0 );
+        if ( --m_numTasksRemaining == 0 )
+        {
+            m_tasksDone.notify_one();
+        }
+        return true;
+    }
+}
@@ -1342,12 +1342,12 @@ void test_client_server_messages()
     config.channel[0].maxBlockSize = 1024;
     config.channel[0].blockFragmentSize = 200;
 
-    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time );
+    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time, nullptr );
 
     uint8_t privateKey[KeyBytes];
     memset( privateKey, 0, KeyBytes );
 
-    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time );
+    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time, nullptr );
 
     server.Start( MaxClients );
 
@@ -1442,7 +1442,7 @@ void CreateClients( int numClients, Client ** clients, const Address & address,
 {
     for ( int i = 0; i < numClients; ++i )
     {
-        clients[i] = YOJIMBO_NEW( GetDefaultAllocator(), Client, GetDefaultAllocator(), address, config, _adapter, time );
+        clients[i] = YOJIMBO_NEW( GetDefaultAllocator(), Client, GetDefaultAllocator(), address, config, _adapter, time, nullptr );
         clients[i]->SetLatency( 250 );
         clients[i]->SetJitter( 100 );
         clients[i]->SetPacketLoss( 25 );
@@ -1509,7 +1509,7 @@ void test_client_server_start_stop_restart()
     uint8_t privateKey[KeyBytes];
     memset( privateKey, 0, KeyBytes );
 
-    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time );
+    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time, nullptr );
 
     server.Start( MaxClients );
 
@@ -1602,6 +1602,368 @@ void test_client_server_start_stop_restart()
     }
 }
 
+void test_client_server_worker_threads()
+{
+    Address clientAddress( "0.0.0.0", 0 );
+    Address serverAddress( "127.0.0.1", ServerPort );
+
+    double time = 100.0;
+
+    ClientServerConfig config;
+    config.serverWorkerThreads = 3;
+    config.channel[0].messageSendQueueSize = 32;
+    config.channel[0].maxMessagesPerPacket = 8;
+    config.channel[0].maxBlockSize = 1024;
+    config.channel[0].blockFragmentSize = 200;
+
+    uint8_t privateKey[KeyBytes];
+    memset( privateKey, 0, KeyBytes );
+
+    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time, nullptr );
+
+    // 8 slots across 3 threads gives uneven shards
+
+    const int NumClients = 8;
+
+    server.Start( NumClients );
+
+    server.SetLatency( 250 );
+    server.SetJitter( 100 );
+    server.SetPacketLoss( 25 );
+    server.SetDuplicates( 25 );
+
+    Client * clients[NumClients];
+
+    CreateClients( NumClients, clients, clientAddress, config, adapter, time );
+
+    ConnectClients( NumClients, clients, privateKey, serverAddress );
+
+    while ( true )
+    {
+        Server * servers[] = { &server };
+
+        PumpClientServerUpdate( time, clients, NumClients, servers, 1 );
+
+        if ( AnyClientDisconnected( NumClients, clients ) )
+            break;
+
+        if ( AllClientsConnected( NumClients, server, clients ) )
+            break;
+    }
+
+    check( AllClientsConnected( NumClients, server, clients ) );
+
+    const int NumMessagesSent = config.channel[0].messageSendQueueSize;
+
+    for ( int clientIndex = 0; clientIndex < NumClients; ++clientIndex )
+    {
+        SendClientToServerMessages( *clients[clientIndex], NumMessagesSent );
+        SendServerToClientMessages( server, clientIndex, NumMessagesSent );
+    }
+
+    int numMessagesReceivedFromClient[NumClients];
+    int numMessagesReceivedFromServer[NumClients];
+
+    memset( numMessagesReceivedFromClient, 0, sizeof( numMessagesReceivedFromClient ) );
+    memset( numMessagesReceivedFromServer, 0, sizeof( numMessagesReceivedFromServer ) );
+
+    const int NumIterations = 10000;
+
+    for ( int i = 0; i < NumIterations; ++i )
+    {
+        Server * servers[] = { &server };
+
+        PumpClientServerUpdate( time, clients, NumClients, servers, 1 );
+
+        bool allMessagesReceived = true;
+
+        for ( int j = 0; j < NumClients; ++j )
+        {
+            ProcessServerToClientMessages( *clients[j], numMessagesReceivedFromServer[j] );
+
+            if ( numMessagesReceivedFromServer[j] != NumMessagesSent )
+                allMessagesReceived = false;
+
+            int clientIndex = clients[j]->GetClientIndex();
+
+            ProcessClientToServerMessages( server, clientIndex, numMessagesReceivedFromClient[clientIndex] );
+
+            if ( numMessagesReceivedFromClient[clientIndex] != NumMessagesSent )
+                allMessagesReceived = false;
+        }
+
+        if ( allMessagesReceived )
+            break;
+    }
+
+    for ( int clientIndex = 0; clientIndex < NumClients; ++clientIndex )
+    {
+        check( numMessagesReceivedFromClient[clientIndex] == NumMessagesSent );
+        check( numMessagesReceivedFromServer[clientIndex] == NumMessagesSent );
+    }
+
+    DestroyClients( NumClients, clients );
+
+    server.Stop();
+}
+
+void test_client_server_wait_for_packets()
+{
+    Address clientAddress( "0.0.0.0", 0 );
+    Address serverAddress( "127.0.0.1", ServerPort );
+
+    double time = 100.0;
+
+    ClientServerConfig config;
+
+    uint8_t privateKey[KeyBytes];
+    memset( privateKey, 0, KeyBytes );
+
+    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time, nullptr );
+
+    server.Start( 1 );
+
+    check( !server.WaitForPackets( 0.01 ) );
+
+    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time, nullptr );
+
+    uint64_t clientId = 0;
+    yojimbo_random_bytes( (uint8_t*) &clientId, 8 );
+    client.InsecureConnect( privateKey, clientId, serverAddress );
+
+    // the connection request goes out on the first client update and wakes the server
+
+    client.AdvanceTime( time );
+
+    check( server.WaitForPackets( 1.0 ) );
+
+    const double deltaTime = 0.1;
+
+    for ( int i = 0; i < 100; ++i )
+    {
+        client.SendPackets();
+        server.SendPackets();
+
+        client.ReceivePackets();
+        server.ReceivePackets();
+
+        time += deltaTime;
+
+        client.AdvanceTime( time );
+
+        server.WaitForPackets( deltaTime );
+        server.AdvanceTime( time );
+
+        if ( client.IsConnected() && server.IsClientConnected( client.GetClientIndex() ) )
+            break;
+    }
+
+    check( client.IsConnected() );
+    check( server.IsClientConnected( client.GetClientIndex() ) );
+
+    // once connected the server wakes the client with a packet of its own
+
+    server.SendPackets();
+
+    check( client.WaitForPackets( 1.0 ) );
+
+    client.Disconnect();
+
+    server.Stop();
+}
+
+void test_client_server_udp_offload()
+{
+    Address clientAddress( "0.0.0.0", 0 );
+    Address serverAddress( "127.0.0.1", ServerPort );
+
+    double time = 100.0;
+
+    // small fragments so every packet with blocks in it is split up and sent as a train
+
+    ClientServerConfig config;
+    config.serverUdpOffload = true;
+    config.fragmentPacketsAbove = 256;
+    config.packetFragmentSize = 256;
+    config.maxPacketFragments = (int) ceil( config.maxPacketSize / config.packetFragmentSize );
+    config.channel[0].messageSendQueueSize = 32;
+    config.channel[0].maxMessagesPerPacket = 8;
+    config.channel[0].maxBlockSize = 1024;
+    config.channel[0].blockFragmentSize = 1024;
+
+    uint8_t privateKey[KeyBytes];
+    memset( privateKey, 0, KeyBytes );
+
+    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time, nullptr );
+
+    const int NumClients = 4;
+
+    server.Start( NumClients );
+
+    Client * clients[NumClients];
+
+    CreateClients( NumClients, clients, clientAddress, config, adapter, time );
+
+    ConnectClients( NumClients, clients, privateKey, serverAddress );
+
+    while ( true )
+    {
+        Server * servers[] = { &server };
+
+        PumpClientServerUpdate( time, clients, NumClients, servers, 1 );
+
+        if ( AnyClientDisconnected( NumClients, clients ) )
+            break;
+
+        if ( AllClientsConnected( NumClients, server, clients ) )
+            break;
+    }
+
+    check( AllClientsConnected( NumClients, server, clients ) );
+
+    const int NumMessagesSent = config.channel[0].messageSendQueueSize;
+
+    for ( int clientIndex = 0; clientIndex < NumClients; ++clientIndex )
+    {
+        SendClientToServerMessages( *clients[clientIndex], NumMessagesSent );
+        SendServerToClientMessages( server, clientIndex, NumMessagesSent );
+    }
+
+    int numMessagesReceivedFromClient[NumClients];
+    int numMessagesReceivedFromServer[NumClients];
+
+    memset( numMessagesReceivedFromClient, 0, sizeof( numMessagesReceivedFromClient ) );
+    memset( numMessagesReceivedFromServer, 0, sizeof( numMessagesReceivedFromServer ) );
+
+    const int NumIterations = 10000;
+
+    for ( int i = 0; i < NumIterations; ++i )
+    {
+        Server * servers[] = { &server };
+
+        PumpClientServerUpdate( time, clients, NumClients, servers, 1 );
+
+        bool allMessagesReceived = true;
+
+        for ( int j = 0; j < NumClients; ++j )
+        {
+            ProcessServerToClientMessages( *clients[j], numMessagesReceivedFromServer[j] );
+
+            if ( numMessagesReceivedFromServer[j] != NumMessagesSent )
+                allMessagesReceived = false;
+
+            int clientIndex = clients[j]->GetClientIndex();
+
+            ProcessClientToServerMessages( server, clientIndex, numMessagesReceivedFromClient[clientIndex] );
+
+            if ( numMessagesReceivedFromClient[clientIndex] != NumMessagesSent )
+                allMessagesReceived = false;
+        }
+
+        if ( allMessagesReceived )
+            break;
+    }
+
+    for ( int clientIndex = 0; clientIndex < NumClients; ++clientIndex )
+    {
+        check( numMessagesReceivedFromClient[clientIndex] == NumMessagesSent );
+        check( numMessagesReceivedFromServer[clientIndex] == NumMessagesSent );
+    }
+
+    DestroyClients( NumClients, clients );
+
+    server.Stop();
+}
+
+void test_client_server_max_clients_above_default()
+{
+    const uint64_t clientId = 1;
+
+    Address clientAddress( "0.0.0.0", ClientPort );
+    Address serverAddress( "127.0.0.1", ServerPort );
+
+    double time = 100.0;
+
+    ClientServerConfig config;
+    config.serverPerClientMemory = 1024 * 1024;
+    config.channel[0].messageSendQueueSize = 32;
+    config.channel[0].maxMessagesPerPacket = 8;
+    config.channel[0].maxBlockSize = 1024;
+    config.channel[0].blockFragmentSize = 200;
+
+    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time, nullptr );
+
+    uint8_t privateKey[KeyBytes];
+    memset( privateKey, 0, KeyBytes );
+
+    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time, nullptr );
+
+    // start with more slots than netcode's default capacity of 256
+
+    const int NumClientSlots = 300;
+
+    server.Start( NumClientSlots );
+
+    check( server.IsRunning() );
+    check( server.GetMaxClients() == NumClientSlots );
+
+    client.InsecureConnect( privateKey, clientId, serverAddress );
+
+    const int NumIterations = 10000;
+
+    for ( int i = 0; i < NumIterations; ++i )
+    {
+        Client * clients[] = { &client };
+        Server * servers[] = { &server };
+
+        PumpClientServerUpdate( time, clients, 1, servers, 1 );
+
+        if ( client.ConnectionFailed() )
+            break;
+
+        if ( !client.IsConnecting() && client.IsConnected() && server.GetNumConnectedClients() == 1 )
+            break;
+    }
+
+    check( client.IsConnected() );
+    check( server.GetNumConnectedClients() == 1 );
+    check( server.IsClientConnected( client.GetClientIndex() ) );
+
+    const int NumMessagesSent = config.channel[0].messageSendQueueSize;
+
+    SendClientToServerMessages( client, NumMessagesSent );
+
+    SendServerToClientMessages( server, client.GetClientIndex(), NumMessagesSent );
+
+    int numMessagesReceivedFromClient = 0;
+    int numMessagesReceivedFromServer = 0;
+
+    for ( int i = 0; i < NumIterations; ++i )
+    {
+        if ( !client.IsConnected() )
+            break;
+
+        Client * clients[] = { &client };
+        Server * servers[] = { &server };
+
+        PumpClientServerUpdate( time, clients, 1, servers, 1 );
+
+        ProcessServerToClientMessages( client, numMessagesReceivedFromServer );
+
+        ProcessClientToServerMessages( server, client.GetClientIndex(), numMessagesReceivedFromClient );
+
+        if ( numMessagesReceivedFromClient == NumMessagesSent && numMessagesReceivedFromServer == NumMessagesSent )
+            break;
+    }
+
+    check( numMessagesReceivedFromClient == NumMessagesSent );
+    check( numMessagesReceivedFromServer == NumMessagesSent );
+
+    client.Disconnect();
+
+    server.Stop();
+}
+
 void test_client_server_message_failed_to_serialize_reliable_ordered()
 {
     const uint64_t clientId = 1;
@@ -1621,11 +1983,11 @@ void test_client_server_message_failed_to_serialize_reliable_ordered()
     uint8_t privateKey[KeyBytes];
     memset( privateKey, 0, KeyBytes );
 
-    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time );
+    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time, nullptr );
 
     server.Start( MaxClients );
 
-    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time );
+    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time, nullptr );
 
     client.InsecureConnect( privateKey, clientId, serverAddress );
 
@@ -1694,11 +2056,11 @@ void test_client_server_message_failed_to_serialize_unreliable_unordered()
     uint8_t privateKey[KeyBytes];
     memset( privateKey, 0, KeyBytes );
 
-    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time );
+    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time, nullptr );
 
     server.Start( MaxClients );
 
-    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time );
+    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time, nullptr );
 
     client.InsecureConnect( privateKey, clientId, serverAddress );
 
@@ -1768,11 +2130,11 @@ void test_client_server_message_exhaust_stream_allocator()
     uint8_t privateKey[KeyBytes];
     memset( privateKey, 0, KeyBytes );
 
-    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time );
+    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time, nullptr );
 
     server.Start( MaxClients );
 
-    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time );
+    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time, nullptr );
 
     client.InsecureConnect( privateKey, clientId, serverAddress );
 
@@ -1843,11 +2205,11 @@ void test_client_server_message_receive_queue_overflow()
     uint8_t privateKey[KeyBytes];
     memset( privateKey, 0, KeyBytes );
 
-    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time );
+    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time, nullptr );
 
     server.Start( MaxClients );
 
-    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time );
+    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time, nullptr );
 
     client.InsecureConnect( privateKey, clientId, serverAddress );
 
@@ -1910,12 +2272,12 @@ void test_reliable_outbound_sequence_outdated()
 
     const int BlockSize = config.channel[0].blockFragmentSize * 2;
 
-    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time );
+    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time, nullptr );
 
     uint8_t privateKey[KeyBytes];
     memset( privateKey, 0, KeyBytes );
 
-    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time );
+    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time, nullptr );
 
     server.Start( MaxClients );
 
@@ -2320,12 +2682,12 @@ void test_client_server_messages_network_sim_leak()
     config.networkSimulator = true;
     config.channel[0].type = CHANNEL_TYPE_UNRELIABLE_UNORDERED;
 
-    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time );
+    Client client( GetDefaultAllocator(), clientAddress, config, adapter, time, nullptr );
 
     uint8_t privateKey[KeyBytes];
     memset( privateKey, 0, KeyBytes );
 
-    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time );
+    Server server( GetDefaultAllocator(), privateKey, serverAddress, config, adapter, time, nullptr );
 
     server.Start( MaxClients );
 
@@ -2502,6 +2864,10 @@ int main()
 
         RUN_TEST( test_client_server_messages );
         RUN_TEST( test_client_server_start_stop_restart );
+        RUN_TEST( test_client_server_max_clients_above_default );
+        RUN_TEST( test_client_server_worker_threads );
+        RUN_TEST( test_client_server_udp_offload );
+        RUN_TEST( test_client_server_wait_for_packets );
         RUN_TEST( test_client_server_message_failed_to_serialize_reliable_ordered );
         RUN_TEST( test_client_server_message_failed_to_serialize_unreliable_unordered );
         RUN_TEST( test_client_server_message_exhaust_stream_allocator );